@@ -0,0 +1,65 @@
+/**
+ * @file lv_alloc.h
+ * @brief LVGL heap split between internal SRAM and PSRAM
+ *
+ * LVGL allocates through these functions (LV_MEM_CUSTOM in lv_conf.h), so
+ * this header is included from C. Small, frequently touched objects stay in
+ * internal SRAM up to a budget, everything larger goes to PSRAM.
+ */
+
+ #ifndef TDECK_LV_ALLOC_H
+ #define TDECK_LV_ALLOC_H
+ 
+ #include <stddef.h>
+ #include <stdint.h>
+ 
+ #ifdef __cplusplus
+ extern "C" {
+ #endif
+ 
+ /* Heaps LVGL allocates from */
+ typedef enum {
+     TDECK_LV_POOL_SRAM,
+     TDECK_LV_POOL_PSRAM,
+     TDECK_LV_POOL_COUNT
+ } tdeck_lv_pool_t;
+ 
+ /* LVGL usage of one pool */
+ typedef struct {
+     size_t used;            /* Bytes held by LVGL, block headers included */
+     size_t peak;            /* High-water mark of used */
+     uint32_t blocks;        /* Blocks held by LVGL */
+     uint32_t fallbacks;     /* Allocations meant for this pool served by the other */
+     size_t heapFree;        /* Free bytes of the whole heap */
+     size_t heapLargest;     /* Largest free block of the whole heap */
+ } tdeck_lv_pool_stats_t;
+ 
+ /* LVGL allocator entry points */
+ void* tdeck_lv_malloc(size_t size);
+ void tdeck_lv_free(void* ptr);
+ void* tdeck_lv_realloc(void* ptr, size_t size);
+ 
+ /**
+  * Get the usage of one pool
+  * @param pool Pool to query
+  * @param stats Receives the usage
+  */
+ void tdeck_lv_get_pool_stats(tdeck_lv_pool_t pool, tdeck_lv_pool_stats_t* stats);
+ 
+ /**
+  * Get the number of allocations neither pool could serve
+  * @return Failed allocations since boot
+  */
+ uint32_t tdeck_lv_get_failures(void);
+ 
+ /**
+  * Get the bytes LVGL could still allocate
+  * @return Remaining SRAM budget plus free PSRAM
+  */
+ size_t tdeck_lv_get_available(void);
+ 
+ #ifdef __cplusplus
+ }
+ #endif
+ 
+ #endif /* TDECK_LV_ALLOC_H */
\ No newline at end of file
@@ -11,6 +11,9 @@
  /* Color depth: 1 (1 byte per pixel), 8 (RGB332), 16 (RGB565), 32 (ARGB8888) */
  #define LV_COLOR_DEPTH 16
  
+ /* 32-bit coordinates, the virtual file list places rows far past the 16-bit limit of 8191 px */
+ #define LV_USE_LARGE_COORD 1
+ 
  /* Use a custom tick source for LVGL */
  #define LV_TICK_CUSTOM 1
  #if LV_TICK_CUSTOM
@@ -21,17 +24,18 @@
  /* Default display refresh period - 5ms */
  #define LV_DISP_DEF_REFR_PERIOD 5
  
- /* Memory settings */
- #define LV_MEM_CUSTOM 0
+ /* Memory settings, small objects in internal SRAM and the rest in PSRAM (include/lv_alloc.h) */
+ #define LV_MEM_CUSTOM 1
  #if LV_MEM_CUSTOM == 0
      #define LV_MEM_SIZE (128U * 1024U)
      #define LV_MEM_ATTR
      #define LV_MEM_ADR 0
      #define LV_MEM_AUTO_DEFRAG 1
  #else
-     #define LV_MEM_CUSTOM_INCLUDE "stdlib.h"
-     #define LV_MEM_CUSTOM_ALLOC malloc
-     #define LV_MEM_CUSTOM_FREE free
+     #define LV_MEM_CUSTOM_INCLUDE "lv_alloc.h"
+     #define LV_MEM_CUSTOM_ALLOC tdeck_lv_malloc
+     #define LV_MEM_CUSTOM_FREE tdeck_lv_free
+     #define LV_MEM_CUSTOM_REALLOC tdeck_lv_realloc
  #endif
  
  /* Use the standard `memcpy` and `memset` for memory operations */
@@ -57,16 +61,16 @@
  #define LV_USE_THEME_BASIC 0
  #define LV_USE_THEME_MONO 0
  
- /* Font usage */
+ /* Font usage, sizes other than the default 14 come from the asset partition (tools/pack_assets.py) */
  #define LV_FONT_MONTSERRAT_8  0
  #define LV_FONT_MONTSERRAT_10 0
- #define LV_FONT_MONTSERRAT_12 1
+ #define LV_FONT_MONTSERRAT_12 0
  #define LV_FONT_MONTSERRAT_14 1
- #define LV_FONT_MONTSERRAT_16 1
- #define LV_FONT_MONTSERRAT_18 1
- #define LV_FONT_MONTSERRAT_20 1
+ #define LV_FONT_MONTSERRAT_16 0
+ #define LV_FONT_MONTSERRAT_18 0
+ #define LV_FONT_MONTSERRAT_20 0
  #define LV_FONT_MONTSERRAT_22 0
- #define LV_FONT_MONTSERRAT_24 1
+ #define LV_FONT_MONTSERRAT_24 0
  #define LV_FONT_MONTSERRAT_26 0
  #define LV_FONT_MONTSERRAT_28 0
  #define LV_FONT_MONTSERRAT_30 0
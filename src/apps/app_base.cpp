@@ -0,0 +1,74 @@
+/**
+ * @file app_base.cpp
+ * @brief Implementation of the application lifecycle
+ */
+
+ #include "app_base.h"
+ 
+ // Constructor
+ AppBase::AppBase(const char* name)
+     : _name(name)
+     , _state(APP_STATE_DESTROYED)
+ {
+ }
+ 
+ // Get the application name
+ const char* AppBase::getName() const {
+     return _name;
+ }
+ 
+ // Get the lifecycle state
+ AppState AppBase::getState() const {
+     return _state;
+ }
+ 
+ // Build the app's screen, hidden
+ bool AppBase::create(lv_obj_t* parent) {
+     if (_state != APP_STATE_DESTROYED) {
+         return true;
+     }
+ 
+     if (!onCreate(parent)) {
+         TDECK_LOG_E("Failed to create app: %s", _name);
+         return false;
+     }
+ 
+     _state = APP_STATE_PAUSED;
+     return true;
+ }
+ 
+ // Bring the app to the foreground
+ bool AppBase::resume(lv_obj_t* parent) {
+     if (_state == APP_STATE_RESUMED) {
+         return true;
+     }
+ 
+     if (!create(parent)) {
+         return false;
+     }
+ 
+     onResume();
+     _state = APP_STATE_RESUMED;
+     return true;
+ }
+ 
+ // Hide the app, keeping its screen
+ void AppBase::pause() {
+     if (_state != APP_STATE_RESUMED) {
+         return;
+     }
+ 
+     onPause();
+     _state = APP_STATE_PAUSED;
+ }
+ 
+ // Pause the app and delete its LVGL objects
+ void AppBase::destroy() {
+     if (_state == APP_STATE_DESTROYED) {
+         return;
+     }
+ 
+     pause();
+     onDestroy();
+     _state = APP_STATE_DESTROYED;
+ }
\ No newline at end of file
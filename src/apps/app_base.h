@@ -0,0 +1,111 @@
+/**
+ * @file app_base.h
+ * @brief Lifecycle shared by the applications shown through the UI manager
+ *
+ * An application is created when it is first shown, paused when another one
+ * takes the foreground and destroyed once it falls out of the UI manager's
+ * set of warm apps. Destroying deletes the app's LVGL objects only, plain
+ * members survive, so apps keep what they need to rebuild their screen there.
+ */
+
+ #ifndef TDECK_APP_BASE_H
+ #define TDECK_APP_BASE_H
+ 
+ #include <Arduino.h>
+ #include <lvgl.h>
+ #include "../config.h"
+ 
+ /**
+  * @brief Lifecycle state of an application
+  */
+ typedef enum {
+     APP_STATE_DESTROYED,    // No LVGL objects
+     APP_STATE_PAUSED,       // Screen built but hidden
+     APP_STATE_RESUMED       // In the foreground
+ } AppState;
+ 
+ /**
+  * @class AppBase
+  * @brief Base class of the applications, driven by UIManager
+  *
+  * Subclasses implement the on*() hooks, UIManager calls the public
+  * transitions, which skip calls that would not change the state.
+  */
+ class AppBase {
+ public:
+     /**
+      * @brief Constructor
+      * @param name Application name, must outlive the app
+      */
+     AppBase(const char* name);
+ 
+     /**
+      * @brief Destructor
+      */
+     virtual ~AppBase() {}
+ 
+     /**
+      * @brief Get the application name
+      * @return Name given to the constructor
+      */
+     const char* getName() const;
+ 
+     /**
+      * @brief Get the lifecycle state
+      * @return Current state
+      */
+     AppState getState() const;
+ 
+     /**
+      * @brief Build the app's screen, hidden
+      * @param parent Parent LVGL container
+      * @return true if the app is now paused, false if it stayed destroyed
+      */
+     bool create(lv_obj_t* parent);
+ 
+     /**
+      * @brief Bring the app to the foreground, creating it first if needed
+      * @param parent Parent LVGL container used if the app must be created
+      * @return true if the app is now resumed
+      */
+     bool resume(lv_obj_t* parent);
+ 
+     /**
+      * @brief Hide the app, keeping its screen
+      */
+     void pause();
+ 
+     /**
+      * @brief Pause the app and delete its LVGL objects
+      */
+     void destroy();
+ 
+ protected:
+     /**
+      * @brief Build the LVGL objects and restore the state kept by onDestroy()
+      * @param parent Parent LVGL container
+      * @return true if successful, false otherwise
+      */
+     virtual bool onCreate(lv_obj_t* parent) = 0;
+ 
+     /**
+      * @brief Show the screen and start its timers
+      */
+     virtual void onResume() = 0;
+ 
+     /**
+      * @brief Hide the screen and stop its timers
+      */
+     virtual void onPause() = 0;
+ 
+     /**
+      * @brief Keep the state needed to rebuild the screen, then delete it
+      */
+     virtual void onDestroy() = 0;
+ 
+ private:
+     const char* _name;      // Application name
+     AppState _state;        // Lifecycle state
+ };
+ 
+ #endif // TDECK_APP_BASE_H
\ No newline at end of file
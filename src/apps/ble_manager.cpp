@@ -5,11 +5,25 @@
 
  #include "apps/ble_manager.h"
  #include "system/fs_manager.h"
+ #include "system/config_storage.h"
  #include <ArduinoJson.h>
  
  // External reference to the file system manager
  extern FSManager fsManager;
  
+ // Bluetooth manager, scan batches come from its update() on the system task
+ extern BluetoothManager btManager;
+ 
+ // Scan batch handed from the system task to the UI task
+ struct BLEScanBatch {
+     BLEManagerApp* app;
+     std::vector<BluetoothDevice> devices;
+     bool complete;
+ };
+ 
+ BLEManagerApp::BLEManagerApp() : AppBase("Bluetooth"), _btManager(btManager) {
+ }
+ 
  bool BLEManagerApp::init(lv_obj_t* parent) {
      if (parent == nullptr) {
          TDECK_LOG_E("BLEManagerApp: Invalid parent container");
@@ -21,6 +35,14 @@
      // Load saved BLE settings
      loadSettings();
      
+     // Batches are merged on the UI task, at most one per TDECK_BLE_SCAN_BATCH_MS
+     _btManager.setScanCallback([this](const std::vector<BluetoothDevice>& devices, bool complete) {
+         BLEScanBatch* batch = new BLEScanBatch{this, devices, complete};
+         if (!uiManager.postWork(onScanBatch, batch, pdMS_TO_TICKS(TDECK_BLE_SCAN_BATCH_MS))) {
+             delete batch;
+         }
+     });
+     
      TDECK_LOG_I("BLEManagerApp: Initialized");
      return true;
  }
@@ -31,13 +53,13 @@
          return true;
      }
      
-     if (_parentContainer == nullptr) {
-         TDECK_LOG_E("BLEManagerApp: Not initialized");
+     if (_appContainer == nullptr) {
+         TDECK_LOG_E("BLEManagerApp: UI not created");
          return false;
      }
      
-     // Create the UI
-     createUI();
+     // Show the UI
+     lv_obj_set_hidden(_appContainer, false);
      
      // Create a task for periodic status updates
      lv_task_create(onStatusUpdateTimer, 1000, LV_TASK_PRIO_LOW, this);
@@ -57,11 +79,8 @@
          stopScan();
      }
      
-     // Delete UI elements
-     if (_appContainer != nullptr) {
-         lv_obj_del(_appContainer);
-         _appContainer = nullptr;
-     }
+     // Hide the UI, it is deleted once the app is destroyed
+     lv_obj_set_hidden(_appContainer, true);
      
      // Delete task
      lv_task_t* task = lv_task_get_next(NULL);
@@ -77,6 +96,49 @@
      TDECK_LOG_I("BLEManagerApp: Stopped");
  }
  
+ bool BLEManagerApp::onCreate(lv_obj_t* parent) {
+     if (!init(parent)) {
+         return false;
+     }
+     
+     createUI();
+     lv_obj_set_hidden(_appContainer, true);
+     
+     // Show the devices found before the UI was last destroyed
+     if (!_deviceList_data.empty()) {
+         updateDeviceList();
+     }
+     
+     return true;
+ }
+ 
+ void BLEManagerApp::onResume() {
+     start();
+ }
+ 
+ void BLEManagerApp::onPause() {
+     stop();
+ }
+ 
+ void BLEManagerApp::onDestroy() {
+     // The devices found so far stay in their vector
+     lv_obj_del(_appContainer);
+     _appContainer = nullptr;
+     _tabView = nullptr;
+     _devicesTab = nullptr;
+     _statusTab = nullptr;
+     _settingsTab = nullptr;
+     _deviceList = nullptr;
+     _scanBtn = nullptr;
+     _stopScanBtn = nullptr;
+     _messageLabel = nullptr;
+     _btEnableSwitch = nullptr;
+     _btVisibilitySwitch = nullptr;
+     _btNameTextArea = nullptr;
+     _saveSettingsBtn = nullptr;
+     _keyboard = nullptr;
+ }
+ 
  bool BLEManagerApp::isRunning() const {
      return _isRunning;
  }
@@ -229,7 +291,7 @@
      doc["autoEnable"] = lv_switch_get_state(_btEnableSwitch);
      doc["discoverable"] = lv_switch_get_state(_btVisibilitySwitch);
      
-     if (fsManager.saveJsonToFile(TDECK_FS_BT_CONFIG_FILE, doc)) {
+     if (configStorage.write(TDECK_FS_BT_CONFIG_FILE, doc)) {
          lv_label_set_text(_messageLabel, "Settings saved");
          updateBLEStatus();
      } else {
@@ -241,7 +303,7 @@
      // Load settings from configuration file
      DynamicJsonDocument doc(512);
      
-     if (fsManager.loadJsonFromFile(TDECK_FS_BT_CONFIG_FILE, doc)) {
+     if (configStorage.read(TDECK_FS_BT_CONFIG_FILE, doc)) {
          String deviceName = doc["deviceName"] | TDECK_BT_DEVICE_NAME;
          bool autoEnable = doc["autoEnable"] | true;
          bool discoverable = doc["discoverable"] | false;
@@ -428,67 +490,82 @@
          return;
      }
      
-     if (!_btManager.isEnabled()) {
+     if (!_btManager.getConfig().bleEnabled) {
          lv_label_set_text(_messageLabel, "Bluetooth is disabled. Enable in Settings tab.");
          return;
      }
      
+     // Clear previous results, the scan table starts empty too
+     lv_list_clean(_deviceList);
+     _deviceList_data.clear();
+     
+     if (!_btManager.startScan()) {
+         lv_label_set_text(_messageLabel, "Scan not started, try again shortly.");
+         return;
+     }
+     
      _isScanning = true;
      lv_label_set_text(_messageLabel, "Scanning for devices...");
+ }
+ 
+ void BLEManagerApp::stopScan() {
+     if (!_isScanning) {
+         return;
+     }
      
-     // Clear previous results
-     lv_list_clean(_deviceList);
-     _deviceList_data.clear();
+     _btManager.stopScan();
+     _isScanning = false;
+     lv_label_set_text(_messageLabel, "Scan stopped.");
+ }
+ 
+ void BLEManagerApp::onScanBatch(void* arg) {
+     BLEScanBatch* batch = (BLEScanBatch*)arg;
+     batch->app->mergeScanBatch(batch->devices, batch->complete);
+     delete batch;
+ }
+ 
+ void BLEManagerApp::mergeScanBatch(const std::vector<BluetoothDevice>& devices, bool complete) {
+     // A batch still in flight when the scan was stopped is dropped
+     if (!_isScanning) {
+         return;
+     }
      
-     // Start scan
-     _btManager.startScan([this](BLEDevice* device, int rssi, bool isComplete) {
-         if (device) {
-             // Check if device already in the list
-             bool found = false;
-             for (auto& dev : _deviceList_data) {
-                 if (dev.address == device->getAddress().toString()) {
-                     // Update RSSI
-                     dev.rssi = rssi;
-                     found = true;
-                     break;
-                 }
-             }
-             
-             if (!found) {
-                 // Add new device
-                 BLEDeviceInfo info;
-                 info.address = device->getAddress().toString();
-                 info.name = device->getName().length() > 0 ? device->getName() : "Unknown";
-                 info.rssi = rssi;
-                 info.isPaired = _btManager.isPaired(device);
-                 info.isConnected = _btManager.isConnected(device);
-                 
-                 _deviceList_data.push_back(info);
-                 
-                 // Update the list
-                 updateDeviceList();
+     for (const BluetoothDevice& device : devices) {
+         BLEDeviceInfo* info = nullptr;
+         for (auto& dev : _deviceList_data) {
+             if (dev.address == device.address) {
+                 info = &dev;
+                 break;
              }
          }
+         if (!info) {
+             _deviceList_data.push_back(BLEDeviceInfo());
+             info = &_deviceList_data.back();
+             info->address = device.address;
+         }
          
-         if (isComplete) {
-             _isScanning = false;
+         // A name may only arrive with a later scan response
+         info->name = device.name.length() > 0 ? device.name : "Unknown";
+         info->rssi = device.rssi;
+         info->isPaired = device.paired;
+         info->isConnected = device.connected;
+     }
+     
+     // One rebuild per batch rather than per advertisement
+     if (_deviceList && !devices.empty()) {
+         updateDeviceList();
+     }
+     
+     if (complete) {
+         _isScanning = false;
+         if (_messageLabel) {
              if (_deviceList_data.empty()) {
                  lv_label_set_text(_messageLabel, "No devices found.");
              } else {
                  lv_label_set_text(_messageLabel, String(String(_deviceList_data.size()) + " devices found").c_str());
              }
          }
-     });
- }
- 
- void BLEManagerApp::stopScan() {
-     if (!_isScanning) {
-         return;
      }
-     
-     _btManager.stopScan();
-     _isScanning = false;
-     lv_label_set_text(_messageLabel, "Scan stopped.");
  }
  
  void BLEManagerApp::updateDeviceList() {
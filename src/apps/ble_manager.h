@@ -15,6 +15,7 @@
  #include "config.h"
  #include "comms/bluetooth.h"
  #include "ui/ui_manager.h"
+ #include "apps/app_base.h"
  
  /**
   * @struct BLEDeviceInfo
@@ -32,8 +33,13 @@
   * @class BLEManagerApp
   * @brief Application for managing Bluetooth connections
   */
- class BLEManagerApp {
+ class BLEManagerApp : public AppBase {
  public:
+     /**
+      * @brief Constructor
+      */
+     BLEManagerApp();
+ 
      /**
       * @brief Initialize the BLE Manager application
       * @param parent Parent container for the application UI
@@ -58,6 +64,13 @@
       */
      bool isRunning() const;
  
+ protected:
+     // AppBase lifecycle
+     bool onCreate(lv_obj_t* parent) override;
+     void onResume() override;
+     void onPause() override;
+     void onDestroy() override;
+ 
  private:
      // UI Objects
      lv_obj_t* _parentContainer = nullptr;  ///< Parent container
@@ -84,7 +97,7 @@
      std::vector<BLEDeviceInfo> _deviceList_data; ///< List of discovered devices
      
      // Bluetooth Manager reference
-     BluetoothManager& _btManager = BluetoothManager::getInstance();
+     BluetoothManager& _btManager;
      
      /**
       * @brief Create the UI components for the application
@@ -106,6 +119,13 @@
       */
      void updateDeviceList();
      
+     /**
+      * @brief Merge a batch of changed scan results into the device list
+      * @param devices Devices added or changed since the previous batch
+      * @param complete Whether the scan has ended
+      */
+     void mergeScanBatch(const std::vector<BluetoothDevice>& devices, bool complete);
+     
      /**
       * @brief Update the BLE status display
       */
@@ -165,6 +185,7 @@
      static void onSaveSettingsBtnClicked(lv_obj_t* obj, lv_event_t event);
      static void onKeyboardEvent(lv_obj_t* obj, lv_event_t event);
      static void onStatusUpdateTimer(lv_task_t* task);
+     static void onScanBatch(void* arg);
      static void onDeviceContextMenu(lv_obj_t* obj, lv_event_t event);
  };
  
@@ -11,6 +11,7 @@
  #include "../hal/sdcard.h"
  #include "../system/fs_manager.h"
  #include "../ui/ui_manager.h"
+ #include "image_viewer.h"
  
  #include <lvgl.h>
  #include <Arduino.h>
@@ -18,9 +19,31 @@
  #include <string>
  #include <algorithm>
  
+ // Virtual file list layout
+ #define FILE_LIST_ROW_HEIGHT 32  // Height of one file row in pixels
+ #define FILE_LIST_HEIGHT (TDECK_DISPLAY_HEIGHT - TDECK_STATUS_BAR_HEIGHT - 40 - 30)
+ #define FILE_LIST_ROW_MARGIN 2   // Spare rows kept bound above and below the view
+ #define FILE_LIST_POOL_SIZE (FILE_LIST_HEIGHT / FILE_LIST_ROW_HEIGHT + 1 + 2 * FILE_LIST_ROW_MARGIN)
+ 
+ // Row i sits at i * FILE_LIST_ROW_HEIGHT, 16-bit coordinates run out at 256 entries
+ static_assert(sizeof(lv_coord_t) >= 4, "The file list needs LV_USE_LARGE_COORD in lv_conf.h");
+ 
+ /**
+  * @brief Recycled file list row, rebound to an entry of file_entries while scrolling
+  */
+ typedef struct {
+     lv_obj_t *btn;         ///< Row button
+     lv_obj_t *icon;        ///< File type icon
+     lv_obj_t *name_label;  ///< File name
+     lv_obj_t *size_label;  ///< File size or <DIR>
+     int32_t index;         ///< Bound index in file_entries, -1 if unbound
+ } FileListRow;
+ 
  // Private variables
  static lv_obj_t *file_browser_screen = NULL;
  static lv_obj_t *file_list = NULL;
+ static lv_obj_t *file_list_spacer = NULL;
+ static FileListRow file_rows[FILE_LIST_POOL_SIZE];
  static lv_obj_t *path_label = NULL;
  static lv_obj_t *no_files_label = NULL;
  static lv_obj_t *status_bar = NULL;
@@ -35,8 +58,23 @@
  static bool is_selecting_mode = false;
  static FileSelectionCallback selection_callback = NULL;
  
+ // Directory listing in progress
+ static FSListHandle list_handle = 0;
+ static bool list_loading = false;
+ 
+ /**
+  * @brief Batch of directory entries handed from the FS worker to the UI task
+  */
+ struct FileListBatch {
+     FSListHandle handle;               ///< Listing the batch belongs to
+     std::vector<FSFileInfo> entries;   ///< New entries
+     bool done;                         ///< Last batch of the listing
+     bool ok;                           ///< Directory could be read
+ };
+ 
  // Forward declarations of event handlers
  static void file_item_event_cb(lv_event_t *e);
+ static void file_list_scroll_event_cb(lv_event_t *e);
  static void back_btn_event_cb(lv_event_t *e);
  static void nav_up_btn_event_cb(lv_event_t *e);
  static void menu_btn_event_cb(lv_event_t *e);
@@ -50,6 +88,9 @@
  // Helper functions
  static void load_directory(const std::string &path);
  static void refresh_file_list();
+ static void rebind_file_list();
+ static void apply_file_list_batch(void *arg);
+ static bool compare_file_entries(const FSFileInfo &a, const FSFileInfo &b);
  static void update_path_label();
  static std::string get_file_extension(const std::string &filename);
  static std::string get_file_size_str(size_t size);
@@ -60,7 +101,9 @@
  static void show_new_folder_dialog();
  static bool is_image_file(const std::string &filename);
  static bool is_text_file(const std::string &filename);
- static lv_obj_t* create_file_list_item(const FSFileInfo &file_info);
+ static void create_file_list_row(FileListRow &row);
+ static void bind_file_list_row(FileListRow &row, int32_t index);
+ static void update_visible_rows();
  static void handle_file_open(const std::string &path, const std::string &filename);
  
  /**
@@ -127,11 +170,24 @@
      lv_label_set_text(menu_label, "Menu");
      lv_obj_center(menu_label);
      
-     // Create file list container
-     file_list = lv_list_create(file_browser_screen);
-     lv_obj_set_size(file_list, TDECK_DISPLAY_WIDTH - 10, 
-                    TDECK_DISPLAY_HEIGHT - TDECK_STATUS_BAR_HEIGHT - 40 - 30);
+     // Create file list container, rows are positioned by hand so only
+     // a fixed pool of them ever exists whatever the directory size
+     file_list = lv_obj_create(file_browser_screen);
+     lv_obj_set_size(file_list, TDECK_DISPLAY_WIDTH - 10, FILE_LIST_HEIGHT);
      lv_obj_align(file_list, LV_ALIGN_TOP_MID, 0, TDECK_STATUS_BAR_HEIGHT + 30);
+     lv_obj_set_style_pad_all(file_list, 0, 0);
+     lv_obj_set_scroll_dir(file_list, LV_DIR_VER);
+     lv_obj_add_event_cb(file_list, file_list_scroll_event_cb, LV_EVENT_SCROLL, NULL);
+     
+     // Invisible spacer at the bottom gives the list its full scroll height
+     file_list_spacer = lv_obj_create(file_list);
+     lv_obj_remove_style_all(file_list_spacer);
+     lv_obj_set_size(file_list_spacer, 1, 1);
+     lv_obj_clear_flag(file_list_spacer, LV_OBJ_FLAG_CLICKABLE);
+     
+     for (int i = 0; i < FILE_LIST_POOL_SIZE; i++) {
+         create_file_list_row(file_rows[i]);
+     }
      
      // Create "No files" label (hidden by default)
      no_files_label = lv_label_create(file_browser_screen);
@@ -184,6 +240,11 @@
   * @brief Close the file browser
   */
  void FileBrowser::close() {
+     // Stop reading a directory nobody will look at
+     FSManager::cancel_list(list_handle);
+     list_handle = 0;
+     list_loading = false;
+     
      // If we're in selection mode, call callback with empty string to indicate cancellation
      if (is_selecting_mode && selection_callback) {
          selection_callback("", "");
@@ -229,49 +290,167 @@
  static void load_directory(const std::string &path) {
      TDECK_LOG_I("Loading directory: %s", path.c_str());
      
+     // Drop the listing of the directory we are leaving
+     FSManager::cancel_list(list_handle);
+     
      // Clear previous file entries
      file_entries.clear();
      
-     // Get file list from file system manager
-     if (!FSManager::list_directory(path, file_entries)) {
-         TDECK_LOG_E("Failed to list directory: %s", path.c_str());
+     // The card belongs to the USB host until it is ejected
+     if (FSManager::is_sd_lent() && path.compare(0, 3, "/sd") == 0) {
+         list_handle = 0;
+         list_loading = false;
+         refresh_file_list();
+         lv_label_set_text(path_label, "SD card in use as a USB drive");
+         return;
      }
      
-     // Sort entries: directories first, then files alphabetically
-     std::sort(file_entries.begin(), file_entries.end(), 
-               [](const FSFileInfo &a, const FSFileInfo &b) {
-                   if (a.is_directory && !b.is_directory) return true;
-                   if (!a.is_directory && b.is_directory) return false;
-                   return a.name < b.name;
-               });
+     list_loading = true;
+     
+     // Read entries on the FS worker, batches are merged in on the UI task
+     list_handle = FSManager::list_directory_async(path,
+         [](FSListHandle handle, const std::vector<FSFileInfo> &batch, bool done, bool ok) {
+             // Hold the worker until the UI task has room, a dropped batch loses
+             // entries and a dropped final batch leaves the list loading forever.
+             // The worker holds no bus here, so the UI task can still flush.
+             FileListBatch *list_batch = new FileListBatch{handle, batch, done, ok};
+             if (!uiManager.postWork(apply_file_list_batch, list_batch, portMAX_DELAY)) {
+                 delete list_batch;
+             }
+         });
+     
+     // Fall back to a blocking listing if the worker is unavailable
+     if (list_handle == 0) {
+         if (!FSManager::list_directory(path, file_entries)) {
+             TDECK_LOG_E("Failed to list directory: %s", path.c_str());
+         }
+         std::sort(file_entries.begin(), file_entries.end(), compare_file_entries);
+         list_loading = false;
+     }
      
      // Update UI
      refresh_file_list();
      update_path_label();
  }
  
+ /**
+  * @brief Merge a batch of directory entries into the sorted list
+  * 
+  * Runs on the UI task through UIManager::postWork.
+  * 
+  * @param arg FileListBatch, owned by this function
+  */
+ static void apply_file_list_batch(void *arg) {
+     FileListBatch *batch = (FileListBatch*)arg;
+     
+     // Ignore batches of a listing that was superseded
+     if (batch->handle != list_handle) {
+         delete batch;
+         return;
+     }
+     
+     if (!batch->ok) {
+         TDECK_LOG_E("Failed to list directory: %s", current_path.c_str());
+     }
+     
+     // Sort the batch and merge it, the existing entries are already sorted
+     std::sort(batch->entries.begin(), batch->entries.end(), compare_file_entries);
+     size_t middle = file_entries.size();
+     file_entries.insert(file_entries.end(), batch->entries.begin(), batch->entries.end());
+     std::inplace_merge(file_entries.begin(), file_entries.begin() + middle, file_entries.end(),
+                        compare_file_entries);
+     
+     if (batch->done) {
+         list_loading = false;
+         list_handle = 0;
+     }
+     
+     // Keep the scroll position, only the pooled rows are rebound
+     rebind_file_list();
+     delete batch;
+ }
+ 
+ /**
+  * @brief Sort order of the file list: directories first, then files alphabetically
+  * 
+  * @param a First entry
+  * @param b Second entry
+  * @return true if a sorts before b
+  */
+ static bool compare_file_entries(const FSFileInfo &a, const FSFileInfo &b) {
+     if (a.is_directory && !b.is_directory) return true;
+     if (!a.is_directory && b.is_directory) return false;
+     return a.name < b.name;
+ }
+ 
  /**
   * @brief Refresh the file list UI with current entries
   */
  static void refresh_file_list() {
-     // Clear the list
-     lv_obj_clean(file_list);
-     
+     lv_obj_scroll_to_y(file_list, 0, LV_ANIM_OFF);
+     rebind_file_list();
+ }
+ 
+ /**
+  * @brief Resize the file list and rebind its rows without moving the scroll position
+  */
+ static void rebind_file_list() {
      // Show "No files" label if directory is empty
      if (file_entries.empty()) {
+         lv_label_set_text_static(no_files_label, list_loading ? "Loading..." : "No files in this directory");
          lv_obj_clear_flag(no_files_label, LV_OBJ_FLAG_HIDDEN);
      } else {
          lv_obj_add_flag(no_files_label, LV_OBJ_FLAG_HIDDEN);
+     }
+     
+     // Size the scroll area for every entry without creating their rows
+     lv_coord_t content_height = (lv_coord_t)(file_entries.size() * FILE_LIST_ROW_HEIGHT);
+     lv_obj_set_pos(file_list_spacer, 0, content_height > 0 ? content_height - 1 : 0);
+     
+     // Force every pooled row to rebind
+     for (int i = 0; i < FILE_LIST_POOL_SIZE; i++) {
+         file_rows[i].index = -1;
+     }
+     
+     update_visible_rows();
+ }
+ 
+ /**
+  * @brief Bind pooled rows to the entries around the scroll position
+  * 
+  * Entry i always lives in slot i % FILE_LIST_POOL_SIZE, so scrolling only
+  * rebinds the rows that moved out of view.
+  */
+ static void update_visible_rows() {
+     int32_t count = (int32_t)file_entries.size();
+     int32_t first = lv_obj_get_scroll_y(file_list) / FILE_LIST_ROW_HEIGHT - FILE_LIST_ROW_MARGIN;
+     if (first < 0) {
+         first = 0;
+     }
+     
+     for (int32_t i = first; i < first + FILE_LIST_POOL_SIZE; i++) {
+         FileListRow &row = file_rows[i % FILE_LIST_POOL_SIZE];
          
-         // Add each file/directory to the list
-         for (const auto &entry : file_entries) {
-             lv_obj_t *item = create_file_list_item(entry);
-             lv_obj_add_event_cb(item, file_item_event_cb, LV_EVENT_CLICKED, 
-                               (void*)&entry);
+         if (i >= count) {
+             if (row.index != -1 || !lv_obj_has_flag(row.btn, LV_OBJ_FLAG_HIDDEN)) {
+                 row.index = -1;
+                 lv_obj_add_flag(row.btn, LV_OBJ_FLAG_HIDDEN);
+             }
+         } else if (row.index != i) {
+             bind_file_list_row(row, i);
          }
      }
  }
  
+ /**
+  * @brief File list scroll event handler
+  * 
+  * @param e LVGL event
+  */
+ static void file_list_scroll_event_cb(lv_event_t *e) {
+     update_visible_rows();
+ }
+ 
  /**
   * @brief Update the path label with current path
   */
@@ -281,56 +460,64 @@
  }
  
  /**
-  * @brief Create a list item for file browser
+  * @brief Create a pooled row for the file list
   * 
-  * @param file_info File information structure
-  * @return lv_obj_t* Created list item
+  * @param row Row to create, starts hidden and unbound
   */
- static lv_obj_t* create_file_list_item(const FSFileInfo &file_info) {
-     // Create list button
-     lv_obj_t *btn = lv_list_add_btn(file_list, NULL, file_info.name.c_str());
-     lv_obj_set_style_bg_opa(btn, LV_OPA_TRANSP, 0);
+ static void create_file_list_row(FileListRow &row) {
+     // Create row button
+     row.btn = lv_btn_create(file_list);
+     lv_obj_set_size(row.btn, lv_pct(100), FILE_LIST_ROW_HEIGHT);
+     lv_obj_set_style_bg_opa(row.btn, LV_OPA_TRANSP, 0);
+     lv_obj_set_style_radius(row.btn, 0, 0);
+     lv_obj_add_flag(row.btn, LV_OBJ_FLAG_HIDDEN);
+     lv_obj_add_event_cb(row.btn, file_item_event_cb, LV_EVENT_CLICKED, &row);
+     
+     // Add icon, file name and size labels
+     row.icon = lv_img_create(row.btn);
+     lv_obj_align(row.icon, LV_ALIGN_LEFT_MID, 5, 0);
+     
+     row.name_label = lv_label_create(row.btn);
+     lv_label_set_long_mode(row.name_label, LV_LABEL_LONG_DOT);
+     lv_obj_set_width(row.name_label, TDECK_DISPLAY_WIDTH - 130);
+     lv_obj_align(row.name_label, LV_ALIGN_LEFT_MID, 30, 0);
      
-     // Add icon based on file type
-     lv_obj_t *icon = lv_img_create(btn);
+     row.size_label = lv_label_create(row.btn);
+     lv_obj_align(row.size_label, LV_ALIGN_RIGHT_MID, -10, 0);
+     
+     row.index = -1;
+ }
+ 
+ /**
+  * @brief Rebind a pooled row to a file entry
+  * 
+  * @param row Row to rebind
+  * @param index Index in file_entries
+  */
+ static void bind_file_list_row(FileListRow &row, int32_t index) {
+     const FSFileInfo &file_info = file_entries[index];
+     row.index = index;
+     
+     lv_obj_set_y(row.btn, index * FILE_LIST_ROW_HEIGHT);
+     lv_obj_clear_flag(row.btn, LV_OBJ_FLAG_HIDDEN);
      
      // Set icon based on file type
      if (file_info.is_directory) {
-         // Use folder icon
-         lv_img_set_src(icon, LV_SYMBOL_DIRECTORY);
+         lv_img_set_src(row.icon, LV_SYMBOL_DIRECTORY);
+     } else if (is_image_file(file_info.name)) {
+         lv_img_set_src(row.icon, LV_SYMBOL_IMAGE);
      } else {
-         // Determine icon based on file extension
-         std::string ext = get_file_extension(file_info.name);
-         
-         if (is_image_file(file_info.name)) {
-             lv_img_set_src(icon, LV_SYMBOL_IMAGE);
-         } else if (is_text_file(file_info.name)) {
-             lv_img_set_src(icon, LV_SYMBOL_FILE);
-         } else {
-             lv_img_set_src(icon, LV_SYMBOL_FILE);
-         }
+         lv_img_set_src(row.icon, LV_SYMBOL_FILE);
      }
      
-     lv_obj_align(icon, LV_ALIGN_LEFT_MID, 5, 0);
-     
-     // Add file name label
-     lv_obj_t *name_label = lv_label_create(btn);
-     lv_label_set_text(name_label, file_info.name.c_str());
-     lv_obj_align(name_label, LV_ALIGN_LEFT_MID, 30, 0);
+     lv_label_set_text(row.name_label, file_info.name.c_str());
      
-     // Add file size or <DIR> indicator
-     lv_obj_t *size_label = lv_label_create(btn);
+     // File size or <DIR> indicator
      if (file_info.is_directory) {
-         lv_label_set_text(size_label, "<DIR>");
+         lv_label_set_text_static(row.size_label, "<DIR>");
      } else {
-         lv_label_set_text(size_label, get_file_size_str(file_info.size).c_str());
+         lv_label_set_text(row.size_label, get_file_size_str(file_info.size).c_str());
      }
-     lv_obj_align(size_label, LV_ALIGN_RIGHT_MID, -10, 0);
-     
-     // Store file info pointer in user data
-     lv_obj_set_user_data(btn, (void*)&file_info);
-     
-     return btn;
  }
  
  /**
@@ -405,12 +592,15 @@
   * @param e LVGL event
   */
  static void file_item_event_cb(lv_event_t *e) {
-     lv_obj_t *target = lv_event_get_target(e);
+     FileListRow *row = (FileListRow*)lv_event_get_user_data(e);
      lv_event_code_t code = lv_event_get_code(e);
      
      if (code == LV_EVENT_CLICKED) {
-         FSFileInfo *file_info = (FSFileInfo*)lv_obj_get_user_data(target);
-         if (!file_info) return;
+         if (!row || row->index < 0 || row->index >= (int32_t)file_entries.size()) return;
+         
+         // Copy the entry, loading a directory replaces file_entries
+         FSFileInfo entry = file_entries[row->index];
+         FSFileInfo *file_info = &entry;
          
          if (file_info->is_directory) {
              // Navigate into directory
@@ -449,9 +639,25 @@
      std::string ext = get_file_extension(filename);
      
      if (is_image_file(filename)) {
-         // Open image viewer
          TDECK_LOG_I("Opening image: %s", full_path.c_str());
-         // TODO: Implement image viewer or call appropriate handler
+         
+         if (ImageViewer::is_supported(filename)) {
+             // Viewer steps through the images of this directory in list order
+             std::vector<std::string> images;
+             size_t index = 0;
+             for (const FSFileInfo &entry : file_entries) {
+                 if (!entry.is_directory && ImageViewer::is_supported(entry.name)) {
+                     if (entry.name == filename) {
+                         index = images.size();
+                     }
+                     images.push_back(entry.name);
+                 }
+             }
+             
+             ImageViewer::open(path, images, index);
+         } else {
+             create_context_menu();
+         }
      } else if (is_text_file(filename)) {
          // Open text viewer/editor
          TDECK_LOG_I("Opening text file: %s", full_path.c_str());
@@ -525,7 +731,8 @@
      lv_event_code_t code = lv_event_get_code(e);
      
      if (code == LV_EVENT_CLICKED) {
-         // Reload current directory
+         // Reload current directory from the card, not the metadata cache
+         FSManager::invalidate_cache(current_path);
          load_directory(current_path);
      }
  }
@@ -0,0 +1,1044 @@
+/**
+ * @file image_viewer.cpp
+ * @brief Image viewer application for T-Deck UI
+ *
+ * Images are decoded on a worker task straight from the file stream.
+ * JPEG files use the decoder's native 1/2, 1/4 and 1/8 scaling, PNG files
+ * are decoded line by line, and any remaining factor is applied by
+ * skipping pixels while the strips are written into cached tiles. Only the
+ * tiles around the viewport are kept, so memory use does not depend on
+ * the image resolution.
+ */
+
+ #include "image_viewer.h"
+ #include "../config.h"
+ #include "../system/fs_manager.h"
+ #include "../ui/ui_manager.h"
+ 
+ #include <lvgl.h>
+ #include <Arduino.h>
+ #include <JPEGDEC.h>
+ #include <PNGdec.h>
+ #include <esp_heap_caps.h>
+ #include <algorithm>
+ #include <atomic>
+ #include <new>
+ 
+ // Viewer layout and cache geometry
+ #define VIEW_WIDTH TDECK_DISPLAY_WIDTH
+ #define VIEW_HEIGHT TDECK_DISPLAY_HEIGHT
+ #define TILE_SIZE TDECK_IMAGE_TILE_SIZE
+ #define TILE_BYTES (TILE_SIZE * TILE_SIZE * sizeof(uint16_t))
+ #define TILE_COUNT (TDECK_IMAGE_CACHE_BUDGET / TILE_BYTES)
+ #define ROI_MARGIN TILE_SIZE       // Decoded beyond the viewport so small pans hit the cache
+ #define PAN_STEP 32                // Pan distance per key press in screen pixels
+ #define MAX_SCALE 64               // Largest supported reduction factor
+ #define INFO_CACHE_SIZE 8          // Image headers remembered
+ 
+ /**
+  * @brief Cached tile of a decoded image
+  */
+ struct ImageTile {
+     uint32_t key;                  ///< Image key, 0 if the tile is free
+     uint16_t scale;                ///< Reduction factor the tile was decoded at
+     uint16_t tx;                   ///< Tile column
+     uint16_t ty;                   ///< Tile row
+     bool valid;                    ///< Pixels are complete
+     uint32_t last_used;            ///< LRU stamp
+     uint16_t *pixels;              ///< TILE_SIZE x TILE_SIZE RGB565 pixels in PSRAM
+ };
+ 
+ /**
+  * @brief Header information of an image
+  */
+ struct ImageInfo {
+     uint32_t key;                  ///< Image key, 0 if unused
+     uint16_t width;                ///< Full width in pixels
+     uint16_t height;               ///< Full height in pixels
+     uint16_t fit_scale;            ///< Smallest power of two reduction that fits the display
+ };
+ 
+ /**
+  * @brief Rectangle in scaled image coordinates
+  */
+ struct ImageRect {
+     int32_t x;
+     int32_t y;
+     int32_t w;
+     int32_t h;
+ };
+ 
+ /**
+  * @brief Decode request queued for the worker
+  */
+ struct DecodeRequest {
+     std::string path;              ///< Full image path
+     uint32_t key;                  ///< Image key
+     uint16_t scale;                ///< Reduction factor, 0 to fit the display
+     ImageRect roi;                 ///< Region to keep, ignored when fitting
+     bool prefetch;                 ///< Neighbour decoded ahead of time
+ };
+ 
+ /**
+  * @brief Decode result posted back to the UI task
+  */
+ struct DecodeResult {
+     uint32_t key;                  ///< Image key
+     bool ok;                       ///< Image was decoded
+ };
+ 
+ /**
+  * @brief State of the decode in progress, shared with the decoder callbacks
+  */
+ struct DecodeContext {
+     uint16_t decimate;             ///< Reduction applied on top of the decoder's scaling
+     ImageRect roi;                 ///< Region kept, in scaled coordinates
+     int32_t tile_x0;               ///< First tile column of the region
+     int32_t tile_y0;               ///< First tile row of the region
+     int32_t tiles_w;               ///< Tile columns in the region
+     int32_t tiles_h;               ///< Tile rows in the region
+     ImageTile **tiles;             ///< Claimed tiles, row major
+     bool abortable;                ///< Stop when a foreground request is waiting
+     PNG *png;                      ///< PNG decoder for line conversion
+     uint16_t *line;                ///< PNG line buffer
+ };
+ 
+ // UI objects
+ static lv_obj_t *viewer_screen = NULL;
+ static lv_obj_t *canvas = NULL;
+ static lv_obj_t *info_label = NULL;
+ static lv_obj_t *status_label = NULL;
+ static uint16_t *view_buffer = NULL;
+ 
+ // Viewer state, only touched by the UI task
+ static std::string image_dir;
+ static std::vector<std::string> image_list;
+ static size_t image_index = 0;
+ static uint32_t current_key = 0;
+ static uint16_t current_scale = 0;
+ static int32_t view_x = 0;
+ static int32_t view_y = 0;
+ static bool decode_pending = false;
+ 
+ // Tile cache and header cache, shared with the worker
+ static ImageTile *tiles = NULL;
+ static ImageInfo info_cache[INFO_CACHE_SIZE];
+ static uint8_t info_next = 0;
+ static uint32_t tile_clock = 0;
+ static SemaphoreHandle_t cache_mutex = NULL;
+ 
+ // Decoder worker
+ static TaskHandle_t decode_task = NULL;
+ static QueueHandle_t decode_queue = NULL;
+ static std::atomic<uint32_t> foreground_queued(0);  ///< Foreground requests waiting in decode_queue
+ static JPEGDEC *jpeg = NULL;
+ static PNG *png = NULL;
+ static DecodeContext *active_ctx = NULL;
+ 
+ // Forward declarations of event handlers
+ static void canvas_event_cb(lv_event_t *e);
+ 
+ // Helper functions
+ static uint32_t image_key(const std::string &path);
+ static std::string get_file_extension(const std::string &filename);
+ static bool lookup_info(uint32_t key, ImageInfo &info);
+ static void store_info(const ImageInfo &info);
+ static ImageTile* find_tile(uint32_t key, uint16_t scale, int32_t tx, int32_t ty);
+ static ImageTile* claim_tile(uint32_t key, uint16_t scale, int32_t tx, int32_t ty);
+ static void write_strip(DecodeContext *ctx, int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels);
+ static bool decode_image(const DecodeRequest &request);
+ static void decode_task_func(void *arg);
+ static void on_decode_done(void *arg);
+ static void request_decode(size_t index, uint16_t scale, bool prefetch);
+ static void show_current(bool reset_view);
+ static bool compose_view();
+ static void update_info_label();
+ static void prefetch_neighbours();
+ static void step_image(int delta);
+ static void pan_view(int32_t dx, int32_t dy);
+ static void zoom_view(bool zoom_in);
+ 
+ // Decoder file and draw callbacks
+ static void* image_file_open(const char *filename, int32_t *size);
+ static void image_file_close(void *handle);
+ static int32_t jpeg_file_read(JPEGFILE *file, uint8_t *buffer, int32_t length);
+ static int32_t jpeg_file_seek(JPEGFILE *file, int32_t position);
+ static int jpeg_draw(JPEGDRAW *draw);
+ static int32_t png_file_read(PNGFILE *file, uint8_t *buffer, int32_t length);
+ static int32_t png_file_seek(PNGFILE *file, int32_t position);
+ static int png_draw(PNGDRAW *draw);
+ 
+ /**
+  * @brief Initialize the image viewer
+  *
+  * @return true if the screen, tile cache and decoder worker were created
+  */
+ bool ImageViewer::init() {
+     if (viewer_screen) {
+         return true;
+     }
+ 
+     TDECK_LOG_I("Initializing Image Viewer");
+ 
+     // Tile cache, view buffer and decoders all live in PSRAM
+     uint8_t *tile_memory = (uint8_t*)heap_caps_malloc(TILE_COUNT * TILE_BYTES, MALLOC_CAP_SPIRAM);
+     tiles = (ImageTile*)heap_caps_calloc(TILE_COUNT, sizeof(ImageTile), MALLOC_CAP_SPIRAM);
+     view_buffer = (uint16_t*)heap_caps_malloc(VIEW_WIDTH * VIEW_HEIGHT * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+     void *jpeg_memory = heap_caps_malloc(sizeof(JPEGDEC), MALLOC_CAP_SPIRAM);
+     void *png_memory = heap_caps_malloc(sizeof(PNG), MALLOC_CAP_SPIRAM);
+ 
+     if (!tile_memory || !tiles || !view_buffer || !jpeg_memory || !png_memory) {
+         TDECK_LOG_E("Failed to allocate image viewer memory");
+         heap_caps_free(tile_memory);
+         heap_caps_free(tiles);
+         heap_caps_free(view_buffer);
+         heap_caps_free(jpeg_memory);
+         heap_caps_free(png_memory);
+         tiles = NULL;
+         view_buffer = NULL;
+         return false;
+     }
+ 
+     for (int i = 0; i < TILE_COUNT; i++) {
+         tiles[i].pixels = (uint16_t*)(tile_memory + i * TILE_BYTES);
+     }
+ 
+     jpeg = new (jpeg_memory) JPEGDEC();
+     png = new (png_memory) PNG();
+ 
+     // Start the decoder worker
+     cache_mutex = xSemaphoreCreateMutex();
+     decode_queue = xQueueCreate(2 + 2 * TDECK_IMAGE_PREFETCH, sizeof(DecodeRequest*));
+     if (!cache_mutex || !decode_queue ||
+         xTaskCreatePinnedToCore(decode_task_func, "Image_Decode", 8192, NULL,
+                                 TDECK_SYSTEM_TASK_PRIORITY, &decode_task, 0) != pdPASS) {
+         TDECK_LOG_E("Failed to start image decoder");
+         return false;
+     }
+ 
+     // Create viewer screen with a full screen canvas
+     viewer_screen = lv_obj_create(NULL);
+     lv_obj_clear_flag(viewer_screen, LV_OBJ_FLAG_SCROLLABLE);
+     lv_obj_set_style_bg_color(viewer_screen, lv_color_black(), 0);
+ 
+     canvas = lv_canvas_create(viewer_screen);
+     lv_canvas_set_buffer(canvas, view_buffer, VIEW_WIDTH, VIEW_HEIGHT, LV_IMG_CF_TRUE_COLOR);
+     lv_obj_set_pos(canvas, 0, 0);
+     lv_obj_add_flag(canvas, LV_OBJ_FLAG_CLICKABLE);
+     lv_obj_clear_flag(canvas, LV_OBJ_FLAG_GESTURE_BUBBLE);
+     lv_obj_add_event_cb(canvas, canvas_event_cb, LV_EVENT_ALL, NULL);
+ 
+     // File name and zoom overlay
+     info_label = lv_label_create(viewer_screen);
+     lv_obj_set_width(info_label, VIEW_WIDTH);
+     lv_label_set_long_mode(info_label, LV_LABEL_LONG_DOT);
+     lv_obj_set_style_bg_color(info_label, lv_color_black(), 0);
+     lv_obj_set_style_bg_opa(info_label, LV_OPA_60, 0);
+     lv_obj_set_style_text_color(info_label, lv_color_white(), 0);
+     lv_obj_align(info_label, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+ 
+     // Loading and error message
+     status_label = lv_label_create(viewer_screen);
+     lv_obj_set_style_text_color(status_label, lv_color_white(), 0);
+     lv_obj_center(status_label);
+     lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+ 
+     // Keyboard input goes to the canvas
+     lv_group_t *input_group = lv_group_create();
+     lv_group_add_obj(input_group, canvas);
+     UIManager::register_input_group(input_group);
+ 
+     return true;
+ }
+ 
+ /**
+  * @brief Open an image and show the viewer
+  *
+  * @param path Directory containing the images (with trailing slash)
+  * @param images Image file names in display order
+  * @param index Index of the image to show
+  */
+ void ImageViewer::open(const std::string &path, const std::vector<std::string> &images, size_t index) {
+     if (!init() || index >= images.size()) {
+         return;
+     }
+ 
+     image_dir = path;
+     image_list = images;
+     image_index = index;
+ 
+     show_current(true);
+     UIManager::switch_screen(viewer_screen);
+ }
+ 
+ /**
+  * @brief Close the image viewer
+  */
+ void ImageViewer::close() {
+     current_key = 0;
+     UIManager::back();
+ }
+ 
+ /**
+  * @brief Check if a file can be shown by the viewer
+  *
+  * @param filename File name to check
+  * @return true for JPEG and PNG files
+  */
+ bool ImageViewer::is_supported(const std::string &filename) {
+     std::string ext = get_file_extension(filename);
+     return ext == "jpg" || ext == "jpeg" || ext == "png";
+ }
+ 
+ /**
+  * @brief Show the current image, from the cache when possible
+  *
+  * @param reset_view true to fit the image and centre it
+  */
+ static void show_current(bool reset_view) {
+     current_key = image_key(image_dir + image_list[image_index]);
+ 
+     ImageInfo info;
+     if (lookup_info(current_key, info)) {
+         if (reset_view || current_scale == 0) {
+             current_scale = info.fit_scale;
+             view_x = 0;
+             view_y = 0;
+         }
+     } else {
+         current_scale = 0;
+     }
+ 
+     update_info_label();
+ 
+     // Decode only what the cache cannot provide
+     if (current_scale == 0 || !compose_view()) {
+         memset(view_buffer, 0, VIEW_WIDTH * VIEW_HEIGHT * sizeof(uint16_t));
+         lv_obj_invalidate(canvas);
+         lv_label_set_text_static(status_label, "Loading...");
+         lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+         request_decode(image_index, current_scale, false);
+     } else {
+         lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+         prefetch_neighbours();
+     }
+ }
+ 
+ /**
+  * @brief Copy the visible tiles into the canvas buffer
+  *
+  * @return true if every visible tile was cached
+  */
+ static bool compose_view() {
+     ImageInfo info;
+     if (!lookup_info(current_key, info) || current_scale == 0) {
+         return false;
+     }
+ 
+     int32_t scaled_w = (info.width + current_scale - 1) / current_scale;
+     int32_t scaled_h = (info.height + current_scale - 1) / current_scale;
+ 
+     // Keep the viewport inside the image and centre small images
+     view_x = constrain(view_x, 0, std::max<int32_t>(0, scaled_w - VIEW_WIDTH));
+     view_y = constrain(view_y, 0, std::max<int32_t>(0, scaled_h - VIEW_HEIGHT));
+     int32_t dest_x = scaled_w < VIEW_WIDTH ? (VIEW_WIDTH - scaled_w) / 2 : 0;
+     int32_t dest_y = scaled_h < VIEW_HEIGHT ? (VIEW_HEIGHT - scaled_h) / 2 : 0;
+     int32_t visible_w = std::min<int32_t>(VIEW_WIDTH, scaled_w);
+     int32_t visible_h = std::min<int32_t>(VIEW_HEIGHT, scaled_h);
+ 
+     memset(view_buffer, 0, VIEW_WIDTH * VIEW_HEIGHT * sizeof(uint16_t));
+ 
+     bool complete = true;
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for (int32_t ty = view_y / TILE_SIZE; ty <= (view_y + visible_h - 1) / TILE_SIZE; ty++) {
+         for (int32_t tx = view_x / TILE_SIZE; tx <= (view_x + visible_w - 1) / TILE_SIZE; tx++) {
+             ImageTile *tile = find_tile(current_key, current_scale, tx, ty);
+             if (!tile || !tile->valid) {
+                 complete = false;
+                 continue;
+             }
+             tile->last_used = ++tile_clock;
+ 
+             // Intersection of the tile with the viewport in image coordinates
+             int32_t x0 = std::max<int32_t>(tx * TILE_SIZE, view_x);
+             int32_t x1 = std::min<int32_t>((tx + 1) * TILE_SIZE, view_x + visible_w);
+             int32_t y0 = std::max<int32_t>(ty * TILE_SIZE, view_y);
+             int32_t y1 = std::min<int32_t>((ty + 1) * TILE_SIZE, view_y + visible_h);
+ 
+             for (int32_t y = y0; y < y1; y++) {
+                 const uint16_t *src = tile->pixels + (y - ty * TILE_SIZE) * TILE_SIZE + (x0 - tx * TILE_SIZE);
+                 uint16_t *dst = view_buffer + (dest_y + y - view_y) * VIEW_WIDTH + dest_x + (x0 - view_x);
+                 memcpy(dst, src, (x1 - x0) * sizeof(uint16_t));
+             }
+         }
+     }
+     xSemaphoreGive(cache_mutex);
+ 
+     lv_obj_invalidate(canvas);
+     return complete;
+ }
+ 
+ /**
+  * @brief Queue a decode of an image around the current viewport
+  *
+  * @param index Index in image_list
+  * @param scale Reduction factor, 0 to fit the display
+  * @param prefetch true for neighbours decoded ahead of time
+  */
+ static void request_decode(size_t index, uint16_t scale, bool prefetch) {
+     DecodeRequest *request = new DecodeRequest();
+     request->path = image_dir + image_list[index];
+     request->key = image_key(request->path);
+     request->scale = scale;
+     request->roi = {view_x - ROI_MARGIN, view_y - ROI_MARGIN,
+                     VIEW_WIDTH + 2 * ROI_MARGIN, VIEW_HEIGHT + 2 * ROI_MARGIN};
+     request->prefetch = prefetch;
+ 
+     // Counted before it is queued so the worker never sees it go negative
+     if (!prefetch) {
+         foreground_queued++;
+     }
+ 
+     if (xQueueSend(decode_queue, &request, 0) != pdTRUE) {
+         if (!prefetch) {
+             foreground_queued--;
+         }
+         delete request;
+         return;
+     }
+ 
+     if (!prefetch) {
+         decode_pending = true;
+     }
+ }
+ 
+ /**
+  * @brief Decode the neighbours of the current image at their fit scale
+  */
+ static void prefetch_neighbours() {
+     for (int offset = 1; offset <= TDECK_IMAGE_PREFETCH; offset++) {
+         if (image_index + offset < image_list.size()) {
+             request_decode(image_index + offset, 0, true);
+         }
+         if (image_index >= (size_t)offset) {
+             request_decode(image_index - offset, 0, true);
+         }
+     }
+ }
+ 
+ /**
+  * @brief Decode finished, runs on the UI task through UIManager::postWork
+  *
+  * @param arg DecodeResult, owned by this function
+  */
+ static void on_decode_done(void *arg) {
+     DecodeResult *result = (DecodeResult*)arg;
+ 
+     if (result->key == current_key) {
+         decode_pending = false;
+ 
+         if (!result->ok) {
+             lv_label_set_text_static(status_label, "Cannot open image");
+             lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+         } else {
+             // First decode of the image tells us its fit scale
+             if (current_scale == 0) {
+                 ImageInfo info;
+                 if (lookup_info(current_key, info)) {
+                     current_scale = info.fit_scale;
+                 }
+             }
+ 
+             compose_view();
+             update_info_label();
+             lv_obj_add_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+             prefetch_neighbours();
+         }
+     }
+ 
+     delete result;
+ }
+ 
+ /**
+  * @brief Update the file name and zoom overlay
+  */
+ static void update_info_label() {
+     char text[96];
+     if (current_scale > 0) {
+         snprintf(text, sizeof(text), "%s  %u/%u  1:%u", image_list[image_index].c_str(),
+                  (unsigned)(image_index + 1), (unsigned)image_list.size(), (unsigned)current_scale);
+     } else {
+         snprintf(text, sizeof(text), "%s  %u/%u", image_list[image_index].c_str(),
+                  (unsigned)(image_index + 1), (unsigned)image_list.size());
+     }
+     lv_label_set_text(info_label, text);
+ }
+ 
+ /**
+  * @brief Show the next or previous image
+  *
+  * @param delta Images to move, negative for previous
+  */
+ static void step_image(int delta) {
+     int32_t index = (int32_t)image_index + delta;
+     if (index < 0 || index >= (int32_t)image_list.size()) {
+         return;
+     }
+ 
+     image_index = index;
+     show_current(true);
+ }
+ 
+ /**
+  * @brief Move the viewport over a zoomed image
+  *
+  * @param dx Horizontal distance in screen pixels
+  * @param dy Vertical distance in screen pixels
+  */
+ static void pan_view(int32_t dx, int32_t dy) {
+     view_x += dx;
+     view_y += dy;
+ 
+     if (!compose_view() && !decode_pending) {
+         request_decode(image_index, current_scale, false);
+     }
+ }
+ 
+ /**
+  * @brief Zoom in or out around the centre of the screen
+  *
+  * @param zoom_in true to halve the reduction factor
+  */
+ static void zoom_view(bool zoom_in) {
+     ImageInfo info;
+     if (current_scale == 0 || !lookup_info(current_key, info)) {
+         return;
+     }
+ 
+     uint16_t scale = zoom_in ? current_scale / 2 : current_scale * 2;
+     if (scale < 1 || scale > info.fit_scale) {
+         return;
+     }
+ 
+     // Keep the same image point in the middle of the screen
+     int32_t centre_x = (view_x + VIEW_WIDTH / 2) * current_scale;
+     int32_t centre_y = (view_y + VIEW_HEIGHT / 2) * current_scale;
+     current_scale = scale;
+     view_x = centre_x / scale - VIEW_WIDTH / 2;
+     view_y = centre_y / scale - VIEW_HEIGHT / 2;
+ 
+     update_info_label();
+     if (!compose_view() && !decode_pending) {
+         request_decode(image_index, current_scale, false);
+     }
+ }
+ 
+ /**
+  * @brief Canvas event handler for keys, swipes and drags
+  *
+  * @param e LVGL event
+  */
+ static void canvas_event_cb(lv_event_t *e) {
+     lv_event_code_t code = lv_event_get_code(e);
+     ImageInfo info;
+     bool zoomed = lookup_info(current_key, info) && current_scale > 0 && current_scale < info.fit_scale;
+ 
+     if (code == LV_EVENT_KEY) {
+         uint32_t key = lv_event_get_key(e);
+ 
+         switch (key) {
+             case LV_KEY_ESC:
+                 ImageViewer::close();
+                 break;
+ 
+             case LV_KEY_LEFT:
+                 if (zoomed) pan_view(-PAN_STEP, 0); else step_image(-1);
+                 break;
+ 
+             case LV_KEY_RIGHT:
+                 if (zoomed) pan_view(PAN_STEP, 0); else step_image(1);
+                 break;
+ 
+             case LV_KEY_UP:
+                 pan_view(0, -PAN_STEP);
+                 break;
+ 
+             case LV_KEY_DOWN:
+                 pan_view(0, PAN_STEP);
+                 break;
+ 
+             case LV_KEY_ENTER:
+             case '+':
+                 zoom_view(true);
+                 break;
+ 
+             case LV_KEY_BACKSPACE:
+             case '-':
+                 zoom_view(false);
+                 break;
+ 
+             case 'n':
+             case ' ':
+                 step_image(1);
+                 break;
+ 
+             case 'p':
+                 step_image(-1);
+                 break;
+         }
+     } else if (code == LV_EVENT_GESTURE && !zoomed) {
+         // Swipe between images when the whole image is visible
+         lv_dir_t dir = lv_indev_get_gesture_dir(lv_indev_get_act());
+         if (dir == LV_DIR_LEFT) {
+             step_image(1);
+         } else if (dir == LV_DIR_RIGHT) {
+             step_image(-1);
+         }
+     } else if (code == LV_EVENT_PRESSING && zoomed) {
+         // Drag a zoomed image
+         lv_point_t vect;
+         lv_indev_get_vect(lv_indev_get_act(), &vect);
+         if (vect.x != 0 || vect.y != 0) {
+             pan_view(-vect.x, -vect.y);
+         }
+     }
+ }
+ 
+ /**
+  * @brief Decoder worker, serves queued requests one at a time
+  *
+  * @param arg Unused
+  */
+ static void decode_task_func(void *arg) {
+     DecodeRequest *request;
+ 
+     while (true) {
+         if (xQueueReceive(decode_queue, &request, portMAX_DELAY) != pdTRUE) {
+             continue;
+         }
+ 
+         if (!request->prefetch) {
+             foreground_queued--;
+         }
+ 
+         bool ok = decode_image(*request);
+ 
+         // Prefetches only warm the cache, foreground decodes update the screen
+         if (!request->prefetch) {
+             DecodeResult *result = new DecodeResult{request->key, ok};
+             if (!uiManager.postWork(on_decode_done, result)) {
+                 delete result;
+             }
+         }
+ 
+         delete request;
+     }
+ }
+ 
+ /**
+  * @brief Decode the requested region of an image into the tile cache
+  *
+  * @param request Decode request
+  * @return true if the region is in the cache
+  */
+ static bool decode_image(const DecodeRequest &request) {
+     std::string ext = get_file_extension(request.path);
+     bool is_png = ext == "png";
+ 
+     // Read the header first, the size decides the scale
+     ImageInfo info;
+     if (!lookup_info(request.key, info)) {
+         int32_t width = 0;
+         int32_t height = 0;
+ 
+         if (is_png) {
+             if (png->open(request.path.c_str(), image_file_open, image_file_close,
+                           png_file_read, png_file_seek, png_draw) != PNG_SUCCESS) {
+                 TDECK_LOG_E("Failed to open PNG: %s", request.path.c_str());
+                 return false;
+             }
+             width = png->getWidth();
+             height = png->getHeight();
+             png->close();
+         } else {
+             if (!jpeg->open(request.path.c_str(), image_file_open, image_file_close,
+                             jpeg_file_read, jpeg_file_seek, jpeg_draw)) {
+                 TDECK_LOG_E("Failed to open JPEG: %s", request.path.c_str());
+                 return false;
+             }
+             width = jpeg->getWidth();
+             height = jpeg->getHeight();
+             jpeg->close();
+         }
+ 
+         if (width <= 0 || height <= 0) {
+             return false;
+         }
+ 
+         info.key = request.key;
+         info.width = width;
+         info.height = height;
+         info.fit_scale = 1;
+         while (info.fit_scale < MAX_SCALE &&
+                ((width + info.fit_scale - 1) / info.fit_scale > VIEW_WIDTH ||
+                 (height + info.fit_scale - 1) / info.fit_scale > VIEW_HEIGHT)) {
+             info.fit_scale *= 2;
+         }
+         store_info(info);
+     }
+ 
+     uint16_t scale = request.scale == 0 ? info.fit_scale : request.scale;
+     int32_t scaled_w = (info.width + scale - 1) / scale;
+     int32_t scaled_h = (info.height + scale - 1) / scale;
+ 
+     // Fitted images are small enough to keep whole, otherwise keep the region
+     ImageRect roi = request.scale == 0 ? ImageRect{0, 0, scaled_w, scaled_h} : request.roi;
+     int32_t roi_x1 = std::min(roi.x + roi.w, scaled_w);
+     int32_t roi_y1 = std::min(roi.y + roi.h, scaled_h);
+     roi.x = std::max<int32_t>(roi.x, 0);
+     roi.y = std::max<int32_t>(roi.y, 0);
+     roi.w = roi_x1 - roi.x;
+     roi.h = roi_y1 - roi.y;
+     if (roi.w <= 0 || roi.h <= 0) {
+         return true;
+     }
+ 
+     DecodeContext ctx = {};
+     ctx.roi = roi;
+     ctx.tile_x0 = roi.x / TILE_SIZE;
+     ctx.tile_y0 = roi.y / TILE_SIZE;
+     ctx.tiles_w = (roi.x + roi.w - 1) / TILE_SIZE - ctx.tile_x0 + 1;
+     ctx.tiles_h = (roi.y + roi.h - 1) / TILE_SIZE - ctx.tile_y0 + 1;
+     ctx.abortable = request.prefetch;
+ 
+     if (ctx.tiles_w * ctx.tiles_h > TILE_COUNT / 2) {
+         TDECK_LOG_E("Image region does not fit the tile cache");
+         return false;
+     }
+ 
+     // Claim the tiles, nothing to do if they are all cached already
+     ctx.tiles = new ImageTile*[ctx.tiles_w * ctx.tiles_h];
+     bool cached = true;
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for (int32_t ty = 0; ty < ctx.tiles_h; ty++) {
+         for (int32_t tx = 0; tx < ctx.tiles_w; tx++) {
+             ImageTile *tile = find_tile(request.key, scale, ctx.tile_x0 + tx, ctx.tile_y0 + ty);
+             cached = cached && tile && tile->valid;
+         }
+     }
+     if (!cached) {
+         for (int32_t ty = 0; ty < ctx.tiles_h; ty++) {
+             for (int32_t tx = 0; tx < ctx.tiles_w; tx++) {
+                 ctx.tiles[ty * ctx.tiles_w + tx] = claim_tile(request.key, scale, ctx.tile_x0 + tx, ctx.tile_y0 + ty);
+             }
+         }
+     }
+     xSemaphoreGive(cache_mutex);
+ 
+     if (cached) {
+         delete[] ctx.tiles;
+         return true;
+     }
+ 
+     uint32_t start = millis();
+     bool ok = false;
+     active_ctx = &ctx;
+ 
+     if (is_png) {
+         // PNG has no scaled decode, every line is decimated while it streams in
+         ctx.decimate = scale;
+         ctx.png = png;
+         if (png->open(request.path.c_str(), image_file_open, image_file_close,
+                       png_file_read, png_file_seek, png_draw) == PNG_SUCCESS) {
+             ctx.line = (uint16_t*)heap_caps_malloc(png->getWidth() * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+             if (ctx.line) {
+                 ok = png->decode(&ctx, 0) == PNG_SUCCESS;
+                 heap_caps_free(ctx.line);
+             }
+             png->close();
+         }
+     } else {
+         // Let the decoder do as much of the reduction as it can
+         uint16_t jpeg_scale = std::min<uint16_t>(scale, 8);
+         int options = jpeg_scale == 8 ? JPEG_SCALE_EIGHTH :
+                       jpeg_scale == 4 ? JPEG_SCALE_QUARTER :
+                       jpeg_scale == 2 ? JPEG_SCALE_HALF : 0;
+         ctx.decimate = scale / jpeg_scale;
+         if (jpeg->open(request.path.c_str(), image_file_open, image_file_close,
+                        jpeg_file_read, jpeg_file_seek, jpeg_draw)) {
+             jpeg->setPixelType(RGB565_LITTLE_ENDIAN);
+             ok = jpeg->decode(0, 0, options) == 1;
+             jpeg->close();
+         }
+     }
+ 
+     active_ctx = NULL;
+ 
+     // Publish the tiles
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for (int32_t i = 0; i < ctx.tiles_w * ctx.tiles_h; i++) {
+         if (ok) {
+             ctx.tiles[i]->valid = true;
+         } else {
+             ctx.tiles[i]->key = 0;
+         }
+     }
+     xSemaphoreGive(cache_mutex);
+     delete[] ctx.tiles;
+ 
+     if (ok) {
+         TDECK_LOG_I("Decoded %s at 1:%u in %lu ms", request.path.c_str(), scale,
+                     (unsigned long)(millis() - start));
+     } else if (!request.prefetch) {
+         TDECK_LOG_E("Failed to decode image: %s", request.path.c_str());
+     }
+ 
+     return ok;
+ }
+ 
+ /**
+  * @brief Write a decoded strip into the claimed tiles
+  *
+  * @param ctx Decode context
+  * @param x Strip X in decoder output coordinates
+  * @param y Strip Y in decoder output coordinates
+  * @param w Strip width
+  * @param h Strip height
+  * @param pixels Strip pixels, w per row
+  */
+ static void write_strip(DecodeContext *ctx, int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *pixels) {
+     int32_t dec = ctx->decimate;
+     int32_t roi_x1 = ctx->roi.x + ctx->roi.w;
+     int32_t roi_y1 = ctx->roi.y + ctx->roi.h;
+ 
+     // Output columns covered by the strip, clipped to the region
+     int32_t out_x0 = std::max<int32_t>((x + dec - 1) / dec, ctx->roi.x);
+     int32_t out_x1 = std::min<int32_t>((x + w - 1) / dec + 1, roi_x1);
+     if (out_x0 >= out_x1) {
+         return;
+     }
+ 
+     for (int32_t row = 0; row < h; row++) {
+         int32_t src_y = y + row;
+         if (src_y % dec != 0) {
+             continue;
+         }
+ 
+         int32_t out_y = src_y / dec;
+         if (out_y < ctx->roi.y || out_y >= roi_y1) {
+             continue;
+         }
+ 
+         const uint16_t *src_row = pixels + row * w;
+         ImageTile **tile_row = ctx->tiles + (out_y / TILE_SIZE - ctx->tile_y0) * ctx->tiles_w;
+         int32_t tile_line = (out_y % TILE_SIZE) * TILE_SIZE;
+ 
+         // Copy one tile wide run at a time
+         int32_t out_x = out_x0;
+         while (out_x < out_x1) {
+             int32_t tile_col = out_x / TILE_SIZE;
+             int32_t run_end = std::min<int32_t>((tile_col + 1) * TILE_SIZE, out_x1);
+             uint16_t *dst = tile_row[tile_col - ctx->tile_x0]->pixels + tile_line + (out_x % TILE_SIZE);
+             const uint16_t *src = src_row + out_x * dec - x;
+ 
+             for (int32_t i = 0; i < run_end - out_x; i++) {
+                 dst[i] = src[i * dec];
+             }
+             out_x = run_end;
+         }
+     }
+ }
+ 
+ /**
+  * @brief Find a cached tile, caller holds cache_mutex
+  *
+  * @return Tile or NULL
+  */
+ static ImageTile* find_tile(uint32_t key, uint16_t scale, int32_t tx, int32_t ty) {
+     for (int i = 0; i < TILE_COUNT; i++) {
+         ImageTile &tile = tiles[i];
+         if (tile.key == key && tile.scale == scale && tile.tx == tx && tile.ty == ty) {
+             return &tile;
+         }
+     }
+     return NULL;
+ }
+ 
+ /**
+  * @brief Get a tile to decode into, evicting the least recently used one, caller holds cache_mutex
+  *
+  * Tiles of the image being decoded at the same scale are never evicted.
+  *
+  * @return Tile, marked invalid until the decode finishes
+  */
+ static ImageTile* claim_tile(uint32_t key, uint16_t scale, int32_t tx, int32_t ty) {
+     ImageTile *tile = find_tile(key, scale, tx, ty);
+ 
+     if (!tile) {
+         for (int i = 0; i < TILE_COUNT; i++) {
+             ImageTile &candidate = tiles[i];
+             if (candidate.key == key && candidate.scale == scale) {
+                 continue;
+             }
+             if (!tile || candidate.key == 0 || candidate.last_used < tile->last_used) {
+                 tile = &candidate;
+                 if (candidate.key == 0) {
+                     break;
+                 }
+             }
+         }
+     }
+ 
+     tile->key = key;
+     tile->scale = scale;
+     tile->tx = tx;
+     tile->ty = ty;
+     tile->valid = false;
+     tile->last_used = ++tile_clock;
+     return tile;
+ }
+ 
+ /**
+  * @brief Look up the header of an image
+  *
+  * @return true if the image was opened before
+  */
+ static bool lookup_info(uint32_t key, ImageInfo &info) {
+     bool found = false;
+ 
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for (int i = 0; i < INFO_CACHE_SIZE; i++) {
+         if (info_cache[i].key == key) {
+             info = info_cache[i];
+             found = true;
+             break;
+         }
+     }
+     xSemaphoreGive(cache_mutex);
+ 
+     return found;
+ }
+ 
+ /**
+  * @brief Remember the header of an image, replacing the oldest one
+  */
+ static void store_info(const ImageInfo &info) {
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     info_cache[info_next] = info;
+     info_next = (info_next + 1) % INFO_CACHE_SIZE;
+     xSemaphoreGive(cache_mutex);
+ }
+ 
+ /**
+  * @brief Hash an image path into a cache key (FNV-1a, never 0)
+  */
+ static uint32_t image_key(const std::string &path) {
+     uint32_t hash = 2166136261u;
+     for (char c : path) {
+         hash = (hash ^ (uint8_t)c) * 16777619u;
+     }
+     return hash ? hash : 1;
+ }
+ 
+ /**
+  * @brief Get file extension from filename
+  *
+  * @param filename Filename
+  * @return std::string File extension (lowercase, without dot)
+  */
+ static std::string get_file_extension(const std::string &filename) {
+     size_t dot_pos = filename.find_last_of('.');
+     if (dot_pos != std::string::npos && dot_pos < filename.length() - 1) {
+         std::string ext = filename.substr(dot_pos + 1);
+         std::transform(ext.begin(), ext.end(), ext.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+         return ext;
+     }
+     return "";
+ }
+ 
+ /**
+  * @brief Decoder open callback, streams the file through FSManager
+  */
+ static void* image_file_open(const char *filename, int32_t *size) {
+     fs::File *file = new fs::File(FSManager::open_file(filename, FILE_READ));
+     if (!*file) {
+         delete file;
+         return NULL;
+     }
+ 
+     *size = file->size();
+     return file;
+ }
+ 
+ /**
+  * @brief Decoder close callback
+  */
+ static void image_file_close(void *handle) {
+     fs::File *file = (fs::File*)handle;
+     if (file) {
+         file->close();
+         delete file;
+     }
+ }
+ 
+ static int32_t jpeg_file_read(JPEGFILE *file, uint8_t *buffer, int32_t length) {
+     return ((fs::File*)file->fHandle)->read(buffer, length);
+ }
+ 
+ static int32_t jpeg_file_seek(JPEGFILE *file, int32_t position) {
+     return ((fs::File*)file->fHandle)->seek(position) ? position : -1;
+ }
+ 
+ /**
+  * @brief JPEG strip callback, one MCU row at a time
+  *
+  * @return 1 to continue, 0 to abort the decode
+  */
+ static int jpeg_draw(JPEGDRAW *draw) {
+     DecodeContext *ctx = active_ctx;
+     if (!ctx) {
+         return 1;
+     }
+ 
+     // Give way to the image the user is waiting for, other prefetches wait their turn
+     if (ctx->abortable && foreground_queued.load() > 0) {
+         return 0;
+     }
+ 
+     write_strip(ctx, draw->x, draw->y, draw->iWidth, draw->iHeight, draw->pPixels);
+     return 1;
+ }
+ 
+ static int32_t png_file_read(PNGFILE *file, uint8_t *buffer, int32_t length) {
+     return ((fs::File*)file->fHandle)->read(buffer, length);
+ }
+ 
+ static int32_t png_file_seek(PNGFILE *file, int32_t position) {
+     return ((fs::File*)file->fHandle)->seek(position) ? position : -1;
+ }
+ 
+ /**
+  * @brief PNG line callback
+  *
+  * @return 1 to continue, 0 to abort the decode
+  */
+ static int png_draw(PNGDRAW *draw) {
+     DecodeContext *ctx = (DecodeContext*)draw->pUser;
+     if (!ctx) {
+         return 1;
+     }
+ 
+     if (ctx->abortable && foreground_queued.load() > 0) {
+         return 0;
+     }
+ 
+     // Lines that are decimated away are not converted at all
+     if (draw->y % ctx->decimate != 0) {
+         return 1;
+     }
+ 
+     ctx->png->getLineAsRGB565(draw, ctx->line, PNG_RGB565_LITTLE_ENDIAN, 0x00000000);
+     write_strip(ctx, 0, draw->y, draw->iWidth, 1, ctx->line);
+     return 1;
+ }
\ No newline at end of file
@@ -0,0 +1,54 @@
+/**
+ * @file image_viewer.h
+ * @brief Image viewer application for T-Deck UI
+ *
+ * This header defines the interface for the image viewer which shows
+ * JPEG and PNG files from the SD card or internal storage.
+ */
+
+ #ifndef TDECK_IMAGE_VIEWER_H
+ #define TDECK_IMAGE_VIEWER_H
+ 
+ #include <string>
+ #include <vector>
+ 
+ /**
+  * @brief Image viewer application
+  *
+  * Images are decoded in strips straight from the file stream, scaled down
+  * while decoding to fit the display, and kept as tiles in a PSRAM cache so
+  * panning and flipping between neighbouring images does not decode again.
+  */
+ class ImageViewer {
+ public:
+     /**
+      * @brief Initialize the image viewer
+      *
+      * @return true if the screen, tile cache and decoder worker were created
+      */
+     static bool init();
+ 
+     /**
+      * @brief Open an image and show the viewer
+      *
+      * @param path Directory containing the images (with trailing slash)
+      * @param images Image file names in display order, used for next/previous
+      * @param index Index of the image to show
+      */
+     static void open(const std::string &path, const std::vector<std::string> &images, size_t index);
+ 
+     /**
+      * @brief Close the image viewer
+      */
+     static void close();
+ 
+     /**
+      * @brief Check if a file can be shown by the viewer
+      *
+      * @param filename File name to check
+      * @return true for JPEG and PNG files
+      */
+     static bool is_supported(const std::string &filename);
+ };
+ 
+ #endif // TDECK_IMAGE_VIEWER_H
\ No newline at end of file
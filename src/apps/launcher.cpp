@@ -4,14 +4,11 @@
  */
 
  #include "launcher.h"
- #include "../hal/power.h"
  #include "../hal/keyboard.h"
- #include "../comms/wifi.h"
- #include "../comms/bluetooth.h"
  #include "../system/fs_manager.h"
- #include <time.h>
+ #include "../system/assets.h"
  
- // Default app icons (to be replaced with actual icon data)
+ // Built-in app icons, used when the asset partition has no copy
  LV_IMG_DECLARE(icon_settings);
  LV_IMG_DECLARE(icon_filebrowser);
  LV_IMG_DECLARE(icon_terminal);
@@ -37,6 +34,14 @@
  LV_IMG_DECLARE(icon_bluetooth_on);
  LV_IMG_DECLARE(icon_bluetooth_off);
  
+ // Asset partition atlas holding every app icon
+ #define LAUNCHER_ATLAS "launcher_icons"
+ 
+ // App icon from the atlas, or the built-in copy
+ static lv_img_dsc_t* appIcon(const char* name, const lv_img_dsc_t* builtIn) {
+     return (lv_img_dsc_t*)assets.getAtlasImage(LAUNCHER_ATLAS, name, builtIn);
+ }
+ 
  /**
   * @brief Constructor
   */
@@ -52,6 +57,10 @@
      appInfoPanel(nullptr),
      appNameLabel(nullptr),
      appDescLabel(nullptr),
+     shownMinute(-1),
+     shownBatteryLow(false),
+     shownWifi(false),
+     shownBluetooth(false),
      selectedIndex(0),
      columns(3),
      rows(2)
@@ -113,34 +122,31 @@
      lv_style_set_text_color(&infoBarStyle, LV_STATE_DEFAULT, lv_color_hex(0x333333));
      lv_style_set_pad_all(&infoBarStyle, LV_STATE_DEFAULT, 5);
      
-     // Register default apps
-     registerApp("Settings", "System configuration", &icon_settings, 
-                 (lv_img_dsc_t*)&icon_settings, launchSettingsApp);
+     // Register default apps, icons are sub-images of one atlas drawn straight from flash
+     registerApp("Settings", "System configuration", appIcon("icon_settings", &icon_settings), 
+                 appIcon("icon_settings", &icon_settings), launchSettingsApp);
      
-     registerApp("Files", "File browser", &icon_filebrowser, 
-                 (lv_img_dsc_t*)&icon_filebrowser, launchFileBrowserApp);
+     registerApp("Files", "File browser", appIcon("icon_filebrowser", &icon_filebrowser), 
+                 appIcon("icon_filebrowser", &icon_filebrowser), launchFileBrowserApp);
      
-     registerApp("Terminal", "Command line interface", &icon_terminal, 
-                 (lv_img_dsc_t*)&icon_terminal, launchTerminalApp);
+     registerApp("Terminal", "Command line interface", appIcon("icon_terminal", &icon_terminal), 
+                 appIcon("icon_terminal", &icon_terminal), launchTerminalApp);
      
-     registerApp("WiFi", "WiFi configuration", &icon_wifi, 
-                 (lv_img_dsc_t*)&icon_wifi, launchWiFiManagerApp);
+     registerApp("WiFi", "WiFi configuration", appIcon("icon_wifi", &icon_wifi), 
+                 appIcon("icon_wifi", &icon_wifi), launchWiFiManagerApp);
      
-     registerApp("Bluetooth", "Bluetooth settings", &icon_bluetooth, 
-                 (lv_img_dsc_t*)&icon_bluetooth, launchBluetoothManagerApp);
+     registerApp("Bluetooth", "Bluetooth settings", appIcon("icon_bluetooth", &icon_bluetooth), 
+                 appIcon("icon_bluetooth", &icon_bluetooth), launchBluetoothManagerApp);
      
-     registerApp("LoRa", "LoRa messenger", &icon_lora, 
-                 (lv_img_dsc_t*)&icon_lora, launchLoRaMessengerApp);
+     registerApp("LoRa", "LoRa messenger", appIcon("icon_lora", &icon_lora), 
+                 appIcon("icon_lora", &icon_lora), launchLoRaMessengerApp);
      
-     registerApp("System", "System information", &icon_system, 
-                 (lv_img_dsc_t*)&icon_system, launchSystemInfoApp);
+     registerApp("System", "System information", appIcon("icon_system", &icon_system), 
+                 appIcon("icon_system", &icon_system), launchSystemInfoApp);
      
-     // Create launcher UI
+     // Create launcher UI, the status bar is then updated by UIManager as values change
      createUI();
      
-     // Start a periodic timer for status updates
-     lv_task_create(statusBarTimerCallback, 1000, LV_TASK_PRIO_LOW, this);
-     
      TDECK_LOG_I("Launcher initialized with %d apps", apps.size());
      return true;
  }
@@ -152,9 +158,8 @@
      TDECK_LOG_I("Starting Launcher");
      
      if (launcherContainer) {
+         // The grid and status bar kept their state while hidden
          lv_obj_set_hidden(launcherContainer, false);
-         updateStatusBar();
-         updateAppGrid();
          updateAppInfoPanel();
      }
  }
@@ -248,8 +253,9 @@
          index = apps.size() - 1;
      }
      
+     uint8_t previous = selectedIndex;
      selectedIndex = index;
-     updateAppGrid();
+     updateSelection(previous);
      updateAppInfoPanel();
  }
  
@@ -388,18 +394,19 @@
      lv_obj_align(appDescLabel, appInfoPanel, LV_ALIGN_IN_LEFT_MID, 10, 8);
      lv_label_set_text(appDescLabel, "");
      lv_obj_set_style_local_text_color(appDescLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, lv_color_hex(0x666666));
-     lv_obj_set_style_local_text_font(appDescLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, &lv_font_montserrat_12);
+     lv_obj_set_style_local_text_font(appDescLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, assets.getFont("montserrat_12"));
      
      // Update info panel with selected app
      updateAppInfoPanel();
  }
  
  /**
-  * @brief Update the app grid
+  * @brief Rebuild the app grid
   */
  void Launcher::updateAppGrid() {
      // First delete all existing children
      lv_obj_clean(gridContainer);
+     appButtons.clear();
      
      // Create a button and image for each app
      for (size_t i = 0; i < apps.size(); i++) {
@@ -410,11 +417,10 @@
          lv_img_set_src(img, apps[i].iconDesc);
          lv_obj_align(img, btn, LV_ALIGN_CENTER, 0, 0);
          
-         // Set button style based on selection
+         // The selected style is added on top, so selection only adds or removes it
+         lv_obj_add_style(btn, LV_BTN_PART_MAIN, &iconStyle);
          if (i == selectedIndex) {
              lv_obj_add_style(btn, LV_BTN_PART_MAIN, &iconStyleSelected);
-         } else {
-             lv_obj_add_style(btn, LV_BTN_PART_MAIN, &iconStyle);
          }
          
          // Set button click handler
@@ -423,53 +429,67 @@
          
          // Store app index in tag
          lv_obj_set_tag(btn, i);
+         appButtons.push_back(btn);
      }
  }
  
  /**
-  * @brief Update the status bar
+  * @brief Move the selected style from one button to another
   */
- void Launcher::updateStatusBar() {
-     if (!statusBar) return;
-     
-     // Update clock
-     char timeStr[6]; // HH:MM + null terminator
-     time_t now;
-     struct tm* timeinfo;
-     time(&now);
-     timeinfo = localtime(&now);
-     sprintf(timeStr, "%02d:%02d", timeinfo->tm_hour, timeinfo->tm_min);
-     lv_label_set_text(statusClock, timeStr);
+ void Launcher::updateSelection(uint8_t previous) {
+     if (previous == selectedIndex) return;
      
-     // Update battery status
-     extern PowerManager powerManager; // External reference to power manager
-     int batteryPercent = powerManager.getBatteryPercentage();
-     
-     if (batteryPercent < TDECK_BATTERY_LOW_THRESHOLD) {
-         lv_img_set_src(statusBattery, &icon_battery_low);
-     } else {
-         lv_img_set_src(statusBattery, &icon_battery_full);
+     // Only the two buttons involved are invalidated
+     if (previous < appButtons.size()) {
+         lv_obj_remove_style(appButtons[previous], LV_BTN_PART_MAIN, &iconStyleSelected);
+     }
+     if (selectedIndex < appButtons.size()) {
+         lv_obj_add_style(appButtons[selectedIndex], LV_BTN_PART_MAIN, &iconStyleSelected);
      }
+ }
+ 
+ /**
+  * @brief Show the time
+  */
+ void Launcher::updateClock(uint8_t hour, uint8_t minute) {
+     int16_t minuteOfDay = hour * 60 + minute;
+     if (!statusClock || minuteOfDay == shownMinute) return;
      
-     // Update WiFi status
-     extern WiFiManager wifiManager; // External reference to WiFi manager
-     bool wifiConnected = wifiManager.isConnected();
+     char timeStr[6]; // HH:MM + null terminator
+     snprintf(timeStr, sizeof(timeStr), "%02d:%02d", hour, minute);
+     lv_label_set_text(statusClock, timeStr);
+     shownMinute = minuteOfDay;
+ }
+ 
+ /**
+  * @brief Show the battery state
+  */
+ void Launcher::updateBatteryStatus(uint8_t percentage) {
+     bool low = percentage < TDECK_BATTERY_LOW_THRESHOLD;
+     if (!statusBattery || low == shownBatteryLow) return;
      
-     if (wifiConnected) {
-         lv_img_set_src(statusWifi, &icon_wifi_connected);
-     } else {
-         lv_img_set_src(statusWifi, &icon_wifi_disconnected);
-     }
+     lv_img_set_src(statusBattery, low ? &icon_battery_low : &icon_battery_full);
+     shownBatteryLow = low;
+ }
+ 
+ /**
+  * @brief Show the WiFi state
+  */
+ void Launcher::updateWiFiStatus(bool connected) {
+     if (!statusWifi || connected == shownWifi) return;
      
-     // Update Bluetooth status
-     extern BluetoothManager btManager; // External reference to BT manager
-     bool btActive = btManager.isActive();
+     lv_img_set_src(statusWifi, connected ? &icon_wifi_connected : &icon_wifi_disconnected);
+     shownWifi = connected;
+ }
+ 
+ /**
+  * @brief Show the Bluetooth state
+  */
+ void Launcher::updateBluetoothStatus(bool active) {
+     if (!statusBluetooth || active == shownBluetooth) return;
      
-     if (btActive) {
-         lv_img_set_src(statusBluetooth, &icon_bluetooth_on);
-     } else {
-         lv_img_set_src(statusBluetooth, &icon_bluetooth_off);
-     }
+     lv_img_set_src(statusBluetooth, active ? &icon_bluetooth_on : &icon_bluetooth_off);
+     shownBluetooth = active;
  }
  
  /**
@@ -509,14 +529,4 @@
      // Select and launch app
      launcher->setSelectedIndex(index);
      launcher->launchApp(index);
- }
- 
- /**
-  * @brief Periodic timer callback for updating status bar
-  */
- void Launcher::statusBarTimerCallback(lv_task_t* task) {
-     Launcher* launcher = (Launcher*)task->user_data;
-     if (launcher) {
-         launcher->updateStatusBar();
-     }
  }
\ No newline at end of file
@@ -4,6 +4,9 @@
  * 
  * This class implements the home screen and app launcher functionality,
  * providing a grid of app icons that can be navigated using touch or keyboard.
+ * App icons come from one atlas in the asset partition. The status bar is
+ * only redrawn when UIManager pushes a changed value, so an idle launcher
+ * does not redraw at all.
  */
 
  #ifndef TDECK_LAUNCHER_H
@@ -111,6 +114,31 @@
       * @return true if key was handled, false otherwise
       */
      bool handleKeyPress(uint32_t key);
+     
+     /**
+      * @brief Show the time, redraws the clock only when the minute changes
+      * @param hour Hour (0-23)
+      * @param minute Minute (0-59)
+      */
+     void updateClock(uint8_t hour, uint8_t minute);
+     
+     /**
+      * @brief Show the battery state, redraws the icon only when it crosses the low threshold
+      * @param percentage Battery percentage (0-100)
+      */
+     void updateBatteryStatus(uint8_t percentage);
+     
+     /**
+      * @brief Show the WiFi state, redraws the icon only when it changes
+      * @param connected Whether WiFi is connected
+      */
+     void updateWiFiStatus(bool connected);
+     
+     /**
+      * @brief Show the Bluetooth state, redraws the icon only when it changes
+      * @param active Whether Bluetooth is active
+      */
+     void updateBluetoothStatus(bool active);
  
  private:
      lv_obj_t* parent;                // Parent LVGL container
@@ -124,6 +152,13 @@
      lv_obj_t* appInfoPanel;          // Panel showing selected app info
      lv_obj_t* appNameLabel;          // Label showing app name
      lv_obj_t* appDescLabel;          // Label showing app description
+     std::vector<lv_obj_t*> appButtons; // Grid button of each app
+     
+     // Status shown in the status bar, starting as created
+     int16_t shownMinute;             // Minute of the day on the clock, -1 before the first update
+     bool shownBatteryLow;
+     bool shownWifi;
+     bool shownBluetooth;
      
      std::vector<AppInfo> apps;       // Vector of registered apps
      uint8_t selectedIndex;           // Currently selected app index
@@ -157,14 +192,15 @@
      void createAppInfoPanel();
      
      /**
-      * @brief Update the app grid
+      * @brief Rebuild the app grid, only needed when the apps change
       */
      void updateAppGrid();
      
      /**
-      * @brief Update the status bar
+      * @brief Move the selected style from one button to another
+      * @param previous Index selected before
       */
-     void updateStatusBar();
+     void updateSelection(uint8_t previous);
      
      /**
       * @brief Update the app info panel
@@ -182,12 +218,6 @@
       * @param event Event data
       */
      static void iconClickHandler(lv_obj_t* obj, lv_event_t event);
-     
-     /**
-      * @brief Periodic timer callback for updating status bar
-      * @param timer Timer instance
-      */
-     static void statusBarTimerCallback(lv_task_t* task);
  };
  
  #endif // TDECK_LAUNCHER_H
\ No newline at end of file
@@ -4,6 +4,8 @@
  */
 
  #include "lora_messenger.h"
+ #include "../ui/ui_manager.h"
+ #include "../system/config_storage.h"
  #include <ArduinoJson.h>
  #include <time.h>
  
@@ -19,12 +21,54 @@
  
  // Message format: [MSG_HEADER][sender_len(1)][sender(var)][content_len(2)][content(var)][timestamp(4)]
  
+ // Received packet handed from the LoRa comms task to the UI task, no payload copy
+ static void handlePacketOnUI(void* arg) {
+     LoRaPacketRef packet = LoRaPacketRef::adopt((LoRaPacket*)arg);
+     uint16_t conversation = packet->destId == 0xFFFF ? MESSAGE_BROADCAST : packet->sourceId;
+     loraMessenger.onMessageReceived(packet->payload, packet->length, conversation);
+ }
+ 
+ // Runs on the LoRa comms task
+ static void loraPacketCallback(const LoRaPacketRef& packet) {
+     if (packet->messageType != LORA_MSG_TEXT) {
+         return;
+     }
+     
+     // The work item holds its own reference until the UI task is done
+     LoRaPacket* shared = LoRaPacketRef(packet).release();
+     if (!uiManager.postWork(handlePacketOnUI, shared)) {
+         LoRaPacketRef::adopt(shared);
+     }
+ }
+ 
+ // Received voice note handed from the decode task to the UI task
+ struct VoiceNoteNotice {
+     String sender;
+     uint32_t durationMs;
+ };
+ 
+ static void handleVoiceOnUI(void* arg) {
+     VoiceNoteNotice* notice = (VoiceNoteNotice*)arg;
+     loraMessenger.onVoiceReceived(notice->sender, notice->durationMs);
+     delete notice;
+ }
+ 
+ // Runs on the voice decode task, the note is already playing
+ static void voiceNoteCallback(uint16_t sourceId, const char* sender, uint32_t durationMs) {
+     VoiceNoteNotice* notice = new VoiceNoteNotice{String(sender), durationMs};
+     if (!uiManager.postWork(handleVoiceOnUI, notice)) {
+         delete notice;
+     }
+ }
+ 
  LoRaMessenger::LoRaMessenger() : 
+     AppBase("LoRa"),
      _parent(nullptr),
      _container(nullptr),
      _messageList(nullptr),
      _inputField(nullptr),
      _sendBtn(nullptr),
+     _talkBtn(nullptr),
      _settingsBtn(nullptr),
      _statusLabel(nullptr),
      _settingsDialog(nullptr),
@@ -34,6 +78,9 @@
      _bandwidthInput(nullptr),
      _active(false),
      _userIdentifier("User"),
+     _store(TDECK_MESSAGE_LOG_FILE, TDECK_MESSAGE_INDEX_FILE),
+     _conversation(MESSAGE_BROADCAST),
+     _firstLoaded(0),
      _messageReceived(false)
  {
      // Get LoRa manager instance
@@ -42,33 +89,42 @@
  }
  
  LoRaMessenger::~LoRaMessenger() {
-     // Save messages and settings on destruction
+     // Save settings on destruction, messages are stored as they arrive
      if (_active) {
-         saveMessages();
          saveSettings();
      }
  }
  
+ bool LoRaMessenger::begin() {
+     // Load settings
+     loadSettings();
+     
+     // Open the message log so messages are stored before the app is first shown
+     _store.open();
+     
+     // Register receive callback with LoRa Manager
+     _loraManager->setMessageCallback(loraPacketCallback);
+     
+     // Voice notes arrive as fragmented transfers and play as they are shown
+     if (loraVoice.init()) {
+         loraVoice.setReceiveCallback(voiceNoteCallback);
+     }
+     
+     return true;
+ }
+ 
  bool LoRaMessenger::init(lv_obj_t* parent) {
      TDECK_LOG_I("Initializing LoRa Messenger");
      
      // Store parent container
      _parent = parent;
      
-     // Load settings
-     loadSettings();
-     
      // Create UI components
      createUI();
      
-     // Load previous messages
+     // Show the last messages of the log
      loadMessages();
      
-     // Register receive callback with LoRa Manager
-     // Note: This would be properly handled in a real implementation
-     // Here we would typically set up a way for the LoRaManager to call
-     // our onMessageReceived method when data arrives.
-     
      TDECK_LOG_I("LoRa Messenger initialized");
      return true;
  }
@@ -96,15 +152,68 @@
          lv_obj_set_hidden(_container, true);
      }
      
-     // Save messages and settings
-     saveMessages();
+     // Save settings
      saveSettings();
      
      // Set as inactive
      _active = false;
  }
  
+ bool LoRaMessenger::onCreate(lv_obj_t* parent) {
+     if (!init(parent)) {
+         return false;
+     }
+     
+     lv_obj_set_hidden(_container, true);
+     
+     // Bring back the message being typed when the UI was destroyed
+     if (_draft.length() > 0) {
+         lv_ta_set_text(_inputField, _draft.c_str());
+         _draft = "";
+     }
+     
+     return true;
+ }
+ 
+ void LoRaMessenger::onResume() {
+     start();
+ }
+ 
+ void LoRaMessenger::onPause() {
+     stop();
+ }
+ 
+ void LoRaMessenger::onDestroy() {
+     _draft = lv_ta_get_text(_inputField);
+     
+     // A note still being recorded has lost its button release
+     loraVoice.cancelNote();
+     
+     // The dialog is not a child of the container
+     if (_settingsDialog) {
+         lv_obj_del(_settingsDialog);
+         _settingsDialog = nullptr;
+         _nameInput = nullptr;
+         _frequencyInput = nullptr;
+         _spreadingInput = nullptr;
+         _bandwidthInput = nullptr;
+     }
+     
+     lv_obj_del(_container);
+     _container = nullptr;
+     _messageList = nullptr;
+     _inputField = nullptr;
+     _sendBtn = nullptr;
+     _talkBtn = nullptr;
+     _settingsBtn = nullptr;
+     _statusLabel = nullptr;
+     _firstLoaded = 0;
+ }
+ 
  void LoRaMessenger::update() {
+     // Compact the message log a few records at a time
+     _store.service();
+     
      // Only process if active
      if (!_active) return;
      
@@ -117,6 +226,11 @@
          lv_page_focus(_messageList, NULL, LV_ANIM_ON);
      }
      
+     // Page older history in once the list is scrolled to the top
+     if (_firstLoaded > 0 && lv_obj_get_y(lv_page_get_scrl(_messageList)) >= 0) {
+         loadOlderMessages();
+     }
+     
      // Update status display
      static uint32_t lastStatusUpdate = 0;
      uint32_t now = millis();
@@ -137,25 +251,34 @@
          return false;
      }
      
+     size_t packetLen = MSG_HEADER_LEN + 1 + _userIdentifier.length() + 2 + message.length() + 4;
+     if (packetLen > LORA_MAX_PAYLOAD_LENGTH) {
+         TDECK_LOG_W("Message too long for one LoRa packet: %d", packetLen);
+         return false;
+     }
+     
      // Create message structure for UI
      LoRaMessage msg;
      msg.sender = _userIdentifier;
      msg.content = message;
      msg.timestamp = millis(); // In a real app, we'd use a proper timestamp
      msg.incoming = false;
+     msg.conversation = MESSAGE_BROADCAST;
      
      // Add to UI
      addMessageToUI(msg);
      
-     // Add to message history
-     _messages.push_back(msg);
+     // Append to the message log
+     _store.append(msg);
      
-     // Save messages
-     saveMessages();
+     // Build the message straight into a pooled packet
+     LoRaPacketRef loraPacket = _loraManager->createPacket(LORA_MSG_TEXT, 0xFFFF);
+     if (!loraPacket) {
+         return false;
+     }
      
-     // Create LoRa packet
-     uint8_t packet[256]; // Max packet size
-     size_t packetLen = 0;
+     uint8_t* packet = loraPacket->payload;
+     packetLen = 0;
      
      // Add header
      memcpy(packet, MSG_HEADER, MSG_HEADER_LEN);
@@ -182,13 +305,17 @@
      packet[packetLen++] = (timestamp >> 8) & 0xFF;
      packet[packetLen++] = (timestamp >> 16) & 0xFF;
      packet[packetLen++] = (timestamp >> 24) & 0xFF;
+     loraPacket->length = packetLen;
+     
+     // Chat text shrinks by about 40% with the dictionary, receivers get it expanded
+     _loraManager->compressText(*loraPacket);
      
      // Send through LoRa
      TDECK_LOG_I("Sending LoRa message, len: %d", packetLen);
-     return _loraManager->sendPacket(packet, packetLen);
+     return _loraManager->sendPacket(loraPacket);
  }
  
- void LoRaMessenger::onMessageReceived(uint8_t* data, size_t len) {
+ void LoRaMessenger::onMessageReceived(uint8_t* data, size_t len, uint16_t conversation) {
      // Check if this is a message for our app (check header)
      if (len < MSG_HEADER_LEN || memcmp(data, MSG_HEADER, MSG_HEADER_LEN) != 0) {
          // Not for us
@@ -230,15 +357,15 @@
      msg.content = content;
      msg.timestamp = timestamp;
      msg.incoming = true;
+     msg.conversation = conversation;
      
-     // Add to UI
-     addMessageToUI(msg);
-     
-     // Add to message history
-     _messages.push_back(msg);
+     // Add to UI if its conversation is shown, before the first launch the log has it
+     if (_messageList && conversation == _conversation) {
+         addMessageToUI(msg);
+     }
      
-     // Save messages
-     saveMessages();
+     // Append to the message log
+     _store.append(msg);
      
      // Set flag for new message
      _messageReceived = true;
@@ -246,6 +373,15 @@
      TDECK_LOG_I("Received message from %s: %s", sender.c_str(), content.c_str());
  }
  
+ void LoRaMessenger::onVoiceReceived(const String& sender, uint32_t durationMs, uint16_t conversation) {
+     addVoiceNote(sender, durationMs, true, conversation);
+     
+     // Set flag for new message
+     _messageReceived = true;
+     
+     TDECK_LOG_I("Received voice note from %s: %u ms", sender.c_str(), durationMs);
+ }
+ 
  void LoRaMessenger::setActive(bool active) {
      _active = active;
      
@@ -289,10 +425,11 @@
      lv_obj_align(_messageList, _container, LV_ALIGN_IN_TOP_MID, 0, 40);
      lv_page_set_scrl_width(_messageList, TDECK_DISPLAY_WIDTH - 30);
      lv_page_set_scrollable_fit(_messageList, LV_FIT_TIGHT);
+     lv_page_set_scrl_layout(_messageList, LV_LAYOUT_COLUMN_MID); // Stack bubbles, oldest at the top
      
      // Create input field
      _inputField = lv_ta_create(_container, NULL);
-     lv_obj_set_size(_inputField, TDECK_DISPLAY_WIDTH - 90, 40);
+     lv_obj_set_size(_inputField, TDECK_DISPLAY_WIDTH - 140, 40);
      lv_obj_align(_inputField, _container, LV_ALIGN_IN_BOTTOM_LEFT, 5, -5);
      lv_ta_set_placeholder_text(_inputField, "Type a message...");
      lv_ta_set_one_line(_inputField, true);
@@ -307,14 +444,24 @@
      lv_obj_t* sendBtnLabel = lv_label_create(_sendBtn, NULL);
      lv_label_set_text(sendBtnLabel, "Send");
      
+     // Create push-to-talk button, between the input field and the send button
+     _talkBtn = lv_btn_create(_container, NULL);
+     lv_obj_set_size(_talkBtn, 45, 40);
+     lv_obj_align(_talkBtn, _sendBtn, LV_ALIGN_OUT_LEFT_MID, -5, 0);
+     lv_obj_set_event_cb(_talkBtn, onTalkBtnEvent);
+     
+     lv_obj_t* talkBtnLabel = lv_label_create(_talkBtn, NULL);
+     lv_label_set_text(talkBtnLabel, LV_SYMBOL_AUDIO);
+     
      // Set user data reference for callbacks
      lv_obj_set_user_data(_container, this);
      lv_obj_set_user_data(_sendBtn, this);
+     lv_obj_set_user_data(_talkBtn, this);
      lv_obj_set_user_data(_settingsBtn, this);
      lv_obj_set_user_data(_inputField, this);
  }
  
- void LoRaMessenger::addMessageToUI(const LoRaMessage& message) {
+ void LoRaMessenger::addMessageToUI(const LoRaMessage& message, bool prepend) {
      // Message bubble (container)
      lv_obj_t* bubble = lv_cont_create(_messageList, NULL);
      
@@ -382,86 +529,74 @@
      // Move next message position down
      lv_page_glue_obj(bubble, true);
      
+     // Older history goes above the messages shown, the view stays where it is
+     if (prepend) {
+         lv_obj_move_background(bubble);
+         return;
+     }
+     
      // Scroll to show the new message
      lv_page_focus(_messageList, bubble, LV_ANIM_ON);
  }
  
+ void LoRaMessenger::addVoiceNote(const String& sender, uint32_t durationMs, bool incoming, uint16_t conversation) {
+     // Stored as text, the audio itself is not kept in the message log
+     char content[32];
+     snprintf(content, sizeof(content), LV_SYMBOL_AUDIO " Voice note, %u.%u s", durationMs / 1000, (durationMs % 1000) / 100);
+     
+     LoRaMessage msg;
+     msg.sender = sender;
+     msg.content = content;
+     msg.timestamp = millis();
+     msg.incoming = incoming;
+     msg.conversation = conversation;
+     
+     if (_messageList && conversation == _conversation) {
+         addMessageToUI(msg);
+     }
+     _store.append(msg);
+ }
+ 
  void LoRaMessenger::clearMessages() {
      // Remove all messages from UI
      lv_obj_t* page_scrl = lv_page_get_scrl(_messageList);
      lv_obj_clean(page_scrl);
      
-     // Clear message history
-     _messages.clear();
+     // Drop the conversation from the message log
+     _store.clear(_conversation);
+     _firstLoaded = 0;
  }
  
  void LoRaMessenger::loadMessages() {
-     // Load messages from storage
-     String messagesPath = "/messages.json";
-     
-     // Check if file exists
-     if (!_fsManager->fileExists(messagesPath)) {
-         TDECK_LOG_I("No saved messages found");
-         return;
-     }
-     
-     // Load JSON file
-     DynamicJsonDocument doc(16384); // Adjust size based on expected message volume
-     
-     if (!_fsManager->loadJsonFromFile(messagesPath, doc)) {
-         TDECK_LOG_E("Failed to load messages from storage");
-         return;
-     }
-     
-     // Clear existing messages
-     _messages.clear();
+     // Only the last screenful is read, older messages page in on scroll
+     size_t total = _store.count(_conversation);
+     _firstLoaded = total > TDECK_MESSAGE_PAGE_SIZE ? total - TDECK_MESSAGE_PAGE_SIZE : 0;
      
-     // Parse JSON and add messages
-     JsonArray messagesArray = doc["messages"].as<JsonArray>();
-     
-     for (JsonObject msgObj : messagesArray) {
-         LoRaMessage msg;
-         msg.sender = msgObj["sender"].as<String>();
-         msg.content = msgObj["content"].as<String>();
-         msg.timestamp = msgObj["timestamp"].as<uint32_t>();
-         msg.incoming = msgObj["incoming"].as<bool>();
-         
-         // Add to message history
-         _messages.push_back(msg);
-         
-         // Add to UI
+     std::vector<LoRaMessage> page;
+     _store.read(_conversation, _firstLoaded, total - _firstLoaded, page);
+     for (const LoRaMessage& msg : page) {
          addMessageToUI(msg);
      }
      
-     TDECK_LOG_I("Loaded %d messages from storage", _messages.size());
+     TDECK_LOG_I("Loaded %d of %d messages from storage", page.size(), total);
  }
  
- void LoRaMessenger::saveMessages() {
-     // Save messages to storage
-     String messagesPath = "/messages.json";
+ void LoRaMessenger::loadOlderMessages() {
+     size_t first = _firstLoaded > TDECK_MESSAGE_PAGE_SIZE ? _firstLoaded - TDECK_MESSAGE_PAGE_SIZE : 0;
      
-     // Create JSON document
-     DynamicJsonDocument doc(16384); // Adjust size based on expected message volume
-     
-     // Create messages array
-     JsonArray messagesArray = doc.createNestedArray("messages");
-     
-     // Add messages to JSON
-     for (const LoRaMessage& msg : _messages) {
-         JsonObject msgObj = messagesArray.createNestedObject();
-         msgObj["sender"] = msg.sender;
-         msgObj["content"] = msg.content;
-         msgObj["timestamp"] = msg.timestamp;
-         msgObj["incoming"] = msg.incoming;
-     }
+     std::vector<LoRaMessage> page;
+     _store.read(_conversation, first, _firstLoaded - first, page);
+     _firstLoaded = first;
      
-     // Save JSON to file
-     if (!_fsManager->saveJsonToFile(messagesPath, doc)) {
-         TDECK_LOG_E("Failed to save messages to storage");
-         return;
+     // Insert newest first, each bubble goes above the previous one
+     lv_obj_t* page_scrl = lv_page_get_scrl(_messageList);
+     lv_coord_t heightBefore = lv_obj_get_height(page_scrl);
+     for (auto it = page.rbegin(); it != page.rend(); ++it) {
+         addMessageToUI(*it, true);
      }
      
-     TDECK_LOG_I("Saved %d messages to storage", _messages.size());
+     // Shift by the added height so the message at the top of the view stays put
+     lv_obj_set_y(page_scrl, lv_obj_get_y(page_scrl) - (lv_obj_get_height(page_scrl) - heightBefore));
  }
  
  void LoRaMessenger::loadSettings() {
@@ -481,7 +616,7 @@
      // Load JSON file
      DynamicJsonDocument doc(512);
      
-     if (!_fsManager->loadJsonFromFile(SETTINGS_PATH, doc)) {
+     if (!configStorage.read(SETTINGS_PATH, doc)) {
          TDECK_LOG_E("Failed to load settings from storage");
          return;
      }
@@ -519,7 +654,7 @@
      doc["bandwidth"] = _loraManager->getBandwidth();
      
      // Save JSON to file
-     if (!_fsManager->saveJsonToFile(SETTINGS_PATH, doc)) {
+     if (!configStorage.write(SETTINGS_PATH, doc)) {
          TDECK_LOG_E("Failed to save settings");
          return;
      }
@@ -604,4 +739,20 @@
          // Dialog already exists, just show it
          lv_obj_set_hidden(_settingsDialog, false);
      }
+ }
+ 
+ void LoRaMessenger::onTalkBtnEvent(lv_obj_t* btn, lv_event_t event) {
+     LoRaMessenger* self = (LoRaMessenger*)lv_obj_get_user_data(btn);
+     
+     // Record while held, send on release, dropping the finger off the button sends too
+     if (event == LV_EVENT_PRESSED) {
+         if (!loraVoice.startNote(0xFFFF)) {
+             lv_label_set_text(self->_statusLabel, "Voice notes unavailable");
+         }
+     } else if (event == LV_EVENT_RELEASED || event == LV_EVENT_PRESS_LOST) {
+         uint32_t durationMs = loraVoice.finishNote(self->_userIdentifier);
+         if (durationMs > 0) {
+             self->addVoiceNote(self->_userIdentifier, durationMs, false, MESSAGE_BROADCAST);
+         }
+     }
  }
\ No newline at end of file
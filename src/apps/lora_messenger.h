@@ -15,23 +15,24 @@
  #include <string>
  #include "../config.h"
  #include "../comms/lora.h"
+ #include "../comms/lora_voice.h"
  #include "../system/fs_manager.h"
+ #include "message_store.h"
+ #include "app_base.h"
  
- // Message structure for LoRa communication
- struct LoRaMessage {
-     String sender;       // Sender identifier (name or ID)
-     String content;      // Message content
-     uint32_t timestamp;  // Message timestamp
-     bool incoming;       // True if received message, false if sent by this device
- };
- 
- class LoRaMessenger {
+ class LoRaMessenger : public AppBase {
  public:
      LoRaMessenger();
      ~LoRaMessenger();
  
      /**
-      * Initialize the LoRa Messenger application
+      * Open the message log and start receiving, without building the UI
+      * @return True if started successfully
+      */
+     bool begin();
+ 
+     /**
+      * Initialize the LoRa Messenger UI, begin() must have run
       * @param parent Parent LVGL container
       * @return True if initialized successfully
       */
@@ -70,8 +71,17 @@
       * Callback for when new LoRa message is received
       * @param data Received data
       * @param len Data length
+      * @param conversation Peer device ID, MESSAGE_BROADCAST for the shared channel
+      */
+     void onMessageReceived(uint8_t* data, size_t len, uint16_t conversation = MESSAGE_BROADCAST);
+     
+     /**
+      * Callback for when a voice note was received, it is already playing
+      * @param sender Sender name
+      * @param durationMs Note length in milliseconds
+      * @param conversation Peer device ID, MESSAGE_BROADCAST for the shared channel
       */
-     void onMessageReceived(uint8_t* data, size_t len);
+     void onVoiceReceived(const String& sender, uint32_t durationMs, uint16_t conversation = MESSAGE_BROADCAST);
  
      /**
       * Set the active state of the app
@@ -85,6 +95,13 @@
       */
      bool isActive() const;
  
+ protected:
+     // AppBase lifecycle, history is reloaded from the message log
+     bool onCreate(lv_obj_t* parent) override;
+     void onResume() override;
+     void onPause() override;
+     void onDestroy() override;
+ 
  private:
      // LVGL UI components
      lv_obj_t* _parent;           // Parent container
@@ -92,6 +109,7 @@
      lv_obj_t* _messageList;      // Container for message bubbles
      lv_obj_t* _inputField;       // Text input field
      lv_obj_t* _sendBtn;          // Send button
+     lv_obj_t* _talkBtn;          // Push-to-talk button, records a voice note while held
      lv_obj_t* _settingsBtn;      // Settings button
      lv_obj_t* _statusLabel;      // Status label
      
@@ -105,7 +123,10 @@
      // Application state
      bool _active;                // Is the application currently active
      String _userIdentifier;      // User name/identifier
-     std::vector<LoRaMessage> _messages;  // Message history
+     MessageStore _store;         // Message history on storage
+     uint16_t _conversation;      // Conversation shown
+     size_t _firstLoaded;         // Number of the oldest message shown
+     String _draft;               // Unsent input text kept while the UI is destroyed
      LoRaManager* _loraManager;   // Reference to LoRa manager
      FSManager* _fsManager;       // Reference to filesystem manager
      bool _messageReceived;       // Flag for new message received
@@ -121,8 +142,18 @@
      /**
       * Add a message to the UI
       * @param message Message to add
+      * @param prepend True to insert above the messages shown, for older history
+      */
+     void addMessageToUI(const LoRaMessage& message, bool prepend = false);
+     
+     /**
+      * Show and store a voice note as a message
+      * @param sender Sender name
+      * @param durationMs Note length in milliseconds
+      * @param incoming True if received
+      * @param conversation Peer device ID, MESSAGE_BROADCAST for the shared channel
       */
-     void addMessageToUI(const LoRaMessage& message);
+     void addVoiceNote(const String& sender, uint32_t durationMs, bool incoming, uint16_t conversation);
  
      /**
       * Clear all messages from the UI
@@ -130,14 +161,14 @@
      void clearMessages();
  
      /**
-      * Load messages from storage
+      * Load the last screenful of messages from storage
       */
      void loadMessages();
  
      /**
-      * Save messages to storage
+      * Load the page of messages before the oldest one shown
       */
-     void saveMessages();
+     void loadOlderMessages();
  
      /**
       * Load settings from storage
@@ -166,6 +197,7 @@
  
      // LVGL callbacks
      static void onSendBtnClick(lv_obj_t* btn, lv_event_t event);
+     static void onTalkBtnEvent(lv_obj_t* btn, lv_event_t event);
      static void onSettingsBtnClick(lv_obj_t* btn, lv_event_t event);
      static void onInputSubmit(lv_obj_t* ta, lv_event_t event);
      static void onSettingsApply(lv_obj_t* btn, lv_event_t event);
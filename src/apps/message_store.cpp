@@ -0,0 +1,511 @@
+/**
+ * @file message_store.cpp
+ * @brief Implementation of the append-only message log
+ */
+
+ #include "message_store.h"
+ #include "../system/fs_manager.h"
+ #include <algorithm>
+ 
+ // First byte of every record, lets recovery resynchronise after a torn write
+ static const uint8_t RECORD_MAGIC = 0xA5;
+ 
+ // Index entries read per file access at boot
+ static const size_t INDEX_READ_ENTRIES = 64;
+ 
+ // CRC-16/CCITT-FALSE, continuing from crc
+ static uint16_t crc16(uint16_t crc, const uint8_t* data, size_t length) {
+     while (length--) {
+         crc ^= (uint16_t)(*data++) << 8;
+         for (int i = 0; i < 8; i++) {
+             crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+         }
+     }
+     return crc;
+ }
+ 
+ // Serialise a record header, the checksum last
+ static void encodeHeader(uint8_t* raw, uint8_t flags, uint16_t conversation, uint32_t timestamp,
+                          uint8_t senderLength, uint16_t contentLength, uint16_t checksum) {
+     raw[0] = RECORD_MAGIC;
+     raw[1] = flags;
+     raw[2] = conversation & 0xFF;
+     raw[3] = conversation >> 8;
+     raw[4] = timestamp & 0xFF;
+     raw[5] = (timestamp >> 8) & 0xFF;
+     raw[6] = (timestamp >> 16) & 0xFF;
+     raw[7] = timestamp >> 24;
+     raw[8] = senderLength;
+     raw[9] = contentLength & 0xFF;
+     raw[10] = contentLength >> 8;
+     raw[11] = checksum & 0xFF;
+     raw[12] = checksum >> 8;
+ }
+ 
+ // Constructor
+ MessageStore::MessageStore(const char* logPath, const char* indexPath)
+     : _logPath(logPath)
+     , _indexPath(indexPath)
+     , _open(false)
+     , _logSize(0)
+     , _deadRecords(0)
+     , _compacting(false)
+     , _compactNext(0)
+     , _compactSize(0)
+     , _compactDead(0)
+ {
+ }
+ 
+ // Load the index and pick up records it missed
+ bool MessageStore::open() {
+     String logTmp = _logPath + ".tmp";
+     String indexTmp = _indexPath + ".tmp";
+ 
+     // A compaction interrupted between removing the old log and renaming the new one
+     if (!FSManager::file_exists(_logPath.c_str()) && FSManager::file_exists(logTmp.c_str())) {
+         FSManager::rename_file(logTmp.c_str(), _logPath.c_str());
+         if (!FSManager::file_exists(_indexPath.c_str()) && FSManager::file_exists(indexTmp.c_str())) {
+             FSManager::rename_file(indexTmp.c_str(), _indexPath.c_str());
+         }
+     }
+     FSManager::remove_file(logTmp.c_str());
+     FSManager::remove_file(indexTmp.c_str());
+ 
+     _conversations.clear();
+     _deadRecords = 0;
+     _logSize = 0;
+     int64_t logSize = FSManager::get_file_size(_logPath.c_str());
+     if (logSize > 0) {
+         _logSize = (uint32_t)logSize;
+     }
+ 
+     // Rebuild the per-conversation offsets from the index, the log is not parsed
+     bool consistent = true;
+     bool indexed = false;
+     uint32_t lastOffset = 0;
+     fs::File index = FSManager::open_file(_indexPath.c_str(), FILE_READ);
+     if (index) {
+         uint8_t buffer[INDEX_READ_ENTRIES * MESSAGE_INDEX_ENTRY_SIZE];
+         int length;
+         while (consistent && (length = index.read(buffer, sizeof(buffer))) > 0) {
+             if (length % MESSAGE_INDEX_ENTRY_SIZE != 0) {
+                 consistent = false;
+             }
+             for (int pos = 0; consistent && pos + MESSAGE_INDEX_ENTRY_SIZE <= length; pos += MESSAGE_INDEX_ENTRY_SIZE) {
+                 const uint8_t* entry = buffer + pos;
+                 uint32_t offset = entry[0] | (entry[1] << 8) | (entry[2] << 16) | ((uint32_t)entry[3] << 24);
+                 uint16_t conversation = entry[4] | (entry[5] << 8);
+ 
+                 // Offsets only grow, anything else means the index was torn or is stale
+                 if (offset >= _logSize || (indexed && offset <= lastOffset)) {
+                     consistent = false;
+                     break;
+                 }
+                 _deadRecords += apply(_conversations, offset, conversation, entry[6]);
+                 lastOffset = offset;
+                 indexed = true;
+             }
+         }
+         index.close();
+     }
+ 
+     // Records past the last index entry were written but not indexed
+     uint32_t from = 0;
+     if (consistent && indexed) {
+         fs::File log = FSManager::open_file(_logPath.c_str(), FILE_READ);
+         RecordHeader header;
+         std::vector<uint8_t> body;
+         if (log && readRecord(log, lastOffset, header, body)) {
+             from = lastOffset + MESSAGE_RECORD_HEADER_SIZE + body.size();
+         } else {
+             consistent = false;
+         }
+         log.close();
+     }
+ 
+     if (!consistent) {
+         TDECK_LOG_W("Message index out of date, rebuilding from the log");
+         _conversations.clear();
+         _deadRecords = 0;
+         FSManager::remove_file(_indexPath.c_str());
+         from = 0;
+     }
+ 
+     if (from < _logSize) {
+         recover(from);
+     }
+ 
+     _open = true;
+ 
+     size_t total = 0;
+     for (const Conversation& conversation : _conversations) {
+         total += conversation.offsets.size();
+     }
+     TDECK_LOG_I("Message store: %d messages in %d conversations, %lu bytes", total, _conversations.size(),
+                 (unsigned long)_logSize);
+     return true;
+ }
+ 
+ // Append a message
+ bool MessageStore::append(const LoRaMessage& message) {
+     return appendRecord(message.incoming ? MESSAGE_FLAG_INCOMING : 0, message.conversation, message.timestamp,
+                         message.sender, message.content);
+ }
+ 
+ // Get the number of messages kept for a conversation
+ size_t MessageStore::count(uint16_t conversation) const {
+     for (const Conversation& entry : _conversations) {
+         if (entry.id == conversation) {
+             return entry.offsets.size();
+         }
+     }
+     return 0;
+ }
+ 
+ // Read a range of messages through the offset index
+ size_t MessageStore::read(uint16_t conversation, size_t first, size_t count, std::vector<LoRaMessage>& out) {
+     Conversation* entry = find(_conversations, conversation, false);
+     if (!entry || first >= entry->offsets.size()) {
+         return 0;
+     }
+ 
+     fs::File log = FSManager::open_file(_logPath.c_str(), FILE_READ);
+     if (!log) {
+         TDECK_LOG_E("Failed to open message log");
+         return 0;
+     }
+ 
+     size_t last = std::min(first + count, entry->offsets.size());
+     size_t read = 0;
+     RecordHeader header;
+     std::vector<uint8_t> body;
+     for (size_t i = first; i < last; i++) {
+         if (!readRecord(log, entry->offsets[i], header, body)) {
+             TDECK_LOG_W("Corrupt message record at %lu", (unsigned long)entry->offsets[i]);
+             continue;
+         }
+ 
+         LoRaMessage message;
+         message.sender = String((const char*)body.data(), header.senderLength);
+         message.content = String((const char*)body.data() + header.senderLength, header.contentLength);
+         message.timestamp = header.timestamp;
+         message.incoming = header.flags & MESSAGE_FLAG_INCOMING;
+         message.conversation = header.conversation;
+         out.push_back(message);
+         read++;
+     }
+ 
+     log.close();
+     return read;
+ }
+ 
+ // Drop a conversation with a tombstone record
+ bool MessageStore::clear(uint16_t conversation) {
+     // The copy in progress would bring the cleared records back
+     if (_compacting) {
+         abortCompaction();
+     }
+     return appendRecord(MESSAGE_FLAG_CLEAR, conversation, millis(), String(), String());
+ }
+ 
+ // Copy a batch of live records into the new log
+ bool MessageStore::service() {
+     if (!_open) {
+         return false;
+     }
+ 
+     if (!_compacting) {
+         if (_deadRecords < TDECK_MESSAGE_COMPACT_THRESHOLD) {
+             return false;
+         }
+         if (!startCompaction()) {
+             // Wait for more dead records before trying again
+             _deadRecords = 0;
+             return false;
+         }
+         return true;
+     }
+ 
+     fs::File log = FSManager::open_file(_logPath.c_str(), FILE_READ);
+     if (!log) {
+         TDECK_LOG_E("Failed to open message log");
+         abortCompaction();
+         return false;
+     }
+ 
+     RecordHeader header;
+     std::vector<uint8_t> body;
+     for (int i = 0; i < TDECK_MESSAGE_COMPACT_BATCH && _compactNext < _compactQueue.size(); i++) {
+         uint32_t offset = _compactQueue[_compactNext++];
+         if (!readRecord(log, offset, header, body)) {
+             TDECK_LOG_W("Dropping corrupt message record at %lu", (unsigned long)offset);
+             continue;
+         }
+ 
+         uint32_t newOffset = _compactSize;
+         if (!writeRecord(_compactLog, header, body.data(), body.data() + header.senderLength) ||
+             !writeIndexEntry(_compactIndex, newOffset, header.conversation, header.flags)) {
+             log.close();
+             TDECK_LOG_E("Message log compaction failed");
+             abortCompaction();
+             _deadRecords = 0;
+             return false;
+         }
+         _compactSize += MESSAGE_RECORD_HEADER_SIZE + body.size();
+         _compactDead += apply(_compactConversations, newOffset, header.conversation, header.flags);
+     }
+     log.close();
+ 
+     if (_compactNext < _compactQueue.size()) {
+         return true;
+     }
+ 
+     finishCompaction();
+     return false;
+ }
+ 
+ // Find a conversation, optionally adding it
+ MessageStore::Conversation* MessageStore::find(std::vector<Conversation>& index, uint16_t id, bool create) {
+     for (Conversation& entry : index) {
+         if (entry.id == id) {
+             return &entry;
+         }
+     }
+     if (!create) {
+         return nullptr;
+     }
+ 
+     index.push_back(Conversation());
+     index.back().id = id;
+     return &index.back();
+ }
+ 
+ // Apply one record to an index
+ uint32_t MessageStore::apply(std::vector<Conversation>& index, uint32_t offset, uint16_t conversation,
+                              uint8_t flags) {
+     Conversation* entry = find(index, conversation, true);
+ 
+     // The tombstone itself is dead as soon as it has done its job
+     if (flags & MESSAGE_FLAG_CLEAR) {
+         uint32_t dead = entry->offsets.size() + 1;
+         entry->offsets.clear();
+         return dead;
+     }
+ 
+     entry->offsets.push_back(offset);
+     if (entry->offsets.size() > TDECK_MESSAGE_HISTORY_MAX) {
+         entry->offsets.erase(entry->offsets.begin());
+         return 1;
+     }
+     return 0;
+ }
+ 
+ // Read one record and check its CRC
+ bool MessageStore::readRecord(fs::File& file, uint32_t offset, RecordHeader& header, std::vector<uint8_t>& body) {
+     uint8_t raw[MESSAGE_RECORD_HEADER_SIZE];
+     if (!file.seek(offset) || file.read(raw, sizeof(raw)) != sizeof(raw) || raw[0] != RECORD_MAGIC) {
+         return false;
+     }
+ 
+     header.flags = raw[1];
+     header.conversation = raw[2] | (raw[3] << 8);
+     header.timestamp = raw[4] | (raw[5] << 8) | (raw[6] << 16) | ((uint32_t)raw[7] << 24);
+     header.senderLength = raw[8];
+     header.contentLength = raw[9] | (raw[10] << 8);
+     header.checksum = raw[11] | (raw[12] << 8);
+ 
+     size_t length = header.senderLength + header.contentLength;
+     if (offset + sizeof(raw) + length > file.size()) {
+         return false;
+     }
+ 
+     body.resize(length);
+     if (length > 0 && file.read(body.data(), length) != length) {
+         return false;
+     }
+ 
+     uint16_t crc = crc16(0xFFFF, raw, MESSAGE_RECORD_HEADER_SIZE - 2);
+     return crc16(crc, body.data(), length) == header.checksum;
+ }
+ 
+ // Write one record
+ bool MessageStore::writeRecord(fs::File& file, RecordHeader& header, const uint8_t* sender, const uint8_t* content) {
+     uint8_t raw[MESSAGE_RECORD_HEADER_SIZE];
+     encodeHeader(raw, header.flags, header.conversation, header.timestamp, header.senderLength,
+                  header.contentLength, 0);
+ 
+     uint16_t crc = crc16(0xFFFF, raw, MESSAGE_RECORD_HEADER_SIZE - 2);
+     crc = crc16(crc, sender, header.senderLength);
+     header.checksum = crc16(crc, content, header.contentLength);
+     raw[11] = header.checksum & 0xFF;
+     raw[12] = header.checksum >> 8;
+ 
+     return file.write(raw, sizeof(raw)) == sizeof(raw) &&
+            file.write(sender, header.senderLength) == header.senderLength &&
+            file.write(content, header.contentLength) == header.contentLength;
+ }
+ 
+ // Write one index entry
+ bool MessageStore::writeIndexEntry(fs::File& file, uint32_t offset, uint16_t conversation, uint8_t flags) {
+     uint8_t entry[MESSAGE_INDEX_ENTRY_SIZE] = {
+         (uint8_t)(offset & 0xFF), (uint8_t)((offset >> 8) & 0xFF), (uint8_t)((offset >> 16) & 0xFF),
+         (uint8_t)(offset >> 24), (uint8_t)(conversation & 0xFF), (uint8_t)(conversation >> 8), flags, 0
+     };
+     return file.write(entry, sizeof(entry)) == sizeof(entry);
+ }
+ 
+ // Scan the log from an offset and index every valid record found
+ void MessageStore::recover(uint32_t from) {
+     fs::File log = FSManager::open_file(_logPath.c_str(), FILE_READ);
+     fs::File index = FSManager::open_file(_indexPath.c_str(), FILE_APPEND);
+     if (!log || !index) {
+         TDECK_LOG_E("Failed to open message store for recovery");
+         return;
+     }
+ 
+     uint32_t pos = from;
+     uint32_t recovered = 0;
+     uint32_t skipped = 0;
+     RecordHeader header;
+     std::vector<uint8_t> body;
+     while (pos + MESSAGE_RECORD_HEADER_SIZE <= _logSize) {
+         if (!readRecord(log, pos, header, body)) {
+             // Torn write, step forward until the next record checks out
+             pos++;
+             skipped++;
+             continue;
+         }
+ 
+         writeIndexEntry(index, pos, header.conversation, header.flags);
+         _deadRecords += apply(_conversations, pos, header.conversation, header.flags);
+         pos += MESSAGE_RECORD_HEADER_SIZE + body.size();
+         recovered++;
+     }
+ 
+     log.close();
+     index.close();
+ 
+     // Skipped bytes stay in the log until the next compaction
+     if (skipped > 0) {
+         _deadRecords++;
+         TDECK_LOG_W("Skipped %lu bytes of damaged message records", (unsigned long)skipped);
+     }
+     TDECK_LOG_I("Recovered %lu message records", (unsigned long)recovered);
+ }
+ 
+ // Append a record and its index entry
+ bool MessageStore::appendRecord(uint8_t flags, uint16_t conversation, uint32_t timestamp,
+                                 const String& sender, const String& content) {
+     if (!_open) {
+         return false;
+     }
+ 
+     RecordHeader header;
+     header.flags = flags;
+     header.conversation = conversation;
+     header.timestamp = timestamp;
+     header.senderLength = std::min(sender.length(), (unsigned int)UINT8_MAX);
+     header.contentLength = std::min(content.length(), (unsigned int)UINT16_MAX);
+ 
+     fs::File log = FSManager::open_file(_logPath.c_str(), FILE_APPEND);
+     if (!log) {
+         TDECK_LOG_E("Failed to open message log");
+         return false;
+     }
+ 
+     uint32_t offset = log.size();
+     bool written = writeRecord(log, header, (const uint8_t*)sender.c_str(), (const uint8_t*)content.c_str());
+     log.close();
+ 
+     if (!written) {
+         // A partial record is skipped by recovery and dropped by compaction
+         TDECK_LOG_E("Failed to append message");
+         int64_t size = FSManager::get_file_size(_logPath.c_str());
+         _logSize = size > 0 ? (uint32_t)size : _logSize;
+         _deadRecords++;
+         return false;
+     }
+     _logSize = offset + MESSAGE_RECORD_HEADER_SIZE + header.senderLength + header.contentLength;
+ 
+     // A missing index entry is found again by recovery at the next boot
+     fs::File index = FSManager::open_file(_indexPath.c_str(), FILE_APPEND);
+     if (!index || !writeIndexEntry(index, offset, conversation, flags)) {
+         TDECK_LOG_W("Failed to index message at %lu", (unsigned long)offset);
+     }
+     index.close();
+ 
+     _deadRecords += apply(_conversations, offset, conversation, flags);
+ 
+     // Records appended while compacting are copied at the end of the pass
+     if (_compacting) {
+         _compactQueue.push_back(offset);
+     }
+     return true;
+ }
+ 
+ // Queue every live record for copying
+ bool MessageStore::startCompaction() {
+     _compactQueue.clear();
+     for (const Conversation& conversation : _conversations) {
+         _compactQueue.insert(_compactQueue.end(), conversation.offsets.begin(), conversation.offsets.end());
+     }
+ 
+     // Copy in log order so the new log keeps the same order across conversations
+     std::sort(_compactQueue.begin(), _compactQueue.end());
+ 
+     _compactLog = FSManager::open_file((_logPath + ".tmp").c_str(), FILE_WRITE);
+     _compactIndex = FSManager::open_file((_indexPath + ".tmp").c_str(), FILE_WRITE);
+     if (!_compactLog || !_compactIndex) {
+         TDECK_LOG_E("Failed to start message log compaction");
+         abortCompaction();
+         return false;
+     }
+ 
+     _compactNext = 0;
+     _compactSize = 0;
+     _compactDead = 0;
+     _compactConversations.clear();
+     _compacting = true;
+ 
+     TDECK_LOG_I("Compacting message log: %d live records, %lu dead", _compactQueue.size(),
+                 (unsigned long)_deadRecords);
+     return true;
+ }
+ 
+ // Replace the old files with the compacted ones
+ bool MessageStore::finishCompaction() {
+     _compactLog.close();
+     _compactIndex.close();
+     _compacting = false;
+ 
+     // open() completes the swap if we lose power part way
+     FSManager::remove_file(_indexPath.c_str());
+     FSManager::remove_file(_logPath.c_str());
+     if (!FSManager::rename_file((_logPath + ".tmp").c_str(), _logPath.c_str()) ||
+         !FSManager::rename_file((_indexPath + ".tmp").c_str(), _indexPath.c_str())) {
+         TDECK_LOG_E("Failed to replace message log, store closed until restart");
+         _open = false;
+         return false;
+     }
+ 
+     TDECK_LOG_I("Message log compacted: %lu -> %lu bytes", (unsigned long)_logSize, (unsigned long)_compactSize);
+ 
+     _conversations.swap(_compactConversations);
+     _compactConversations.clear();
+     _compactQueue.clear();
+     _compactQueue.shrink_to_fit();
+     _logSize = _compactSize;
+     _deadRecords = _compactDead;
+     return true;
+ }
+ 
+ // Abandon a compaction
+ void MessageStore::abortCompaction() {
+     _compactLog.close();
+     _compactIndex.close();
+     FSManager::remove_file((_logPath + ".tmp").c_str());
+     FSManager::remove_file((_indexPath + ".tmp").c_str());
+     _compactQueue.clear();
+     _compactConversations.clear();
+     _compacting = false;
+ }
\ No newline at end of file
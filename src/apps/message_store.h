@@ -0,0 +1,196 @@
+/**
+ * @file message_store.h
+ * @brief Append-only message log for the LoRa Messenger
+ *
+ * Every message is appended to the log as one binary record with a fixed
+ * header, so saving costs the same however long the history is. A second
+ * file holds one small entry per record, from which the per-conversation
+ * offset index is rebuilt at boot without parsing the messages themselves.
+ * Old and cleared records are dropped by a compaction that runs a few
+ * records at a time from the application's update loop.
+ */
+
+ #ifndef TDECK_MESSAGE_STORE_H
+ #define TDECK_MESSAGE_STORE_H
+ 
+ #include <Arduino.h>
+ #include <FS.h>
+ #include <vector>
+ #include "../config.h"
+ 
+ // Conversation of messages broadcast to every device
+ #define MESSAGE_BROADCAST 0xFFFF
+ 
+ // Record header: magic (1), flags (1), conversation (2), timestamp (4),
+ // sender length (1), content length (2), CRC-16 of header and body (2)
+ #define MESSAGE_RECORD_HEADER_SIZE 13
+ 
+ // Index entry: record offset (4), conversation (2), flags (1), reserved (1)
+ #define MESSAGE_INDEX_ENTRY_SIZE 8
+ 
+ // Record flags
+ #define MESSAGE_FLAG_INCOMING 0x01  // Received rather than sent by this device
+ #define MESSAGE_FLAG_CLEAR 0x02     // Tombstone, drops all earlier records of the conversation
+ 
+ // Message structure for LoRa communication
+ struct LoRaMessage {
+     String sender;          // Sender identifier (name or ID)
+     String content;         // Message content
+     uint32_t timestamp;     // Message timestamp
+     bool incoming;          // True if received message, false if sent by this device
+     uint16_t conversation;  // Peer device ID, MESSAGE_BROADCAST for the shared channel
+ };
+ 
+ /**
+  * @class MessageStore
+  * @brief Log-structured message history with a per-conversation offset index
+  *
+  * Messages of a conversation are numbered from 0, the oldest still kept.
+  * Not thread safe, all calls come from the UI task.
+  */
+ class MessageStore {
+ public:
+     /**
+      * @brief Constructor
+      * @param logPath Path of the record log
+      * @param indexPath Path of the offset index
+      */
+     MessageStore(const char* logPath, const char* indexPath);
+ 
+     /**
+      * @brief Load the index and recover records appended after its last entry
+      * @return true if the store is usable
+      */
+     bool open();
+ 
+     /**
+      * @brief Append a message to the log
+      * @param message Message to store
+      * @return true if the record was written
+      */
+     bool append(const LoRaMessage& message);
+ 
+     /**
+      * @brief Get the number of messages kept for a conversation
+      * @param conversation Conversation ID
+      * @return Message count
+      */
+     size_t count(uint16_t conversation) const;
+ 
+     /**
+      * @brief Read a range of messages, oldest first
+      * @param conversation Conversation ID
+      * @param first Number of the first message to read
+      * @param count Messages to read
+      * @param out Receives the messages read
+      * @return Number of messages appended to out
+      */
+     size_t read(uint16_t conversation, size_t first, size_t count, std::vector<LoRaMessage>& out);
+ 
+     /**
+      * @brief Drop all messages of a conversation
+      * @param conversation Conversation ID
+      * @return true if the tombstone was written
+      */
+     bool clear(uint16_t conversation);
+ 
+     /**
+      * @brief Run one step of background compaction
+      *
+      * Compaction starts once TDECK_MESSAGE_COMPACT_THRESHOLD records are dead
+      * and copies at most TDECK_MESSAGE_COMPACT_BATCH records per call.
+      *
+      * @return true while a compaction is in progress
+      */
+     bool service();
+ 
+ private:
+     // Offsets of the messages kept for one conversation, oldest first
+     struct Conversation {
+         uint16_t id;
+         std::vector<uint32_t> offsets;
+     };
+ 
+     // Decoded record header
+     struct RecordHeader {
+         uint8_t flags;
+         uint16_t conversation;
+         uint32_t timestamp;
+         uint8_t senderLength;
+         uint16_t contentLength;
+         uint16_t checksum;
+     };
+ 
+     String _logPath;                            // Record log
+     String _indexPath;                          // Offset index
+     bool _open;                                 // open() succeeded
+     uint32_t _logSize;                          // Bytes in the log
+     uint32_t _deadRecords;                      // Records no longer reachable from the index
+     std::vector<Conversation> _conversations;   // Per-conversation index
+ 
+     bool _compacting;                           // Compaction in progress
+     std::vector<uint32_t> _compactQueue;        // Old log offsets still to copy, in log order
+     size_t _compactNext;                        // Next entry of _compactQueue
+     uint32_t _compactSize;                      // Bytes written to the new log
+     uint32_t _compactDead;                      // Dead records written to the new log
+     fs::File _compactLog;                       // New log being written
+     fs::File _compactIndex;                     // New index being written
+     std::vector<Conversation> _compactConversations; // Index of the new log
+ 
+     /**
+      * @brief Find a conversation in an index
+      * @param create Add it if missing
+      * @return Conversation, nullptr if missing and not created
+      */
+     static Conversation* find(std::vector<Conversation>& index, uint16_t id, bool create);
+ 
+     /**
+      * @brief Apply one record to an index, trimming history past TDECK_MESSAGE_HISTORY_MAX
+      * @return Records that became dead
+      */
+     static uint32_t apply(std::vector<Conversation>& index, uint32_t offset, uint16_t conversation, uint8_t flags);
+ 
+     /**
+      * @brief Read the record at offset and check its CRC
+      * @param body Receives the sender followed by the content
+      */
+     static bool readRecord(fs::File& file, uint32_t offset, RecordHeader& header, std::vector<uint8_t>& body);
+ 
+     /**
+      * @brief Write one record, filling in the header checksum
+      */
+     static bool writeRecord(fs::File& file, RecordHeader& header, const uint8_t* sender, const uint8_t* content);
+ 
+     /**
+      * @brief Write one index entry
+      */
+     static bool writeIndexEntry(fs::File& file, uint32_t offset, uint16_t conversation, uint8_t flags);
+ 
+     /**
+      * @brief Index records found after the last index entry, skipping torn writes
+      */
+     void recover(uint32_t from);
+ 
+     /**
+      * @brief Write a record to the log and its entry to the index
+      */
+     bool appendRecord(uint8_t flags, uint16_t conversation, uint32_t timestamp,
+                       const String& sender, const String& content);
+ 
+     /**
+      * @brief Begin a compaction into temporary files
+      */
+     bool startCompaction();
+ 
+     /**
+      * @brief Swap the compacted files in place of the old ones
+      */
+     bool finishCompaction();
+ 
+     /**
+      * @brief Abandon a compaction and remove its temporary files
+      */
+     void abortCompaction();
+ };
+ 
+ #endif // TDECK_MESSAGE_STORE_H
\ No newline at end of file
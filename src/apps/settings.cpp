@@ -5,17 +5,16 @@
 
  #include "settings.h"
  #include "../system/fs_manager.h"
+ #include "../system/config_storage.h"
  #include "../hal/display.h"
  #include "../hal/power.h"
- #include "launcher.h"
+ #include "../ui/ui_manager.h"
+ #include "../system/assets.h"
  #include <ArduinoJson.h>
  
  // Define the global settings instance
  Settings settings;
  
- // External reference to launcher (from main)
- extern Launcher launcher;
- 
  // External reference to display and power manager
  extern Display display;
  extern PowerManager powerManager;
@@ -31,17 +30,11 @@
  const char* sleepOptionLabels[] = {"1 min", "5 min", "10 min", "30 min", "1 hour", "2 hours", "Never"};
  const uint8_t sleepOptionCount = sizeof(sleepOptions) / sizeof(sleepOptions[0]);
  
- /**
-  * @brief Function to launch the settings app (for launcher registration)
-  */
- void launchSettingsApp() {
-     settings.start();
- }
- 
  /**
   * @brief Constructor
   */
  Settings::Settings() :
+     AppBase("Settings"),
      parent(nullptr),
      settingsContainer(nullptr),
      tabview(nullptr),
@@ -58,7 +51,8 @@
      brightness(TDECK_DISPLAY_BL_MAX),          // Default full brightness
      powerSaveTimeout(TDECK_POWER_SAVE_TIMEOUT / 1000), // Convert ms to seconds
      sleepTimeout(TDECK_SLEEP_TIMEOUT / 1000),  // Convert ms to seconds
-     darkMode(false)                            // Default light mode
+     darkMode(false),                           // Default light mode
+     activeTab(0)
  {
  }
  
@@ -69,6 +63,13 @@
      // Cleanup resources if needed
  }
  
+ /**
+  * @brief Load saved settings and apply them to the hardware
+  */
+ bool Settings::begin() {
+     return loadSettings();
+ }
+ 
  /**
   * @brief Initialize the settings app
   */
@@ -78,7 +79,7 @@
      
      // Initialize styles
      lv_style_init(&headerStyle);
-     lv_style_set_text_font(&headerStyle, LV_STATE_DEFAULT, &lv_font_montserrat_18);
+     lv_style_set_text_font(&headerStyle, LV_STATE_DEFAULT, assets.getFont("montserrat_18"));
      lv_style_set_pad_all(&headerStyle, LV_STATE_DEFAULT, 10);
      
      lv_style_init(&containerStyle);
@@ -99,10 +100,7 @@
      lv_style_set_pad_all(&buttonStyle, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING);
      lv_style_set_radius(&buttonStyle, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
      
-     // Load saved settings
-     loadSettings();
-     
-     // Create the settings UI
+     // Create the settings UI from the values loaded by begin()
      createUI();
      
      // Hide the container by default
@@ -133,15 +131,66 @@
  void Settings::exit() {
      TDECK_LOG_I("Exiting Settings app");
      
+     // Pauses the app and shows the launcher
+     uiManager.showLauncher();
+ }
+ 
+ /**
+  * @brief Build the settings UI and return to the tab shown last
+  */
+ bool Settings::onCreate(lv_obj_t* parent) {
+     if (!init(parent)) {
+         return false;
+     }
+     
+     lv_tabview_set_tab_act(tabview, activeTab, LV_ANIM_OFF);
+     return true;
+ }
+ 
+ /**
+  * @brief Show the settings UI
+  */
+ void Settings::onResume() {
+     start();
+ }
+ 
+ /**
+  * @brief Hide the settings UI
+  */
+ void Settings::onPause() {
      if (settingsContainer) {
-         // Hide the container
          lv_obj_set_hidden(settingsContainer, true);
-         
-         // Return to launcher
-         launcher.start();
      }
  }
  
+ /**
+  * @brief Delete the settings UI, the values stay in their members
+  */
+ void Settings::onDestroy() {
+     activeTab = lv_tabview_get_tab_act(tabview);
+     
+     lv_obj_del(settingsContainer);
+     settingsContainer = nullptr;
+     tabview = nullptr;
+     tabDisplay = nullptr;
+     tabPower = nullptr;
+     tabSystem = nullptr;
+     brightnessSlider = nullptr;
+     powerSaveDropdown = nullptr;
+     sleepDropdown = nullptr;
+     darkModeSwitch = nullptr;
+     resetButton = nullptr;
+     saveButton = nullptr;
+     exitButton = nullptr;
+     
+     // Release the properties init() gave the styles
+     lv_style_reset(&headerStyle);
+     lv_style_reset(&containerStyle);
+     lv_style_reset(&labelStyle);
+     lv_style_reset(&settingRowStyle);
+     lv_style_reset(&buttonStyle);
+ }
+ 
  /**
   * @brief Get display brightness level
   */
@@ -262,7 +311,7 @@
      doc["darkMode"] = darkMode;
      
      // Save to file
-     bool success = fsManager.saveJsonToFile(TDECK_FS_CONFIG_FILE, doc);
+     bool success = configStorage.write(TDECK_FS_CONFIG_FILE, doc);
      
      if (success) {
          TDECK_LOG_I("Settings saved successfully");
@@ -283,7 +332,7 @@
      DynamicJsonDocument doc(512);
      
      // Load from file
-     bool success = fsManager.loadJsonFromFile(TDECK_FS_CONFIG_FILE, doc);
+     bool success = configStorage.read(TDECK_FS_CONFIG_FILE, doc);
      
      if (success) {
          TDECK_LOG_I("Settings loaded successfully");
@@ -552,7 +601,7 @@
      
      lv_obj_t* deviceInfoLabel = lv_label_create(deviceInfoRow, NULL);
      lv_label_set_text(deviceInfoLabel, "Device Information");
-     lv_obj_set_style_local_text_font(deviceInfoLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, &lv_font_montserrat_16);
+     lv_obj_set_style_local_text_font(deviceInfoLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, assets.getFont("montserrat_16"));
      lv_obj_align(deviceInfoLabel, deviceInfoRow, LV_ALIGN_IN_TOP_LEFT, 0, 0);
      
      lv_obj_t* firmwareVersionLabel = lv_label_create(deviceInfoRow, NULL);
@@ -572,7 +621,7 @@
      
      lv_obj_t* storageLabel = lv_label_create(storageRow, NULL);
      lv_label_set_text(storageLabel, "Storage");
-     lv_obj_set_style_local_text_font(storageLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, &lv_font_montserrat_16);
+     lv_obj_set_style_local_text_font(storageLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, assets.getFont("montserrat_16"));
      lv_obj_align(storageLabel, storageRow, LV_ALIGN_IN_TOP_LEFT, 0, 0);
      
      // Get storage info from file system manager
@@ -592,7 +641,7 @@
      
      lv_obj_t* maintenanceLabel = lv_label_create(maintenanceRow, NULL);
      lv_label_set_text(maintenanceLabel, "System Maintenance");
-     lv_obj_set_style_local_text_font(maintenanceLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, &lv_font_montserrat_16);
+     lv_obj_set_style_local_text_font(maintenanceLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, assets.getFont("montserrat_16"));
      lv_obj_align(maintenanceLabel, maintenanceRow, LV_ALIGN_IN_TOP_LEFT, 0, 0);
      
      // Create clear cache button
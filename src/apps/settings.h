@@ -14,12 +14,13 @@
  #include <lvgl.h>
  #include <ArduinoJson.h>
  #include "../config.h"
+ #include "app_base.h"
  
  /**
   * @class Settings
   * @brief Implements the settings application functionality
   */
- class Settings {
+ class Settings : public AppBase {
  public:
      /**
       * @brief Constructor
@@ -32,7 +33,16 @@
      ~Settings();
      
      /**
-      * @brief Initialize the settings app
+      * @brief Load saved settings and apply them to the hardware
+      *
+      * Runs at boot, the UI is only built by init() on first launch.
+      *
+      * @return true if saved settings were found, false if defaults are used
+      */
+     bool begin();
+     
+     /**
+      * @brief Initialize the settings app, begin() must have run
       * @param parent Parent LVGL container
       * @return true if successful, false otherwise
       */
@@ -120,6 +130,13 @@
       */
      bool handleKeyPress(uint32_t key);
  
+ protected:
+     // AppBase lifecycle
+     bool onCreate(lv_obj_t* parent) override;
+     void onResume() override;
+     void onPause() override;
+     void onDestroy() override;
+ 
  private:
      lv_obj_t* parent;               // Parent LVGL container
      lv_obj_t* settingsContainer;    // Main settings container
@@ -140,6 +157,7 @@
      uint32_t powerSaveTimeout;      // Power save timeout in seconds
      uint32_t sleepTimeout;          // Sleep timeout in seconds
      bool darkMode;                  // Dark mode enabled flag
+     uint16_t activeTab;             // Tab shown, kept while the UI is destroyed
      
      // Style definitions
      lv_style_t headerStyle;         // Header style
@@ -17,6 +17,11 @@
  #include "../hal/display.h"
  #include "../hal/sdcard.h"
  #include "../ui/theme.h"
+ #include "../ui/frame_stats.h"
+ #include "../system/boot_timeline.h"
+ #include "../system/heap_tracker.h"
+ #include "../system/task_profiler.h"
+ #include "lv_alloc.h"
  
  // Update interval in milliseconds
  #define SYSTEM_INFO_UPDATE_INTERVAL 1000
@@ -27,22 +32,35 @@
          // Get the user data pointer which points to our SystemInfo instance
          SystemInfo* instance = (SystemInfo*)lv_obj_get_user_data(obj);
          if (instance) {
-             instance->stop();
+             uiManager.showLauncher();
          }
      }
  }
  
+ // Static event handler for the frame stats overlay switch
+ static void _overlaySwitchEventHandler(lv_obj_t* obj, lv_event_t event) {
+     if (event == LV_EVENT_VALUE_CHANGED) {
+         frameStats.setOverlayVisible(lv_switch_get_state(obj));
+     }
+ }
+ 
  SystemInfo::SystemInfo() : 
+     AppBase("System"),
      _mainPage(nullptr),
      _tabView(nullptr),
      _tabSystem(nullptr),
      _tabMemory(nullptr),
      _tabNetwork(nullptr),
      _tabHardware(nullptr),
+     _tabGraphics(nullptr),
+     _tabBoot(nullptr),
+     _lblBootTimeline(nullptr),
+     _bootStagesShown(0),
      _powerManager(nullptr),
      _isInitialized(false),
      _isActive(false),
-     _lastUpdateTime(0) {
+     _lastUpdateTime(0),
+     _activeTab(0) {
  }
  
  SystemInfo::~SystemInfo() {
@@ -87,12 +105,16 @@
      _tabMemory = lv_tabview_add_tab(_tabView, "Memory");
      _tabNetwork = lv_tabview_add_tab(_tabView, "Network");
      _tabHardware = lv_tabview_add_tab(_tabView, "Hardware");
+     _tabGraphics = lv_tabview_add_tab(_tabView, "Graphics");
+     _tabBoot = lv_tabview_add_tab(_tabView, "Boot");
      
      // Initialize tabs with content
      _createSystemTab();
      _createMemoryTab();
      _createNetworkTab();
      _createHardwareTab();
+     _createGraphicsTab();
+     _createBootTab();
      
      // Get references to system components
      extern PowerManager powerManager;
@@ -134,6 +156,42 @@
      _isActive = false;
  }
  
+ bool SystemInfo::onCreate(lv_obj_t* parent) {
+     if (!init(parent)) {
+         return false;
+     }
+     
+     lv_tabview_set_tab_act(_tabView, _activeTab, LV_ANIM_OFF);
+     return true;
+ }
+ 
+ void SystemInfo::onResume() {
+     start();
+ }
+ 
+ void SystemInfo::onPause() {
+     stop();
+ }
+ 
+ void SystemInfo::onDestroy() {
+     _activeTab = lv_tabview_get_tab_act(_tabView);
+     
+     // The labels are children of the page and only touched while active
+     lv_obj_del(_mainPage);
+     _mainPage = nullptr;
+     _tabView = nullptr;
+     _tabSystem = nullptr;
+     _tabMemory = nullptr;
+     _tabNetwork = nullptr;
+     _tabHardware = nullptr;
+     _tabGraphics = nullptr;
+     _tabBoot = nullptr;
+     _lblBootTimeline = nullptr;
+     _bootStagesShown = 0;
+     _lastUpdateTime = 0;
+     _isInitialized = false;
+ }
+ 
  void SystemInfo::update() {
      if (!_isActive) {
          return;
@@ -141,15 +199,23 @@
      
      unsigned long currentTime = millis();
      
-     // Update only at the defined interval
-     if (currentTime - _lastUpdateTime >= SYSTEM_INFO_UPDATE_INTERVAL) {
-         _updateSystemTab();
-         _updateMemoryTab();
-         _updateNetworkTab();
-         _updateHardwareTab();
-         
-         _lastUpdateTime = currentTime;
+     // Only the tab on screen is refreshed, at the interval or as soon as it is shown
+     uint16_t tab = lv_tabview_get_tab_act(_tabView);
+     if (tab == _activeTab && currentTime - _lastUpdateTime < SYSTEM_INFO_UPDATE_INTERVAL) {
+         return;
+     }
+     
+     switch (tab) {
+         case 0: _updateSystemTab(); break;
+         case 1: _updateMemoryTab(); break;
+         case 2: _updateNetworkTab(); break;
+         case 3: _updateHardwareTab(); break;
+         case 4: _updateGraphicsTab(); break;
+         case 5: _updateBootTab(); break;
      }
+     
+     _activeTab = tab;
+     _lastUpdateTime = currentTime;
  }
  
  void SystemInfo::_createSystemTab() {
@@ -215,6 +281,23 @@
      yPos += yStep;
      
      _lblFlashUsed = _createLabelPair(_tabMemory, "Flash Used:", yPos);
+     yPos += yStep;
+     
+     // LVGL heap, used / high-water mark / fragmentation of the pool
+     _lblLvglSram = _createLabelPair(_tabMemory, "LVGL SRAM:", yPos);
+     yPos += yStep - 10;
+     
+     _lblLvglPsram = _createLabelPair(_tabMemory, "LVGL PSRAM:", yPos);
+     yPos += yStep - 10;
+     
+     _lblLvglFailed = _createLabelPair(_tabMemory, "LVGL Failed:", yPos);
+     yPos += yStep;
+     
+     // Heap tracker, fragmentation of each heap and the subsystem holding the most
+     _lblHeapFrag = _createLabelPair(_tabMemory, "Heap Frag:", yPos);
+     yPos += yStep - 10;
+     
+     _lblHeapTop = _createLabelPair(_tabMemory, "Top Heap User:", yPos);
  }
  
  void SystemInfo::_createNetworkTab() {
@@ -246,6 +329,12 @@
      yPos += yStep;
      
      _lblLoraFreq = _createLabelPair(_tabNetwork, "LoRa Frequency:", yPos);
+     yPos += yStep;
+     
+     _lblLoraAirtime = _createLabelPair(_tabNetwork, "LoRa Airtime:", yPos);
+     yPos += yStep;
+     
+     _lblLoraDelivery = _createLabelPair(_tabNetwork, "LoRa Delivery:", yPos);
  }
  
  void SystemInfo::_createHardwareTab() {
@@ -272,6 +361,9 @@
      _barCpu1Usage = _createUsageBar(_tabHardware, "CPU Core 1 Usage:", yPos);
      yPos += yStep + 10;
      
+     _lblTopTasks = _createLabelPair(_tabHardware, "Busiest Tasks:", yPos);
+     yPos += yStep;
+     
      // Other hardware
      _lblDisplayInfo = _createLabelPair(_tabHardware, "Display:", yPos);
      yPos += yStep;
@@ -279,6 +371,45 @@
      _lblSdCardInfo = _createLabelPair(_tabHardware, "SD Card:", yPos);
  }
  
+ void SystemInfo::_createGraphicsTab() {
+     int yPos = 10;
+     const int yStep = 30;
+     
+     // Rolling frame timing (min / avg / p99)
+     _lblRenderTime = _createLabelPair(_tabGraphics, "Render (ms):", yPos);
+     yPos += yStep;
+     
+     _lblFlushTime = _createLabelPair(_tabGraphics, "Flush (ms):", yPos);
+     yPos += yStep;
+     
+     _lblFlushedArea = _createLabelPair(_tabGraphics, "Flushed (px):", yPos);
+     yPos += yStep;
+     
+     _lblInvalidArea = _createLabelPair(_tabGraphics, "Invalidated (px):", yPos);
+     yPos += yStep;
+     
+     _lblFrameCount = _createLabelPair(_tabGraphics, "Frames:", yPos);
+     yPos += yStep + 10;
+     
+     // Overlay toggle
+     lv_obj_t* overlayLabel = lv_label_create(_tabGraphics, NULL);
+     lv_label_set_text(overlayLabel, "Stats Overlay:");
+     lv_obj_set_pos(overlayLabel, 10, yPos);
+     lv_obj_add_style(overlayLabel, LV_LABEL_PART_MAIN, theme_get_style_label());
+     
+     _swOverlay = lv_switch_create(_tabGraphics, NULL);
+     lv_obj_set_pos(_swOverlay, 160, yPos - 5);
+     lv_obj_set_event_cb(_swOverlay, _overlaySwitchEventHandler);
+ }
+ 
+ void SystemInfo::_createBootTab() {
+     // One line per stage, filled in by _updateBootTab()
+     _lblBootTimeline = lv_label_create(_tabBoot, NULL);
+     lv_label_set_text(_lblBootTimeline, "");
+     lv_obj_set_pos(_lblBootTimeline, 10, 10);
+     lv_obj_add_style(_lblBootTimeline, LV_LABEL_PART_MAIN, theme_get_style_label());
+ }
+ 
  void SystemInfo::_updateSystemTab() {
      // Update firmware information
      lv_label_set_text(_lblVersion, TDECK_FIRMWARE_NAME " v" TDECK_FIRMWARE_VERSION);
@@ -389,6 +520,55 @@
          lv_label_set_text(_lblFlashUsed, "Unknown");
          lv_bar_set_value(_barFlashUsage, 0, LV_ANIM_OFF);
      }
+     
+     // LVGL allocator pools
+     lv_obj_t* poolLabels[TDECK_LV_POOL_COUNT] = {_lblLvglSram, _lblLvglPsram};
+     for (int pool = 0; pool < TDECK_LV_POOL_COUNT; pool++) {
+         tdeck_lv_pool_stats_t stats;
+         tdeck_lv_get_pool_stats((tdeck_lv_pool_t)pool, &stats);
+         
+         char used[16];
+         char peak[16];
+         _formatByteSize(stats.used, used, sizeof(used));
+         _formatByteSize(stats.peak, peak, sizeof(peak));
+         
+         // Fragmentation: share of the free heap outside its largest block
+         int frag = stats.heapFree ? 100 - (int)((uint64_t)stats.heapLargest * 100 / stats.heapFree) : 0;
+         
+         char text[48];
+         snprintf(text, sizeof(text), "%s / %s / %d%%", used, peak, frag);
+         lv_label_set_text(poolLabels[pool], text);
+     }
+     
+     snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)tdeck_lv_get_failures());
+     lv_label_set_text(_lblLvglFailed, buffer);
+     
+     HeapCapsStats internal;
+     HeapCapsStats psram;
+     HeapTracker::getCapsStats(MALLOC_CAP_INTERNAL, internal);
+     HeapTracker::getCapsStats(MALLOC_CAP_SPIRAM, psram);
+     snprintf(buffer, sizeof(buffer), "SRAM %u%% / PSRAM %u%%", internal.fragmentation, psram.fragmentation);
+     lv_label_set_text(_lblHeapFrag, buffer);
+     
+     if (heapTracker.isTracking()) {
+         HeapTag top = HEAP_TAG_OTHER;
+         HeapTagStats topStats = {};
+         for (int tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+             HeapTagStats stats;
+             heapTracker.getTagStats((HeapTag)tag, stats);
+             if (stats.live > topStats.live) {
+                 top = (HeapTag)tag;
+                 topStats = stats;
+             }
+         }
+         
+         char live[16];
+         _formatByteSize(topStats.live, live, sizeof(live));
+         snprintf(buffer, sizeof(buffer), "%s %s", HeapTracker::getTagName(top), live);
+         lv_label_set_text(_lblHeapTop, buffer);
+     } else {
+         lv_label_set_text(_lblHeapTop, "Tracking off");
+     }
  }
  
  void SystemInfo::_updateNetworkTab() {
@@ -458,13 +638,35 @@
              char freqStr[16];
              snprintf(freqStr, sizeof(freqStr), "%.1f MHz", TDECK_LORA_FREQUENCY / 1E6);
              lv_label_set_text(_lblLoraFreq, freqStr);
+             
+             char airtimeStr[48];
+             snprintf(airtimeStr, sizeof(airtimeStr), "%.1f s, %.2f%% duty (1 h)",
+                      loraStats.getTxAirtime() / 1E6, loraStats.getDutyCycle());
+             lv_label_set_text(_lblLoraAirtime, airtimeStr);
+             
+             LoRaPeerStats totals;
+             loraStats.getTotals(totals);
+             uint32_t total = totals.delivered + totals.failed;
+             if (total > 0) {
+                 char deliveryStr[48];
+                 snprintf(deliveryStr, sizeof(deliveryStr), "%.1f%%, %lu retx, RTT %lu ms",
+                          totals.delivered * 100.0f / total, (unsigned long)totals.retransmits,
+                          (unsigned long)(totals.rttSamples ? totals.rttTotalMs / totals.rttSamples : 0));
+                 lv_label_set_text(_lblLoraDelivery, deliveryStr);
+             } else {
+                 lv_label_set_text(_lblLoraDelivery, "No reliable traffic");
+             }
          } else {
              lv_label_set_text(_lblLoraStatus, "Not Initialized");
              lv_label_set_text(_lblLoraFreq, "N/A");
+             lv_label_set_text(_lblLoraAirtime, "N/A");
+             lv_label_set_text(_lblLoraDelivery, "N/A");
          }
      } else {
          lv_label_set_text(_lblLoraStatus, "Disabled (Feature)");
          lv_label_set_text(_lblLoraFreq, "N/A");
+         lv_label_set_text(_lblLoraAirtime, "N/A");
+         lv_label_set_text(_lblLoraDelivery, "N/A");
      }
  }
  
@@ -581,10 +783,21 @@
      snprintf(coresStr, sizeof(coresStr), "%d", chipInfo.cores);
      lv_label_set_text(_lblCpuCores, coresStr);
      
-     // CPU usage - This is a placeholder
-     // Proper CPU usage monitoring requires additional code
-     lv_bar_set_value(_barCpu0Usage, 50, LV_ANIM_OFF); // Example value
-     lv_bar_set_value(_barCpu1Usage, 30, LV_ANIM_OFF); // Example value
+     // CPU usage from the task profiler, which keeps sampling while this tab is shown
+     taskProfiler.watch();
+     lv_bar_set_value(_barCpu0Usage, taskProfiler.getCoreLoad(0), LV_ANIM_OFF);
+     lv_bar_set_value(_barCpu1Usage, taskProfiler.getCoreLoad(1), LV_ANIM_OFF);
+     
+     // The three busiest tasks, the top command lists them all
+     TaskCpuStats tasks[3];
+     size_t taskCount = taskProfiler.getIntervalMs() ? taskProfiler.getTasks(tasks, 3) : 0;
+     char topStr[96] = "Collecting...";
+     size_t used = 0;
+     for (size_t i = 0; i < taskCount && used < sizeof(topStr); i++) {
+         used += snprintf(topStr + used, sizeof(topStr) - used, "%s%s %u%%", i ? ", " : "",
+                          tasks[i].name, (tasks[i].cpuPermille + 5) / 10);
+     }
+     lv_label_set_text(_lblTopTasks, topStr);
      
      // Display information
      extern Display display;
@@ -613,4 +826,60 @@
          lv_label_set_text(_lblSdCardInfo, sdCardStr);
      } else {
          lv_label_set_text(_lblSdCardInfo, "Not mounted");
-     }
\ No newline at end of file
+     }
+ }
+ 
+ void SystemInfo::_updateGraphicsTab() {
+     char buffer[48];
+     
+     FrameStatSummary render = frameStats.getSummary(FRAME_METRIC_RENDER);
+     snprintf(buffer, sizeof(buffer), "%.1f / %.1f / %.1f", 
+              render.min / 1000.0f, render.avg / 1000.0f, render.p99 / 1000.0f);
+     lv_label_set_text(_lblRenderTime, buffer);
+     
+     FrameStatSummary flush = frameStats.getSummary(FRAME_METRIC_FLUSH);
+     snprintf(buffer, sizeof(buffer), "%.1f / %.1f / %.1f", 
+              flush.min / 1000.0f, flush.avg / 1000.0f, flush.p99 / 1000.0f);
+     lv_label_set_text(_lblFlushTime, buffer);
+     
+     FrameStatSummary flushed = frameStats.getSummary(FRAME_METRIC_FLUSHED_PX);
+     snprintf(buffer, sizeof(buffer), "%lu / %lu / %lu", 
+              (unsigned long)flushed.min, (unsigned long)flushed.avg, (unsigned long)flushed.p99);
+     lv_label_set_text(_lblFlushedArea, buffer);
+     
+     FrameStatSummary invalid = frameStats.getSummary(FRAME_METRIC_INVALID_PX);
+     snprintf(buffer, sizeof(buffer), "%lu / %lu / %lu", 
+              (unsigned long)invalid.min, (unsigned long)invalid.avg, (unsigned long)invalid.p99);
+     lv_label_set_text(_lblInvalidArea, buffer);
+     
+     snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)frameStats.getFrameCount());
+     lv_label_set_text(_lblFrameCount, buffer);
+     
+     // Keep the switch in sync if the overlay was toggled elsewhere
+     if (lv_switch_get_state(_swOverlay) != frameStats.isOverlayVisible()) {
+         if (frameStats.isOverlayVisible()) {
+             lv_switch_on(_swOverlay, LV_ANIM_OFF);
+         } else {
+             lv_switch_off(_swOverlay, LV_ANIM_OFF);
+         }
+     }
+ }
+ 
+ void SystemInfo::_updateBootTab() {
+     // Stages only get added while the radios come up, rebuild the text when they do
+     size_t count = bootTimeline.getCount();
+     if (count == _bootStagesShown) {
+         return;
+     }
+     
+     String text;
+     BootStage stage;
+     char line[48];
+     for (size_t i = 0; bootTimeline.getStage(i, stage); i++) {
+         snprintf(line, sizeof(line), "%7.1f ms  %s\n", stage.micros / 1000.0f, stage.name);
+         text += line;
+     }
+     
+     lv_label_set_text(_lblBootTimeline, text.c_str());
+     _bootStagesShown = count;
+ }
\ No newline at end of file
@@ -20,8 +20,9 @@
  #include "../hal/power.h"
  #include "../ui/ui_manager.h"
  #include "../system/battery.h"
+ #include "app_base.h"
  
- class SystemInfo {
+ class SystemInfo : public AppBase {
  public:
      /**
       * Constructor
@@ -56,6 +57,13 @@
       */
      void update();
  
+ protected:
+     // AppBase lifecycle
+     bool onCreate(lv_obj_t* parent) override;
+     void onResume() override;
+     void onPause() override;
+     void onDestroy() override;
+ 
  private:
      // UI elements
      lv_obj_t* _mainPage;
@@ -64,6 +72,8 @@
      lv_obj_t* _tabMemory;
      lv_obj_t* _tabNetwork;
      lv_obj_t* _tabHardware;
+     lv_obj_t* _tabGraphics;
+     lv_obj_t* _tabBoot;
      
      // Data labels
      lv_obj_t* _lblVersion;
@@ -85,6 +95,11 @@
      lv_obj_t* _lblFlashSize;
      lv_obj_t* _lblFlashUsed;
      lv_obj_t* _barFlashUsage;
+     lv_obj_t* _lblLvglSram;
+     lv_obj_t* _lblLvglPsram;
+     lv_obj_t* _lblLvglFailed;
+     lv_obj_t* _lblHeapFrag;
+     lv_obj_t* _lblHeapTop;
      
      // Network information
      lv_obj_t* _lblWifiStatus;
@@ -95,6 +110,8 @@
      lv_obj_t* _lblBtName;
      lv_obj_t* _lblLoraStatus;
      lv_obj_t* _lblLoraFreq;
+     lv_obj_t* _lblLoraAirtime;
+     lv_obj_t* _lblLoraDelivery;
      
      // Hardware information
      lv_obj_t* _lblCpuType;
@@ -103,9 +120,22 @@
      lv_obj_t* _lblCpuCores;
      lv_obj_t* _barCpu0Usage;
      lv_obj_t* _barCpu1Usage;
+     lv_obj_t* _lblTopTasks;
      lv_obj_t* _lblDisplayInfo;
      lv_obj_t* _lblSdCardInfo;
      
+     // Graphics information
+     lv_obj_t* _lblRenderTime;
+     lv_obj_t* _lblFlushTime;
+     lv_obj_t* _lblFlushedArea;
+     lv_obj_t* _lblInvalidArea;
+     lv_obj_t* _lblFrameCount;
+     lv_obj_t* _swOverlay;
+     
+     // Boot timeline
+     lv_obj_t* _lblBootTimeline;
+     size_t _bootStagesShown;
+     
      // References to other system components
      PowerManager* _powerManager;
      
@@ -130,6 +160,16 @@
       */
      void _createHardwareTab();
      
+     /**
+      * Creates the graphics (frame timing) tab
+      */
+     void _createGraphicsTab();
+     
+     /**
+      * Creates the boot timeline tab
+      */
+     void _createBootTab();
+     
      /**
       * Updates the system tab information
       */
@@ -150,6 +190,16 @@
       */
      void _updateHardwareTab();
      
+     /**
+      * Updates the graphics tab information
+      */
+     void _updateGraphicsTab();
+     
+     /**
+      * Updates the boot timeline once more stages have finished
+      */
+     void _updateBootTab();
+     
      /**
       * Creates a label pair (title and value)
       * @param parent Parent container
@@ -186,6 +236,7 @@
      bool _isInitialized;
      bool _isActive;
      unsigned long _lastUpdateTime;
+     uint16_t _activeTab;        // Tab last refreshed, kept while the UI is destroyed
  };
  
  #endif // SYSTEM_INFO_H
\ No newline at end of file
@@ -11,6 +11,12 @@
  #include <sys/time.h>
  #include "../../hal/keyboard.h"
  #include "../../ui/ui_manager.h"
+ #include "../comms/lora.h"
+ #include "../system/config_storage.h"
+ #include "../system/heap_tracker.h"
+ #include "../system/ota.h"
+ #include "../system/task_profiler.h"
+ #include "../system/trace.h"
  
  // Static event callback functions
  static void terminal_event_handler(lv_obj_t* obj, lv_event_t event) {
@@ -28,15 +34,43 @@
      }
  }
  
+ // Drag handler for the output area
+ static void terminal_scroll_handler(lv_obj_t* obj, lv_event_t event) {
+     Terminal* terminal = static_cast<Terminal*>(lv_obj_get_user_data(obj));
+     if (!terminal) {
+         return;
+     }
+     
+     if (event == LV_EVENT_PRESSING) {
+         lv_point_t vect;
+         lv_indev_get_vect(lv_indev_get_act(), &vect);
+         terminal->handleDrag(vect.y);
+     }
+ }
+ 
  // Constructor
  Terminal::Terminal() : 
+     AppBase("Terminal"),
      _parent(nullptr),
      _container(nullptr),
      _textArea(nullptr),
      _cmdLine(nullptr),
      _scrollBar(nullptr),
+     _group(nullptr),
      _running(false),
-     _cmdHistoryPos(0) {
+     _lineStart(0),
+     _lineCount(0),
+     _lineOpen(false),
+     _lineSeq(0),
+     _scrollOffset(0),
+     _dragAccum(0),
+     _cmdHistoryPos(0),
+     _renderTask(nullptr),
+     _renderPending(false) {
+     memset(_lineLabels, 0, sizeof(_lineLabels));
+     memset(_viewText, 0, sizeof(_viewText));
+     memset(_viewSeq, 0, sizeof(_viewSeq));
+     memset(_viewColor, 0, sizeof(_viewColor));
  }
  
  // Destructor
@@ -64,21 +98,32 @@
      
      lv_cont_set_style(_container, LV_CONT_STYLE_MAIN, &style_terminal);
      
-     // Create text area for terminal output
-     _textArea = lv_ta_create(_container, NULL);
+     // Create output area, a fixed set of line labels showing the bottom of the scrollback
+     _textArea = lv_cont_create(_container, NULL);
      lv_obj_set_size(_textArea, lv_obj_get_width(_container), lv_obj_get_height(_container) - 30);
      lv_obj_align(_textArea, _container, LV_ALIGN_IN_TOP_MID, 0, 0);
-     lv_ta_set_cursor_type(_textArea, LV_CURSOR_NONE);
-     lv_ta_set_text(_textArea, ""); // Empty text
-     lv_ta_set_style(_textArea, LV_TA_STYLE_BG, &style_terminal);
-     lv_ta_set_scrollbar_mode(_textArea, LV_SCROLLBAR_MODE_AUTO);
-     lv_ta_set_one_line(_textArea, false);
-     lv_ta_set_cursor_click_pos(_textArea, false);
-     lv_ta_set_text_align(_textArea, LV_LABEL_ALIGN_LEFT);
-     lv_ta_set_pwd_mode(_textArea, false);
-     lv_obj_set_event_cb(_textArea, terminal_event_handler);
+     lv_cont_set_style(_textArea, LV_CONT_STYLE_MAIN, &style_terminal);
+     lv_obj_set_click(_textArea, true);
+     lv_obj_set_event_cb(_textArea, terminal_scroll_handler);
      lv_obj_set_user_data(_textArea, this);
      
+     // New labels start from the text cache, forget what was drawn so colors get reapplied
+     memset(_viewSeq, 0, sizeof(_viewSeq));
+     for (uint8_t i = 0; i < TERM_VISIBLE_LINES; i++) {
+         lv_style_copy(&_viewStyles[i], &style_terminal);
+         _viewColor[i] = TERM_COLOR_NORMAL;
+         
+         _lineLabels[i] = lv_label_create(_textArea, NULL);
+         lv_label_set_long_mode(_lineLabels[i], LV_LABEL_LONG_CROP);
+         lv_obj_set_size(_lineLabels[i], lv_obj_get_width(_textArea), TERM_LINE_HEIGHT);
+         lv_obj_set_pos(_lineLabels[i], 2, i * TERM_LINE_HEIGHT);
+         lv_label_set_style(_lineLabels[i], LV_LABEL_STYLE_MAIN, &_viewStyles[i]);
+         lv_label_set_static_text(_lineLabels[i], _viewText[i]);
+     }
+     
+     // Render task stays off until output changes
+     _renderTask = lv_task_create(renderTaskCallback, 0, LV_TASK_PRIO_OFF, this);
+     
      // Create command line input
      _cmdLine = lv_ta_create(_container, NULL);
      lv_obj_set_size(_cmdLine, lv_obj_get_width(_container), 30);
@@ -91,25 +136,36 @@
      lv_obj_set_event_cb(_cmdLine, terminal_event_handler);
      lv_obj_set_user_data(_cmdLine, this);
      
+     // Bring back a command that was being typed when the UI was destroyed
+     if (_draftCommand.length() > 0) {
+         lv_ta_set_text(_cmdLine, _draftCommand.c_str());
+         _draftCommand = "";
+     }
+     
      // Set focus on command line
-     lv_group_t* g = lv_group_create();
-     lv_group_add_obj(g, _cmdLine);
-     lv_group_set_focus_cb(g, NULL);
+     _group = lv_group_create();
+     lv_group_add_obj(_group, _cmdLine);
+     lv_group_set_focus_cb(_group, NULL);
      lv_indev_t* cur_drv = lv_indev_get_next(NULL);
      while (cur_drv) {
          if (cur_drv->driver.type == LV_INDEV_TYPE_KEYPAD) {
-             lv_indev_set_group(cur_drv, g);
+             lv_indev_set_group(cur_drv, _group);
          }
          cur_drv = lv_indev_get_next(cur_drv);
      }
      
-     // Initialize built-in commands
-     initCommands();
-     
-     // Print welcome message
-     println("T-Deck Terminal v1.0", TERM_COLOR_SYSTEM);
-     println("Type 'help' for a list of commands", TERM_COLOR_SYSTEM);
-     println("", TERM_COLOR_NORMAL);
+     if (_commands.empty()) {
+         // Initialize built-in commands
+         initCommands();
+         
+         // Print welcome message
+         println("T-Deck Terminal v1.0", TERM_COLOR_SYSTEM);
+         println("Type 'help' for a list of commands", TERM_COLOR_SYSTEM);
+         println("", TERM_COLOR_NORMAL);
+     } else {
+         // Recreated, redraw the scrollback
+         updateDisplay();
+     }
      
      TDECK_LOG_I("Terminal initialized");
      return true;
@@ -134,6 +190,44 @@
      }
  }
  
+ // Build the UI, the scrollback is kept from before
+ bool Terminal::onCreate(lv_obj_t* parent) {
+     return init(parent);
+ }
+ 
+ // Show the terminal
+ void Terminal::onResume() {
+     start();
+ }
+ 
+ // Hide the terminal
+ void Terminal::onPause() {
+     stop();
+ }
+ 
+ // Keep the command being typed and delete the UI
+ void Terminal::onDestroy() {
+     _draftCommand = lv_ta_get_text(_cmdLine);
+     if (_draftCommand == TERM_PROMPT) {
+         _draftCommand = "";
+     }
+     
+     lv_task_del(_renderTask);
+     _renderTask = nullptr;
+     _renderPending = false;
+     
+     // Keypads fall back to no group until the next create
+     lv_group_del(_group);
+     _group = nullptr;
+     
+     lv_obj_del(_container);
+     _container = nullptr;
+     _textArea = nullptr;
+     _cmdLine = nullptr;
+     _scrollBar = nullptr;
+     memset(_lineLabels, 0, sizeof(_lineLabels));
+ }
+ 
  // Check if terminal is running
  bool Terminal::isRunning() const {
      return _running;
@@ -141,28 +235,51 @@
  
  // Add text to terminal
  void Terminal::print(const String& text, uint32_t color) {
-     // Add to history with color markup
-     String coloredText = String("#") + String(color, HEX) + " " + text + String("#");
-     _history.push_back(coloredText);
+     HeapTagScope heapTag(HEAP_TAG_TERMINAL);
+     appendText(text.c_str(), color);
      
-     // Limit history size
-     while (_history.size() > TERM_MAX_HISTORY) {
-         _history.pop_front();
-     }
-     
-     // Update display
+     // Redraw once per frame, however many lines a command prints
      updateDisplay();
  }
  
  // Add line to terminal
  void Terminal::println(const String& text, uint32_t color) {
-     print(text + "\n", color);
+     HeapTagScope heapTag(HEAP_TAG_TERMINAL);
+     appendText(text.c_str(), color);
+     appendText("\n", color);
+     updateDisplay();
  }
  
  // Clear terminal
  void Terminal::clear() {
-     _history.clear();
-     lv_ta_set_text(_textArea, "");
+     _lineStart = 0;
+     _lineCount = 0;
+     _lineOpen = false;
+     _scrollOffset = 0;
+     updateDisplay();
+ }
+ 
+ // Scroll through the scrollback
+ void Terminal::scrollLines(int delta) {
+     int maxOffset = _lineCount > TERM_VISIBLE_LINES ? _lineCount - TERM_VISIBLE_LINES : 0;
+     int offset = constrain((int)_scrollOffset + delta, 0, maxOffset);
+     
+     if (offset != _scrollOffset) {
+         _scrollOffset = offset;
+         updateDisplay();
+     }
+ }
+ 
+ // Turn drag distance into whole lines of scrolling
+ void Terminal::handleDrag(lv_coord_t dy) {
+     _dragAccum += dy;
+     
+     // Dragging down reveals older lines
+     int lines = _dragAccum / TERM_LINE_HEIGHT;
+     if (lines != 0) {
+         _dragAccum -= lines * TERM_LINE_HEIGHT;
+         scrollLines(lines);
+     }
  }
  
  // Handle keyboard events
@@ -180,7 +297,8 @@
              if (cmdText.length() > strlen(TERM_PROMPT)) {
                  String command = cmdText.substring(strlen(TERM_PROMPT));
                  
-                 // Print command to terminal
+                 // Print command to terminal and jump back to the latest output
+                 scrollToBottom();
                  println(cmdText, TERM_COLOR_COMMAND);
                  
                  // Process command
@@ -253,6 +371,18 @@
              return true;
          }
          
+         case LV_KEY_PREV: {
+             // Page back through the scrollback
+             scrollLines(TERM_VISIBLE_LINES - 1);
+             return true;
+         }
+         
+         case LV_KEY_NEXT: {
+             // Page forward through the scrollback
+             scrollLines(-(TERM_VISIBLE_LINES - 1));
+             return true;
+         }
+         
          case LV_KEY_ESC: {
              // Clear current command
              lv_ta_set_text(_cmdLine, TERM_PROMPT);
@@ -277,6 +407,8 @@
  
  // Process a command
  void Terminal::processCommand(const String& command) {
+     HeapTagScope heapTag(HEAP_TAG_TERMINAL);
+     
      // Parse command into arguments
      std::vector<String> args = parseCommand(command);
      
@@ -338,29 +470,119 @@
      return args;
  }
  
- // Update terminal display
- void Terminal::updateDisplay() {
-     String display;
+ // Append text to the scrollback ring
+ void Terminal::appendText(const char* text, uint32_t color) {
+     for (const char* p = text; *p; p++) {
+         if (*p == '\r') {
+             continue;
+         }
+         
+         // Close the current line, the next character opens a new one
+         if (*p == '\n') {
+             if (!_lineOpen) {
+                 newLine(color);
+             }
+             _lineOpen = false;
+             continue;
+         }
+         
+         // Open a new line, or wrap a full one
+         TermLine* line = &_lines[(_lineStart + _lineCount - 1) % TERM_MAX_HISTORY];
+         if (!_lineOpen || line->length >= TERM_LINE_LENGTH) {
+             line = &newLine(color);
+         }
+         
+         line->text[line->length++] = (*p == '\t') ? ' ' : *p;
+         line->text[line->length] = '\0';
+         line->seq = ++_lineSeq;
+     }
+ }
+ 
+ // Start a new line, overwriting the oldest one when the ring is full
+ Terminal::TermLine& Terminal::newLine(uint32_t color) {
+     uint16_t index = (_lineStart + _lineCount) % TERM_MAX_HISTORY;
      
-     // Build display text from history
-     for (const auto& line : _history) {
-         display += line;
+     if (_lineCount < TERM_MAX_HISTORY) {
+         _lineCount++;
+     } else {
+         _lineStart = (_lineStart + 1) % TERM_MAX_HISTORY;
      }
      
-     // Update text area
-     lv_ta_set_text(_textArea, display.c_str());
+     // Keep a scrolled back view anchored on the same lines
+     if (_scrollOffset > 0 && _scrollOffset < _lineCount - TERM_VISIBLE_LINES) {
+         _scrollOffset++;
+     }
+     
+     TermLine& line = _lines[index];
+     line.text[0] = '\0';
+     line.length = 0;
+     line.color = color;
+     line.seq = ++_lineSeq;
+     _lineOpen = true;
+     
+     return line;
+ }
+ 
+ // Schedule a redraw of the visible lines
+ void Terminal::updateDisplay() {
+     if (_renderPending || !_renderTask) {
+         return;
+     }
      
-     // Scroll to bottom
-     scrollToBottom();
+     _renderPending = true;
+     lv_task_set_prio(_renderTask, LV_TASK_PRIO_MID);
+     lv_task_ready(_renderTask);
+ }
+ 
+ // Redraw only the visible lines whose content changed
+ void Terminal::renderLines() {
+     int first = (int)_lineCount - _scrollOffset - TERM_VISIBLE_LINES;
+     
+     for (uint8_t i = 0; i < TERM_VISIBLE_LINES; i++) {
+         int index = first + i;
+         const TermLine* line = nullptr;
+         if (index >= 0 && index < _lineCount) {
+             line = &_lines[(_lineStart + index) % TERM_MAX_HISTORY];
+         }
+         
+         uint32_t seq = line ? line->seq : 0;
+         if (seq == _viewSeq[i]) {
+             continue;
+         }
+         _viewSeq[i] = seq;
+         
+         // Copy into the label's own buffer so the ring can be reused freely
+         if (line) {
+             memcpy(_viewText[i], line->text, line->length + 1);
+         } else {
+             _viewText[i][0] = '\0';
+         }
+         
+         uint32_t color = line ? line->color : TERM_COLOR_NORMAL;
+         if (color != _viewColor[i]) {
+             _viewColor[i] = color;
+             _viewStyles[i].text.color = lv_color_hex(color);
+             lv_obj_refresh_style(_lineLabels[i]);
+         }
+         
+         lv_label_set_static_text(_lineLabels[i], _viewText[i]);
+     }
+ }
+ 
+ // Render task callback, runs once after a burst of output
+ void Terminal::renderTaskCallback(lv_task_t* task) {
+     Terminal* terminal = static_cast<Terminal*>(task->user_data);
+     
+     terminal->renderLines();
+     terminal->_renderPending = false;
+     lv_task_set_prio(task, LV_TASK_PRIO_OFF);
  }
  
  // Scroll to bottom of terminal
  void Terminal::scrollToBottom() {
-     // Get total lines
-     uint16_t totalLines = lv_ta_get_text_sel_en(_textArea);
-     if (totalLines > 0) {
-         // Scroll to last line
-         lv_ta_set_cursor_pos(_textArea, strlen(lv_ta_get_text(_textArea)));
+     if (_scrollOffset != 0) {
+         _scrollOffset = 0;
+         updateDisplay();
      }
  }
  
@@ -596,6 +818,221 @@
          }
      );
      
+     // HEAP command (heap tracker report)
+     registerCommand("heap", "Heap usage by subsystem and allocation site (tags, sites, reset)",
+         [this](const std::vector<String>& args) {
+             String action = args.size() > 1 ? args[1] : "tags";
+             char line[96];
+             
+             if (action == "reset") {
+                 heapTracker.reset();
+                 println("Heap sites and peaks reset", TERM_COLOR_NORMAL);
+                 return;
+             }
+             
+             // Free / low-water mark / largest block / fragmentation of each heap
+             const uint32_t caps[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM};
+             const char* capsNames[] = {"SRAM", "PSRAM"};
+             println("Heap   free KB  low KB  block KB  frag", TERM_COLOR_SYSTEM);
+             for (int i = 0; i < 2; i++) {
+                 HeapCapsStats stats;
+                 HeapTracker::getCapsStats(caps[i], stats);
+                 snprintf(line, sizeof(line), "%-5s  %7lu  %6lu  %8lu  %3u%%", capsNames[i],
+                          (unsigned long)(stats.free / 1024), (unsigned long)(stats.minFree / 1024),
+                          (unsigned long)(stats.largest / 1024), stats.fragmentation);
+                 println(line, TERM_COLOR_NORMAL);
+             }
+             
+             if (!heapTracker.isTracking()) {
+                 println("Allocation tracking is off, build the tdeck-heap environment", TERM_COLOR_SYSTEM);
+                 return;
+             }
+             
+             if (action == "tags") {
+                 println("Tag        live KB  peak KB   allocs    frees", TERM_COLOR_SYSTEM);
+                 for (int tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+                     HeapTagStats stats;
+                     heapTracker.getTagStats((HeapTag)tag, stats);
+                     snprintf(line, sizeof(line), "%-9s  %7.1f  %7.1f  %7lu  %7lu",
+                              HeapTracker::getTagName((HeapTag)tag), stats.live / 1024.0f, stats.peak / 1024.0f,
+                              (unsigned long)stats.allocs, (unsigned long)stats.frees);
+                     println(line, TERM_COLOR_NORMAL);
+                 }
+             } else if (action == "sites") {
+                 // "heap sites count" ranks by allocations rather than bytes
+                 bool byCount = args.size() > 2 && args[2] == "count";
+                 HeapSite sites[10];
+                 size_t count = heapTracker.getSites(sites, 10, byCount);
+                 
+                 println("Tag       count  total KB  max B  live  backtrace", TERM_COLOR_SYSTEM);
+                 for (size_t i = 0; i < count; i++) {
+                     const HeapSite& site = sites[i];
+                     bool large = site.maxSize >= TDECK_HEAP_ALLOCATION_THRESHOLD;
+                     snprintf(line, sizeof(line), "%-8s %6lu  %8.1f  %5lu  %4lu ", HeapTracker::getTagName((HeapTag)site.tag),
+                              (unsigned long)site.count, site.bytes / 1024.0f, (unsigned long)site.maxSize,
+                              (unsigned long)site.live);
+                     
+                     // Resolve with xtensa-esp32s3-elf-addr2line -e firmware.elf
+                     String text = line;
+                     for (int depth = 0; depth < TDECK_HEAP_TRACK_DEPTH && site.pcs[depth]; depth++) {
+                         snprintf(line, sizeof(line), " %08lx", (unsigned long)site.pcs[depth]);
+                         text += line;
+                     }
+                     println(text, large ? TERM_COLOR_ERROR : TERM_COLOR_NORMAL);
+                 }
+             } else {
+                 println("Usage: heap [tags|sites [count]|reset]", TERM_COLOR_ERROR);
+                 return;
+             }
+             
+             if (heapTracker.getUntracked() > 0) {
+                 println("Untracked (tables full): " + String(heapTracker.getUntracked()), TERM_COLOR_SYSTEM);
+             }
+         }
+     );
+     
+     // TOP command (per-task CPU usage)
+     registerCommand("top", "Per-task CPU, stack and core (top [count])",
+         [this](const std::vector<String>& args) {
+             char line[96];
+             taskProfiler.watch();
+             
+             uint32_t intervalMs = taskProfiler.getIntervalMs();
+             if (intervalMs == 0) {
+                 println("Collecting CPU figures, run top again in a second", TERM_COLOR_SYSTEM);
+             } else {
+                 snprintf(line, sizeof(line), "CPU0 %3u%%  CPU1 %3u%%  over %.1f s from %s",
+                          taskProfiler.getCoreLoad(0), taskProfiler.getCoreLoad(1), intervalMs / 1000.0f,
+                          TaskProfiler::hasRunTimeCounters() ? "run time" : "samples");
+                 println(line, TERM_COLOR_SYSTEM);
+             }
+             
+             static TaskCpuStats tasks[TDECK_PROFILER_MAX_TASKS];
+             size_t limit = args.size() > 1 ? (size_t)max(1L, args[1].toInt()) : TDECK_PROFILER_MAX_TASKS;
+             size_t count = taskProfiler.getTasks(tasks, min(limit, (size_t)TDECK_PROFILER_MAX_TASKS));
+             
+             println("Task              CPU%  Core  Pri  Stack free", TERM_COLOR_SYSTEM);
+             for (size_t i = 0; i < count; i++) {
+                 const TaskCpuStats& task = tasks[i];
+                 char core[4] = "any";
+                 if (task.core != PROFILER_ANY_CORE) {
+                     snprintf(core, sizeof(core), "%u", task.core);
+                 }
+                 snprintf(line, sizeof(line), "%-16s %5.1f  %4s  %3u  %10lu", task.name, task.cpuPermille / 10.0f,
+                          core, task.priority, (unsigned long)task.stackFree);
+                 
+                 // Under 512 bytes of headroom is worth a look
+                 println(line, task.stackFree < 512 ? TERM_COLOR_ERROR : TERM_COLOR_NORMAL);
+             }
+         }
+     );
+     
+     // PERF command (PC sampling profile)
+     registerCommand("perf", "PC sampling profile (start [hz], stop, report [count], dump)",
+         [this](const std::vector<String>& args) {
+             String action = args.size() > 1 ? args[1] : "report";
+             char line[96];
+             
+             if (action == "start") {
+                 uint32_t hz = args.size() > 2 ? args[2].toInt() : TDECK_PROFILER_SAMPLE_HZ;
+                 if (!taskProfiler.startPerf(hz)) {
+                     snprintf(line, sizeof(line), "Failed to start sampling, rates are 1-%d Hz", TDECK_PROFILER_MAX_HZ);
+                     println(line, TERM_COLOR_ERROR);
+                     return;
+                 }
+                 snprintf(line, sizeof(line), "Sampling both cores at %lu Hz, 'perf stop' to end", (unsigned long)hz);
+                 println(line, TERM_COLOR_SYSTEM);
+                 return;
+             }
+             if (action == "stop") {
+                 taskProfiler.stopPerf();
+                 println("Sampling stopped, 'perf report' shows the profile", TERM_COLOR_SYSTEM);
+                 return;
+             }
+             if (action != "report" && action != "dump") {
+                 println("Usage: perf [start [hz]|stop|report [count]|dump]", TERM_COLOR_ERROR);
+                 return;
+             }
+             
+             // Dumps go to the serial port, for tools/perf_report.py to total per function
+             bool dump = action == "dump";
+             static PerfHotspot hotspots[TDECK_PROFILER_PC_SLOTS * portNUM_PROCESSORS];
+             size_t limit = dump ? TDECK_PROFILER_PC_SLOTS * portNUM_PROCESSORS :
+                                   (args.size() > 2 ? (size_t)max(1L, args[2].toInt()) : 10);
+             uint32_t total;
+             uint32_t dropped;
+             size_t count = taskProfiler.getHotspots(hotspots,
+                                                     min(limit, (size_t)(TDECK_PROFILER_PC_SLOTS * portNUM_PROCESSORS)),
+                                                     total, dropped);
+             if (total == 0) {
+                 println("No samples, run 'perf start' first", TERM_COLOR_NORMAL);
+                 return;
+             }
+             
+             snprintf(line, sizeof(line), "%lu samples%s, %lu dropped", (unsigned long)total,
+                      taskProfiler.isPerfRunning() ? " so far" : "", (unsigned long)dropped);
+             println(line, TERM_COLOR_SYSTEM);
+             
+             if (dump) {
+                 for (size_t i = 0; i < count; i++) {
+                     TDECK_DEBUG_SERIAL.printf("PERF %u %08lx %lu\n", hotspots[i].core, (unsigned long)hotspots[i].pc,
+                                               (unsigned long)hotspots[i].count);
+                 }
+                 TDECK_DEBUG_SERIAL.printf("PERF total %lu\n", (unsigned long)total);
+                 snprintf(line, sizeof(line), "Wrote %u buckets to the serial port", (unsigned)count);
+                 println(line, TERM_COLOR_NORMAL);
+                 return;
+             }
+             
+             // Resolve with xtensa-esp32s3-elf-addr2line -pfe firmware.elf
+             println("Share  Samples  Core  PC", TERM_COLOR_SYSTEM);
+             for (size_t i = 0; i < count; i++) {
+                 snprintf(line, sizeof(line), "%4.1f%%  %7lu  %4u  %08lx", hotspots[i].count * 100.0f / total,
+                          (unsigned long)hotspots[i].count, hotspots[i].core, (unsigned long)hotspots[i].pc);
+                 println(line, TERM_COLOR_NORMAL);
+             }
+         }
+     );
+     
+     // TRACE command (deferred trace log)
+     registerCommand("trace", "Trace rings and sinks (trace [serial|sd on|off], flush)",
+         [this](const std::vector<String>& args) {
+             String action = args.size() > 1 ? args[1] : "";
+             char line[96];
+             
+             if (action == "serial" || action == "sd") {
+                 uint8_t sink = action == "serial" ? TRACE_SINK_SERIAL : TRACE_SINK_SD;
+                 if (args.size() < 3 || (args[2] != "on" && args[2] != "off")) {
+                     println("Usage: trace " + action + " on|off", TERM_COLOR_ERROR);
+                     return;
+                 }
+                 uint8_t sinks = traceLog.getSinks();
+                 traceLog.setSinks(args[2] == "on" ? sinks | sink : sinks & ~sink);
+             } else if (action == "flush") {
+                 snprintf(line, sizeof(line), "Wrote %u records", (unsigned)traceLog.drain());
+                 println(line, TERM_COLOR_NORMAL);
+                 return;
+             } else if (action != "") {
+                 println("Usage: trace [serial on|off|sd on|off|flush]", TERM_COLOR_ERROR);
+                 return;
+             }
+             
+             uint8_t sinks = traceLog.getSinks();
+             snprintf(line, sizeof(line), "Serial %s, SD %s (%s)", sinks & TRACE_SINK_SERIAL ? "on" : "off",
+                      sinks & TRACE_SINK_SD ? "on" : "off", TDECK_TRACE_LOG_FILE);
+             println(line, TERM_COLOR_SYSTEM);
+             
+             println("Core  Recorded  Dropped  Queued B", TERM_COLOR_SYSTEM);
+             for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                 TraceRingStats stats;
+                 traceLog.getStats(core, stats);
+                 snprintf(line, sizeof(line), "%4d  %8lu  %7lu  %8lu", core, (unsigned long)stats.recorded,
+                          (unsigned long)stats.dropped, (unsigned long)stats.used);
+                 println(line, stats.dropped ? TERM_COLOR_ERROR : TERM_COLOR_NORMAL);
+             }
+         }
+     );
+     
      // WIFI command (WiFi control)
      registerCommand("wifi", "WiFi control (scan, connect, status)",
          [this](const std::vector<String>& args) {
@@ -624,10 +1061,214 @@
          }
      );
      
+     // LORA command (link statistics and benchmark)
+     registerCommand("lora", "LoRa link statistics and benchmark (stats, bench)",
+         [this](const std::vector<String>& args) {
+             if (args.size() < 2) {
+                 println("Usage: lora <stats|bench> [...]", TERM_COLOR_ERROR);
+                 return;
+             }
+             
+             if (!TDECK_FEATURE_LORA || !loraManager.isInitialized()) {
+                 println("LoRa not initialized", TERM_COLOR_ERROR);
+                 return;
+             }
+             
+             String action = args[1];
+             char line[96];
+             
+             if (action == "stats") {
+                 if (args.size() >= 3 && args[2] == "reset") {
+                     loraStats.reset();
+                     println("LoRa statistics cleared", TERM_COLOR_SYSTEM);
+                     return;
+                 }
+                 
+                 println("LoRa Statistics", TERM_COLOR_SYSTEM);
+                 println("---------------", TERM_COLOR_SYSTEM);
+                 
+                 snprintf(line, sizeof(line), "Airtime TX: %.1f s (%lu frames), RX: %.1f s (%lu frames)",
+                          loraStats.getTxAirtime() / 1e6, (unsigned long)loraStats.getTxFrames(),
+                          loraStats.getRxAirtime() / 1e6, (unsigned long)loraStats.getRxFrames());
+                 println(line, TERM_COLOR_NORMAL);
+                 
+                 snprintf(line, sizeof(line), "Duty cycle (%d min): %.2f%%", TDECK_LORA_DUTY_WINDOW_MIN,
+                          loraStats.getDutyCycle());
+                 println(line, TERM_COLOR_NORMAL);
+                 
+                 snprintf(line, sizeof(line), "Time on air: %d B %.1f ms, %d B %.1f ms",
+                          TDECK_LORA_BENCH_SIZE, loraManager.getTimeOnAir(TDECK_LORA_BENCH_SIZE) / 1000.0,
+                          LORA_MAX_PAYLOAD_LENGTH, loraManager.getTimeOnAir(LORA_MAX_PAYLOAD_LENGTH) / 1000.0);
+                 println(line, TERM_COLOR_NORMAL);
+                 
+                 LoRaPeerStats peers[TDECK_LORA_STATS_PEERS + 1];
+                 loraStats.getTotals(peers[0]);
+                 int count = 1 + loraStats.getPeers(peers + 1, TDECK_LORA_STATS_PEERS);
+                 
+                 for (int i = 0; i < count; i++) {
+                     const LoRaPeerStats& stats = peers[i];
+                     uint32_t total = stats.delivered + stats.failed;
+                     String name = i == 0 ? String("All peers") : "Peer 0x" + String(stats.peer, HEX);
+                     
+                     snprintf(line, sizeof(line), "%s: %lu/%lu delivered (%.1f%%), %lu retransmits",
+                              name.c_str(), (unsigned long)stats.delivered, (unsigned long)total,
+                              total ? stats.delivered * 100.0f / total : 0.0f, (unsigned long)stats.retransmits);
+                     println(line, i == 0 ? TERM_COLOR_SYSTEM : TERM_COLOR_NORMAL);
+                     
+                     if (stats.rttSamples > 0) {
+                         snprintf(line, sizeof(line), "  RTT avg %lu ms, p50 %lu ms, p90 %lu ms, max %lu ms",
+                                  (unsigned long)(stats.rttTotalMs / stats.rttSamples),
+                                  (unsigned long)LoRaStats::rttPercentile(stats, 50),
+                                  (unsigned long)LoRaStats::rttPercentile(stats, 90),
+                                  (unsigned long)stats.rttMaxMs);
+                         println(line, TERM_COLOR_NORMAL);
+                     }
+                 }
+                 
+                 // Histogram of all peers
+                 if (peers[0].rttSamples > 0) {
+                     String histogram = "  RTT ms:";
+                     for (int i = 0; i < LORA_RTT_BUCKETS; i++) {
+                         histogram += i < LORA_RTT_BUCKETS - 1 ? " <" + String(64 << i) : String(" more");
+                         histogram += "=" + String(peers[0].rttHistogram[i]);
+                     }
+                     println(histogram, TERM_COLOR_NORMAL);
+                 }
+                 
+                 snprintf(line, sizeof(line), "LBT deferrals: %lu, relayed: %lu, dropped: %lu",
+                          (unsigned long)loraManager.getLbtDeferrals(), (unsigned long)loraManager.getRelayedPackets(),
+                          (unsigned long)loraManager.getDroppedPackets());
+                 println(line, TERM_COLOR_NORMAL);
+             } else if (action == "bench") {
+                 if (args.size() >= 3 && args[2] == "stop") {
+                     loraManager.stopBenchmark();
+                 } else if (args.size() >= 3) {
+                     LoRaBenchMode mode;
+                     if (args[2] == "ping") {
+                         mode = LORA_BENCH_MODE_PING;
+                     } else if (args[2] == "flood") {
+                         mode = LORA_BENCH_MODE_FLOOD;
+                     } else {
+                         println("Unknown benchmark: " + args[2], TERM_COLOR_ERROR);
+                         return;
+                     }
+                     
+                     if (args.size() < 4) {
+                         println("Usage: lora bench <ping|flood> <peer hex id> [count] [size]", TERM_COLOR_ERROR);
+                         return;
+                     }
+                     
+                     uint16_t peer = strtoul(args[3].c_str(), nullptr, 16);
+                     int count = args.size() >= 5 ? args[4].toInt() : TDECK_LORA_BENCH_COUNT;
+                     int size = args.size() >= 6 ? args[5].toInt() : TDECK_LORA_BENCH_SIZE;
+                     
+                     if (count <= 0 || count > 0xFFFF || size <= 0 ||
+                         !loraManager.startBenchmark(mode, peer, count, min(size, 255))) {
+                         println("Failed to start LoRa benchmark", TERM_COLOR_ERROR);
+                         return;
+                     }
+                     println("Benchmark started, run 'lora bench' for progress", TERM_COLOR_SYSTEM);
+                 }
+                 
+                 LoRaBenchResult result;
+                 loraManager.getBenchmark(result);
+                 if (result.mode == LORA_BENCH_IDLE) {
+                     println("No benchmark has run", TERM_COLOR_NORMAL);
+                     println("Usage: lora bench <ping|flood|stop> [peer hex id] [count] [size]", TERM_COLOR_NORMAL);
+                     return;
+                 }
+                 
+                 snprintf(line, sizeof(line), "%s to 0x%04X: %s, %u/%u sent, %u B each",
+                          result.mode == LORA_BENCH_MODE_PING ? "Ping" : "Flood", result.peer,
+                          result.running ? "running" : "done", result.sent, result.count, result.size);
+                 println(line, TERM_COLOR_SYSTEM);
+                 
+                 snprintf(line, sizeof(line), "%s: %u, lost: %u, elapsed: %.1f s, airtime: %.1f s",
+                          result.mode == LORA_BENCH_MODE_PING ? "Pongs" : "Delivered", result.received,
+                          result.failed, result.elapsedMs / 1000.0, result.airtimeMicros / 1e6);
+                 println(line, TERM_COLOR_NORMAL);
+                 
+                 if (result.mode == LORA_BENCH_MODE_PING && result.received > 0) {
+                     snprintf(line, sizeof(line), "RTT min/avg/max: %lu/%lu/%lu ms",
+                              (unsigned long)result.rttMinMs, (unsigned long)(result.rttTotalMs / result.received),
+                              (unsigned long)result.rttMaxMs);
+                     println(line, TERM_COLOR_NORMAL);
+                 }
+                 
+                 snprintf(line, sizeof(line), "Goodput: %.0f bit/s", LoRaBench::goodput(result));
+                 println(line, TERM_COLOR_NORMAL);
+             } else {
+                 println("Unknown LoRa command: " + action, TERM_COLOR_ERROR);
+             }
+         }
+     );
+     
+     // OTA command (updates from the SD card or a LoRa peer, without WiFi)
+     registerCommand("ota", "Firmware update (status, file, accept, send, abort)",
+         [this](const std::vector<String>& args) {
+             String action = args.size() >= 2 ? args[1] : String("status");
+             
+             if (action == "status") {
+                 static const char* const names[] = {
+                     "idle", "checking", "update available", "downloading", "applying", "complete", "error"
+                 };
+                 OTAUpdateStatus status = otaManager.getStatus();
+                 println(String("OTA: ") + names[status] + ", " + String(otaManager.getDownloadProgress()) + "%",
+                         TERM_COLOR_SYSTEM);
+                 if (status == OTA_ERROR) {
+                     println(otaManager.getErrorMessage(), TERM_COLOR_ERROR);
+                 }
+             } else if (action == "file") {
+                 if (args.size() < 3) {
+                     println("Usage: ota file <path> [sha256]", TERM_COLOR_ERROR);
+                     return;
+                 }
+                 if (!otaManager.startUpdateFromFile(args[2].c_str(), args.size() >= 4 ? args[3].c_str() : NULL)) {
+                     println(String("Update not started: ") + otaManager.getErrorMessage(), TERM_COLOR_ERROR);
+                     return;
+                 }
+                 println("Updating from " + args[2] + ", run 'ota' for progress", TERM_COLOR_SYSTEM);
+             } else if (action == "accept") {
+                 if (args.size() < 3) {
+                     println("Usage: ota accept <peer hex id> [seconds]", TERM_COLOR_ERROR);
+                     return;
+                 }
+                 uint16_t peer = strtoul(args[2].c_str(), nullptr, 16);
+                 uint32_t timeoutMs = args.size() >= 4 ? args[3].toInt() * 1000 : TDECK_OTA_PEER_TIMEOUT_MS;
+                 if (!otaManager.acceptPeerUpdate(peer, timeoutMs)) {
+                     println(String("Cannot accept an update: ") + otaManager.getErrorMessage(), TERM_COLOR_ERROR);
+                     return;
+                 }
+                 println("Accepting one update from 0x" + String(peer, HEX) + ", it is applied once received",
+                         TERM_COLOR_SYSTEM);
+             } else if (action == "send") {
+                 if (args.size() < 4) {
+                     println("Usage: ota send <peer hex id> <path>", TERM_COLOR_ERROR);
+                     return;
+                 }
+                 uint16_t peer = strtoul(args[2].c_str(), nullptr, 16);
+                 if (!otaManager.sendPeerUpdate(args[3].c_str(), peer)) {
+                     println("Failed to send " + args[3], TERM_COLOR_ERROR);
+                     return;
+                 }
+                 println("Sending " + args[3] + " to 0x" + String(peer, HEX) + ", the peer must run 'ota accept'",
+                         TERM_COLOR_SYSTEM);
+             } else if (action == "abort") {
+                 if (!otaManager.abortUpdate()) {
+                     println("No update in progress", TERM_COLOR_ERROR);
+                 }
+             } else {
+                 println("Unknown OTA command: " + action, TERM_COLOR_ERROR);
+             }
+         }
+     );
+     
      // REBOOT command
      registerCommand("reboot", "Reboot the device",
          [this](const std::vector<String>& args) {
              println("Rebooting...", TERM_COLOR_SYSTEM);
+             configStorage.flush();
+             traceLog.drain();
              delay(1000);
              ESP.restart();
          }
@@ -17,6 +17,7 @@
  #include <functional>
  #include "../../config.h"
  #include "../system/fs_manager.h"
+ #include "app_base.h"
  
  extern FSManager fsManager;
  
@@ -28,7 +29,10 @@
  #define TERM_COLOR_SYSTEM    0xFFFF00 // Yellow
  
  // Terminal configuration
- #define TERM_MAX_HISTORY        100   // Maximum lines in terminal history
+ #define TERM_MAX_HISTORY        100   // Maximum lines in terminal history (scrollback ring size)
+ #define TERM_LINE_LENGTH        52    // Characters per line before wrapping
+ #define TERM_VISIBLE_LINES      11    // Output lines shown on screen
+ #define TERM_LINE_HEIGHT        16    // Output line height in pixels
  #define TERM_MAX_CMD_HISTORY    20    // Maximum commands in history
  #define TERM_MAX_COMMAND_LENGTH 128   // Maximum command length
  #define TERM_PROMPT             "> "  // Command prompt
@@ -36,7 +40,7 @@
  /**
   * @brief Terminal application class
   */
- class Terminal {
+ class Terminal : public AppBase {
  public:
      /**
       * @brief Constructor
@@ -112,17 +116,67 @@
      void registerCommand(const String& command, const String& description, 
                          std::function<void(const std::vector<String>&)> handler);
      
+     /**
+      * @brief Scroll the output through the scrollback
+      * 
+      * @param delta Lines to scroll, positive moves back in history
+      */
+     void scrollLines(int delta);
+     
+     /**
+      * @brief Handle a drag on the output area
+      * 
+      * @param dy Vertical drag distance in pixels since the last call
+      */
+     void handleDrag(lv_coord_t dy);
+     
+ protected:
+     // AppBase lifecycle, the scrollback and history outlive the UI
+     bool onCreate(lv_obj_t* parent) override;
+     void onResume() override;
+     void onPause() override;
+     void onDestroy() override;
+     
  private:
      // UI Elements
      lv_obj_t* _parent;            // Parent container
      lv_obj_t* _container;         // Terminal container
-     lv_obj_t* _textArea;          // Text display area
+     lv_obj_t* _textArea;          // Output area container
+     lv_obj_t* _lineLabels[TERM_VISIBLE_LINES]; // One label per visible output line
      lv_obj_t* _cmdLine;           // Command input line
      lv_obj_t* _scrollBar;         // Scroll bar
+     lv_group_t* _group;           // Keypad focus group of the command line
+     String _draftCommand;         // Command line text kept while the UI is destroyed
      
      // State
      bool _running;                // Is terminal running
-     std::deque<String> _history;  // Terminal output history
+     
+     // Output scrollback, a fixed ring of lines so printing never reallocates
+     struct TermLine {
+         char text[TERM_LINE_LENGTH + 1];
+         uint8_t length;
+         uint32_t color;
+         uint32_t seq;             // Changes whenever the line content changes
+     };
+     
+     TermLine _lines[TERM_MAX_HISTORY]; // Ring buffer of output lines
+     uint16_t _lineStart;          // Ring index of the oldest line
+     uint16_t _lineCount;          // Lines in the ring
+     bool _lineOpen;               // Last line has no newline yet
+     uint32_t _lineSeq;            // Last sequence number handed out
+     uint16_t _scrollOffset;       // Lines scrolled back from the bottom
+     lv_coord_t _dragAccum;        // Drag distance not yet turned into lines
+     
+     // Visible line cache, labels point at these buffers
+     char _viewText[TERM_VISIBLE_LINES][TERM_LINE_LENGTH + 1];
+     uint32_t _viewSeq[TERM_VISIBLE_LINES];
+     uint32_t _viewColor[TERM_VISIBLE_LINES];
+     lv_style_t _viewStyles[TERM_VISIBLE_LINES];
+     
+     // Coalesced rendering
+     lv_task_t* _renderTask;       // Redraws the view once per frame when output changed
+     bool _renderPending;          // Render task is scheduled
+     
      std::deque<String> _cmdHistory; // Command history
      int _cmdHistoryPos;           // Position in command history
      
@@ -151,10 +205,38 @@
      std::vector<String> parseCommand(const String& command);
      
      /**
-      * @brief Update terminal display
+      * @brief Append text to the scrollback ring
+      * 
+      * @param text Text to append, newlines start a new line
+      * @param color Text color for new lines
+      */
+     void appendText(const char* text, uint32_t color);
+     
+     /**
+      * @brief Start a new line in the scrollback ring
+      * 
+      * @param color Text color of the line
+      * @return The new line
+      */
+     TermLine& newLine(uint32_t color);
+     
+     /**
+      * @brief Schedule a redraw of the visible lines for the next frame
       */
      void updateDisplay();
      
+     /**
+      * @brief Redraw the visible lines that changed
+      */
+     void renderLines();
+     
+     /**
+      * @brief Render task callback
+      * 
+      * @param task LVGL task
+      */
+     static void renderTaskCallback(lv_task_t* task);
+     
      /**
       * @brief Scroll to bottom of terminal
       */
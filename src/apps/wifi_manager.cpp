@@ -5,11 +5,26 @@
 
  #include "apps/wifi_manager.h"
  #include "system/fs_manager.h"
+ #include "system/config_storage.h"
  #include <ArduinoJson.h>
  
  // External reference to the file system manager
  extern FSManager fsManager;
  
+ // WiFi manager, scan table changes come from its update() on the system task
+ extern WiFiManager wifiManager;
+ 
+ // One channel's scan table changes handed from the system task to the UI task
+ struct WiFiScanBatch {
+     WiFiManagerApp* app;
+     std::vector<WiFiScanChange> changes;
+     WiFiScanEvent event;
+     size_t index;
+ };
+ 
+ WiFiManagerApp::WiFiManagerApp() : AppBase("WiFi"), _wifiManager(wifiManager) {
+ }
+ 
  bool WiFiManagerApp::init(lv_obj_t* parent) {
      if (parent == nullptr) {
          TDECK_LOG_E("WiFiManagerApp: Invalid parent container");
@@ -21,6 +36,30 @@
      // Load saved WiFi configuration
      loadWiFiConfig();
      
+     // The table is only read here, on its own task, and posted to the UI once per channel
+     _wifiManager.setScanCallback([this](WiFiScanEvent event, size_t index) {
+         // Networks found before we registered would otherwise only show once they change
+         if (!_tableSeeded) {
+             for (size_t i = 0; i < _wifiManager.getScanResultCount(); i++) {
+                 _pendingChanges.push_back(WiFiScanChange{WIFI_SCAN_NETWORK_ADDED, _wifiManager.getScanResult(i)});
+             }
+             _tableSeeded = true;
+         }
+         
+         if (event != WIFI_SCAN_CHANNEL_DONE && event != WIFI_SCAN_FINISHED) {
+             _pendingChanges.push_back(WiFiScanChange{event, _wifiManager.getScanResult(index)});
+             return;
+         }
+         
+         WiFiScanBatch* batch = new WiFiScanBatch{this, std::move(_pendingChanges), event, index};
+         _pendingChanges.clear();
+         if (!uiManager.postWork(onScanBatch, batch, pdMS_TO_TICKS(TDECK_WIFI_SCAN_DWELL_MS))) {
+             // Keep the changes for the next channel rather than lose a removal
+             _pendingChanges = std::move(batch->changes);
+             delete batch;
+         }
+     });
+     
      TDECK_LOG_I("WiFiManagerApp: Initialized");
      return true;
  }
@@ -31,13 +70,13 @@
          return true;
      }
      
-     if (_parentContainer == nullptr) {
-         TDECK_LOG_E("WiFiManagerApp: Not initialized");
+     if (_appContainer == nullptr) {
+         TDECK_LOG_E("WiFiManagerApp: UI not created");
          return false;
      }
      
-     // Create the UI
-     createUI();
+     // Show the UI
+     lv_obj_set_hidden(_appContainer, false);
      
      // Start with a WiFi scan
      startScan();
@@ -55,11 +94,8 @@
          return;
      }
      
-     // Delete UI elements
-     if (_appContainer != nullptr) {
-         lv_obj_del(_appContainer);
-         _appContainer = nullptr;
-     }
+     // Hide the UI, it is deleted once the app is destroyed
+     lv_obj_set_hidden(_appContainer, true);
      
      // Delete task
      lv_task_t* task = lv_task_get_next(NULL);
@@ -75,6 +111,49 @@
      TDECK_LOG_I("WiFiManagerApp: Stopped");
  }
  
+ bool WiFiManagerApp::onCreate(lv_obj_t* parent) {
+     if (!init(parent)) {
+         return false;
+     }
+     
+     createUI();
+     lv_obj_set_hidden(_appContainer, true);
+     
+     // Show the networks found before the UI was last destroyed
+     if (!_scanResults.empty()) {
+         updateNetworkList();
+     }
+     
+     return true;
+ }
+ 
+ void WiFiManagerApp::onResume() {
+     start();
+ }
+ 
+ void WiFiManagerApp::onPause() {
+     stop();
+ }
+ 
+ void WiFiManagerApp::onDestroy() {
+     // The networks found so far stay in their vector
+     lv_obj_del(_appContainer);
+     _appContainer = nullptr;
+     _tabView = nullptr;
+     _scanTab = nullptr;
+     _connectTab = nullptr;
+     _statusTab = nullptr;
+     _settingsTab = nullptr;
+     _networkList = nullptr;
+     _scanBtn = nullptr;
+     _messageLabel = nullptr;
+     _passwordTextArea = nullptr;
+     _connectBtn = nullptr;
+     _disconnectBtn = nullptr;
+     _apModeSwitch = nullptr;
+     _keyboard = nullptr;
+ }
+ 
  bool WiFiManagerApp::isRunning() const {
      return _isRunning;
  }
@@ -194,32 +273,76 @@
          return;
      }
      
+     // The list keeps the last scan, each channel's changes arrive through the scan callback
+     if (!_wifiManager.startScan()) {
+         lv_label_set_text(_messageLabel, "Scan failed. Try again.");
+         return;
+     }
+     
      _isScanning = true;
      lv_label_set_text(_messageLabel, "Scanning for networks...");
-     
-     // Clear previous results
-     lv_list_clean(_networkList);
-     _scanResults.clear();
-     
-     // Start scan asynchronously
-     _wifiManager.startScan([this](const std::vector<WiFiResult>& results, bool success) {
-         _isScanning = false;
-         
-         if (!success) {
-             lv_label_set_text(_messageLabel, "Scan failed. Try again.");
-             return;
+ }
+ 
+ void WiFiManagerApp::onScanBatch(void* arg) {
+     WiFiScanBatch* batch = (WiFiScanBatch*)arg;
+     batch->app->applyScanChanges(batch->changes, batch->event, batch->index);
+     delete batch;
+ }
+ 
+ void WiFiManagerApp::applyScanChanges(const std::vector<WiFiScanChange>& changes, WiFiScanEvent event, size_t index) {
+     for (const WiFiScanChange& change : changes) {
+         size_t i = 0;
+         while (i < _scanResults.size() && _scanResults[i].bssid != change.network.bssid) {
+             i++;
          }
          
-         _scanResults = results;
-         
-         if (_scanResults.empty()) {
-             lv_label_set_text(_messageLabel, "No networks found.");
-             return;
+         if (change.event == WIFI_SCAN_NETWORK_REMOVED) {
+             if (i < _scanResults.size()) {
+                 _scanResults.erase(_scanResults.begin() + i);
+             }
+         } else if (i < _scanResults.size()) {
+             _scanResults[i] = change.network;
+         } else {
+             _scanResults.push_back(change.network);
+         }
+     }
+     
+     if (!changes.empty()) {
+         // Removals shift the list, follow the selected network by name
+         _selectedNetworkIndex = -1;
+         for (size_t i = 0; i < _scanResults.size(); i++) {
+             if (_scanResults[i].ssid == _selectedSSID) {
+                 _selectedNetworkIndex = i;
+                 break;
+             }
          }
          
+         // One rebuild per channel rather than per network
+         if (_networkList) {
+             updateNetworkList();
+         }
+     }
+     
+     // Scans started elsewhere update the list without touching the message
+     if (!_isScanning || !_messageLabel) {
+         if (event == WIFI_SCAN_FINISHED) {
+             _isScanning = false;
+         }
+         return;
+     }
+     
+     if (event == WIFI_SCAN_CHANNEL_DONE) {
+         lv_label_set_text(_messageLabel, String("Scanning channel " + String(index) + "... " +
+                                                 String(_scanResults.size()) + " networks").c_str());
+         return;
+     }
+     
+     _isScanning = false;
+     if (_scanResults.empty()) {
+         lv_label_set_text(_messageLabel, "No networks found.");
+     } else {
          lv_label_set_text(_messageLabel, String(String(_scanResults.size()) + " networks found").c_str());
-         updateNetworkList();
-     });
+     }
  }
  
  void WiFiManagerApp::updateNetworkList() {
@@ -228,7 +351,7 @@
      
      // Add networks to list
      for (size_t i = 0; i < _scanResults.size(); i++) {
-         const WiFiResult& result = _scanResults[i];
+         const WiFiNetwork& result = _scanResults[i];
          
          // Determine signal strength icon
          const char* signalIcon;
@@ -244,7 +367,7 @@
          String itemText = String(signalIcon) + " " + result.ssid;
          
          // Add lock symbol for secured networks
-         if (result.encryption != WIFI_AUTH_OPEN) {
+         if (result.encryptionType != WIFI_AUTH_OPEN) {
              itemText += " " + String(LV_SYMBOL_LOCK);
          }
          
@@ -317,7 +440,7 @@
          return;
      }
      
-     const WiFiResult& network = _scanResults[_selectedNetworkIndex];
+     const WiFiNetwork& network = _scanResults[_selectedNetworkIndex];
      String password = String(lv_textarea_get_text(_passwordTextArea));
      
      lv_label_set_text(_messageLabel, String("Connecting to " + network.ssid + "...").c_str());
@@ -367,7 +490,7 @@
      doc["apSSID"] = _wifiConfig.apSSID;
      doc["apPassword"] = _wifiConfig.apPassword;
      
-     fsManager.saveJsonToFile(TDECK_FS_WIFI_CONFIG_FILE, doc);
+     configStorage.write(TDECK_FS_WIFI_CONFIG_FILE, doc);
      TDECK_LOG_I("WiFiManagerApp: Configuration saved");
  }
  
@@ -383,7 +506,7 @@
      _wifiConfig.apPassword = TDECK_WIFI_AP_PASSWORD;
      
      // Try to load from file
-     if (fsManager.loadJsonFromFile(TDECK_FS_WIFI_CONFIG_FILE, doc)) {
+     if (configStorage.read(TDECK_FS_WIFI_CONFIG_FILE, doc)) {
          _wifiConfig.autoConnect = doc["autoConnect"] | false;
          _wifiConfig.lastSSID = doc["lastSSID"] | "";
          _wifiConfig.lastPassword = doc["lastPassword"] | "";
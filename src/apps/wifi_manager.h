@@ -16,13 +16,27 @@
  #include "config.h"
  #include "comms/wifi.h"
  #include "ui/ui_manager.h"
+ #include "apps/app_base.h"
+ 
+ /**
+  * @brief One change to the WiFi scan table, as seen by the app
+  */
+ struct WiFiScanChange {
+     WiFiScanEvent event;  ///< Added, updated or removed
+     WiFiNetwork network;  ///< The network, matched to the app's list by BSSID
+ };
  
  /**
   * @class WiFiManagerApp
   * @brief Application for managing WiFi connections
   */
- class WiFiManagerApp {
+ class WiFiManagerApp : public AppBase {
  public:
+     /**
+      * @brief Constructor
+      */
+     WiFiManagerApp();
+ 
      /**
       * @brief Initialize the WiFi Manager application
       * @param parent Parent container for the application UI
@@ -47,6 +61,13 @@
       */
      bool isRunning() const;
  
+ protected:
+     // AppBase lifecycle
+     bool onCreate(lv_obj_t* parent) override;
+     void onResume() override;
+     void onPause() override;
+     void onDestroy() override;
+ 
  private:
      // UI Objects
      lv_obj_t* _parentContainer = nullptr;  ///< Parent container
@@ -70,11 +91,15 @@
      bool _isScanning = false;              ///< WiFi scanning state
      String _selectedSSID;                  ///< Currently selected SSID
      int _selectedNetworkIndex = -1;        ///< Index of selected network in scan results
-     std::vector<WiFiResult> _scanResults;  ///< WiFi scan results
+     std::vector<WiFiNetwork> _scanResults; ///< Scan table, kept in step with its change notifications
      WiFiConfigData _wifiConfig;            ///< WiFi configuration data
      
+     // Only touched by the scan callback, on the task running WiFiManager::update()
+     std::vector<WiFiScanChange> _pendingChanges; ///< Changes since the last channel was posted
+     bool _tableSeeded = false;             ///< Whether the existing table has been posted
+     
      // WiFi Manager reference
-     WiFiManager& _wifiManager = WiFiManager::getInstance();
+     WiFiManager& _wifiManager;
      
      /**
       * @brief Create the UI components for the application
@@ -91,6 +116,14 @@
       */
      void updateNetworkList();
      
+     /**
+      * @brief Apply one channel's scan table changes, on the UI task
+      * @param changes Changes in the order the table made them
+      * @param event WIFI_SCAN_CHANNEL_DONE or WIFI_SCAN_FINISHED
+      * @param index Channel number, or the table size once finished
+      */
+     void applyScanChanges(const std::vector<WiFiScanChange>& changes, WiFiScanEvent event, size_t index);
+     
      /**
       * @brief Update the WiFi status display
       */
@@ -130,6 +163,7 @@
      static void onApModeSwitchChanged(lv_obj_t* obj, lv_event_t event);
      static void onKeyboardEvent(lv_obj_t* obj, lv_event_t event);
      static void onStatusUpdateTimer(lv_task_t* task);
+     static void onScanBatch(void* arg);
  };
  
  #endif // TDECK_WIFI_MANAGER_H
\ No newline at end of file
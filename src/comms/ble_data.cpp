@@ -0,0 +1,237 @@
+/**
+ * @file ble_data.cpp
+ * @brief Implementation of the BLE data channel
+ */
+
+ #include "ble_data.h"
+ #include <BLEDevice.h>
+ #include <BLE2902.h>
+ #include <esp_gap_ble_api.h>
+ #include <esp_heap_caps.h>
+ #include "../system/trace.h"
+ 
+ // ATT notification header, the rest of the MTU is payload
+ #define BLE_ATT_HEADER_SIZE 3
+ 
+ // Default ATT MTU before the exchange
+ #define BLE_ATT_DEFAULT_MTU 23
+ 
+ // Largest link layer payload with data length extension
+ #define BLE_DLE_MAX_OCTETS 251
+ 
+ // Connection interval asked for, in 1.25 ms units
+ #define BLE_DATA_CONN_INTERVAL_MIN 6
+ #define BLE_DATA_CONN_INTERVAL_MAX 12
+ #define BLE_DATA_SUPERVISION_TIMEOUT 400   // 10 ms units
+ 
+ // Constructor
+ BLEDataChannel::BLEDataChannel()
+     : _server(nullptr)
+     , _rx(nullptr)
+     , _tx(nullptr)
+     , _credits(nullptr)
+     , _txRing(NULL)
+     , _rxRing(NULL)
+     , _txCredits(NULL)
+     , _txTask(NULL)
+     , _connected(false)
+     , _mtu(BLE_ATT_DEFAULT_MTU)
+     , _rxDropped(0)
+ {
+ }
+ 
+ // Create the service, buffers and TX task and start advertising
+ bool BLEDataChannel::begin(BLEServer* server) {
+     if (_server) {
+         return true;
+     }
+     if (!server) {
+         return false;
+     }
+ 
+     // Rings in PSRAM, the stream buffer control blocks stay in this object
+     uint8_t* txStorage = (uint8_t*)heap_caps_malloc(TDECK_BLE_DATA_TX_BUFFER + 1, MALLOC_CAP_SPIRAM);
+     uint8_t* rxStorage = (uint8_t*)heap_caps_malloc(TDECK_BLE_DATA_RX_BUFFER + 1, MALLOC_CAP_SPIRAM);
+     _txCredits = xSemaphoreCreateCounting(TDECK_BLE_DATA_MAX_CREDITS, 0);
+     if (!txStorage || !rxStorage || !_txCredits) {
+         TDECK_LOG_E("Failed to allocate BLE data channel buffers");
+         heap_caps_free(txStorage);
+         heap_caps_free(rxStorage);
+         if (_txCredits) {
+             vSemaphoreDelete(_txCredits);
+             _txCredits = NULL;
+         }
+         return false;
+     }
+     _txRing = xStreamBufferCreateStatic(TDECK_BLE_DATA_TX_BUFFER + 1, 1, txStorage, &_txRingState);
+     _rxRing = xStreamBufferCreateStatic(TDECK_BLE_DATA_RX_BUFFER + 1, 1, rxStorage, &_rxRingState);
+ 
+     // The peer starts the MTU exchange, this is the largest we accept
+     BLEDevice::setMTU(TDECK_BLE_DATA_MTU);
+ 
+     BLEService* service = server->createService(BLE_DATA_SERVICE_UUID);
+     _rx = service->createCharacteristic(BLE_DATA_RX_UUID, BLECharacteristic::PROPERTY_WRITE_NR |
+                                                           BLECharacteristic::PROPERTY_WRITE);
+     _tx = service->createCharacteristic(BLE_DATA_TX_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+     _credits = service->createCharacteristic(BLE_DATA_CREDITS_UUID, BLECharacteristic::PROPERTY_WRITE);
+     _tx->addDescriptor(new BLE2902());
+     _rx->setCallbacks(this);
+     _credits->setCallbacks(this);
+     service->start();
+ 
+     _server = server;
+     server->setCallbacks(this);
+ 
+     if (xTaskCreatePinnedToCore(txTask, "ble_data_tx", TDECK_BLE_DATA_STACK_SIZE, this, 2,
+                                 &_txTask, 0) != pdPASS) {
+         TDECK_LOG_E("Failed to create BLE data TX task");
+         return false;
+     }
+ 
+     BLEAdvertising* advertising = BLEDevice::getAdvertising();
+     advertising->addServiceUUID(BLE_DATA_SERVICE_UUID);
+     advertising->setScanResponse(true);
+     BLEDevice::startAdvertising();
+ 
+     TDECK_LOG_I("BLE data channel started");
+     return true;
+ }
+ 
+ // Queue data for the peer
+ size_t BLEDataChannel::send(const uint8_t* data, size_t length, uint32_t timeoutMs) {
+     if (!_connected || !_txRing || !data || length == 0) {
+         return 0;
+     }
+     return xStreamBufferSend(_txRing, data, length, pdMS_TO_TICKS(timeoutMs));
+ }
+ 
+ // Read data received from the peer
+ size_t BLEDataChannel::read(uint8_t* buffer, size_t maxLength) {
+     if (!_rxRing || !buffer || maxLength == 0) {
+         return 0;
+     }
+     return xStreamBufferReceive(_rxRing, buffer, maxLength, 0);
+ }
+ 
+ // Get the number of received bytes waiting to be read
+ size_t BLEDataChannel::available() const {
+     return _rxRing ? xStreamBufferBytesAvailable(_rxRing) : 0;
+ }
+ 
+ // Check if a peer is connected
+ bool BLEDataChannel::isConnected() const {
+     return _connected;
+ }
+ 
+ // Get the negotiated ATT MTU
+ uint16_t BLEDataChannel::getMTU() const {
+     return _mtu;
+ }
+ 
+ // A peer connected, ask for the faster link options it may support
+ void BLEDataChannel::onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+     reset();
+     _mtu = BLE_ATT_DEFAULT_MTU;
+     _connected = true;
+ 
+     esp_bd_addr_t peer;
+     memcpy(peer, param->connect.remote_bda, sizeof(peer));
+ 
+     // Data length extension: whole notifications in one link layer packet
+     esp_ble_gap_set_pkt_data_len(peer, BLE_DLE_MAX_OCTETS);
+ 
+ #if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+     // 2M PHY halves the air time of every packet
+     esp_ble_gap_set_preferred_phy(peer, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                   ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+ #endif
+ 
+     // A short connection interval gives more connection events per second
+     esp_ble_conn_update_params_t conn = {};
+     memcpy(conn.bda, peer, sizeof(conn.bda));
+     conn.min_int = BLE_DATA_CONN_INTERVAL_MIN;
+     conn.max_int = BLE_DATA_CONN_INTERVAL_MAX;
+     conn.latency = 0;
+     conn.timeout = BLE_DATA_SUPERVISION_TIMEOUT;
+     esp_ble_gap_update_conn_params(&conn);
+ 
+     TDECK_TRACE_I(BLE, "BLE data peer connected");
+ }
+ 
+ // The peer left, advertise again for the next one
+ void BLEDataChannel::onDisconnect(BLEServer* server) {
+     _connected = false;
+     reset();
+     TDECK_TRACE_I(BLE, "BLE data peer disconnected, %u received bytes dropped", _rxDropped);
+     BLEDevice::startAdvertising();
+ }
+ 
+ // The MTU exchange finished, chunks grow to match
+ void BLEDataChannel::onMtuChanged(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+     _mtu = param->mtu.mtu;
+     TDECK_TRACE_I(BLE, "BLE data MTU %u", _mtu);
+ }
+ 
+ // Data or credits from the peer, runs on the BT task
+ void BLEDataChannel::onWrite(BLECharacteristic* characteristic) {
+     const uint8_t* data = characteristic->getData();
+     size_t length = characteristic->getLength();
+ 
+     if (characteristic == _credits) {
+         if (length < 2) {
+             return;
+         }
+         uint16_t granted = data[0] | (data[1] << 8);
+         for (uint16_t i = 0; i < granted && xSemaphoreGive(_txCredits) == pdTRUE; i++) {
+         }
+         return;
+     }
+ 
+     size_t stored = xStreamBufferSend(_rxRing, data, length, 0);
+     if (stored < length) {
+         _rxDropped += length - stored;
+     }
+ }
+ 
+ // Drop queued data and credits
+ void BLEDataChannel::reset() {
+     while (xSemaphoreTake(_txCredits, 0) == pdTRUE) {
+     }
+     xStreamBufferReset(_txRing);
+     xStreamBufferReset(_rxRing);
+     _rxDropped = 0;
+ }
+ 
+ // TX task, sends MTU-sized chunks as credits allow
+ void BLEDataChannel::txTask(void* parameter) {
+     BLEDataChannel* channel = static_cast<BLEDataChannel*>(parameter);
+     uint8_t* chunk = (uint8_t*)heap_caps_malloc(TDECK_BLE_DATA_MTU, MALLOC_CAP_INTERNAL);
+     if (!chunk) {
+         TDECK_TRACE_E(BLE, "Failed to allocate BLE data TX chunk");
+         vTaskDelete(NULL);
+         return;
+     }
+ 
+     while (true) {
+         // Hold each notification back until the peer has room for it
+         if (xSemaphoreTake(channel->_txCredits, portMAX_DELAY) != pdTRUE) {
+             continue;
+         }
+ 
+         // A full chunk if one is queued, otherwise what arrives within the flush time
+         size_t payload = min((size_t)channel->_mtu, (size_t)TDECK_BLE_DATA_MTU) - BLE_ATT_HEADER_SIZE;
+         xStreamBufferSetTriggerLevel(channel->_txRing, payload);
+         size_t length = xStreamBufferReceive(channel->_txRing, chunk, payload,
+                                              pdMS_TO_TICKS(TDECK_BLE_DATA_FLUSH_MS));
+         if (length == 0 || !channel->_connected) {
+             // Nothing sent, the credit is still the peer's
+             if (channel->_connected) {
+                 xSemaphoreGive(channel->_txCredits);
+             }
+             continue;
+         }
+ 
+         channel->_tx->setValue(chunk, length);
+         channel->_tx->notify();
+     }
+ }
\ No newline at end of file
@@ -0,0 +1,112 @@
+/**
+ * @file ble_data.h
+ * @brief High-throughput BLE data channel
+ *
+ * A GATT service with an RX characteristic the peer writes to, a TX
+ * characteristic notified back, and a credit characteristic. Outgoing data
+ * is queued in a PSRAM ring and sent by a task in chunks as large as the
+ * negotiated MTU allows, one notification per credit the peer has granted,
+ * so a slow peer is never overrun. On connect the channel asks for data
+ * length extension, the 2M PHY and a short connection interval; the peer
+ * decides which it accepts.
+ */
+
+ #ifndef TDECK_COMMS_BLE_DATA_H
+ #define TDECK_COMMS_BLE_DATA_H
+ 
+ #include <Arduino.h>
+ #include <BLEServer.h>
+ #include <freertos/stream_buffer.h>
+ #include "../config.h"
+ 
+ // Service and characteristic UUIDs, shared with the companion app
+ #define BLE_DATA_SERVICE_UUID "7d2e0001-5f84-4c5e-9d4a-54444543b001"
+ #define BLE_DATA_RX_UUID "7d2e0002-5f84-4c5e-9d4a-54444543b001"       // Write without response: peer to device
+ #define BLE_DATA_TX_UUID "7d2e0003-5f84-4c5e-9d4a-54444543b001"       // Notify: device to peer
+ #define BLE_DATA_CREDITS_UUID "7d2e0004-5f84-4c5e-9d4a-54444543b001"  // Write: uint16 little endian, notifications granted
+ 
+ /**
+  * @class BLEDataChannel
+  * @brief Buffered, flow-controlled byte stream over one BLE connection
+  */
+ class BLEDataChannel : public BLEServerCallbacks, public BLECharacteristicCallbacks {
+ public:
+     /**
+      * @brief Constructor
+      */
+     BLEDataChannel();
+ 
+     /**
+      * @brief Create the service, buffers and TX task and start advertising
+      * @param server BLE server to add the service to
+      * @return true if successful
+      */
+     bool begin(BLEServer* server);
+ 
+     /**
+      * @brief Queue data for the peer
+      * @param data Data to send
+      * @param length Number of bytes
+      * @param timeoutMs How long to wait for room in the TX ring
+      * @return Bytes queued, 0 if no peer is connected
+      */
+     size_t send(const uint8_t* data, size_t length, uint32_t timeoutMs = 0);
+ 
+     /**
+      * @brief Read data received from the peer
+      * @param buffer Buffer to receive the data
+      * @param maxLength Maximum bytes to read
+      * @return Bytes read
+      */
+     size_t read(uint8_t* buffer, size_t maxLength);
+ 
+     /**
+      * @brief Get the number of received bytes waiting to be read
+      */
+     size_t available() const;
+ 
+     /**
+      * @brief Check if a peer is connected
+      */
+     bool isConnected() const;
+ 
+     /**
+      * @brief Get the negotiated ATT MTU
+      */
+     uint16_t getMTU() const;
+ 
+     // BLEServerCallbacks
+     void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) override;
+     void onDisconnect(BLEServer* server) override;
+     void onMtuChanged(BLEServer* server, esp_ble_gatts_cb_param_t* param) override;
+ 
+     // BLECharacteristicCallbacks
+     void onWrite(BLECharacteristic* characteristic) override;
+ 
+ private:
+     BLEServer* _server;
+     BLECharacteristic* _rx;
+     BLECharacteristic* _tx;
+     BLECharacteristic* _credits;
+     StreamBufferHandle_t _txRing;          // Queued outgoing bytes
+     StreamBufferHandle_t _rxRing;          // Received bytes not yet read
+     StaticStreamBuffer_t _txRingState;
+     StaticStreamBuffer_t _rxRingState;
+     SemaphoreHandle_t _txCredits;          // One count per notification the peer accepts
+     TaskHandle_t _txTask;
+     volatile bool _connected;
+     volatile uint16_t _mtu;
+     uint32_t _rxDropped;                   // Received bytes lost, RX ring full
+ 
+     /**
+      * @brief Drop queued data and credits, a new peer starts clean
+      */
+     void reset();
+ 
+     /**
+      * @brief TX task, sends MTU-sized chunks as credits allow
+      */
+     static void txTask(void* parameter);
+ };
+ 
+ #endif // TDECK_COMMS_BLE_DATA_H
\ No newline at end of file
@@ -0,0 +1,308 @@
+/**
+ * @file ble_scan_table.cpp
+ * @brief Implementation of the BLE scan result table
+ */
+
+ #include "ble_scan_table.h"
+ #include <esp_heap_caps.h>
+ 
+ static_assert((TDECK_BLE_SCAN_TABLE_SIZE & (TDECK_BLE_SCAN_TABLE_SIZE - 1)) == 0,
+               "TDECK_BLE_SCAN_TABLE_SIZE must be a power of two");
+ 
+ // New advertisers are refused above this fill, probe runs stay short
+ #define BLE_SCAN_TABLE_MAX_FILL (TDECK_BLE_SCAN_TABLE_SIZE * 3 / 4)
+ 
+ // AD structure types
+ #define BLE_AD_UUID16_SOME 0x02
+ #define BLE_AD_UUID16_ALL 0x03
+ #define BLE_AD_UUID128_SOME 0x06
+ #define BLE_AD_UUID128_ALL 0x07
+ #define BLE_AD_NAME_SHORT 0x08
+ #define BLE_AD_NAME_COMPLETE 0x09
+ 
+ // Find an AD structure of a type in one payload, returns its data or nullptr
+ static const uint8_t* findAd(const uint8_t* data, size_t length, uint8_t type, size_t from, size_t& adLength, size_t& next) {
+     size_t offset = from;
+     while (offset + 1 < length) {
+         size_t fieldLength = data[offset];
+         if (fieldLength == 0 || offset + 1 + fieldLength > length) {
+             break;
+         }
+         if (data[offset + 1] == type) {
+             adLength = fieldLength - 1;
+             next = offset + 1 + fieldLength;
+             return data + offset + 2;
+         }
+         offset += 1 + fieldLength;
+     }
+     return nullptr;
+ }
+ 
+ // Append the UUIDs of every AD structure of a type
+ static void collectUuids(const uint8_t* data, size_t length, uint8_t type, size_t uuidSize, std::vector<String>& uuids) {
+     size_t from = 0;
+     size_t adLength;
+     size_t next;
+     const uint8_t* ad;
+     while ((ad = findAd(data, length, type, from, adLength, next)) != nullptr) {
+         for (size_t i = 0; i + uuidSize <= adLength; i += uuidSize) {
+             char text[37];
+             if (uuidSize == 2) {
+                 snprintf(text, sizeof(text), "%02X%02X", ad[i + 1], ad[i]);
+             } else {
+                 // Little endian on air, canonical text is big endian
+                 const uint8_t* u = ad + i;
+                 snprintf(text, sizeof(text),
+                          "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                          u[15], u[14], u[13], u[12], u[11], u[10], u[9], u[8],
+                          u[7], u[6], u[5], u[4], u[3], u[2], u[1], u[0]);
+             }
+             uuids.push_back(text);
+         }
+         from = next;
+     }
+ }
+ 
+ // Constructor
+ BLEScanTable::BLEScanTable()
+     : _entries(nullptr)
+     , _count(0)
+     , _dropped(0)
+     , _lock(NULL)
+ {
+ }
+ 
+ // Destructor
+ BLEScanTable::~BLEScanTable() {
+     heap_caps_free(_entries);
+ }
+ 
+ // Allocate the table and its lock
+ bool BLEScanTable::init() {
+     if (!_lock) {
+         _lock = xSemaphoreCreateMutex();
+     }
+     if (!_entries) {
+         _entries = (BLEScanEntry*)heap_caps_calloc(TDECK_BLE_SCAN_TABLE_SIZE, sizeof(BLEScanEntry),
+                                                    MALLOC_CAP_SPIRAM);
+     }
+     if (!_lock || !_entries) {
+         TDECK_LOG_E("Failed to allocate BLE scan table");
+         return false;
+     }
+     return true;
+ }
+ 
+ // Forget every entry
+ void BLEScanTable::clear() {
+     if (!_entries) {
+         return;
+     }
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     memset(_entries, 0, TDECK_BLE_SCAN_TABLE_SIZE * sizeof(BLEScanEntry));
+     _count = 0;
+     _dropped = 0;
+     xSemaphoreGive(_lock);
+ }
+ 
+ // Record one advertisement or scan response
+ void BLEScanTable::report(const uint8_t address[6], uint8_t addressType, int rssi,
+                           const uint8_t* adv, size_t advLength, const uint8_t* rsp, size_t rspLength) {
+     if (!_entries) {
+         return;
+     }
+ 
+     uint64_t key = 0;
+     for (int i = 0; i < 6; i++) {
+         key = (key << 8) | address[i];
+     }
+     // The all-zero address is not a valid advertiser, keep it as the free marker
+     if (key == 0) {
+         return;
+     }
+     advLength = min(advLength, (size_t)BLE_SCAN_ADV_MAX);
+     rspLength = min(rspLength, (size_t)BLE_SCAN_ADV_MAX);
+     uint32_t now = millis();
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     size_t index = homeSlot(key);
+     while (_entries[index].address != 0 && _entries[index].address != key) {
+         index = (index + 1) & (TDECK_BLE_SCAN_TABLE_SIZE - 1);
+     }
+ 
+     BLEScanEntry& entry = _entries[index];
+     if (entry.address == 0) {
+         if (_count >= BLE_SCAN_TABLE_MAX_FILL) {
+             _dropped++;
+             xSemaphoreGive(_lock);
+             return;
+         }
+         _count++;
+         entry.address = key;
+         entry.rssi = rssi * 16;
+         entry.firstSeen = now;
+         entry.changed = true;
+     } else {
+         // Exponential average with weight 1/4, a changed reading worth showing is a dB or more
+         int16_t smoothed = entry.rssi + (rssi * 16 - entry.rssi) / 4;
+         if ((smoothed >> 4) != (entry.rssi >> 4)) {
+             entry.changed = true;
+         }
+         entry.rssi = smoothed;
+     }
+ 
+     entry.addressType = addressType;
+     entry.lastSeen = now;
+     if (entry.reports < UINT16_MAX) {
+         entry.reports++;
+     }
+ 
+     // Only copy payloads that differ, most advertisers repeat themselves
+     if (adv && advLength > 0 && (advLength != entry.advLength || memcmp(entry.adv, adv, advLength) != 0)) {
+         memcpy(entry.adv, adv, advLength);
+         entry.advLength = advLength;
+         entry.changed = true;
+     }
+     if (rsp && rspLength > 0 && (rspLength != entry.rspLength || memcmp(entry.rsp, rsp, rspLength) != 0)) {
+         memcpy(entry.rsp, rsp, rspLength);
+         entry.rspLength = rspLength;
+         entry.changed = true;
+     }
+     xSemaphoreGive(_lock);
+ }
+ 
+ // Remove entries not heard for a while
+ size_t BLEScanTable::expire(uint32_t maxAgeMs) {
+     if (!_entries) {
+         return 0;
+     }
+ 
+     uint32_t now = millis();
+     size_t removed = 0;
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     size_t index = 0;
+     while (index < TDECK_BLE_SCAN_TABLE_SIZE) {
+         // removeAt() may shift the next entry into this slot, look at it again
+         if (_entries[index].address != 0 && now - _entries[index].lastSeen > maxAgeMs) {
+             removeAt(index);
+             removed++;
+         } else {
+             index++;
+         }
+     }
+     xSemaphoreGive(_lock);
+     return removed;
+ }
+ 
+ // Copy the entries changed since the last call
+ size_t BLEScanTable::takeChanged(std::vector<BLEScanEntry>& out) {
+     out.clear();
+     if (!_entries) {
+         return 0;
+     }
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     for (size_t i = 0; i < TDECK_BLE_SCAN_TABLE_SIZE; i++) {
+         if (_entries[i].address != 0 && _entries[i].changed) {
+             _entries[i].changed = false;
+             out.push_back(_entries[i]);
+         }
+     }
+     xSemaphoreGive(_lock);
+     return out.size();
+ }
+ 
+ // Copy every entry
+ size_t BLEScanTable::snapshot(std::vector<BLEScanEntry>& out) {
+     out.clear();
+     if (!_entries) {
+         return 0;
+     }
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     out.reserve(_count);
+     for (size_t i = 0; i < TDECK_BLE_SCAN_TABLE_SIZE; i++) {
+         if (_entries[i].address != 0) {
+             out.push_back(_entries[i]);
+         }
+     }
+     xSemaphoreGive(_lock);
+     return out.size();
+ }
+ 
+ // Get the number of entries
+ size_t BLEScanTable::size() const {
+     return _count;
+ }
+ 
+ // Get the number of advertisers dropped because the table was full
+ uint32_t BLEScanTable::dropped() const {
+     return _dropped;
+ }
+ 
+ // Decode the advertised name, the complete one preferred
+ String BLEScanTable::decodeName(const BLEScanEntry& entry) {
+     const uint8_t types[] = { BLE_AD_NAME_COMPLETE, BLE_AD_NAME_SHORT };
+     for (uint8_t type : types) {
+         size_t adLength;
+         size_t next;
+         const uint8_t* name = findAd(entry.adv, entry.advLength, type, 0, adLength, next);
+         if (!name) {
+             name = findAd(entry.rsp, entry.rspLength, type, 0, adLength, next);
+         }
+         if (name) {
+             String text;
+             text.reserve(adLength);
+             for (size_t i = 0; i < adLength; i++) {
+                 text += (char)name[i];
+             }
+             return text;
+         }
+     }
+     return String();
+ }
+ 
+ // Decode the advertised service UUIDs
+ void BLEScanTable::decodeServices(const BLEScanEntry& entry, std::vector<String>& uuids) {
+     const uint8_t* payloads[] = { entry.adv, entry.rsp };
+     const size_t lengths[] = { entry.advLength, entry.rspLength };
+     for (int p = 0; p < 2; p++) {
+         collectUuids(payloads[p], lengths[p], BLE_AD_UUID16_ALL, 2, uuids);
+         collectUuids(payloads[p], lengths[p], BLE_AD_UUID16_SOME, 2, uuids);
+         collectUuids(payloads[p], lengths[p], BLE_AD_UUID128_ALL, 16, uuids);
+         collectUuids(payloads[p], lengths[p], BLE_AD_UUID128_SOME, 16, uuids);
+     }
+ }
+ 
+ // Format an address as aa:bb:cc:dd:ee:ff
+ String BLEScanTable::formatAddress(uint64_t address) {
+     char text[18];
+     snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x",
+              (unsigned)(address >> 40) & 0xFF, (unsigned)(address >> 32) & 0xFF,
+              (unsigned)(address >> 24) & 0xFF, (unsigned)(address >> 16) & 0xFF,
+              (unsigned)(address >> 8) & 0xFF, (unsigned)address & 0xFF);
+     return String(text);
+ }
+ 
+ // Home slot of an address, a multiplicative hash spreads vendor prefixes
+ size_t BLEScanTable::homeSlot(uint64_t address) {
+     return (size_t)((address * 0x9E3779B97F4A7C15ULL) >> 32) & (TDECK_BLE_SCAN_TABLE_SIZE - 1);
+ }
+ 
+ // Free a slot, shifting later entries of its probe run back so lookups never stop early
+ void BLEScanTable::removeAt(size_t index) {
+     const size_t mask = TDECK_BLE_SCAN_TABLE_SIZE - 1;
+     size_t hole = index;
+     size_t next = (hole + 1) & mask;
+     while (_entries[next].address != 0) {
+         // An entry may fill the hole if the hole lies between its home slot and where it sits
+         size_t home = homeSlot(_entries[next].address);
+         if (((next - home) & mask) >= ((next - hole) & mask)) {
+             _entries[hole] = _entries[next];
+             hole = next;
+         }
+         next = (next + 1) & mask;
+     }
+     memset(&_entries[hole], 0, sizeof(BLEScanEntry));
+     _count--;
+ }
\ No newline at end of file
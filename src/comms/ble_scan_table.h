@@ -0,0 +1,146 @@
+/**
+ * @file ble_scan_table.h
+ * @brief Fixed-capacity table of BLE scan results
+ *
+ * Advertisements are recorded straight from the GAP event, keyed by the
+ * 48-bit address in an open-addressing hash. An entry keeps a smoothed RSSI
+ * and the raw advertising data; names and service UUIDs are only decoded
+ * when a consumer asks for them. The table lives in PSRAM and never grows,
+ * entries not heard for a while are aged out.
+ */
+
+ #ifndef TDECK_COMMS_BLE_SCAN_TABLE_H
+ #define TDECK_COMMS_BLE_SCAN_TABLE_H
+ 
+ #include <Arduino.h>
+ #include <vector>
+ #include "../config.h"
+ 
+ // Longest legacy advertising or scan response payload
+ #define BLE_SCAN_ADV_MAX 31
+ 
+ /**
+  * @brief One advertiser in the scan table
+  */
+ struct BLEScanEntry {
+     uint64_t address;                 // 48-bit address, 0 marks a free slot
+     int16_t rssi;                     // Smoothed RSSI in 1/16 dBm
+     uint8_t addressType;              // Public, random, ...
+     uint8_t advLength;                // Valid bytes in adv
+     uint8_t rspLength;                // Valid bytes in rsp
+     bool changed;                     // Changed since the last takeChanged()
+     uint16_t reports;                 // Advertisements heard, saturates
+     uint32_t firstSeen;               // millis() of the first advertisement
+     uint32_t lastSeen;                // millis() of the latest advertisement
+     uint8_t adv[BLE_SCAN_ADV_MAX];    // Raw advertising data
+     uint8_t rsp[BLE_SCAN_ADV_MAX];    // Raw scan response data
+ };
+ 
+ /**
+  * @class BLEScanTable
+  * @brief Deduplicated scan results shared by the BT task and its consumers
+  */
+ class BLEScanTable {
+ public:
+     /**
+      * @brief Constructor
+      */
+     BLEScanTable();
+ 
+     /**
+      * @brief Destructor
+      */
+     ~BLEScanTable();
+ 
+     /**
+      * @brief Allocate the table and its lock, call before any other method
+      * @return true if successful
+      */
+     bool init();
+ 
+     /**
+      * @brief Forget every entry
+      */
+     void clear();
+ 
+     /**
+      * @brief Record one advertisement or scan response, runs on the BT task
+      * @param address Address as reported by the controller, most significant byte first
+      * @param addressType Address type
+      * @param rssi Signal strength in dBm
+      * @param adv Advertising data, may be nullptr
+      * @param advLength Advertising data length
+      * @param rsp Scan response data, may be nullptr
+      * @param rspLength Scan response data length
+      */
+     void report(const uint8_t address[6], uint8_t addressType, int rssi,
+                 const uint8_t* adv, size_t advLength, const uint8_t* rsp, size_t rspLength);
+ 
+     /**
+      * @brief Remove entries not heard for a while
+      * @param maxAgeMs Age in milliseconds at which an entry goes
+      * @return Number of entries removed
+      */
+     size_t expire(uint32_t maxAgeMs);
+ 
+     /**
+      * @brief Copy the entries changed since the last call and clear their flag
+      * @param out Receives the entries, cleared first
+      * @return Number of entries copied
+      */
+     size_t takeChanged(std::vector<BLEScanEntry>& out);
+ 
+     /**
+      * @brief Copy every entry
+      * @param out Receives the entries, cleared first
+      * @return Number of entries copied
+      */
+     size_t snapshot(std::vector<BLEScanEntry>& out);
+ 
+     /**
+      * @brief Get the number of entries
+      */
+     size_t size() const;
+ 
+     /**
+      * @brief Get the number of advertisers dropped because the table was full
+      */
+     uint32_t dropped() const;
+ 
+     /**
+      * @brief Decode the advertised name
+      * @param entry Table entry
+      * @return Complete or shortened local name, empty if none
+      */
+     static String decodeName(const BLEScanEntry& entry);
+ 
+     /**
+      * @brief Decode the advertised service UUIDs
+      * @param entry Table entry
+      * @param uuids Receives 16-bit UUIDs as 4 hex digits and 128-bit ones in canonical form
+      */
+     static void decodeServices(const BLEScanEntry& entry, std::vector<String>& uuids);
+ 
+     /**
+      * @brief Format an address as aa:bb:cc:dd:ee:ff
+      */
+     static String formatAddress(uint64_t address);
+ 
+ private:
+     BLEScanEntry* _entries;           // TDECK_BLE_SCAN_TABLE_SIZE slots in PSRAM
+     size_t _count;                    // Slots in use
+     uint32_t _dropped;                // Advertisers not recorded, table full
+     SemaphoreHandle_t _lock;          // Guards the table
+ 
+     /**
+      * @brief Home slot of an address
+      */
+     static size_t homeSlot(uint64_t address);
+ 
+     /**
+      * @brief Free a slot, shifting later entries of its probe run back, caller holds _lock
+      */
+     void removeAt(size_t index);
+ };
+ 
+ #endif // TDECK_COMMS_BLE_SCAN_TABLE_H
\ No newline at end of file
@@ -4,68 +4,19 @@
  */
 
  #include "bluetooth.h"
+ #include "../system/config_storage.h"
 
- // Implementation of the BLE scan callbacks
- BLEScanCallbacks::BLEScanCallbacks(std::vector<BluetoothDevice>& scanResults)
-     : _scanResults(scanResults)
- {
- }
- 
- void BLEScanCallbacks::onResult(BLEAdvertisedDevice advertisedDevice) {
-     BluetoothDevice device;
-     
-     // Fill device information
-     device.address = advertisedDevice.getAddress().toString().c_str();
-     
-     if (advertisedDevice.haveName()) {
-         device.name = advertisedDevice.getName().c_str();
-     } else {
-         device.name = "Unknown";
-     }
-     
-     device.rssi = advertisedDevice.getRSSI();
-     device.paired = false;  // Will be updated later if device is paired
-     device.connected = false; // Will be updated later if device is connected
-     
-     // Add services if advertised
-     if (advertisedDevice.haveServiceUUID()) {
-         String uuid = advertisedDevice.getServiceUUID().toString().c_str();
-         device.services[uuid] = "Unknown Service"; // Default description
-         
-         // Add known service descriptions (could be expanded)
-         if (uuid == "1800") device.services[uuid] = "Generic Access";
-         if (uuid == "1801") device.services[uuid] = "Generic Attribute";
-         if (uuid == "180F") device.services[uuid] = "Battery Service";
-         if (uuid == "180A") device.services[uuid] = "Device Information";
-         if (uuid == "1812") device.services[uuid] = "HID";
-     }
-     
-     // Check if device already exists in results (by address)
-     bool exists = false;
-     for (auto& existingDevice : _scanResults) {
-         if (existingDevice.address == device.address) {
-             // Update existing device info
-             existingDevice = device;
-             exists = true;
-             break;
-         }
-     }
-     
-     // Add new device if not found
-     if (!exists) {
-         _scanResults.push_back(device);
-     }
-     
-     // Log discovery
-     TDECK_LOG_I("BLE device found: %s (%s), RSSI: %d", 
-                 device.name.c_str(), 
-                 device.address.c_str(), 
-                 device.rssi);
- }
+ // Manager receiving GAP events, set by initBLE()
+ static BluetoothManager* gapOwner = nullptr;
  
  // Constructor
  BluetoothManager::BluetoothManager()
      : _scanInProgress(false)
+     , _scanRunning(false)
+     , _scanRestart(false)
+     , _scanEndTime(0)
+     , _scanRestartTime(0)
+     , _lastBatchTime(0)
      , _lastScanTime(0)
      , _lastStatusCheck(0)
      , _isConnected(false)
@@ -73,10 +24,8 @@
      , _isDiscoverable(false)
      , _discoverableEndTime(0)
      , _serialBT(nullptr)
-     , _bleScan(nullptr)
      , _bleServer(nullptr)
      , _bleClient(nullptr)
-     , _scanCallbacks(nullptr)
  {
      // Initialize with default values
      createDefaultConfig();
@@ -90,8 +39,8 @@
          delete _serialBT;
      }
      
-     if (_scanCallbacks) {
-         delete _scanCallbacks;
+     if (gapOwner == this) {
+         gapOwner = nullptr;
      }
      
      // BLE resources are managed by the BLE library
@@ -172,10 +121,29 @@
          // from the BLE library
      }
      
-     // Check if scan has completed (for BLE)
-     if (_scanInProgress && _bleScan && !_bleScan->isScanning()) {
-         _scanInProgress = false;
-         TDECK_LOG_I("BLE scan completed, found %d devices", _scanResults.size());
+     // BLE scan housekeeping, the results themselves arrive on the BT task
+     if (_scanInProgress) {
+         // A duplicate filter hides RSSI changes, restarting the scan resets it
+         if (_config.scanFilterDuplicates && _scanRunning && !_scanRestart &&
+             currentTime - _scanRestartTime >= TDECK_BLE_SCAN_REFRESH_MS &&
+             (long)(_scanEndTime - currentTime) > 1000) {
+             _scanRestartTime = currentTime;
+             _scanRestart = true;
+             if (esp_ble_gap_stop_scanning() != ESP_OK) {
+                 _scanRestart = false;
+             }
+         }
+         
+         _scanTable.expire(TDECK_BLE_SCAN_AGE_MS);
+         
+         if (!_scanRunning && !_scanRestart) {
+             _scanInProgress = false;
+             TDECK_LOG_I("BLE scan completed, found %d devices, %u dropped",
+                         _scanTable.size(), _scanTable.dropped());
+             deliverScanBatch(true);
+         } else if (currentTime - _lastBatchTime >= TDECK_BLE_SCAN_BATCH_MS) {
+             deliverScanBatch(false);
+         }
      }
  }
  
@@ -194,15 +162,35 @@
      
      TDECK_LOG_I("Starting Bluetooth scan");
      
-     // Clear previous results
-     _scanResults.clear();
-     
      // Start BLE scan if enabled
-     if (_config.bleEnabled && _bleScan) {
-         _bleScan->setActiveScan(true);
-         _bleScan->start(durationSeconds, false); // Non-blocking scan
+     if (_config.bleEnabled && gapOwner == this) {
+         // Clear previous results
+         _scanTable.clear();
+         
+         // Scanning starts once the controller has taken the parameters
+         esp_ble_scan_params_t params = {};
+         params.scan_type = BLE_SCAN_TYPE_ACTIVE;
+         params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+         params.scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL;
+         params.scan_interval = TDECK_BLE_SCAN_INTERVAL;
+         params.scan_window = TDECK_BLE_SCAN_WINDOW;
+         params.scan_duplicate = _config.scanFilterDuplicates ? BLE_SCAN_DUPLICATE_ENABLE
+                                                              : BLE_SCAN_DUPLICATE_DISABLE;
+         
+         unsigned long now = millis();
+         _scanEndTime = now + durationSeconds * 1000UL;
+         _scanRestartTime = now;
+         _lastBatchTime = now;
+         _scanRestart = false;
+         _scanRunning = true;
+         if (esp_ble_gap_set_scan_params(&params) != ESP_OK) {
+             TDECK_LOG_E("Failed to set BLE scan parameters");
+             _scanRunning = false;
+             return false;
+         }
+         
          _scanInProgress = true;
-         _lastScanTime = millis();
+         _lastScanTime = now;
          return true;
      }
      
@@ -211,23 +199,35 @@
      return false;
  }
  
+ // End a scan early
+ void BluetoothManager::stopScan() {
+     if (!_scanInProgress) {
+         return;
+     }
+     
+     // No time left, so the stop is not taken for a duplicate filter reset
+     _scanEndTime = millis();
+     if (esp_ble_gap_stop_scanning() != ESP_OK) {
+         _scanRunning = false;
+     }
+ }
+ 
  // Get results of the last Bluetooth scan
  std::vector<BluetoothDevice> BluetoothManager::getScanResults() {
-     // Mark paired devices in scan results
-     for (auto& device : _scanResults) {
-         // Check if device is in paired list
-         for (const auto& pairedAddress : _config.pairedDevices) {
-             if (device.address == pairedAddress) {
-                 device.paired = true;
-                 break;
-             }
-         }
-         
-         // Check if device is currently connected
-         device.connected = (_isConnected && device.address == _connectedDeviceAddress);
-     }
+     std::vector<BLEScanEntry> entries;
+     _scanTable.snapshot(entries);
      
-     return _scanResults;
+     std::vector<BluetoothDevice> devices;
+     devices.reserve(entries.size());
+     for (const BLEScanEntry& entry : entries) {
+         devices.push_back(toDevice(entry));
+     }
+     return devices;
+ }
+ 
+ // Register for batches of scan results
+ void BluetoothManager::setScanCallback(BLEScanBatchCallback callback) {
+     _scanCallback = callback;
  }
  
  // Check if Bluetooth scan is in progress
@@ -303,8 +303,8 @@
      }
      
      // Try to find the device in scan results first
-     for (const auto& scannedDevice : _scanResults) {
-         if (scannedDevice.address == _connectedDeviceAddress) {
+     for (const auto& scannedDevice : getScanResults()) {
+         if (scannedDevice.address.equalsIgnoreCase(_connectedDeviceAddress)) {
              *device = scannedDevice;
              device->connected = true;
              return true;
@@ -402,6 +402,8 @@
      doc["lastConnectedDevice"] = _config.lastConnectedDevice;
      doc["classicEnabled"] = _config.classicEnabled;
      doc["bleEnabled"] = _config.bleEnabled;
+     doc["scanFilterDuplicates"] = _config.scanFilterDuplicates;
+     doc["dataChannel"] = _config.dataChannel;
      
      // Store paired devices as array
      JsonArray devices = doc.createNestedArray("pairedDevices");
@@ -410,7 +412,7 @@
      }
      
      // Save to file
-     return fsManager.saveJsonToFile(TDECK_FS_BT_CONFIG_FILE, doc);
+     return configStorage.write(TDECK_FS_BT_CONFIG_FILE, doc);
  }
  
  // Load Bluetooth configuration
@@ -421,7 +423,7 @@
      DynamicJsonDocument doc(2048); // Adjust size as needed
      
      // Check if config file exists and load it
-     if (!fsManager.loadJsonFromFile(TDECK_FS_BT_CONFIG_FILE, doc)) {
+     if (!configStorage.read(TDECK_FS_BT_CONFIG_FILE, doc)) {
          TDECK_LOG_W("Bluetooth config file not found or invalid JSON");
          return false;
      }
@@ -433,6 +435,8 @@
      _config.lastConnectedDevice = doc["lastConnectedDevice"] | "";
      _config.classicEnabled = doc["classicEnabled"] | true;
      _config.bleEnabled = doc["bleEnabled"] | true;
+     _config.scanFilterDuplicates = doc["scanFilterDuplicates"] | true;
+     _config.dataChannel = doc["dataChannel"] | false;
      
      // Clear and load paired devices
      _config.pairedDevices.clear();
@@ -445,8 +449,12 @@
      return true;
  }
  
- // Send data via Bluetooth Serial (Classic)
+ // Send data via Bluetooth Serial (Classic), or the BLE data channel when its peer is connected
  size_t BluetoothManager::sendSerialData(const String& data) {
+     if (_dataChannel.isConnected()) {
+         return _dataChannel.send((const uint8_t*)data.c_str(), data.length());
+     }
+     
      if (!_config.classicEnabled || !_serialBT || !_isConnected) {
          return 0;
      }
@@ -454,6 +462,36 @@
      return _serialBT->print(data);
  }
  
+ // Start the BLE data channel and advertise it
+ bool BluetoothManager::startDataChannel() {
+     if (!_config.bleEnabled || !_bleServer) {
+         TDECK_LOG_W("BLE not initialized, no data channel");
+         return false;
+     }
+     
+     return _dataChannel.begin(_bleServer);
+ }
+ 
+ // Queue data for the BLE data channel peer
+ size_t BluetoothManager::sendData(const uint8_t* data, size_t length, uint32_t timeoutMs) {
+     return _dataChannel.send(data, length, timeoutMs);
+ }
+ 
+ // Read data received on the BLE data channel
+ size_t BluetoothManager::readData(uint8_t* buffer, size_t maxLen) {
+     return _dataChannel.read(buffer, maxLen);
+ }
+ 
+ // Get the number of bytes waiting on the BLE data channel
+ size_t BluetoothManager::dataAvailable() {
+     return _dataChannel.available();
+ }
+ 
+ // Check if a peer is connected to the BLE data channel
+ bool BluetoothManager::isDataChannelConnected() {
+     return _dataChannel.isConnected();
+ }
+ 
  // Check if data is available to read from Bluetooth Serial
  int BluetoothManager::serialDataAvailable() {
      if (!_config.classicEnabled || !_serialBT) {
@@ -551,6 +589,8 @@
      _config.pairedDevices.clear();
      _config.classicEnabled = true;
      _config.bleEnabled = true;
+     _config.scanFilterDuplicates = true;
+     _config.dataChannel = false;
  }
  
  // Initialize Classic Bluetooth (Serial)
@@ -584,17 +624,13 @@
      // Initialize BLE device
      BLEDevice::init(_config.deviceName.c_str());
      
-     // Create scan object
-     _bleScan = BLEDevice::getScan();
-     
-     if (!_bleScan) {
-         TDECK_LOG_E("Failed to create BLE scan object");
+     // Scan results go to our table from the raw GAP events, the library
+     // scanner (BLEDevice::getScan()) is never created so it stays out of the way
+     if (!_scanTable.init()) {
          return false;
      }
-     
-     // Set up scan callbacks
-     _scanCallbacks = new BLEScanCallbacks(_scanResults);
-     _bleScan->setAdvertisedDeviceCallbacks(_scanCallbacks);
+     gapOwner = this;
+     BLEDevice::setCustomGapHandler(gapHandler);
      
      // Create server for advertising and connections
      _bleServer = BLEDevice::createServer();
@@ -612,8 +648,10 @@
          return false;
      }
      
-     // Set up server callbacks for connection events
-     // This would require implementing a server callbacks class
+     // Server connection callbacks belong to the data channel
+     if (_config.dataChannel) {
+         startDataChannel();
+     }
      
      // Set up client callbacks for connection events
      // This would require implementing a client callbacks class
@@ -632,4 +670,118 @@
      
      // Attempt to connect using the address
      return connect(_config.lastConnectedDevice, false);
+ }
+ 
+ // Build the device description of a scan table entry, names and services decoded here
+ BluetoothDevice BluetoothManager::toDevice(const BLEScanEntry& entry) {
+     BluetoothDevice device;
+     device.address = BLEScanTable::formatAddress(entry.address);
+     device.name = BLEScanTable::decodeName(entry);
+     if (device.name.isEmpty()) {
+         device.name = "Unknown";
+     }
+     device.rssi = (entry.rssi + 8) >> 4;
+     
+     // Check if device is in paired list
+     device.paired = false;
+     for (const auto& pairedAddress : _config.pairedDevices) {
+         if (device.address.equalsIgnoreCase(pairedAddress)) {
+             device.paired = true;
+             break;
+         }
+     }
+     
+     // Check if device is currently connected
+     device.connected = _isConnected && device.address.equalsIgnoreCase(_connectedDeviceAddress);
+     
+     // Add services if advertised, with known descriptions (could be expanded)
+     std::vector<String> uuids;
+     BLEScanTable::decodeServices(entry, uuids);
+     for (const String& uuid : uuids) {
+         const char* description = "Unknown Service";
+         if (uuid == "1800") description = "Generic Access";
+         if (uuid == "1801") description = "Generic Attribute";
+         if (uuid == "180F") description = "Battery Service";
+         if (uuid == "180A") description = "Device Information";
+         if (uuid == "1812") description = "HID";
+         device.services[uuid] = description;
+     }
+     
+     return device;
+ }
+ 
+ // Deliver the scan results changed since the last batch
+ void BluetoothManager::deliverScanBatch(bool complete) {
+     _lastBatchTime = millis();
+     if (!_scanCallback) {
+         return;
+     }
+     
+     std::vector<BLEScanEntry> entries;
+     _scanTable.takeChanged(entries);
+     if (entries.empty() && !complete) {
+         return;
+     }
+     
+     std::vector<BluetoothDevice> devices;
+     devices.reserve(entries.size());
+     for (const BLEScanEntry& entry : entries) {
+         devices.push_back(toDevice(entry));
+     }
+     _scanCallback(devices, complete);
+ }
+ 
+ // GAP event handler, runs on the BT task
+ void BluetoothManager::gapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+     BluetoothManager* manager = gapOwner;
+     if (!manager) {
+         return;
+     }
+     
+     switch (event) {
+         case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: {
+             if (param->scan_param_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                 manager->_scanRunning = false;
+                 break;
+             }
+             uint32_t seconds = max(1L, ((long)(manager->_scanEndTime - millis()) + 999) / 1000);
+             if (esp_ble_gap_start_scanning(seconds) != ESP_OK) {
+                 manager->_scanRunning = false;
+             }
+             break;
+         }
+         
+         case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+             if (param->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                 manager->_scanRunning = false;
+                 manager->_scanRestart = false;
+             }
+             break;
+             
+         case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT: {
+             // Stopped by update() to reset the duplicate filter, carry on for the time left
+             long remaining = (long)(manager->_scanEndTime - millis());
+             bool restart = manager->_scanRestart && remaining > 0;
+             manager->_scanRestart = false;
+             if (!restart || esp_ble_gap_start_scanning((remaining + 999) / 1000) != ESP_OK) {
+                 manager->_scanRunning = false;
+             }
+             break;
+         }
+         
+         case ESP_GAP_BLE_SCAN_RESULT_EVT: {
+             const auto& result = param->scan_rst;
+             if (result.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+                 manager->_scanTable.report(result.bda, result.ble_addr_type, result.rssi,
+                                            result.ble_adv, result.adv_data_len,
+                                            result.ble_adv + result.adv_data_len, result.scan_rsp_len);
+             } else if (result.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+                 manager->_scanRunning = false;
+             }
+             break;
+         }
+         
+         default:
+             break;
+     }
  }
\ No newline at end of file
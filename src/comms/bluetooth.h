@@ -16,12 +16,15 @@
  #include <BLEServer.h>
  #include <BLEClient.h>
  #include <BLEScan.h>
- #include <BLEAdvertisedDevice.h>
+ #include <esp_gap_ble_api.h>
  #include <vector>
  #include <map>
+ #include <functional>
  #include <ArduinoJson.h>
  #include "../config.h"
  #include "../system/fs_manager.h"
+ #include "ble_scan_table.h"
+ #include "ble_data.h"
  
  // External declaration of file system manager
  extern FSManager fsManager;
@@ -54,17 +57,12 @@
      std::vector<String> pairedDevices; // List of paired device addresses
      bool classicEnabled;           // Enable Classic Bluetooth (Serial)
      bool bleEnabled;               // Enable Bluetooth Low Energy
+     bool scanFilterDuplicates;     // Let the controller drop repeated advertisements during a scan
+     bool dataChannel;              // Offer the BLE data channel when BLE starts
  };
  
- // Callback class for BLE scan results
- class BLEScanCallbacks : public BLEAdvertisedDeviceCallbacks {
- public:
-     BLEScanCallbacks(std::vector<BluetoothDevice>& scanResults);
-     void onResult(BLEAdvertisedDevice advertisedDevice) override;
-     
- private:
-     std::vector<BluetoothDevice>& _scanResults;
- };
+ // Scan results changed since the previous batch, complete is set on the last batch of a scan
+ using BLEScanBatchCallback = std::function<void(const std::vector<BluetoothDevice>& devices, bool complete)>;
  
  /**
   * @brief Manages Bluetooth connectivity and configuration
@@ -103,6 +101,14 @@
       */
      bool startScan(int durationSeconds = 5);
  
+     /**
+      * @brief End a scan early
+      * 
+      * The last batch, with complete set, follows from update() once the
+      * controller has stopped.
+      */
+     void stopScan();
+ 
      /**
       * @brief Get results of the last Bluetooth scan
       * 
@@ -110,6 +116,16 @@
       */
      std::vector<BluetoothDevice> getScanResults();
  
+     /**
+      * @brief Register for batches of scan results
+      * 
+      * Batches are delivered from update(), at most every TDECK_BLE_SCAN_BATCH_MS,
+      * each holding only the devices that appeared or changed since the last one.
+      * 
+      * @param callback Callback, nullptr to stop batches
+      */
+     void setScanCallback(BLEScanBatchCallback callback);
+ 
      /**
       * @brief Check if Bluetooth scan is in progress
       * 
@@ -208,6 +224,42 @@
       */
      size_t sendSerialData(const String& data);
  
+     /**
+      * @brief Start the BLE data channel and advertise it
+      * 
+      * @return true if the channel is running
+      */
+     bool startDataChannel();
+ 
+     /**
+      * @brief Queue data for the BLE data channel peer
+      * 
+      * @param data Data to send
+      * @param length Number of bytes
+      * @param timeoutMs How long to wait for room in the TX ring
+      * @return size_t Number of bytes queued
+      */
+     size_t sendData(const uint8_t* data, size_t length, uint32_t timeoutMs = 0);
+ 
+     /**
+      * @brief Read data received on the BLE data channel
+      * 
+      * @param buffer Buffer to store data
+      * @param maxLen Maximum length to read
+      * @return size_t Number of bytes read
+      */
+     size_t readData(uint8_t* buffer, size_t maxLen);
+ 
+     /**
+      * @brief Get the number of bytes waiting on the BLE data channel
+      */
+     size_t dataAvailable();
+ 
+     /**
+      * @brief Check if a peer is connected to the BLE data channel
+      */
+     bool isDataChannelConnected();
+ 
      /**
       * @brief Check if data is available to read from Bluetooth Serial
       * 
@@ -265,8 +317,14 @@
  
  private:
      BluetoothConfig _config;                   // Bluetooth configuration
-     std::vector<BluetoothDevice> _scanResults; // Results of the last scan
+     BLEScanTable _scanTable;                   // Results of the last scan, filled from the GAP handler
+     BLEScanBatchCallback _scanCallback;        // Scan batch consumer
      bool _scanInProgress;                      // Whether a scan is currently in progress
+     volatile bool _scanRunning;                // Controller is scanning, cleared from the GAP handler
+     volatile bool _scanRestart;                // Scan stopped to reset the duplicate filter, restart it
+     unsigned long _scanEndTime;                // When the current scan ends
+     unsigned long _scanRestartTime;            // When the duplicate filter was last reset
+     unsigned long _lastBatchTime;              // When the last scan batch was delivered
      unsigned long _lastScanTime;               // Timestamp of the last scan
      unsigned long _lastStatusCheck;            // Timestamp of the last status check
      bool _isConnected;                         // Current connection status
@@ -276,10 +334,9 @@
      
      // Bluetooth components
      BluetoothSerial* _serialBT;                // Serial Bluetooth instance
-     BLEScan* _bleScan;                         // BLE scanner
      BLEServer* _bleServer;                     // BLE server
      BLEClient* _bleClient;                     // BLE client
-     BLEScanCallbacks* _scanCallbacks;          // BLE scan callbacks
+     BLEDataChannel _dataChannel;               // High-throughput GATT data service
      
      /**
       * @brief Create default configuration
@@ -300,6 +357,26 @@
       * @brief Automatically connect to last paired device
       */
      bool autoConnectToLastDevice();
+     
+     /**
+      * @brief Build the device description of a scan table entry
+      */
+     BluetoothDevice toDevice(const BLEScanEntry& entry);
+     
+     /**
+      * @brief Deliver the scan results changed since the last batch
+      * 
+      * @param complete Whether this is the last batch of the scan
+      */
+     void deliverScanBatch(bool complete);
+     
+     /**
+      * @brief GAP event handler, runs on the BT task
+      * 
+      * The BLE library's scanner is never created, so advertisements go
+      * straight into the scan table without building BLEAdvertisedDevice objects.
+      */
+     static void gapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
  };
  
  #endif // TDECK_BLUETOOTH_H
\ No newline at end of file
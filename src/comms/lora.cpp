@@ -5,11 +5,24 @@
 
  #include "lora.h"
  #include "../system/fs_manager.h"
+ #include "../system/config_storage.h"
+ #include "../hal/sx127x.h"
+ #include "../hal/spi_bus.h"
+ #include "../hal/power.h"
+ #include "../system/heap_tracker.h"
+ #include "../system/trace.h"
+ #include "lora_wire.h"
  #include <LoRa.h>
+ #include <SPI.h>
  
  // Global instance
  LoRaManager loraManager;
  
+ // Signed deadline check that survives millis() wrap-around
+ static inline bool isDue(uint32_t deadline, uint32_t now) {
+     return (int32_t)(deadline - now) <= 0;
+ }
+ 
  // Default device ID (last 2 bytes of ESP32 MAC address)
  static uint16_t getDefaultDeviceId() {
      uint8_t mac[6];
@@ -31,12 +44,32 @@
      , _lastRssi(0)
      , _lastSnr(0)
      , _messageCallback(nullptr)
+     , _monitorCallback(nullptr)
+     , _commsTask(NULL)
+     , _rxQueue(NULL)
+     , _txQueue(NULL)
+     , _radioMutex(NULL)
+     , _droppedPackets(0)
+     , _peerLock(portMUX_INITIALIZER_UNLOCKED)
+     , _rxDutyCycleMs(TDECK_LORA_RX_DUTY_CYCLE_MS)
+     , _radioAsleep(false)
+     , _listenUntil(0)
+     , _nextCad(0)
+     , _lbtDeferrals(0)
+     , _radioRate(LORA_ADR_HOME)
+     , _sessionPeer(0)
+     , _sessionRate(LORA_ADR_HOME)
+     , _sessionUntil(0)
+     , _relayEnabled(TDECK_LORA_MESH_RELAY)
+     , _preambleLength(8)
  {
+     memset(_peers, 0, sizeof(_peers));
  }
  
  // Destructor
  LoRaManager::~LoRaManager() {
      if (_initialized) {
+         SPIBusLock bus(SPI_BUS_LORA);
          LoRa.end();
          _initialized = false;
      }
@@ -51,8 +84,13 @@
      
      // Initialize the LoRa module with current settings
      LoRa.setPins(TDECK_LORA_CS, TDECK_LORA_RST, TDECK_LORA_DIO);
+     LoRa.setSPI(spiBus.spi());
+     LoRa.setSPIFrequency(TDECK_SPI_LORA_FREQUENCY);
      
+     // Reset and configuration run as one burst on the shared bus
+     spiBus.acquire(SPI_BUS_LORA);
      if (!LoRa.begin(_frequency)) {
+         spiBus.release(SPI_BUS_LORA);
          TDECK_LOG_E("LoRa initialization failed");
          return false;
      }
@@ -65,26 +103,505 @@
      
      // Enable CRC checking
      LoRa.enableCrc();
+     _adr.setHome(_spreadingFactor, _bandwidth);
+     applyPreamble();
+     spiBus.release(SPI_BUS_LORA);
+     
+     _radioMutex = xSemaphoreCreateMutex();
+     _rxQueue = xQueueCreate(TDECK_LORA_RX_QUEUE_SIZE, sizeof(LoRaPacket*));
+     _txQueue = xQueueCreate(TDECK_LORA_TX_QUEUE_SIZE, sizeof(LoRaPacket*));
+     if (!_radioMutex || !_rxQueue || !_txQueue) {
+         TDECK_LOG_E("Failed to allocate LoRa packet queues");
+         return false;
+     }
+     
+     if (!_reliable.init() || !_fragmenter.init()) {
+         TDECK_LOG_E("Failed to initialize LoRa reliable delivery");
+         return false;
+     }
      
      _initialized = true;
      _enabled = true;
      
-     TDECK_LOG_I("LoRa initialized at %ld Hz, DeviceID: 0x%04X", _frequency, _deviceId);
+     // Start the comms task before the interrupt so the ISR always has a task to wake
+     if (xTaskCreatePinnedToCore(commsTask, "LoRa_Comms", TDECK_COMMS_TASK_STACK_SIZE, this,
+                                 TDECK_COMMS_TASK_PRIORITY, &_commsTask, 0) != pdPASS) {
+         TDECK_LOG_E("Failed to create LoRa comms task, falling back to polling");
+         _commsTask = NULL;
+     }
+     
+     // DIO0 rises on RxDone while receiving (and on TxDone while sending). As a
+     // wake source the line is level triggered, dioISR() disarms it and the comms
+     // task rearms it once the IRQ flags are cleared. On a pin shared with another
+     // peripheral the comms task polls the radio instead
+     if (TDECK_LORA_DIO_IRQ) {
+         pinMode(TDECK_LORA_DIO, INPUT);
+         attachInterruptArg(TDECK_LORA_DIO, dioISR, this, RISING);
+         Power::addWakeSource((gpio_num_t)TDECK_LORA_DIO, HIGH);
+     } else {
+         TDECK_LOG_W("LoRa DIO pin %d is shared with another peripheral, polling the radio", TDECK_LORA_DIO);
+     }
+     startReceive();
+     
+     TDECK_LOG_I("LoRa initialized at %ld Hz, DeviceID: 0x%04X (%s)", _frequency, _deviceId,
+                 _commsTask && TDECK_LORA_DIO_IRQ ? "IRQ" : "polling");
      
      return true;
  }
  
  // Update routine to check for received messages
- void LoRaManager::update() {
+ uint32_t LoRaManager::update() {
      if (!_initialized || !_enabled) {
-         return;
+         return UINT32_MAX;
+     }
+     
+     // The comms task owns reception in IRQ mode
+     if (_commsTask) {
+         return UINT32_MAX;
+     }
+     
+     drainRadio();
+     while (dispatchQueued()) {
      }
      
-     // Check if a packet is available
+     // Without the DIO interrupt only polling notices a packet
+     uint32_t next = min((uint32_t)TDECK_LORA_POLL_MS, _reliable.service());
+     next = min(next, _fragmenter.service());
+     next = min(next, _mesh.service());
+     next = min(next, _bench.service());
+     next = min(next, serviceRateSession());
+     next = min(next, serviceDutyCycle());
+     return next;
+ }
+ 
+ // Queue a packet for acknowledged delivery
+ uint32_t LoRaManager::sendReliable(LoRaPacketRef packet, LoRaDeliveryCallback callback, void* context) {
+     if (!_initialized || !_enabled) {
+         return 0;
+     }
+     
+     return _reliable.send(packet, callback, context);
+ }
+ 
+ // Send a payload as a fragmented transfer
+ uint16_t LoRaManager::sendBuffer(uint8_t messageType, const uint8_t* data, size_t length, uint16_t destId,
+                                  LoRaTransferCallback callback, void* context) {
+     if (!_initialized || !_enabled) {
+         return 0;
+     }
+     
+     return _fragmenter.sendBuffer(messageType, destId, data, length, callback, context);
+ }
+ 
+ // Send a file as a fragmented transfer
+ uint16_t LoRaManager::sendFile(uint8_t messageType, const char* path, uint16_t destId,
+                                LoRaTransferCallback callback, void* context) {
+     if (!_initialized || !_enabled) {
+         return 0;
+     }
+     
+     return _fragmenter.sendFile(messageType, destId, path, callback, context);
+ }
+ 
+ // Queue a packet for the comms task, or transmit it directly when polling
+ bool LoRaManager::sendPacket(LoRaPacketRef packet) {
+     if (!_initialized || !_enabled || !packet) {
+         return false;
+     }
+     
+     if (!_commsTask) {
+         return transmit(*packet);
+     }
+     
+     LoRaPacket* queued = packet.release();
+     if (xQueueSend(_txQueue, &queued, 0) != pdTRUE) {
+         LoRaPacketRef::adopt(queued);
+         TDECK_TRACE_W(LORA, "LoRa transmit queue full");
+         return false;
+     }
+     
+     xTaskNotifyGive(_commsTask);
+     return true;
+ }
+ 
+ // Comms task - sleeps until the DIO interrupt signals a packet
+ void LoRaManager::commsTask(void* arg) {
+     LoRaManager* lora = static_cast<LoRaManager*>(arg);
+     heapTracker.setTaskTag(HEAP_TAG_LORA);
+     
+     while (1) {
+         // Sleep until the next ACK, retransmission, fragment or CAD is due. Otherwise the
+         // timeout only covers a missed edge, packets normally arrive by IRQ
+         uint32_t timeout = min((uint32_t)TDECK_LORA_RX_POLL_MS, lora->_reliable.service());
+         timeout = min(timeout, lora->_fragmenter.service());
+         timeout = min(timeout, lora->serviceRateSession());
+         timeout = min(timeout, lora->_mesh.service());
+         timeout = min(timeout, lora->_bench.service());
+         timeout = min(timeout, lora->serviceDutyCycle());
+         if (!TDECK_LORA_DIO_IRQ) {
+             timeout = min(timeout, (uint32_t)TDECK_LORA_POLL_MS);
+         }
+         ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+         
+         if (!lora->_enabled) {
+             continue;
+         }
+         
+         lora->drainRadio();
+         
+         // Dispatch received and send queued packets, but empty the radio FIFO
+         // first whenever another packet arrives so none is overwritten
+         bool busy = true;
+         while (busy) {
+             busy = lora->dispatchQueued();
+             
+             LoRaPacket* queued;
+             if (xQueueReceive(lora->_txQueue, &queued, 0) == pdTRUE) {
+                 lora->transmit(*LoRaPacketRef::adopt(queued));
+                 busy = true;
+             }
+             
+             if (ulTaskNotifyTake(pdTRUE, 0) > 0) {
+                 lora->drainRadio();
+             }
+         }
+     }
+ }
+ 
+ // DIO interrupt - the radio is only touched from task context
+ void IRAM_ATTR LoRaManager::dioISR(void* arg) {
+     LoRaManager* lora = static_cast<LoRaManager*>(arg);
+     
+     // Level triggered, stays quiet until the comms task has drained the radio
+     Power::disarmWakeFromISR((gpio_num_t)TDECK_LORA_DIO);
+     
+     BaseType_t woken = pdFALSE;
+     if (lora->_commsTask) {
+         vTaskNotifyGiveFromISR(lora->_commsTask, &woken);
+     }
+     portYIELD_FROM_ISR(woken);
+ }
+ 
+ // Read a pending packet from the radio FIFO straight into a pool slot
+ bool LoRaManager::drainRadio() {
+     bool received = false;
+     
+     xSemaphoreTake(_radioMutex, portMAX_DELAY);
+     
+     // parsePacket would wake a sleeping radio into receive mode
+     if (_radioAsleep) {
+         xSemaphoreGive(_radioMutex);
+         return false;
+     }
+     
+     // Status, RSSI and FIFO reads share one burst on the bus
+     SPIBusLock bus(SPI_BUS_LORA);
      int packetSize = LoRa.parsePacket();
      if (packetSize > 0) {
-         handleReceivedPacket();
+         LoRaPacketRef packet = loraPacketPool.allocate();
+         
+         if (!packet) {
+             _droppedPackets++;
+             TDECK_TRACE_W(LORA, "LoRa packet pool exhausted, packet dropped");
+         } else if (packetSize < LORA_HEADER_SIZE) {
+             TDECK_TRACE_W(LORA, "Received malformed LoRa packet (too small)");
+         } else {
+             packet->rssi = LoRa.packetRssi();
+             packet->snr = LoRa.packetSnr();
+             
+             int spreadingFactor;
+             long bandwidth;
+             _adr.settings(_radioRate, spreadingFactor, bandwidth);
+             loraStats.noteReceive(LoRaStats::timeOnAir(packetSize, spreadingFactor, bandwidth,
+                                                        _codingRate, _preambleLength));
+             
+             // One burst read of header, payload and trailer, parsePacket has
+             // pointed the FIFO at the start of the packet
+             uint8_t frame[LORA_MAX_FRAME_SIZE];
+             int frameSize = min(packetSize, LORA_MAX_FRAME_SIZE);
+             
+             SPI.beginTransaction(spiBus.settings(SPI_BUS_LORA));
+             digitalWrite(TDECK_LORA_CS, LOW);
+             SPI.transfer(SX127X_REG_FIFO);
+             SPI.transferBytes(NULL, frame, frameSize);
+             digitalWrite(TDECK_LORA_CS, HIGH);
+             SPI.endTransaction();
+             
+             LoRaWireStatus status = LoRaWire::decode(frame, frameSize, *packet);
+             
+             // Only a packet heard straight from its source says anything about the link
+             if (packet->hopCount == 0) {
+                 _adr.noteReception(packet->sourceId, packet->rssi, packet->snr, _radioRate);
+                 if (packet->destId == _deviceId) {
+                     followRateOffer(packet->sourceId, packet->rate);
+                 }
+             }
+             
+             if (status == LORA_WIRE_TRUNCATED) {
+                 TDECK_TRACE_W(LORA, "Received truncated LoRa packet: %d of %d bytes", packet->length, frame[7]);
+             } else {
+                 // The queue takes over the reference
+                 LoRaPacket* queued = packet.release();
+                 if (xQueueSend(_rxQueue, &queued, 0) == pdTRUE) {
+                     received = true;
+                 } else {
+                     LoRaPacketRef::adopt(queued);
+                     _droppedPackets++;
+                     TDECK_TRACE_W(LORA, "LoRa receive queue full, packet dropped");
+                 }
+             }
+         }
+     }
+     
+     // parsePacket leaves the radio in standby after a packet and may leave it
+     // in single receive mode after a TxDone or spurious wake, listen again either way
+     startReceive();
+     
+     // DIO0 holds until parsePacket clears the IRQ flags, only now can it fire again
+     if (TDECK_LORA_DIO_IRQ) {
+         Power::rearmWake((gpio_num_t)TDECK_LORA_DIO, HIGH);
+     }
+     
+     xSemaphoreGive(_radioMutex);
+     
+     return received;
+ }
+ 
+ // Dispatch one queued packet
+ bool LoRaManager::dispatchQueued() {
+     LoRaPacket* queued;
+     if (xQueueReceive(_rxQueue, &queued, 0) != pdTRUE) {
+         return false;
+     }
+     
+     handleReceivedPacket(LoRaPacketRef::adopt(queued));
+     return true;
+ }
+ 
+ // Put the radio back into continuous receive mode, caller holds _radioMutex
+ void LoRaManager::startReceive() {
+     SPIBusLock bus(SPI_BUS_LORA);
+     LoRa.receive();
+     _radioAsleep = false;
+     _listenUntil = millis() + _rxDutyCycleMs + TDECK_LORA_RX_LISTEN_MS;
+ }
+ 
+ // Switch the radio to a rate from the ADR table, caller holds _radioMutex
+ void LoRaManager::tuneRadio(uint8_t rate) {
+     int spreadingFactor;
+     long bandwidth;
+     if (rate == _radioRate || !_adr.settings(rate, spreadingFactor, bandwidth)) {
+         return;
+     }
+     
+     SPIBusLock bus(SPI_BUS_LORA);
+     LoRa.idle();
+     LoRa.setSpreadingFactor(spreadingFactor);
+     LoRa.setSignalBandwidth(bandwidth);
+     _radioRate = rate;
+     applyPreamble();
+ }
+ 
+ // Join or leave a rate session on a received offer, caller holds _radioMutex
+ void LoRaManager::followRateOffer(uint16_t sourceId, uint8_t rate) {
+     int spreadingFactor;
+     long bandwidth;
+     
+     if (rate != LORA_ADR_HOME && _adr.settings(rate, spreadingFactor, bandwidth)) {
+         // Answer and keep listening on the offered rate
+         _sessionPeer = sourceId;
+         _sessionRate = rate;
+         _sessionUntil = millis() + TDECK_LORA_ADR_HOLD_MS;
+     } else if (_sessionRate != LORA_ADR_HOME && sourceId == _sessionPeer) {
+         // The sender fell back to the home setting
+         _sessionRate = LORA_ADR_HOME;
+     } else {
+         return;
+     }
+     
+     tuneRadio(_sessionRate);
+     startReceive();
+ }
+ 
+ // End an expired rate session
+ uint32_t LoRaManager::serviceRateSession() {
+     if (!_initialized || _sessionRate == LORA_ADR_HOME) {
+         return UINT32_MAX;
+     }
+     
+     uint32_t now = millis();
+     uint32_t remaining = 0;
+     
+     xSemaphoreTake(_radioMutex, portMAX_DELAY);
+     if (_sessionRate != LORA_ADR_HOME) {
+         if (isDue(_sessionUntil, now)) {
+             _sessionRate = LORA_ADR_HOME;
+             tuneRadio(LORA_ADR_HOME);
+             startReceive();
+         } else {
+             remaining = _sessionUntil - now;
+         }
+     }
+     xSemaphoreGive(_radioMutex);
+     
+     return remaining > 0 ? remaining : UINT32_MAX;
+ }
+ 
+ // Put the radio to sleep until the next CAD, caller holds _radioMutex
+ void LoRaManager::sleepRadio() {
+     SPIBusLock bus(SPI_BUS_LORA);
+     LoRa.sleep();
+     _radioAsleep = true;
+     _nextCad = millis() + _rxDutyCycleMs;
+ }
+ 
+ // Check whether a packet is on the air, caller holds _radioMutex
+ bool LoRaManager::channelBusy() {
+     // A reception in progress would be cut off by CAD
+     if (!_radioAsleep && (sx127xReadRegister(SPI, SX127X_REG_MODEM_STAT) & SX127X_MODEM_SIGNAL_DETECTED)) {
+         return true;
+     }
+     
+     // CAD only sees preambles at the rate the radio is tuned to
+     int spreadingFactor;
+     long bandwidth;
+     _adr.settings(_radioRate, spreadingFactor, bandwidth);
+     return sx127xChannelActivity(SPI, spreadingFactor, bandwidth) == SX127xCad::DETECTED;
+ }
+ 
+ // Duty-cycled receive - sleep, wake for CAD, listen only when there is activity
+ uint32_t LoRaManager::serviceDutyCycle() {
+     if (!_initialized || !_enabled || _rxDutyCycleMs == 0) {
+         return UINT32_MAX;
+     }
+     
+     uint32_t now = millis();
+     xSemaphoreTake(_radioMutex, portMAX_DELAY);
+     
+     if (_radioAsleep) {
+         if (isDue(_nextCad, now)) {
+             if (sx127xChannelActivity(SPI, _spreadingFactor, _bandwidth) == SX127xCad::DETECTED) {
+                 // The sender's long preamble keeps going until we are listening
+                 startReceive();
+             } else {
+                 sleepRadio();
+             }
+         }
+     } else if (isDue(_listenUntil, now) && _sessionRate == LORA_ADR_HOME) {
+         uint8_t flags = sx127xReadRegister(SPI, SX127X_REG_IRQ_FLAGS);
+         uint8_t status = sx127xReadRegister(SPI, SX127X_REG_MODEM_STAT);
+         if ((flags & SX127X_IRQ_RX_DONE) || (status & SX127X_MODEM_SIGNAL_DETECTED)) {
+             // Mid-packet or not yet drained, keep listening
+             _listenUntil = now + TDECK_LORA_RX_LISTEN_MS;
+         } else {
+             sleepRadio();
+         }
+     }
+     
+     uint32_t deadline = _radioAsleep ? _nextCad : _listenUntil;
+     xSemaphoreGive(_radioMutex);
+     
+     now = millis();
+     return isDue(deadline, now) ? 0 : deadline - now;
+ }
+ 
+ // Make every preamble long enough to reach a duty-cycled receiver's CAD
+ void LoRaManager::applyPreamble() {
+     long symbols = 8;
+     if (_rxDutyCycleMs > 0 && _radioRate == LORA_ADR_HOME) {
+         uint32_t symbolMicros = sx127xSymbolMicros(_spreadingFactor, _bandwidth);
+         symbols += ((uint64_t)_rxDutyCycleMs * 1000 + symbolMicros - 1) / symbolMicros;
+     }
+     _preambleLength = min(symbols, 65535L);
+     
+     SPIBusLock bus(SPI_BUS_LORA);
+     LoRa.setPreambleLength(_preambleLength);
+ }
+ 
+ // Set the duty-cycled receive interval
+ void LoRaManager::setRxDutyCycle(uint16_t intervalMs) {
+     _rxDutyCycleMs = intervalMs;
+     
+     if (_initialized) {
+         xSemaphoreTake(_radioMutex, portMAX_DELAY);
+         applyPreamble();
+         startReceive();
+         xSemaphoreGive(_radioMutex);
+         
+         if (_commsTask) {
+             xTaskNotifyGive(_commsTask);
+         }
+     }
+     
+     saveConfig();
+ }
+ 
+ // Get the duty-cycled receive interval
+ uint16_t LoRaManager::getRxDutyCycle() const {
+     return _rxDutyCycleMs;
+ }
+ 
+ // Get the rate adaptive data rate would offer a peer
+ uint8_t LoRaManager::getPeerRate(uint16_t peerId) const {
+     return _adr.rateFor(peerId);
+ }
+ 
+ // Get the smoothed link quality of a peer
+ bool LoRaManager::getPeerLink(uint16_t peerId, LoRaLink& link) const {
+     return _adr.getLink(peerId, link);
+ }
+ 
+ // Enable or disable relay mode
+ void LoRaManager::setRelayEnabled(bool enable) {
+     _relayEnabled = enable;
+     saveConfig();
+ }
+ 
+ // Check if relay mode is enabled
+ bool LoRaManager::isRelayEnabled() const {
+     return _relayEnabled;
+ }
+ 
+ // Get the number of packets relayed for other nodes
+ uint32_t LoRaManager::getRelayedPackets() const {
+     return _mesh.getRelayedCount();
+ }
+ 
+ // Time-on-air at the home setting
+ uint32_t LoRaManager::getTimeOnAir(size_t payloadLength) const {
+     return LoRaStats::timeOnAir(LORA_HEADER_SIZE + payloadLength + LORA_CAPS_TRAILER_SIZE,
+                                 _spreadingFactor, _bandwidth, _codingRate, _preambleLength);
+ }
+ 
+ // Start a benchmark and wake the comms task to send the first packet
+ bool LoRaManager::startBenchmark(LoRaBenchMode mode, uint16_t peerId, uint16_t count, uint8_t size) {
+     if (!_initialized || !_enabled || peerId == _deviceId) {
+         return false;
+     }
+     
+     if (!_bench.start(mode, peerId, count, size)) {
+         return false;
+     }
+     
+     if (_commsTask) {
+         xTaskNotifyGive(_commsTask);
      }
+     return true;
+ }
+ 
+ // Stop the benchmark in progress
+ void LoRaManager::stopBenchmark() {
+     _bench.stop();
+ }
+ 
+ // Get the progress or result of the last benchmark
+ void LoRaManager::getBenchmark(LoRaBenchResult& result) const {
+     _bench.getResult(result);
+ }
+ 
+ // Get the number of transmits deferred because the channel was busy
+ uint32_t LoRaManager::getLbtDeferrals() const {
+     return _lbtDeferrals;
  }
  
  // Send a text message via LoRa
@@ -93,19 +610,20 @@
          return false;
      }
      
-     // Convert String to byte array
-     uint8_t payload[LORA_MAX_PACKET_SIZE];
      size_t length = message.length();
+     if (length > LORA_MAX_PAYLOAD_LENGTH) {
+         return sendBuffer(LORA_MSG_TEXT, (const uint8_t*)message.c_str(), length, destId) != 0;
+     }
      
-     if (length > LORA_MAX_PACKET_SIZE) {
-         TDECK_LOG_W("Message too long, truncating");
-         length = LORA_MAX_PACKET_SIZE;
+     LoRaPacketRef packet = createPacket(LORA_MSG_TEXT, destId);
+     if (!packet) {
+         return false;
      }
      
-     memcpy(payload, message.c_str(), length);
+     memcpy(packet->payload, message.c_str(), length);
+     packet->length = length;
+     compressText(*packet);
      
-     // Create and send packet
-     LoRaPacket packet = createPacket(LORA_MSG_TEXT, destId, payload, length);
      return sendPacket(packet);
  }
  
@@ -115,18 +633,31 @@
          return false;
      }
      
-     // Create a JSON document for the location data
-     StaticJsonDocument<128> doc;
-     doc["lat"] = latitude;
-     doc["lon"] = longitude;
-     doc["alt"] = altitude;
+     LoRaPacketRef packet = createPacket(LORA_MSG_LOCATION, destId);
+     if (!packet) {
+         return false;
+     }
      
-     // Serialize to byte array
-     uint8_t payload[LORA_MAX_PACKET_SIZE];
-     size_t length = serializeJson(doc, (char*)payload, LORA_MAX_PACKET_SIZE);
+     size_t length;
+     if (peerSupportsBinary(destId)) {
+         // Fixed-point binary beacon, about 12 bytes instead of 50
+         LoRaLocation location;
+         location.latitude = lroundf(latitude * 1e7f);
+         location.longitude = lroundf(longitude * 1e7f);
+         location.altitude = lroundf(altitude * 10.0f);
+         length = LoRaCodec::encodeLocation(location, packet->payload, LORA_MAX_PAYLOAD_LENGTH);
+     } else {
+         // Create a JSON document for the location data
+         StaticJsonDocument<128> doc;
+         doc["lat"] = latitude;
+         doc["lon"] = longitude;
+         doc["alt"] = altitude;
+         
+         // Serialize straight into the packet
+         length = serializeJson(doc, (char*)packet->payload, LORA_MAX_PAYLOAD_LENGTH);
+     }
+     packet->length = length;
      
-     // Create and send packet
-     LoRaPacket packet = createPacket(LORA_MSG_LOCATION, destId, payload, length);
      return sendPacket(packet);
  }
  
@@ -136,17 +667,27 @@
          return false;
      }
      
-     // Serialize to byte array
-     uint8_t payload[LORA_MAX_PACKET_SIZE];
-     size_t length = serializeJson(status, (char*)payload, LORA_MAX_PACKET_SIZE);
+     LoRaPacketRef packet = createPacket(LORA_MSG_STATUS, destId);
+     if (!packet) {
+         return false;
+     }
      
-     if (length > LORA_MAX_PACKET_SIZE) {
-         TDECK_LOG_W("Status data too large, truncating");
-         length = LORA_MAX_PACKET_SIZE;
+     // Encode as TLV when the peer understands it, JSON otherwise
+     size_t length = 0;
+     if (peerSupportsBinary(destId)) {
+         length = LoRaCodec::encodeObject(status.as<JsonObjectConst>(), packet->payload, LORA_MAX_PAYLOAD_LENGTH);
      }
      
-     // Create and send packet
-     LoRaPacket packet = createPacket(LORA_MSG_STATUS, destId, payload, length);
+     if (length == 0) {
+         if (measureJson(status) > LORA_MAX_PAYLOAD_LENGTH) {
+             String json;
+             serializeJson(status, json);
+             return sendBuffer(LORA_MSG_STATUS, (const uint8_t*)json.c_str(), json.length(), destId) != 0;
+         }
+         length = serializeJson(status, (char*)packet->payload, LORA_MAX_PAYLOAD_LENGTH);
+     }
+     packet->length = length;
+     
      return sendPacket(packet);
  }
  
@@ -156,65 +697,180 @@
          return false;
      }
      
-     // Create a combined JSON document
-     StaticJsonDocument<256> doc;
-     doc["cmd"] = command;
-     doc["params"] = params;
+     LoRaPacketRef packet = createPacket(LORA_MSG_COMMAND, destId);
+     if (!packet) {
+         return false;
+     }
      
-     // Serialize to byte array
-     uint8_t payload[LORA_MAX_PACKET_SIZE];
-     size_t length = serializeJson(doc, (char*)payload, LORA_MAX_PACKET_SIZE);
+     // Encode as TLV when the peer understands it, JSON otherwise
+     size_t length = 0;
+     if (peerSupportsBinary(destId)) {
+         length = LoRaCodec::encodeObject(params.as<JsonObjectConst>(), packet->payload,
+                                          LORA_MAX_PAYLOAD_LENGTH, command.c_str());
+     }
      
-     if (length > LORA_MAX_PACKET_SIZE) {
-         TDECK_LOG_W("Command data too large, truncating");
-         length = LORA_MAX_PACKET_SIZE;
+     if (length == 0) {
+         // Create a combined JSON document
+         StaticJsonDocument<256> doc;
+         doc["cmd"] = command;
+         doc["params"] = params;
+         
+         if (measureJson(doc) > LORA_MAX_PAYLOAD_LENGTH) {
+             String json;
+             serializeJson(doc, json);
+             return sendBuffer(LORA_MSG_COMMAND, (const uint8_t*)json.c_str(), json.length(), destId) != 0;
+         }
+         length = serializeJson(doc, (char*)packet->payload, LORA_MAX_PAYLOAD_LENGTH);
      }
+     packet->length = length;
      
-     // Create and send packet
-     LoRaPacket packet = createPacket(LORA_MSG_COMMAND, destId, payload, length);
      return sendPacket(packet);
  }
  
- // Send a raw LoRa packet
- bool LoRaManager::sendPacket(const LoRaPacket& packet) {
-     if (!_initialized || !_enabled) {
-         return false;
+ // Transmit a packet with one burst write of header, payload and trailer
+ bool LoRaManager::transmit(const LoRaPacket& packet) {
+     uint8_t header[LORA_HEADER_SIZE];
+     LoRaWire::encodeHeader(packet, header);
+     
+     xSemaphoreTake(_radioMutex, portMAX_DELAY);
+     
+     // Pick the data rate: a running session with the peer keeps its rate,
+     // a strong link gets a faster rate offered, a retransmission falls back
+     uint32_t now = millis();
+     bool unicast = packet.destId != 0xFFFF && packet.sourceId == _deviceId;
+     bool inSession = unicast && _sessionRate != LORA_ADR_HOME && packet.destId == _sessionPeer &&
+                      !isDue(_sessionUntil, now);
+     uint8_t rate = LORA_ADR_HOME;
+     uint8_t offer = LORA_ADR_HOME;
+     
+     if (unicast && packet.attempt > 0) {
+         _adr.noteFailure(packet.destId);
+         if (packet.destId == _sessionPeer) {
+             _sessionRate = LORA_ADR_HOME;
+         }
+     } else if (inSession) {
+         rate = offer = _sessionRate;
+         _sessionUntil = now + TDECK_LORA_ADR_HOLD_MS;
+     } else if (unicast && (packet.flags & LORA_FLAG_RELIABLE)) {
+         // The offer goes out on the home setting, the ACK comes back on the new rate
+         offer = _adr.rateFor(packet.destId);
+         if (offer != LORA_ADR_HOME) {
+             _sessionPeer = packet.destId;
+             _sessionRate = offer;
+             _sessionUntil = now + TDECK_LORA_ADR_HOLD_MS;
+         }
      }
+     tuneRadio(rate);
+     
+     // Advertise the capability level, flags, rate offer and route, outside the payload length
+     uint8_t trailer[LORA_CAPS_TRAILER_SIZE];
+     LoRaWire::encodeTrailer(packet, offer, trailer);
      
-     // Begin packet transmission
+     // Our own packet echoed back by a relay must not be forwarded or delivered
+     _mesh.markSeen(packet);
+     
+     // Listen before talk, back off with jitter while another node is sending
+     if (TDECK_FEATURE_LORA_LBT) {
+         for (int attempt = 0; channelBusy(); attempt++) {
+             if (attempt >= TDECK_LORA_LBT_RETRIES) {
+                 TDECK_TRACE_W(LORA, "LoRa channel still busy, transmitting anyway");
+                 break;
+             }
+             _lbtDeferrals++;
+             
+             // Keep receiving during the backoff, the busy channel may be a packet for us
+             startReceive();
+             xSemaphoreGive(_radioMutex);
+             vTaskDelay(pdMS_TO_TICKS(TDECK_LORA_LBT_BACKOFF_MS / 2 + esp_random() % (TDECK_LORA_LBT_BACKOFF_MS + 1)));
+             drainRadio();
+             xSemaphoreTake(_radioMutex, portMAX_DELAY);
+         }
+     }
+     
+     // Full clock from loading the FIFO until the radio is back in receive
+     Power::lock(PowerLock::RADIO);
+     
+     // Loading the FIFO and starting the transmission is one burst on the bus
+     spiBus.acquire(SPI_BUS_LORA);
+     
+     // Puts the radio in standby and resets the FIFO pointer
      LoRa.beginPacket();
      
-     // Write packet header
-     LoRa.write(packet.messageType);
-     LoRa.write((uint8_t)(packet.sourceId >> 8));
-     LoRa.write((uint8_t)(packet.sourceId & 0xFF));
-     LoRa.write((uint8_t)(packet.destId >> 8));
-     LoRa.write((uint8_t)(packet.destId & 0xFF));
-     LoRa.write((uint8_t)(packet.packetId >> 8));
-     LoRa.write((uint8_t)(packet.packetId & 0xFF));
-     LoRa.write(packet.length);
+     SPI.beginTransaction(spiBus.settings(SPI_BUS_LORA));
+     digitalWrite(TDECK_LORA_CS, LOW);
+     SPI.transfer(SX127X_REG_FIFO | SX127X_REG_WRITE);
+     SPI.writeBytes(header, LORA_HEADER_SIZE);
+     SPI.writeBytes(packet.payload, packet.length);
+     SPI.writeBytes(trailer, LORA_CAPS_TRAILER_SIZE);
+     digitalWrite(TDECK_LORA_CS, HIGH);
+     SPI.endTransaction();
+     
+     sx127xWriteRegister(SPI, SX127X_REG_PAYLOAD_LENGTH, LORA_HEADER_SIZE + packet.length + LORA_CAPS_TRAILER_SIZE);
      
-     // Write payload
-     LoRa.write(packet.payload, packet.length);
+     // Start the transmission without spinning on the bus until it is done
+     LoRa.endPacket(true);
+     spiBus.release(SPI_BUS_LORA);
      
-     // End packet and transmit
-     bool result = LoRa.endPacket();
+     int spreadingFactor;
+     long bandwidth;
+     _adr.settings(_radioRate, spreadingFactor, bandwidth);
+     uint32_t airtime = LoRaStats::timeOnAir(LORA_HEADER_SIZE + packet.length + LORA_CAPS_TRAILER_SIZE,
+                                             spreadingFactor, bandwidth, _codingRate, _preambleLength);
      
+     bool result = waitTransmitDone(airtime);
      if (result) {
-         TDECK_LOG_I("Sent LoRa packet: type=%d, dest=0x%04X, id=%d, len=%d", 
-                     packet.messageType, packet.destId, packet.packetId, packet.length);
+         loraStats.noteTransmit(airtime);
+     }
+     
+     // Transmitting leaves the radio in standby, listen where the reply will come
+     tuneRadio(_sessionRate);
+     startReceive();
+     Power::unlock(PowerLock::RADIO);
+     xSemaphoreGive(_radioMutex);
+     
+     if (result) {
+         TDECK_TRACE_I(LORA, "Sent LoRa packet: type=%d, dest=0x%04X, id=%d, len=%d", 
+                       packet.messageType, packet.destId, packet.packetId, packet.length);
      } else {
-         TDECK_LOG_E("Failed to send LoRa packet");
+         TDECK_TRACE_E(LORA, "Failed to send LoRa packet");
      }
      
      return result;
  }
  
+ // Wait for TxDone, caller holds _radioMutex
+ bool LoRaManager::waitTransmitDone(uint32_t airtimeMicros) {
+     // Twice the time-on-air covers clock error, anything longer means the radio is stuck
+     uint32_t timeoutMs = (2 * airtimeMicros) / 1000 + 100;
+     uint32_t start = millis();
+     
+     while (!(sx127xReadRegister(SPI, SX127X_REG_IRQ_FLAGS) & SX127X_IRQ_TX_DONE)) {
+         if (millis() - start > timeoutMs) {
+             TDECK_TRACE_W(LORA, "LoRa TxDone timed out after %lu ms", (unsigned long)timeoutMs);
+             return false;
+         }
+         vTaskDelay(1);
+     }
+     
+     sx127xWriteRegister(SPI, SX127X_REG_IRQ_FLAGS, SX127X_IRQ_TX_DONE);
+     return true;
+ }
+ 
  // Register a callback for received messages
  void LoRaManager::setMessageCallback(LoRaMessageCallback callback) {
      _messageCallback = callback;
  }
  
+ // Register a callback for every packet heard
+ void LoRaManager::setMonitorCallback(LoRaMessageCallback callback) {
+     _monitorCallback = callback;
+ }
+ 
+ // Add a callback for reassembled transfers
+ bool LoRaManager::addTransferCallback(LoRaReassemblyCallback callback) {
+     return _fragmenter.addReassemblyCallback(callback);
+ }
+ 
  // Configure LoRa parameters
  bool LoRaManager::configure(long frequency, long bandwidth, int spreadingFactor, int codingRate, int syncWord) {
      if (!_initialized) {
@@ -228,6 +884,8 @@
      
      // Update settings on the fly
      bool success = true;
+     xSemaphoreTake(_radioMutex, portMAX_DELAY);
+     spiBus.acquire(SPI_BUS_LORA);
      
      // Update frequency if changed
      if (frequency != _frequency) {
@@ -269,6 +927,17 @@
          _syncWord = syncWord;
      }
      
+     // The radio is on the new home setting, any rate session is dropped
+     _adr.setHome(_spreadingFactor, _bandwidth);
+     _radioRate = LORA_ADR_HOME;
+     _sessionRate = LORA_ADR_HOME;
+     
+     // Symbol time may have changed
+     applyPreamble();
+     startReceive();
+     spiBus.release(SPI_BUS_LORA);
+     xSemaphoreGive(_radioMutex);
+     
      // Save configuration to file
      if (success) {
          saveConfig();
@@ -280,7 +949,7 @@
  // Load configuration from file
  bool LoRaManager::loadConfig() {
      StaticJsonDocument<256> doc;
-     if (!fsManager.loadJsonFromFile(TDECK_FS_LORA_CONFIG_FILE, doc)) {
+     if (!configStorage.read(TDECK_FS_LORA_CONFIG_FILE, doc)) {
          TDECK_LOG_W("LoRa config file not found, using defaults");
          return false;
      }
@@ -293,6 +962,8 @@
      _syncWord = doc["syncWord"] | TDECK_LORA_SYNC_WORD;
      _deviceId = doc["deviceId"] | getDefaultDeviceId();
      _enabled = doc["enabled"] | true;
+     _rxDutyCycleMs = doc["rxDutyCycleMs"] | TDECK_LORA_RX_DUTY_CYCLE_MS;
+     _relayEnabled = doc["relay"] | (bool)TDECK_LORA_MESH_RELAY;
      
      TDECK_LOG_I("Loaded LoRa configuration: %ld Hz, SF%d, BW %ld, CR 4/%d", 
                  _frequency, _spreadingFactor, _bandwidth, _codingRate);
@@ -302,9 +973,6 @@
  
  // Save current configuration to file
  bool LoRaManager::saveConfig() {
-     // Create directory if it doesn't exist
-     fsManager.createDir(TDECK_FS_CONFIG_DIR);
-     
      // Create JSON document with current settings
      StaticJsonDocument<256> doc;
      doc["frequency"] = _frequency;
@@ -314,9 +982,11 @@
      doc["syncWord"] = _syncWord;
      doc["deviceId"] = _deviceId;
      doc["enabled"] = _enabled;
+     doc["rxDutyCycleMs"] = _rxDutyCycleMs;
+     doc["relay"] = _relayEnabled;
      
-     // Save to file
-     bool result = fsManager.saveJsonToFile(TDECK_FS_LORA_CONFIG_FILE, doc);
+     // Written back by the config cache once changes settle
+     bool result = configStorage.write(TDECK_FS_LORA_CONFIG_FILE, doc);
      if (!result) {
          TDECK_LOG_E("Failed to save LoRa configuration");
      }
@@ -340,6 +1010,11 @@
      return _enabled;
  }
  
+ // Check if the radio was initialized
+ bool LoRaManager::isInitialized() const {
+     return _initialized;
+ }
+ 
  // Enable or disable LoRa functionality
  void LoRaManager::setEnabled(bool enable) {
      _enabled = enable;
@@ -356,56 +1031,188 @@
      return _lastSnr;
  }
  
- // Handle received LoRa packets
- void LoRaManager::handleReceivedPacket() {
-     // Read packet size
-     int packetSize = LoRa.available();
+ // Get the number of received packets dropped because the queue was full
+ uint32_t LoRaManager::getDroppedPackets() const {
+     return _droppedPackets;
+ }
+ 
+ // Check whether payloads for a destination can use the binary schema
+ bool LoRaManager::peerSupportsBinary(uint16_t destId) const {
+     return peerHasLevel(destId, LORA_SCHEMA_VERSION);
+ }
+ 
+ // Check whether a destination can expand compressed text
+ bool LoRaManager::peerSupportsCompression(uint16_t destId) const {
+     return peerHasLevel(destId, LORA_CAPS_COMPRESSED_TEXT);
+ }
+ 
+ // Compress a text payload in place when it helps and the destination understands it
+ bool LoRaManager::compressText(LoRaPacket& packet) const {
+     if (!TDECK_FEATURE_LORA_COMPRESSION || packet.length < 2 || !peerSupportsCompression(packet.destId)) {
+         return false;
+     }
      
-     if (packetSize < 8) {  // Minimum header size
-         TDECK_LOG_W("Received malformed LoRa packet (too small)");
-         return;
+     uint8_t compressed[LORA_MAX_PAYLOAD_LENGTH];
+     size_t length = LoRaCodec::compressText(packet.payload, packet.length, compressed, sizeof(compressed));
+     if (length == 0) {
+         return false;
      }
      
-     // Store signal quality metrics
-     _lastRssi = LoRa.packetRssi();
-     _lastSnr = LoRa.packetSnr();
+     memcpy(packet.payload, compressed, length);
+     packet.length = length;
+     packet.flags |= LORA_FLAG_COMPRESSED;
+     return true;
+ }
+ 
+ // Check the capability level of a destination
+ bool LoRaManager::peerHasLevel(uint16_t destId, uint8_t level) const {
+     bool broadcast = destId == 0xFFFF;
+     bool supported = broadcast;
+     
+     portENTER_CRITICAL(&_peerLock);
+     for (const LoRaPeer& peer : _peers) {
+         if (peer.lastSeen == 0) {
+             continue;
+         }
+         
+         if (broadcast) {
+             // One older listener keeps broadcasts readable for everyone
+             if (peer.schema < level) {
+                 supported = false;
+                 break;
+             }
+         } else if (peer.id == destId) {
+             supported = peer.schema >= level;
+             break;
+         }
+     }
+     portEXIT_CRITICAL(&_peerLock);
+     
+     return supported;
+ }
+ 
+ // Remember the payload format a peer advertised, replacing the stalest entry
+ void LoRaManager::notePeer(uint16_t id, uint8_t schema) {
+     uint32_t now = millis() | 1;  // 0 marks an unused entry
      
-     // Read header fields
-     uint8_t messageType = LoRa.read();
-     uint16_t sourceId = (LoRa.read() << 8) | LoRa.read();
-     uint16_t destId = (LoRa.read() << 8) | LoRa.read();
-     uint16_t packetId = (LoRa.read() << 8) | LoRa.read();
-     uint8_t length = LoRa.read();
+     portENTER_CRITICAL(&_peerLock);
+     LoRaPeer* slot = &_peers[0];
+     for (LoRaPeer& peer : _peers) {
+         if (peer.lastSeen != 0 && peer.id == id) {
+             slot = &peer;
+             break;
+         }
+         if (peer.lastSeen < slot->lastSeen) {
+             slot = &peer;
+         }
+     }
+     slot->id = id;
+     slot->schema = schema;
+     slot->lastSeen = now;
+     portEXIT_CRITICAL(&_peerLock);
+ }
+ 
+ // Handle a received LoRa packet
+ void LoRaManager::handleReceivedPacket(const LoRaPacketRef& ref) {
+     LoRaPacket& packet = *ref;
+     uint8_t messageType = packet.messageType;
+     uint16_t sourceId = packet.sourceId;
+     uint16_t destId = packet.destId;
+     uint16_t packetId = packet.packetId;
+     uint8_t length = packet.length;
+     
+     // Drop echoes and copies heard over several paths, mesh-aware senders
+     // always set a hop limit or count
+     if (packet.hopLimit != 0 || packet.hopCount != 0) {
+         if (sourceId == _deviceId || !_mesh.markSeen(packet)) {
+             // Someone else forwarded it first
+             _mesh.cancelRelay(packet);
+             return;
+         }
+         
+         if (_relayEnabled && packet.hopLimit > 0 && destId != _deviceId) {
+             _mesh.scheduleRelay(ref);
+         }
+     }
+     
+     // Learn the sender's payload format from every packet heard
+     notePeer(sourceId, packet.schema);
+     
+     // A gateway forwards traffic for every node, not just ours
+     if (_monitorCallback != nullptr) {
+         _monitorCallback(ref);
+     }
      
      // Check if packet is for us (or broadcast)
      if (destId != _deviceId && destId != 0xFFFF) {
-         // Not for us, ignore
+         // Not for us, any relay has been scheduled above
          return;
      }
      
-     // Read payload
-     LoRaPacket packet;
-     packet.messageType = messageType;
-     packet.sourceId = sourceId;
-     packet.destId = destId;
-     packet.packetId = packetId;
-     packet.length = length;
+     // Store signal quality metrics
+     _lastRssi = packet.rssi;
+     _lastSnr = packet.snr;
      
-     // Check payload length
-     if (length > LORA_MAX_PACKET_SIZE) {
-         TDECK_LOG_W("Received LoRa packet with invalid payload length: %d", length);
+     // Log packet details
+     TDECK_TRACE_I(LORA, "Received LoRa packet: type=%d, source=0x%04X, id=%d, len=%d, RSSI=%d, SNR=%.1f", 
+                   messageType, sourceId, packetId, length, _lastRssi, _lastSnr);
+     
+     // Reliable unicast is acknowledged by the window, retransmitted copies
+     // are acknowledged again but not delivered twice
+     bool reliable = (packet.flags & LORA_FLAG_RELIABLE) && destId != 0xFFFF && messageType != LORA_MSG_ACK;
+     if (reliable && !_reliable.onData(packet)) {
+         TDECK_TRACE_I(LORA, "Duplicate LoRa packet %d from 0x%04X", packetId, sourceId);
          return;
      }
      
-     // Read payload data
-     int bytesRead = 0;
-     while (LoRa.available() && bytesRead < length) {
-         packet.payload[bytesRead++] = LoRa.read();
+     // Fragments are delivered through the transfer callback once complete
+     if (packet.flags & LORA_FLAG_FRAGMENT) {
+         _fragmenter.onFragment(packet);
+         return;
      }
      
-     // Log packet details
-     TDECK_LOG_I("Received LoRa packet: type=%d, source=0x%04X, id=%d, len=%d, RSSI=%d, SNR=%.1f", 
-                 messageType, sourceId, packetId, length, _lastRssi, _lastSnr);
+     // A relay scheduled above keeps forwarding the compact copy
+     if ((packet.flags & LORA_FLAG_COMPRESSED) && messageType == LORA_MSG_TEXT) {
+         LoRaPacketRef expanded = expandText(packet);
+         if (expanded) {
+             deliverPacket(expanded);
+         }
+         return;
+     }
+     
+     deliverPacket(ref);
+ }
+ 
+ // Expand compressed text into a fresh pool slot
+ LoRaPacketRef LoRaManager::expandText(const LoRaPacket& packet) {
+     LoRaPacketRef expanded = loraPacketPool.allocate();
+     if (!expanded) {
+         _droppedPackets++;
+         TDECK_TRACE_W(LORA, "LoRa packet pool exhausted, packet dropped");
+         return expanded;
+     }
+     
+     // Room is left for the terminator added on delivery
+     size_t length = LoRaCodec::expandText(packet.payload, packet.length, expanded->payload, LORA_MAX_PACKET_SIZE - 1);
+     if (length == 0) {
+         TDECK_TRACE_W(LORA, "Failed to expand compressed text from 0x%04X", packet.sourceId);
+         return LoRaPacketRef();
+     }
+     
+     // Header fields and link metrics carry over unchanged
+     memcpy(expanded.get(), &packet, offsetof(LoRaPacket, payload));
+     expanded->length = length;
+     expanded->flags &= ~LORA_FLAG_COMPRESSED;
+     return expanded;
+ }
+ 
+ // Dispatch a packet addressed to us
+ void LoRaManager::deliverPacket(const LoRaPacketRef& ref) {
+     LoRaPacket& packet = *ref;
+     uint8_t messageType = packet.messageType;
+     uint16_t sourceId = packet.sourceId;
+     uint16_t destId = packet.destId;
+     uint8_t length = packet.length;
      
      // Handle packet based on type
      switch (messageType) {
@@ -416,10 +1223,21 @@
              } else {
                  packet.payload[LORA_MAX_PACKET_SIZE - 1] = 0;
              }
-             TDECK_LOG_I("LoRa text message: %s", (char*)packet.payload);
+             TDECK_TRACE_I(LORA, "LoRa text message: %s", (char*)packet.payload);
              break;
              
          case LORA_MSG_LOCATION:
+             if (LoRaCodec::isBinary(packet.payload, length)) {
+                 LoRaLocation location;
+                 if (LoRaCodec::decodeLocation(packet.payload, length, location)) {
+                     TDECK_TRACE_I(LORA, "LoRa location: lat=%.6f, lon=%.6f, alt=%.1f",
+                                   location.latitude / 1e7, location.longitude / 1e7, location.altitude / 10.0);
+                 } else {
+                     TDECK_TRACE_W(LORA, "Failed to decode binary location data");
+                 }
+                 break;
+             }
+             
              // Parse JSON location data
              {
                  StaticJsonDocument<128> doc;
@@ -428,14 +1246,30 @@
                      float lat = doc["lat"];
                      float lon = doc["lon"];
                      float alt = doc["alt"];
-                     TDECK_LOG_I("LoRa location: lat=%.6f, lon=%.6f, alt=%.1f", lat, lon, alt);
+                     TDECK_TRACE_I(LORA, "LoRa location: lat=%.6f, lon=%.6f, alt=%.1f", lat, lon, alt);
                  } else {
-                     TDECK_LOG_W("Failed to parse location data: %s", error.c_str());
+                     TDECK_TRACE_W(LORA, "Failed to parse location data: %s", error.c_str());
                  }
              }
              break;
              
          case LORA_MSG_STATUS:
+             if (LoRaCodec::isBinary(packet.payload, length)) {
+                 LoRaTlvReader reader(packet.payload, length);
+                 LoRaTlvField field;
+                 int fields = 0;
+                 while (reader.next(field)) {
+                     fields++;
+                 }
+                 
+                 if (reader.ok()) {
+                     TDECK_TRACE_I(LORA, "LoRa status: %d binary fields", fields);
+                 } else {
+                     TDECK_TRACE_W(LORA, "Failed to decode binary status data");
+                 }
+                 break;
+             }
+             
              // Parse JSON status data
              {
                  StaticJsonDocument<256> doc;
@@ -443,73 +1277,93 @@
                  if (!error) {
                      String status;
                      serializeJson(doc, status);
-                     TDECK_LOG_I("LoRa status: %s", status.c_str());
+                     TDECK_TRACE_I(LORA, "LoRa status: %s", status.c_str());
                  } else {
-                     TDECK_LOG_W("Failed to parse status data: %s", error.c_str());
+                     TDECK_TRACE_W(LORA, "Failed to parse status data: %s", error.c_str());
                  }
              }
              break;
              
          case LORA_MSG_COMMAND:
+             if (LoRaCodec::isBinary(packet.payload, length)) {
+                 LoRaTlvReader reader(packet.payload, length);
+                 LoRaTlvField field;
+                 if (reader.next(field) && field.field == LORA_FIELD_CMD && field.type == LORA_WIRE_BYTES) {
+                     TDECK_LOG_I("LoRa command: %.*s", (int)field.length, (const char*)field.data);
+                 } else {
+                     TDECK_TRACE_W(LORA, "Failed to decode binary command data");
+                 }
+                 break;
+             }
+             
              // Parse JSON command data
              {
                  StaticJsonDocument<256> doc;
                  DeserializationError error = deserializeJson(doc, (char*)packet.payload, length);
                  if (!error) {
                      String command = doc["cmd"];
-                     TDECK_LOG_I("LoRa command: %s", command.c_str());
+                     TDECK_TRACE_I(LORA, "LoRa command: %s", command.c_str());
                  } else {
-                     TDECK_LOG_W("Failed to parse command data: %s", error.c_str());
+                     TDECK_TRACE_W(LORA, "Failed to parse command data: %s", error.c_str());
                  }
              }
              break;
              
          case LORA_MSG_ACK:
              // Acknowledgment packet
-             {
+             if (destId == _deviceId && length >= 2) {
                  uint16_t ackPacketId = (packet.payload[0] << 8) | packet.payload[1];
-                 TDECK_LOG_I("LoRa acknowledgment for packet ID: %d", ackPacketId);
+                 TDECK_TRACE_I(LORA, "LoRa acknowledgment for packet ID: %d", ackPacketId);
+                 _adr.noteSuccess(sourceId);
+                 _reliable.onAck(packet);
              }
              break;
              
+         case LORA_MSG_BENCH:
+             _bench.onPacket(packet);
+             break;
+             
          default:
-             TDECK_LOG_W("Unknown LoRa message type: %d", messageType);
+             TDECK_TRACE_W(LORA, "Unknown LoRa message type: %d", messageType);
              break;
      }
      
-     // Send acknowledgment if not a broadcast or ACK
-     if (destId != 0xFFFF && messageType != LORA_MSG_ACK) {
+     // Nodes without the capability trailer expect one ACK per unicast packet
+     if (destId != 0xFFFF && messageType != LORA_MSG_ACK && packet.schema == 0) {
          sendAcknowledgment(packet);
      }
      
-     // Call the message callback if registered
+     // Call the message callback if registered, it may keep the handle
      if (_messageCallback != nullptr) {
-         _messageCallback(&packet);
+         _messageCallback(ref);
      }
  }
  
- // Create a packet with the specified parameters
- LoRaPacket LoRaManager::createPacket(uint8_t messageType, uint16_t destId, const uint8_t* payload, uint8_t length) {
-     LoRaPacket packet;
-     packet.messageType = messageType;
-     packet.sourceId = _deviceId;
-     packet.destId = destId;
-     packet.packetId = _packetCounter++;
-     packet.length = length;
-     
-     if (length > 0 && payload != nullptr) {
-         memcpy(packet.payload, payload, length);
+ // Allocate a pooled packet with the header filled in
+ LoRaPacketRef LoRaManager::createPacket(uint8_t messageType, uint16_t destId) {
+     LoRaPacketRef packet = loraPacketPool.allocate();
+     if (!packet) {
+         TDECK_TRACE_W(LORA, "LoRa packet pool exhausted");
+         return packet;
      }
      
+     packet->messageType = messageType;
+     packet->sourceId = _deviceId;
+     packet->destId = destId;
+     packet->packetId = _packetCounter++;
+     packet->hopLimit = TDECK_LORA_MESH_HOPS;
      return packet;
  }
  
  // Send an acknowledgment for a received packet
  bool LoRaManager::sendAcknowledgment(const LoRaPacket& receivedPacket) {
-     uint8_t payload[2];
-     payload[0] = (receivedPacket.packetId >> 8) & 0xFF;
-     payload[1] = receivedPacket.packetId & 0xFF;
+     LoRaPacketRef ackPacket = createPacket(LORA_MSG_ACK, receivedPacket.sourceId);
+     if (!ackPacket) {
+         return false;
+     }
      
-     LoRaPacket ackPacket = createPacket(LORA_MSG_ACK, receivedPacket.sourceId, payload, 2);
+     ackPacket->payload[0] = (receivedPacket.packetId >> 8) & 0xFF;
+     ackPacket->payload[1] = receivedPacket.packetId & 0xFF;
+     ackPacket->length = 2;
      return sendPacket(ackPacket);
  }
\ No newline at end of file
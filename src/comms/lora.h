@@ -13,9 +13,17 @@
  #include <LoRa.h>
  #include <ArduinoJson.h>
  #include "../config.h"
+ #include "lora_codec.h"
+ #include "lora_packet.h"
+ #include "lora_reliable.h"
+ #include "lora_fragment.h"
+ #include "lora_adr.h"
+ #include "lora_mesh.h"
+ #include "lora_stats.h"
+ #include "lora_bench.h"
  
- // Maximum packet size for LoRa transmission
- #define LORA_MAX_PACKET_SIZE 256
+ // Largest payload that fits the radio FIFO with header and trailer
+ #define LORA_MAX_PAYLOAD_LENGTH (255 - LORA_HEADER_SIZE - LORA_CAPS_TRAILER_SIZE)
  
  // Message types for LoRa packets
  enum LoRaMessageType {
@@ -23,21 +31,21 @@
      LORA_MSG_LOCATION = 1,  // Location data
      LORA_MSG_STATUS = 2,    // Status update
      LORA_MSG_COMMAND = 3,   // Command message
-     LORA_MSG_ACK = 4        // Acknowledgment
+     LORA_MSG_ACK = 4,       // Acknowledgment
+    LORA_MSG_BENCH = 5,     // Link benchmark probe
+    LORA_MSG_FIRMWARE = 6,  // Firmware image or delta patch, see OTAManager
+    LORA_MSG_VOICE = 7      // Codec2 voice note, see LoRaVoice
  };
  
- // LoRa packet structure
- struct LoRaPacket {
-     uint8_t messageType;    // Type of message
-     uint16_t sourceId;      // Source device ID
-     uint16_t destId;        // Destination device ID (0xFFFF for broadcast)
-     uint16_t packetId;      // Unique packet ID
-     uint8_t length;         // Payload length
-     uint8_t payload[LORA_MAX_PACKET_SIZE]; // Message payload
+ // Payload format last heard from a peer
+ struct LoRaPeer {
+     uint16_t id;            // Peer device ID
+     uint8_t schema;         // Capability level, 0 for JSON-only nodes
+     uint32_t lastSeen;      // millis() of the last packet from the peer
  };
  
- // Callback function type for received messages
- typedef void (*LoRaMessageCallback)(LoRaPacket* packet);
+ // Callback function type for received messages, copy the handle to keep the packet
+ typedef void (*LoRaMessageCallback)(const LoRaPacketRef& packet);
  
  /**
   * @class LoRaManager
@@ -66,9 +74,10 @@
      
      /**
       * @brief Update routine to be called periodically
-      * Checks for received messages and handles them
+      * Polls the radio when the interrupt-driven comms task is not running
+      * @return Milliseconds until the radio next needs polling, UINT32_MAX if the comms task owns it
       */
-     void update();
+     uint32_t update();
      
      /**
       * @brief Send a text message via LoRa
@@ -106,11 +115,67 @@
      bool sendCommand(const String& command, const JsonDocument& params, uint16_t destId = 0xFFFF);
      
      /**
-      * @brief Send a raw LoRa packet
-      * @param packet The packet to send
-      * @return true if packet was sent successfully, false otherwise
+      * @brief Allocate a pooled packet addressed from this device
+      * 
+      * The caller writes the payload and length in place, then passes the
+      * handle to sendPacket().
+      * 
+      * @param messageType Type of message
+      * @param destId Destination device ID
+      * @return Packet handle, empty if the pool is exhausted
+      */
+     LoRaPacketRef createPacket(uint8_t messageType, uint16_t destId);
+     
+     /**
+      * @brief Send a LoRa packet
+      * @param packet The packet to send, shared with the transmit queue
+      * @return true if packet was queued (or sent when polling), false otherwise
+      */
+     bool sendPacket(LoRaPacketRef packet);
+     
+     /**
+      * @brief Send a unicast packet with acknowledged delivery
+      * 
+      * Returns at once. The packet is retransmitted until the destination
+      * acknowledges it or the retries run out, then the callback reports the
+      * outcome on the comms task. Each destination has its own window, so
+      * packets to different peers do not wait for each other.
+      * 
+      * @param packet Packet from createPacket(), the packet ID is replaced by the window sequence
+      * @param callback Completion callback, may be nullptr
+      * @param context Passed to the callback
+      * @return Delivery token, 0 if the packet is a broadcast or the window is full
+      */
+     uint32_t sendReliable(LoRaPacketRef packet, LoRaDeliveryCallback callback = nullptr, void* context = nullptr);
+     
+     /**
+      * @brief Send a payload larger than one packet as a fragmented transfer
+      * 
+      * Unicast fragments use acknowledged delivery, so only lost fragments
+      * are sent again. The data is copied before this returns.
+      * 
+      * @param messageType Message type of the reassembled payload
+      * @param data Payload
+      * @param length Payload length, at most TDECK_LORA_TRANSFER_MAX
+      * @param destId Destination device ID (0xFFFF for broadcast)
+      * @param callback Completion callback, may be nullptr
+      * @param context Passed to the callback
+      * @return Transfer ID, 0 on failure
+      */
+     uint16_t sendBuffer(uint8_t messageType, const uint8_t* data, size_t length, uint16_t destId = 0xFFFF,
+                         LoRaTransferCallback callback = nullptr, void* context = nullptr);
+     
+     /**
+      * @brief Send a file as a fragmented transfer
+      * @param messageType Message type of the reassembled payload
+      * @param path File path
+      * @param destId Destination device ID (0xFFFF for broadcast)
+      * @param callback Completion callback, may be nullptr
+      * @param context Passed to the callback
+      * @return Transfer ID, 0 on failure
       */
-     bool sendPacket(const LoRaPacket& packet);
+     uint16_t sendFile(uint8_t messageType, const char* path, uint16_t destId = 0xFFFF,
+                       LoRaTransferCallback callback = nullptr, void* context = nullptr);
      
      /**
       * @brief Register a callback for received messages
@@ -118,6 +183,22 @@
       */
      void setMessageCallback(LoRaMessageCallback callback);
      
+     /**
+      * @brief Register a callback for every packet heard, before address filtering
+      * @param callback Function to call with each packet, once per packet across relay paths
+      */
+     void setMonitorCallback(LoRaMessageCallback callback);
+     
+     /**
+      * @brief Add a callback for reassembled fragmented transfers
+      * 
+      * Every callback sees every transfer and picks its message types.
+      * 
+      * @param callback Function to call with each complete payload
+      * @return true if added, false if TDECK_LORA_TRANSFER_CALLBACKS are registered
+      */
+     bool addTransferCallback(LoRaReassemblyCallback callback);
+     
      /**
       * @brief Configure LoRa parameters
       * @param frequency Frequency in Hz
@@ -159,6 +240,12 @@
       */
      bool isEnabled() const;
      
+     /**
+      * @brief Check if the radio was initialized
+      * @return true if init() succeeded
+      */
+     bool isInitialized() const;
+     
      /**
       * @brief Enable or disable LoRa functionality
       * @param enable true to enable, false to disable
@@ -177,6 +264,135 @@
       */
      float getSNR() const;
      
+     /**
+      * @brief Get the number of received packets dropped because the receive queue was full
+      * @return Dropped packet count since boot
+      */
+     uint32_t getDroppedPackets() const;
+     
+     /**
+      * @brief Check whether payloads for a destination can use the binary schema
+      * 
+      * Unicast needs the peer to have advertised the schema. Broadcasts use it
+      * unless a JSON-only node has been heard.
+      * 
+      * @param destId Destination device ID
+      * @return true to send binary payloads
+      */
+     bool peerSupportsBinary(uint16_t destId) const;
+     
+     /**
+      * @brief Check whether a destination can expand compressed text
+      * @param destId Destination device ID
+      * @return true to send compressed text
+      */
+     bool peerSupportsCompression(uint16_t destId) const;
+     
+     /**
+      * @brief Compress a text payload in place before sending
+      * 
+      * Leaves the payload raw when the destination cannot expand it or
+      * compression would not make it shorter.
+      * 
+      * @param packet Text packet from createPacket() with its payload written
+      * @return true if the payload was compressed and LORA_FLAG_COMPRESSED set
+      */
+     bool compressText(LoRaPacket& packet) const;
+     
+     /**
+      * @brief Set duty-cycled receive
+      * 
+      * The radio sleeps between channel activity checks and only listens
+      * when a preamble is detected, after a transmit, or for a short window
+      * after each wake. Outgoing preambles are lengthened to span the
+      * interval, so peers running the same interval always wake in time.
+      * 
+      * @param intervalMs Sleep between CAD checks, 0 to receive continuously
+      */
+     void setRxDutyCycle(uint16_t intervalMs);
+     
+     /**
+      * @brief Get the duty-cycled receive interval
+      * @return Sleep between CAD checks in ms, 0 if receiving continuously
+      */
+     uint16_t getRxDutyCycle() const;
+     
+     /**
+      * @brief Get the number of transmits deferred by listen-before-talk
+      * @return Busy-channel backoffs since boot
+      */
+     uint32_t getLbtDeferrals() const;
+     
+     /**
+      * @brief Get the data rate adaptive data rate would offer a peer
+      * @param peerId Peer device ID
+      * @return Rate index, LORA_ADR_HOME for the configured setting
+      */
+     uint8_t getPeerRate(uint16_t peerId) const;
+     
+     /**
+      * @brief Get the smoothed RSSI/SNR history of a peer
+      * @param peerId Peer device ID
+      * @param link Receives the history
+      * @return true if the peer has been heard
+      */
+     bool getPeerLink(uint16_t peerId, LoRaLink& link) const;
+     
+     /**
+      * @brief Enable or disable relay mode
+      * 
+      * A relay forwards packets from other nodes until their hop limit runs
+      * out. Duplicates are suppressed and forwarding waits an SNR-ordered
+      * delay, so only one of several relays in range usually transmits.
+      * 
+      * @param enable true to forward packets for other nodes
+      */
+     void setRelayEnabled(bool enable);
+     
+     /**
+      * @brief Check if relay mode is enabled
+      * @return true if packets for other nodes are forwarded
+      */
+     bool isRelayEnabled() const;
+     
+     /**
+      * @brief Get the number of packets forwarded for other nodes
+      * @return Relayed packet count since boot
+      */
+     uint32_t getRelayedPackets() const;
+     
+     /**
+      * @brief Compute the time-on-air of a packet at the configured setting
+      * @param payloadLength Payload bytes, header and trailer are added
+      * @return Time-on-air in microseconds
+      */
+     uint32_t getTimeOnAir(size_t payloadLength) const;
+     
+     /**
+      * @brief Start a ping or flood benchmark against another device
+      * 
+      * Runs on the comms task, poll getBenchmark() for progress. The peer
+      * answers automatically when it runs this firmware.
+      * 
+      * @param mode LORA_BENCH_MODE_PING or LORA_BENCH_MODE_FLOOD
+      * @param peerId Peer device ID
+      * @param count Packets to send
+      * @param size Payload bytes per packet
+      * @return true if started
+      */
+     bool startBenchmark(LoRaBenchMode mode, uint16_t peerId, uint16_t count, uint8_t size);
+     
+     /**
+      * @brief Stop the benchmark in progress
+      */
+     void stopBenchmark();
+     
+     /**
+      * @brief Get the progress or result of the last benchmark
+      * @param result Receives a snapshot
+      */
+     void getBenchmark(LoRaBenchResult& result) const;
+     
  private:
      bool _initialized;           // Initialization flag
      bool _enabled;               // Whether LoRa is currently enabled
@@ -190,21 +406,152 @@
      int _lastRssi;               // Last RSSI value
      float _lastSnr;              // Last SNR value
      LoRaMessageCallback _messageCallback; // Callback for received messages
+     LoRaMessageCallback _monitorCallback; // Callback for every packet heard
+     TaskHandle_t _commsTask;     // Receive task woken by the DIO interrupt, NULL when polling
+     QueueHandle_t _rxQueue;      // Packets read from the radio, waiting for dispatch
+     QueueHandle_t _txQueue;      // Packets waiting for the comms task to transmit
+     SemaphoreHandle_t _radioMutex; // Serializes access to the radio
+     uint32_t _droppedPackets;    // Packets lost to a full receive queue
+     LoRaPeer _peers[TDECK_LORA_MAX_PEERS]; // Payload formats of recently heard peers
+     mutable portMUX_TYPE _peerLock; // Guards _peers
+     LoRaReliable _reliable;      // Windows and timers for acknowledged delivery
+     LoRaFragmenter _fragmenter;  // Fragmented transfers in both directions
+     uint16_t _rxDutyCycleMs;     // Sleep between CAD checks, 0 = continuous receive
+     bool _radioAsleep;           // Radio is in sleep mode between CAD checks
+     uint32_t _listenUntil;       // millis() the current receive window ends
+     uint32_t _nextCad;           // millis() of the next CAD while asleep
+     uint32_t _lbtDeferrals;      // Transmits deferred by a busy channel
+     LoRaAdr _adr;                // Per-peer link history and rate selection
+     uint8_t _radioRate;          // Rate index the radio is tuned to
+     uint16_t _sessionPeer;       // Peer of the current rate session
+     uint8_t _sessionRate;        // Rate of the current session, LORA_ADR_HOME if none
+     uint32_t _sessionUntil;      // millis() the session ends without further traffic
+     LoRaMesh _mesh;              // Seen-packet cache and scheduled rebroadcasts
+     bool _relayEnabled;          // Forward packets for other nodes
+     long _preambleLength;        // Preamble symbols of the current setting
+     LoRaBench _bench;            // Ping/flood benchmark state
      
      /**
-      * @brief Handle received LoRa packets
+      * @brief Comms task, moves packets from the radio to the queue and dispatches them
+      * @param arg LoRaManager instance
       */
-     void handleReceivedPacket();
+     static void commsTask(void* arg);
      
      /**
-      * @brief Create a packet with the specified parameters
-      * @param messageType Type of message
+      * @brief DIO interrupt handler, wakes the comms task on RxDone/TxDone
+      * @param arg LoRaManager instance
+      */
+     static void IRAM_ATTR dioISR(void* arg);
+     
+     /**
+      * @brief Read a pending packet from the radio FIFO into the receive queue
+      * @return true if a packet was read
+      */
+     bool drainRadio();
+     
+     /**
+      * @brief Dispatch one queued packet
+      * @return true if a packet was dispatched
+      */
+     bool dispatchQueued();
+     
+     /**
+      * @brief Put the radio back into continuous receive mode and open a receive window
+      */
+     void startReceive();
+     
+     /**
+      * @brief Put the radio to sleep until the next CAD
+      */
+     void sleepRadio();
+     
+     /**
+      * @brief Check for a reception in progress or a preamble on the air
+      * @return true if the channel is busy
+      */
+     bool channelBusy();
+     
+     /**
+      * @brief Run the duty-cycled receive state machine
+      * @return Milliseconds until the next step, UINT32_MAX if receiving continuously
+      */
+     uint32_t serviceDutyCycle();
+     
+     /**
+      * @brief Set the preamble length for the current duty cycle and modem settings
+      */
+     void applyPreamble();
+     
+     /**
+      * @brief Switch the radio to a rate from the ADR table
+      * @param rate Rate index
+      */
+     void tuneRadio(uint8_t rate);
+     
+     /**
+      * @brief Wait for the packet handed to the radio to leave the air
+      * 
+      * Polls TxDone one register read at a time, so the shared SPI bus stays
+      * free for the display and SD card while the packet is on the air.
+      * 
+      * @param airtimeMicros Expected time-on-air of the packet
+      * @return true if TxDone arrived in time
+      */
+     bool waitTransmitDone(uint32_t airtimeMicros);
+     
+     /**
+      * @brief Join or leave a rate session on a received offer
+      * @param sourceId Sender of the packet
+      * @param rate Rate offered in the trailer
+      */
+     void followRateOffer(uint16_t sourceId, uint8_t rate);
+     
+     /**
+      * @brief End an expired rate session
+      * @return Milliseconds until the session ends, UINT32_MAX if none
+      */
+     uint32_t serviceRateSession();
+     
+     /**
+      * @brief Transmit a packet, blocking until the radio is done
+      * @param packet Packet to send
+      * @return true if the radio reported TxDone
+      */
+     bool transmit(const LoRaPacket& packet);
+     
+     /**
+      * @brief Handle a received LoRa packet
+      * @param packet Packet read from the radio
+      */
+     void handleReceivedPacket(const LoRaPacketRef& packet);
+     
+     /**
+      * @brief Dispatch a packet addressed to us by message type
+      * @param packet Packet with a plain payload
+      */
+     void deliverPacket(const LoRaPacketRef& packet);
+     
+     /**
+      * @brief Expand a compressed text packet into its own pool slot
+      * @param packet Packet with LORA_FLAG_COMPRESSED
+      * @return Packet with the plain text, empty on failure
+      */
+     LoRaPacketRef expandText(const LoRaPacket& packet);
+     
+     /**
+      * @brief Check the capability level of a peer, or of every heard peer for broadcasts
       * @param destId Destination device ID
-      * @param payload Pointer to payload data
-      * @param length Length of payload
-      * @return Constructed LoRa packet
+      * @param level Required capability level
+      * @return true if the destination is at the level or above
+      */
+     bool peerHasLevel(uint16_t destId, uint8_t level) const;
+     
+     /**
+      * @brief Remember the payload format a peer advertised
+      * @param id Peer device ID
+      * @param schema Binary schema version, 0 for JSON-only nodes
       */
-     LoRaPacket createPacket(uint8_t messageType, uint16_t destId, const uint8_t* payload, uint8_t length);
+     void notePeer(uint16_t id, uint8_t schema);
      
      /**
       * @brief Send an acknowledgment for a received packet
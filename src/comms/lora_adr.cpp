@@ -0,0 +1,181 @@
+/**
+ * @file lora_adr.cpp
+ * @brief Implementation of per-peer adaptive data rate for LoRa
+ */
+
+ #include "lora_adr.h"
+ 
+ // Rates a peer can be offered, fastest first. The SNR floors are the SX127x
+ // demodulation limits per spreading factor.
+ static const LoRaRate RATES[] = {
+     { 7, 250000, -7.5f },
+     { 7, 125000, -7.5f },
+     { 8, 125000, -10.0f },
+     { 9, 125000, -12.5f },
+     { 10, 125000, -15.0f },
+     { 11, 125000, -17.5f },
+     { 12, 125000, -20.0f },
+ };
+ 
+ static const uint8_t RATE_COUNT = sizeof(RATES) / sizeof(RATES[0]);
+ 
+ // Constructor
+ LoRaAdr::LoRaAdr()
+     : _homeSpreadingFactor(TDECK_LORA_SPREADING_FACTOR)
+     , _homeBandwidth(TDECK_LORA_BANDWIDTH)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+     memset(_links, 0, sizeof(_links));
+ }
+ 
+ // Set the home setting
+ void LoRaAdr::setHome(int spreadingFactor, long bandwidth) {
+     _homeSpreadingFactor = spreadingFactor;
+     _homeBandwidth = bandwidth;
+ }
+ 
+ // Record the signal of a received packet
+ void LoRaAdr::noteReception(uint16_t peer, int rssi, float snr, uint8_t rate) {
+     int spreadingFactor;
+     long bandwidth;
+     if (!settings(rate, spreadingFactor, bandwidth)) {
+         return;
+     }
+ 
+     // Noise scales with bandwidth, normalize so samples from any rate compare
+     float homeSnr = snr + 10.0f * log10f((float)bandwidth / _homeBandwidth);
+     float homeRssi = rssi;
+ 
+     portENTER_CRITICAL(&_lock);
+     LoRaLink* link = find(peer);
+     if (!link) {
+         // Replace the least recently heard peer
+         link = &_links[0];
+         for (LoRaLink& entry : _links) {
+             if (entry.lastHeard < link->lastHeard) {
+                 link = &entry;
+             }
+         }
+         memset(link, 0, sizeof(*link));
+         link->peer = peer;
+     }
+ 
+     if (link->samples == 0) {
+         link->snr = homeSnr;
+         link->rssi = homeRssi;
+     } else {
+         // Fall quickly, recover slowly, so a fading link drops rate at once
+         float alpha = homeSnr < link->snr ? 0.5f : 0.125f;
+         link->snr += alpha * (homeSnr - link->snr);
+         link->rssi += 0.25f * (homeRssi - link->rssi);
+     }
+     if (link->samples < 255) {
+         link->samples++;
+     }
+     link->lastHeard = millis() | 1;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Record an ACK from a peer
+ void LoRaAdr::noteSuccess(uint16_t peer) {
+     portENTER_CRITICAL(&_lock);
+     LoRaLink* link = find(peer);
+     if (link) {
+         link->failures = 0;
+     }
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Record a missing ACK
+ void LoRaAdr::noteFailure(uint16_t peer) {
+     portENTER_CRITICAL(&_lock);
+     LoRaLink* link = find(peer);
+     if (link && link->failures < RATE_COUNT) {
+         link->failures++;
+     }
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Choose the fastest rate with enough margin
+ uint8_t LoRaAdr::rateFor(uint16_t peer) const {
+     portENTER_CRITICAL(&_lock);
+     const LoRaLink* found = find(peer);
+     LoRaLink link = found ? *found : LoRaLink();
+     portEXIT_CRITICAL(&_lock);
+ 
+     if (!found || link.samples < TDECK_LORA_ADR_MIN_SAMPLES ||
+         millis() - link.lastHeard > TDECK_LORA_ADR_STALE_MS) {
+         return LORA_ADR_HOME;
+     }
+ 
+     float homeCost = symbolCost(_homeSpreadingFactor, _homeBandwidth);
+ 
+     for (uint8_t i = 0; i < RATE_COUNT; i++) {
+         const LoRaRate& rate = RATES[i];
+ 
+         // Only rates that beat the home setting are worth a session
+         if (symbolCost(rate.spreadingFactor, rate.bandwidth) >= homeCost) {
+             break;
+         }
+ 
+         float margin = link.snr - rate.requiredSnr - 10.0f * log10f((float)rate.bandwidth / _homeBandwidth);
+         if (margin >= TDECK_LORA_ADR_MARGIN_DB) {
+             // Each missing ACK steps one rate slower
+             uint16_t index = i + link.failures;
+             if (index >= RATE_COUNT ||
+                 symbolCost(RATES[index].spreadingFactor, RATES[index].bandwidth) >= homeCost) {
+                 return LORA_ADR_HOME;
+             }
+             return index + 1;
+         }
+     }
+ 
+     return LORA_ADR_HOME;
+ }
+ 
+ // Get the radio setting for a rate index
+ bool LoRaAdr::settings(uint8_t rate, int& spreadingFactor, long& bandwidth) const {
+     if (rate == LORA_ADR_HOME) {
+         spreadingFactor = _homeSpreadingFactor;
+         bandwidth = _homeBandwidth;
+         return true;
+     }
+ 
+     if (rate > RATE_COUNT) {
+         return false;
+     }
+ 
+     spreadingFactor = RATES[rate - 1].spreadingFactor;
+     bandwidth = RATES[rate - 1].bandwidth;
+     return true;
+ }
+ 
+ // Get the link history of a peer
+ bool LoRaAdr::getLink(uint16_t peer, LoRaLink& link) const {
+     portENTER_CRITICAL(&_lock);
+     const LoRaLink* found = find(peer);
+     if (found) {
+         link = *found;
+     }
+     portEXIT_CRITICAL(&_lock);
+     return found != nullptr;
+ }
+ 
+ // Find a peer's entry
+ LoRaLink* LoRaAdr::find(uint16_t peer) {
+     for (LoRaLink& link : _links) {
+         if (link.lastHeard != 0 && link.peer == peer) {
+             return &link;
+         }
+     }
+     return nullptr;
+ }
+ 
+ const LoRaLink* LoRaAdr::find(uint16_t peer) const {
+     return const_cast<LoRaAdr*>(this)->find(peer);
+ }
+ 
+ // Symbol time over bits per symbol, proportional to air time per bit
+ float LoRaAdr::symbolCost(int spreadingFactor, long bandwidth) {
+     return (float)(1UL << spreadingFactor) / ((float)bandwidth * spreadingFactor);
+ }
\ No newline at end of file
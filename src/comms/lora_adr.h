@@ -0,0 +1,122 @@
+/**
+ * @file lora_adr.h
+ * @brief Per-peer adaptive data rate for LoRa
+ *
+ * This file contains the link-quality table used to pick a spreading factor
+ * and bandwidth for each peer. Every node listens on the configured home
+ * setting. A sender that sees a strong link offers a faster rate in the
+ * packet trailer, and both ends stay on that rate for a short session while
+ * traffic keeps flowing. A missing ACK ends the session and pushes the peer
+ * towards slower rates until it answers again.
+ */
+
+ #ifndef TDECK_COMMS_LORA_ADR_H
+ #define TDECK_COMMS_LORA_ADR_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // Rate index 0 is the configured home setting, 1 onwards index the rate table from fastest to slowest
+ #define LORA_ADR_HOME 0
+ 
+ // Radio setting selectable per peer
+ struct LoRaRate {
+     uint8_t spreadingFactor;    // Spreading factor
+     long bandwidth;             // Bandwidth in Hz
+     float requiredSnr;          // Demodulation floor in dB
+ };
+ 
+ // Smoothed link quality of one peer, measured at the home bandwidth
+ struct LoRaLink {
+     uint16_t peer;              // Peer device ID
+     float rssi;                 // Smoothed RSSI in dBm
+     float snr;                  // Smoothed SNR in dB
+     uint8_t samples;            // Packets measured, saturates at 255
+     uint8_t failures;           // Consecutive missing ACKs
+     uint32_t lastHeard;         // millis() of the last packet, 0 if unused
+ };
+ 
+ /**
+  * @class LoRaAdr
+  * @brief Link history per peer and rate selection
+  *
+  * All methods may be called from any task.
+  */
+ class LoRaAdr {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaAdr();
+ 
+     /**
+      * @brief Set the home setting every node listens on
+      * @param spreadingFactor Home spreading factor
+      * @param bandwidth Home bandwidth in Hz
+      */
+     void setHome(int spreadingFactor, long bandwidth);
+ 
+     /**
+      * @brief Record the signal of a received packet
+      * @param peer Source device ID
+      * @param rssi RSSI in dBm
+      * @param snr SNR in dB
+      * @param rate Rate index the radio was tuned to
+      */
+     void noteReception(uint16_t peer, int rssi, float snr, uint8_t rate);
+ 
+     /**
+      * @brief Record an ACK from a peer, clearing its failures
+      * @param peer Peer device ID
+      */
+     void noteSuccess(uint16_t peer);
+ 
+     /**
+      * @brief Record a missing ACK, the next rate chosen for the peer is one step slower
+      * @param peer Peer device ID
+      */
+     void noteFailure(uint16_t peer);
+ 
+     /**
+      * @brief Choose the fastest rate that keeps TDECK_LORA_ADR_MARGIN_DB of margin
+      * @param peer Destination device ID
+      * @return Rate index, LORA_ADR_HOME if no faster rate is safe
+      */
+     uint8_t rateFor(uint16_t peer) const;
+ 
+     /**
+      * @brief Get the radio setting for a rate index
+      * @param rate Rate index
+      * @param spreadingFactor Receives the spreading factor
+      * @param bandwidth Receives the bandwidth in Hz
+      * @return true if the index is valid
+      */
+     bool settings(uint8_t rate, int& spreadingFactor, long& bandwidth) const;
+ 
+     /**
+      * @brief Get the link history of a peer
+      * @param peer Peer device ID
+      * @param link Receives the history
+      * @return true if the peer has been heard
+      */
+     bool getLink(uint16_t peer, LoRaLink& link) const;
+ 
+ private:
+     LoRaLink _links[TDECK_LORA_ADR_PEERS];  // Link history, LRU replaced
+     int _homeSpreadingFactor;               // Home spreading factor
+     long _homeBandwidth;                    // Home bandwidth in Hz
+     mutable portMUX_TYPE _lock;             // Guards _links
+ 
+     /**
+      * @brief Find a peer's entry, caller holds _lock
+      */
+     LoRaLink* find(uint16_t peer);
+     const LoRaLink* find(uint16_t peer) const;
+ 
+     /**
+      * @brief Air time cost of a setting relative to others, lower is faster
+      */
+     static float symbolCost(int spreadingFactor, long bandwidth);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_ADR_H
\ No newline at end of file
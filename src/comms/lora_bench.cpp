@@ -0,0 +1,267 @@
+/**
+ * @file lora_bench.cpp
+ * @brief Implementation of the LoRa ping and flood benchmark
+ */
+
+ #include "lora_bench.h"
+ #include "lora.h"
+ #include "lora_stats.h"
+ 
+ // Signed deadline check that survives millis() wrap-around
+ static inline bool isDue(uint32_t deadline, uint32_t now) {
+     return (int32_t)(deadline - now) <= 0;
+ }
+ 
+ // Constructor
+ LoRaBench::LoRaBench()
+     : _started(0)
+     , _deadline(0)
+     , _awaiting(false)
+     , _inFlight(0)
+     , _firstToken(0)
+     , _reportPending(false)
+     , _airtimeStart(0)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+     memset(&_result, 0, sizeof(_result));
+ }
+ 
+ // Start a benchmark
+ bool LoRaBench::start(LoRaBenchMode mode, uint16_t peer, uint16_t count, uint8_t size) {
+     if ((mode != LORA_BENCH_MODE_PING && mode != LORA_BENCH_MODE_FLOOD) || peer == 0xFFFF || count == 0) {
+         return false;
+     }
+ 
+     uint64_t airtime = loraStats.getTxAirtime();
+ 
+     portENTER_CRITICAL(&_lock);
+     memset(&_result, 0, sizeof(_result));
+     _result.mode = mode;
+     _result.running = true;
+     _result.peer = peer;
+     _result.count = count;
+     _result.size = constrain(size, LORA_BENCH_HEADER_SIZE, LORA_MAX_PAYLOAD_LENGTH);
+     _result.rttMinMs = UINT32_MAX;
+     _started = millis();
+     _awaiting = false;
+     _inFlight = 0;
+     _firstToken = 0;
+     _airtimeStart = airtime;
+     portEXIT_CRITICAL(&_lock);
+ 
+     TDECK_LOG_I("LoRa %s benchmark to 0x%04X: %d x %d bytes",
+                 mode == LORA_BENCH_MODE_PING ? "ping" : "flood", peer, count, _result.size);
+     return true;
+ }
+ 
+ // Stop the benchmark in progress
+ void LoRaBench::stop() {
+     portENTER_CRITICAL(&_lock);
+     if (_result.running) {
+         finish(millis());
+     }
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Answer pings and time pongs
+ void LoRaBench::onPacket(const LoRaPacket& packet) {
+     if (packet.length < LORA_BENCH_HEADER_SIZE) {
+         return;
+     }
+ 
+     uint8_t op = packet.payload[0];
+     uint16_t seq = (packet.payload[1] << 8) | packet.payload[2];
+ 
+     if (op == LORA_BENCH_PING) {
+         // Echo the whole probe so both directions carry the same payload
+         LoRaPacketRef reply = loraManager.createPacket(LORA_MSG_BENCH, packet.sourceId);
+         if (reply) {
+             memcpy(reply->payload, packet.payload, packet.length);
+             reply->payload[0] = LORA_BENCH_PONG;
+             reply->length = packet.length;
+             loraManager.sendPacket(reply);
+         }
+     } else if (op == LORA_BENCH_PONG) {
+         uint32_t now = millis();
+         uint32_t stamp = ((uint32_t)packet.payload[3] << 24) | ((uint32_t)packet.payload[4] << 16) |
+                          ((uint32_t)packet.payload[5] << 8) | packet.payload[6];
+         uint32_t rtt = now - stamp;
+ 
+         portENTER_CRITICAL(&_lock);
+         // Late pongs for a ping that already timed out are ignored
+         if (_result.running && _result.mode == LORA_BENCH_MODE_PING && _awaiting &&
+             packet.sourceId == _result.peer && seq == (uint16_t)(_result.sent - 1)) {
+             _awaiting = false;
+             _result.received++;
+             _result.rttTotalMs += rtt;
+             _result.rttMinMs = min(_result.rttMinMs, rtt);
+             _result.rttMaxMs = max(_result.rttMaxMs, rtt);
+             if (_result.sent >= _result.count) {
+                 finish(now);
+             }
+         }
+         portEXIT_CRITICAL(&_lock);
+     }
+ 
+     // Flood data only needs the reliable ACK
+ }
+ 
+ // Send the next packets and time out lost pings
+ uint32_t LoRaBench::service() {
+     // Logging is not allowed inside the lock, so completions report here
+     if (_reportPending) {
+         _reportPending = false;
+         LoRaBenchResult result;
+         getResult(result);
+         TDECK_LOG_I("LoRa benchmark done: %d/%d in %lu ms, %.0f bit/s", result.received, result.sent,
+                     (unsigned long)result.elapsedMs, goodput(result));
+     }
+ 
+     if (!_result.running) {
+         return UINT32_MAX;
+     }
+ 
+     uint32_t now = millis();
+ 
+     portENTER_CRITICAL(&_lock);
+     LoRaBenchMode mode = _result.mode;
+     if (mode == LORA_BENCH_MODE_PING && _awaiting) {
+         if (!isDue(_deadline, now)) {
+             uint32_t remaining = _deadline - now;
+             portEXIT_CRITICAL(&_lock);
+             return remaining;
+         }
+         _awaiting = false;
+         _result.failed++;
+     }
+     if (_result.running && _result.sent >= _result.count && (mode == LORA_BENCH_MODE_PING || _inFlight == 0)) {
+         finish(now);
+     }
+     bool running = _result.running;
+     uint16_t seq = _result.sent;
+     uint16_t count = _result.count;
+     portEXIT_CRITICAL(&_lock);
+ 
+     if (!running) {
+         return UINT32_MAX;
+     }
+ 
+     if (mode == LORA_BENCH_MODE_PING) {
+         // One probe at a time, so every RTT is a clean sample
+         LoRaPacketRef packet = createPacket(LORA_BENCH_PING, seq);
+         if (!packet) {
+             return TDECK_LORA_ACK_DELAY_MS;
+         }
+ 
+         portENTER_CRITICAL(&_lock);
+         _result.sent++;
+         _awaiting = true;
+         _deadline = now + TDECK_LORA_BENCH_PING_TIMEOUT_MS;
+         portEXIT_CRITICAL(&_lock);
+ 
+         loraManager.sendPacket(packet);
+         return TDECK_LORA_BENCH_PING_TIMEOUT_MS;
+     }
+ 
+     // Keep the reliable window full, completions make room for more
+     while (seq < count) {
+         LoRaPacketRef packet = createPacket(LORA_BENCH_DATA, seq);
+         if (!packet) {
+             return TDECK_LORA_ACK_DELAY_MS;
+         }
+ 
+         uint32_t token = loraManager.sendReliable(packet, onDelivered, this);
+         if (token == 0) {
+             break;
+         }
+ 
+         portENTER_CRITICAL(&_lock);
+         if (_firstToken == 0) {
+             _firstToken = token;
+         }
+         _result.sent++;
+         _inFlight++;
+         portEXIT_CRITICAL(&_lock);
+         seq++;
+     }
+ 
+     return UINT32_MAX;
+ }
+ 
+ // Get a snapshot of the benchmark
+ void LoRaBench::getResult(LoRaBenchResult& result) const {
+     uint64_t airtime = loraStats.getTxAirtime();
+ 
+     portENTER_CRITICAL(&_lock);
+     result = _result;
+     if (result.running) {
+         result.elapsedMs = millis() - _started;
+         result.airtimeMicros = airtime - _airtimeStart;
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     if (result.rttMinMs == UINT32_MAX) {
+         result.rttMinMs = 0;
+     }
+ }
+ 
+ // Delivered payload bits per second
+ float LoRaBench::goodput(const LoRaBenchResult& result) {
+     if (result.elapsedMs == 0 || result.received == 0) {
+         return 0;
+     }
+     return (float)result.received * result.size * 8000.0f / result.elapsedMs;
+ }
+ 
+ // Build a benchmark packet, padded to the configured size
+ LoRaPacketRef LoRaBench::createPacket(uint8_t op, uint16_t seq) {
+     LoRaPacketRef packet = loraManager.createPacket(LORA_MSG_BENCH, _result.peer);
+     if (!packet) {
+         return packet;
+     }
+ 
+     uint32_t now = millis();
+     packet->payload[0] = op;
+     packet->payload[1] = seq >> 8;
+     packet->payload[2] = seq & 0xFF;
+     packet->payload[3] = now >> 24;
+     packet->payload[4] = (now >> 16) & 0xFF;
+     packet->payload[5] = (now >> 8) & 0xFF;
+     packet->payload[6] = now & 0xFF;
+     for (int i = LORA_BENCH_HEADER_SIZE; i < _result.size; i++) {
+         packet->payload[i] = i;
+     }
+     packet->length = _result.size;
+     return packet;
+ }
+ 
+ // Finish the benchmark
+ void LoRaBench::finish(uint32_t now) {
+     _result.running = false;
+     _result.elapsedMs = now - _started;
+     _result.airtimeMicros = loraStats.getTxAirtime() - _airtimeStart;
+     _awaiting = false;
+     _reportPending = true;
+ }
+ 
+ // Count a delivered or lost flood packet
+ void LoRaBench::onDelivered(uint32_t token, uint16_t destId, bool delivered, void* context) {
+     LoRaBench* bench = static_cast<LoRaBench*>(context);
+     uint32_t now = millis();
+ 
+     portENTER_CRITICAL(&bench->_lock);
+     // Completions of a stopped or replaced run are not counted
+     if (bench->_result.running && bench->_result.mode == LORA_BENCH_MODE_FLOOD &&
+         bench->_firstToken != 0 && (int32_t)(token - bench->_firstToken) >= 0 && destId == bench->_result.peer) {
+         if (delivered) {
+             bench->_result.received++;
+         } else {
+             bench->_result.failed++;
+         }
+         bench->_inFlight--;
+         if (bench->_result.sent >= bench->_result.count && bench->_inFlight == 0) {
+             bench->finish(now);
+         }
+     }
+     portEXIT_CRITICAL(&bench->_lock);
+ }
\ No newline at end of file
@@ -0,0 +1,131 @@
+/**
+ * @file lora_bench.h
+ * @brief Ping and flood benchmark between two LoRa devices
+ *
+ * This file contains the built-in link benchmark. Ping mode sends one
+ * unacknowledged probe at a time and the peer echoes it straight back, which
+ * measures round-trip time and loss without retransmissions. Flood mode keeps
+ * the reliable window full with fixed-size packets and reports the goodput
+ * actually delivered. Any device running this firmware answers as the peer.
+ */
+
+ #ifndef TDECK_COMMS_LORA_BENCH_H
+ #define TDECK_COMMS_LORA_BENCH_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "lora_packet.h"
+ 
+ // Benchmark payload header: operation (1), sequence (2), sender millis() (4)
+ #define LORA_BENCH_HEADER_SIZE 7
+ 
+ // Benchmark payload operations
+ enum LoRaBenchOp {
+     LORA_BENCH_PING = 0,    // Probe, answered with a pong
+     LORA_BENCH_PONG = 1,    // Echoed probe
+     LORA_BENCH_DATA = 2     // Flood packet, only acknowledged
+ };
+ 
+ // Benchmark modes
+ enum LoRaBenchMode {
+     LORA_BENCH_IDLE = 0,    // No benchmark has run
+     LORA_BENCH_MODE_PING,   // Round-trip time and loss
+     LORA_BENCH_MODE_FLOOD   // Reliable goodput
+ };
+ 
+ // Progress or result of the last benchmark
+ struct LoRaBenchResult {
+     LoRaBenchMode mode;     // Benchmark mode
+     bool running;           // Still in progress
+     uint16_t peer;          // Peer device ID
+     uint16_t count;         // Packets to send
+     uint8_t size;           // Payload bytes per packet
+     uint16_t sent;          // Packets sent
+     uint16_t received;      // Pongs received or packets delivered
+     uint16_t failed;        // Pings timed out or packets lost
+     uint32_t rttMinMs;      // Fastest round trip (ping)
+     uint32_t rttMaxMs;      // Slowest round trip (ping)
+     uint32_t rttTotalMs;    // Sum of round trips (ping)
+     uint32_t elapsedMs;     // Time from the first send to the last completion
+     uint64_t airtimeMicros; // Transmit airtime spent by this device
+ };
+ 
+ /**
+  * @class LoRaBench
+  * @brief Ping/flood state machine, serviced by the LoRa comms task
+  */
+ class LoRaBench {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaBench();
+ 
+     /**
+      * @brief Start a benchmark, replacing any one in progress
+      * @param mode LORA_BENCH_MODE_PING or LORA_BENCH_MODE_FLOOD
+      * @param peer Peer device ID, must be unicast
+      * @param count Packets to send
+      * @param size Payload bytes per packet
+      * @return true if started
+      */
+     bool start(LoRaBenchMode mode, uint16_t peer, uint16_t count, uint8_t size);
+ 
+     /**
+      * @brief Stop the benchmark in progress, keeping its partial result
+      */
+     void stop();
+ 
+     /**
+      * @brief Handle a received benchmark packet
+      * @param packet Packet of type LORA_MSG_BENCH addressed to us
+      */
+     void onPacket(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Send the next packets and time out lost pings
+      * @return Milliseconds until the next call is needed, UINT32_MAX if idle
+      */
+     uint32_t service();
+ 
+     /**
+      * @brief Get the progress or result of the last benchmark
+      * @param result Receives a snapshot
+      */
+     void getResult(LoRaBenchResult& result) const;
+ 
+     /**
+      * @brief Compute the goodput of a result
+      * @param result Benchmark result
+      * @return Delivered payload bits per second, 0 if nothing was delivered
+      */
+     static float goodput(const LoRaBenchResult& result);
+ 
+ private:
+     LoRaBenchResult _result;    // Current or last benchmark
+     uint32_t _started;          // millis() of the first send
+     uint32_t _deadline;         // millis() the outstanding ping times out
+     bool _awaiting;             // A ping is outstanding
+     uint16_t _inFlight;         // Flood packets not yet completed
+     uint32_t _firstToken;       // Delivery token of the first flood packet, 0 before it is sent
+     bool _reportPending;        // Finished but not yet logged
+     uint64_t _airtimeStart;     // Transmit airtime when the benchmark started
+     mutable portMUX_TYPE _lock; // Guards the state above
+ 
+     /**
+      * @brief Build a benchmark packet with the header filled in
+      */
+     LoRaPacketRef createPacket(uint8_t op, uint16_t seq);
+ 
+     /**
+      * @brief Finish the benchmark, caller holds _lock, the result is logged by service()
+      */
+     void finish(uint32_t now);
+ 
+     /**
+      * @brief Reliable delivery callback for one flood packet
+      */
+     static void onDelivered(uint32_t token, uint16_t destId, bool delivered, void* context);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_BENCH_H
\ No newline at end of file
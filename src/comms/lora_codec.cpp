@@ -0,0 +1,506 @@
+/**
+ * @file lora_codec.cpp
+ * @brief Implementation of the binary LoRa payload encoding
+ */
+
+ #include "lora_codec.h"
+ 
+ // Well-known fields and their JSON keys
+ struct LoRaFieldKey {
+     uint8_t field;
+     const char* key;
+ };
+ 
+ static const LoRaFieldKey FIELD_KEYS[] = {
+     { LORA_FIELD_CMD, "cmd" },
+     { LORA_FIELD_BATTERY, "battery" },
+     { LORA_FIELD_CHARGING, "charging" },
+     { LORA_FIELD_RSSI, "rssi" },
+     { LORA_FIELD_SNR, "snr" },
+     { LORA_FIELD_UPTIME, "uptime" },
+     { LORA_FIELD_STATE, "state" },
+     { LORA_FIELD_NAME, "name" },
+     { LORA_FIELD_HEAP, "heap" },
+ };
+ 
+ // Text dictionary, ordered roughly by how often the entry shows up in chat.
+ // Entry i is written as code 0x80 + i, entries past 127 use codes 0x02-0x1F.
+ static const char* const TEXT_DICTIONARY[] = {
+     " the", " you", " to", " and", " is", " in", " it", " of", " for", " on", " are", " be", " at", " me",
+     " my", " we", " can", " do", " not", " have", " with", " that", " this", " what", " will", " just",
+     " now", " here", " there", " your", " when", " where", " how", " see", " get", " go", " going", " know",
+     " like", " good", " back", " time", " come", " home", " out", " up", " so", " but", " if", " all",
+     " was", " from", " got", " need", " want", " think", " one", " did", " about", " they", " then", " way",
+     " today", " tomorrow", " tonight", " soon", " later", " meet", " wait", " call", " let", " an", " or",
+     " our", " us", " some", " more", " would", " could", " should", " still", " right", " left", " min",
+     " minutes", " water", " food", " help", " safe", " ok", " yes", " no", " thanks", " please", " trail",
+     " camp", " road", " signal", " battery", " copy", " north", " south", " east", " west",
+     "I'm ", "I'll ", "I ", "OK", "Ok", "Yes", "No", "Hi", "Hey", "Thanks", "The", "You", "Where", "What",
+     "When", "How", "Can",
+     "ing", "tion", "ion", "ent", "ight", "ould", "n't", "'s", "th", "he", "in", "er", "an", "re", "on", "at",
+     "en", "nd", "es", "or", "ed", "st", "ar", "ou", "ll", "ve", "le", "e ", "s ", "t ", "d ", "y ", ". ",
+     ", ", "? ", "! ", "..",
+ };
+ 
+ // Text codes outside the dictionary
+ #define TEXT_ESCAPE_BYTE 0x00   // One literal byte follows
+ #define TEXT_ESCAPE_RUN 0x01    // Length byte and that many literal bytes follow
+ #define TEXT_LOW_FIRST 0x02     // First low dictionary code
+ #define TEXT_LOW_LAST 0x1F      // Last low dictionary code
+ 
+ static_assert(sizeof(TEXT_DICTIONARY) / sizeof(TEXT_DICTIONARY[0]) == 128 + TEXT_LOW_LAST - TEXT_LOW_FIRST + 1,
+               "Text dictionary must fill every dictionary code");
+ 
+ static inline bool isPrintable(uint8_t c) {
+     return c >= 0x20 && c < 0x7F;
+ }
+ 
+ static_assert(LORA_FIELD_MAX < 32, "Field ids must fit the high 5 bits of a tag byte");
+ static_assert(LORA_SCHEMA_VERSION != '{', "Schema version must differ from a JSON payload");
+ 
+ // Zigzag mapping keeps small negative values short
+ static inline uint32_t zigzagEncode(int32_t value) {
+     return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+ }
+ 
+ static inline int32_t zigzagDecode(uint32_t value) {
+     return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+ }
+ 
+ static inline void putInt32(uint8_t* buffer, int32_t value) {
+     buffer[0] = value & 0xFF;
+     buffer[1] = (value >> 8) & 0xFF;
+     buffer[2] = (value >> 16) & 0xFF;
+     buffer[3] = (value >> 24) & 0xFF;
+ }
+ 
+ static inline int32_t getInt32(const uint8_t* buffer) {
+     return (int32_t)((uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+                      ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24));
+ }
+ 
+ // Writer constructor
+ LoRaTlvWriter::LoRaTlvWriter(uint8_t* buffer, size_t capacity)
+     : _buffer(buffer)
+     , _capacity(capacity)
+     , _length(0)
+     , _failed(false)
+ {
+     uint8_t version = LORA_SCHEMA_VERSION;
+     writeRaw(&version, 1);
+ }
+ 
+ // Write an integer field
+ bool LoRaTlvWriter::writeInt(uint8_t field, int32_t value, const char* key) {
+     size_t start = _length;
+     if (!writeTag(field, LORA_WIRE_VARINT, key) || !writeVarint(zigzagEncode(value))) {
+         _length = start;
+         _failed = true;
+     }
+     return !_failed;
+ }
+ 
+ // Write a float field
+ bool LoRaTlvWriter::writeFloat(uint8_t field, float value, const char* key) {
+     size_t start = _length;
+     uint32_t bits;
+     memcpy(&bits, &value, sizeof(bits));
+ 
+     uint8_t raw[4];
+     putInt32(raw, (int32_t)bits);
+ 
+     if (!writeTag(field, LORA_WIRE_FLOAT, key) || !writeRaw(raw, sizeof(raw))) {
+         _length = start;
+         _failed = true;
+     }
+     return !_failed;
+ }
+ 
+ // Write a boolean field, the value is carried by the wire type
+ bool LoRaTlvWriter::writeBool(uint8_t field, bool value, const char* key) {
+     size_t start = _length;
+     if (!writeTag(field, value ? LORA_WIRE_TRUE : LORA_WIRE_FALSE, key)) {
+         _length = start;
+         _failed = true;
+     }
+     return !_failed;
+ }
+ 
+ // Write a string field
+ bool LoRaTlvWriter::writeString(uint8_t field, const char* value, const char* key) {
+     size_t start = _length;
+     size_t length = value ? strlen(value) : 0;
+ 
+     if (!writeTag(field, LORA_WIRE_BYTES, key) || !writeVarint(length) ||
+         !writeRaw((const uint8_t*)value, length)) {
+         _length = start;
+         _failed = true;
+     }
+     return !_failed;
+ }
+ 
+ // Get the encoded length
+ size_t LoRaTlvWriter::length() const {
+     return _failed ? 0 : _length;
+ }
+ 
+ // Write a tag byte, followed by the key for named fields
+ bool LoRaTlvWriter::writeTag(uint8_t field, LoRaWireType type, const char* key) {
+     if (_failed || field > LORA_FIELD_MAX) {
+         return false;
+     }
+ 
+     uint8_t tag = (field << 3) | type;
+     if (!writeRaw(&tag, 1)) {
+         return false;
+     }
+ 
+     if (field == LORA_FIELD_NAMED) {
+         size_t keyLength = key ? strlen(key) : 0;
+         if (keyLength == 0 || keyLength > 255) {
+             return false;
+         }
+ 
+         uint8_t length = keyLength;
+         return writeRaw(&length, 1) && writeRaw((const uint8_t*)key, keyLength);
+     }
+ 
+     return true;
+ }
+ 
+ // Write raw bytes
+ bool LoRaTlvWriter::writeRaw(const uint8_t* data, size_t length) {
+     if (_length + length > _capacity) {
+         return false;
+     }
+ 
+     memcpy(_buffer + _length, data, length);
+     _length += length;
+     return true;
+ }
+ 
+ // Write an unsigned varint, 7 bits per byte, low group first
+ bool LoRaTlvWriter::writeVarint(uint32_t value) {
+     do {
+         uint8_t byte = value & 0x7F;
+         value >>= 7;
+         if (value) {
+             byte |= 0x80;
+         }
+         if (!writeRaw(&byte, 1)) {
+             return false;
+         }
+     } while (value);
+ 
+     return true;
+ }
+ 
+ // Reader constructor
+ LoRaTlvReader::LoRaTlvReader(const uint8_t* payload, size_t length)
+     : _payload(payload)
+     , _length(length)
+     , _pos(1)
+     , _failed(!LoRaCodec::isBinary(payload, length))
+ {
+ }
+ 
+ // Read the next field
+ bool LoRaTlvReader::next(LoRaTlvField& out) {
+     if (_failed || _pos >= _length) {
+         return false;
+     }
+ 
+     uint8_t tag = _payload[_pos++];
+     out.field = tag >> 3;
+     out.type = (LoRaWireType)(tag & 0x07);
+     out.key = nullptr;
+     out.keyLength = 0;
+     out.intValue = 0;
+     out.floatValue = 0;
+     out.boolValue = false;
+     out.data = nullptr;
+     out.length = 0;
+ 
+     // Named fields carry their key
+     if (out.field == LORA_FIELD_NAMED) {
+         if (_pos >= _length || _pos + 1 + _payload[_pos] > _length) {
+             _failed = true;
+             return false;
+         }
+         out.keyLength = _payload[_pos++];
+         out.key = (const char*)(_payload + _pos);
+         _pos += out.keyLength;
+     }
+ 
+     uint32_t value;
+     switch (out.type) {
+         case LORA_WIRE_VARINT:
+             if (!readVarint(value)) {
+                 _failed = true;
+                 return false;
+             }
+             out.intValue = zigzagDecode(value);
+             break;
+ 
+         case LORA_WIRE_FLOAT:
+             if (_pos + 4 > _length) {
+                 _failed = true;
+                 return false;
+             }
+             value = (uint32_t)getInt32(_payload + _pos);
+             memcpy(&out.floatValue, &value, sizeof(value));
+             _pos += 4;
+             break;
+ 
+         case LORA_WIRE_BYTES:
+             if (!readVarint(value) || _pos + value > _length) {
+                 _failed = true;
+                 return false;
+             }
+             out.data = _payload + _pos;
+             out.length = value;
+             _pos += value;
+             break;
+ 
+         case LORA_WIRE_TRUE:
+         case LORA_WIRE_FALSE:
+             out.boolValue = out.type == LORA_WIRE_TRUE;
+             break;
+ 
+         default:
+             // Unknown wire type, the rest of the payload cannot be framed
+             _failed = true;
+             return false;
+     }
+ 
+     return true;
+ }
+ 
+ // Check whether the payload was well formed
+ bool LoRaTlvReader::ok() const {
+     return !_failed;
+ }
+ 
+ // Read an unsigned varint
+ bool LoRaTlvReader::readVarint(uint32_t& value) {
+     value = 0;
+     for (int shift = 0; shift < 35; shift += 7) {
+         if (_pos >= _length) {
+             return false;
+         }
+ 
+         uint8_t byte = _payload[_pos++];
+         value |= (uint32_t)(byte & 0x7F) << shift;
+         if (!(byte & 0x80)) {
+             return true;
+         }
+     }
+ 
+     return false;
+ }
+ 
+ // Check if a payload uses the binary schema
+ bool LoRaCodec::isBinary(const uint8_t* payload, size_t length) {
+     return length > 0 && payload[0] == LORA_SCHEMA_VERSION;
+ }
+ 
+ // Encode a location: version, lat and lon as fixed 32-bit, altitude as zigzag varint
+ size_t LoRaCodec::encodeLocation(const LoRaLocation& location, uint8_t* buffer, size_t capacity) {
+     if (capacity < LORA_LOCATION_MAX_SIZE) {
+         return 0;
+     }
+ 
+     buffer[0] = LORA_SCHEMA_VERSION;
+     putInt32(buffer + 1, location.latitude);
+     putInt32(buffer + 5, location.longitude);
+ 
+     size_t length = 9;
+     uint32_t altitude = zigzagEncode(location.altitude);
+     do {
+         uint8_t byte = altitude & 0x7F;
+         altitude >>= 7;
+         buffer[length++] = altitude ? (byte | 0x80) : byte;
+     } while (altitude);
+ 
+     return length;
+ }
+ 
+ // Decode a location
+ bool LoRaCodec::decodeLocation(const uint8_t* payload, size_t length, LoRaLocation& location) {
+     if (!isBinary(payload, length) || length < 10) {
+         return false;
+     }
+ 
+     location.latitude = getInt32(payload + 1);
+     location.longitude = getInt32(payload + 5);
+ 
+     uint32_t altitude = 0;
+     size_t pos = 9;
+     for (int shift = 0; shift < 35 && pos < length; shift += 7) {
+         uint8_t byte = payload[pos++];
+         altitude |= (uint32_t)(byte & 0x7F) << shift;
+         if (!(byte & 0x80)) {
+             location.altitude = zigzagDecode(altitude);
+             return true;
+         }
+     }
+ 
+     return false;
+ }
+ 
+ // Encode a flat JSON object, well-known keys cost one tag byte
+ size_t LoRaCodec::encodeObject(JsonObjectConst object, uint8_t* buffer, size_t capacity,
+                                const char* command) {
+     LoRaTlvWriter writer(buffer, capacity);
+ 
+     if (command) {
+         writer.writeString(LORA_FIELD_CMD, command);
+     }
+ 
+     for (JsonPairConst pair : object) {
+         const char* key = pair.key().c_str();
+         uint8_t field = fieldForKey(key);
+         const char* name = field == LORA_FIELD_NAMED ? key : nullptr;
+         JsonVariantConst value = pair.value();
+ 
+         if (value.is<bool>()) {
+             writer.writeBool(field, value.as<bool>(), name);
+         } else if (value.is<int32_t>()) {
+             writer.writeInt(field, value.as<int32_t>(), name);
+         } else if (value.is<float>()) {
+             writer.writeFloat(field, value.as<float>(), name);
+         } else if (value.is<const char*>()) {
+             writer.writeString(field, value.as<const char*>(), name);
+         } else {
+             // Nested values have no binary form, the caller falls back to JSON
+             return 0;
+         }
+     }
+ 
+     return writer.length();
+ }
+ 
+ // Get the JSON key of a well-known field
+ const char* LoRaCodec::fieldKey(uint8_t field) {
+     for (const LoRaFieldKey& entry : FIELD_KEYS) {
+         if (entry.field == field) {
+             return entry.key;
+         }
+     }
+     return nullptr;
+ }
+ 
+ // Get the well-known field for a JSON key
+ uint8_t LoRaCodec::fieldForKey(const char* key) {
+     for (const LoRaFieldKey& entry : FIELD_KEYS) {
+         if (strcmp(entry.key, key) == 0) {
+             return entry.field;
+         }
+     }
+     return LORA_FIELD_NAMED;
+ }
+ 
+ // Greedy longest match against the dictionary, literals for the rest
+ size_t LoRaCodec::compressText(const uint8_t* text, size_t length, uint8_t* buffer, size_t capacity) {
+     // Only a shorter result is worth the flag
+     size_t limit = min(capacity, length > 0 ? length - 1 : 0);
+     size_t out = 0;
+     size_t pos = 0;
+ 
+     while (pos < length) {
+         int best = -1;
+         size_t bestLength = 1;
+         for (size_t i = 0; i < sizeof(TEXT_DICTIONARY) / sizeof(TEXT_DICTIONARY[0]); i++) {
+             const char* entry = TEXT_DICTIONARY[i];
+             if ((uint8_t)entry[0] != text[pos]) {
+                 continue;
+             }
+ 
+             size_t n = strlen(entry);
+             if (n > bestLength && n <= length - pos && memcmp(entry, text + pos, n) == 0) {
+                 best = i;
+                 bestLength = n;
+             }
+         }
+ 
+         if (best >= 0) {
+             if (out + 1 > limit) {
+                 return 0;
+             }
+             buffer[out++] = best < 128 ? 0x80 + best : TEXT_LOW_FIRST + best - 128;
+             pos += bestLength;
+         } else if (isPrintable(text[pos])) {
+             if (out + 1 > limit) {
+                 return 0;
+             }
+             buffer[out++] = text[pos++];
+         } else {
+             // UTF-8 sequences and control bytes go out verbatim as one run
+             size_t run = 1;
+             while (pos + run < length && run < 255 && !isPrintable(text[pos + run])) {
+                 run++;
+             }
+ 
+             size_t needed = run == 1 ? 2 : run + 2;
+             if (out + needed > limit) {
+                 return 0;
+             }
+             if (run == 1) {
+                 buffer[out++] = TEXT_ESCAPE_BYTE;
+             } else {
+                 buffer[out++] = TEXT_ESCAPE_RUN;
+                 buffer[out++] = run;
+             }
+             memcpy(buffer + out, text + pos, run);
+             out += run;
+             pos += run;
+         }
+     }
+ 
+     return out;
+ }
+ 
+ // Expand compressed text, no allocation
+ size_t LoRaCodec::expandText(const uint8_t* payload, size_t length, uint8_t* buffer, size_t capacity) {
+     size_t out = 0;
+     size_t pos = 0;
+ 
+     while (pos < length) {
+         uint8_t code = payload[pos++];
+         const uint8_t* data;
+         size_t n;
+ 
+         if (code == TEXT_ESCAPE_BYTE || code == TEXT_ESCAPE_RUN) {
+             n = 1;
+             if (code == TEXT_ESCAPE_RUN) {
+                 if (pos >= length) {
+                     return 0;
+                 }
+                 n = payload[pos++];
+             }
+             if (n == 0 || pos + n > length) {
+                 return 0;
+             }
+             data = payload + pos;
+             pos += n;
+         } else if (isPrintable(code)) {
+             data = payload + pos - 1;
+             n = 1;
+         } else if (code >= 0x80 || (code >= TEXT_LOW_FIRST && code <= TEXT_LOW_LAST)) {
+             const char* entry = TEXT_DICTIONARY[code >= 0x80 ? code - 0x80 : 128 + code - TEXT_LOW_FIRST];
+             data = (const uint8_t*)entry;
+             n = strlen(entry);
+         } else {
+             // 0x7F is not assigned
+             return 0;
+         }
+ 
+         if (out + n > capacity) {
+             return 0;
+         }
+         memcpy(buffer + out, data, n);
+         out += n;
+     }
+ 
+     return out;
+ }
\ No newline at end of file
@@ -0,0 +1,280 @@
+/**
+ * @file lora_codec.h
+ * @brief Compact binary payload encoding for LoRa messages
+ *
+ * This file contains the versioned binary schema used for location, status
+ * and command payloads. Every binary payload starts with the schema version
+ * byte, JSON payloads from older nodes start with '{', so both can be told
+ * apart on receive. Encoding and decoding work on caller supplied buffers
+ * and never allocate.
+ */
+
+ #ifndef TDECK_COMMS_LORA_CODEC_H
+ #define TDECK_COMMS_LORA_CODEC_H
+ 
+ #include <Arduino.h>
+ #include <ArduinoJson.h>
+ 
+ // Binary schema version, first byte of every binary payload
+ #define LORA_SCHEMA_VERSION 1
+ 
+ // Capability trailer appended after the payload of every packet we send:
+ // magic, capability level, packet flags, offered data rate, hops (count in the
+ // high nibble, remaining limit in the low nibble) and transmission attempt.
+ // Older nodes stop reading at the header length and never see it.
+ #define LORA_CAPS_MAGIC 0xC5
+ #define LORA_CAPS_TRAILER_SIZE 6
+ 
+ // Highest capability level advertised in the trailer schema byte, peers at
+ // LORA_CAPS_COMPRESSED_TEXT or above expand compressed text messages
+ #define LORA_CAPS_LEVEL 2
+ #define LORA_CAPS_COMPRESSED_TEXT 2
+ 
+ // Encoded size of a location payload: version, lat, lon and up to 5 varint bytes of altitude
+ #define LORA_LOCATION_MAX_SIZE (1 + 4 + 4 + 5)
+ 
+ // TLV wire types, low 3 bits of a tag byte
+ enum LoRaWireType {
+     LORA_WIRE_VARINT = 0,   // Zigzag varint integer
+     LORA_WIRE_FLOAT = 1,    // IEEE 754 float, little endian
+     LORA_WIRE_BYTES = 2,    // Varint length followed by the bytes
+     LORA_WIRE_TRUE = 3,     // Boolean true, no value bytes
+     LORA_WIRE_FALSE = 4     // Boolean false, no value bytes
+ };
+ 
+ // Well-known TLV fields, high 5 bits of a tag byte
+ enum LoRaField {
+     LORA_FIELD_NAMED = 0,   // Key follows the tag as length-prefixed bytes
+     LORA_FIELD_CMD = 1,     // Command name
+     LORA_FIELD_BATTERY = 2, // Battery level in percent
+     LORA_FIELD_CHARGING = 3,// Charging flag
+     LORA_FIELD_RSSI = 4,    // RSSI in dBm
+     LORA_FIELD_SNR = 5,     // SNR in dB
+     LORA_FIELD_UPTIME = 6,  // Uptime in seconds
+     LORA_FIELD_STATE = 7,   // Free-form state string
+     LORA_FIELD_NAME = 8,    // Device name
+     LORA_FIELD_HEAP = 9,    // Free heap in bytes
+     LORA_FIELD_MAX = 31     // Largest id that fits a tag byte
+ };
+ 
+ // Location in fixed point, 1e-7 degrees resolves about 1 cm
+ struct LoRaLocation {
+     int32_t latitude;       // Latitude in degrees * 1e7
+     int32_t longitude;      // Longitude in degrees * 1e7
+     int32_t altitude;       // Altitude in decimetres
+ };
+ 
+ // One decoded TLV field, data and key point into the payload
+ struct LoRaTlvField {
+     uint8_t field;          // Field id (LORA_FIELD_NAMED if key is set)
+     LoRaWireType type;      // Wire type
+     const char* key;        // Key of a named field (not null-terminated)
+     uint8_t keyLength;      // Key length
+     int32_t intValue;       // LORA_WIRE_VARINT value
+     float floatValue;       // LORA_WIRE_FLOAT value
+     bool boolValue;         // LORA_WIRE_TRUE/FALSE value
+     const uint8_t* data;    // LORA_WIRE_BYTES data
+     size_t length;          // LORA_WIRE_BYTES length
+ };
+ 
+ /**
+  * @class LoRaTlvWriter
+  * @brief Appends type-tagged fields to a fixed buffer
+  *
+  * A write that does not fit marks the writer as failed and leaves the
+  * buffer unchanged from that point on.
+  */
+ class LoRaTlvWriter {
+ public:
+     /**
+      * @brief Constructor, writes the schema version byte
+      * @param buffer Output buffer
+      * @param capacity Buffer size in bytes
+      */
+     LoRaTlvWriter(uint8_t* buffer, size_t capacity);
+ 
+     /**
+      * @brief Write an integer field
+      * @param field Field id
+      * @param value Value
+      * @param key Key for LORA_FIELD_NAMED, otherwise nullptr
+      * @return true if the field fit
+      */
+     bool writeInt(uint8_t field, int32_t value, const char* key = nullptr);
+ 
+     /**
+      * @brief Write a float field
+      * @param field Field id
+      * @param value Value
+      * @param key Key for LORA_FIELD_NAMED, otherwise nullptr
+      * @return true if the field fit
+      */
+     bool writeFloat(uint8_t field, float value, const char* key = nullptr);
+ 
+     /**
+      * @brief Write a boolean field
+      * @param field Field id
+      * @param value Value
+      * @param key Key for LORA_FIELD_NAMED, otherwise nullptr
+      * @return true if the field fit
+      */
+     bool writeBool(uint8_t field, bool value, const char* key = nullptr);
+ 
+     /**
+      * @brief Write a string field
+      * @param field Field id
+      * @param value Null-terminated string
+      * @param key Key for LORA_FIELD_NAMED, otherwise nullptr
+      * @return true if the field fit
+      */
+     bool writeString(uint8_t field, const char* value, const char* key = nullptr);
+ 
+     /**
+      * @brief Get the number of bytes written
+      * @return Encoded length, 0 if any write failed
+      */
+     size_t length() const;
+ 
+ private:
+     uint8_t* _buffer;            // Output buffer
+     size_t _capacity;            // Buffer size
+     size_t _length;              // Bytes written
+     bool _failed;                // A write did not fit
+ 
+     /**
+      * @brief Write a tag byte and the key of a named field
+      */
+     bool writeTag(uint8_t field, LoRaWireType type, const char* key);
+ 
+     /**
+      * @brief Write raw bytes
+      */
+     bool writeRaw(const uint8_t* data, size_t length);
+ 
+     /**
+      * @brief Write an unsigned varint
+      */
+     bool writeVarint(uint32_t value);
+ };
+ 
+ /**
+  * @class LoRaTlvReader
+  * @brief Iterates the type-tagged fields of a binary payload
+  */
+ class LoRaTlvReader {
+ public:
+     /**
+      * @brief Constructor, skips the schema version byte
+      * @param payload Binary payload
+      * @param length Payload length
+      */
+     LoRaTlvReader(const uint8_t* payload, size_t length);
+ 
+     /**
+      * @brief Read the next field
+      * @param out Decoded field
+      * @return true if a field was read, false at the end or on malformed input
+      */
+     bool next(LoRaTlvField& out);
+ 
+     /**
+      * @brief Check whether the payload was read to the end without errors
+      * @return true if well formed
+      */
+     bool ok() const;
+ 
+ private:
+     const uint8_t* _payload;     // Payload
+     size_t _length;              // Payload length
+     size_t _pos;                 // Read position
+     bool _failed;                // Malformed input seen
+ 
+     /**
+      * @brief Read an unsigned varint
+      */
+     bool readVarint(uint32_t& value);
+ };
+ 
+ /**
+  * @class LoRaCodec
+  * @brief Encodes and decodes the binary message payloads
+  */
+ class LoRaCodec {
+ public:
+     /**
+      * @brief Check if a payload uses the binary schema
+      * @param payload Payload
+      * @param length Payload length
+      * @return true for binary payloads, false for JSON
+      */
+     static bool isBinary(const uint8_t* payload, size_t length);
+ 
+     /**
+      * @brief Encode a location
+      * @param location Location to encode
+      * @param buffer Output buffer, at least LORA_LOCATION_MAX_SIZE bytes
+      * @param capacity Buffer size
+      * @return Encoded length, 0 if it did not fit
+      */
+     static size_t encodeLocation(const LoRaLocation& location, uint8_t* buffer, size_t capacity);
+ 
+     /**
+      * @brief Decode a location
+      * @param payload Binary payload
+      * @param length Payload length
+      * @param location Decoded location
+      * @return true if the payload was a valid location
+      */
+     static bool decodeLocation(const uint8_t* payload, size_t length, LoRaLocation& location);
+ 
+     /**
+      * @brief Encode a flat JSON object as TLV fields
+      * @param object Object to encode, nested objects and arrays are not supported
+      * @param buffer Output buffer
+      * @param capacity Buffer size
+      * @param command Command name written first as LORA_FIELD_CMD, or nullptr
+      * @return Encoded length, 0 if it did not fit or could not be encoded
+      */
+     static size_t encodeObject(JsonObjectConst object, uint8_t* buffer, size_t capacity,
+                                const char* command = nullptr);
+ 
+     /**
+      * @brief Get the JSON key of a well-known field
+      * @param field Field id
+      * @return Key, or nullptr if the field is not well known
+      */
+     static const char* fieldKey(uint8_t field);
+ 
+     /**
+      * @brief Get the well-known field for a JSON key
+      * @param key Key
+      * @return Field id, LORA_FIELD_NAMED if the key is not well known
+      */
+     static uint8_t fieldForKey(const char* key);
+ 
+     /**
+      * @brief Compress short text with the static chat dictionary
+      * 
+      * Printable ASCII is kept as is, common words and fragments become one
+      * byte, anything else is escaped.
+      * 
+      * @param text Text, UTF-8 or any bytes
+      * @param length Text length
+      * @param buffer Output buffer
+      * @param capacity Buffer size
+      * @return Compressed length, 0 if it would not be shorter than the text or did not fit
+      */
+     static size_t compressText(const uint8_t* text, size_t length, uint8_t* buffer, size_t capacity);
+ 
+     /**
+      * @brief Expand text compressed by compressText()
+      * @param payload Compressed text
+      * @param length Compressed length
+      * @param buffer Output buffer
+      * @param capacity Buffer size
+      * @return Text length, 0 if the input is malformed or did not fit
+      */
+     static size_t expandText(const uint8_t* payload, size_t length, uint8_t* buffer, size_t capacity);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_CODEC_H
\ No newline at end of file
@@ -0,0 +1,452 @@
+/**
+ * @file lora_fragment.cpp
+ * @brief Implementation of LoRa fragmentation and reassembly
+ */
+
+ #include "lora_fragment.h"
+ #include "lora.h"
+ #include "../system/fs_manager.h"
+ #include "../system/trace.h"
+ #include <esp_heap_caps.h>
+ 
+ // Payload bytes carried by every fragment but the last
+ #define LORA_FRAGMENT_DATA_SIZE (LORA_MAX_PAYLOAD_LENGTH - LORA_FRAGMENT_HEADER_SIZE)
+ 
+ // Finished transfer, reported after the lock is released
+ struct LoRaTransferResult {
+     LoRaTransferCallback callback;
+     void* context;
+     uint16_t id;
+     bool delivered;
+ };
+ 
+ static void reportResults(const LoRaTransferResult* results, int count) {
+     for (int i = 0; i < count; i++) {
+         if (results[i].callback) {
+             results[i].callback(results[i].id, results[i].delivered, results[i].context);
+         }
+     }
+ }
+ 
+ // Signed deadline check that survives millis() wrap-around
+ static inline bool isDue(uint32_t deadline, uint32_t now) {
+     return (int32_t)(deadline - now) <= 0;
+ }
+ 
+ // Constructor
+ LoRaFragmenter::LoRaFragmenter()
+     : _callbacks()
+     , _lock(NULL)
+     , _nextId(0)
+ {
+     for (Transfer& transfer : _transfers) {
+         transfer.owner = this;
+         transfer.active = false;
+         transfer.buffer = nullptr;
+     }
+     for (Reassembly& reassembly : _reassembly) {
+         reassembly.active = false;
+         reassembly.buffer = nullptr;
+     }
+ }
+ 
+ // Create the lock
+ bool LoRaFragmenter::init() {
+     if (!_lock) {
+         _lock = xSemaphoreCreateMutex();
+     }
+ 
+     // Random start so a restarted sender does not collide with its old transfers
+     _nextId = esp_random() & 0xFFFF;
+     return _lock != NULL;
+ }
+ 
+ // Send a buffer as a fragmented transfer
+ uint16_t LoRaFragmenter::sendBuffer(uint8_t messageType, uint16_t destId, const uint8_t* data, size_t length,
+                                     LoRaTransferCallback callback, void* context) {
+     if (!_lock || !data || length == 0) {
+         return 0;
+     }
+ 
+     if (length > TDECK_LORA_TRANSFER_MAX) {
+         TDECK_LOG_E("LoRa transfer too large: %u bytes", (unsigned)length);
+         return 0;
+     }
+ 
+     uint8_t* buffer = (uint8_t*)heap_caps_malloc(length, MALLOC_CAP_SPIRAM);
+     if (!buffer) {
+         TDECK_LOG_E("Failed to allocate LoRa transfer buffer");
+         return 0;
+     }
+     memcpy(buffer, data, length);
+ 
+     LoRaTransferResult result = { callback, context, 0, false };
+     bool finished = false;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     Transfer* transfer = startTransfer(messageType, destId, length, callback, context);
+     if (transfer) {
+         transfer->buffer = buffer;
+         result.id = transfer->id;
+         finished = pump(*transfer);
+         if (finished) {
+             result.delivered = !transfer->failed;
+             endTransfer(*transfer);
+         }
+     }
+     xSemaphoreGive(_lock);
+ 
+     if (!transfer) {
+         heap_caps_free(buffer);
+         return 0;
+     }
+ 
+     if (finished) {
+         reportResults(&result, 1);
+     }
+     return result.id;
+ }
+ 
+ // Send a file as a fragmented transfer
+ uint16_t LoRaFragmenter::sendFile(uint8_t messageType, uint16_t destId, const char* path,
+                                   LoRaTransferCallback callback, void* context) {
+     if (!_lock || !path) {
+         return 0;
+     }
+ 
+     fs::File file = FSManager::open_file(path, "r");
+     if (!file) {
+         TDECK_LOG_E("Failed to open %s for LoRa transfer", path);
+         return 0;
+     }
+ 
+     size_t length = file.size();
+     if (length == 0 || length > TDECK_LORA_TRANSFER_MAX) {
+         TDECK_LOG_E("Cannot send %s over LoRa: %u bytes", path, (unsigned)length);
+         return 0;
+     }
+ 
+     LoRaTransferResult result = { callback, context, 0, false };
+     bool finished = false;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     Transfer* transfer = startTransfer(messageType, destId, length, callback, context);
+     if (transfer) {
+         transfer->file = file;
+         result.id = transfer->id;
+         finished = pump(*transfer);
+         if (finished) {
+             result.delivered = !transfer->failed;
+             endTransfer(*transfer);
+         }
+     }
+     xSemaphoreGive(_lock);
+ 
+     if (finished) {
+         reportResults(&result, 1);
+     }
+     return result.id;
+ }
+ 
+ // Add a received fragment to its transfer
+ void LoRaFragmenter::onFragment(const LoRaPacket& packet) {
+     if (!_lock || packet.length < LORA_FRAGMENT_HEADER_SIZE) {
+         return;
+     }
+ 
+     uint16_t id = (packet.payload[0] << 8) | packet.payload[1];
+     uint8_t index = packet.payload[2];
+     uint8_t count = packet.payload[3];
+     const uint8_t* data = packet.payload + LORA_FRAGMENT_HEADER_SIZE;
+     size_t length = packet.length - LORA_FRAGMENT_HEADER_SIZE;
+     bool last = index + 1 == count;
+ 
+     // Every fragment but the last is full, which fixes each one's offset
+     if (count == 0 || index >= count || (!last && length != LORA_FRAGMENT_DATA_SIZE) ||
+         length > LORA_FRAGMENT_DATA_SIZE) {
+         TDECK_TRACE_W(LORA, "Malformed LoRa fragment from 0x%04X", packet.sourceId);
+         return;
+     }
+ 
+     if ((size_t)(count - 1) * LORA_FRAGMENT_DATA_SIZE >= TDECK_LORA_TRANSFER_MAX) {
+         TDECK_TRACE_W(LORA, "LoRa transfer from 0x%04X too large, dropped", packet.sourceId);
+         return;
+     }
+ 
+     uint32_t now = millis();
+     uint8_t* complete = nullptr;
+     size_t completeLength = 0;
+     uint8_t messageType = 0;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+ 
+     Reassembly* slot = nullptr;
+     Reassembly* unused = nullptr;
+     for (Reassembly& reassembly : _reassembly) {
+         if (reassembly.active && reassembly.sourceId == packet.sourceId && reassembly.id == id) {
+             slot = &reassembly;
+             break;
+         }
+         if (!reassembly.active && !unused) {
+             unused = &reassembly;
+         }
+     }
+ 
+     if (!slot && unused) {
+         unused->buffer = (uint8_t*)heap_caps_malloc(count * LORA_FRAGMENT_DATA_SIZE, MALLOC_CAP_SPIRAM);
+         if (unused->buffer) {
+             slot = unused;
+             slot->active = true;
+             slot->sourceId = packet.sourceId;
+             slot->id = id;
+             slot->messageType = packet.messageType;
+             slot->count = count;
+             slot->received = 0;
+             slot->length = 0;
+             memset(slot->bitmap, 0, sizeof(slot->bitmap));
+         } else {
+             TDECK_TRACE_E(LORA, "Failed to allocate LoRa reassembly buffer");
+         }
+     } else if (!slot) {
+         TDECK_TRACE_W(LORA, "No free LoRa reassembly buffer, fragment from 0x%04X dropped", packet.sourceId);
+     }
+ 
+     if (slot && slot->count == count) {
+         uint32_t bit = 1UL << (index & 31);
+         if (!(slot->bitmap[index >> 5] & bit)) {
+             slot->bitmap[index >> 5] |= bit;
+             memcpy(slot->buffer + index * LORA_FRAGMENT_DATA_SIZE, data, length);
+             slot->received++;
+             if (last) {
+                 slot->length = index * LORA_FRAGMENT_DATA_SIZE + length;
+             }
+         }
+         slot->deadline = now + TDECK_LORA_REASSEMBLY_TIMEOUT_MS;
+ 
+         // Hand the buffer over so the callback runs without the lock
+         if (slot->received == slot->count) {
+             complete = slot->buffer;
+             completeLength = slot->length;
+             messageType = slot->messageType;
+             slot->buffer = nullptr;
+             slot->active = false;
+         }
+     }
+ 
+     LoRaReassemblyCallback callbacks[TDECK_LORA_TRANSFER_CALLBACKS];
+     memcpy(callbacks, _callbacks, sizeof(callbacks));
+     xSemaphoreGive(_lock);
+ 
+     if (complete) {
+         TDECK_TRACE_I(LORA, "Reassembled LoRa transfer %d from 0x%04X: %u bytes", id, packet.sourceId,
+                       (unsigned)completeLength);
+         for (LoRaReassemblyCallback callback : callbacks) {
+             if (callback) {
+                 callback(packet.sourceId, messageType, complete, completeLength);
+             }
+         }
+         heap_caps_free(complete);
+     }
+ }
+ 
+ // Send more fragments and drop stalled reassemblies
+ uint32_t LoRaFragmenter::service() {
+     if (!_lock) {
+         return UINT32_MAX;
+     }
+ 
+     LoRaTransferResult results[TDECK_LORA_TRANSFERS];
+     int count = 0;
+     uint32_t now = millis();
+     uint32_t next = UINT32_MAX;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+ 
+     for (Reassembly& reassembly : _reassembly) {
+         if (!reassembly.active) {
+             continue;
+         }
+ 
+         if (isDue(reassembly.deadline, now)) {
+             TDECK_TRACE_W(LORA, "LoRa transfer %d from 0x%04X timed out with %d of %d fragments",
+                           reassembly.id, reassembly.sourceId, reassembly.received, reassembly.count);
+             endReassembly(reassembly);
+         } else {
+             next = min(next, reassembly.deadline - now);
+         }
+     }
+ 
+     for (Transfer& transfer : _transfers) {
+         if (!transfer.active || transfer.nextIndex >= transfer.count) {
+             continue;
+         }
+ 
+         if (pump(transfer)) {
+             results[count++] = { transfer.callback, transfer.context, transfer.id, !transfer.failed };
+             endTransfer(transfer);
+         } else if (transfer.nextIndex < transfer.count) {
+             // Window or transmit queue full, try again shortly
+             next = min(next, (uint32_t)TDECK_LORA_ACK_DELAY_MS);
+         }
+     }
+ 
+     xSemaphoreGive(_lock);
+ 
+     reportResults(results, count);
+     return next;
+ }
+ 
+ // Add a callback for reassembled payloads
+ bool LoRaFragmenter::addReassemblyCallback(LoRaReassemblyCallback callback) {
+     // Callbacks are added at startup, possibly before init(), and never removed
+     for (LoRaReassemblyCallback& slot : _callbacks) {
+         if (!slot || slot == callback) {
+             slot = callback;
+             return true;
+         }
+     }
+     return false;
+ }
+ 
+ // Claim a transfer slot
+ LoRaFragmenter::Transfer* LoRaFragmenter::startTransfer(uint8_t messageType, uint16_t destId, size_t length,
+                                                         LoRaTransferCallback callback, void* context) {
+     size_t count = (length + LORA_FRAGMENT_DATA_SIZE - 1) / LORA_FRAGMENT_DATA_SIZE;
+     if (count > LORA_FRAGMENT_MAX_COUNT) {
+         TDECK_TRACE_E(LORA, "LoRa transfer needs %u fragments", (unsigned)count);
+         return nullptr;
+     }
+ 
+     for (Transfer& transfer : _transfers) {
+         if (transfer.active) {
+             continue;
+         }
+ 
+         transfer.active = true;
+         transfer.failed = false;
+         transfer.id = _nextId++;
+         transfer.destId = destId;
+         transfer.messageType = messageType;
+         transfer.count = count;
+         transfer.nextIndex = 0;
+         transfer.inFlight = 0;
+         transfer.delivered = 0;
+         transfer.buffer = nullptr;
+         transfer.length = length;
+         transfer.callback = callback;
+         transfer.context = context;
+         return &transfer;
+     }
+ 
+     TDECK_TRACE_W(LORA, "Too many LoRa transfers in progress");
+     return nullptr;
+ }
+ 
+ // Send fragments until the window or transmit queue is full
+ bool LoRaFragmenter::pump(Transfer& transfer) {
+     bool broadcast = transfer.destId == 0xFFFF;
+ 
+     while (!transfer.failed && transfer.nextIndex < transfer.count) {
+         LoRaPacketRef packet = loraManager.createPacket(transfer.messageType, transfer.destId);
+         if (!packet) {
+             break;
+         }
+ 
+         uint8_t index = transfer.nextIndex;
+         size_t offset = (size_t)index * LORA_FRAGMENT_DATA_SIZE;
+         size_t length = min((size_t)LORA_FRAGMENT_DATA_SIZE, transfer.length - offset);
+         uint8_t* data = packet->payload + LORA_FRAGMENT_HEADER_SIZE;
+ 
+         if (transfer.buffer) {
+             memcpy(data, transfer.buffer + offset, length);
+         } else if (!transfer.file.seek(offset) || transfer.file.read(data, length) != length) {
+             TDECK_TRACE_E(LORA, "Failed to read fragment %d of LoRa transfer %d", index, transfer.id);
+             transfer.failed = true;
+             break;
+         }
+ 
+         packet->payload[0] = transfer.id >> 8;
+         packet->payload[1] = transfer.id & 0xFF;
+         packet->payload[2] = index;
+         packet->payload[3] = transfer.count;
+         packet->length = LORA_FRAGMENT_HEADER_SIZE + length;
+         packet->flags = LORA_FLAG_FRAGMENT;
+         if (index + 1 == transfer.count) {
+             packet->flags |= LORA_FLAG_LAST_FRAG;
+         }
+ 
+         // Unicast fragments are retransmitted one by one by the window
+         if (broadcast) {
+             if (!loraManager.sendPacket(packet)) {
+                 break;
+             }
+         } else {
+             if (loraManager.sendReliable(packet, onFragmentDelivered, &transfer) == 0) {
+                 break;
+             }
+             transfer.inFlight++;
+         }
+ 
+         transfer.nextIndex++;
+     }
+ 
+     if (broadcast) {
+         return transfer.failed || transfer.nextIndex == transfer.count;
+     }
+     return transfer.inFlight == 0 && (transfer.failed || transfer.delivered == transfer.count);
+ }
+ 
+ // Release a transfer's resources
+ void LoRaFragmenter::endTransfer(Transfer& transfer) {
+     if (transfer.buffer) {
+         heap_caps_free(transfer.buffer);
+         transfer.buffer = nullptr;
+     }
+     if (transfer.file) {
+         transfer.file.close();
+     }
+     transfer.active = false;
+ }
+ 
+ // Release a reassembly buffer
+ void LoRaFragmenter::endReassembly(Reassembly& reassembly) {
+     if (reassembly.buffer) {
+         heap_caps_free(reassembly.buffer);
+         reassembly.buffer = nullptr;
+     }
+     reassembly.active = false;
+ }
+ 
+ // One fragment was acknowledged or given up on
+ void LoRaFragmenter::onFragmentDelivered(uint32_t token, uint16_t destId, bool delivered, void* context) {
+     Transfer* transfer = static_cast<Transfer*>(context);
+     LoRaFragmenter* self = transfer->owner;
+ 
+     LoRaTransferResult result = { nullptr, nullptr, 0, false };
+     bool finished = false;
+ 
+     xSemaphoreTake(self->_lock, portMAX_DELAY);
+     if (transfer->active) {
+         transfer->inFlight--;
+         if (delivered) {
+             transfer->delivered++;
+         } else {
+             // Fragments already in flight still complete, nothing new is sent
+             transfer->failed = true;
+         }
+ 
+         finished = self->pump(*transfer);
+         if (finished) {
+             result = { transfer->callback, transfer->context, transfer->id, !transfer->failed };
+             self->endTransfer(*transfer);
+         }
+     }
+     xSemaphoreGive(self->_lock);
+ 
+     if (finished) {
+         if (!result.delivered) {
+             TDECK_TRACE_W(LORA, "LoRa transfer %d to 0x%04X failed", result.id, destId);
+         }
+         reportResults(&result, 1);
+     }
+ }
\ No newline at end of file
@@ -0,0 +1,164 @@
+/**
+ * @file lora_fragment.h
+ * @brief Fragmentation and reassembly of large LoRa payloads
+ *
+ * This file contains the layer that splits buffers and files larger than
+ * one packet into fragments and puts them back together on the receiver.
+ * Unicast fragments go through the reliable window, so a lost fragment is
+ * the only one sent again. Reassembly uses a small number of PSRAM buffers,
+ * each bounded in size and dropped if the transfer stalls.
+ */
+
+ #ifndef TDECK_COMMS_LORA_FRAGMENT_H
+ #define TDECK_COMMS_LORA_FRAGMENT_H
+ 
+ #include <Arduino.h>
+ #include <FS.h>
+ #include "../config.h"
+ #include "lora_packet.h"
+ 
+ // Fragment header at the start of the payload: transfer ID (2), index (1), count (1)
+ #define LORA_FRAGMENT_HEADER_SIZE 4
+ 
+ // Most fragments in one transfer
+ #define LORA_FRAGMENT_MAX_COUNT 255
+ 
+ // Sender-side completion, runs on the LoRa comms task
+ typedef void (*LoRaTransferCallback)(uint16_t transferId, bool delivered, void* context);
+ 
+ // Reassembled payload, the data is only valid during the call
+ typedef void (*LoRaReassemblyCallback)(uint16_t sourceId, uint8_t messageType, const uint8_t* data, size_t length);
+ 
+ /**
+  * @class LoRaFragmenter
+  * @brief Splits outgoing transfers and reassembles incoming ones
+  */
+ class LoRaFragmenter {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaFragmenter();
+ 
+     /**
+      * @brief Create the lock, call before any other method
+      * @return true if successful
+      */
+     bool init();
+ 
+     /**
+      * @brief Send a buffer as a fragmented transfer
+      *
+      * The data is copied, so the caller may free it at once.
+      *
+      * @param messageType Message type of the reassembled payload
+      * @param destId Destination device ID (0xFFFF for broadcast, sent without ACKs)
+      * @param data Payload
+      * @param length Payload length, at most TDECK_LORA_TRANSFER_MAX
+      * @param callback Completion callback, may be nullptr
+      * @param context Passed to the callback
+      * @return Transfer ID, 0 on failure
+      */
+     uint16_t sendBuffer(uint8_t messageType, uint16_t destId, const uint8_t* data, size_t length,
+                         LoRaTransferCallback callback, void* context);
+ 
+     /**
+      * @brief Send a file as a fragmented transfer, read as fragments are sent
+      * @param messageType Message type of the reassembled payload
+      * @param destId Destination device ID
+      * @param path File path
+      * @param callback Completion callback, may be nullptr
+      * @param context Passed to the callback
+      * @return Transfer ID, 0 on failure
+      */
+     uint16_t sendFile(uint8_t messageType, uint16_t destId, const char* path,
+                       LoRaTransferCallback callback, void* context);
+ 
+     /**
+      * @brief Add a received fragment to its transfer
+      * @param packet Packet with LORA_FLAG_FRAGMENT
+      */
+     void onFragment(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Send more fragments where there is room and drop stalled reassemblies
+      * @return Milliseconds until the next call is needed, UINT32_MAX if idle
+      */
+     uint32_t service();
+ 
+     /**
+      * @brief Add a callback for reassembled payloads
+      * @param callback Callback
+      * @return true if added, false if all TDECK_LORA_TRANSFER_CALLBACKS slots are taken
+      */
+     bool addReassemblyCallback(LoRaReassemblyCallback callback);
+ 
+ private:
+     // Outgoing transfer
+     struct Transfer {
+         LoRaFragmenter* owner;           // Fragmenter, for the delivery callback
+         bool active;                     // Slot in use
+         bool failed;                     // A fragment was lost, finish once none are in flight
+         uint16_t id;                     // Transfer ID
+         uint16_t destId;                 // Destination device ID
+         uint8_t messageType;             // Message type of the payload
+         uint8_t count;                   // Fragments in the transfer
+         uint8_t nextIndex;               // Next fragment to send
+         uint8_t inFlight;                // Fragments sent but not yet acknowledged
+         uint8_t delivered;               // Fragments acknowledged
+         uint8_t* buffer;                 // PSRAM copy of the payload, nullptr for files
+         fs::File file;                   // Source file, read per fragment
+         size_t length;                   // Payload length
+         LoRaTransferCallback callback;   // Completion callback
+         void* context;                   // Callback context
+     };
+ 
+     // Incoming transfer
+     struct Reassembly {
+         bool active;                     // Slot in use
+         uint16_t sourceId;               // Sender device ID
+         uint16_t id;                     // Transfer ID
+         uint8_t messageType;             // Message type of the payload
+         uint8_t count;                   // Fragments in the transfer
+         uint8_t received;                // Fragments received
+         uint32_t bitmap[8];              // Bit i set: fragment i received
+         uint8_t* buffer;                 // PSRAM buffer for count full fragments
+         size_t length;                   // Payload length, known once the last fragment arrived
+         uint32_t deadline;               // millis() the transfer is dropped
+     };
+ 
+     Transfer _transfers[TDECK_LORA_TRANSFERS];      // Outgoing transfers
+     Reassembly _reassembly[TDECK_LORA_REASSEMBLY_SLOTS]; // Incoming transfers
+     LoRaReassemblyCallback _callbacks[TDECK_LORA_TRANSFER_CALLBACKS]; // Reassembled payload callbacks
+     SemaphoreHandle_t _lock;                        // Guards both tables
+     uint16_t _nextId;                               // Next transfer ID
+ 
+     /**
+      * @brief Claim a transfer slot and assign its ID, caller holds _lock
+      */
+     Transfer* startTransfer(uint8_t messageType, uint16_t destId, size_t length,
+                             LoRaTransferCallback callback, void* context);
+ 
+     /**
+      * @brief Send fragments until the window or transmit queue is full, caller holds _lock
+      * @return true if the transfer finished
+      */
+     bool pump(Transfer& transfer);
+ 
+     /**
+      * @brief Release a transfer's resources, caller holds _lock
+      */
+     void endTransfer(Transfer& transfer);
+ 
+     /**
+      * @brief Release a reassembly buffer, caller holds _lock
+      */
+     void endReassembly(Reassembly& reassembly);
+ 
+     /**
+      * @brief Reliable delivery callback for one fragment
+      */
+     static void onFragmentDelivered(uint32_t token, uint16_t destId, bool delivered, void* context);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_FRAGMENT_H
\ No newline at end of file
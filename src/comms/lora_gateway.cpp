@@ -0,0 +1,376 @@
+/**
+ * @file lora_gateway.cpp
+ * @brief Implementation of the LoRa to WiFi uplink gateway
+ */
+
+ #include "lora_gateway.h"
+ #include "lora.h"
+ #include "wifi.h"
+ #include "../system/config_storage.h"
+ #include <HTTPClient.h>
+ #include <esp_heap_caps.h>
+ #include <mbedtls/base64.h>
+ #if __has_include(<esp32s3/rom/miniz.h>)
+ #include <esp32s3/rom/miniz.h>
+ #else
+ #include <rom/miniz.h>
+ #endif
+ 
+ // Global instance
+ LoRaGateway loraGateway;
+ 
+ // Defined in main.cpp
+ extern WiFiManager wifiManager;
+ 
+ // Longest JSON line of one record, a full payload in base64 and every field at its widest
+ #define GATEWAY_LINE_MAX (((LORA_MAX_PACKET_SIZE + 2) / 3) * 4 + 160)
+ 
+ // Batch text buffer
+ #define GATEWAY_BODY_SIZE (TDECK_LORA_GATEWAY_BATCH_MAX * GATEWAY_LINE_MAX)
+ 
+ // Greedy parsing with few probes, batches are small and mostly repeated keys
+ #define GATEWAY_DEFLATE_FLAGS (TDEFL_WRITE_ZLIB_HEADER | TDEFL_GREEDY_PARSING_FLAG | 32)
+ 
+ // How often the state machine looks at WiFi while it connects
+ #define GATEWAY_WAKE_POLL_MS 100
+ 
+ // Forward every packet heard to the gateway queue
+ static void monitorPacket(const LoRaPacketRef& packet) {
+     loraGateway.onPacket(*packet);
+ }
+ 
+ // Constructor
+ LoRaGateway::LoRaGateway()
+     : _records(nullptr)
+     , _head(0)
+     , _count(0)
+     , _dropped(0)
+     , _uploaded(0)
+     , _evicted(0)
+     , _lock(NULL)
+     , _body(nullptr)
+     , _compressed(nullptr)
+     , _deflator(nullptr)
+     , _state(STATE_IDLE)
+     , _flushRequested(false)
+     , _wokeWiFi(false)
+     , _wakeStart(0)
+     , _retryAt(0)
+     , _retryDelay(TDECK_LORA_GATEWAY_RETRY_MS)
+ {
+ }
+ 
+ // Load the configuration, allocate the queue and start listening
+ bool LoRaGateway::init() {
+     loadConfig();
+     if (!_config.enabled) {
+         TDECK_LOG_I("LoRa gateway disabled");
+         return true;
+     }
+ 
+     _lock = xSemaphoreCreateMutex();
+     _records = (LoRaGatewayRecord*)heap_caps_calloc(TDECK_LORA_GATEWAY_QUEUE, sizeof(LoRaGatewayRecord),
+                                                     MALLOC_CAP_SPIRAM);
+     _body = (char*)heap_caps_malloc(GATEWAY_BODY_SIZE, MALLOC_CAP_SPIRAM);
+     _compressed = (uint8_t*)heap_caps_malloc(GATEWAY_BODY_SIZE, MALLOC_CAP_SPIRAM);
+     if (!_lock || !_records || !_body || !_compressed) {
+         TDECK_LOG_E("Failed to allocate LoRa gateway queue");
+         heap_caps_free(_records);
+         heap_caps_free(_body);
+         heap_caps_free(_compressed);
+         _records = nullptr;
+         _body = nullptr;
+         _compressed = nullptr;
+         return false;
+     }
+ 
+     loraManager.setMonitorCallback(monitorPacket);
+     TDECK_LOG_I("LoRa gateway uplinking to %s", _config.url.c_str());
+     return true;
+ }
+ 
+ // Run the uplink state machine
+ uint32_t LoRaGateway::update() {
+     if (!_records) {
+         return UINT32_MAX;
+     }
+ 
+     uint32_t now = millis();
+ 
+     if (_state == STATE_WAKING) {
+         if (wifiManager.isConnected()) {
+             _state = STATE_IDLE;
+         } else if (now - _wakeStart > TDECK_LORA_GATEWAY_CONNECT_TIMEOUT_MS) {
+             TDECK_LOG_W("LoRa gateway: WiFi did not connect, %u packets kept", getQueued());
+             _state = STATE_IDLE;
+             releaseWiFi();
+             return backOff();
+         } else {
+             return GATEWAY_WAKE_POLL_MS;
+         }
+     }
+ 
+     // Nothing before a retry is due
+     if (_retryAt != 0 && (int32_t)(now - _retryAt) < 0) {
+         return _retryAt - now;
+     }
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     size_t count = _count;
+     uint32_t age = count > 0 ? now - _records[_head].receivedAt : 0;
+     xSemaphoreGive(_lock);
+ 
+     if (count == 0) {
+         _flushRequested = false;
+         releaseWiFi();
+         return UINT32_MAX;
+     }
+     if (!_flushRequested && count < _config.batchPackets && age < _config.batchMs) {
+         // The batch fills, or its oldest packet comes due
+         releaseWiFi();
+         return _config.batchMs - age;
+     }
+ 
+     if (!wifiManager.isConnected()) {
+         // Wake the radio through the cached access point and lease
+         if (!wifiManager.reconnect()) {
+             TDECK_LOG_W("LoRa gateway: no WiFi network to uplink through");
+             return backOff();
+         }
+         _wokeWiFi = true;
+         _state = STATE_WAKING;
+         _wakeStart = now;
+         return GATEWAY_WAKE_POLL_MS;
+     }
+ 
+     if (!uploadBatch()) {
+         releaseWiFi();
+         return backOff();
+     }
+ 
+     // Keep the radio up while full batches remain, the rest waits for its turn
+     _retryAt = 0;
+     _retryDelay = TDECK_LORA_GATEWAY_RETRY_MS;
+     if (getQueued() >= _config.batchPackets) {
+         return 0;
+     }
+     _flushRequested = false;
+     releaseWiFi();
+     return _config.batchMs;
+ }
+ 
+ // Queue a received packet
+ void LoRaGateway::onPacket(const LoRaPacket& packet) {
+     if (!_records) {
+         return;
+     }
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     if (_count == TDECK_LORA_GATEWAY_QUEUE) {
+         // Full, the oldest packet makes room
+         _head = (_head + 1) % TDECK_LORA_GATEWAY_QUEUE;
+         _count--;
+         _dropped++;
+         _evicted++;
+     }
+     LoRaGatewayRecord& record = _records[(_head + _count) % TDECK_LORA_GATEWAY_QUEUE];
+     record.receivedAt = millis();
+     record.snr = packet.snr;
+     record.rssi = packet.rssi;
+     record.sourceId = packet.sourceId;
+     record.destId = packet.destId;
+     record.packetId = packet.packetId;
+     record.messageType = packet.messageType;
+     record.flags = packet.flags;
+     record.hopCount = packet.hopCount;
+     record.length = packet.length;
+     memcpy(record.payload, packet.payload, packet.length);
+     _count++;
+     xSemaphoreGive(_lock);
+ }
+ 
+ // Uplink the queued packets without waiting for a full batch
+ void LoRaGateway::flush() {
+     _flushRequested = true;
+     _retryAt = 0;
+ }
+ 
+ // Get the gateway configuration
+ const LoRaGatewayConfig& LoRaGateway::getConfig() const {
+     return _config;
+ }
+ 
+ // Change the gateway configuration and save it, enabling takes effect on the next boot
+ bool LoRaGateway::setConfig(const LoRaGatewayConfig& config) {
+     _config = config;
+     _config.batchPackets = constrain(_config.batchPackets, 1, TDECK_LORA_GATEWAY_BATCH_MAX);
+     return saveConfig();
+ }
+ 
+ // Get the number of packets waiting for uplink
+ size_t LoRaGateway::getQueued() const {
+     return _count;
+ }
+ 
+ // Get the number of packets dropped because the queue was full
+ uint32_t LoRaGateway::getDropped() const {
+     return _dropped;
+ }
+ 
+ // Get the number of packets uplinked
+ uint32_t LoRaGateway::getUploaded() const {
+     return _uploaded;
+ }
+ 
+ // Load the configuration, defaults if there is none
+ void LoRaGateway::loadConfig() {
+     // A missing file leaves the document empty and every field at its default
+     DynamicJsonDocument doc(512);
+     configStorage.read(TDECK_FS_GATEWAY_CONFIG_FILE, doc);
+ 
+     _config.enabled = doc["enabled"] | false;
+     _config.url = doc["url"] | "";
+     _config.token = doc["token"] | "";
+     _config.batchMs = doc["batchMs"] | TDECK_LORA_GATEWAY_BATCH_MS;
+     _config.batchPackets = doc["batchPackets"] | TDECK_LORA_GATEWAY_BATCH_PACKETS;
+     _config.batchPackets = constrain(_config.batchPackets, 1, TDECK_LORA_GATEWAY_BATCH_MAX);
+ 
+     if (_config.enabled && _config.url.isEmpty()) {
+         TDECK_LOG_W("LoRa gateway enabled without an uplink URL");
+         _config.enabled = false;
+     }
+ }
+ 
+ // Save the configuration
+ bool LoRaGateway::saveConfig() {
+     DynamicJsonDocument doc(512);
+     doc["enabled"] = _config.enabled;
+     doc["url"] = _config.url;
+     doc["token"] = _config.token;
+     doc["batchMs"] = _config.batchMs;
+     doc["batchPackets"] = _config.batchPackets;
+     return configStorage.write(TDECK_FS_GATEWAY_CONFIG_FILE, doc);
+ }
+ 
+ // Format up to one batch of records as JSON lines
+ size_t LoRaGateway::buildBatch(size_t& bodyLength) {
+     uint32_t now = millis();
+     size_t length = 0;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     size_t batch = min(_count, (size_t)_config.batchPackets);
+     for (size_t i = 0; i < batch; i++) {
+         const LoRaGatewayRecord& record = _records[(_head + i) % TDECK_LORA_GATEWAY_QUEUE];
+         char* line = _body + length;
+         int written = snprintf(line, GATEWAY_LINE_MAX,
+                                "{\"age\":%lu,\"type\":%u,\"flags\":%u,\"src\":%u,\"dst\":%u,\"id\":%u,"
+                                "\"hops\":%u,\"rssi\":%d,\"snr\":%.1f,\"data\":\"",
+                                (unsigned long)(now - record.receivedAt), record.messageType, record.flags,
+                                record.sourceId, record.destId, record.packetId, record.hopCount,
+                                record.rssi, record.snr);
+         size_t encoded = 0;
+         mbedtls_base64_encode((unsigned char*)line + written, GATEWAY_LINE_MAX - written - 3, &encoded,
+                               record.payload, record.length);
+         written += encoded;
+         line[written++] = '"';
+         line[written++] = '}';
+         line[written++] = '\n';
+         length += written;
+     }
+     _evicted = 0;
+     xSemaphoreGive(_lock);
+ 
+     bodyLength = length;
+     return batch;
+ }
+ 
+ // Compress the batch text
+ size_t LoRaGateway::compressBatch(size_t bodyLength) {
+     if (!_deflator) {
+         _deflator = heap_caps_malloc(sizeof(tdefl_compressor), MALLOC_CAP_SPIRAM);
+         if (!_deflator) {
+             TDECK_LOG_W("LoRa gateway: no memory for compression, sending batches as is");
+             return 0;
+         }
+     }
+ 
+     tdefl_compressor* deflator = (tdefl_compressor*)_deflator;
+     if (tdefl_init(deflator, NULL, NULL, GATEWAY_DEFLATE_FLAGS) != TDEFL_STATUS_OKAY) {
+         return 0;
+     }
+     size_t inLength = bodyLength;
+     size_t outLength = GATEWAY_BODY_SIZE;
+     if (tdefl_compress(deflator, _body, &inLength, _compressed, &outLength, TDEFL_FINISH) != TDEFL_STATUS_DONE ||
+         outLength >= bodyLength) {
+         return 0;
+     }
+     return outLength;
+ }
+ 
+ // Build, compress and POST one batch
+ bool LoRaGateway::uploadBatch() {
+     size_t bodyLength = 0;
+     size_t batch = buildBatch(bodyLength);
+     if (batch == 0) {
+         return true;
+     }
+     size_t compressedLength = compressBatch(bodyLength);
+ 
+     HTTPClient http;
+     http.setTimeout(TDECK_LORA_GATEWAY_HTTP_TIMEOUT_MS);
+     if (!http.begin(_config.url)) {
+         TDECK_LOG_E("LoRa gateway: invalid uplink URL %s", _config.url.c_str());
+         return false;
+     }
+     http.addHeader("Content-Type", "application/x-ndjson");
+     http.addHeader("X-Gateway-Id", String(loraManager.getDeviceId(), HEX));
+     if (!_config.token.isEmpty()) {
+         http.addHeader("Authorization", "Bearer " + _config.token);
+     }
+ 
+     int httpCode;
+     if (compressedLength > 0) {
+         http.addHeader("Content-Encoding", "deflate");
+         httpCode = http.POST(_compressed, compressedLength);
+     } else {
+         httpCode = http.POST((uint8_t*)_body, bodyLength);
+     }
+     http.end();
+ 
+     if (httpCode < 200 || httpCode >= 300) {
+         TDECK_LOG_W("LoRa gateway: uplink of %u packets failed (%d)", batch, httpCode);
+         return false;
+     }
+ 
+     // Packets overwritten during the upload were already part of the batch
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     size_t sent = batch > _evicted ? batch - _evicted : 0;
+     sent = min(sent, _count);
+     _head = (_head + sent) % TDECK_LORA_GATEWAY_QUEUE;
+     _count -= sent;
+     xSemaphoreGive(_lock);
+     _uploaded += batch;
+ 
+     TDECK_LOG_I("LoRa gateway: uplinked %u packets, %u bytes (%u before compression)", batch,
+                 compressedLength > 0 ? compressedLength : bodyLength, bodyLength);
+     return true;
+ }
+ 
+ // Wait longer before the next attempt
+ uint32_t LoRaGateway::backOff() {
+     uint32_t wait = _retryDelay;
+     _retryAt = millis() + wait;
+     if (_retryAt == 0) {
+         _retryAt = 1;
+     }
+     _retryDelay = min(_retryDelay * 2, (uint32_t)TDECK_LORA_GATEWAY_RETRY_MAX_MS);
+     return wait;
+ }
+ 
+ // Turn WiFi off again if the gateway woke it
+ void LoRaGateway::releaseWiFi() {
+     if (_wokeWiFi) {
+         _wokeWiFi = false;
+         wifiManager.disconnect(true);
+     }
+ }
\ No newline at end of file
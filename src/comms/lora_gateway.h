@@ -0,0 +1,185 @@
+/**
+ * @file lora_gateway.h
+ * @brief LoRa to WiFi uplink gateway
+ *
+ * Every LoRa packet heard is queued with its link metrics in a bounded PSRAM
+ * ring. When a batch is full or its oldest packet has waited long enough,
+ * the gateway wakes WiFi through the fast reconnect path, POSTs the batch
+ * compressed, and powers WiFi down again if it was the one that woke it.
+ * A failed upload keeps the packets and retries with a growing delay; when
+ * the ring is full the oldest packets go first.
+ *
+ * The batch body is one JSON object per line, zlib compressed with
+ * Content-Encoding: deflate when that makes it smaller:
+ *
+ *     {"age":1200,"type":1,"flags":0,"src":4660,"dst":65535,"id":7,"hops":0,"rssi":-87,"snr":6.5,"data":"aGVsbG8="}
+ *
+ * age is milliseconds between reception and upload, data is the raw payload
+ * in base64 (compressed text stays compressed, see LORA_FLAG_COMPRESSED).
+ */
+
+ #ifndef TDECK_COMMS_LORA_GATEWAY_H
+ #define TDECK_COMMS_LORA_GATEWAY_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "lora_packet.h"
+ 
+ /**
+  * @brief Structure to hold gateway configuration
+  */
+ struct LoRaGatewayConfig {
+     bool enabled;                  // Queue and uplink received packets
+     String url;                    // HTTP endpoint batches are POSTed to
+     String token;                  // Bearer token, empty for none
+     uint32_t batchMs;              // Longest a packet waits for its batch
+     uint16_t batchPackets;         // Packets that make a full batch, at most TDECK_LORA_GATEWAY_BATCH_MAX
+ };
+ 
+ /**
+  * @brief One queued packet
+  */
+ struct LoRaGatewayRecord {
+     uint32_t receivedAt;           // millis() at reception
+     float snr;                     // SNR in dB
+     int16_t rssi;                  // RSSI in dBm
+     uint16_t sourceId;             // Source device ID
+     uint16_t destId;               // Destination device ID
+     uint16_t packetId;             // Packet ID
+     uint8_t messageType;           // Message type
+     uint8_t flags;                 // Packet flags
+     uint8_t hopCount;              // Relays the packet passed
+     uint8_t length;                // Valid bytes in payload
+     uint8_t payload[LORA_MAX_PACKET_SIZE];
+ };
+ 
+ /**
+  * @class LoRaGateway
+  * @brief Queues received LoRa packets and uplinks them in batches over WiFi
+  */
+ class LoRaGateway {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaGateway();
+ 
+     /**
+      * @brief Load the configuration, allocate the queue and start listening
+      * @return true if successful
+      */
+     bool init();
+ 
+     /**
+      * @brief Run the uplink state machine, called by the system scheduler
+      * @return Milliseconds until the gateway next needs to run
+      */
+     uint32_t update();
+ 
+     /**
+      * @brief Queue a received packet, runs on the LoRa dispatch path
+      * @param packet Packet as heard, before address filtering
+      */
+     void onPacket(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Uplink the queued packets without waiting for a full batch
+      */
+     void flush();
+ 
+     /**
+      * @brief Get the gateway configuration
+      */
+     const LoRaGatewayConfig& getConfig() const;
+ 
+     /**
+      * @brief Change the gateway configuration and save it
+      * @param config New configuration
+      * @return true if saved
+      */
+     bool setConfig(const LoRaGatewayConfig& config);
+ 
+     /**
+      * @brief Get the number of packets waiting for uplink
+      */
+     size_t getQueued() const;
+ 
+     /**
+      * @brief Get the number of packets dropped because the queue was full
+      */
+     uint32_t getDropped() const;
+ 
+     /**
+      * @brief Get the number of packets uplinked
+      */
+     uint32_t getUploaded() const;
+ 
+ private:
+     enum State {
+         STATE_IDLE,                // Waiting for a batch
+         STATE_WAKING               // WiFi reconnecting for a batch
+     };
+ 
+     LoRaGatewayConfig _config;
+     LoRaGatewayRecord* _records;   // TDECK_LORA_GATEWAY_QUEUE slots in PSRAM
+     size_t _head;                  // Slot of the oldest record
+     size_t _count;                 // Records queued
+     uint32_t _dropped;             // Records overwritten, queue full
+     uint32_t _uploaded;            // Records uplinked
+     uint32_t _evicted;             // Oldest records overwritten since the batch was built
+     SemaphoreHandle_t _lock;       // Guards the queue
+     char* _body;                   // Batch text in PSRAM
+     uint8_t* _compressed;          // Compressed batch in PSRAM
+     void* _deflator;               // tdefl_compressor, allocated on the first upload
+     State _state;
+     bool _flushRequested;
+     bool _wokeWiFi;                // WiFi was off before this batch, turn it off after
+     uint32_t _wakeStart;
+     uint32_t _retryAt;             // No upload before this, 0 when not backing off
+     uint32_t _retryDelay;
+ 
+     /**
+      * @brief Load the configuration, defaults if there is none
+      */
+     void loadConfig();
+ 
+     /**
+      * @brief Save the configuration
+      */
+     bool saveConfig();
+ 
+     /**
+      * @brief Format up to one batch of records as JSON lines
+      * @param bodyLength Receives the text length
+      * @return Records in the batch
+      */
+     size_t buildBatch(size_t& bodyLength);
+ 
+     /**
+      * @brief Compress the batch text
+      * @return Compressed length, 0 if it did not get smaller
+      */
+     size_t compressBatch(size_t bodyLength);
+ 
+     /**
+      * @brief Build, compress and POST one batch, drop it from the queue on success
+      * @return true if the server accepted it
+      */
+     bool uploadBatch();
+ 
+     /**
+      * @brief Wait longer before the next attempt
+      * @return Milliseconds until the next attempt
+      */
+     uint32_t backOff();
+ 
+     /**
+      * @brief Turn WiFi off again if the gateway woke it
+      */
+     void releaseWiFi();
+ };
+ 
+ // Global instance
+ extern LoRaGateway loraGateway;
+ 
+ #endif // TDECK_COMMS_LORA_GATEWAY_H
\ No newline at end of file
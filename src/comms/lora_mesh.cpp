@@ -0,0 +1,144 @@
+/**
+ * @file lora_mesh.cpp
+ * @brief Implementation of managed flooding for multi-hop LoRa
+ */
+
+ #include "lora_mesh.h"
+ #include "lora.h"
+ #include "../system/trace.h"
+ 
+ static_assert((TDECK_LORA_MESH_SEEN_BUCKETS & (TDECK_LORA_MESH_SEEN_BUCKETS - 1)) == 0,
+               "Seen cache bucket count must be a power of two");
+ 
+ // Constructor
+ LoRaMesh::LoRaMesh()
+     : _relayed(0)
+     , _suppressed(0)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+     memset(_seen, 0, sizeof(_seen));
+ }
+ 
+ // Record a packet as seen
+ bool LoRaMesh::markSeen(const LoRaPacket& packet) {
+     uint32_t k = key(packet);
+     uint32_t now = millis();
+     Seen* bucket = _seen[k & (TDECK_LORA_MESH_SEEN_BUCKETS - 1)];
+     bool fresh = true;
+ 
+     portENTER_CRITICAL(&_lock);
+     Seen* victim = nullptr;
+     bool victimLive = true;
+     for (int i = 0; i < LORA_MESH_SEEN_WAYS; i++) {
+         Seen& entry = bucket[i];
+         bool live = entry.key != 0 && now - entry.time < TDECK_LORA_MESH_SEEN_MS;
+ 
+         if (live && entry.key == k) {
+             fresh = false;
+             victim = &entry;
+             break;
+         }
+ 
+         // Prefer an empty or expired way, otherwise the oldest
+         if (!victim || (victimLive && (!live || (int32_t)(entry.time - victim->time) < 0))) {
+             victim = &entry;
+             victimLive = live;
+         }
+     }
+     victim->key = k;
+     victim->time = now;
+     portEXIT_CRITICAL(&_lock);
+ 
+     return fresh;
+ }
+ 
+ // Schedule a rebroadcast
+ bool LoRaMesh::scheduleRelay(const LoRaPacketRef& packet) {
+     for (Relay& relay : _relays) {
+         if (relay.packet) {
+             continue;
+         }
+ 
+         // Low SNR means the far edge of the sender's range, where forwarding
+         // reaches the most new nodes, so it waits the least
+         float snr = constrain(packet->snr, -20.0f, 10.0f);
+         uint32_t delay = TDECK_LORA_MESH_DELAY_MIN_MS +
+                          (uint32_t)((snr + 20.0f) / 30.0f * (TDECK_LORA_MESH_DELAY_MAX_MS - TDECK_LORA_MESH_DELAY_MIN_MS));
+         delay += esp_random() % (TDECK_LORA_MESH_DELAY_MIN_MS + 1);
+ 
+         relay.packet = packet;
+         relay.key = key(*packet);
+         relay.due = millis() + delay;
+         return true;
+     }
+ 
+     TDECK_TRACE_W(LORA, "LoRa relay queue full, packet from 0x%04X not forwarded", packet->sourceId);
+     return false;
+ }
+ 
+ // Drop a scheduled rebroadcast
+ void LoRaMesh::cancelRelay(const LoRaPacket& packet) {
+     uint32_t k = key(packet);
+     for (Relay& relay : _relays) {
+         if (relay.packet && relay.key == k) {
+             relay.packet.reset();
+             _suppressed++;
+         }
+     }
+ }
+ 
+ // Forward due rebroadcasts
+ uint32_t LoRaMesh::service() {
+     uint32_t now = millis();
+     uint32_t next = UINT32_MAX;
+ 
+     for (Relay& relay : _relays) {
+         if (!relay.packet) {
+             continue;
+         }
+ 
+         int32_t remaining = (int32_t)(relay.due - now);
+         if (remaining > 0) {
+             next = min(next, (uint32_t)remaining);
+             continue;
+         }
+ 
+         relay.packet->hopLimit--;
+         if (relay.packet->hopCount < 15) {
+             relay.packet->hopCount++;
+         }
+ 
+         if (loraManager.sendPacket(relay.packet)) {
+             _relayed++;
+         }
+         relay.packet.reset();
+     }
+ 
+     return next;
+ }
+ 
+ // Get the number of packets forwarded
+ uint32_t LoRaMesh::getRelayedCount() const {
+     return _relayed;
+ }
+ 
+ // Get the number of rebroadcasts cancelled
+ uint32_t LoRaMesh::getSuppressedCount() const {
+     return _suppressed;
+ }
+ 
+ // FNV-1a over the fields that identify one transmission of a packet. The
+ // attempt is included so a reliable retransmission floods again.
+ uint32_t LoRaMesh::key(const LoRaPacket& packet) {
+     uint8_t fields[6] = {
+         (uint8_t)(packet.sourceId >> 8), (uint8_t)(packet.sourceId & 0xFF),
+         (uint8_t)(packet.packetId >> 8), (uint8_t)(packet.packetId & 0xFF),
+         packet.messageType, packet.attempt
+     };
+ 
+     uint32_t hash = 2166136261UL;
+     for (uint8_t byte : fields) {
+         hash = (hash ^ byte) * 16777619UL;
+     }
+     return hash ? hash : 1;
+ }
\ No newline at end of file
@@ -0,0 +1,98 @@
+/**
+ * @file lora_mesh.h
+ * @brief Managed flooding for multi-hop LoRa
+ *
+ * This file contains the relay logic used when LoRaManager runs in relay
+ * mode. Every mesh-aware packet carries a hop limit and hop count in its
+ * trailer. A set-associative cache of recently seen packets drops echoes
+ * and copies heard over several paths. Relays wait a delay ordered by SNR
+ * before forwarding, so the most distant listener goes first, and cancel
+ * their own copy when they hear another node forward it.
+ */
+
+ #ifndef TDECK_COMMS_LORA_MESH_H
+ #define TDECK_COMMS_LORA_MESH_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "lora_packet.h"
+ 
+ // Ways per bucket of the seen-packet cache
+ #define LORA_MESH_SEEN_WAYS 4
+ 
+ /**
+  * @class LoRaMesh
+  * @brief Seen-packet cache and delayed rebroadcasts
+  */
+ class LoRaMesh {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaMesh();
+ 
+     /**
+      * @brief Record a packet as seen
+      * @param packet Packet heard or sent
+      * @return true if the packet was not seen before
+      */
+     bool markSeen(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Schedule a packet for rebroadcast after its SNR-ordered delay
+      * @param packet Packet to forward, hop limit not yet decremented
+      * @return true if scheduled
+      */
+     bool scheduleRelay(const LoRaPacketRef& packet);
+ 
+     /**
+      * @brief Drop a scheduled rebroadcast because another node forwarded it
+      * @param packet Copy heard from the other node
+      */
+     void cancelRelay(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Forward rebroadcasts that are due
+      * @return Milliseconds until the next one, UINT32_MAX if none
+      */
+     uint32_t service();
+ 
+     /**
+      * @brief Get the number of packets forwarded since boot
+      * @return Relayed packet count
+      */
+     uint32_t getRelayedCount() const;
+ 
+     /**
+      * @brief Get the number of rebroadcasts cancelled by another relay
+      * @return Suppressed rebroadcast count
+      */
+     uint32_t getSuppressedCount() const;
+ 
+ private:
+     // Seen-cache entry
+     struct Seen {
+         uint32_t key;            // Packet key, 0 if empty
+         uint32_t time;           // millis() the packet was seen
+     };
+ 
+     // Scheduled rebroadcast
+     struct Relay {
+         LoRaPacketRef packet;    // Packet to forward, empty if the slot is free
+         uint32_t key;            // Packet key
+         uint32_t due;            // millis() to forward
+     };
+ 
+     Seen _seen[TDECK_LORA_MESH_SEEN_BUCKETS][LORA_MESH_SEEN_WAYS]; // Seen-packet cache
+     Relay _relays[TDECK_LORA_MESH_PENDING];    // Scheduled rebroadcasts
+     uint32_t _relayed;                         // Packets forwarded
+     uint32_t _suppressed;                      // Rebroadcasts cancelled
+     mutable portMUX_TYPE _lock;                // Guards _seen
+ 
+     /**
+      * @brief Hash of source, packet ID, type and attempt, never 0
+      */
+     static uint32_t key(const LoRaPacket& packet);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_MESH_H
\ No newline at end of file
@@ -0,0 +1,134 @@
+/**
+ * @file lora_packet.cpp
+ * @brief Implementation of the LoRa packet pool for T-Deck UI Firmware
+ */
+
+ #include "lora_packet.h"
+ 
+ // Global instance
+ LoRaPacketPool loraPacketPool;
+ 
+ // Empty handle
+ LoRaPacketRef::LoRaPacketRef()
+     : _packet(nullptr)
+ {
+ }
+ 
+ // Share a packet
+ LoRaPacketRef::LoRaPacketRef(const LoRaPacketRef& other)
+     : _packet(other._packet)
+ {
+     if (_packet) {
+         loraPacketPool.retain(_packet);
+     }
+ }
+ 
+ // Take over another handle's reference
+ LoRaPacketRef::LoRaPacketRef(LoRaPacketRef&& other)
+     : _packet(other._packet)
+ {
+     other._packet = nullptr;
+ }
+ 
+ // Drop the reference
+ LoRaPacketRef::~LoRaPacketRef() {
+     reset();
+ }
+ 
+ // Assign by swapping with the by-value copy
+ LoRaPacketRef& LoRaPacketRef::operator=(LoRaPacketRef other) {
+     LoRaPacket* packet = _packet;
+     _packet = other._packet;
+     other._packet = packet;
+     return *this;
+ }
+ 
+ // Drop the reference and leave the handle empty
+ void LoRaPacketRef::reset() {
+     if (_packet) {
+         loraPacketPool.release(_packet);
+         _packet = nullptr;
+     }
+ }
+ 
+ // Give up the handle without dropping its reference
+ LoRaPacket* LoRaPacketRef::release() {
+     LoRaPacket* packet = _packet;
+     _packet = nullptr;
+     return packet;
+ }
+ 
+ // Take back a reference given up by release()
+ LoRaPacketRef LoRaPacketRef::adopt(LoRaPacket* packet) {
+     LoRaPacketRef ref;
+     ref._packet = packet;
+     return ref;
+ }
+ 
+ // Constructor - chain every slot into the free list
+ LoRaPacketPool::LoRaPacketPool()
+     : _freeHead(0)
+     , _free(TDECK_LORA_POOL_SIZE)
+     , _exhausted(0)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+     for (int i = 0; i < TDECK_LORA_POOL_SIZE; i++) {
+         _slots[i].refs = 0;
+         _slots[i].next = (i + 1 < TDECK_LORA_POOL_SIZE) ? i + 1 : -1;
+     }
+ }
+ 
+ // Take a free packet from the pool
+ LoRaPacketRef LoRaPacketPool::allocate() {
+     portENTER_CRITICAL(&_lock);
+     int16_t index = _freeHead;
+     if (index >= 0) {
+         _freeHead = _slots[index].next;
+         _slots[index].refs = 1;
+         _free--;
+     } else {
+         _exhausted++;
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     if (index < 0) {
+         return LoRaPacketRef();
+     }
+ 
+     // Only the header is cleared, the payload is written by the producer
+     LoRaPacket* packet = &_slots[index].packet;
+     memset(packet, 0, offsetof(LoRaPacket, payload));
+     return LoRaPacketRef::adopt(packet);
+ }
+ 
+ // Get the number of free packets
+ size_t LoRaPacketPool::available() const {
+     return _free;
+ }
+ 
+ // Get the number of failed allocations
+ uint32_t LoRaPacketPool::getExhaustedCount() const {
+     return _exhausted;
+ }
+ 
+ // Add a reference to a pooled packet
+ void LoRaPacketPool::retain(LoRaPacket* packet) {
+     Slot* slot = reinterpret_cast<Slot*>(packet);
+ 
+     portENTER_CRITICAL(&_lock);
+     slot->refs++;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Drop a reference, returning the slot to the pool on the last one
+ void LoRaPacketPool::release(LoRaPacket* packet) {
+     Slot* slot = reinterpret_cast<Slot*>(packet);
+ 
+     portENTER_CRITICAL(&_lock);
+     if (slot->refs > 0 && --slot->refs == 0) {
+         slot->next = _freeHead;
+         _freeHead = slot - _slots;
+         _free++;
+     }
+     portEXIT_CRITICAL(&_lock);
+ }
\ No newline at end of file
@@ -0,0 +1,177 @@
+/**
+ * @file lora_packet.h
+ * @brief LoRa packet type and preallocated packet pool for T-Deck UI Firmware
+ *
+ * This file contains the single packet type shared by the LoRa driver, the
+ * LoRa manager and the apps, together with a fixed pool of packet buffers.
+ * Packets are handed around as reference-counted handles so the radio can
+ * read and write its FIFO straight into a pool slot and no layer has to copy
+ * the payload.
+ */
+
+ #ifndef TDECK_COMMS_LORA_PACKET_H
+ #define TDECK_COMMS_LORA_PACKET_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // Maximum packet size for LoRa transmission
+ #define LORA_MAX_PACKET_SIZE 256
+ 
+ // On-air header: type, source, destination, packet ID, length
+ #define LORA_HEADER_SIZE 8
+ 
+ // LoRa packet flags
+ #define LORA_FLAG_ACK       0x01    // Acknowledgment packet
+ #define LORA_FLAG_RELIABLE  0x02    // Reliable transmission (requires ACK)
+ #define LORA_FLAG_BROADCAST 0x04    // Broadcast packet
+ #define LORA_FLAG_ENCRYPTED 0x08    // Encrypted payload
+ #define LORA_FLAG_FRAGMENT  0x10    // Fragmented packet
+ #define LORA_FLAG_LAST_FRAG 0x20    // Last fragment
+ #define LORA_FLAG_COMPRESSED 0x40   // Text payload compressed with the static dictionary
+ 
+ // LoRa packet structure
+ struct LoRaPacket {
+     uint8_t messageType;    // Type of message
+     uint8_t flags;          // Packet flags (LORA_FLAG_*)
+     uint16_t sourceId;      // Source device ID
+     uint16_t destId;        // Destination device ID (0xFFFF for broadcast)
+     uint16_t packetId;      // Unique packet ID
+     uint8_t length;         // Payload length
+     uint8_t schema;         // Capability level of the sender, 0 for JSON-only nodes
+     uint8_t rate;           // Data rate offered by the sender, LORA_ADR_HOME for none
+     uint8_t attempt;        // Earlier transmissions of this packet by its source
+     uint8_t hopLimit;       // Further relays allowed, 0 for the last hop
+     uint8_t hopCount;       // Relays the packet has passed, 0 if heard from its source
+     int16_t rssi;           // RSSI of a received packet in dBm
+     float snr;              // SNR of a received packet in dB
+     uint8_t payload[LORA_MAX_PACKET_SIZE]; // Message payload
+ };
+ 
+ /**
+  * @class LoRaPacketRef
+  * @brief Reference-counted handle to a pooled packet
+  *
+  * Copying a handle shares the packet, the slot returns to the pool when the
+  * last handle goes away. FreeRTOS queues copy bytes, so a handle crosses a
+  * queue as a raw pointer: release() hands its reference to the queue and
+  * adopt() takes it back on the other side.
+  */
+ class LoRaPacketRef {
+ public:
+     /**
+      * @brief Construct an empty handle
+      */
+     LoRaPacketRef();
+ 
+     /**
+      * @brief Share a packet
+      * @param other Handle to share
+      */
+     LoRaPacketRef(const LoRaPacketRef& other);
+ 
+     /**
+      * @brief Take over another handle's reference
+      * @param other Handle to move from, left empty
+      */
+     LoRaPacketRef(LoRaPacketRef&& other);
+ 
+     /**
+      * @brief Drop the reference
+      */
+     ~LoRaPacketRef();
+ 
+     /**
+      * @brief Replace the packet, sharing or taking over the other one
+      * @param other Handle to assign
+      * @return This handle
+      */
+     LoRaPacketRef& operator=(LoRaPacketRef other);
+ 
+     LoRaPacket* operator->() const { return _packet; }
+     LoRaPacket& operator*() const { return *_packet; }
+     LoRaPacket* get() const { return _packet; }
+     explicit operator bool() const { return _packet != nullptr; }
+ 
+     /**
+      * @brief Drop the reference and leave the handle empty
+      */
+     void reset();
+ 
+     /**
+      * @brief Give up the handle without dropping its reference
+      * @return Packet pointer that now owns one reference
+      */
+     LoRaPacket* release();
+ 
+     /**
+      * @brief Take back a reference given up by release()
+      * @param packet Packet pointer owning one reference
+      * @return Handle owning that reference
+      */
+     static LoRaPacketRef adopt(LoRaPacket* packet);
+ 
+ private:
+     LoRaPacket* _packet;         // Pooled packet, nullptr if empty
+ };
+ 
+ /**
+  * @class LoRaPacketPool
+  * @brief Fixed pool of preallocated packet buffers
+  */
+ class LoRaPacketPool {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaPacketPool();
+ 
+     /**
+      * @brief Take a free packet from the pool
+      * @return Handle to a zeroed packet header, empty if the pool is exhausted
+      */
+     LoRaPacketRef allocate();
+ 
+     /**
+      * @brief Get the number of free packets
+      * @return Free packet count
+      */
+     size_t available() const;
+ 
+     /**
+      * @brief Get the number of allocations that failed because the pool was empty
+      * @return Failed allocation count since boot
+      */
+     uint32_t getExhaustedCount() const;
+ 
+ private:
+     friend class LoRaPacketRef;
+ 
+     // Pool slot, the packet comes first so a packet pointer is a slot pointer
+     struct Slot {
+         LoRaPacket packet;       // Packet buffer
+         uint16_t refs;           // Live handles
+         int16_t next;            // Next free slot, -1 at the end
+     };
+ 
+     Slot _slots[TDECK_LORA_POOL_SIZE]; // Packet buffers
+     int16_t _freeHead;           // First free slot, -1 if exhausted
+     size_t _free;                // Free slot count
+     uint32_t _exhausted;         // Failed allocations
+     mutable portMUX_TYPE _lock;  // Guards the free list and reference counts
+ 
+     /**
+      * @brief Add a reference to a pooled packet
+      */
+     void retain(LoRaPacket* packet);
+ 
+     /**
+      * @brief Drop a reference, returning the slot to the pool on the last one
+      */
+     void release(LoRaPacket* packet);
+ };
+ 
+ // Global instance
+ extern LoRaPacketPool loraPacketPool;
+ 
+ #endif // TDECK_COMMS_LORA_PACKET_H
\ No newline at end of file
@@ -0,0 +1,374 @@
+/**
+ * @file lora_reliable.cpp
+ * @brief Implementation of asynchronous reliable LoRa delivery
+ */
+
+ #include "lora_reliable.h"
+ #include "lora.h"
+ #include "lora_stats.h"
+ #include "../system/trace.h"
+ 
+ // Sequence comparison that survives wrap-around
+ static inline int16_t seqDiff(uint16_t a, uint16_t b) {
+     return (int16_t)(a - b);
+ }
+ 
+ // Signed deadline check that survives millis() wrap-around
+ static inline bool isDue(uint32_t deadline, uint32_t now) {
+     return (int32_t)(deadline - now) <= 0;
+ }
+ 
+ // Constructor
+ LoRaReliable::LoRaReliable()
+     : _lock(NULL)
+     , _nextToken(1)
+     , _retransmits(0)
+ {
+     for (TxWindow& window : _tx) {
+         window.peer = 0;
+         window.nextSeq = 0;
+         window.count = 0;
+         window.lastUsed = 0;
+         for (Pending& slot : window.slots) {
+             slot.token = 0;
+         }
+     }
+     memset(_rx, 0, sizeof(_rx));
+ }
+ 
+ // Create the lock
+ bool LoRaReliable::init() {
+     if (!_lock) {
+         _lock = xSemaphoreCreateMutex();
+     }
+     return _lock != NULL;
+ }
+ 
+ // Queue a packet for reliable delivery
+ uint32_t LoRaReliable::send(LoRaPacketRef packet, LoRaDeliveryCallback callback, void* context) {
+     if (!packet || !_lock || packet->destId == 0xFFFF) {
+         return 0;
+     }
+ 
+     uint16_t destId = packet->destId;
+     uint32_t token = 0;
+     uint32_t now = millis();
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     TxWindow* window = txWindow(destId, true);
+     if (window && window->count < TDECK_LORA_WINDOW_SIZE) {
+         // The slot can still hold an unacknowledged packet a full window older
+         Pending& slot = window->slots[window->nextSeq % TDECK_LORA_WINDOW_SIZE];
+         if (slot.token == 0) {
+             packet->packetId = window->nextSeq++;
+             packet->flags |= LORA_FLAG_RELIABLE;
+ 
+             token = _nextToken++;
+             if (_nextToken == 0) {
+                 _nextToken = 1;
+             }
+ 
+             slot.packet = packet;
+             slot.token = token;
+             slot.attempts = 1;
+             slot.sentAt = now;
+             slot.deadline = now + retransmitTimeout(0);
+             slot.callback = callback;
+             slot.context = context;
+ 
+             window->count++;
+             window->lastUsed = now;
+         }
+     }
+     xSemaphoreGive(_lock);
+ 
+     // A full window is flow control, the caller decides whether to retry
+     if (token == 0) {
+         return 0;
+     }
+ 
+     loraManager.sendPacket(packet);
+     return token;
+ }
+ 
+ // Process an ACK addressed to us
+ void LoRaReliable::onAck(const LoRaPacket& packet) {
+     if (!_lock || packet.length < 2) {
+         return;
+     }
+ 
+     // Windowed ACKs carry the next expected sequence and a selective bitmap,
+     // legacy nodes acknowledge exactly one packet ID
+     bool windowed = (packet.flags & LORA_FLAG_ACK) && packet.length >= LORA_ACK_PAYLOAD_SIZE;
+     uint16_t seq = (packet.payload[0] << 8) | packet.payload[1];
+     uint32_t bitmap = 0;
+     if (windowed) {
+         bitmap = ((uint32_t)packet.payload[2] << 24) | ((uint32_t)packet.payload[3] << 16) |
+                  ((uint32_t)packet.payload[4] << 8) | packet.payload[5];
+     }
+ 
+     Completion completions[TDECK_LORA_WINDOW_SIZE];
+     int count = 0;
+     uint32_t now = millis();
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     TxWindow* window = txWindow(packet.sourceId, false);
+     if (window) {
+         window->lastUsed = now;
+ 
+         for (Pending& slot : window->slots) {
+             if (slot.token == 0) {
+                 continue;
+             }
+ 
+             int16_t d = seqDiff(slot.packet->packetId, seq);
+             bool acked;
+             if (windowed) {
+                 acked = d < 0 || (d >= 1 && d <= 32 && (bitmap & (1UL << (d - 1))));
+ 
+                 // Later packets arrived but this one did not, resend it now
+                 if (d == 0 && bitmap != 0 && slot.attempts == 1) {
+                     slot.deadline = now;
+                 }
+             } else {
+                 acked = d == 0;
+             }
+ 
+             if (acked) {
+                 complete(*window, slot, true, completions, count);
+             }
+         }
+     }
+     xSemaphoreGive(_lock);
+ 
+     report(completions, count);
+ }
+ 
+ // Record a received reliable packet and schedule its ACK
+ bool LoRaReliable::onData(const LoRaPacket& packet) {
+     if (!_lock) {
+         return true;
+     }
+ 
+     uint32_t now = millis();
+     uint16_t seq = packet.packetId;
+     bool fresh = false;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     RxWindow* window = rxWindow(packet.sourceId);
+ 
+     int16_t d = seqDiff(seq, window->expected);
+ 
+     // First packet from this source, or the sender restarted its sequence
+     if (window->lastUsed == 0 || d < -4 * TDECK_LORA_WINDOW_SIZE || d > 32) {
+         window->expected = seq;
+         window->received = 0;
+         d = 0;
+     }
+ 
+     if (d == 0) {
+         // Advance past this packet and everything already received after it
+         fresh = true;
+         window->expected++;
+         while (window->received & 1) {
+             window->received >>= 1;
+             window->expected++;
+         }
+         window->received >>= 1;
+     } else if (d > 0) {
+         uint32_t bit = 1UL << (d - 1);
+         fresh = !(window->received & bit);
+         window->received |= bit;
+     }
+ 
+     // One ACK covers everything that arrives within the delay
+     if (!window->ackPending) {
+         window->ackPending = true;
+         window->ackDeadline = now + TDECK_LORA_ACK_DELAY_MS;
+     }
+     window->lastUsed = now | 1;
+     xSemaphoreGive(_lock);
+ 
+     return fresh;
+ }
+ 
+ // Send due ACKs and retransmissions
+ uint32_t LoRaReliable::service() {
+     if (!_lock) {
+         return UINT32_MAX;
+     }
+ 
+     LoRaPacketRef outgoing[TDECK_LORA_RELIABLE_PEERS * (TDECK_LORA_WINDOW_SIZE + 1)];
+     int outgoingCount = 0;
+     Completion completions[TDECK_LORA_RELIABLE_PEERS * TDECK_LORA_WINDOW_SIZE];
+     int count = 0;
+     uint32_t now = millis();
+     uint32_t next = UINT32_MAX;
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+ 
+     for (TxWindow& window : _tx) {
+         if (window.count == 0) {
+             continue;
+         }
+ 
+         for (Pending& slot : window.slots) {
+             if (slot.token == 0) {
+                 continue;
+             }
+ 
+             if (isDue(slot.deadline, now)) {
+                 if (slot.attempts > TDECK_LORA_MAX_RETRIES) {
+                     TDECK_TRACE_W(LORA, "LoRa packet %d to 0x%04X not acknowledged", slot.packet->packetId, window.peer);
+                     complete(window, slot, false, completions, count);
+                     continue;
+                 }
+ 
+                 slot.deadline = now + retransmitTimeout(slot.attempts);
+                 slot.packet->attempt = slot.attempts;
+                 slot.attempts++;
+                 outgoing[outgoingCount++] = slot.packet;
+                 _retransmits++;
+             }
+ 
+             next = min(next, slot.deadline - now);
+         }
+     }
+ 
+     for (RxWindow& window : _rx) {
+         if (!window.ackPending) {
+             continue;
+         }
+ 
+         if (!isDue(window.ackDeadline, now)) {
+             next = min(next, window.ackDeadline - now);
+             continue;
+         }
+ 
+         LoRaPacketRef ack = loraManager.createPacket(LORA_MSG_ACK, window.peer);
+         if (!ack) {
+             // Pool exhausted, try again shortly
+             next = min(next, (uint32_t)TDECK_LORA_ACK_DELAY_MS);
+             continue;
+         }
+ 
+         ack->flags = LORA_FLAG_ACK;
+         ack->payload[0] = window.expected >> 8;
+         ack->payload[1] = window.expected & 0xFF;
+         ack->payload[2] = window.received >> 24;
+         ack->payload[3] = (window.received >> 16) & 0xFF;
+         ack->payload[4] = (window.received >> 8) & 0xFF;
+         ack->payload[5] = window.received & 0xFF;
+         ack->length = LORA_ACK_PAYLOAD_SIZE;
+ 
+         outgoing[outgoingCount++] = ack;
+         window.ackPending = false;
+     }
+ 
+     xSemaphoreGive(_lock);
+ 
+     for (int i = 0; i < outgoingCount; i++) {
+         loraManager.sendPacket(outgoing[i]);
+     }
+     report(completions, count);
+ 
+     return next;
+ }
+ 
+ // Get the number of packets waiting for an ACK
+ uint16_t LoRaReliable::getPendingCount() const {
+     if (!_lock) {
+         return 0;
+     }
+     
+     uint16_t pending = 0;
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     for (const TxWindow& window : _tx) {
+         pending += window.count;
+     }
+     xSemaphoreGive(_lock);
+     return pending;
+ }
+ 
+ // Get the number of retransmissions
+ uint32_t LoRaReliable::getRetransmitCount() const {
+     return _retransmits;
+ }
+ 
+ // Find or claim the send window for a destination
+ LoRaReliable::TxWindow* LoRaReliable::txWindow(uint16_t peer, bool create) {
+     TxWindow* idle = nullptr;
+ 
+     for (TxWindow& window : _tx) {
+         if (window.lastUsed != 0 && window.peer == peer) {
+             return &window;
+         }
+ 
+         // Only windows without outstanding packets can be reused
+         if (window.count == 0 && (!idle || window.lastUsed < idle->lastUsed)) {
+             idle = &window;
+         }
+     }
+ 
+     if (!create || !idle) {
+         return nullptr;
+     }
+ 
+     // Random start so a restarted sender is not mistaken for duplicates
+     idle->peer = peer;
+     idle->nextSeq = esp_random() & 0xFFFF;
+     idle->lastUsed = millis() | 1;
+     return idle;
+ }
+ 
+ // Find or claim the receive window for a source, evicting the stalest
+ LoRaReliable::RxWindow* LoRaReliable::rxWindow(uint16_t peer) {
+     RxWindow* oldest = &_rx[0];
+ 
+     for (RxWindow& window : _rx) {
+         if (window.lastUsed != 0 && window.peer == peer) {
+             return &window;
+         }
+         if (window.lastUsed < oldest->lastUsed) {
+             oldest = &window;
+         }
+     }
+ 
+     memset(oldest, 0, sizeof(*oldest));
+     oldest->peer = peer;
+     return oldest;
+ }
+ 
+ // Exponential backoff with jitter so colliding senders drift apart
+ uint32_t LoRaReliable::retransmitTimeout(uint8_t attempts) {
+     uint32_t timeout = (uint32_t)TDECK_LORA_ACK_TIMEOUT_MS << min((int)attempts, 4);
+     return timeout + esp_random() % (TDECK_LORA_ACK_TIMEOUT_MS / 4 + 1);
+ }
+ 
+ // Complete the packet in a slot
+ void LoRaReliable::complete(TxWindow& window, Pending& slot, bool delivered, Completion* out, int& count) {
+     Completion& completion = out[count++];
+     completion.token = slot.token;
+     completion.destId = window.peer;
+     completion.delivered = delivered;
+     completion.callback = slot.callback;
+     completion.context = slot.context;
+ 
+     // Only packets acknowledged on their first attempt give an unambiguous round trip
+     uint32_t rtt = delivered && slot.attempts == 1 ? max((uint32_t)(millis() - slot.sentAt), (uint32_t)1) : 0;
+     loraStats.noteDelivery(window.peer, delivered, slot.attempts, rtt);
+ 
+     slot.packet.reset();
+     slot.token = 0;
+     window.count--;
+ }
+ 
+ // Report collected completions outside the lock
+ void LoRaReliable::report(const Completion* completions, int count) {
+     for (int i = 0; i < count; i++) {
+         const Completion& completion = completions[i];
+         if (completion.callback) {
+             completion.callback(completion.token, completion.destId, completion.delivered, completion.context);
+         }
+     }
+ }
\ No newline at end of file
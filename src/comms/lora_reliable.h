@@ -0,0 +1,161 @@
+/**
+ * @file lora_reliable.h
+ * @brief Asynchronous reliable delivery for LoRa packets
+ *
+ * This file contains the delivery engine used by LoRaManager for packets
+ * that need an acknowledgment. Each destination gets its own sliding window
+ * of outstanding packets with retransmit timers, so messages to different
+ * peers never wait for each other. Receivers answer with one cumulative ACK
+ * plus a selective bitmap for everything that arrived within a short delay.
+ */
+
+ #ifndef TDECK_COMMS_LORA_RELIABLE_H
+ #define TDECK_COMMS_LORA_RELIABLE_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "lora_packet.h"
+ 
+ // Payload of a windowed ACK: next expected sequence (2) and selective bitmap (4)
+ #define LORA_ACK_PAYLOAD_SIZE 6
+ 
+ // Completion callback, runs on the LoRa comms task
+ typedef void (*LoRaDeliveryCallback)(uint32_t token, uint16_t destId, bool delivered, void* context);
+ 
+ /**
+  * @class LoRaReliable
+  * @brief Per-destination windows, retransmit timers and ACK aggregation
+  *
+  * All methods may be called from any task. Transmissions are handed to
+  * LoRaManager::sendPacket() so the radio stays owned by the comms task.
+  */
+ class LoRaReliable {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaReliable();
+ 
+     /**
+      * @brief Create the lock, call before any other method
+      * @return true if successful
+      */
+     bool init();
+ 
+     /**
+      * @brief Queue a packet for reliable delivery
+      *
+      * Assigns the per-destination sequence number and returns at once. The
+      * callback reports delivery or failure after the last retry.
+      *
+      * @param packet Unicast packet to deliver
+      * @param callback Completion callback, may be nullptr
+      * @param context Passed to the callback
+      * @return Delivery token, 0 if the destination's window is full
+      */
+     uint32_t send(LoRaPacketRef packet, LoRaDeliveryCallback callback, void* context);
+ 
+     /**
+      * @brief Process an ACK addressed to us
+      * @param packet Received ACK, windowed or single-packet legacy format
+      */
+     void onAck(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Record a received reliable packet and schedule its ACK
+      * @param packet Received packet with LORA_FLAG_RELIABLE
+      * @return true if the packet is new, false for a retransmitted duplicate
+      */
+     bool onData(const LoRaPacket& packet);
+ 
+     /**
+      * @brief Send due ACKs and retransmissions
+      * @return Milliseconds until the next deadline, UINT32_MAX if idle
+      */
+     uint32_t service();
+ 
+     /**
+      * @brief Get the number of packets waiting for an ACK
+      * @return Outstanding packet count
+      */
+     uint16_t getPendingCount() const;
+ 
+     /**
+      * @brief Get the number of retransmissions since boot
+      * @return Retransmission count
+      */
+     uint32_t getRetransmitCount() const;
+ 
+ private:
+     // Packet waiting for its ACK
+     struct Pending {
+         LoRaPacketRef packet;            // Packet as sent, shared with the TX queue
+         uint32_t token;                  // Delivery token, 0 if the slot is free
+         uint32_t deadline;               // millis() of the next retransmission
+         uint32_t sentAt;                 // millis() the packet was queued
+         uint8_t attempts;                // Transmissions so far
+         LoRaDeliveryCallback callback;   // Completion callback
+         void* context;                   // Callback context
+     };
+ 
+     // Outstanding packets to one destination, slot = sequence % window size
+     struct TxWindow {
+         uint16_t peer;                   // Destination device ID
+         uint16_t nextSeq;                // Sequence of the next new packet
+         uint8_t count;                   // Slots in use
+         uint32_t lastUsed;               // millis() of the last activity, 0 if unused
+         Pending slots[TDECK_LORA_WINDOW_SIZE];
+     };
+ 
+     // Receive state for one source
+     struct RxWindow {
+         uint16_t peer;                   // Source device ID
+         uint16_t expected;               // Lowest sequence not yet received
+         uint32_t received;               // Bit i set: expected + 1 + i received
+         bool ackPending;                 // An ACK is scheduled
+         uint32_t ackDeadline;            // millis() the ACK is due
+         uint32_t lastUsed;               // millis() of the last packet, 0 if unused
+     };
+ 
+     // Completion collected under the lock, reported after it is released
+     struct Completion {
+         uint32_t token;
+         uint16_t destId;
+         bool delivered;
+         LoRaDeliveryCallback callback;
+         void* context;
+     };
+ 
+     TxWindow _tx[TDECK_LORA_RELIABLE_PEERS];    // Send windows per destination
+     RxWindow _rx[TDECK_LORA_RELIABLE_PEERS];    // Receive windows per source
+     SemaphoreHandle_t _lock;                    // Guards both tables
+     uint32_t _nextToken;                        // Next delivery token
+     uint32_t _retransmits;                      // Retransmissions since boot
+ 
+     /**
+      * @brief Find or claim the send window for a destination, caller holds _lock
+      */
+     TxWindow* txWindow(uint16_t peer, bool create);
+ 
+     /**
+      * @brief Find or claim the receive window for a source, caller holds _lock
+      */
+     RxWindow* rxWindow(uint16_t peer);
+ 
+     /**
+      * @brief Retransmit timeout for the given attempt, with exponential backoff and jitter
+      */
+     static uint32_t retransmitTimeout(uint8_t attempts);
+ 
+     /**
+      * @brief Complete the packet in a slot, caller holds _lock
+      */
+     void complete(TxWindow& window, Pending& slot, bool delivered, Completion* out, int& count);
+ 
+     /**
+      * @brief Report collected completions
+      */
+     static void report(const Completion* completions, int count);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_RELIABLE_H
\ No newline at end of file
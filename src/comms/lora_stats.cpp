@@ -0,0 +1,224 @@
+/**
+ * @file lora_stats.cpp
+ * @brief Implementation of LoRa airtime and link statistics
+ */
+
+ #include "lora_stats.h"
+ 
+ // Global instance
+ LoRaStats loraStats;
+ 
+ // Smallest round-trip time histogram bound in ms
+ static const uint32_t RTT_FIRST_BUCKET_MS = 64;
+ 
+ // Constructor
+ LoRaStats::LoRaStats()
+     : _txAirtime(0)
+     , _rxAirtime(0)
+     , _txFrames(0)
+     , _rxFrames(0)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+     memset(_dutyAirtime, 0, sizeof(_dutyAirtime));
+     memset(_dutyMinute, 0, sizeof(_dutyMinute));
+     memset(&_totals, 0, sizeof(_totals));
+     memset(_peers, 0, sizeof(_peers));
+     _totals.peer = 0xFFFF;
+ }
+ 
+ // Semtech time-on-air formula, explicit header and CRC on
+ uint32_t LoRaStats::timeOnAir(size_t frameLength, int spreadingFactor, long bandwidth, int codingRate,
+                               long preambleLength) {
+     if (bandwidth <= 0) {
+         return 0;
+     }
+ 
+     uint64_t symbolNanos = ((uint64_t)1000000000 << spreadingFactor) / bandwidth;
+ 
+     // Low data rate optimization carries two bits less per symbol
+     bool lowRate = symbolNanos > 16000000;
+     int payloadBits = 8 * (int)frameLength - 4 * spreadingFactor + 28 + 16;
+     int bitsPerBlock = 4 * (spreadingFactor - (lowRate ? 2 : 0));
+     int payloadSymbols = 8;
+     if (payloadBits > 0) {
+         payloadSymbols += (payloadBits + bitsPerBlock - 1) / bitsPerBlock * codingRate;
+     }
+ 
+     // Preamble plus 4.25 sync symbols, counted in quarter symbols
+     uint64_t quarters = (uint64_t)preambleLength * 4 + 17 + (uint64_t)payloadSymbols * 4;
+     return (uint32_t)(quarters * symbolNanos / 4000);
+ }
+ 
+ // Charge a transmitted frame to the current minute
+ void LoRaStats::noteTransmit(uint32_t airtimeMicros) {
+     uint32_t minute = millis() / 60000;
+     int bucket = minute % TDECK_LORA_DUTY_WINDOW_MIN;
+ 
+     portENTER_CRITICAL(&_lock);
+     if (_dutyMinute[bucket] != minute) {
+         _dutyMinute[bucket] = minute;
+         _dutyAirtime[bucket] = 0;
+     }
+     _dutyAirtime[bucket] += airtimeMicros;
+     _txAirtime += airtimeMicros;
+     _txFrames++;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Count a received frame
+ void LoRaStats::noteReceive(uint32_t airtimeMicros) {
+     portENTER_CRITICAL(&_lock);
+     _rxAirtime += airtimeMicros;
+     _rxFrames++;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Record a completed reliable packet against the peer and the totals
+ void LoRaStats::noteDelivery(uint16_t peer, bool delivered, uint8_t attempts, uint32_t rttMs) {
+     uint32_t now = millis() | 1;
+ 
+     portENTER_CRITICAL(&_lock);
+     LoRaPeerStats* entry = &_peers[0];
+     for (LoRaPeerStats& stats : _peers) {
+         if (stats.lastUsed != 0 && stats.peer == peer) {
+             entry = &stats;
+             break;
+         }
+         if (stats.lastUsed < entry->lastUsed) {
+             entry = &stats;
+         }
+     }
+ 
+     // Evict the least recently used peer
+     if (entry->lastUsed == 0 || entry->peer != peer) {
+         memset(entry, 0, sizeof(*entry));
+         entry->peer = peer;
+     }
+ 
+     add(*entry, delivered, attempts, rttMs, now);
+     add(_totals, delivered, attempts, rttMs, now);
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Get the transmit duty cycle over the window
+ float LoRaStats::getDutyCycle() const {
+     uint32_t minute = millis() / 60000;
+     uint64_t airtime = 0;
+ 
+     portENTER_CRITICAL(&_lock);
+     for (int i = 0; i < TDECK_LORA_DUTY_WINDOW_MIN; i++) {
+         if (minute - _dutyMinute[i] < TDECK_LORA_DUTY_WINDOW_MIN) {
+             airtime += _dutyAirtime[i];
+         }
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     return airtime * 100.0f / (TDECK_LORA_DUTY_WINDOW_MIN * 60000000.0f);
+ }
+ 
+ // Get the total transmit airtime
+ uint64_t LoRaStats::getTxAirtime() const {
+     portENTER_CRITICAL(&_lock);
+     uint64_t airtime = _txAirtime;
+     portEXIT_CRITICAL(&_lock);
+     return airtime;
+ }
+ 
+ // Get the total receive airtime
+ uint64_t LoRaStats::getRxAirtime() const {
+     portENTER_CRITICAL(&_lock);
+     uint64_t airtime = _rxAirtime;
+     portEXIT_CRITICAL(&_lock);
+     return airtime;
+ }
+ 
+ // Get the number of frames transmitted
+ uint32_t LoRaStats::getTxFrames() const {
+     return _txFrames;
+ }
+ 
+ // Get the number of frames received
+ uint32_t LoRaStats::getRxFrames() const {
+     return _rxFrames;
+ }
+ 
+ // Get the statistics of all peers together
+ void LoRaStats::getTotals(LoRaPeerStats& totals) const {
+     portENTER_CRITICAL(&_lock);
+     totals = _totals;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Copy out the peers in use
+ int LoRaStats::getPeers(LoRaPeerStats* out, int max) const {
+     int count = 0;
+ 
+     portENTER_CRITICAL(&_lock);
+     for (const LoRaPeerStats& stats : _peers) {
+         if (count >= max) {
+             break;
+         }
+         if (stats.lastUsed != 0) {
+             out[count++] = stats;
+         }
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     return count;
+ }
+ 
+ // Clear all counters
+ void LoRaStats::reset() {
+     portENTER_CRITICAL(&_lock);
+     _txAirtime = 0;
+     _rxAirtime = 0;
+     _txFrames = 0;
+     _rxFrames = 0;
+     memset(&_totals, 0, sizeof(_totals));
+     memset(_peers, 0, sizeof(_peers));
+     _totals.peer = 0xFFFF;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Walk the histogram to the bucket holding the percentile
+ uint32_t LoRaStats::rttPercentile(const LoRaPeerStats& stats, int percent) {
+     if (stats.rttSamples == 0) {
+         return 0;
+     }
+ 
+     uint32_t target = ((uint64_t)stats.rttSamples * constrain(percent, 1, 100) + 99) / 100;
+     uint32_t seen = 0;
+     for (int i = 0; i < LORA_RTT_BUCKETS - 1; i++) {
+         seen += stats.rttHistogram[i];
+         if (seen >= target) {
+             return min(RTT_FIRST_BUCKET_MS << i, stats.rttMaxMs);
+         }
+     }
+     return stats.rttMaxMs;
+ }
+ 
+ // Add a completion to one set of statistics
+ void LoRaStats::add(LoRaPeerStats& stats, bool delivered, uint8_t attempts, uint32_t rttMs, uint32_t now) {
+     if (delivered) {
+         stats.delivered++;
+     } else {
+         stats.failed++;
+     }
+     if (attempts > 1) {
+         stats.retransmits += attempts - 1;
+     }
+     stats.lastUsed = now;
+ 
+     if (rttMs == 0) {
+         return;
+     }
+ 
+     int bucket = 0;
+     while (bucket < LORA_RTT_BUCKETS - 1 && rttMs >= (RTT_FIRST_BUCKET_MS << bucket)) {
+         bucket++;
+     }
+     stats.rttHistogram[bucket]++;
+     stats.rttSamples++;
+     stats.rttTotalMs += rttMs;
+     stats.rttMaxMs = max(stats.rttMaxMs, rttMs);
+ }
\ No newline at end of file
@@ -0,0 +1,162 @@
+/**
+ * @file lora_stats.h
+ * @brief LoRa airtime and link statistics
+ *
+ * This file contains the metrics shared by the LoRa layers. Every frame sent
+ * or received is charged its time-on-air at the rate it went out on, which
+ * feeds a rolling one-hour duty-cycle window. Reliable delivery reports each
+ * completed packet, giving per-peer delivery ratios, retransmission counts
+ * and a round-trip time histogram.
+ */
+
+ #ifndef TDECK_COMMS_LORA_STATS_H
+ #define TDECK_COMMS_LORA_STATS_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // Round-trip time histogram buckets, bucket i counts RTTs below 64 << i ms, the last is open
+ #define LORA_RTT_BUCKETS 8
+ 
+ // Delivery statistics for one peer, or for all peers together
+ struct LoRaPeerStats {
+     uint16_t peer;                           // Peer device ID, 0xFFFF for the totals
+     uint32_t delivered;                      // Reliable packets acknowledged
+     uint32_t failed;                         // Reliable packets lost after the last retry
+     uint32_t retransmits;                    // Retransmissions of completed packets
+     uint32_t rttSamples;                     // Packets acknowledged on the first attempt
+     uint32_t rttTotalMs;                     // Sum of the sampled round-trip times
+     uint32_t rttMaxMs;                       // Largest sampled round-trip time
+     uint32_t rttHistogram[LORA_RTT_BUCKETS]; // Sampled round-trip times by bucket
+     uint32_t lastUsed;                       // millis() of the last completion, 0 if unused
+ };
+ 
+ /**
+  * @class LoRaStats
+  * @brief Time-on-air, duty cycle, delivery ratio and round-trip times
+  *
+  * All methods may be called from any task.
+  */
+ class LoRaStats {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaStats();
+ 
+     /**
+      * @brief Compute the time-on-air of a frame
+      *
+      * Uses the Semtech SX127x formula for explicit header mode with CRC,
+      * with low data rate optimization above 16 ms per symbol as the radio
+      * driver enables it.
+      *
+      * @param frameLength Bytes on the air, header and trailer included
+      * @param spreadingFactor Spreading factor (6-12)
+      * @param bandwidth Bandwidth in Hz
+      * @param codingRate Coding rate (5-8, representing 4/5-4/8)
+      * @param preambleLength Preamble length in symbols
+      * @return Time-on-air in microseconds
+      */
+     static uint32_t timeOnAir(size_t frameLength, int spreadingFactor, long bandwidth, int codingRate,
+                               long preambleLength);
+ 
+     /**
+      * @brief Charge a transmitted frame to the duty-cycle window
+      * @param airtimeMicros Time-on-air of the frame
+      */
+     void noteTransmit(uint32_t airtimeMicros);
+ 
+     /**
+      * @brief Count a received frame
+      * @param airtimeMicros Time-on-air of the frame
+      */
+     void noteReceive(uint32_t airtimeMicros);
+ 
+     /**
+      * @brief Record a completed reliable packet
+      * @param peer Destination device ID
+      * @param delivered true if acknowledged
+      * @param attempts Transmissions of the packet
+      * @param rttMs Round-trip time, 0 if not sampled
+      */
+     void noteDelivery(uint16_t peer, bool delivered, uint8_t attempts, uint32_t rttMs);
+ 
+     /**
+      * @brief Get the transmit duty cycle over the last hour
+      * @return Share of the window spent transmitting, in percent
+      */
+     float getDutyCycle() const;
+ 
+     /**
+      * @brief Get the total transmit time-on-air since boot or reset
+      * @return Airtime in microseconds
+      */
+     uint64_t getTxAirtime() const;
+ 
+     /**
+      * @brief Get the total receive time-on-air since boot or reset
+      * @return Airtime in microseconds
+      */
+     uint64_t getRxAirtime() const;
+ 
+     /**
+      * @brief Get the number of frames transmitted
+      * @return Frame count
+      */
+     uint32_t getTxFrames() const;
+ 
+     /**
+      * @brief Get the number of frames received
+      * @return Frame count
+      */
+     uint32_t getRxFrames() const;
+ 
+     /**
+      * @brief Get the statistics of all peers together
+      * @param totals Receives the totals
+      */
+     void getTotals(LoRaPeerStats& totals) const;
+ 
+     /**
+      * @brief Get the statistics of recently used peers
+      * @param out Receives up to max entries
+      * @param max Capacity of out
+      * @return Number of entries written
+      */
+     int getPeers(LoRaPeerStats* out, int max) const;
+ 
+     /**
+      * @brief Clear all counters, the duty-cycle window is kept
+      */
+     void reset();
+ 
+     /**
+      * @brief Estimate a round-trip time percentile from the histogram
+      * @param stats Peer or total statistics
+      * @param percent Percentile (1-100)
+      * @return Upper bound of the bucket holding the percentile in ms, 0 without samples
+      */
+     static uint32_t rttPercentile(const LoRaPeerStats& stats, int percent);
+ 
+ private:
+     uint32_t _dutyAirtime[TDECK_LORA_DUTY_WINDOW_MIN];  // Transmit airtime per minute in microseconds
+     uint32_t _dutyMinute[TDECK_LORA_DUTY_WINDOW_MIN];   // Minute since boot each bucket belongs to
+     uint64_t _txAirtime;                                // Transmit airtime since reset
+     uint64_t _rxAirtime;                                // Receive airtime since reset
+     uint32_t _txFrames;                                 // Frames transmitted since reset
+     uint32_t _rxFrames;                                 // Frames received since reset
+     LoRaPeerStats _totals;                              // All peers together
+     LoRaPeerStats _peers[TDECK_LORA_STATS_PEERS];       // Most recently used peers
+     mutable portMUX_TYPE _lock;                         // Guards all counters
+ 
+     /**
+      * @brief Add a completion to one set of statistics, caller holds _lock
+      */
+     static void add(LoRaPeerStats& stats, bool delivered, uint8_t attempts, uint32_t rttMs, uint32_t now);
+ };
+ 
+ // Global instance
+ extern LoRaStats loraStats;
+ 
+ #endif // TDECK_COMMS_LORA_STATS_H
\ No newline at end of file
@@ -0,0 +1,276 @@
+/**
+ * @file lora_voice.cpp
+ * @brief Implementation of push-to-talk voice notes over LoRa
+ */
+
+ #include "lora_voice.h"
+ #include "lora.h"
+ #include "../hal/audio.h"
+ #include "../system/fs_manager.h"
+ #include <esp_heap_caps.h>
+ 
+ // Payload layout version
+ #define VOICE_VERSION 1
+ 
+ // Fixed part of the payload header, the sender name follows it
+ #define VOICE_HEADER_SIZE 6
+ 
+ // Global instance
+ LoRaVoice loraVoice;
+ 
+ // Received note handed from the LoRa comms task to a decode task
+ struct VoiceNote {
+     uint16_t sourceId;
+     size_t length;
+     uint8_t data[];
+ };
+ 
+ // Constructor
+ LoRaVoice::LoRaVoice()
+     : _note(nullptr)
+     , _noteFrames(0)
+     , _maxFrames(0)
+     , _frame(nullptr)
+     , _frameFill(0)
+     , _carry(0)
+     , _carrying(false)
+     , _destId(0xFFFF)
+     , _recording(false)
+     , _callback(nullptr)
+     , _decodeLock(NULL)
+ {
+ }
+ 
+ // Start listening for voice notes
+ bool LoRaVoice::init() {
+     if (!_decodeLock) {
+         _decodeLock = xSemaphoreCreateMutex();
+     }
+     if (!_decodeLock || !loraManager.addTransferCallback(onTransfer)) {
+         TDECK_LOG_E("Failed to start voice notes");
+         return false;
+     }
+     return true;
+ }
+ 
+ // Start recording a note
+ bool LoRaVoice::startNote(uint16_t destId) {
+     if (_recording) {
+         cancelNote();
+     }
+     if (!_encoder.begin()) {
+         return false;
+     }
+ 
+     // The whole note stays in PSRAM until it is sent
+     size_t samplesPerFrame = _encoder.getSamplesPerFrame();
+     _maxFrames = (size_t)((uint64_t)TDECK_LORA_VOICE_MAX_MS * VOICE_SAMPLE_RATE / 1000 / samplesPerFrame);
+     _note = (uint8_t*)heap_caps_malloc(_maxFrames * _encoder.getBytesPerFrame(), MALLOC_CAP_SPIRAM);
+     _frame = (int16_t*)malloc(samplesPerFrame * sizeof(int16_t));
+     if (!_note || !_frame) {
+         TDECK_LOG_E("Failed to allocate voice note buffers");
+         endNote();
+         return false;
+     }
+     _noteFrames = 0;
+     _frameFill = 0;
+     _carrying = false;
+     _destId = destId;
+ 
+     TDeckAudio::enableMicrophone(true);
+     if (!AudioRecorder::startStream(onCapture, this, TDECK_LORA_VOICE_MAX_MS)) {
+         endNote();
+         return false;
+     }
+     _recording = true;
+     return true;
+ }
+ 
+ // Stop recording and send the note
+ uint32_t LoRaVoice::finishNote(const String& sender) {
+     if (!_recording) {
+         return 0;
+     }
+ 
+     // Once the stream has stopped the sink has seen every frame
+     _recording = false;
+     AudioRecorder::stop();
+     if (_noteFrames == 0) {
+         endNote();
+         return 0;
+     }
+ 
+     size_t senderLength = min(sender.length(), (unsigned int)UINT8_MAX);
+     size_t bytesPerFrame = _encoder.getBytesPerFrame();
+     size_t length = VOICE_HEADER_SIZE + senderLength + _noteFrames * bytesPerFrame;
+     uint8_t* payload = (uint8_t*)heap_caps_malloc(length, MALLOC_CAP_SPIRAM);
+     if (!payload) {
+         TDECK_LOG_E("Failed to allocate voice note payload");
+         endNote();
+         return 0;
+     }
+ 
+     payload[0] = VOICE_VERSION;
+     payload[1] = TDECK_AUDIO_VOICE_BITRATE & 0xFF;
+     payload[2] = TDECK_AUDIO_VOICE_BITRATE >> 8;
+     payload[3] = _noteFrames & 0xFF;
+     payload[4] = _noteFrames >> 8;
+     payload[5] = senderLength;
+     memcpy(payload + VOICE_HEADER_SIZE, sender.c_str(), senderLength);
+     memcpy(payload + VOICE_HEADER_SIZE + senderLength, _note, _noteFrames * bytesPerFrame);
+ 
+     uint32_t durationMs = (uint32_t)((uint64_t)_noteFrames * _encoder.getSamplesPerFrame() * 1000 / VOICE_SAMPLE_RATE);
+     bool sent = loraManager.sendBuffer(LORA_MSG_VOICE, payload, length, _destId) != 0;
+     heap_caps_free(payload);
+     endNote();
+ 
+     if (!sent) {
+         TDECK_LOG_E("Failed to send voice note");
+         return 0;
+     }
+     TDECK_LOG_I("Sent voice note: %u ms in %u bytes", durationMs, (unsigned)length);
+     return durationMs;
+ }
+ 
+ // Stop recording and drop the note
+ void LoRaVoice::cancelNote() {
+     if (_recording) {
+         _recording = false;
+         AudioRecorder::stop();
+     }
+     endNote();
+ }
+ 
+ // Check if a note is being recorded
+ bool LoRaVoice::isRecording() const {
+     return _recording;
+ }
+ 
+ // Register the callback for received notes
+ void LoRaVoice::setReceiveCallback(LoRaVoiceCallback callback) {
+     _callback = callback;
+ }
+ 
+ // Free the note buffers
+ void LoRaVoice::endNote() {
+     heap_caps_free(_note);
+     free(_frame);
+     _note = nullptr;
+     _frame = nullptr;
+     _encoder.end();
+ }
+ 
+ // Recorder sink, runs on the recorder's writer task
+ void LoRaVoice::onCapture(const int16_t* frames, size_t count, void* context) {
+     LoRaVoice* voice = (LoRaVoice*)context;
+     const size_t samplesPerFrame = voice->_encoder.getSamplesPerFrame();
+     const size_t bytesPerFrame = voice->_encoder.getBytesPerFrame();
+ 
+     for (size_t i = 0; i < count && voice->_noteFrames < voice->_maxFrames; i++) {
+         // Two stereo input frames average into one 8 kHz sample, which also filters above 4 kHz
+         int32_t sum = frames[i * 2] + frames[i * 2 + 1];
+         if (!voice->_carrying) {
+             voice->_carry = sum;
+             voice->_carrying = true;
+             continue;
+         }
+         voice->_carrying = false;
+         voice->_frame[voice->_frameFill++] = (int16_t)((voice->_carry + sum) / 4);
+ 
+         if (voice->_frameFill == samplesPerFrame) {
+             voice->_encoder.encode(voice->_frame, voice->_note + voice->_noteFrames * bytesPerFrame);
+             voice->_noteFrames++;
+             voice->_frameFill = 0;
+         }
+     }
+ }
+ 
+ // Reassembled transfer callback, copies the note for a decode task
+ void LoRaVoice::onTransfer(uint16_t sourceId, uint8_t messageType, const uint8_t* data, size_t length) {
+     if (messageType != LORA_MSG_VOICE) {
+         return;
+     }
+     if (length < VOICE_HEADER_SIZE || data[0] != VOICE_VERSION) {
+         TDECK_LOG_W("Ignoring voice note from 0x%04X, unknown format", sourceId);
+         return;
+     }
+ 
+     // Decoding takes far longer than the comms task may be held up
+     VoiceNote* note = (VoiceNote*)heap_caps_malloc(sizeof(VoiceNote) + length, MALLOC_CAP_SPIRAM);
+     if (!note) {
+         TDECK_LOG_E("Failed to allocate received voice note");
+         return;
+     }
+     note->sourceId = sourceId;
+     note->length = length;
+     memcpy(note->data, data, length);
+ 
+     if (xTaskCreatePinnedToCore(decodeTaskFunc, "voice_decode", TDECK_LORA_VOICE_DECODE_STACK_SIZE, note,
+                                 TDECK_SYSTEM_TASK_PRIORITY, NULL, 0) != pdPASS) {
+         TDECK_LOG_E("Failed to create voice decode task");
+         heap_caps_free(note);
+     }
+ }
+ 
+ // Decode task, writes the note as 8 kHz mono WAV and plays it
+ void LoRaVoice::decodeTaskFunc(void* parameter) {
+     VoiceNote* note = (VoiceNote*)parameter;
+     const uint8_t* data = note->data;
+     uint16_t bitrate = data[1] | (data[2] << 8);
+     size_t frames = data[3] | (data[4] << 8);
+     size_t senderLength = data[5];
+ 
+     // Scoped so the decoder and file are destroyed before the task deletes itself
+     {
+         xSemaphoreTake(loraVoice._decodeLock, portMAX_DELAY);
+ 
+         VoiceCodec decoder;
+         FSStream file;
+         char path[TDECK_FS_MAX_PATH_LENGTH];
+         snprintf(path, sizeof(path), "%s/voice_%04X.wav", TDECK_FS_TEMP_DIR, note->sourceId);
+         bool ok = decoder.begin(bitrate) &&
+                   VOICE_HEADER_SIZE + senderLength + frames * decoder.getBytesPerFrame() <= note->length;
+         int16_t* samples = ok ? (int16_t*)malloc(decoder.getSamplesPerFrame() * sizeof(int16_t)) : nullptr;
+         ok = ok && samples && file.open(path, FILE_WRITE);
+ 
+         // The latest note of each peer is kept, so it can be played again
+         AudioFormat format = {VOICE_SAMPLE_RATE, 1, 16, 2, 0, 0, WAV_FORMAT_PCM, 0};
+         uint8_t header[WAV_HEADER_MAX_SIZE];
+         size_t headerSize = AudioDSP::buildWavHeader(header, format, 0);
+         ok = ok && file.write(header, headerSize) == (int64_t)headerSize;
+ 
+         const uint8_t* bits = data + VOICE_HEADER_SIZE + senderLength;
+         size_t frameBytes = ok ? decoder.getSamplesPerFrame() * sizeof(int16_t) : 0;
+         for (size_t i = 0; ok && i < frames; i++) {
+             decoder.decode(bits + i * decoder.getBytesPerFrame(), samples);
+             ok = file.write((const uint8_t*)samples, frameBytes) == (int64_t)frameBytes;
+         }
+ 
+         if (ok) {
+             format.dataSize = frames * frameBytes;
+             AudioDSP::buildWavHeader(header, format, frames * decoder.getSamplesPerFrame());
+             ok = file.seek(0) && file.write(header, headerSize) == (int64_t)headerSize;
+         }
+         if (file.is_open()) {
+             ok = file.close() && ok;
+         }
+         free(samples);
+         xSemaphoreGive(loraVoice._decodeLock);
+ 
+         if (ok) {
+             uint32_t durationMs = (uint32_t)((uint64_t)frames * decoder.getSamplesPerFrame() * 1000 / VOICE_SAMPLE_RATE);
+             String sender((const char*)data + VOICE_HEADER_SIZE, senderLength);
+             TDECK_LOG_I("Voice note from 0x%04X: %u ms", note->sourceId, durationMs);
+             TDeckAudio::playSound(path);
+             if (loraVoice._callback) {
+                 loraVoice._callback(note->sourceId, sender.c_str(), durationMs);
+             }
+         } else {
+             TDECK_LOG_E("Failed to decode voice note from 0x%04X", note->sourceId);
+         }
+ 
+     }
+ 
+     heap_caps_free(note);
+     vTaskDelete(NULL);
+ }
\ No newline at end of file
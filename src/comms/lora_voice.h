@@ -0,0 +1,112 @@
+/**
+ * @file lora_voice.h
+ * @brief Push-to-talk voice notes over LoRa
+ *
+ * While the talk button is held the microphone streams through the
+ * recording pipeline into a Codec2 encoder on the recorder's writer task,
+ * so encoding keeps pace with capture on core 0 and the UI task only starts
+ * and stops it. On release the encoded frames go out as one fragmented
+ * transfer. A receiver decodes the note on a short-lived core 0 task into a
+ * WAV file and plays it through the audio mixer.
+ *
+ * The payload is a small header followed by the Codec2 frames:
+ *
+ *     [version(1)][bitrate(2)][frames(2)][sender length(1)][sender][frames * frame bytes]
+ */
+
+ #ifndef TDECK_COMMS_LORA_VOICE_H
+ #define TDECK_COMMS_LORA_VOICE_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "../hal/voice_codec.h"
+ 
+ // Received note, runs on the decode task after playback has started
+ typedef void (*LoRaVoiceCallback)(uint16_t sourceId, const char* sender, uint32_t durationMs);
+ 
+ /**
+  * @class LoRaVoice
+  * @brief Records, sends, receives and plays Codec2 voice notes
+  */
+ class LoRaVoice {
+ public:
+     /**
+      * @brief Constructor
+      */
+     LoRaVoice();
+ 
+     /**
+      * @brief Start listening for voice notes
+      * @return true if successful
+      */
+     bool init();
+ 
+     /**
+      * @brief Start recording a note, any recording in progress is stopped
+      * @param destId Destination device ID (0xFFFF for broadcast)
+      * @return true if the microphone stream and encoder started
+      */
+     bool startNote(uint16_t destId = 0xFFFF);
+ 
+     /**
+      * @brief Stop recording and send the note
+      * @param sender Name shown to the receiver
+      * @return Length of the note sent in milliseconds, 0 if nothing was sent
+      */
+     uint32_t finishNote(const String& sender);
+ 
+     /**
+      * @brief Stop recording and drop the note
+      */
+     void cancelNote();
+ 
+     /**
+      * @brief Check if a note is being recorded
+      */
+     bool isRecording() const;
+ 
+     /**
+      * @brief Register the callback for received notes
+      * @param callback Callback, may be nullptr
+      */
+     void setReceiveCallback(LoRaVoiceCallback callback);
+ 
+ private:
+     VoiceCodec _encoder;           // Encoder of the note being recorded
+     uint8_t* _note;                // PSRAM encoded frames
+     size_t _noteFrames;            // Frames encoded
+     size_t _maxFrames;             // Frames that fit TDECK_LORA_VOICE_MAX_MS
+     int16_t* _frame;               // 8 kHz mono samples of the frame being filled
+     size_t _frameFill;
+     int32_t _carry;                // Sum of an input frame waiting for its pair
+     bool _carrying;
+     uint16_t _destId;
+     volatile bool _recording;
+     LoRaVoiceCallback _callback;
+     SemaphoreHandle_t _decodeLock; // One note decodes at a time
+ 
+     /**
+      * @brief Free the note buffers and the encoder
+      */
+     void endNote();
+ 
+     /**
+      * @brief Recorder sink, downmixes to 8 kHz mono and encodes whole frames
+      */
+     static void onCapture(const int16_t* frames, size_t count, void* context);
+ 
+     /**
+      * @brief Reassembled transfer callback, runs on the LoRa comms task
+      */
+     static void onTransfer(uint16_t sourceId, uint8_t messageType, const uint8_t* data, size_t length);
+ 
+     /**
+      * @brief Decodes one received note to a file and plays it
+      */
+     static void decodeTaskFunc(void* parameter);
+ };
+ 
+ // Global instance
+ extern LoRaVoice loraVoice;
+ 
+ #endif // TDECK_COMMS_LORA_VOICE_H
\ No newline at end of file
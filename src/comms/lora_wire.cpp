@@ -0,0 +1,69 @@
+/**
+ * @file lora_wire.cpp
+ * @brief Implementation of the LoRa frame layout
+ */
+
+ #include "lora_wire.h"
+ 
+ // Header fields
+ void LoRaWire::encodeHeader(const LoRaPacket& packet, uint8_t* header) {
+     header[0] = packet.messageType;
+     header[1] = packet.sourceId >> 8;
+     header[2] = packet.sourceId & 0xFF;
+     header[3] = packet.destId >> 8;
+     header[4] = packet.destId & 0xFF;
+     header[5] = packet.packetId >> 8;
+     header[6] = packet.packetId & 0xFF;
+     header[7] = packet.length;
+ }
+ 
+ // Capability level, flags, rate offer and route
+ void LoRaWire::encodeTrailer(const LoRaPacket& packet, uint8_t offer, uint8_t* trailer) {
+     trailer[0] = LORA_CAPS_MAGIC;
+     trailer[1] = LORA_CAPS_LEVEL;
+     trailer[2] = packet.flags;
+     trailer[3] = offer;
+     trailer[4] = (packet.hopCount << 4) | (packet.hopLimit & 0x0F);
+     trailer[5] = packet.attempt;
+ }
+ 
+ // Header, payload and trailer back to back
+ size_t LoRaWire::encode(const LoRaPacket& packet, uint8_t offer, uint8_t* frame) {
+     size_t length = min((size_t)packet.length, (size_t)(LORA_MAX_FRAME_SIZE - LORA_HEADER_SIZE - LORA_CAPS_TRAILER_SIZE));
+     encodeHeader(packet, frame);
+     frame[7] = length;
+     memcpy(frame + LORA_HEADER_SIZE, packet.payload, length);
+     encodeTrailer(packet, offer, frame + LORA_HEADER_SIZE + length);
+     return LORA_HEADER_SIZE + length + LORA_CAPS_TRAILER_SIZE;
+ }
+ 
+ // Split a frame into header, payload and trailer
+ LoRaWireStatus LoRaWire::decode(const uint8_t* frame, size_t size, LoRaPacket& packet) {
+     if (size < LORA_HEADER_SIZE) {
+         return LORA_WIRE_TOO_SHORT;
+     }
+     
+     size_t length = min((size_t)frame[7], size - LORA_HEADER_SIZE);
+     packet.messageType = frame[0];
+     packet.sourceId = (frame[1] << 8) | frame[2];
+     packet.destId = (frame[3] << 8) | frame[4];
+     packet.packetId = (frame[5] << 8) | frame[6];
+     packet.length = length;
+     memcpy(packet.payload, frame + LORA_HEADER_SIZE, length);
+     
+     // Earlier firmware sends fewer trailer fields, missing ones read as zero
+     const uint8_t* trailer = frame + LORA_HEADER_SIZE + length;
+     size_t extra = min(size - LORA_HEADER_SIZE - length, (size_t)LORA_CAPS_TRAILER_SIZE);
+     if (extra >= 2 && trailer[0] == LORA_CAPS_MAGIC) {
+         uint8_t fields[LORA_CAPS_TRAILER_SIZE] = {0, 0, 0, 0, 0, 0};
+         memcpy(fields, trailer, extra);
+         packet.schema = fields[1];
+         packet.flags = fields[2];
+         packet.rate = fields[3];
+         packet.hopCount = fields[4] >> 4;
+         packet.hopLimit = fields[4] & 0x0F;
+         packet.attempt = fields[5];
+     }
+     
+     return length < frame[7] ? LORA_WIRE_TRUNCATED : LORA_WIRE_OK;
+ }
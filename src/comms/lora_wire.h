@@ -0,0 +1,73 @@
+/**
+ * @file lora_wire.h
+ * @brief On-air frame layout of LoRa packets
+ *
+ * A frame is the 8-byte header, the payload and, from nodes that speak the
+ * binary schema, the capability trailer. Older nodes stop reading at the
+ * header length and never see the trailer. These functions only move bytes
+ * between a frame and a LoRaPacket, so the driver and host-side fuzzers
+ * share one parser.
+ */
+
+ #ifndef TDECK_COMMS_LORA_WIRE_H
+ #define TDECK_COMMS_LORA_WIRE_H
+ 
+ #include <Arduino.h>
+ #include "lora_packet.h"
+ #include "lora_codec.h"
+ 
+ // Largest frame on air: header, the longest payload and the trailer
+ #define LORA_MAX_FRAME_SIZE 255
+ 
+ // Result of decoding a received frame
+ enum LoRaWireStatus {
+     LORA_WIRE_OK = 0,           // Packet decoded
+     LORA_WIRE_TOO_SHORT,        // Shorter than the header
+     LORA_WIRE_TRUNCATED         // Fewer payload bytes than the header announces, the rest is decoded
+ };
+ 
+ /**
+  * @class LoRaWire
+  * @brief Frame encoder and decoder
+  */
+ class LoRaWire {
+ public:
+     /**
+      * @brief Write the header of a packet
+      * @param packet Packet to send
+      * @param header Receives LORA_HEADER_SIZE bytes
+      */
+     static void encodeHeader(const LoRaPacket& packet, uint8_t* header);
+ 
+     /**
+      * @brief Write the capability trailer of a packet
+      * @param packet Packet to send
+      * @param offer Data rate offered to the destination
+      * @param trailer Receives LORA_CAPS_TRAILER_SIZE bytes
+      */
+     static void encodeTrailer(const LoRaPacket& packet, uint8_t offer, uint8_t* trailer);
+ 
+     /**
+      * @brief Write a whole frame
+      * @param packet Packet to send
+      * @param offer Data rate offered to the destination
+      * @param frame Receives up to LORA_MAX_FRAME_SIZE bytes
+      * @return Frame length
+      */
+     static size_t encode(const LoRaPacket& packet, uint8_t offer, uint8_t* frame);
+ 
+     /**
+      * @brief Decode a received frame
+      *
+      * Fills the header, payload and trailer fields, the signal fields are
+      * left alone. A packet without a trailer keeps schema 0 and no flags.
+      *
+      * @param frame Frame as read from the radio FIFO
+      * @param size Frame length
+      * @param packet Packet to fill, its trailer fields should be zero
+      * @return LORA_WIRE_OK, or why the frame cannot be delivered
+      */
+     static LoRaWireStatus decode(const uint8_t* frame, size_t size, LoRaPacket& packet);
+ };
+ 
+ #endif // TDECK_COMMS_LORA_WIRE_H
@@ -9,6 +9,11 @@
  #include <esp_ota_ops.h>
  #include <stdarg.h>
  #include "../hal/power.h"
+ #include "../system/config_storage.h"
+ #include "../system/trace.h"
+ #include <esp_heap_caps.h>
+ #include <esp_rom_crc.h>
+ #include <mbedtls/sha256.h>
  
  // External reference to the power manager
  extern PowerManager powerManager;
@@ -26,6 +31,15 @@
  // Timeout for data transfers (ms)
  #define USB_TRANSFER_TIMEOUT 10000
  
+ // Set by the TinyUSB task when the host ejects the drive, handled in update()
+ static volatile bool mscEjected = false;
+ 
+ // Sector size of the lent card, for the MSC callbacks
+ static uint16_t mscSectorSize = 512;
+ 
+ // A binary chunk is always queued to the writer whole
+ static_assert(TDECK_USB_CHUNK_SIZE <= TDECK_FS_WRITER_SLOT_SIZE, "USB chunks must fit a writer slot");
+ 
  // External reference to the filesystem manager defined in main.cpp
  
  /**
@@ -35,8 +49,29 @@
      : _mode(USBMode::CDC_CONSOLE),
        _cmdBufferIndex(0),
        _transferActive(false),
+       _writeSlot(nullptr),
+       _writeFill(0),
        _connected(false),
-       _lastConnCheckTime(0) {
+       _lastConnCheckTime(0),
+       _binary(false),
+       _rxFrame(nullptr),
+       _rxLength(0),
+       _txChunk(nullptr),
+       _direction(USBTransferDirection::NONE),
+       _binarySize(0),
+       _chunkCount(0),
+       _windowBase(0),
+       _windowNext(0),
+       _pending(0),
+       _nacked(0),
+       _window(nullptr),
+       _filePosition(0),
+       _fileCrc(0),
+       _lastProgress(0),
+       _lastResend(0),
+       _retransmits(0),
+       _crcErrors(0),
+       _patch(false) {
      // Initialize command buffer
      memset(_cmdBuffer, 0, USB_CMD_BUFFER_SIZE);
  }
@@ -51,9 +86,21 @@
      TDECK_LOG_I("Initializing USB subsystem");
      
      // USB is already initialized by Arduino's USB.begin() in main.cpp
-     // We just need to set up our CDC serial interface
+     // We just need to set up our CDC serial interface. The receive buffer holds two
+     // binary frames, one being parsed while the host sends the next
+     _usbCDC.setRxBufferSize(TDECK_USB_RX_BUFFER_SIZE);
      _usbCDC.begin(115200);
      
+     // The drive enumerates with the CDC port but reports no media until MASS_STORAGE
+     _msc.vendorID("LILYGO");
+     _msc.productID("T-Deck SD");
+     _msc.productRevision(TDECK_FIRMWARE_VERSION);
+     _msc.onRead(_onMscRead);
+     _msc.onWrite(_onMscWrite);
+     _msc.onStartStop(_onMscStartStop);
+     _msc.mediaPresent(false);
+     _msc.begin(0, mscSectorSize);
+     
      // USB subsystem is initialized
      
      _mode = USBMode::CDC_CONSOLE;
@@ -73,6 +120,14 @@
   * This function should be called periodically from the main loop or system task
   */
  void USBManager::update() {
+     // The host ejected the drive, give the card back to the firmware
+     if (mscEjected) {
+         mscEjected = false;
+         if (_mode == USBMode::MASS_STORAGE) {
+             setMode(USBMode::CDC_CONSOLE);
+         }
+     }
+     
      // Check if USB is connected periodically
      unsigned long now = millis();
      if (now - _lastConnCheckTime > USB_CONN_CHECK_INTERVAL) {
@@ -84,6 +139,9 @@
          if (wasConnected != _connected) {
              if (_connected) {
                  TDECK_LOG_I("USB connected");
+                 // The USB peripheral stops in light sleep, stay awake for the host
+                 Power::lock(PowerLock::USB);
+                 
                  // Reset state
                  _resetCmdBuffer();
                  _transferActive = false;
@@ -93,68 +151,63 @@
                                USB_RESP_INFO, TDECK_FIRMWARE_NAME, TDECK_FIRMWARE_VERSION);
              } else {
                  TDECK_LOG_I("USB disconnected");
+                 Power::unlock(PowerLock::USB);
+                 
+                 // Binary mode ends with the session, the host starts again from text
+                 _exitBinary();
                  
-                 // If a transfer was active, close the file
-                 if (_transferActive && _transferFile) {
-                     _transferFile.close();
+                 // If a transfer was active, drop the partial file
+                 if (_transferActive) {
+                     _abortWrite();
                      _transferActive = false;
                  }
              }
          }
      }
      
+     // Binary mode has its own framing and timeouts
+     if (_binary) {
+         if (_connected) {
+             _serviceBinary();
+         }
+         return;
+     }
+     
      // Process received data
      if (_connected && _usbCDC.available()) {
-         // Read data from USB
-         while (_usbCDC.available()) {
+         // Read commands from USB. File data following a WRITE command and frames
+         // following a BINARY command are left for their own readers
+         while (_usbCDC.available() && !_binary && !_transferActive) {
              char c = _usbCDC.read();
              
-             // If in data transfer mode, handle binary data
-             if (_transferActive) {
-                 // Write to file directly
-                 if (_transferFile) {
-                     _transferFile.write(c);
-                     _transferredBytes++;
-                     
-                     // Check if transfer is complete
-                     if (_transferredBytes >= _totalTransferSize) {
-                         _transferFile.close();
-                         _transferActive = false;
-                         _sendAck(true, "Transfer complete");
-                         TDECK_LOG_I("File transfer complete: %s (%d bytes)", 
-                                     _currentTransferPath.c_str(), _transferredBytes);
-                     }
-                 } else {
-                     // Something went wrong with the file
-                     _transferActive = false;
-                     _sendAck(false, "File transfer error");
-                     TDECK_LOG_E("File transfer error: Invalid file handle");
-                 }
-             } else {
-                 // Handle command mode (line-based)
-                 if (c == '\n' || c == '\r') {
-                     // Process command if buffer contains data
-                     if (_cmdBufferIndex > 0) {
-                         _cmdBuffer[_cmdBufferIndex] = '\0';
-                         _processCommand(_cmdBuffer);
-                         _resetCmdBuffer();
-                     }
-                 } else if (_cmdBufferIndex < USB_CMD_BUFFER_SIZE - 1) {
-                     // Add to buffer
-                     _cmdBuffer[_cmdBufferIndex++] = c;
+             // Handle command mode (line-based)
+             if (c == '\n' || c == '\r') {
+                 // Process command if buffer contains data
+                 if (_cmdBufferIndex > 0) {
+                     _cmdBuffer[_cmdBufferIndex] = '\0';
+                     _processCommand(_cmdBuffer);
+                     _resetCmdBuffer();
                  }
+             } else if (_cmdBufferIndex < USB_CMD_BUFFER_SIZE - 1) {
+                 // Add to buffer
+                 _cmdBuffer[_cmdBufferIndex++] = c;
              }
          }
      }
      
+     // File data goes straight into writer slots
+     if (_connected && _transferActive) {
+         _receiveWriteData();
+     }
+     
      // Check for transfer timeout
      if (_transferActive) {
          if (millis() - _lastConnCheckTime > USB_TRANSFER_TIMEOUT) {
              // Transfer timed out
-             _transferFile.close();
+             _abortWrite();
              _transferActive = false;
              _sendAck(false, "Transfer timeout");
-             TDECK_LOG_E("File transfer timeout");
+             TDECK_TRACE_E(USB, "File transfer timeout");
          }
      }
  }
@@ -166,13 +219,19 @@
   */
  void USBManager::setMode(USBMode mode) {
      if (_mode != mode) {
+         if (_mode == USBMode::MASS_STORAGE) {
+             _stopMassStorage();
+         }
          _mode = mode;
          
          // Reset state when changing mode
          _resetCmdBuffer();
-         _transferActive = false;
+         if (_transferActive) {
+             _abortWrite();
+             _transferActive = false;
+         }
          
-         if (_transferFile) {
+         if (_transferFile.is_open()) {
              _transferFile.close();
          }
          
@@ -192,6 +251,19 @@
                  sendFormatted("%s Mode set to Firmware Update\r\n", USB_RESP_INFO);
                  break;
                  
+             case USBMode::MASS_STORAGE:
+                 // Binary transfers hold files on the card
+                 _exitBinary();
+                 if (_startMassStorage()) {
+                     TDECK_LOG_I("USB mode: Mass Storage");
+                     sendFormatted("%s Mode set to Mass Storage\r\n", USB_RESP_INFO);
+                 } else {
+                     _mode = USBMode::CDC_CONSOLE;
+                     sendFormatted("%s Mass storage unavailable: %s\r\n", USB_RESP_ERROR,
+                                   FSManager::get_last_error().c_str());
+                 }
+                 break;
+                 
              default:
                  TDECK_LOG_W("USB mode: Unknown (%d)", static_cast<int>(_mode));
                  break;
@@ -274,6 +346,8 @@
      sendFormatted("%s Entering firmware update mode. Device will reboot.\r\n", USB_RESP_INFO);
      
      // Small delay to allow USB message to be sent
+     configStorage.flush();
+     traceLog.drain();
      delay(500);
      
      // Restart in download mode
@@ -288,7 +362,7 @@
   * @param cmd The command string to process
   */
  void USBManager::_processCommand(const char* cmd) {
-     TDECK_LOG_I("USB command: %s", cmd);
+     TDECK_TRACE_I(USB, "USB command: %s", cmd);
      
      // Parse command and parameters
      String params[8];
@@ -372,6 +446,8 @@
      else if (params[0] == "REBOOT") {
          // Reboot device
          sendFormatted("%s Rebooting device...\r\n", USB_RESP_OK);
+         configStorage.flush();
+         traceLog.drain();
          delay(500);
          ESP.restart();
      }
@@ -379,15 +455,28 @@
          // Enter firmware update mode
          enterUpdateMode();
      }
+     else if (params[0] == "BINARY") {
+         // Switch to framed binary transfers until an EXIT frame or disconnect
+         if (_transferActive) {
+             _sendAck(false, "Transfer already active");
+         } else if (_enterBinary()) {
+             sendFormatted("%s BINARY %d %d %d\r\n", USB_RESP_OK, USB_BINARY_VERSION,
+                           TDECK_USB_CHUNK_SIZE, TDECK_USB_WINDOW);
+         } else {
+             _sendAck(false, "Out of memory");
+         }
+     }
      else if (params[0] == "MODE") {
          // Change USB mode
          if (paramCount < 2) {
              sendFormatted("%s Current mode: %d\r\n", USB_RESP_OK, static_cast<int>(_mode));
          } else {
              int mode = params[1].toInt();
-             if (mode >= 0 && mode <= 2) {
+             if (mode >= 0 && mode <= 3) {
                  setMode(static_cast<USBMode>(mode));
-                 _sendAck(true, "Mode changed");
+                 if (_mode == static_cast<USBMode>(mode)) {
+                     _sendAck(true, "Mode changed");
+                 }
              } else {
                  _sendAck(false, "Invalid mode");
              }
@@ -400,12 +489,13 @@
          sendFormatted("LIST [path] - List files in directory\r\n");
          sendFormatted("READ path - Read file content\r\n");
          sendFormatted("WRITE path size - Write file (binary data follows)\r\n");
+         sendFormatted("BINARY - Switch to framed binary transfers (tools/usb_transfer.py)\r\n");
          sendFormatted("DELETE path - Delete a file\r\n");
          sendFormatted("MKDIR path - Create a directory\r\n");
          sendFormatted("RMDIR path - Remove a directory\r\n");
          sendFormatted("INFO path - Get file information\r\n");
          sendFormatted("SYSINFO - Get system information\r\n");
-         sendFormatted("MODE [mode] - Get/set USB mode (0=CDC, 1=Transfer, 2=Update)\r\n");
+         sendFormatted("MODE [mode] - Get/set USB mode (0=CDC, 1=Transfer, 2=Update, 3=Mass storage)\r\n");
          sendFormatted("UPDATE - Enter firmware update mode\r\n");
          sendFormatted("REBOOT - Reboot device\r\n");
          sendFormatted("HELP - Show this help\r\n");
@@ -468,10 +558,12 @@
   * @param path File path to read
   */
  void USBManager::_handleReadFile(const String& path) {
-     // Open file for reading
-     File file = fsManager.open(path.c_str(), FILE_READ);
+     // Chunks are as large as the stream buffer, so the stream itself needs none
+     FSStream file;
+     uint8_t* buf = FSStream::alloc_buffer(TDECK_FS_STREAM_BUFFER_SIZE);
      
-     if (!file || !file.available()) {
+     if (!buf || !file.open(path.c_str(), FILE_READ, 0)) {
+         FSStream::free_buffer(buf);
          _sendAck(false, "Failed to open file");
          return;
      }
@@ -479,22 +571,17 @@
      // Get file size
      size_t fileSize = file.size();
      
-     // Send file size and prepare client for data
+     // Send file size, the data follows directly on the same stream
      sendFormatted("%s %d\r\n", USB_RESP_DATA, fileSize);
      
-     // Small delay to ensure client is ready
-     delay(100);
-     
      // Read and send file in chunks
-     const size_t bufSize = 1024;
-     uint8_t buf[bufSize];
      size_t bytesRead = 0;
      
      while (bytesRead < fileSize) {
-         size_t toRead = min(bufSize, fileSize - bytesRead);
-         size_t read = file.read(buf, toRead);
+         size_t toRead = min((size_t)TDECK_FS_STREAM_BUFFER_SIZE, fileSize - bytesRead);
+         int64_t read = file.read(buf, toRead);
          
-         if (read == 0) {
+         if (read <= 0) {
              break;
          }
          
@@ -503,9 +590,10 @@
      }
      
      file.close();
+     FSStream::free_buffer(buf);
      
      // Log success
-     TDECK_LOG_I("Sent file: %s (%d bytes)", path.c_str(), bytesRead);
+     TDECK_TRACE_I(USB, "Sent file: %s (%d bytes)", path.c_str(), bytesRead);
  }
  
  /**
@@ -529,18 +617,18 @@
      if (lastSlash > 0) {
          dirPath = dirPath.substring(0, lastSlash);
          fsManager.createDir(dirPath.c_str());
+         FSManager::invalidate_cache(dirPath.c_str());
      }
      
-     // Open file for writing
-     _transferFile = fsManager.open(path.c_str(), FILE_WRITE);
-     
-     if (!_transferFile) {
+     // Open file for writing, the writer task drains the data to it
+     if (!_writer.open(path.c_str())) {
          _sendAck(false, "Failed to create file");
          return false;
      }
      
      // Set up transfer state
      _currentTransferPath = path;
+     _writePath = path;
      _totalTransferSize = size;
      _transferredBytes = 0;
      _transferActive = true;
@@ -548,7 +636,7 @@
      
      // Acknowledge and start receiving data
      _sendAck(true, "Ready for data");
-     TDECK_LOG_I("Starting file transfer to: %s (%d bytes)", path.c_str(), size);
+     TDECK_TRACE_I(USB, "Starting file transfer to: %s (%d bytes)", path.c_str(), size);
      
      return true;
  }
@@ -560,8 +648,9 @@
   */
  void USBManager::_handleDeleteFile(const String& path) {
      if (fsManager.deleteFile(path.c_str())) {
+         FSManager::invalidate_cache(path.c_str());
          _sendAck(true, "File deleted");
-         TDECK_LOG_I("Deleted file: %s", path.c_str());
+         TDECK_TRACE_I(USB, "Deleted file: %s", path.c_str());
      } else {
          _sendAck(false, "Failed to delete file");
      }
@@ -574,8 +663,9 @@
   */
  void USBManager::_handleMakeDir(const String& path) {
      if (fsManager.createDir(path.c_str())) {
+         FSManager::invalidate_cache(path.c_str());
          _sendAck(true, "Directory created");
-         TDECK_LOG_I("Created directory: %s", path.c_str());
+         TDECK_TRACE_I(USB, "Created directory: %s", path.c_str());
      } else {
          _sendAck(false, "Failed to create directory");
      }
@@ -588,8 +678,9 @@
   */
  void USBManager::_handleRemoveDir(const String& path) {
      if (fsManager.removeDir(path.c_str())) {
+         FSManager::invalidate_cache(path.c_str());
          _sendAck(true, "Directory removed");
-         TDECK_LOG_I("Removed directory: %s", path.c_str());
+         TDECK_TRACE_I(USB, "Removed directory: %s", path.c_str());
      } else {
          _sendAck(false, "Failed to remove directory");
      }
@@ -699,4 +790,885 @@
  void USBManager::_resetCmdBuffer() {
      memset(_cmdBuffer, 0, USB_CMD_BUFFER_SIZE);
      _cmdBufferIndex = 0;
+ }
+ 
+ /**
+  * @brief Take the SD card off the file system and present it to the host
+  * 
+  * @return true if the host now sees the card
+  */
+ bool USBManager::_startMassStorage() {
+     uint32_t sectorCount = 0;
+     uint16_t sectorSize = 0;
+     if (!FSManager::lend_sd(sectorCount, sectorSize)) {
+         return false;
+     }
+     
+     // The host rereads the capacity when the media comes up
+     mscSectorSize = sectorSize;
+     mscEjected = false;
+     _msc.begin(sectorCount, sectorSize);
+     _msc.mediaPresent(true);
+     return true;
+ }
+ 
+ /**
+  * @brief Withdraw the card from the host and remount it
+  */
+ void USBManager::_stopMassStorage() {
+     // The host sees the drive vanish, it should have been ejected first
+     _msc.mediaPresent(false);
+     if (!FSManager::return_sd()) {
+         sendFormatted("%s SD card remount failed\r\n", USB_RESP_ERROR);
+     }
+ }
+ 
+ /**
+  * @brief MSC read callback, runs on the TinyUSB task
+  * 
+  * @param lba First block
+  * @param offset Byte offset into the first block
+  * @param buffer Buffer to fill
+  * @param bufsize Bytes requested
+  * @return Bytes read, or -1 on error
+  */
+ int32_t USBManager::_onMscRead(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) {
+     // TinyUSB splits large requests at whole sectors
+     uint32_t sector = lba + offset / mscSectorSize;
+     if (!FSManager::read_sd_sectors(sector, (uint8_t*)buffer, bufsize / mscSectorSize)) {
+         return -1;
+     }
+     return bufsize;
+ }
+ 
+ /**
+  * @brief MSC write callback, runs on the TinyUSB task
+  * 
+  * @param lba First block
+  * @param offset Byte offset into the first block
+  * @param buffer Data to write
+  * @param bufsize Bytes to write
+  * @return Bytes written, or -1 on error
+  */
+ int32_t USBManager::_onMscWrite(uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize) {
+     uint32_t sector = lba + offset / mscSectorSize;
+     if (!FSManager::write_sd_sectors(sector, buffer, bufsize / mscSectorSize)) {
+         return -1;
+     }
+     return bufsize;
+ }
+ 
+ /**
+  * @brief MSC start/stop callback, an eject ends mass storage mode
+  * 
+  * @param powerCondition SCSI power condition
+  * @param start true to start the unit
+  * @param loadEject true to load or eject the medium
+  * @return true to accept
+  */
+ bool USBManager::_onMscStartStop(uint8_t powerCondition, bool start, bool loadEject) {
+     if (loadEject && !start) {
+         mscEjected = true;
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Switch the CDC stream to binary frames
+  * 
+  * @return true if the frame buffers were allocated
+  */
+ bool USBManager::_enterBinary() {
+     if (_binary) {
+         return true;
+     }
+     
+     // The send chunk goes to the card, so it gets a DMA-friendly buffer. The frame
+     // and the reorder window are only copied, PSRAM is fine for them
+     _rxFrame = (uint8_t*)heap_caps_malloc(USB_FRAME_HEADER_SIZE + USB_FRAME_MAX_PAYLOAD + USB_FRAME_CRC_SIZE,
+                                           MALLOC_CAP_SPIRAM);
+     _window = (uint8_t*)heap_caps_malloc(TDECK_USB_CHUNK_SIZE * TDECK_USB_WINDOW, MALLOC_CAP_SPIRAM);
+     _txChunk = FSStream::alloc_buffer(TDECK_USB_CHUNK_SIZE);
+     
+     if (!_rxFrame || !_window || !_txChunk) {
+         TDECK_LOG_E("Not enough memory for USB binary mode");
+         heap_caps_free(_rxFrame);
+         heap_caps_free(_window);
+         FSStream::free_buffer(_txChunk);
+         _rxFrame = nullptr;
+         _window = nullptr;
+         _txChunk = nullptr;
+         return false;
+     }
+     
+     _rxLength = 0;
+     _retransmits = 0;
+     _crcErrors = 0;
+     _binary = true;
+     
+     TDECK_LOG_I("USB binary mode");
+     return true;
+ }
+ 
+ /**
+  * @brief Return to text commands, aborting any binary transfer
+  */
+ void USBManager::_exitBinary() {
+     if (!_binary) {
+         return;
+     }
+     
+     if (_direction == USBTransferDirection::WRITE) {
+         // An unfinished upload is not a usable file
+         _abortWrite();
+     }
+     _endBinaryTransfer();
+     
+     heap_caps_free(_rxFrame);
+     heap_caps_free(_window);
+     FSStream::free_buffer(_txChunk);
+     _rxFrame = nullptr;
+     _window = nullptr;
+     _txChunk = nullptr;
+     _binary = false;
+     _resetCmdBuffer();
+     
+     TDECK_TRACE_I(USB, "USB binary mode left (%lu retransmits, %lu bad frames)",
+                   (unsigned long)_retransmits, (unsigned long)_crcErrors);
+ }
+ 
+ /**
+  * @brief Receive frames and keep the send window full
+  */
+ void USBManager::_serviceBinary() {
+     // Chunks held back by a full writer go first. While the writer is still
+     // full, frames stay in the CDC buffer and the withheld ACK paces the host
+     if (_direction == USBTransferDirection::WRITE && (_pending & 1) && !_drainWindow()) {
+         _lastProgress = millis();
+         _lastResend = _lastProgress;
+         return;
+     }
+     
+     _receiveBinary();
+     
+     if (_direction == USBTransferDirection::NONE) {
+         return;
+     }
+     
+     unsigned long now = millis();
+     if (now - _lastProgress > USB_TRANSFER_TIMEOUT) {
+         _failBinary("Transfer timeout");
+         return;
+     }
+     
+     if (_direction == USBTransferDirection::READ) {
+         // The host lost a chunk or our last chunks: resend the oldest one
+         if (_windowBase < _windowNext && now - _lastResend > TDECK_USB_ACK_TIMEOUT_MS) {
+             _pending |= 1;
+             _retransmits++;
+             _lastResend = now;
+         }
+         _sendChunks();
+     } else if (_direction == USBTransferDirection::HASH) {
+         _sendHashes();
+     } else if (now - _lastResend > TDECK_USB_ACK_TIMEOUT_MS) {
+         // Nothing usable arrived lately, ask for the chunk the file is waiting on
+         _nacked |= 1;
+         _retransmits++;
+         _lastResend = now;
+         _sendFrame(USBFrameType::NACK, _windowBase);
+     }
+ }
+ 
+ /**
+  * @brief Read received bytes straight into the frame buffer and handle complete frames
+  */
+ void USBManager::_receiveBinary() {
+     while (_binary) {
+         // Check what the buffer holds before reading more
+         if ((_rxLength >= 1 && _rxFrame[0] != (USB_FRAME_MAGIC & 0xFF)) ||
+             (_rxLength >= 2 && _rxFrame[1] != (USB_FRAME_MAGIC >> 8))) {
+             _resyncBinary();
+             continue;
+         }
+         
+         size_t needed = USB_FRAME_HEADER_SIZE;
+         if (_rxLength >= USB_FRAME_HEADER_SIZE) {
+             uint32_t payloadLength;
+             memcpy(&payloadLength, _rxFrame + 8, sizeof(payloadLength));
+             if (payloadLength > USB_FRAME_MAX_PAYLOAD) {
+                 _crcErrors++;
+                 _resyncBinary();
+                 continue;
+             }
+             
+             needed = USB_FRAME_HEADER_SIZE + payloadLength + USB_FRAME_CRC_SIZE;
+             if (_rxLength == needed) {
+                 uint32_t expected;
+                 memcpy(&expected, _rxFrame + USB_FRAME_HEADER_SIZE + payloadLength, sizeof(expected));
+                 uint32_t crc = esp_rom_crc32_le(0, _rxFrame + 2, USB_FRAME_HEADER_SIZE - 2 + payloadLength);
+                 
+                 if (crc != expected) {
+                     // The real frame may start inside the bytes taken for this one
+                     _crcErrors++;
+                     _resyncBinary();
+                     continue;
+                 }
+                 
+                 uint32_t seq;
+                 memcpy(&seq, _rxFrame + 4, sizeof(seq));
+                 _rxLength = 0;
+                 _handleFrame(_rxFrame[2], seq, _rxFrame + USB_FRAME_HEADER_SIZE, payloadLength);
+                 continue;
+             }
+         }
+         
+         // Read no further than the end of this frame, the next one starts at offset 0
+         int available = _usbCDC.available();
+         if (available <= 0) {
+             break;
+         }
+         size_t count = min((size_t)available, needed - _rxLength);
+         _rxLength += _usbCDC.read(_rxFrame + _rxLength, count);
+     }
+ }
+ 
+ /**
+  * @brief Drop the first byte of the frame buffer and skip to the next possible frame start
+  */
+ void USBManager::_resyncBinary() {
+     size_t start = 1;
+     while (start < _rxLength && _rxFrame[start] != (USB_FRAME_MAGIC & 0xFF)) {
+         start++;
+     }
+     
+     _rxLength = start < _rxLength ? _rxLength - start : 0;
+     memmove(_rxFrame, _rxFrame + start, _rxLength);
+ }
+ 
+ /**
+  * @brief Handle one frame whose CRC checked out
+  * 
+  * @param type Frame type
+  * @param seq Sequence number
+  * @param payload Frame payload
+  * @param len Payload length
+  */
+ void USBManager::_handleFrame(uint8_t type, uint32_t seq, const uint8_t* payload, size_t len) {
+     switch (static_cast<USBFrameType>(type)) {
+         case USBFrameType::OPEN_READ:
+         case USBFrameType::OPEN_WRITE:
+         case USBFrameType::HASH:
+         case USBFrameType::PATCH: {
+             if (_direction != USBTransferDirection::NONE) {
+                 const char* message = "Transfer already active";
+                 _sendFrame(USBFrameType::ERROR, 0, (const uint8_t*)message, strlen(message));
+                 break;
+             }
+             
+             if (static_cast<USBFrameType>(type) == USBFrameType::OPEN_READ) {
+                 _openBinaryRead(String((const char*)payload, len));
+             } else if (static_cast<USBFrameType>(type) == USBFrameType::HASH) {
+                 _openBinaryHash(String((const char*)payload, len));
+             } else if (len > sizeof(uint64_t)) {
+                 uint64_t size;
+                 memcpy(&size, payload, sizeof(size));
+                 _openBinaryWrite(String((const char*)payload + sizeof(size), len - sizeof(size)), size,
+                                  static_cast<USBFrameType>(type) == USBFrameType::PATCH);
+             }
+             break;
+         }
+         
+         case USBFrameType::ACK:
+             // Cumulative: every chunk before seq arrived
+             if (_direction == USBTransferDirection::READ && seq > _windowBase && seq <= _windowNext) {
+                 _pending >>= seq - _windowBase;
+                 _windowBase = seq;
+                 _lastProgress = millis();
+                 _lastResend = _lastProgress;
+                 
+                 if (_windowBase == _chunkCount) {
+                     _sendFrame(USBFrameType::DONE, _chunkCount, (const uint8_t*)&_fileCrc, sizeof(_fileCrc));
+                     TDECK_TRACE_I(USB, "Sent file: %s (%llu bytes, %lu retransmits)", _currentTransferPath.c_str(),
+                                   (unsigned long long)_binarySize, (unsigned long)_retransmits);
+                     _endBinaryTransfer();
+                 }
+             }
+             break;
+         
+         case USBFrameType::NACK:
+             // Selective: only the named chunk is sent again
+             if (_direction == USBTransferDirection::READ && seq >= _windowBase && seq < _windowNext) {
+                 _pending |= 1UL << (seq - _windowBase);
+                 _retransmits++;
+             }
+             break;
+         
+         case USBFrameType::DATA:
+             if (_direction == USBTransferDirection::WRITE) {
+                 _receiveChunk(seq, payload, len);
+             }
+             break;
+         
+         case USBFrameType::ABORT:
+             if (_direction == USBTransferDirection::WRITE) {
+                 _abortWrite();
+             }
+             _endBinaryTransfer();
+             _sendFrame(USBFrameType::ACK, 0);
+             break;
+         
+         case USBFrameType::EXIT:
+             _sendFrame(USBFrameType::ACK, 0);
+             _exitBinary();
+             break;
+         
+         default:
+             break;
+     }
+ }
+ 
+ /**
+  * @brief Send one frame
+  * 
+  * @param type Frame type
+  * @param seq Sequence number
+  * @param payload Frame payload, may be nullptr if len is 0
+  * @param len Payload length
+  * @return true if the whole frame was queued
+  */
+ bool USBManager::_sendFrame(USBFrameType type, uint32_t seq, const uint8_t* payload, size_t len) {
+     uint8_t header[USB_FRAME_HEADER_SIZE];
+     uint16_t magic = USB_FRAME_MAGIC;
+     uint32_t length = len;
+     memcpy(header, &magic, sizeof(magic));
+     header[2] = static_cast<uint8_t>(type);
+     header[3] = 0;
+     memcpy(header + 4, &seq, sizeof(seq));
+     memcpy(header + 8, &length, sizeof(length));
+     
+     uint32_t crc = esp_rom_crc32_le(0, header + 2, sizeof(header) - 2);
+     if (len > 0) {
+         crc = esp_rom_crc32_le(crc, payload, len);
+     }
+     
+     // The CDC FIFO drains over USB while the next chunk is read from the file
+     size_t sent = _usbCDC.write(header, sizeof(header));
+     if (len > 0) {
+         sent += _usbCDC.write(payload, len);
+     }
+     sent += _usbCDC.write((const uint8_t*)&crc, sizeof(crc));
+     
+     return sent == sizeof(header) + len + sizeof(crc);
+ }
+ 
+ /**
+  * @brief Send an ERROR frame and end the transfer
+  * 
+  * @param message Error message
+  */
+ void USBManager::_failBinary(const char* message) {
+     TDECK_TRACE_E(USB, "USB transfer of %s failed: %s", _currentTransferPath.c_str(), message);
+     _sendFrame(USBFrameType::ERROR, _windowBase, (const uint8_t*)message, strlen(message));
+     
+     if (_direction == USBTransferDirection::WRITE) {
+         _abortWrite();
+     }
+     _endBinaryTransfer();
+ }
+ 
+ /**
+  * @brief Start sending a file
+  * 
+  * @param path File path
+  */
+ void USBManager::_openBinaryRead(const String& path) {
+     // Chunks are larger than any stream buffer would be, read them directly
+     if (!_transferFile.open(path.c_str(), FILE_READ, 0)) {
+         const char* message = "Failed to open file";
+         _sendFrame(USBFrameType::ERROR, 0, (const uint8_t*)message, strlen(message));
+         return;
+     }
+     
+     _currentTransferPath = path;
+     _direction = USBTransferDirection::READ;
+     _binarySize = _transferFile.size();
+     _chunkCount = (_binarySize + TDECK_USB_CHUNK_SIZE - 1) / TDECK_USB_CHUNK_SIZE;
+     _windowBase = 0;
+     _windowNext = 0;
+     _pending = 0;
+     _nacked = 0;
+     _filePosition = 0;
+     _fileCrc = 0;
+     _lastProgress = millis();
+     _lastResend = _lastProgress;
+     
+     uint8_t reply[16] = {0};
+     uint32_t chunk = TDECK_USB_CHUNK_SIZE;
+     uint16_t window = TDECK_USB_WINDOW;
+     memcpy(reply, &_binarySize, sizeof(_binarySize));
+     memcpy(reply + 8, &chunk, sizeof(chunk));
+     memcpy(reply + 12, &window, sizeof(window));
+     _sendFrame(USBFrameType::OPEN_ACK, _chunkCount, reply, sizeof(reply));
+     
+     if (_chunkCount == 0) {
+         _sendFrame(USBFrameType::DONE, 0, (const uint8_t*)&_fileCrc, sizeof(_fileCrc));
+         _endBinaryTransfer();
+     }
+ }
+ 
+ /**
+  * @brief Start receiving a file
+  * 
+  * @param path File path
+  * @param size Size of the file to receive
+  * @param patch Keep the chunks of the existing file the host leaves empty
+  */
+ void USBManager::_openBinaryWrite(const String& path, uint64_t size, bool patch) {
+     // Create necessary directories if they don't exist
+     int lastSlash = path.lastIndexOf('/');
+     if (lastSlash > 0) {
+         String dirPath = path.substring(0, lastSlash);
+         fsManager.createDir(dirPath.c_str());
+         FSManager::invalidate_cache(dirPath.c_str());
+     }
+     
+     // A patch reads the old file while the new one is written beside it
+     String writePath = patch ? path + USB_PATCH_SUFFIX : path;
+     if (patch && !_transferFile.open(path.c_str(), FILE_READ, 0)) {
+         const char* message = "Failed to open file";
+         _sendFrame(USBFrameType::ERROR, 0, (const uint8_t*)message, strlen(message));
+         return;
+     }
+     
+     if (!_writer.open(writePath.c_str())) {
+         const char* message = "Failed to create file";
+         _sendFrame(USBFrameType::ERROR, 0, (const uint8_t*)message, strlen(message));
+         _transferFile.close();
+         return;
+     }
+     FSManager::invalidate_cache(path.c_str());
+     
+     _currentTransferPath = path;
+     _writePath = writePath;
+     _patch = patch;
+     _direction = USBTransferDirection::WRITE;
+     _binarySize = size;
+     _chunkCount = (size + TDECK_USB_CHUNK_SIZE - 1) / TDECK_USB_CHUNK_SIZE;
+     _windowBase = 0;
+     _windowNext = 0;
+     _pending = 0;
+     _nacked = 0;
+     _filePosition = 0;
+     _fileCrc = 0;
+     _lastProgress = millis();
+     _lastResend = _lastProgress;
+     
+     uint8_t reply[16] = {0};
+     uint32_t chunk = TDECK_USB_CHUNK_SIZE;
+     uint16_t window = TDECK_USB_WINDOW;
+     memcpy(reply, &_binarySize, sizeof(_binarySize));
+     memcpy(reply + 8, &chunk, sizeof(chunk));
+     memcpy(reply + 12, &window, sizeof(window));
+     _sendFrame(USBFrameType::OPEN_ACK, _chunkCount, reply, sizeof(reply));
+     
+     if (_chunkCount == 0) {
+         _drainWindow();
+     }
+ }
+ 
+ /**
+  * @brief Start hashing a file for the host
+  * 
+  * @param path File path
+  */
+ void USBManager::_openBinaryHash(const String& path) {
+     // Missing files are told apart so the host can send them whole
+     if (!FSManager::file_exists(path.c_str())) {
+         const char* message = "File not found";
+         _sendFrame(USBFrameType::ERROR, 0, (const uint8_t*)message, strlen(message));
+         return;
+     }
+     if (!_transferFile.open(path.c_str(), FILE_READ, 0)) {
+         const char* message = "Failed to open file";
+         _sendFrame(USBFrameType::ERROR, 0, (const uint8_t*)message, strlen(message));
+         return;
+     }
+     
+     _currentTransferPath = path;
+     _direction = USBTransferDirection::HASH;
+     _binarySize = _transferFile.size();
+     _chunkCount = (_binarySize + TDECK_USB_CHUNK_SIZE - 1) / TDECK_USB_CHUNK_SIZE;
+     _windowBase = 0;
+     _windowNext = 0;
+     _lastProgress = millis();
+     _lastResend = _lastProgress;
+     
+     // The digests are sent from update() a few chunks at a time
+     _sendHashes();
+ }
+ 
+ /**
+  * @brief Hash the next few chunks, sending a HASHES frame each time one fills
+  */
+ void USBManager::_sendHashes() {
+     for (int i = 0; i < TDECK_USB_HASH_CHUNKS_PER_POLL && _windowNext < _chunkCount; i++) {
+         size_t len = _chunkLength(_windowNext);
+         if (_transferFile.read(_window, len) != (int64_t)len) {
+             _failBinary("File read error");
+             return;
+         }
+         
+         // mbedtls runs on the SHA accelerator
+         uint8_t* digest = _txChunk + sizeof(uint64_t) + (_windowNext - _windowBase) * USB_HASH_SIZE;
+         mbedtls_sha256(_window, len, digest, 0);
+         _windowNext++;
+         
+         if (_windowNext - _windowBase == USB_HASHES_PER_FRAME) {
+             _sendHashFrame();
+         }
+     }
+     _lastProgress = millis();
+     
+     if (_windowNext == _chunkCount) {
+         // An empty file still gets one frame with its size
+         if (_windowNext > _windowBase || _chunkCount == 0) {
+             _sendHashFrame();
+         }
+         _sendFrame(USBFrameType::DONE, _chunkCount);
+         TDECK_TRACE_I(USB, "Hashed file: %s (%llu bytes)", _currentTransferPath.c_str(), (unsigned long long)_binarySize);
+         _endBinaryTransfer();
+     }
+ }
+ 
+ /**
+  * @brief Send the digests gathered since the last HASHES frame
+  */
+ void USBManager::_sendHashFrame() {
+     memcpy(_txChunk, &_binarySize, sizeof(_binarySize));
+     _sendFrame(USBFrameType::HASHES, _windowBase, _txChunk,
+                sizeof(uint64_t) + (_windowNext - _windowBase) * USB_HASH_SIZE);
+     _windowBase = _windowNext;
+ }
+ 
+ /**
+  * @brief Send resent and new chunks while the window has room
+  */
+ void USBManager::_sendChunks() {
+     // Requested chunks first, oldest first
+     while (_pending && _direction == USBTransferDirection::READ) {
+         uint32_t offset = __builtin_ctz(_pending);
+         _pending &= ~(1UL << offset);
+         if (!_sendChunk(_windowBase + offset)) {
+             return;
+         }
+     }
+     
+     while (_direction == USBTransferDirection::READ && _windowNext < _chunkCount &&
+            _windowNext - _windowBase < TDECK_USB_WINDOW) {
+         if (!_sendChunk(_windowNext)) {
+             return;
+         }
+         _windowNext++;
+     }
+ }
+ 
+ /**
+  * @brief Read and send one chunk
+  * 
+  * @param seq Chunk number
+  * @return true if the chunk was sent
+  */
+ bool USBManager::_sendChunk(uint32_t seq) {
+     size_t len = _chunkLength(seq);
+     uint64_t offset = (uint64_t)seq * TDECK_USB_CHUNK_SIZE;
+     
+     // Only resent chunks move the file position backwards
+     if (_filePosition != offset) {
+         if (!_transferFile.seek(offset)) {
+             _failBinary("File seek error");
+             return false;
+         }
+         _filePosition = offset;
+     }
+     
+     if (_transferFile.read(_txChunk, len) != (int64_t)len) {
+         _failBinary("File read error");
+         return false;
+     }
+     _filePosition += len;
+     
+     if (!_sendFrame(USBFrameType::DATA, seq, _txChunk, len)) {
+         return false;
+     }
+     
+     // A new chunk counts once it is sent, a failed send is retried and must not count twice
+     if (seq == _windowNext) {
+         _fileCrc = esp_rom_crc32_le(_fileCrc, _txChunk, len);
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Copy a chunk of the file being patched into its window slot
+  * 
+  * @param seq Chunk number
+  * @param slot Window slot
+  * @return true if the whole chunk was read
+  */
+ bool USBManager::_keepChunk(uint32_t seq, uint8_t* slot) {
+     size_t len = _chunkLength(seq);
+     uint64_t offset = (uint64_t)seq * TDECK_USB_CHUNK_SIZE;
+     if (offset + len > _transferFile.size() || !_transferFile.seek(offset)) {
+         return false;
+     }
+     return _transferFile.read(slot, len) == (int64_t)len;
+ }
+ 
+ /**
+  * @brief Store a received chunk and write every chunk now in order
+  * 
+  * @param seq Chunk number
+  * @param data Chunk data
+  * @param len Chunk length
+  */
+ void USBManager::_receiveChunk(uint32_t seq, const uint8_t* data, size_t len) {
+     if (seq < _windowBase) {
+         // Already written, our ACK was probably lost
+         _sendFrame(USBFrameType::ACK, _windowBase);
+         return;
+     }
+     // While patching, an empty chunk means the device already has it
+     bool keep = _patch && len == 0;
+     if (seq >= _chunkCount || seq - _windowBase >= TDECK_USB_WINDOW || (len != _chunkLength(seq) && !keep)) {
+         return;
+     }
+     
+     uint32_t bit = 1UL << (seq - _windowBase);
+     if (!(_pending & bit)) {
+         uint8_t* slot = _window + (seq % TDECK_USB_WINDOW) * TDECK_USB_CHUNK_SIZE;
+         if (keep) {
+             if (!_keepChunk(seq, slot)) {
+                 _failBinary("File read error");
+                 return;
+             }
+         } else {
+             memcpy(slot, data, len);
+         }
+         _pending |= bit;
+     }
+     
+     // A later chunk arrived first: ask once for each chunk skipped over
+     for (uint32_t offset = 0; offset < seq - _windowBase; offset++) {
+         uint32_t missing = 1UL << offset;
+         if (!(_pending & missing) && !(_nacked & missing)) {
+             _nacked |= missing;
+             _retransmits++;
+             _sendFrame(USBFrameType::NACK, _windowBase + offset);
+         }
+     }
+     
+     _drainWindow();
+ }
+ 
+ /**
+  * @brief Hand the chunks that are now in order to the writer
+  * 
+  * @return true if the window is drained, false while the writer has no free slot
+  */
+ bool USBManager::_drainWindow() {
+     bool advanced = false;
+     while (_pending & 1) {
+         size_t chunkLength = _chunkLength(_windowBase);
+         const uint8_t* chunk = _window + (_windowBase % TDECK_USB_WINDOW) * TDECK_USB_CHUNK_SIZE;
+         if (!_queueWrite(chunk, chunkLength)) {
+             if (_writer.failed()) {
+                 _failBinary("File write error");
+                 return true;
+             }
+             break;
+         }
+         _fileCrc = esp_rom_crc32_le(_fileCrc, chunk, chunkLength);
+         
+         _pending >>= 1;
+         _nacked >>= 1;
+         _windowBase++;
+         advanced = true;
+     }
+     
+     // Chunks are only acknowledged once a slot holds them, so a slow card holds the host back
+     if (advanced) {
+         _lastProgress = millis();
+         _lastResend = _lastProgress;
+         _sendFrame(USBFrameType::ACK, _windowBase);
+     }
+     
+     if (_windowBase == _chunkCount) {
+         if (!_flushWrite() || !_writer.close()) {
+             _failBinary("File write error");
+             return true;
+         }
+         if (_patch) {
+             // The rebuilt file replaces the old one only once it is complete
+             _transferFile.close();
+             if (!FSManager::remove_file(_currentTransferPath.c_str()) ||
+                 !FSManager::rename_file(_writePath.c_str(), _currentTransferPath.c_str())) {
+                 _failBinary("File rename error");
+                 return true;
+             }
+         }
+         _sendFrame(USBFrameType::DONE, _chunkCount, (const uint8_t*)&_fileCrc, sizeof(_fileCrc));
+         TDECK_TRACE_I(USB, "File transfer complete: %s (%llu bytes, %lu retransmits)", _currentTransferPath.c_str(),
+                       (unsigned long long)_binarySize, (unsigned long)_retransmits);
+         _endBinaryTransfer();
+         return true;
+     }
+     
+     return !(_pending & 1);
+ }
+ 
+ /**
+  * @brief Read text mode file data straight into writer slots
+  */
+ void USBManager::_receiveWriteData() {
+     while (_transferActive && _transferredBytes < _totalTransferSize && _usbCDC.available()) {
+         if (_writeSlot == nullptr) {
+             _writeSlot = _writer.acquire();
+             _writeFill = 0;
+             if (_writeSlot == nullptr) {
+                 // The card is behind: leave the data in the CDC buffer so the host is held off
+                 break;
+             }
+         }
+         
+         size_t want = min((size_t)TDECK_FS_WRITER_SLOT_SIZE - _writeFill, _totalTransferSize - _transferredBytes);
+         size_t got = _usbCDC.read(_writeSlot + _writeFill, want);
+         if (got == 0) {
+             break;
+         }
+         _writeFill += got;
+         _transferredBytes += got;
+         _lastConnCheckTime = millis(); // Reset timeout counter
+         
+         if (_writeFill == TDECK_FS_WRITER_SLOT_SIZE && !_flushWrite()) {
+             break;
+         }
+     }
+     
+     if (_writer.failed()) {
+         _abortWrite();
+         _transferActive = false;
+         _sendAck(false, "File write error");
+         TDECK_TRACE_E(USB, "File transfer write error: %s", _currentTransferPath.c_str());
+         return;
+     }
+     
+     // Check if transfer is complete
+     if (_transferActive && _transferredBytes >= _totalTransferSize) {
+         bool written = _flushWrite() && _writer.close();
+         _transferActive = false;
+         if (written) {
+             _sendAck(true, "Transfer complete");
+             TDECK_TRACE_I(USB, "File transfer complete: %s (%d bytes)", 
+                           _currentTransferPath.c_str(), _transferredBytes);
+         } else {
+             _abortWrite();
+             _sendAck(false, "File write error");
+             TDECK_TRACE_E(USB, "File transfer write error: %s", _currentTransferPath.c_str());
+         }
+     }
+ }
+ 
+ /**
+  * @brief Copy upload data into writer slots, committing each one that fills
+  * 
+  * @param data Data to write
+  * @param len Data length, at most one slot
+  * @return true if all of it was taken, false if no slot was free or a write failed
+  */
+ bool USBManager::_queueWrite(const uint8_t* data, size_t len) {
+     if (_writer.failed()) {
+         return false;
+     }
+     
+     // Take a fresh slot if this data will not fit the held one, so nothing is split
+     if (_writeSlot != nullptr && _writeFill + len > TDECK_FS_WRITER_SLOT_SIZE && !_flushWrite()) {
+         return false;
+     }
+     if (_writeSlot == nullptr) {
+         _writeSlot = _writer.acquire();
+         _writeFill = 0;
+         if (_writeSlot == nullptr) {
+             return false;
+         }
+     }
+     
+     memcpy(_writeSlot + _writeFill, data, len);
+     _writeFill += len;
+     if (_writeFill == TDECK_FS_WRITER_SLOT_SIZE) {
+         return _flushWrite();
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Commit the partly filled slot
+  * 
+  * @return true if nothing was held or it was queued
+  */
+ bool USBManager::_flushWrite() {
+     if (_writeSlot == nullptr) {
+         return true;
+     }
+     
+     uint8_t* slot = _writeSlot;
+     size_t length = _writeFill;
+     _writeSlot = nullptr;
+     _writeFill = 0;
+     return _writer.commit(slot, length);
+ }
+ 
+ /**
+  * @brief Drop the upload and delete the partial file
+  */
+ void USBManager::_abortWrite() {
+     if (_writeSlot != nullptr) {
+         _writer.commit(_writeSlot, 0);
+         _writeSlot = nullptr;
+         _writeFill = 0;
+     }
+     if (_writer.is_open()) {
+         _writer.abort();
+     }
+     FSManager::remove_file(_writePath.c_str());
+ }
+ 
+ /**
+  * @brief Size of a chunk, the last one may be short
+  * 
+  * @param seq Chunk number
+  * @return Chunk length in bytes
+  */
+ size_t USBManager::_chunkLength(uint32_t seq) const {
+     if (seq + 1 < _chunkCount) {
+         return TDECK_USB_CHUNK_SIZE;
+     }
+     return _binarySize - (uint64_t)seq * TDECK_USB_CHUNK_SIZE;
+ }
+ 
+ /**
+  * @brief Close the file and clear the transfer state
+  */
+ void USBManager::_endBinaryTransfer() {
+     if (_transferFile.is_open()) {
+         _transferFile.close();
+     }
+     
+     _direction = USBTransferDirection::NONE;
+     _patch = false;
+     _pending = 0;
+     _nacked = 0;
+     _windowBase = 0;
+     _windowNext = 0;
+     _chunkCount = 0;
  }
\ No newline at end of file
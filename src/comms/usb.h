@@ -13,8 +13,10 @@
  #include <Arduino.h>
  #include <USB.h>
  #include <USBCDC.h>
+ #include <USBMSC.h>
  #include "../config.h"
  #include "../system/fs_manager.h"
+ #include "../system/fs_writer.h"
  
  // External reference to the file system manager
  extern FSManager fsManager;
@@ -26,12 +28,57 @@
      NONE,           // No USB mode active
      CDC_CONSOLE,    // Console/Terminal mode
      DATA_TRANSFER,  // Data transfer mode
-     FIRMWARE_UPDATE // Firmware update mode
+     FIRMWARE_UPDATE,// Firmware update mode
+     MASS_STORAGE    // SD card exposed as a USB drive
  };
  
  // Command buffer size for USB commands
  #define USB_CMD_BUFFER_SIZE 256
  
+ // Binary transfer frames: magic (2), type (1), reserved (1), sequence (4), payload length (4),
+ // payload, then CRC-32 (4) of everything from the type byte to the end of the payload
+ #define USB_FRAME_MAGIC 0x5AA5
+ #define USB_FRAME_HEADER_SIZE 12
+ #define USB_FRAME_CRC_SIZE 4
+ #define USB_FRAME_MAX_PAYLOAD (TDECK_USB_CHUNK_SIZE + 256)
+ #define USB_BINARY_VERSION 2
+ 
+ // Chunk digests for incremental sync, as many per HASHES frame as fit a chunk buffer
+ #define USB_HASH_SIZE 32
+ #define USB_HASHES_PER_FRAME ((TDECK_USB_CHUNK_SIZE - sizeof(uint64_t)) / USB_HASH_SIZE)
+ 
+ // Patched files are rebuilt next to the original, then renamed over it
+ #define USB_PATCH_SUFFIX ".sync"
+ 
+ /**
+  * @brief Binary transfer frame types
+  */
+ enum class USBFrameType : uint8_t {
+     OPEN_READ = 0x01,   // Host: path, device streams the file
+     OPEN_WRITE = 0x02,  // Host: size (8) then path, host streams the file
+     OPEN_ACK = 0x03,    // Device: size (8), chunk size (4), window (2), reserved (2)
+     DATA = 0x04,        // Either: one chunk, sequence is the chunk number
+     ACK = 0x05,         // Receiver: every chunk before sequence arrived
+     NACK = 0x06,        // Receiver: resend chunk sequence
+     DONE = 0x07,        // Device: transfer finished, CRC-32 of the whole file (4)
+     ERROR = 0x08,       // Device: message
+     ABORT = 0x09,       // Host: cancel the transfer
+     EXIT = 0x0A,        // Host: leave binary mode
+     HASH = 0x0B,        // Host: path, device replies with HASHES frames then DONE
+     HASHES = 0x0C,      // Device: file size (8), SHA-256 of each chunk from chunk sequence on
+     PATCH = 0x0D,       // Host: size (8) then path, as OPEN_WRITE but an empty DATA keeps the device's chunk
+ };
+ 
+ /**
+  * @brief Direction of the active binary transfer
+  */
+ enum class USBTransferDirection {
+     NONE,   // No binary transfer
+     READ,   // Device to host
+     WRITE,  // Host to device
+     HASH    // Device hashes a file for the host
+ };
+ 
  /**
   * @brief USB transfer protocol commands
   */
@@ -132,6 +179,9 @@
      // USB CDC instance for serial communication
      USBCDC _usbCDC;
      
+     // Mass storage interface, enumerated from boot but without media outside MASS_STORAGE
+     USBMSC _msc;
+     
      // Current USB mode
      USBMode _mode;
      
@@ -142,15 +192,44 @@
      // Data transfer state
      bool _transferActive;
      String _currentTransferPath;
-     File _transferFile;
+     FSStream _transferFile;
      size_t _totalTransferSize;
      size_t _transferredBytes;
      
+     // Uploads are handed to a writer task in slots
+     FSWriter _writer;
+     uint8_t* _writeSlot;                // Slot being filled, nullptr if none is held
+     size_t _writeFill;                  // Bytes in _writeSlot
+     String _writePath;                  // File the writer fills, a temporary while patching
+     
      // Flag to track USB connection status
      bool _connected;
      
      // Last connection check time
      unsigned long _lastConnCheckTime;
+     
+     // Binary mode, entered with the BINARY command
+     bool _binary;
+     uint8_t* _rxFrame;                  // Frame being received, header then payload and CRC
+     size_t _rxLength;                   // Bytes in _rxFrame
+     uint8_t* _txChunk;                  // Chunk read from the file for sending
+     
+     // Binary transfer state, one chunk window in flight
+     USBTransferDirection _direction;
+     uint64_t _binarySize;               // File size
+     uint32_t _chunkCount;               // Chunks in the file
+     uint32_t _windowBase;               // Oldest chunk not yet acknowledged (read) or written (write)
+     uint32_t _windowNext;               // Next chunk never sent (read) or hashed (hash)
+     uint32_t _pending;                  // Window bits: chunks to resend (read) or buffered (write)
+     uint32_t _nacked;                   // Window bits: chunks already requested again (write)
+     uint8_t* _window;                   // Out-of-order chunks waiting to be written, one slot each
+     uint64_t _filePosition;             // Position of _transferFile
+     uint32_t _fileCrc;                  // CRC-32 of the chunks sent or written so far, in order
+     unsigned long _lastProgress;        // millis() of the last window movement
+     unsigned long _lastResend;          // millis() of the last timeout resend or window movement
+     uint32_t _retransmits;              // Chunks sent or requested again
+     uint32_t _crcErrors;                // Frames dropped for a bad CRC or header
+     bool _patch;                        // Write rebuilds the open _transferFile, empty chunks are kept
  
      /**
       * @brief Process a received command
@@ -238,6 +317,215 @@
       * @brief Reset the command buffer
       */
      void _resetCmdBuffer();
+     
+     /**
+      * @brief Take the SD card off the file system and present it to the host
+      * 
+      * @return true if the host now sees the card
+      */
+     bool _startMassStorage();
+     
+     /**
+      * @brief Withdraw the card from the host and remount it
+      */
+     void _stopMassStorage();
+     
+     /**
+      * @brief MSC read callback, runs on the TinyUSB task
+      * 
+      * @param lba First block
+      * @param offset Byte offset into the first block
+      * @param buffer Buffer to fill
+      * @param bufsize Bytes requested
+      * @return Bytes read, or -1 on error
+      */
+     static int32_t _onMscRead(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
+     
+     /**
+      * @brief MSC write callback, runs on the TinyUSB task
+      * 
+      * @param lba First block
+      * @param offset Byte offset into the first block
+      * @param buffer Data to write
+      * @param bufsize Bytes to write
+      * @return Bytes written, or -1 on error
+      */
+     static int32_t _onMscWrite(uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+     
+     /**
+      * @brief MSC start/stop callback, an eject ends mass storage mode
+      * 
+      * @param powerCondition SCSI power condition
+      * @param start true to start the unit
+      * @param loadEject true to load or eject the medium
+      * @return true to accept
+      */
+     static bool _onMscStartStop(uint8_t powerCondition, bool start, bool loadEject);
+     
+     /**
+      * @brief Switch the CDC stream to binary frames
+      * 
+      * @return true if the frame buffers were allocated
+      */
+     bool _enterBinary();
+     
+     /**
+      * @brief Return to text commands, aborting any binary transfer
+      */
+     void _exitBinary();
+     
+     /**
+      * @brief Receive frames and keep the send window full
+      */
+     void _serviceBinary();
+     
+     /**
+      * @brief Read received bytes straight into the frame buffer and handle complete frames
+      */
+     void _receiveBinary();
+     
+     /**
+      * @brief Drop the first byte of the frame buffer and skip to the next possible frame start
+      */
+     void _resyncBinary();
+     
+     /**
+      * @brief Handle one frame whose CRC checked out
+      * 
+      * @param type Frame type
+      * @param seq Sequence number
+      * @param payload Frame payload
+      * @param len Payload length
+      */
+     void _handleFrame(uint8_t type, uint32_t seq, const uint8_t* payload, size_t len);
+     
+     /**
+      * @brief Send one frame
+      * 
+      * @param type Frame type
+      * @param seq Sequence number
+      * @param payload Frame payload, may be nullptr if len is 0
+      * @param len Payload length
+      * @return true if the whole frame was queued
+      */
+     bool _sendFrame(USBFrameType type, uint32_t seq, const uint8_t* payload = nullptr, size_t len = 0);
+     
+     /**
+      * @brief Send an ERROR frame and end the transfer
+      * 
+      * @param message Error message
+      */
+     void _failBinary(const char* message);
+     
+     /**
+      * @brief Start sending a file
+      * 
+      * @param path File path
+      */
+     void _openBinaryRead(const String& path);
+     
+     /**
+      * @brief Start receiving a file
+      * 
+      * @param path File path
+      * @param size Size of the file to receive
+      * @param patch Keep the chunks of the existing file the host leaves empty
+      */
+     void _openBinaryWrite(const String& path, uint64_t size, bool patch = false);
+     
+     /**
+      * @brief Start hashing a file for the host
+      * 
+      * @param path File path
+      */
+     void _openBinaryHash(const String& path);
+     
+     /**
+      * @brief Hash the next few chunks, sending a HASHES frame each time one fills
+      */
+     void _sendHashes();
+     
+     /**
+      * @brief Send the digests gathered since the last HASHES frame
+      */
+     void _sendHashFrame();
+     
+     /**
+      * @brief Send resent and new chunks while the window has room
+      */
+     void _sendChunks();
+     
+     /**
+      * @brief Read and send one chunk
+      * 
+      * @param seq Chunk number
+      * @return true if the chunk was sent
+      */
+     bool _sendChunk(uint32_t seq);
+     
+     /**
+      * @brief Copy a chunk of the file being patched into its window slot
+      * 
+      * @param seq Chunk number
+      * @param slot Window slot
+      * @return true if the whole chunk was read
+      */
+     bool _keepChunk(uint32_t seq, uint8_t* slot);
+     
+     /**
+      * @brief Store a received chunk and write every chunk now in order
+      * 
+      * @param seq Chunk number
+      * @param data Chunk data
+      * @param len Chunk length
+      */
+     void _receiveChunk(uint32_t seq, const uint8_t* data, size_t len);
+     
+     /**
+      * @brief Hand the chunks that are now in order to the writer
+      * 
+      * @return true if the window is drained, false while the writer has no free slot
+      */
+     bool _drainWindow();
+     
+     /**
+      * @brief Read text mode file data straight into writer slots
+      */
+     void _receiveWriteData();
+     
+     /**
+      * @brief Copy upload data into writer slots, committing each one that fills
+      * 
+      * @param data Data to write
+      * @param len Data length, at most one slot
+      * @return true if all of it was taken, false if no slot was free or a write failed
+      */
+     bool _queueWrite(const uint8_t* data, size_t len);
+     
+     /**
+      * @brief Commit the partly filled slot
+      * 
+      * @return true if nothing was held or it was queued
+      */
+     bool _flushWrite();
+     
+     /**
+      * @brief Drop the upload and delete the partial file
+      */
+     void _abortWrite();
+     
+     /**
+      * @brief Size of a chunk, the last one may be short
+      * 
+      * @param seq Chunk number
+      * @return Chunk length in bytes
+      */
+     size_t _chunkLength(uint32_t seq) const;
+     
+     /**
+      * @brief Close the file and clear the transfer state
+      */
+     void _endBinaryTransfer();
  };
  
  #endif // TDECK_USB_H
\ No newline at end of file
@@ -4,16 +4,19 @@
  */
 
  #include "wifi.h"
+ #include "../system/config_storage.h"
+ #include <esp_wifi.h>
 
  // Constructor
  WiFiManager::WiFiManager()
      : _scanInProgress(false)
+     , _scanChannelIndex(0)
      , _lastScanTime(0)
-     , _lastStatusCheck(0)
      , _lastStatus(WL_DISCONNECTED)
      , _reconnectAttempted(false)
      , _connectionStartTime(0)
      , _connectionTimeout(30000) // 30 second timeout for connections
+     , _fastConnecting(false)
  {
      // Initialize with default values
      createDefaultConfig();
@@ -48,8 +51,7 @@
                  // Found the network in preferred list, try to connect
                  // This requires the password to be saved in the ESP32's NVS
                  // from a previous successful connection
-                 WiFi.begin();
-                 _connectionStartTime = millis();
+                 reconnect();
                  return true;
              }
          }
@@ -62,110 +64,108 @@
  void WiFiManager::update() {
      unsigned long currentTime = millis();
      
-     // Check connection status periodically (every second)
-     if (currentTime - _lastStatusCheck >= 1000) {
-         _lastStatusCheck = currentTime;
-         
-         wl_status_t currentStatus = WiFi.status();
-         
-         // Status changed
-         if (currentStatus != _lastStatus) {
-             _lastStatus = currentStatus;
-             
-             switch (currentStatus) {
-                 case WL_CONNECTED:
-                     TDECK_LOG_I("WiFi connected to: %s", WiFi.SSID().c_str());
-                     TDECK_LOG_I("IP address: %s", WiFi.localIP().toString().c_str());
-                     
-                     // Update last connected network if not already set
-                     if (_config.lastConnectedSsid != WiFi.SSID()) {
-                         _config.lastConnectedSsid = WiFi.SSID();
-                         saveConfig();
-                     }
-                     break;
-                     
-                 case WL_DISCONNECTED:
-                     TDECK_LOG_I("WiFi disconnected");
-                     break;
-                     
-                 case WL_CONNECT_FAILED:
-                     TDECK_LOG_W("WiFi connection failed");
-                     break;
-                     
-                 case WL_NO_SSID_AVAIL:
-                     TDECK_LOG_W("WiFi SSID not available");
-                     break;
-                     
-                 default:
-                     TDECK_LOG_I("WiFi status changed: %d", currentStatus);
-                     break;
-             }
-         }
+     // The scheduler runs this every second, and at once on any WiFi event
+     wl_status_t currentStatus = WiFi.status();
+     
+     // Status changed
+     if (currentStatus != _lastStatus) {
+         _lastStatus = currentStatus;
          
-         // Handle connection timeout
-         if (currentStatus == WL_CONNECTING && 
-             _connectionStartTime > 0 && 
-             currentTime - _connectionStartTime > _connectionTimeout) {
-             handleConnectTimeout();
+         switch (currentStatus) {
+             case WL_CONNECTED:
+                 TDECK_LOG_I("WiFi connected to: %s", WiFi.SSID().c_str());
+                 TDECK_LOG_I("IP address: %s", WiFi.localIP().toString().c_str());
+                 
+                 if (_connectionStartTime > 0) {
+                     TDECK_LOG_I("Connected in %lu ms%s", currentTime - _connectionStartTime,
+                                 _fastConnecting ? " (fast reconnect)" : "");
+                 }
+                 _fastConnecting = false;
+                 _reconnectAttempted = false;
+                 _connectionStartTime = 0;
+                 
+                 // Remember the network, access point and lease for the next reconnect
+                 saveFastConnect();
+                 break;
+                 
+             case WL_DISCONNECTED:
+                 TDECK_LOG_I("WiFi disconnected");
+                 break;
+                 
+             case WL_CONNECT_FAILED:
+                 TDECK_LOG_W("WiFi connection failed");
+                 break;
+                 
+             case WL_NO_SSID_AVAIL:
+                 TDECK_LOG_W("WiFi SSID not available");
+                 break;
+                 
+             default:
+                 TDECK_LOG_I("WiFi status changed: %d", currentStatus);
+                 break;
          }
+     }
+     
+     // A directed reconnect gets a short time, then the normal path takes over
+     if (_fastConnecting && currentStatus != WL_CONNECTED &&
+         (currentStatus == WL_CONNECT_FAILED || currentStatus == WL_NO_SSID_AVAIL ||
+          currentTime - _connectionStartTime > TDECK_WIFI_FAST_CONNECT_TIMEOUT_MS)) {
+         fallBackFromFastConnect();
+     }
+     
+     // Handle connection timeout
+     if (currentStatus == WL_CONNECTING && 
+         _connectionStartTime > 0 && 
+         currentTime - _connectionStartTime > _connectionTimeout) {
+         handleConnectTimeout();
+     }
+     
+     // Auto-reconnect logic (if disconnected and not already trying to reconnect)
+     if (currentStatus == WL_DISCONNECTED && 
+         !_reconnectAttempted && 
+         _config.autoConnect && 
+         !_config.lastConnectedSsid.isEmpty()) {
          
-         // Auto-reconnect logic (if disconnected and not already trying to reconnect)
-         if (currentStatus == WL_DISCONNECTED && 
-             !_reconnectAttempted && 
-             _config.autoConnect && 
-             !_config.lastConnectedSsid.isEmpty()) {
-             
-             // Only try to reconnect if we have been connected before
-             _reconnectAttempted = true;
-             
-             // Try to reconnect
-             TDECK_LOG_I("Attempting to reconnect to: %s", _config.lastConnectedSsid.c_str());
-             WiFi.begin();
-             _connectionStartTime = currentTime;
-         }
+         // Only try to reconnect if we have been connected before
+         TDECK_LOG_I("Attempting to reconnect to: %s", _config.lastConnectedSsid.c_str());
+         reconnect();
      }
      
-     // Check if scan has completed
+     // Merge each channel as it completes, the scan done event brings us here at once
      if (_scanInProgress && WiFi.scanComplete() != WIFI_SCAN_RUNNING) {
          int numNetworks = WiFi.scanComplete();
-         _scanInProgress = false;
+         uint8_t channel = _scanChannels[_scanChannelIndex];
          
-         TDECK_LOG_I("WiFi scan completed, found %d networks", numNetworks);
-         
-         // Clear previous results
-         _scanResults.clear();
-         
-         if (numNetworks > 0) {
-             // Process scan results
-             for (int i = 0; i < numNetworks; i++) {
-                 WiFiNetwork network;
-                 network.ssid = WiFi.SSID(i);
-                 network.rssi = WiFi.RSSI(i);
-                 network.encryptionType = WiFi.encryptionType(i);
-                 network.bssid = WiFi.BSSIDstr(i);
-                 network.channel = WiFi.channel(i);
-                 
-                 // Check if we're currently connected to this network
-                 network.isConnected = (WiFi.status() == WL_CONNECTED && 
-                                      WiFi.SSID() == network.ssid);
-                 
-                 _scanResults.push_back(network);
-             }
-             
-             // Sort networks by signal strength (RSSI)
-             std::sort(_scanResults.begin(), _scanResults.end(), 
-                      [](const WiFiNetwork& a, const WiFiNetwork& b) {
-                          return a.rssi > b.rssi;
-                      });
+         if (numNetworks >= 0) {
+             mergeScanResults(channel, numNetworks);
+         } else {
+             TDECK_LOG_W("WiFi scan of channel %d failed", channel);
          }
          
          // Delete scan results from memory
          WiFi.scanDelete();
+         
+         if (_scanCallback) {
+             _scanCallback(WIFI_SCAN_CHANNEL_DONE, channel);
+         }
+         
+         // Next channel, or the end of the scan
+         bool next = false;
+         while (!next && ++_scanChannelIndex < _scanChannels.size()) {
+             next = scanChannel(_scanChannels[_scanChannelIndex]);
+         }
+         if (!next) {
+             _scanInProgress = false;
+             TDECK_LOG_I("WiFi scan completed, %u networks known", _scanResults.size());
+             if (_scanCallback) {
+                 _scanCallback(WIFI_SCAN_FINISHED, _scanResults.size());
+             }
+         }
      }
  }
  
  // Start scanning for WiFi networks
- bool WiFiManager::startScan() {
+ bool WiFiManager::startScan(const std::vector<uint8_t>& channels) {
      // Can't start a new scan if one is already in progress
      if (_scanInProgress) {
          return false;
@@ -177,12 +177,21 @@
          return false;
      }
      
-     TDECK_LOG_I("Starting WiFi scan");
+     // One channel at a time, so each can be published as soon as it is done
+     _scanChannels = channels;
+     if (_scanChannels.empty()) {
+         for (uint8_t channel = 1; channel <= TDECK_WIFI_SCAN_CHANNELS; channel++) {
+             _scanChannels.push_back(channel);
+         }
+     }
      
-     // Start async scan (non-blocking)
-     int result = WiFi.scanNetworks(true); // async=true
+     TDECK_LOG_I("Starting WiFi scan of %u channels", _scanChannels.size());
      
-     if (result == WIFI_SCAN_FAILED) {
+     _scanChannelIndex = 0;
+     while (_scanChannelIndex < _scanChannels.size() && !scanChannel(_scanChannels[_scanChannelIndex])) {
+         _scanChannelIndex++;
+     }
+     if (_scanChannelIndex == _scanChannels.size()) {
          TDECK_LOG_E("WiFi scan failed to start");
          return false;
      }
@@ -192,9 +201,87 @@
      return true;
  }
  
- // Get results of the last WiFi scan
+ // Get a copy of the scan results, strongest first
  std::vector<WiFiNetwork> WiFiManager::getScanResults() {
-     return _scanResults;
+     std::vector<WiFiNetwork> results = _scanResults;
+     std::sort(results.begin(), results.end(),
+              [](const WiFiNetwork& a, const WiFiNetwork& b) {
+                  return a.rssi > b.rssi;
+              });
+     return results;
+ }
+ 
+ // Get the number of networks in the scan result table
+ size_t WiFiManager::getScanResultCount() const {
+     return _scanResults.size();
+ }
+ 
+ // Get one network of the scan result table
+ const WiFiNetwork& WiFiManager::getScanResult(size_t index) const {
+     return _scanResults[index];
+ }
+ 
+ // Register for changes to the scan result table
+ void WiFiManager::setScanCallback(WiFiScanCallback callback) {
+     _scanCallback = callback;
+ }
+ 
+ // Start the async scan of one channel
+ bool WiFiManager::scanChannel(uint8_t channel) {
+     int result = WiFi.scanNetworks(true, false, false, TDECK_WIFI_SCAN_DWELL_MS, channel);
+     return result != WIFI_SCAN_FAILED;
+ }
+ 
+ // Merge a finished channel scan into the result table
+ void WiFiManager::mergeScanResults(uint8_t channel, int count) {
+     std::vector<bool> heard(_scanResults.size(), false);
+     bool connected = WiFi.status() == WL_CONNECTED;
+     String connectedBssid = connected ? WiFi.BSSIDstr() : String();
+     
+     for (int i = 0; i < count; i++) {
+         WiFiNetwork network;
+         network.ssid = WiFi.SSID(i);
+         network.rssi = WiFi.RSSI(i);
+         network.encryptionType = WiFi.encryptionType(i);
+         network.bssid = WiFi.BSSIDstr(i);
+         network.channel = WiFi.channel(i);
+         network.isConnected = connected && network.bssid == connectedBssid;
+         
+         // A few dozen access points at most, a linear lookup is enough
+         size_t index = 0;
+         while (index < _scanResults.size() && _scanResults[index].bssid != network.bssid) {
+             index++;
+         }
+         
+         if (index == _scanResults.size()) {
+             _scanResults.push_back(network);
+             heard.push_back(true);
+             if (_scanCallback) {
+                 _scanCallback(WIFI_SCAN_NETWORK_ADDED, index);
+             }
+             continue;
+         }
+         
+         WiFiNetwork& known = _scanResults[index];
+         bool changed = known.rssi != network.rssi || known.ssid != network.ssid ||
+                        known.channel != network.channel || known.encryptionType != network.encryptionType ||
+                        known.isConnected != network.isConnected;
+         known = network;
+         heard[index] = true;
+         if (changed && _scanCallback) {
+             _scanCallback(WIFI_SCAN_NETWORK_UPDATED, index);
+         }
+     }
+     
+     // Networks on this channel that did not answer are gone, from the back so indices hold
+     for (size_t index = _scanResults.size(); index-- > 0; ) {
+         if (!heard[index] && _scanResults[index].channel == channel) {
+             if (_scanCallback) {
+                 _scanCallback(WIFI_SCAN_NETWORK_REMOVED, index);
+             }
+             _scanResults.erase(_scanResults.begin() + index);
+         }
+     }
  }
  
  // Check if WiFi scan is in progress
@@ -218,20 +305,61 @@
      WiFi.disconnect();
      delay(100);
      
+     // A new network gets its address from DHCP
+     WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+     
      // Begin connection with provided credentials
      WiFi.begin(ssid.c_str(), password.c_str());
      
      // Reset flags and timers
      _reconnectAttempted = false;
+     _fastConnecting = false;
      _connectionStartTime = millis();
      
      return true;
  }
  
+ // Reconnect to the last network, directed at the cached access point when known
+ bool WiFiManager::reconnect() {
+     if (_config.lastConnectedSsid.isEmpty()) {
+         return false;
+     }
+     
+     _reconnectAttempted = true;
+     _connectionStartTime = millis();
+     
+     // The password is only kept in the driver's NVS copy of the station config
+     wifi_config_t stored;
+     bool cached = _config.lastChannel > 0 &&
+                   esp_wifi_get_config(WIFI_IF_STA, &stored) == ESP_OK &&
+                   _config.lastConnectedSsid == (const char*)stored.sta.ssid;
+     if (!cached) {
+         _fastConnecting = false;
+         WiFi.begin();
+         return true;
+     }
+     
+     // A known lease skips the DHCP round trips, only if the user opted in
+     if (_config.reuseLease && (uint32_t)_config.lastIp != 0) {
+         WiFi.config(_config.lastIp, _config.lastGateway, _config.lastSubnet, _config.lastDns);
+     } else {
+         WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+     }
+     
+     // One channel, one BSSID: no scan before the association
+     TDECK_LOG_I("Fast reconnect to %s on channel %d", _config.lastConnectedSsid.c_str(), _config.lastChannel);
+     _fastConnecting = true;
+     WiFi.begin((const char*)stored.sta.ssid, (const char*)stored.sta.password,
+                _config.lastChannel, _config.lastBssid);
+     return true;
+ }
+ 
  // Disconnect from current WiFi network
- void WiFiManager::disconnect() {
+ void WiFiManager::disconnect(bool radioOff) {
      TDECK_LOG_I("Disconnecting from WiFi");
-     WiFi.disconnect();
+     
+     // With the radio stopped the status leaves WL_DISCONNECTED, so update() does not reconnect
+     WiFi.disconnect(radioOff);
  }
  
  // Check if connected to a WiFi network
@@ -334,6 +462,19 @@
      doc["apHidden"] = _config.apHidden;
      doc["apMaxConnections"] = _config.apMaxConnections;
      
+     // Fast reconnect cache
+     char bssid[18];
+     snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X",
+              _config.lastBssid[0], _config.lastBssid[1], _config.lastBssid[2],
+              _config.lastBssid[3], _config.lastBssid[4], _config.lastBssid[5]);
+     doc["lastBssid"] = bssid;
+     doc["lastChannel"] = _config.lastChannel;
+     doc["lastIp"] = _config.lastIp.toString();
+     doc["lastGateway"] = _config.lastGateway.toString();
+     doc["lastSubnet"] = _config.lastSubnet.toString();
+     doc["lastDns"] = _config.lastDns.toString();
+     doc["reuseLease"] = _config.reuseLease;
+     
      // Store preferred networks as array
      JsonArray networks = doc.createNestedArray("preferredNetworks");
      for (const auto& network : _config.preferredNetworks) {
@@ -341,7 +482,7 @@
      }
      
      // Save to file
-     return fsManager.saveJsonToFile(TDECK_FS_WIFI_CONFIG_FILE, doc);
+     return configStorage.write(TDECK_FS_WIFI_CONFIG_FILE, doc);
  }
  
  // Load WiFi configuration
@@ -352,7 +493,7 @@
      DynamicJsonDocument doc(2048); // Adjust size as needed
      
      // Check if config file exists and load it
-     if (!fsManager.loadJsonFromFile(TDECK_FS_WIFI_CONFIG_FILE, doc)) {
+     if (!configStorage.read(TDECK_FS_WIFI_CONFIG_FILE, doc)) {
          TDECK_LOG_W("WiFi config file not found or invalid JSON");
          return false;
      }
@@ -367,6 +508,23 @@
      _config.apHidden = doc["apHidden"] | TDECK_WIFI_AP_HIDE_SSID;
      _config.apMaxConnections = doc["apMaxConnections"] | TDECK_WIFI_AP_MAX_CONNECTIONS;
      
+     // Fast reconnect cache, a malformed BSSID leaves the channel unknown
+     const char* bssid = doc["lastBssid"] | "";
+     unsigned int octets[6];
+     _config.lastChannel = 0;
+     if (sscanf(bssid, "%x:%x:%x:%x:%x:%x", &octets[0], &octets[1], &octets[2],
+                &octets[3], &octets[4], &octets[5]) == 6) {
+         for (int i = 0; i < 6; i++) {
+             _config.lastBssid[i] = octets[i];
+         }
+         _config.lastChannel = doc["lastChannel"] | 0;
+     }
+     _config.lastIp.fromString(doc["lastIp"] | "0.0.0.0");
+     _config.lastGateway.fromString(doc["lastGateway"] | "0.0.0.0");
+     _config.lastSubnet.fromString(doc["lastSubnet"] | "0.0.0.0");
+     _config.lastDns.fromString(doc["lastDns"] | "0.0.0.0");
+     _config.reuseLease = doc["reuseLease"] | false;
+     
      // Clear and load preferred networks
      _config.preferredNetworks.clear();
      if (doc.containsKey("preferredNetworks") && doc["preferredNetworks"].is<JsonArray>()) {
@@ -482,6 +640,13 @@
      _config.apChannel = TDECK_WIFI_AP_CHANNEL;
      _config.apHidden = TDECK_WIFI_AP_HIDE_SSID;
      _config.apMaxConnections = TDECK_WIFI_AP_MAX_CONNECTIONS;
+     memset(_config.lastBssid, 0, sizeof(_config.lastBssid));
+     _config.lastChannel = 0;
+     _config.lastIp = IPAddress();
+     _config.lastGateway = IPAddress();
+     _config.lastSubnet = IPAddress();
+     _config.lastDns = IPAddress();
+     _config.reuseLease = false;
  }
  
  // Handle connection timeout
@@ -500,6 +665,48 @@
      }
  }
  
+ // Drop a failed directed reconnect and start a normal one
+ void WiFiManager::fallBackFromFastConnect() {
+     TDECK_LOG_W("Fast reconnect failed, scanning for %s", _config.lastConnectedSsid.c_str());
+     _fastConnecting = false;
+     
+     // The access point may have moved channel or the lease may be gone
+     _config.lastChannel = 0;
+     WiFi.disconnect();
+     WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+     WiFi.begin();
+     _connectionStartTime = millis();
+ }
+ 
+ // Record the current connection in the fast reconnect cache
+ void WiFiManager::saveFastConnect() {
+     const uint8_t* bssid = WiFi.BSSID();
+     uint8_t channel = WiFi.channel();
+     
+     // Written only when something changed, most reconnects find the same values
+     bool changed = _config.lastConnectedSsid != WiFi.SSID() ||
+                    _config.lastChannel != channel ||
+                    (bssid && memcmp(_config.lastBssid, bssid, sizeof(_config.lastBssid)) != 0) ||
+                    _config.lastIp != WiFi.localIP() ||
+                    _config.lastGateway != WiFi.gatewayIP() ||
+                    _config.lastSubnet != WiFi.subnetMask() ||
+                    _config.lastDns != WiFi.dnsIP();
+     if (!changed) {
+         return;
+     }
+     
+     _config.lastConnectedSsid = WiFi.SSID();
+     _config.lastChannel = bssid ? channel : 0;
+     if (bssid) {
+         memcpy(_config.lastBssid, bssid, sizeof(_config.lastBssid));
+     }
+     _config.lastIp = WiFi.localIP();
+     _config.lastGateway = WiFi.gatewayIP();
+     _config.lastSubnet = WiFi.subnetMask();
+     _config.lastDns = WiFi.dnsIP();
+     saveConfig();
+ }
+ 
  // Automatically connect to preferred networks
  bool WiFiManager::autoConnectToPreferred() {
      // Only proceed if we have preferred networks and auto-connect is enabled
@@ -520,19 +727,24 @@
          return false;
      }
      
-     // Try to find a preferred network in scan results
+     // Find the strongest preferred network in the scan results, the table is in the order found
+     const WiFiNetwork* best = nullptr;
      for (const auto& result : _scanResults) {
          for (const auto& preferred : _config.preferredNetworks) {
-             if (result.ssid == preferred) {
-                 // Found a match, try to connect
-                 // This requires the password to be saved in the ESP32's NVS
-                 TDECK_LOG_I("Attempting to connect to preferred network: %s", preferred.c_str());
-                 WiFi.begin(preferred.c_str());
-                 _connectionStartTime = millis();
-                 return true;
+             if (result.ssid == preferred && (best == nullptr || result.rssi > best->rssi)) {
+                 best = &result;
              }
          }
      }
      
-     return false; // No suitable network found
+     if (best == nullptr) {
+         return false; // No suitable network found
+     }
+     
+     // Found a match, try to connect
+     // This requires the password to be saved in the ESP32's NVS
+     TDECK_LOG_I("Attempting to connect to preferred network: %s", best->ssid.c_str());
+     WiFi.begin(best->ssid.c_str());
+     _connectionStartTime = millis();
+     return true;
  }
\ No newline at end of file
@@ -13,6 +13,7 @@
  #include <Arduino.h>
  #include <WiFi.h>
  #include <vector>
+ #include <functional>
  #include <ArduinoJson.h>
  #include "../config.h"
  #include "../system/fs_manager.h"
@@ -32,6 +33,20 @@
      bool isConnected;
  };
  
+ /**
+  * @brief Changes to the scan result table, reported as each channel completes
+  */
+ enum WiFiScanEvent {
+     WIFI_SCAN_NETWORK_ADDED,    // New BSSID, appended at index
+     WIFI_SCAN_NETWORK_UPDATED,  // Known BSSID at index heard again with a new RSSI or details
+     WIFI_SCAN_NETWORK_REMOVED,  // BSSID at index not heard on its channel, erased after the call
+     WIFI_SCAN_CHANNEL_DONE,     // A channel finished, index is the channel number
+     WIFI_SCAN_FINISHED          // Every requested channel scanned, index is the table size
+ };
+ 
+ // Scan table change notification, runs on the task calling update()
+ using WiFiScanCallback = std::function<void(WiFiScanEvent event, size_t index)>;
+ 
  /**
   * @brief Structure to hold WiFi configuration
   */
@@ -45,6 +60,15 @@
      uint8_t apChannel;         // Custom AP channel (if not using default)
      bool apHidden;             // Whether to hide AP SSID
      uint8_t apMaxConnections;  // Maximum number of AP connections
+     
+     // Fast reconnect cache, describes the last connection to lastConnectedSsid
+     uint8_t lastBssid[6];      // Access point, all zero if unknown
+     uint8_t lastChannel;       // Channel, 0 if unknown
+     IPAddress lastIp;          // DHCP lease
+     IPAddress lastGateway;
+     IPAddress lastSubnet;
+     IPAddress lastDns;
+     bool reuseLease;           // Reconnect with the last lease as a static IP, skipping DHCP
  };
  
  /**
@@ -66,25 +90,55 @@
      bool init();
  
      /**
-      * @brief Update WiFi status (called periodically)
+      * @brief Update WiFi status
+      * 
+      * Run by the system scheduler every second and right after each WiFi event.
       */
      void update();
  
      /**
       * @brief Scan for available WiFi networks
       * 
+      * Channels are scanned one at a time and merged into the result table as
+      * each completes, so results appear progressively. The table is keyed by
+      * BSSID and keeps its order between scans; a network that no longer
+      * answers on a rescanned channel is removed.
+      * 
+      * @param channels Channels to scan, empty for 1 to TDECK_WIFI_SCAN_CHANNELS
       * @return true if scan started successfully
       * @return false if scan failed to start
       */
-     bool startScan();
+     bool startScan(const std::vector<uint8_t>& channels = std::vector<uint8_t>());
  
      /**
-      * @brief Get results of the last WiFi scan
+      * @brief Get a copy of the scan results, strongest first
       * 
       * @return std::vector<WiFiNetwork> List of found WiFi networks
       */
      std::vector<WiFiNetwork> getScanResults();
  
+     /**
+      * @brief Get the number of networks in the scan result table
+      * 
+      * @return size_t Number of networks
+      */
+     size_t getScanResultCount() const;
+ 
+     /**
+      * @brief Get one network of the scan result table
+      * 
+      * @param index Table index, as reported to the scan callback
+      * @return const WiFiNetwork& Network, valid until the next update()
+      */
+     const WiFiNetwork& getScanResult(size_t index) const;
+ 
+     /**
+      * @brief Register for changes to the scan result table
+      * 
+      * @param callback Callback, nullptr to stop notifications
+      */
+     void setScanCallback(WiFiScanCallback callback);
+ 
      /**
       * @brief Check if WiFi scan is in progress
       * 
@@ -103,11 +157,26 @@
       * @return false if connection attempt failed to start
       */
      bool connect(const String& ssid, const String& password, bool saveCredentials = true);
+     
+     /**
+      * @brief Reconnect to the last network
+      * 
+      * When the access point and channel of the last connection are known,
+      * associates with it directly on that channel, and with reuseLease set
+      * skips DHCP as well. Falls back to a full scan if that fails within
+      * TDECK_WIFI_FAST_CONNECT_TIMEOUT_MS.
+      * 
+      * @return true if a connection attempt started
+      * @return false if there is no network to reconnect to
+      */
+     bool reconnect();
  
      /**
       * @brief Disconnect from the current WiFi network
+      * 
+      * @param radioOff Also stop the radio, reconnect() starts it again
       */
-     void disconnect();
+     void disconnect(bool radioOff = false);
  
      /**
       * @brief Get the current connection status
@@ -227,14 +296,17 @@
  
  private:
      WiFiConfig _config;                   // WiFi configuration
-     std::vector<WiFiNetwork> _scanResults; // Results of the last scan
+     std::vector<WiFiNetwork> _scanResults; // Scan result table, one entry per BSSID in order found
      bool _scanInProgress;                 // Whether a scan is currently in progress
+     std::vector<uint8_t> _scanChannels;   // Channels of the current scan
+     size_t _scanChannelIndex;             // Channel being scanned
+     WiFiScanCallback _scanCallback;       // Scan table change notification
      unsigned long _lastScanTime;          // Timestamp of the last scan
-     unsigned long _lastStatusCheck;       // Timestamp of the last status check
      wl_status_t _lastStatus;              // Last WiFi status
      bool _reconnectAttempted;             // Whether a reconnect has been attempted
      unsigned long _connectionStartTime;    // When current connection attempt started
      unsigned long _connectionTimeout;      // Timeout for connection attempt
+     bool _fastConnecting;                 // Current attempt is directed at the cached access point
  
      /**
       * @brief Convert WiFi encryption type to readable string
@@ -244,6 +316,22 @@
       */
      String encryptionTypeToString(uint8_t encType);
  
+     /**
+      * @brief Start the async scan of one channel
+      * 
+      * @param channel Channel number
+      * @return true if the scan started
+      */
+     bool scanChannel(uint8_t channel);
+ 
+     /**
+      * @brief Merge a finished channel scan into the result table
+      * 
+      * @param channel Channel that was scanned
+      * @param count Networks the driver found
+      */
+     void mergeScanResults(uint8_t channel, int count);
+ 
      /**
       * @brief Create default configuration
       */
@@ -254,6 +342,16 @@
       */
      void handleConnectTimeout();
  
+     /**
+      * @brief Drop a failed directed reconnect and start a normal one
+      */
+     void fallBackFromFastConnect();
+ 
+     /**
+      * @brief Record the current connection in the fast reconnect cache
+      */
+     void saveFastConnect();
+ 
      /**
       * @brief Automatically connect to preferred networks
       * 
@@ -26,14 +26,34 @@
  #define TDECK_DISPLAY_BL_CHANNEL 0   // PWM channel for backlight
  #define TDECK_DISPLAY_BL_RESOLUTION 8 // PWM resolution for backlight
  #define TDECK_DISPLAY_BL_MAX 255     // Maximum backlight value
+ #define TDECK_DISPLAY_FLUSH_DMA 1    // Flush LVGL buffers with async SPI DMA (0 = blocking pushColors)
+ #define TDECK_DISPLAY_BUF_LINES 40   // Height of each LVGL draw buffer in display lines
+ #define TDECK_TOUCH_IRQ_MODE 1       // Sample touch on a reader task woken by TDECK_TOUCH_INT (0 = poll from UI task)
+ #define TDECK_TOUCH_QUEUE_SIZE 32    // Buffered touch samples, must be a power of two
+ #define TDECK_TOUCH_SAMPLE_MS 10     // Resample interval while a finger is down
+ #define TDECK_KEYBOARD_DEBOUNCE_MS 5 // Per-key debounce time in milliseconds
+ #define TDECK_KEYBOARD_QUEUE_SIZE 32 // Buffered key events, must be a power of two
+ #define TDECK_SPI_LORA_FREQUENCY 8000000 // LoRa radio clock on the shared SPI bus
+ #define TDECK_SPI_DISPLAY_FREQUENCY 40000000 // Display clock, TFT_eSPI is built with the same SPI_FREQUENCY
+ #define TDECK_SPI_SD_FREQUENCY 20000000 // SD card clock on the shared SPI bus
+ #define TDECK_SPI_SD_BURST 4096      // Bytes an SD transfer moves before stepping aside for the radio or display
  
  // Battery
  #define TDECK_BATTERY_MIN_VOLTAGE 3.3f  // Minimum battery voltage
  #define TDECK_BATTERY_MAX_VOLTAGE 4.2f  // Maximum battery voltage
  #define TDECK_BATTERY_LOW_THRESHOLD 15  // Low battery warning threshold (%)
  #define TDECK_BATTERY_CRITICAL_THRESHOLD 5 // Critical battery threshold (%)
+ #define TDECK_BATTERY_DIVIDER 2.0f      // Battery to ADC pin voltage divider ratio
+ #define TDECK_BATTERY_OVERSAMPLE 256    // ADC conversions averaged per battery reading
+ #define TDECK_BATTERY_ADC_RATE 20000    // Conversion rate of a battery reading burst in Hz
+ #define TDECK_BATTERY_FILTER_SHIFT 2    // Each reading moves the published voltage by 1/4 of the difference
  #define TDECK_POWER_SAVE_TIMEOUT 60000  // Power save timeout in milliseconds (1 minute)
  #define TDECK_SLEEP_TIMEOUT 300000      // Sleep timeout in milliseconds (5 minutes)
+ #define TDECK_PM_MAX_MHZ 240            // CPU clock in NORMAL while busy or a PM lock is held
+ #define TDECK_PM_MIN_MHZ 80             // CPU clock in NORMAL while every task is blocked
+ #define TDECK_PM_LOW_POWER_MAX_MHZ 80   // CPU clock in LOW_POWER while busy or a PM lock is held
+ #define TDECK_PM_LOW_POWER_MIN_MHZ 40   // CPU clock in LOW_POWER while every task is blocked
+ #define TDECK_PM_LIGHT_SLEEP 1          // Light sleep between ticks when idle (needs a tickless idle build)
  
  // LoRa Configuration
  #define TDECK_LORA_FREQUENCY 915E6   // Default LoRa frequency in Hz (915MHz)
@@ -41,6 +61,61 @@
  #define TDECK_LORA_SPREADING_FACTOR 7 // Default spreading factor
  #define TDECK_LORA_CODING_RATE 5     // Default coding rate (4/5)
  #define TDECK_LORA_SYNC_WORD 0x12    // Default sync word
+ #define TDECK_LORA_RX_QUEUE_SIZE 8   // Received packets buffered between the radio and dispatch
+ #define TDECK_LORA_RX_POLL_MS 1000   // Comms task wakes at least this often in case a DIO edge is missed
+ 
+ // DIO can only be an interrupt and wake source on a line no other peripheral drives
+ #if TDECK_LORA_DIO == TDECK_TOUCH_SCL || TDECK_LORA_DIO == TDECK_TOUCH_SDA || \
+     TDECK_LORA_DIO == TDECK_KEYBOARD_SCL || TDECK_LORA_DIO == TDECK_KEYBOARD_SDA
+ #define TDECK_LORA_DIO_IRQ 0
+ #else
+ #define TDECK_LORA_DIO_IRQ 1
+ #endif
+ #define TDECK_LORA_POLL_MS 20        // Radio poll interval when the DIO interrupt is not available
+ #define TDECK_LORA_MAX_PEERS 16      // Peers whose payload format is remembered
+ #define TDECK_LORA_POOL_SIZE 32      // Preallocated packet buffers shared by RX, TX and apps
+ #define TDECK_LORA_TX_QUEUE_SIZE 8   // Packets waiting for the comms task to transmit
+ #define TDECK_LORA_WINDOW_SIZE 4     // Unacknowledged reliable packets per destination
+ #define TDECK_LORA_RELIABLE_PEERS 4  // Peers with reliable send/receive windows at once
+ #define TDECK_LORA_ACK_TIMEOUT_MS 1500 // First retransmit timeout, doubled on each retry
+ #define TDECK_LORA_MAX_RETRIES 4     // Retransmissions before a packet is reported lost
+ #define TDECK_LORA_ACK_DELAY_MS 50   // Receiver waits this long to cover several packets with one ACK
+ #define TDECK_LORA_TRANSFERS 4       // Fragmented transfers being sent at once
+ #define TDECK_LORA_REASSEMBLY_SLOTS 2 // Fragmented transfers being received at once
+ #define TDECK_LORA_TRANSFER_MAX (16 * 1024) // Largest fragmented payload in bytes
+ #define TDECK_LORA_REASSEMBLY_TIMEOUT_MS 30000 // Incomplete transfer is dropped after this long without a fragment
+ #define TDECK_LORA_TRANSFER_CALLBACKS 4 // Receivers of reassembled transfers (OTA, voice notes, ...)
+ #define TDECK_LORA_VOICE_MAX_MS 30000 // Longest voice note, 6 KB at the default Codec2 bitrate
+ #define TDECK_LORA_VOICE_DECODE_STACK_SIZE (24 * 1024) // Voice note decode task stack, Codec2 needs a deep one
+ #define TDECK_LORA_LBT_RETRIES 5     // Busy-channel backoffs before transmitting anyway
+ #define TDECK_LORA_LBT_BACKOFF_MS 100 // Mean random backoff after CAD finds the channel busy
+ #define TDECK_LORA_RX_DUTY_CYCLE_MS 0 // Radio sleeps this long between CAD checks (0 = always receive)
+ #define TDECK_LORA_RX_LISTEN_MS 500  // Receive window after activity, a transmit or a wake-up
+ #define TDECK_LORA_ADR_PEERS 16      // Peers with link history for adaptive data rate
+ #define TDECK_LORA_ADR_MARGIN_DB 6.0f // SNR margin kept above the demodulation floor of a faster rate
+ #define TDECK_LORA_ADR_MIN_SAMPLES 3 // Packets heard from a peer before offering it a faster rate
+ #define TDECK_LORA_ADR_STALE_MS 300000 // Link history older than this is not trusted
+ #define TDECK_LORA_MESH_RELAY 0      // Forward packets for other nodes by default
+ #define TDECK_LORA_MESH_HOPS 3       // Hop limit of packets we originate (at most 15)
+ #define TDECK_LORA_MESH_SEEN_BUCKETS 32 // Seen-packet cache buckets (power of two, 4 entries each)
+ #define TDECK_LORA_MESH_SEEN_MS 60000 // A seen packet is remembered this long
+ #define TDECK_LORA_MESH_PENDING 4    // Rebroadcasts waiting for their delay
+ #define TDECK_LORA_MESH_DELAY_MIN_MS 20 // Rebroadcast delay at the lowest SNR, also the jitter range
+ #define TDECK_LORA_MESH_DELAY_MAX_MS 500 // Rebroadcast delay at the highest SNR
+ #define TDECK_LORA_ADR_HOLD_MS 1000  // Both ends stay on a faster rate this long after the last packet, below the ACK timeout
+ #define TDECK_LORA_DUTY_WINDOW_MIN 60 // Rolling window of the transmit duty cycle in minutes
+ #define TDECK_LORA_STATS_PEERS 8     // Peers with delivery and round-trip statistics
+ #define TDECK_LORA_BENCH_COUNT 20    // Default packets per benchmark run
+ #define TDECK_LORA_BENCH_SIZE 32     // Default benchmark payload in bytes
+ #define TDECK_LORA_GATEWAY_QUEUE 256 // Received packets the gateway holds in PSRAM, oldest dropped first
+ #define TDECK_LORA_GATEWAY_BATCH_MAX 64 // Largest gateway uplink batch in packets
+ #define TDECK_LORA_GATEWAY_BATCH_PACKETS 32 // Default packets that make a full gateway batch
+ #define TDECK_LORA_GATEWAY_BATCH_MS 60000 // Default longest a packet waits for its gateway batch
+ #define TDECK_LORA_GATEWAY_CONNECT_TIMEOUT_MS 10000 // Gateway gives up waiting for WiFi after this long
+ #define TDECK_LORA_GATEWAY_HTTP_TIMEOUT_MS 10000 // Gateway uplink request timeout
+ #define TDECK_LORA_GATEWAY_RETRY_MS 5000 // First retry after a failed uplink, doubled on each failure
+ #define TDECK_LORA_GATEWAY_RETRY_MAX_MS 300000 // Longest delay between uplink retries
+ #define TDECK_LORA_BENCH_PING_TIMEOUT_MS 5000 // A benchmark ping without a pong is counted lost after this long
  
  // WiFi Configuration
  #define TDECK_WIFI_AP_SSID "T-Deck"  // Default Access Point SSID
@@ -49,18 +124,58 @@
  #define TDECK_WIFI_AP_MAX_CONNECTIONS 4 // Maximum AP connections
  #define TDECK_WIFI_AP_HIDE_SSID false // Hide SSID
  #define TDECK_WIFI_SCAN_TIMEOUT 10000 // WiFi scan timeout in milliseconds
+ #define TDECK_WIFI_SCAN_CHANNELS 13   // Channels an incremental scan covers by default, 1 to this
+ #define TDECK_WIFI_SCAN_DWELL_MS 120  // Active scan time per channel
+ #define TDECK_WIFI_FAST_CONNECT_TIMEOUT_MS 1500 // Directed reconnect to the cached access point before a full scan
  
  // Bluetooth Configuration
  #define TDECK_BT_DEVICE_NAME "T-Deck" // Bluetooth device name
+ #define TDECK_BLE_SCAN_TABLE_SIZE 128 // Advertisers the scan table holds, a power of two filled to 3/4 at most
+ #define TDECK_BLE_SCAN_AGE_MS 30000  // A scanned device not heard for this long leaves the table
+ #define TDECK_BLE_SCAN_BATCH_MS 1000 // Shortest time between scan batches delivered to the UI
+ #define TDECK_BLE_SCAN_REFRESH_MS 3000 // A duplicate-filtered scan restarts this often so RSSI keeps updating
+ #define TDECK_BLE_SCAN_INTERVAL 0x50 // Scan interval in 0.625 ms units
+ #define TDECK_BLE_SCAN_WINDOW 0x30   // Scan window in 0.625 ms units
+ #define TDECK_BLE_DATA_MTU 517       // Largest ATT MTU the data channel accepts
+ #define TDECK_BLE_DATA_TX_BUFFER 16384 // Data channel TX ring in PSRAM, bytes
+ #define TDECK_BLE_DATA_RX_BUFFER 8192 // Data channel RX ring in PSRAM, bytes
+ #define TDECK_BLE_DATA_MAX_CREDITS 64 // Notifications the peer may grant ahead
+ #define TDECK_BLE_DATA_FLUSH_MS 10   // A partial chunk waits this long for more data
+ #define TDECK_BLE_DATA_STACK_SIZE 4096 // Data channel TX task stack
+ 
+ // USB Configuration
+ #define TDECK_USB_CHUNK_SIZE 8192    // Payload of one binary transfer DATA frame
+ #define TDECK_USB_WINDOW 8           // DATA frames in flight before an ACK is needed (at most 32)
+ #define TDECK_USB_ACK_TIMEOUT_MS 500 // Resend the oldest unacknowledged chunk after this long without progress
+ #define TDECK_USB_HASH_CHUNKS_PER_POLL 4 // Chunks hashed per update() while serving a HASH request
+ #define TDECK_USB_RX_BUFFER_SIZE (2 * TDECK_USB_CHUNK_SIZE + 64) // CDC receive buffer, two frames deep
+ 
+ // OTA Configuration
+ #define TDECK_OTA_SLOTS 4            // PSRAM buffers between the download and flash writer tasks
+ #define TDECK_OTA_SLOT_SIZE 32768    // Bytes per OTA buffer, one Update.write() each
+ #define TDECK_OTA_WRITER_STACK_SIZE 4096 // Flash writer task stack
+ #define TDECK_OTA_RETRIES 5          // Resume attempts in a row without progress before a download fails
+ #define TDECK_OTA_RETRY_DELAY_MS 2000 // Wait before a resume attempt, multiplied by the attempt number
+ #define TDECK_OTA_PROGRESS_INTERVAL_MS 250 // Shortest time between progress callbacks
+ #define TDECK_OTA_DELTA_SCRATCH_SIZE 4096 // Running firmware read per step while applying a delta patch
+ #define TDECK_OTA_PEER_TIMEOUT_MS 600000 // How long acceptPeerUpdate() waits for a LoRa update
  
  // UI Configuration
- #define TDECK_UI_REFRESH_RATE 20     // UI refresh rate in milliseconds
+ #define TDECK_UI_REFRESH_RATE 20     // UI poll interval in milliseconds while input is active
+ #define TDECK_UI_MAX_IDLE_MS 500     // Longest UI task sleep without a wake event
+ #define TDECK_UI_INPUT_IDLE_MS 200   // Keep polling input devices this long after the last input
+ #define TDECK_UI_WORK_QUEUE_SIZE 16  // Pending UI work items posted from other tasks
+ #define TDECK_UI_WARM_APPS 1         // Background apps that keep their screen, older ones are destroyed
+ #define TDECK_UI_APP_MIN_FREE_MEM (24U * 1024U) // Below this much free LVGL heap only the foreground app is kept
+ #define TDECK_LV_SRAM_MAX_BLOCK 256  // LVGL blocks up to this size (header included) go to internal SRAM
+ #define TDECK_LV_SRAM_BUDGET (64U * 1024U) // Internal SRAM LVGL may hold, further blocks go to PSRAM
  #define TDECK_STATUS_BAR_HEIGHT 24   // Status bar height in pixels
  #define TDECK_MAX_APPS 16            // Maximum number of apps in launcher
  #define TDECK_APP_ICON_SIZE 64       // App icon size in pixels
  #define TDECK_UI_ANIMATION_SPEED 200 // Animation duration in milliseconds
  #define TDECK_UI_BUTTON_PADDING 10   // Default padding for buttons
  #define TDECK_UI_DEFAULT_CORNER_RADIUS 5 // Default corner radius for UI elements
+ #define TDECK_FRAME_STATS_WINDOW 64  // Number of frames kept for rolling render statistics
  
  // File System Configuration
  #define TDECK_FS_MAX_PATH_LENGTH 128 // Maximum file path length
@@ -72,11 +187,33 @@
  #define TDECK_FS_WIFI_CONFIG_FILE "/config/wifi.json" // WiFi configuration file
  #define TDECK_FS_BT_CONFIG_FILE "/config/bluetooth.json" // Bluetooth configuration file
  #define TDECK_FS_LORA_CONFIG_FILE "/config/lora.json" // LoRa configuration file
+ #define TDECK_FS_GATEWAY_CONFIG_FILE "/config/gateway.json" // LoRa gateway configuration file
+ #define TDECK_CONFIG_CACHE_ENTRIES 16 // Configuration files held parsed in RAM
+ #define TDECK_CONFIG_WRITE_DELAY_MS 2000 // Quiet time before a changed configuration is written back
+ #define TDECK_CONFIG_WRITE_MAX_DELAY_MS 10000 // Longest a configuration change waits for write-back
+ #define TDECK_MESSAGE_LOG_FILE "/flash/messages.log" // LoRa Messenger record log
+ #define TDECK_MESSAGE_INDEX_FILE "/flash/messages.idx" // Offset index of the message log
+ #define TDECK_MESSAGE_PAGE_SIZE 10   // Messages loaded per screenful of history
+ #define TDECK_MESSAGE_HISTORY_MAX 500 // Messages kept per conversation
+ #define TDECK_MESSAGE_COMPACT_THRESHOLD 100 // Dead records that trigger a message log compaction
+ #define TDECK_MESSAGE_COMPACT_BATCH 8 // Records copied per update while compacting
+ #define TDECK_FS_LIST_BATCH_SIZE 32  // Entries per batch delivered by async directory listing
+ #define TDECK_FS_LIST_MAX_REQUESTS 4 // Async directory listings queued or running at once
+ #define TDECK_FS_STREAM_BUFFER_SIZE 16384 // Default read-ahead/write-behind buffer of an FSStream
+ #define TDECK_FS_WRITER_SLOTS 4 // Buffers queued between a producer and the SD writer task
+ #define TDECK_FS_WRITER_SLOT_SIZE 16384 // Bytes per writer buffer, a multiple of the 512 byte sector
+ #define TDECK_FS_WRITER_STACK_SIZE 4096 // SD writer task stack
+ #define TDECK_FS_CACHE_BUDGET 65536  // Bytes of PSRAM for cached directory listings (0 = disable)
+ #define TDECK_IMAGE_CACHE_BUDGET (2 * 1024 * 1024) // Bytes of PSRAM for decoded image tiles
+ #define TDECK_IMAGE_TILE_SIZE 64     // Edge length of a cached image tile in pixels
+ #define TDECK_IMAGE_PREFETCH 1       // Neighbouring images decoded ahead on each side
  
  // Feature flags
  #define TDECK_FEATURE_WIFI 1         // Enable/disable WiFi functionality
  #define TDECK_FEATURE_BLUETOOTH 1    // Enable/disable Bluetooth functionality
  #define TDECK_FEATURE_LORA 1         // Enable/disable LoRa functionality
+ #define TDECK_FEATURE_LORA_LBT 1     // Enable/disable listen-before-talk before each LoRa transmit
+ #define TDECK_FEATURE_LORA_COMPRESSION 1 // Enable/disable dictionary compression of outgoing LoRa text
  #define TDECK_FEATURE_SD_CARD 1      // Enable/disable SD card functionality
  #define TDECK_FEATURE_OTA 1          // Enable/disable OTA updates
  #define TDECK_FEATURE_BATTERY_MONITOR 1 // Enable/disable battery monitoring
@@ -87,13 +224,70 @@
  // System parameters
  #define TDECK_SYSTEM_TASK_STACK_SIZE 4096 // Stack size for system tasks
  #define TDECK_SYSTEM_TASK_PRIORITY 1  // Priority for system tasks
+ #define TDECK_SCHEDULER_MAX_SERVICES 12 // Services the system task scheduler can hold
+ #define TDECK_BOOT_TASK_STACK_SIZE 8192 // Stack size for the one-shot radio bring-up tasks
+ #define TDECK_BOOT_TIMELINE_MAX 24    // Boot stages the timeline can record
+ #define TDECK_ASSET_PARTITION "assets" // Label of the flash partition holding packed fonts and icons
+ #define TDECK_ASSET_GLYPH_CACHE_SLOTS 32 // PSRAM glyph bitmaps kept when the asset partition cannot be mapped
+ #define TDECK_ASSET_GLYPH_MAX_BYTES 320 // Largest glyph bitmap the cache holds, larger glyphs are not drawn
+ #define TDECK_SERVICE_BATTERY_ADC_MS 2000 // Battery ADC burst period, the battery and power managers read its result
+ #define TDECK_SERVICE_BATTERY_MS 10000 // Battery status and low battery callback period
+ #define TDECK_SERVICE_POWER_MS 5000   // Power state and idle timeout check period
+ #define TDECK_SERVICE_OTA_MS 5000     // OTA auto-check and download watchdog period
+ #define TDECK_SERVICE_WIFI_MS 1000    // WiFi status poll period, WiFi events run it at once
+ #define TDECK_SERVICE_BLUETOOTH_MS 1000 // Bluetooth status poll period
+ #define TDECK_SERVICE_PROFILER_MS 1000 // Task CPU snapshot period of the top command and System Info
  #define TDECK_UI_TASK_STACK_SIZE 8192 // Stack size for UI task
  #define TDECK_UI_TASK_PRIORITY 2      // Priority for UI task
+ #define TDECK_UI_NOTIFY_KEYBOARD (1 << 0) // UI task notification bit: keyboard interrupt
+ #define TDECK_UI_NOTIFY_TOUCH (1 << 1)    // UI task notification bit: touch interrupt
+ #define TDECK_UI_NOTIFY_WORK (1 << 2)     // UI task notification bit: work item posted
  #define TDECK_COMMS_TASK_STACK_SIZE 4096 // Stack size for communications tasks
- #define TDECK_COMMS_TASK_PRIORITY 1   // Priority for communications tasks
+ #define TDECK_COMMS_TASK_PRIORITY 3   // Priority for communications tasks (above UI so radio FIFOs drain promptly)
  
  // Memory allocation
- #define TDECK_HEAP_ALLOCATION_THRESHOLD 1024 // Warning threshold for heap allocations
+ #define TDECK_HEAP_ALLOCATION_THRESHOLD 1024 // Allocations this large are always kept as heap tracker sites
+ #ifndef TDECK_HEAP_TRACKING
+ #define TDECK_HEAP_TRACKING 0        // Track allocations through the malloc wrappers, set by the tdeck-heap environment
+ #endif
+ #define TDECK_HEAP_TRACK_SLOTS 2048  // Live blocks the heap tracker can record, a power of two
+ #define TDECK_HEAP_TRACK_SITES 64    // Allocation sites the heap tracker can record
+ #define TDECK_HEAP_TRACK_DEPTH 3     // Return addresses recorded per allocation site
+ #define TDECK_HEAP_TRACK_TASKS 16    // Tasks that can carry a heap tag
+ 
+ // Profiling
+ #define TDECK_PROFILER_MAX_TASKS 40  // Tasks a profiler snapshot can hold
+ #define TDECK_PROFILER_SAMPLE_HZ 997 // Sampling interrupt rate per core, off the 1 kHz RTOS tick to avoid aliasing
+ #define TDECK_PROFILER_MAX_HZ 10000  // Highest sampling rate perf accepts
+ #define TDECK_PROFILER_WATCH_MS 10000 // Sampling stops this long after the last top or System Info read
+ #define TDECK_PROFILER_PC_SLOTS 256  // PC buckets recorded per core, a power of two
+ #define TDECK_PROFILER_PC_GRANULE 16 // Bytes of code per PC bucket, a power of two
+ 
+ // Tracing
+ #define TDECK_TRACE_RING_SIZE 4096   // Trace ring bytes per core, a power of two
+ #define TDECK_TRACE_MAX_STRING 48    // Longest string argument a trace record keeps
+ #define TDECK_TRACE_DRAIN_MS 50      // Trace drain period while records are arriving
+ #define TDECK_TRACE_IDLE_MS 1000     // Trace drain period while idle, a half full ring wakes it sooner
+ #define TDECK_TRACE_TASK_STACK_SIZE 4096 // Stack size for the trace drain task
+ #define TDECK_TRACE_TASK_PRIORITY 1  // Priority for the trace drain task (below everything it traces)
+ #define TDECK_TRACE_LOG_FILE "/sd/logs/trace.log" // Trace log on the SD card when its sink is on
+ #define TDECK_TRACE_LOG_MAX_SIZE (512 * 1024) // Trace log size that starts a new file
+ #define TDECK_TRACE_LOG_FILES 3      // Rotated trace logs kept besides the current one
+ #ifndef TDECK_TRACE_LEVEL_SYSTEM
+ #define TDECK_TRACE_LEVEL_SYSTEM 3   // Trace level of system services, TRACE_LEVEL_* in system/trace.h
+ #endif
+ #ifndef TDECK_TRACE_LEVEL_LORA
+ #define TDECK_TRACE_LEVEL_LORA 3     // Trace level of the LoRa stack
+ #endif
+ #ifndef TDECK_TRACE_LEVEL_BLE
+ #define TDECK_TRACE_LEVEL_BLE 3      // Trace level of Bluetooth
+ #endif
+ #ifndef TDECK_TRACE_LEVEL_USB
+ #define TDECK_TRACE_LEVEL_USB 3      // Trace level of USB serial and file transfer
+ #endif
+ #ifndef TDECK_TRACE_LEVEL_FS
+ #define TDECK_TRACE_LEVEL_FS 3       // Trace level of the file system
+ #endif
  
  // Debug macros
  #if TDECK_DEBUG
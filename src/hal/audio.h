@@ -11,6 +11,8 @@
  
  #include <Arduino.h>
  #include "../config.h"
+ #include "audio_mixer.h"
+ #include "audio_recorder.h"
  
  // Audio hardware pins
  #define TDECK_I2S_SCK       42  // I2S clock (BCLK)
@@ -22,6 +24,19 @@
  #define TDECK_AUDIO_SAMPLE_RATE     16000  // Sample rate in Hz
  #define TDECK_AUDIO_BITS_PER_SAMPLE 16     // Bits per sample
  #define TDECK_AUDIO_BUFFER_SIZE     512    // DMA buffer size in bytes
+ #define TDECK_AUDIO_MIXER_VOICES    8      // Voices mixed at once
+ #define TDECK_AUDIO_MIXER_BLOCK     256    // Frames mixed per I2S write
+ #define TDECK_AUDIO_MIXER_STACK_SIZE 8192  // Mixer task stack, MP3 decoding runs on it
+ #define TDECK_AUDIO_IDLE_STOP_MS    500    // Silence before the speaker I2S stops and light sleep may begin
+ #define TDECK_AUDIO_STREAM_BUFFER_SIZE (32 * 1024) // Read-ahead of a streamed sound file
+ #define TDECK_AUDIO_RECORD_RING_SIZE (64 * 1024) // PSRAM ring between the I2S reader and the file writer, about 1 s
+ #define TDECK_AUDIO_RECORD_BATCH    (16 * 1024) // Bytes the recording writer takes per file write
+ #define TDECK_AUDIO_RECORD_ADPCM_BLOCK 1024 // Bytes per IMA-ADPCM block of a recording
+ #define TDECK_AUDIO_RECORD_STACK_SIZE 4096 // Recording reader and writer task stacks
+ #define TDECK_AUDIO_RECORD_SINK_STACK_SIZE (24 * 1024) // Writer stack when it runs a voice encoder
+ #define TDECK_AUDIO_VOICE_BITRATE   1600   // Codec2 mode of voice notes, 200 bytes per second
+ #define TDECK_AUDIO_CLIP_SLOTS      8      // Clips in the decoded cache
+ #define TDECK_AUDIO_CLIP_CACHE_BYTES (256 * 1024) // PSRAM for decoded clips
  
  // Speaker volume control
  #define TDECK_SPEAKER_ENABLE_PIN    1      // Speaker enable pin
@@ -67,6 +82,13 @@
       */
      static uint8_t getVolume();
  
+     /**
+      * @brief Get the Q15 gain of the current volume
+      * 
+      * @return Gain the mixer applies to its output
+      */
+     static int16_t getGain();
+ 
      /**
       * @brief Enable/disable speaker
       * 
@@ -98,6 +120,8 @@
      /**
       * @brief Play a tone through the speaker
       * 
+      * Returns at once, the tone mixes with any other sound playing.
+      * 
       * @param frequency Tone frequency in Hz
       * @param duration Duration in milliseconds
       */
@@ -106,6 +130,9 @@
      /**
       * @brief Play a sound file from the filesystem
       * 
+      * Replaces the previous file started here; clips and tones from the
+      * mixer keep playing over it.
+      * 
       * @param filePath Path to the sound file
       * @return true if playback started successfully, false otherwise
       */
@@ -119,14 +146,20 @@
      /**
       * @brief Record audio from the microphone
       * 
+      * Capture and file writes run on separate tasks, see AudioRecorder.
+      * 
       * @param filePath Path to save the recorded audio
       * @param duration Recording duration in milliseconds (0 for manual stop)
+      * @param encoding PCM, or IMA-ADPCM for a quarter of the size
       * @return true if recording started successfully, false otherwise
       */
-     static bool recordAudio(const char* filePath, uint32_t duration = 0);
+     static bool recordAudio(const char* filePath, uint32_t duration = 0,
+                             AudioRecordEncoding encoding = AUDIO_RECORD_PCM);
  
      /**
       * @brief Stop current audio recording
+      * 
+      * Waits until the file has been written and its header finished.
       */
      static void stopRecording();
  
@@ -144,28 +177,18 @@
       */
      static bool isRecording();
  
+     /**
+      * @brief Get the overrun and write counters of the current or last recording
+      */
+     static AudioRecordStats getRecordingStats();
+ 
  private:
      static uint8_t _volume;              // Current volume level
+     static volatile int16_t _gain;       // Q15 playback gain of the volume level
      static bool _speakerEnabled;         // Speaker enabled flag
      static bool _microphoneEnabled;      // Microphone enabled flag
-     static bool _isPlaying;              // Audio playback flag
-     static bool _isRecording;            // Audio recording flag
-     static TaskHandle_t _playbackTask;   // Playback task handle
-     static TaskHandle_t _recordTask;     // Recording task handle
- 
-     /**
-      * @brief Audio playback task
-      * 
-      * @param parameter Task parameters
-      */
-     static void playbackTaskFunc(void* parameter);
- 
-     /**
-      * @brief Audio recording task
-      * 
-      * @param parameter Task parameters
-      */
-     static void recordTaskFunc(void* parameter);
+     static AudioVoiceId _soundVoice;     // Mixer voice of playSound()
+     static QueueHandle_t _microphoneEvents; // I2S_NUM_1 driver events, for overrun counting
  };
  
  #endif // TDECK_AUDIO_H
\ No newline at end of file
@@ -0,0 +1,403 @@
+/**
+ * @file audio_decoder.cpp
+ * @brief Implementation of the sound file decoders
+ */
+
+ #include "audio_decoder.h"
+ #include "audio.h"
+ #include "../system/fs_manager.h"
+ #if __has_include(<libhelix-mp3/mp3dec.h>)
+ #include <libhelix-mp3/mp3dec.h>
+ #define AUDIO_DECODER_MP3 1
+ #else
+ #define AUDIO_DECODER_MP3 0
+ #endif
+ 
+ /**
+  * @brief PCM WAV and raw files, 8-bit samples widened to 16
+  */
+ class PcmDecoder : public AudioDecoder {
+ public:
+     PcmDecoder(FSStream* file, const AudioFormat& source)
+         : AudioDecoder(file, source)
+         , _remaining(source.dataSize)
+     {
+     }
+ 
+     size_t decode(int16_t* output, size_t maxFrames) override {
+         size_t bytes = min((size_t)_remaining, maxFrames * _source.blockAlign);
+         bytes -= bytes % _source.blockAlign;
+         if (bytes == 0) {
+             return 0;
+         }
+ 
+         // 8-bit frames are half the size, read them into the back half and widen forwards
+         uint8_t* target = (uint8_t*)output;
+         if (_source.bitsPerSample == 8) {
+             target += bytes;
+         }
+         int64_t bytesRead = _file->read(target, bytes);
+         if (bytesRead <= 0) {
+             _remaining = 0;
+             return 0;
+         }
+         bytesRead -= bytesRead % _source.blockAlign;
+         _remaining -= bytesRead;
+ 
+         if (_source.bitsPerSample == 8) {
+             for (int64_t i = 0; i < bytesRead; i++) {
+                 output[i] = (int16_t)((target[i] - 128) << 8);
+             }
+         }
+         return bytesRead / _source.blockAlign;
+     }
+ 
+ protected:
+     bool begin() override {
+         _format.bitsPerSample = 16;
+         _format.blockAlign = _format.channels * 2;
+         _format.formatTag = WAV_FORMAT_PCM;
+         return true;
+     }
+ 
+ private:
+     uint32_t _remaining;           // Data bytes not yet read
+ };
+ 
+ /**
+  * @brief IMA-ADPCM WAV, decoded a block at a time
+  */
+ class AdpcmDecoder : public AudioDecoder {
+ public:
+     AdpcmDecoder(FSStream* file, const AudioFormat& source)
+         : AudioDecoder(file, source)
+         , _remaining(source.dataSize)
+         , _block(nullptr)
+         , _pcm(nullptr)
+         , _pcmFrames(0)
+         , _pcmPosition(0)
+     {
+     }
+ 
+     ~AdpcmDecoder() override {
+         free(_block);
+         free(_pcm);
+     }
+ 
+     size_t decode(int16_t* output, size_t maxFrames) override {
+         size_t frames = 0;
+         while (frames < maxFrames) {
+             if (_pcmPosition >= _pcmFrames && !decodeBlock()) {
+                 break;
+             }
+             size_t count = min(maxFrames - frames, _pcmFrames - _pcmPosition);
+             memcpy(output + frames * _format.channels, _pcm + _pcmPosition * _format.channels,
+                    count * _format.channels * sizeof(int16_t));
+             _pcmPosition += count;
+             frames += count;
+         }
+         return frames;
+     }
+ 
+ protected:
+     bool begin() override {
+         _format.bitsPerSample = 16;
+         _format.blockAlign = _format.channels * 2;
+         _format.formatTag = WAV_FORMAT_PCM;
+         _block = (uint8_t*)malloc(_source.blockAlign);
+         _pcm = (int16_t*)malloc(_source.samplesPerBlock * _source.channels * sizeof(int16_t));
+         if (!_block || !_pcm) {
+             TDECK_LOG_E("Failed to allocate ADPCM buffers");
+             return false;
+         }
+         return true;
+     }
+ 
+ private:
+     uint32_t _remaining;           // Data bytes not yet read
+     uint8_t* _block;               // One encoded block
+     int16_t* _pcm;                 // The block decoded
+     size_t _pcmFrames;
+     size_t _pcmPosition;
+ 
+     // Read and decode the next block, the last one may be short
+     bool decodeBlock() {
+         const uint16_t channels = _source.channels;
+         size_t bytes = min((size_t)_remaining, (size_t)_source.blockAlign);
+         if (bytes <= 4u * channels) {
+             return false;
+         }
+         int64_t bytesRead = _file->read(_block, bytes);
+         if (bytesRead <= 4 * channels) {
+             _remaining = 0;
+             return false;
+         }
+         _remaining -= bytes;
+ 
+         // Each channel's header holds its first sample and step index
+         AdpcmState state[2];
+         for (uint16_t c = 0; c < channels; c++) {
+             const uint8_t* header = _block + c * 4;
+             state[c].predictor = (int16_t)(header[0] | (header[1] << 8));
+             state[c].index = min((int)header[2], ADPCM_MAX_INDEX);
+             _pcm[c] = (int16_t)state[c].predictor;
+         }
+ 
+         // After the headers each channel in turn has 4 bytes, 8 samples
+         size_t dataBytes = bytesRead - 4 * channels;
+         size_t groups = dataBytes / (4 * channels);
+         for (size_t g = 0; g < groups; g++) {
+             for (uint16_t c = 0; c < channels; c++) {
+                 const uint8_t* data = _block + 4 * channels + (g * channels + c) * 4;
+                 int16_t* out = _pcm + (1 + g * 8) * channels + c;
+                 for (int b = 0; b < 4; b++) {
+                     out[(b * 2) * channels] = AudioDSP::adpcmDecode(data[b] & 0x0F, state[c]);
+                     out[(b * 2 + 1) * channels] = AudioDSP::adpcmDecode(data[b] >> 4, state[c]);
+                 }
+             }
+         }
+ 
+         _pcmFrames = 1 + groups * 8;
+         _pcmPosition = 0;
+         return true;
+     }
+ };
+ 
+ #if AUDIO_DECODER_MP3
+ // Bytes kept ahead of the MP3 decoder, two of its largest main data buffers
+ #define MP3_INPUT_SIZE (MAINBUF_SIZE * 2)
+ 
+ // Decoded samples of the largest frame, MPEG-1 layer III stereo
+ #define MP3_FRAME_SAMPLES (MAX_NCHAN * MAX_NGRAN * MAX_NSAMP)
+ 
+ /**
+  * @brief MP3 through the Helix fixed-point decoder, a frame at a time
+  */
+ class Mp3Decoder : public AudioDecoder {
+ public:
+     Mp3Decoder(FSStream* file, const AudioFormat& source)
+         : AudioDecoder(file, source)
+         , _decoder(nullptr)
+         , _input(nullptr)
+         , _inputLength(0)
+         , _inputPosition(0)
+         , _eof(false)
+         , _pcm(nullptr)
+         , _pcmFrames(0)
+         , _pcmPosition(0)
+     {
+     }
+ 
+     ~Mp3Decoder() override {
+         if (_decoder) {
+             MP3FreeDecoder(_decoder);
+         }
+         free(_input);
+         free(_pcm);
+     }
+ 
+     size_t decode(int16_t* output, size_t maxFrames) override {
+         size_t frames = 0;
+         while (frames < maxFrames) {
+             if (_pcmPosition >= _pcmFrames && !decodeFrame()) {
+                 break;
+             }
+             size_t count = min(maxFrames - frames, _pcmFrames - _pcmPosition);
+             memcpy(output + frames * _format.channels, _pcm + _pcmPosition * _format.channels,
+                    count * _format.channels * sizeof(int16_t));
+             _pcmPosition += count;
+             frames += count;
+         }
+         return frames;
+     }
+ 
+ protected:
+     bool begin() override {
+         _decoder = MP3InitDecoder();
+         _input = (uint8_t*)malloc(MP3_INPUT_SIZE);
+         _pcm = (int16_t*)malloc(MP3_FRAME_SAMPLES * sizeof(int16_t));
+         if (!_decoder || !_input || !_pcm) {
+             TDECK_LOG_E("Failed to allocate MP3 decoder");
+             return false;
+         }
+ 
+         skipId3();
+ 
+         // The first frame tells the rate and channels, its samples are played too
+         if (!decodeFrame()) {
+             TDECK_LOG_E("No MP3 frame found");
+             return false;
+         }
+         return true;
+     }
+ 
+ private:
+     HMP3Decoder _decoder;
+     uint8_t* _input;
+     size_t _inputLength;
+     size_t _inputPosition;
+     bool _eof;
+     int16_t* _pcm;                 // The last frame decoded
+     size_t _pcmFrames;
+     size_t _pcmPosition;
+ 
+     // Skip an ID3v2 tag, it can hold cover art far larger than the input buffer
+     void skipId3() {
+         uint8_t header[10];
+         if (_file->read(header, sizeof(header)) == sizeof(header) && memcmp(header, "ID3", 3) == 0) {
+             uint32_t size = ((header[6] & 0x7F) << 21) | ((header[7] & 0x7F) << 14) |
+                             ((header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+             _file->seek(sizeof(header) + size + ((header[5] & 0x10) ? 10 : 0));
+         } else {
+             _file->seek(0);
+         }
+     }
+ 
+     // Move unread input to the front and top it up from the file
+     void refill() {
+         if (_inputPosition > 0) {
+             memmove(_input, _input + _inputPosition, _inputLength - _inputPosition);
+             _inputLength -= _inputPosition;
+             _inputPosition = 0;
+         }
+         if (!_eof && _inputLength < MP3_INPUT_SIZE) {
+             int64_t bytesRead = _file->read(_input + _inputLength, MP3_INPUT_SIZE - _inputLength);
+             if (bytesRead <= 0) {
+                 _eof = true;
+             } else {
+                 _inputLength += bytesRead;
+             }
+         }
+     }
+ 
+     // Decode the next frame into _pcm, resynchronizing over damaged data
+     bool decodeFrame() {
+         while (true) {
+             if (_inputLength - _inputPosition < MAINBUF_SIZE) {
+                 refill();
+             }
+             if (_inputPosition >= _inputLength) {
+                 return false;
+             }
+ 
+             int offset = MP3FindSyncWord(_input + _inputPosition, _inputLength - _inputPosition);
+             if (offset < 0) {
+                 // No sync in what is buffered, keep the last bytes in case a header straddles
+                 _inputPosition = _inputLength > 3 ? _inputLength - 3 : _inputLength;
+                 if (_eof) {
+                     return false;
+                 }
+                 continue;
+             }
+             _inputPosition += offset;
+ 
+             unsigned char* data = _input + _inputPosition;
+             int bytesLeft = _inputLength - _inputPosition;
+             int result = MP3Decode(_decoder, &data, &bytesLeft, _pcm, 0);
+             size_t used = (_inputLength - _inputPosition) - bytesLeft;
+ 
+             if (result == ERR_MP3_INDATA_UNDERFLOW) {
+                 // A frame cut by the end of the buffer, or a bogus header claiming more than it holds
+                 if (_eof) {
+                     return false;
+                 }
+                 if (_inputPosition == 0 && _inputLength == MP3_INPUT_SIZE) {
+                     _inputPosition++;
+                 } else {
+                     refill();
+                 }
+                 continue;
+             }
+             _inputPosition += used > 0 ? used : 1;
+             if (result == ERR_MP3_MAINDATA_UNDERFLOW) {
+                 // The bit reservoir is still filling, the next frame plays
+                 continue;
+             }
+             if (result != ERR_MP3_NONE) {
+                 continue;
+             }
+ 
+             MP3FrameInfo info;
+             MP3GetLastFrameInfo(_decoder, &info);
+             if (info.nChans < 1 || info.nChans > 2 || info.samprate <= 0) {
+                 continue;
+             }
+             if (_format.formatTag == 0) {
+                 _format.sampleRate = info.samprate;
+                 _format.channels = info.nChans;
+                 _format.bitsPerSample = 16;
+                 _format.blockAlign = info.nChans * 2;
+                 _format.formatTag = WAV_FORMAT_PCM;
+             } else if ((uint32_t)info.samprate != _format.sampleRate || info.nChans != _format.channels) {
+                 // A format change mid-stream would need a new resampler, skip such frames
+                 continue;
+             }
+             _pcmFrames = info.outputSamps / info.nChans;
+             _pcmPosition = 0;
+             return true;
+         }
+     }
+ };
+ #endif
+ 
+ // Constructor
+ AudioDecoder::AudioDecoder(FSStream* file, const AudioFormat& source)
+     : _file(file)
+     , _source(source)
+     , _format(source)
+ {
+ }
+ 
+ // Destructor, closes the file
+ AudioDecoder::~AudioDecoder() {
+     delete _file;
+ }
+ 
+ // Get the format of the decoded frames
+ const AudioFormat& AudioDecoder::getFormat() const {
+     return _format;
+ }
+ 
+ // Open a sound file with the decoder its contents need
+ AudioDecoder* AudioDecoder::open(const char* path) {
+     FSStream* file = new FSStream();
+     if (!file->open(path, FILE_READ, TDECK_AUDIO_STREAM_BUFFER_SIZE)) {
+         TDECK_LOG_E("Failed to open sound file: %s", path);
+         delete file;
+         return nullptr;
+     }
+ 
+     const char* extension = strrchr(path, '.');
+     AudioFormat source = {TDECK_AUDIO_SAMPLE_RATE, 2, 16, 4, 0, (uint32_t)file->size(), WAV_FORMAT_PCM, 0};
+     AudioDecoder* decoder = nullptr;
+ 
+     if (extension && strcasecmp(extension, ".wav") == 0) {
+         if (!AudioDSP::parseWav(file, source)) {
+             delete file;
+             return nullptr;
+         }
+         if (source.formatTag == WAV_FORMAT_IMA_ADPCM) {
+             decoder = new AdpcmDecoder(file, source);
+         } else {
+             decoder = new PcmDecoder(file, source);
+         }
+     } else if (extension && strcasecmp(extension, ".mp3") == 0) {
+ #if AUDIO_DECODER_MP3
+         // The first frame fills in the real format
+         source.formatTag = 0;
+         decoder = new Mp3Decoder(file, source);
+ #else
+         TDECK_LOG_E("MP3 support not built in: %s", path);
+         delete file;
+         return nullptr;
+ #endif
+     } else {
+         decoder = new PcmDecoder(file, source);
+     }
+ 
+     if (!decoder->begin()) {
+         delete decoder;
+         return nullptr;
+     }
+     return decoder;
+ }
\ No newline at end of file
@@ -0,0 +1,75 @@
+/**
+ * @file audio_decoder.h
+ * @brief Sound file decoders for T-Deck hardware
+ *
+ * A decoder turns one sound file into 16-bit PCM frames at the file's own
+ * rate and channel count; AudioResampler takes it from there. PCM WAV and
+ * raw files, IMA-ADPCM WAV and MP3 are supported. Files are read through
+ * an FSStream with a large read-ahead buffer, so a compressed stream costs
+ * a few big card reads per second instead of many small ones.
+ */
+
+ #ifndef TDECK_AUDIO_DECODER_H
+ #define TDECK_AUDIO_DECODER_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "audio_dsp.h"
+ 
+ class FSStream;
+ 
+ /**
+  * @class AudioDecoder
+  * @brief Pulls decoded PCM frames from a sound file
+  */
+ class AudioDecoder {
+ public:
+     /**
+      * @brief Open a sound file with the decoder its contents need
+      *
+      * .wav files pick PCM or IMA-ADPCM from the fmt chunk, .mp3 files the
+      * MP3 decoder; anything else is raw 16-bit stereo at TDECK_AUDIO_SAMPLE_RATE.
+      *
+      * @param path Path to the sound file
+      * @return Decoder, nullptr if the file cannot be played
+      */
+     static AudioDecoder* open(const char* path);
+ 
+     /**
+      * @brief Destructor, closes the file
+      */
+     virtual ~AudioDecoder();
+ 
+     /**
+      * @brief Get the format of the decoded frames, always 16 bits per sample
+      */
+     const AudioFormat& getFormat() const;
+ 
+     /**
+      * @brief Decode the next frames
+      * @param output Receives interleaved 16-bit samples, getFormat().channels per frame
+      * @param maxFrames Room in output, in frames
+      * @return Frames decoded, 0 at the end of the file
+      */
+     virtual size_t decode(int16_t* output, size_t maxFrames) = 0;
+ 
+ protected:
+     FSStream* _file;
+     AudioFormat _source;           // Format as stored in the file
+     AudioFormat _format;           // Format of the decoded frames
+ 
+     /**
+      * @brief Constructor
+      * @param file Open file, owned by the decoder
+      * @param source Stored format, for WAV as parsed
+      */
+     AudioDecoder(FSStream* file, const AudioFormat& source);
+ 
+     /**
+      * @brief Prepare to decode, fills _format
+      * @return true if the stream can be decoded
+      */
+     virtual bool begin() = 0;
+ };
+ 
+ #endif // TDECK_AUDIO_DECODER_H
\ No newline at end of file
@@ -0,0 +1,316 @@
+/**
+ * @file audio_dsp.cpp
+ * @brief Implementation of audio sample processing
+ */
+
+ #include "audio_dsp.h"
+ #include "audio.h"
+ #include "../system/fs_manager.h"
+ #if __has_include(<dsps_mulc.h>)
+ #include <dsps_mulc.h>
+ #define AUDIO_DSP_HAS_MULC 1
+ #else
+ #define AUDIO_DSP_HAS_MULC 0
+ #endif
+ 
+ // IMA-ADPCM quantizer step sizes
+ static const int16_t adpcmSteps[ADPCM_MAX_INDEX + 1] = {
+     7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+     50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+     253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+     1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+     3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+     11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+     32767
+ };
+ 
+ // IMA-ADPCM step index change per nibble magnitude
+ static const int8_t adpcmIndexChange[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+ 
+ // Read a little-endian value from a chunk
+ static uint16_t readLE16(const uint8_t* data) {
+     return data[0] | (data[1] << 8);
+ }
+ 
+ static uint32_t readLE32(const uint8_t* data) {
+     return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+ }
+ 
+ // Store a little-endian value in a chunk
+ static void putLE16(uint8_t* data, uint16_t value) {
+     data[0] = value & 0xFF;
+     data[1] = value >> 8;
+ }
+ 
+ static void putLE32(uint8_t* data, uint32_t value) {
+     putLE16(data, value & 0xFFFF);
+     putLE16(data + 2, value >> 16);
+ }
+ 
+ // Constructor
+ AudioResampler::AudioResampler()
+     : _channels(2)
+     , _bitsPerSample(16)
+     , _blockAlign(4)
+     , _step(1 << 16)
+     , _phase(1 << 16)
+     , _previous{0, 0}
+     , _current{0, 0}
+     , _passthrough(true)
+ {
+ }
+ 
+ // Set up a conversion
+ void AudioResampler::begin(const AudioFormat& source, uint32_t outputRate) {
+     _channels = source.channels;
+     _bitsPerSample = source.bitsPerSample;
+     _blockAlign = source.blockAlign;
+     _step = (uint32_t)(((uint64_t)source.sampleRate << 16) / outputRate);
+     // The first call reads a frame before producing any output
+     _phase = 1 << 16;
+     _previous[0] = _previous[1] = 0;
+     _current[0] = _current[1] = 0;
+     _passthrough = _channels == 2 && _bitsPerSample == 16 && source.sampleRate == outputRate;
+ }
+ 
+ // Check if the input is already 16-bit stereo at the output rate
+ bool AudioResampler::isPassthrough() const {
+     return _passthrough;
+ }
+ 
+ // Convert whole input frames into output frames
+ size_t AudioResampler::process(const uint8_t* input, size_t inputLength, size_t& consumed,
+                                int16_t* output, size_t maxFrames) {
+     size_t offset = 0;
+     size_t frames = 0;
+ 
+     while (frames < maxFrames) {
+         // Step the input forward until the read position lies between two frames
+         while (_phase >= (1 << 16)) {
+             if (offset + _blockAlign > inputLength) {
+                 consumed = offset;
+                 return frames;
+             }
+             const uint8_t* frame = input + offset;
+             int16_t left;
+             int16_t right;
+             if (_bitsPerSample == 16) {
+                 left = (int16_t)readLE16(frame);
+                 right = _channels == 2 ? (int16_t)readLE16(frame + 2) : left;
+             } else {
+                 left = (int16_t)((frame[0] - 128) << 8);
+                 right = _channels == 2 ? (int16_t)((frame[1] - 128) << 8) : left;
+             }
+             _previous[0] = _current[0];
+             _previous[1] = _current[1];
+             _current[0] = left;
+             _current[1] = right;
+             offset += _blockAlign;
+             _phase -= 1 << 16;
+         }
+ 
+         // Q15 so a full-scale difference times the fraction stays within 32 bits
+         int32_t fraction = _phase >> 1;
+         output[frames * 2] = _previous[0] + (((_current[0] - _previous[0]) * fraction) >> 15);
+         output[frames * 2 + 1] = _previous[1] + (((_current[1] - _previous[1]) * fraction) >> 15);
+         frames++;
+         _phase += _step;
+     }
+ 
+     consumed = offset;
+     return frames;
+ }
+ 
+ // Read the RIFF chunks of a WAV file and seek to its samples
+ bool AudioDSP::parseWav(FSStream* file, AudioFormat& format) {
+     uint8_t header[12];
+     if (!file->seek(0) || file->read(header, sizeof(header)) != sizeof(header) ||
+         memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+         TDECK_LOG_E("Not a RIFF WAVE file");
+         return false;
+     }
+ 
+     bool haveFormat = false;
+     uint16_t formatTag = 0;
+     format.dataOffset = 0;
+     uint64_t position = sizeof(header);
+     uint64_t fileSize = file->size();
+ 
+     while (position + 8 <= fileSize) {
+         uint8_t chunk[8];
+         if (file->read(chunk, sizeof(chunk)) != sizeof(chunk)) {
+             break;
+         }
+         uint32_t chunkSize = readLE32(chunk + 4);
+         position += sizeof(chunk);
+ 
+         if (memcmp(chunk, "fmt ", 4) == 0) {
+             uint8_t fmt[40];
+             size_t length = min((size_t)chunkSize, sizeof(fmt));
+             if (length < 16 || file->read(fmt, length) != (int64_t)length) {
+                 TDECK_LOG_E("Truncated WAV fmt chunk");
+                 return false;
+             }
+             formatTag = readLE16(fmt);
+             format.channels = readLE16(fmt + 2);
+             format.sampleRate = readLE32(fmt + 4);
+             format.blockAlign = readLE16(fmt + 12);
+             format.bitsPerSample = readLE16(fmt + 14);
+             // Extensible files carry the real format tag in the sub-format GUID
+             if (formatTag == WAV_FORMAT_EXTENSIBLE && length >= 26) {
+                 formatTag = readLE16(fmt + 24);
+             }
+             // ADPCM appends the frames per block after the extension size
+             format.samplesPerBlock = (formatTag == WAV_FORMAT_IMA_ADPCM && length >= 20) ? readLE16(fmt + 18) : 0;
+             haveFormat = true;
+         } else if (memcmp(chunk, "data", 4) == 0) {
+             if (!haveFormat) {
+                 TDECK_LOG_E("WAV data chunk before fmt chunk");
+                 return false;
+             }
+             format.dataOffset = position;
+             // Streams written without a final size report 0 or too much
+             format.dataSize = (chunkSize == 0 || position + chunkSize > fileSize) ? fileSize - position : chunkSize;
+             break;
+         }
+ 
+         // Chunks are padded to an even length
+         position += chunkSize + (chunkSize & 1);
+         if (!file->seek(position)) {
+             break;
+         }
+     }
+ 
+     if (!haveFormat || format.dataOffset == 0) {
+         TDECK_LOG_E("WAV file without fmt or data chunk");
+         return false;
+     }
+     format.formatTag = formatTag;
+     bool layout = format.channels >= 1 && format.channels <= 2 && format.sampleRate > 0;
+     bool pcm = layout && formatTag == WAV_FORMAT_PCM && (format.bitsPerSample == 8 || format.bitsPerSample == 16) &&
+                format.blockAlign == format.channels * format.bitsPerSample / 8;
+     bool adpcm = layout && formatTag == WAV_FORMAT_IMA_ADPCM && format.bitsPerSample == 4 &&
+                  format.blockAlign > 4 * format.channels &&
+                  format.samplesPerBlock == (format.blockAlign - 4 * format.channels) * 2 / format.channels + 1;
+     if (!pcm && !adpcm) {
+         TDECK_LOG_E("Unsupported WAV format: tag %u, %u channels, %u bits, %lu Hz", formatTag,
+                     format.channels, format.bitsPerSample, (unsigned long)format.sampleRate);
+         return false;
+     }
+ 
+     return file->seek(format.dataOffset);
+ }
+ 
+ // Build the header of a WAV file
+ size_t AudioDSP::buildWavHeader(uint8_t* header, const AudioFormat& format, uint32_t frames) {
+     const bool adpcm = format.formatTag == WAV_FORMAT_IMA_ADPCM;
+     const size_t headerSize = adpcm ? WAV_HEADER_MAX_SIZE : 44;
+     const uint32_t byteRate = adpcm
+         ? (uint32_t)((uint64_t)format.sampleRate * format.blockAlign / format.samplesPerBlock)
+         : format.sampleRate * format.blockAlign;
+ 
+     uint8_t* p = header;
+     memcpy(p, "RIFF", 4);
+     putLE32(p + 4, headerSize - 8 + format.dataSize);
+     memcpy(p + 8, "WAVE", 4);
+     p += 12;
+ 
+     memcpy(p, "fmt ", 4);
+     putLE32(p + 4, adpcm ? 20 : 16);
+     putLE16(p + 8, adpcm ? WAV_FORMAT_IMA_ADPCM : WAV_FORMAT_PCM);
+     putLE16(p + 10, format.channels);
+     putLE32(p + 12, format.sampleRate);
+     putLE32(p + 16, byteRate);
+     putLE16(p + 20, format.blockAlign);
+     putLE16(p + 22, format.bitsPerSample);
+     p += 24;
+ 
+     // ADPCM readers need the frames per block and the real frame count
+     if (adpcm) {
+         putLE16(p, 2);
+         putLE16(p + 2, format.samplesPerBlock);
+         memcpy(p + 4, "fact", 4);
+         putLE32(p + 8, 4);
+         putLE32(p + 12, frames);
+         p += 16;
+     }
+ 
+     memcpy(p, "data", 4);
+     putLE32(p + 4, format.dataSize);
+     return headerSize;
+ }
+ 
+ // Convert a volume level to a Q15 gain
+ int16_t AudioDSP::volumeToGain(uint8_t volume) {
+     if (volume >= TDECK_SPEAKER_MAX_VOLUME) {
+         return AUDIO_GAIN_UNITY;
+     }
+     return (int16_t)((AUDIO_GAIN_UNITY * volume) / TDECK_SPEAKER_MAX_VOLUME);
+ }
+ 
+ // Scale samples in place by a Q15 gain
+ void AudioDSP::applyGain(int16_t* samples, size_t count, int16_t gain) {
+     if (gain == AUDIO_GAIN_UNITY) {
+         return;
+     }
+     if (gain == 0) {
+         memset(samples, 0, count * sizeof(int16_t));
+         return;
+     }
+ 
+ #if AUDIO_DSP_HAS_MULC
+     // The optimized version multiplies with the MAC unit, (sample * gain) >> 15
+     dsps_mulc_s16(samples, samples, count, gain, 1, 1);
+ #else
+     for (size_t i = 0; i < count; i++) {
+         samples[i] = (int16_t)((samples[i] * gain) >> 15);
+     }
+ #endif
+ }
+ 
+ // Move the predictor by a code and adapt the step, shared by both directions
+ static int16_t adpcmStep(uint8_t nibble, AdpcmState& state) {
+     int step = adpcmSteps[state.index];
+     int diff = step >> 3;
+     if (nibble & 1) diff += step >> 2;
+     if (nibble & 2) diff += step >> 1;
+     if (nibble & 4) diff += step;
+     state.predictor += (nibble & 8) ? -diff : diff;
+     state.predictor = constrain(state.predictor, -32768, 32767);
+     state.index = constrain(state.index + adpcmIndexChange[nibble & 7], 0, ADPCM_MAX_INDEX);
+     return (int16_t)state.predictor;
+ }
+ 
+ // Encode one sample as an IMA-ADPCM nibble
+ uint8_t AudioDSP::adpcmEncode(int16_t sample, AdpcmState& state) {
+     int diff = sample - state.predictor;
+     uint8_t nibble = 0;
+     if (diff < 0) {
+         nibble = 8;
+         diff = -diff;
+     }
+ 
+     // Quantize against the step, the reconstruction happens in adpcmStep()
+     int step = adpcmSteps[state.index];
+     if (diff >= step) {
+         nibble |= 4;
+         diff -= step;
+     }
+     step >>= 1;
+     if (diff >= step) {
+         nibble |= 2;
+         diff -= step;
+     }
+     step >>= 1;
+     if (diff >= step) {
+         nibble |= 1;
+     }
+ 
+     adpcmStep(nibble, state);
+     return nibble;
+ }
+ 
+ // Decode one IMA-ADPCM nibble
+ int16_t AudioDSP::adpcmDecode(uint8_t nibble, AdpcmState& state) {
+     return adpcmStep(nibble, state);
+ }
\ No newline at end of file
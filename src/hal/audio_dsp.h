@@ -0,0 +1,160 @@
+/**
+ * @file audio_dsp.h
+ * @brief Audio sample processing for T-Deck hardware
+ *
+ * WAV parsing that walks the RIFF chunks instead of assuming a 44-byte
+ * header, a converter from any 8 or 16-bit mono or stereo PCM stream to the
+ * 16-bit stereo frames the I2S output takes, with fixed-point linear
+ * resampling, a Q15 gain stage that uses the ESP-DSP multiply when the
+ * library is present, and the IMA-ADPCM sample codec.
+ */
+
+ #ifndef TDECK_AUDIO_DSP_H
+ #define TDECK_AUDIO_DSP_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ class FSStream;
+ 
+ // Q15 gain that leaves samples unchanged
+ #define AUDIO_GAIN_UNITY 32767
+ 
+ // WAVE format tags
+ #define WAV_FORMAT_PCM 0x0001
+ #define WAV_FORMAT_IMA_ADPCM 0x0011
+ #define WAV_FORMAT_EXTENSIBLE 0xFFFE
+ 
+ // Largest header buildWavHeader() writes, IMA-ADPCM with its fact chunk
+ #define WAV_HEADER_MAX_SIZE 60
+ 
+ /**
+  * @brief PCM stream format, as read from a WAV fmt chunk
+  */
+ struct AudioFormat {
+     uint32_t sampleRate;           // Frames per second
+     uint16_t channels;             // 1 or 2
+     uint16_t bitsPerSample;        // 8 (unsigned) or 16 (signed)
+     uint16_t blockAlign;           // Bytes per frame
+     uint32_t dataOffset;           // File offset of the first sample
+     uint32_t dataSize;             // Bytes of sample data
+     uint16_t formatTag;            // WAV_FORMAT_PCM or WAV_FORMAT_IMA_ADPCM
+     uint16_t samplesPerBlock;      // Frames per ADPCM block
+ };
+ 
+ // Highest IMA-ADPCM step index
+ #define ADPCM_MAX_INDEX 88
+ 
+ /**
+  * @brief IMA-ADPCM state of one channel, the same on both ends of the codec
+  */
+ struct AdpcmState {
+     int32_t predictor;             // Last reconstructed sample
+     int index;                     // Step table index, 0 to ADPCM_MAX_INDEX
+ };
+ 
+ /**
+  * @class AudioResampler
+  * @brief Streams PCM of any supported format into 16-bit stereo at the output rate
+  *
+  * The read position advances in Q16 steps of input rate / output rate and
+  * each output frame interpolates the two input frames around it, so no
+  * floating point runs in the sample loop.
+  */
+ class AudioResampler {
+ public:
+     /**
+      * @brief Constructor
+      */
+     AudioResampler();
+ 
+     /**
+      * @brief Set up a conversion
+      * @param source Input format
+      * @param outputRate Output sample rate
+      */
+     void begin(const AudioFormat& source, uint32_t outputRate);
+ 
+     /**
+      * @brief Check if the input is already 16-bit stereo at the output rate
+      */
+     bool isPassthrough() const;
+ 
+     /**
+      * @brief Convert whole input frames into output frames
+      * @param input Input bytes
+      * @param inputLength Input length, whole frames
+      * @param consumed Receives the input bytes used
+      * @param output Receives interleaved stereo samples
+      * @param maxFrames Room in output, in frames
+      * @return Frames written, call again with the rest of the input while it is nonzero
+      */
+     size_t process(const uint8_t* input, size_t inputLength, size_t& consumed,
+                    int16_t* output, size_t maxFrames);
+ 
+ private:
+     uint16_t _channels;
+     uint16_t _bitsPerSample;
+     uint16_t _blockAlign;
+     uint32_t _step;                // Input frames per output frame, Q16
+     uint32_t _phase;               // Position between _previous and _current, Q16
+     int16_t _previous[2];          // Input frame before the read position
+     int16_t _current[2];           // Input frame after the read position
+     bool _passthrough;
+ };
+ 
+ /**
+  * @class AudioDSP
+  * @brief Stateless audio helpers
+  */
+ class AudioDSP {
+ public:
+     /**
+      * @brief Read the RIFF chunks of a WAV file and seek to its samples
+      * @param file Open file, positioned anywhere
+      * @param format Receives the format and data location
+      * @return true if the file is PCM or IMA-ADPCM a decoder can play
+      */
+     static bool parseWav(FSStream* file, AudioFormat& format);
+ 
+     /**
+      * @brief Build the header of a WAV file
+      * @param header Receives up to WAV_HEADER_MAX_SIZE bytes
+      * @param format PCM or IMA-ADPCM format with dataSize filled in
+      * @param frames Frames in the file, for the ADPCM fact chunk
+      * @return Header length, the samples follow it
+      */
+     static size_t buildWavHeader(uint8_t* header, const AudioFormat& format, uint32_t frames);
+ 
+     /**
+      * @brief Convert a volume level to a Q15 gain
+      * @param volume Volume level (0 to TDECK_SPEAKER_MAX_VOLUME)
+      */
+     static int16_t volumeToGain(uint8_t volume);
+ 
+     /**
+      * @brief Scale samples in place by a Q15 gain
+      * @param samples Samples
+      * @param count Number of samples
+      * @param gain Q15 gain, AUDIO_GAIN_UNITY leaves samples unchanged
+      */
+     static void applyGain(int16_t* samples, size_t count, int16_t gain);
+ 
+     /**
+      * @brief Encode one sample as an IMA-ADPCM nibble
+      * @param sample Sample to encode
+      * @param state Channel state, advanced to what the decoder will reconstruct
+      * @return 4-bit code
+      */
+     static uint8_t adpcmEncode(int16_t sample, AdpcmState& state);
+ 
+     /**
+      * @brief Decode one IMA-ADPCM nibble
+      * @param nibble 4-bit code
+      * @param state Channel state
+      * @return Reconstructed sample
+      */
+     static int16_t adpcmDecode(uint8_t nibble, AdpcmState& state);
+ };
+ 
+ #endif // TDECK_AUDIO_DSP_H
\ No newline at end of file
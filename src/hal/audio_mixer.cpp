@@ -0,0 +1,696 @@
+/**
+ * @file audio_mixer.cpp
+ * @brief Implementation of the multi-voice audio mixer
+ */
+
+ #include "audio_mixer.h"
+ #include "audio.h"
+ #include <driver/i2s.h>
+ #include <esp_heap_caps.h>
+ #include "audio_decoder.h"
+ #include "power.h"
+ 
+ // Sine table for tones, a power of two indexed by the top phase bits
+ #define TONE_TABLE_BITS 8
+ #define TONE_TABLE_SIZE (1 << TONE_TABLE_BITS)
+ 
+ // Commands queued between the API and the mixer task
+ #define MIXER_QUEUE_SIZE 16
+ 
+ // Bytes of decoded samples a stream voice pulls at a time
+ #define STREAM_READ_SIZE 2048
+ 
+ // Decoded clip buffers grow by this many frames
+ #define CLIP_GROW_FRAMES 4096
+ 
+ enum VoiceType {
+     VOICE_FREE,
+     VOICE_CLIP,
+     VOICE_TONE,
+     VOICE_STREAM
+ };
+ 
+ enum CommandType {
+     CMD_PLAY,
+     CMD_STOP,
+     CMD_FADE,
+     CMD_STOP_ALL
+ };
+ 
+ // A cached clip, 16-bit stereo at TDECK_AUDIO_SAMPLE_RATE in PSRAM
+ struct MixerClip {
+     char path[TDECK_FS_MAX_PATH_LENGTH];
+     int16_t* samples;
+     uint32_t frames;
+     uint16_t generation;           // Bumped on eviction, stale voices stop
+     uint16_t users;                // Voices playing it
+     uint32_t lastUsed;             // millis() of the last play
+ };
+ 
+ // One voice of the mix
+ struct MixerVoice {
+     AudioVoiceId id;
+     uint8_t type;
+     int32_t gain;                  // Q15
+     int32_t gainStep;              // Added each block while fading
+     int32_t fadeTarget;            // Gain the fade ends on
+     uint32_t fadeBlocks;           // Blocks left in the fade
+     bool stopAfterFade;
+     bool loop;
+     int8_t clip;
+     uint16_t generation;
+     uint32_t position;             // Clip frame
+     uint32_t phase;                // Tone phase, Q32 of a full period
+     uint32_t phaseStep;
+     uint32_t framesLeft;           // Tone frames still to play
+     AudioDecoder* decoder;
+     AudioResampler* resampler;
+     uint8_t* input;                // Decoded stream samples
+     size_t inputLength;
+     size_t inputPosition;
+     bool ended;                    // Decoder has no more frames
+ };
+ 
+ struct MixerCommand {
+     uint8_t type;
+     uint8_t voiceType;
+     bool loop;
+     int8_t clip;
+     uint16_t generation;
+     int16_t gain;
+     AudioVoiceId voice;
+     uint32_t value;                // Tone frequency, or fade time in ms
+     uint32_t durationMs;           // Tone duration
+     AudioDecoder* decoder;
+ };
+ 
+ static MixerClip clips[TDECK_AUDIO_CLIP_SLOTS];
+ static size_t clipBytes = 0;
+ static SemaphoreHandle_t clipLock = NULL;
+ static MixerVoice voices[TDECK_AUDIO_MIXER_VOICES];
+ static volatile AudioVoiceId voiceIds[TDECK_AUDIO_MIXER_VOICES]; // Read by isActive() from any task
+ static volatile AudioVoiceId lastProcessed = AUDIO_VOICE_NONE;
+ static AudioVoiceId nextVoiceId = AUDIO_VOICE_NONE;
+ static portMUX_TYPE voiceIdMux = portMUX_INITIALIZER_UNLOCKED;
+ static QueueHandle_t commands = NULL;
+ static TaskHandle_t mixerTask = NULL;
+ static bool outputRunning = false;   // Speaker I2S started, PM lock held
+ static int16_t toneTable[TONE_TABLE_SIZE];
+ 
+ // Decode a whole file into PSRAM at the mixer format
+ static int16_t* decodeClip(const char* path, uint32_t& frames) {
+     AudioDecoder* decoder = AudioDecoder::open(path);
+     if (!decoder) {
+         return nullptr;
+     }
+ 
+     uint8_t* input = (uint8_t*)malloc(STREAM_READ_SIZE);
+     if (!input) {
+         TDECK_LOG_E("Failed to allocate memory for clip %s", path);
+         delete decoder;
+         return nullptr;
+     }
+ 
+     // Compressed files do not tell their length up front, so the buffer grows
+     const AudioFormat& format = decoder->getFormat();
+     const size_t maxFrames = TDECK_AUDIO_CLIP_CACHE_BYTES / (2 * sizeof(int16_t));
+     const size_t readFrames = STREAM_READ_SIZE / format.blockAlign;
+     AudioResampler resampler;
+     resampler.begin(format, TDECK_AUDIO_SAMPLE_RATE);
+     int16_t* samples = nullptr;
+     size_t capacity = 0;
+     bool fits = true;
+     frames = 0;
+ 
+     size_t decoded;
+     while ((decoded = decoder->decode((int16_t*)input, readFrames)) > 0) {
+         size_t inputLength = decoded * format.blockAlign;
+         size_t inputPosition = 0;
+         while (inputPosition < inputLength) {
+             if (frames == capacity) {
+                 if (capacity >= maxFrames) {
+                     fits = false;
+                     break;
+                 }
+                 size_t grown = min(capacity + CLIP_GROW_FRAMES, maxFrames);
+                 int16_t* larger = (int16_t*)heap_caps_realloc(samples, grown * 2 * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+                 if (!larger) {
+                     TDECK_LOG_E("Failed to allocate memory for clip %s", path);
+                     heap_caps_free(samples);
+                     free(input);
+                     delete decoder;
+                     return nullptr;
+                 }
+                 samples = larger;
+                 capacity = grown;
+             }
+             size_t consumed = 0;
+             frames += resampler.process(input + inputPosition, inputLength - inputPosition, consumed,
+                                         samples + frames * 2, capacity - frames);
+             inputPosition += consumed;
+         }
+         if (!fits) {
+             break;
+         }
+     }
+ 
+     free(input);
+     delete decoder;
+     if (!fits) {
+         TDECK_LOG_W("Clip %s is too long to cache (over %u bytes)", path, TDECK_AUDIO_CLIP_CACHE_BYTES);
+         heap_caps_free(samples);
+         return nullptr;
+     }
+     return samples;
+ }
+ 
+ // Hand out the next voice handle
+ static AudioVoiceId allocateVoiceId() {
+     portENTER_CRITICAL(&voiceIdMux);
+     if (++nextVoiceId == AUDIO_VOICE_NONE) {
+         nextVoiceId++;
+     }
+     AudioVoiceId id = nextVoiceId;
+     portEXIT_CRITICAL(&voiceIdMux);
+     return id;
+ }
+ 
+ // Queue a command for the mixer task
+ static bool post(const MixerCommand& command) {
+     if (!commands || xQueueSend(commands, &command, 0) != pdTRUE) {
+         TDECK_LOG_W("Audio mixer command queue full");
+         return false;
+     }
+     return true;
+ }
+ 
+ // Queue a new voice
+ static AudioVoiceId postPlay(MixerCommand& command) {
+     if (!TDeckAudio::isSpeakerEnabled()) {
+         TDeckAudio::enableSpeaker(true);
+     }
+     command.type = CMD_PLAY;
+     command.voice = allocateVoiceId();
+     return post(command) ? command.voice : AUDIO_VOICE_NONE;
+ }
+ 
+ // Release what a voice holds, runs on the mixer task
+ static void endVoice(MixerVoice& voice) {
+     if (voice.type == VOICE_CLIP) {
+         xSemaphoreTake(clipLock, portMAX_DELAY);
+         if (clips[voice.clip].generation == voice.generation && clips[voice.clip].users > 0) {
+             clips[voice.clip].users--;
+         }
+         xSemaphoreGive(clipLock);
+     } else if (voice.type == VOICE_STREAM) {
+         delete voice.decoder;
+         delete voice.resampler;
+         free(voice.input);
+     }
+     voice.type = VOICE_FREE;
+     voice.id = AUDIO_VOICE_NONE;
+ }
+ 
+ // Find the voice of a handle
+ static MixerVoice* findVoice(AudioVoiceId id) {
+     for (size_t i = 0; i < TDECK_AUDIO_MIXER_VOICES; i++) {
+         if (voices[i].type != VOICE_FREE && voices[i].id == id) {
+             return &voices[i];
+         }
+     }
+     return nullptr;
+ }
+ 
+ // Start a queued voice, runs on the mixer task
+ static void startVoice(const MixerCommand& command) {
+     MixerVoice* voice = nullptr;
+     for (size_t i = 0; i < TDECK_AUDIO_MIXER_VOICES && !voice; i++) {
+         if (voices[i].type == VOICE_FREE) {
+             voice = &voices[i];
+         }
+     }
+     if (!voice) {
+         TDECK_LOG_W("No free audio voice, sound dropped");
+         delete command.decoder;
+         return;
+     }
+ 
+     memset(voice, 0, sizeof(MixerVoice));
+     voice->id = command.voice;
+     voice->gain = command.gain;
+     voice->loop = command.loop;
+ 
+     switch (command.voiceType) {
+         case VOICE_CLIP:
+             xSemaphoreTake(clipLock, portMAX_DELAY);
+             if (clips[command.clip].samples && clips[command.clip].generation == command.generation) {
+                 clips[command.clip].users++;
+                 voice->type = VOICE_CLIP;
+                 voice->clip = command.clip;
+                 voice->generation = command.generation;
+             }
+             xSemaphoreGive(clipLock);
+             break;
+ 
+         case VOICE_TONE:
+             voice->type = VOICE_TONE;
+             voice->phaseStep = (uint32_t)(((uint64_t)command.value << 32) / TDECK_AUDIO_SAMPLE_RATE);
+             voice->framesLeft = (uint32_t)((uint64_t)command.durationMs * TDECK_AUDIO_SAMPLE_RATE / 1000);
+             break;
+ 
+         case VOICE_STREAM:
+             voice->input = (uint8_t*)malloc(STREAM_READ_SIZE);
+             voice->resampler = new AudioResampler();
+             if (!voice->input || !voice->resampler) {
+                 TDECK_LOG_E("Failed to allocate memory for audio stream");
+                 free(voice->input);
+                 delete voice->resampler;
+                 delete command.decoder;
+                 break;
+             }
+             voice->type = VOICE_STREAM;
+             voice->decoder = command.decoder;
+             voice->resampler->begin(command.decoder->getFormat(), TDECK_AUDIO_SAMPLE_RATE);
+             break;
+     }
+ }
+ 
+ // Render a clip voice, returns the frames rendered
+ static size_t renderClip(MixerVoice& voice, int16_t* out, size_t frames) {
+     const MixerClip& clip = clips[voice.clip];
+     if (clip.generation != voice.generation || !clip.samples) {
+         return 0;
+     }
+ 
+     size_t rendered = 0;
+     while (rendered < frames) {
+         if (voice.position >= clip.frames) {
+             if (!voice.loop || clip.frames == 0) {
+                 break;
+             }
+             voice.position = 0;
+         }
+         size_t count = min(frames - rendered, (size_t)(clip.frames - voice.position));
+         memcpy(out + rendered * 2, clip.samples + voice.position * 2, count * 2 * sizeof(int16_t));
+         voice.position += count;
+         rendered += count;
+     }
+     return rendered;
+ }
+ 
+ // Render a tone voice
+ static size_t renderTone(MixerVoice& voice, int16_t* out, size_t frames) {
+     size_t count = min(frames, (size_t)voice.framesLeft);
+     for (size_t i = 0; i < count; i++) {
+         int16_t sample = toneTable[voice.phase >> (32 - TONE_TABLE_BITS)];
+         out[i * 2] = sample;
+         out[i * 2 + 1] = sample;
+         voice.phase += voice.phaseStep;
+     }
+     voice.framesLeft -= count;
+     return count;
+ }
+ 
+ // Render a stream voice, decoding more of the file as its buffer empties
+ static size_t renderStream(MixerVoice& voice, int16_t* out, size_t frames) {
+     const uint16_t blockAlign = voice.decoder->getFormat().blockAlign;
+     size_t rendered = 0;
+     while (rendered < frames) {
+         if (voice.inputPosition >= voice.inputLength) {
+             if (voice.ended) {
+                 break;
+             }
+             size_t decoded = voice.decoder->decode((int16_t*)voice.input, STREAM_READ_SIZE / blockAlign);
+             if (decoded == 0) {
+                 voice.ended = true;
+                 break;
+             }
+             voice.inputLength = decoded * blockAlign;
+             voice.inputPosition = 0;
+         }
+         size_t consumed = 0;
+         rendered += voice.resampler->process(voice.input + voice.inputPosition,
+                                              voice.inputLength - voice.inputPosition, consumed,
+                                              out + rendered * 2, frames - rendered);
+         voice.inputPosition += consumed;
+     }
+     return rendered;
+ }
+ 
+ // True while any voice is playing, the mixer task's own view of voices[]
+ static bool anyVoiceActive() {
+     for (size_t v = 0; v < TDECK_AUDIO_MIXER_VOICES; v++) {
+         if (voices[v].type != VOICE_FREE) {
+             return true;
+         }
+     }
+     return false;
+ }
+ 
+ // Apply one queued command, runs on the mixer task
+ static void applyCommand(const MixerCommand& command) {
+     switch (command.type) {
+         case CMD_PLAY:
+             startVoice(command);
+             lastProcessed = command.voice;
+             break;
+ 
+         case CMD_STOP: {
+             MixerVoice* voice = findVoice(command.voice);
+             if (voice) {
+                 endVoice(*voice);
+             }
+             break;
+         }
+ 
+         case CMD_FADE: {
+             MixerVoice* voice = findVoice(command.voice);
+             if (!voice) {
+                 break;
+             }
+             uint32_t blocks = (uint32_t)((uint64_t)command.value * TDECK_AUDIO_SAMPLE_RATE /
+                                          (1000 * TDECK_AUDIO_MIXER_BLOCK));
+             if (blocks == 0) {
+                 blocks = 1;
+             }
+             voice->fadeTarget = command.gain;
+             voice->gainStep = (voice->fadeTarget - voice->gain) / (int32_t)blocks;
+             voice->fadeBlocks = blocks;
+             voice->stopAfterFade = command.gain == 0;
+             break;
+         }
+ 
+         case CMD_STOP_ALL:
+             for (size_t i = 0; i < TDECK_AUDIO_MIXER_VOICES; i++) {
+                 if (voices[i].type != VOICE_FREE) {
+                     endVoice(voices[i]);
+                 }
+             }
+             break;
+     }
+ }
+ 
+ // Start the mixer task
+ bool AudioMixer::init() {
+     if (mixerTask) {
+         return true;
+     }
+ 
+     for (size_t i = 0; i < TONE_TABLE_SIZE; i++) {
+         toneTable[i] = (int16_t)(sinf(2.0f * PI * i / TONE_TABLE_SIZE) * 32767.0f);
+     }
+ 
+     clipLock = xSemaphoreCreateMutex();
+     commands = xQueueCreate(MIXER_QUEUE_SIZE, sizeof(MixerCommand));
+     if (!clipLock || !commands) {
+         TDECK_LOG_E("Failed to create audio mixer queue");
+         return false;
+     }
+ 
+     if (xTaskCreatePinnedToCore(mixerTaskFunc, "audio_mixer", TDECK_AUDIO_MIXER_STACK_SIZE, NULL,
+                                 TDECK_SYSTEM_TASK_PRIORITY + 1, &mixerTask, 0) != pdPASS) {
+         TDECK_LOG_E("Failed to create audio mixer task");
+         return false;
+     }
+ 
+     TDECK_LOG_I("Audio mixer started, %d voices", TDECK_AUDIO_MIXER_VOICES);
+     return true;
+ }
+ 
+ // Decode a clip into the cache
+ AudioClipId AudioMixer::loadClip(const char* path) {
+     if (!clipLock || !path) {
+         return AUDIO_CLIP_NONE;
+     }
+ 
+     xSemaphoreTake(clipLock, portMAX_DELAY);
+     for (int i = 0; i < TDECK_AUDIO_CLIP_SLOTS; i++) {
+         if (clips[i].samples && strcmp(clips[i].path, path) == 0) {
+             xSemaphoreGive(clipLock);
+             return i;
+         }
+     }
+     xSemaphoreGive(clipLock);
+ 
+     // Decode outside the lock, the mixer keeps playing meanwhile
+     uint32_t frames = 0;
+     int16_t* samples = decodeClip(path, frames);
+     if (!samples) {
+         return AUDIO_CLIP_NONE;
+     }
+     size_t bytes = frames * 2 * sizeof(int16_t);
+ 
+     xSemaphoreTake(clipLock, portMAX_DELAY);
+     AudioClipId slot = AUDIO_CLIP_NONE;
+     while (slot == AUDIO_CLIP_NONE) {
+         // A free slot if the budget allows, otherwise evict the least recently played idle clip
+         AudioClipId oldest = AUDIO_CLIP_NONE;
+         for (int i = 0; i < TDECK_AUDIO_CLIP_SLOTS; i++) {
+             if (!clips[i].samples) {
+                 if (clipBytes + bytes <= TDECK_AUDIO_CLIP_CACHE_BYTES) {
+                     slot = i;
+                     break;
+                 }
+             } else if (clips[i].users == 0 && (oldest == AUDIO_CLIP_NONE || clips[i].lastUsed < clips[oldest].lastUsed)) {
+                 oldest = i;
+             }
+         }
+         if (slot != AUDIO_CLIP_NONE) {
+             break;
+         }
+         if (oldest == AUDIO_CLIP_NONE) {
+             xSemaphoreGive(clipLock);
+             TDECK_LOG_W("Audio clip cache full, %s not cached", path);
+             heap_caps_free(samples);
+             return AUDIO_CLIP_NONE;
+         }
+         heap_caps_free(clips[oldest].samples);
+         clipBytes -= clips[oldest].frames * 2 * sizeof(int16_t);
+         clips[oldest].samples = nullptr;
+         clips[oldest].generation++;
+     }
+ 
+     MixerClip& clip = clips[slot];
+     strlcpy(clip.path, path, sizeof(clip.path));
+     clip.samples = samples;
+     clip.frames = frames;
+     clip.users = 0;
+     clip.lastUsed = millis();
+     clipBytes += bytes;
+     xSemaphoreGive(clipLock);
+ 
+     TDECK_LOG_I("Cached audio clip %s, %lu frames", path, (unsigned long)frames);
+     return slot;
+ }
+ 
+ // Play a cached clip
+ AudioVoiceId AudioMixer::playClip(AudioClipId clip, int16_t gain, bool loop) {
+     if (clip < 0 || clip >= TDECK_AUDIO_CLIP_SLOTS || !clipLock) {
+         return AUDIO_VOICE_NONE;
+     }
+ 
+     MixerCommand command = {};
+     xSemaphoreTake(clipLock, portMAX_DELAY);
+     clips[clip].lastUsed = millis();
+     command.generation = clips[clip].generation;
+     xSemaphoreGive(clipLock);
+ 
+     command.voiceType = VOICE_CLIP;
+     command.clip = clip;
+     command.gain = gain;
+     command.loop = loop;
+     return postPlay(command);
+ }
+ 
+ // Play a clip by path, loading it on first use
+ AudioVoiceId AudioMixer::playClip(const char* path, int16_t gain) {
+     return playClip(loadClip(path), gain, false);
+ }
+ 
+ // Stream a sound file from storage
+ AudioVoiceId AudioMixer::playFile(const char* path, int16_t gain) {
+     MixerCommand command = {};
+     command.decoder = AudioDecoder::open(path);
+     if (!command.decoder) {
+         return AUDIO_VOICE_NONE;
+     }
+ 
+     command.voiceType = VOICE_STREAM;
+     command.gain = gain;
+     AudioVoiceId voice = postPlay(command);
+     if (voice == AUDIO_VOICE_NONE) {
+         delete command.decoder;
+     }
+     return voice;
+ }
+ 
+ // Play a sine tone
+ AudioVoiceId AudioMixer::playTone(uint16_t frequency, uint32_t durationMs, int16_t gain) {
+     MixerCommand command = {};
+     command.voiceType = VOICE_TONE;
+     command.value = frequency;
+     command.durationMs = durationMs;
+     command.gain = gain;
+     return postPlay(command);
+ }
+ 
+ // Stop a voice
+ void AudioMixer::stop(AudioVoiceId voice) {
+     if (voice == AUDIO_VOICE_NONE) {
+         return;
+     }
+     MixerCommand command = {};
+     command.type = CMD_STOP;
+     command.voice = voice;
+     post(command);
+ }
+ 
+ // Ramp the gain of a voice
+ void AudioMixer::fade(AudioVoiceId voice, int16_t gain, uint32_t durationMs) {
+     if (voice == AUDIO_VOICE_NONE) {
+         return;
+     }
+     MixerCommand command = {};
+     command.type = CMD_FADE;
+     command.voice = voice;
+     command.gain = max(gain, (int16_t)0);
+     command.value = durationMs;
+     post(command);
+ }
+ 
+ // Stop every voice
+ void AudioMixer::stopAll() {
+     MixerCommand command = {};
+     command.type = CMD_STOP_ALL;
+     post(command);
+ }
+ 
+ // Check if a voice is queued or playing, handles only grow so a newer one is still queued
+ bool AudioMixer::isActive(AudioVoiceId voice) {
+     if (voice == AUDIO_VOICE_NONE) {
+         return false;
+     }
+     if ((int32_t)(voice - lastProcessed) > 0) {
+         return true;
+     }
+     for (size_t i = 0; i < TDECK_AUDIO_MIXER_VOICES; i++) {
+         if (voiceIds[i] == voice) {
+             return true;
+         }
+     }
+     return false;
+ }
+ 
+ // Get the number of voices playing
+ size_t AudioMixer::getActiveVoices() {
+     size_t count = 0;
+     for (size_t i = 0; i < TDECK_AUDIO_MIXER_VOICES; i++) {
+         if (voiceIds[i] != AUDIO_VOICE_NONE) {
+             count++;
+         }
+     }
+     return count;
+ }
+ 
+ // Mixer task, renders and writes one block at a time
+ void AudioMixer::mixerTaskFunc(void* parameter) {
+     int32_t* mix = (int32_t*)malloc(TDECK_AUDIO_MIXER_BLOCK * 2 * sizeof(int32_t));
+     int16_t* scratch = (int16_t*)malloc(TDECK_AUDIO_MIXER_BLOCK * 2 * sizeof(int16_t));
+     int16_t* out = (int16_t*)malloc(TDECK_AUDIO_MIXER_BLOCK * 2 * sizeof(int16_t));
+     if (!mix || !scratch || !out) {
+         TDECK_LOG_E("Failed to allocate audio mixer buffers");
+         free(mix);
+         free(scratch);
+         free(out);
+         mixerTask = NULL;
+         vTaskDelete(NULL);
+         return;
+     }
+ 
+     const size_t samples = TDECK_AUDIO_MIXER_BLOCK * 2;
+     MixerCommand command;
+ 
+     while (true) {
+         // Sleep on the queue while silent. The DMA plays zeros for a moment, then the
+         // driver stops so its APB lock no longer keeps the chip out of light sleep
+         bool idle = !anyVoiceActive();
+         TickType_t wait = !idle ? 0 : outputRunning ? pdMS_TO_TICKS(TDECK_AUDIO_IDLE_STOP_MS) : portMAX_DELAY;
+         if (xQueueReceive(commands, &command, wait) == pdTRUE) {
+             do {
+                 applyCommand(command);
+             } while (xQueueReceive(commands, &command, 0) == pdTRUE);
+         } else if (idle && outputRunning) {
+             i2s_stop(I2S_NUM_0);
+             Power::unlock(PowerLock::AUDIO);
+             outputRunning = false;
+             continue;
+         }
+ 
+         // voiceIds[] is only published after mixing, a voice started just now is only in voices[]
+         if (!outputRunning && anyVoiceActive()) {
+             Power::lock(PowerLock::AUDIO);
+             i2s_start(I2S_NUM_0);
+             outputRunning = true;
+         }
+ 
+         memset(mix, 0, samples * sizeof(int32_t));
+         bool audible = false;
+ 
+         // Clip samples may not be evicted while a block reads them
+         xSemaphoreTake(clipLock, portMAX_DELAY);
+         for (size_t v = 0; v < TDECK_AUDIO_MIXER_VOICES; v++) {
+             MixerVoice& voice = voices[v];
+             if (voice.type == VOICE_FREE) {
+                 continue;
+             }
+ 
+             size_t frames = 0;
+             switch (voice.type) {
+                 case VOICE_CLIP:
+                     frames = renderClip(voice, scratch, TDECK_AUDIO_MIXER_BLOCK);
+                     break;
+                 case VOICE_TONE:
+                     frames = renderTone(voice, scratch, TDECK_AUDIO_MIXER_BLOCK);
+                     break;
+                 case VOICE_STREAM:
+                     frames = renderStream(voice, scratch, TDECK_AUDIO_MIXER_BLOCK);
+                     break;
+             }
+ 
+             AudioDSP::applyGain(scratch, frames * 2, (int16_t)voice.gain);
+             for (size_t i = 0; i < frames * 2; i++) {
+                 mix[i] += scratch[i];
+             }
+             audible |= frames > 0;
+ 
+             if (voice.fadeBlocks > 0) {
+                 voice.gain = --voice.fadeBlocks == 0 ? voice.fadeTarget : voice.gain + voice.gainStep;
+             }
+             bool faded = voice.stopAfterFade && voice.fadeBlocks == 0;
+             if (frames < TDECK_AUDIO_MIXER_BLOCK || faded) {
+                 // endVoice() takes the clip lock itself
+                 xSemaphoreGive(clipLock);
+                 endVoice(voice);
+                 xSemaphoreTake(clipLock, portMAX_DELAY);
+             }
+         }
+         xSemaphoreGive(clipLock);
+ 
+         for (size_t v = 0; v < TDECK_AUDIO_MIXER_VOICES; v++) {
+             voiceIds[v] = voices[v].type != VOICE_FREE ? voices[v].id : AUDIO_VOICE_NONE;
+         }
+ 
+         if (!audible) {
+             continue;
+         }
+ 
+         // Saturate the sum, then the master volume
+         for (size_t i = 0; i < samples; i++) {
+             out[i] = (int16_t)constrain(mix[i], -32768, 32767);
+         }
+         AudioDSP::applyGain(out, samples, TDeckAudio::getGain());
+ 
+         size_t bytesWritten;
+         i2s_write(I2S_NUM_0, out, samples * sizeof(int16_t), &bytesWritten, portMAX_DELAY);
+     }
+ }
\ No newline at end of file
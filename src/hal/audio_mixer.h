@@ -0,0 +1,121 @@
+/**
+ * @file audio_mixer.h
+ * @brief Multi-voice audio mixer for T-Deck hardware
+ *
+ * One task owns the I2S output and mixes up to TDECK_AUDIO_MIXER_VOICES
+ * voices, each a cached clip, a tone or a file stream, with its own gain.
+ * Every call here only queues a command for that task, so none of them
+ * waits for audio. Short clips such as key clicks are decoded once into a
+ * PSRAM cache and start with a copy from memory instead of a file open.
+ */
+
+ #ifndef TDECK_AUDIO_MIXER_H
+ #define TDECK_AUDIO_MIXER_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "audio_dsp.h"
+ 
+ // Handle of a playing voice, never reused
+ typedef uint32_t AudioVoiceId;
+ #define AUDIO_VOICE_NONE 0
+ 
+ // Handle of a cached clip
+ typedef int8_t AudioClipId;
+ #define AUDIO_CLIP_NONE -1
+ 
+ /**
+  * @class AudioMixer
+  * @brief Mixes clips, tones and streams into the speaker output
+  */
+ class AudioMixer {
+ public:
+     /**
+      * @brief Start the mixer task, the I2S driver must be installed
+      * @return true if successful
+      */
+     static bool init();
+ 
+     /**
+      * @brief Decode a sound file into the cache
+      *
+      * A clip already cached is found by path. When the cache is full the
+      * least recently played clip that is not playing makes room.
+      *
+      * @param path Path to the sound file
+      * @return Clip handle, AUDIO_CLIP_NONE if it could not be loaded
+      */
+     static AudioClipId loadClip(const char* path);
+ 
+     /**
+      * @brief Play a cached clip
+      * @param clip Clip handle
+      * @param gain Q15 voice gain
+      * @param loop Repeat until stopped
+      * @return Voice handle, AUDIO_VOICE_NONE if the command queue is full
+      */
+     static AudioVoiceId playClip(AudioClipId clip, int16_t gain = AUDIO_GAIN_UNITY, bool loop = false);
+ 
+     /**
+      * @brief Play a clip by path, loading it into the cache on first use
+      * @param path Path to the sound file
+      * @param gain Q15 voice gain
+      * @return Voice handle, AUDIO_VOICE_NONE on failure
+      */
+     static AudioVoiceId playClip(const char* path, int16_t gain = AUDIO_GAIN_UNITY);
+ 
+     /**
+      * @brief Stream a sound file from storage
+      * @param path Path to a PCM or IMA-ADPCM WAV, an MP3, or raw 16-bit stereo PCM at TDECK_AUDIO_SAMPLE_RATE
+      * @param gain Q15 voice gain
+      * @return Voice handle, AUDIO_VOICE_NONE on failure
+      */
+     static AudioVoiceId playFile(const char* path, int16_t gain = AUDIO_GAIN_UNITY);
+ 
+     /**
+      * @brief Play a sine tone
+      * @param frequency Tone frequency in Hz
+      * @param durationMs Duration in milliseconds
+      * @param gain Q15 voice gain
+      * @return Voice handle, AUDIO_VOICE_NONE if the command queue is full
+      */
+     static AudioVoiceId playTone(uint16_t frequency, uint32_t durationMs, int16_t gain = AUDIO_GAIN_UNITY);
+ 
+     /**
+      * @brief Stop a voice
+      * @param voice Voice handle
+      */
+     static void stop(AudioVoiceId voice);
+ 
+     /**
+      * @brief Ramp the gain of a voice
+      * @param voice Voice handle
+      * @param gain Q15 gain to reach, 0 stops the voice when reached
+      * @param durationMs Ramp time in milliseconds
+      */
+     static void fade(AudioVoiceId voice, int16_t gain, uint32_t durationMs);
+ 
+     /**
+      * @brief Stop every voice
+      */
+     static void stopAll();
+ 
+     /**
+      * @brief Check if a voice is queued or playing
+      * @param voice Voice handle
+      */
+     static bool isActive(AudioVoiceId voice);
+ 
+     /**
+      * @brief Get the number of voices playing
+      */
+     static size_t getActiveVoices();
+ 
+ private:
+     /**
+      * @brief Mixer task, renders and writes one block at a time
+      */
+     static void mixerTaskFunc(void* parameter);
+ };
+ 
+ #endif // TDECK_AUDIO_MIXER_H
\ No newline at end of file
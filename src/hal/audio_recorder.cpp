@@ -0,0 +1,425 @@
+/**
+ * @file audio_recorder.cpp
+ * @brief Implementation of the microphone recording pipeline
+ */
+
+ #include "audio_recorder.h"
+ #include "audio.h"
+ #include <driver/i2s.h>
+ #include <esp_heap_caps.h>
+ #include <freertos/stream_buffer.h>
+ #include "../system/fs_manager.h"
+ #include "power.h"
+ 
+ // The microphone runs 16-bit stereo at the speaker rate
+ #define RECORD_CHANNELS 2
+ #define RECORD_FRAME_BYTES (RECORD_CHANNELS * sizeof(int16_t))
+ 
+ // Bytes per I2S read, one DMA buffer
+ #define RECORD_READ_SIZE (TDECK_AUDIO_BUFFER_SIZE * RECORD_FRAME_BYTES)
+ 
+ // Frames per IMA-ADPCM block
+ #define RECORD_ADPCM_FRAMES ((TDECK_AUDIO_RECORD_ADPCM_BLOCK - 4 * RECORD_CHANNELS) * 2 / RECORD_CHANNELS + 1)
+ 
+ // Writer wait for a full batch before writing what there is
+ #define RECORD_FLUSH_MS 100
+ 
+ // stop() wait for the writer to finish the file
+ #define RECORD_STOP_TIMEOUT_MS 5000
+ 
+ static StreamBufferHandle_t ring = NULL;
+ static StaticStreamBuffer_t ringState;
+ static QueueHandle_t i2sEvents = NULL;
+ static SemaphoreHandle_t finished = NULL;      // Given when the writer closes the file
+ static FSStream* file = nullptr;
+ static AudioRecordSink sink = nullptr;         // Set instead of file for streamed capture
+ static void* sinkContext = nullptr;
+ static AudioRecordEncoding encoding = AUDIO_RECORD_PCM;
+ static uint32_t frameLimit = 0;                // Frames to capture, 0 for no limit
+ static volatile bool active = false;           // A recording is in progress
+ static volatile bool capturing = false;        // Reader keeps reading
+ static volatile bool captureDone = false;      // Reader has put its last block in the ring
+ static bool lastResult = true;
+ static AudioRecordStats stats;
+ 
+ // IMA-ADPCM encoder, runs on the writer task
+ static AdpcmState adpcmState[RECORD_CHANNELS];
+ static int16_t* adpcmPending = nullptr;        // Frames of the block being filled
+ static size_t adpcmPendingFrames = 0;
+ 
+ // WAV format of the file for the sizes so far
+ static AudioFormat fileFormat(uint32_t dataSize) {
+     if (encoding == AUDIO_RECORD_ADPCM) {
+         return {TDECK_AUDIO_SAMPLE_RATE, RECORD_CHANNELS, 4, TDECK_AUDIO_RECORD_ADPCM_BLOCK, 0, dataSize,
+                 WAV_FORMAT_IMA_ADPCM, RECORD_ADPCM_FRAMES};
+     }
+     return {TDECK_AUDIO_SAMPLE_RATE, RECORD_CHANNELS, 16, RECORD_FRAME_BYTES, 0, dataSize, WAV_FORMAT_PCM, 0};
+ }
+ 
+ // Write to the file and note the slowest write
+ static bool timedWrite(const uint8_t* data, size_t length) {
+     uint32_t start = millis();
+     bool written = file->write(data, length) == (int64_t)length;
+     uint32_t elapsed = millis() - start;
+     if (elapsed > stats.writeMaxMs) {
+         stats.writeMaxMs = elapsed;
+     }
+     if (written) {
+         stats.bytesWritten += length;
+     }
+     return written;
+ }
+ 
+ // Encode up to one block of frames, a short last block is padded to whole nibble groups
+ static size_t encodeBlock(const int16_t* pcm, size_t frames, uint8_t* out) {
+     for (int c = 0; c < RECORD_CHANNELS; c++) {
+         // The header sample restarts the predictor, the step index carries over
+         adpcmState[c].predictor = pcm[c];
+         out[c * 4] = pcm[c] & 0xFF;
+         out[c * 4 + 1] = (uint16_t)pcm[c] >> 8;
+         out[c * 4 + 2] = adpcmState[c].index;
+         out[c * 4 + 3] = 0;
+     }
+ 
+     size_t groups = (frames + 6) / 8;
+     for (size_t g = 0; g < groups; g++) {
+         for (int c = 0; c < RECORD_CHANNELS; c++) {
+             uint8_t* data = out + 4 * RECORD_CHANNELS + (g * RECORD_CHANNELS + c) * 4;
+             for (int b = 0; b < 4; b++) {
+                 size_t first = min(1 + g * 8 + b * 2, frames - 1);
+                 size_t second = min(first + 1, frames - 1);
+                 uint8_t low = AudioDSP::adpcmEncode(pcm[first * RECORD_CHANNELS + c], adpcmState[c]);
+                 uint8_t high = AudioDSP::adpcmEncode(pcm[second * RECORD_CHANNELS + c], adpcmState[c]);
+                 data[b] = low | (high << 4);
+             }
+         }
+     }
+     return 4 * RECORD_CHANNELS + groups * 4 * RECORD_CHANNELS;
+ }
+ 
+ // Encode a batch of frames, writing each batch of whole blocks at once
+ static bool writeAdpcm(const int16_t* pcm, size_t frames, uint8_t* encoded, size_t encodedSize, bool flush) {
+     size_t encodedLength = 0;
+     bool ok = true;
+     while (frames > 0 || (flush && adpcmPendingFrames > 0)) {
+         size_t count = min(frames, RECORD_ADPCM_FRAMES - adpcmPendingFrames);
+         if (count > 0) {
+             memcpy(adpcmPending + adpcmPendingFrames * RECORD_CHANNELS, pcm, count * RECORD_FRAME_BYTES);
+             adpcmPendingFrames += count;
+             pcm += count * RECORD_CHANNELS;
+             frames -= count;
+         }
+ 
+         if (adpcmPendingFrames < RECORD_ADPCM_FRAMES && !(flush && frames == 0)) {
+             break;
+         }
+         if (encodedLength + TDECK_AUDIO_RECORD_ADPCM_BLOCK > encodedSize) {
+             ok &= timedWrite(encoded, encodedLength);
+             encodedLength = 0;
+         }
+         encodedLength += encodeBlock(adpcmPending, adpcmPendingFrames, encoded + encodedLength);
+         adpcmPendingFrames = 0;
+     }
+     if (encodedLength > 0) {
+         ok &= timedWrite(encoded, encodedLength);
+     }
+     return ok;
+ }
+ 
+ // Set up the ring
+ bool AudioRecorder::init(QueueHandle_t events) {
+     if (ring) {
+         return true;
+     }
+ 
+     uint8_t* storage = (uint8_t*)heap_caps_malloc(TDECK_AUDIO_RECORD_RING_SIZE + 1, MALLOC_CAP_SPIRAM);
+     finished = xSemaphoreCreateBinary();
+     if (!storage || !finished) {
+         TDECK_LOG_E("Failed to allocate audio recording ring");
+         heap_caps_free(storage);
+         if (finished) {
+             vSemaphoreDelete(finished);
+             finished = NULL;
+         }
+         return false;
+     }
+     ring = xStreamBufferCreateStatic(TDECK_AUDIO_RECORD_RING_SIZE + 1, TDECK_AUDIO_RECORD_BATCH,
+                                      storage, &ringState);
+     i2sEvents = events;
+     return true;
+ }
+ 
+ // Start recording
+ bool AudioRecorder::start(const char* path, uint32_t durationMs, AudioRecordEncoding recordEncoding) {
+     if (!ring) {
+         TDECK_LOG_E("Audio recorder not initialized");
+         return false;
+     }
+     if (active) {
+         stop();
+     }
+ 
+     // Unbuffered, the writer already hands over large batches
+     file = new FSStream();
+     if (!file->open(path, FILE_WRITE, 0)) {
+         TDECK_LOG_E("Failed to open file for recording: %s", path);
+         delete file;
+         file = nullptr;
+         return false;
+     }
+ 
+     // Reserve the header, it is written again with the sizes on stop
+     encoding = recordEncoding;
+     memset(&stats, 0, sizeof(stats));
+     uint8_t header[WAV_HEADER_MAX_SIZE];
+     size_t headerSize = AudioDSP::buildWavHeader(header, fileFormat(0), 0);
+     if (file->write(header, headerSize) != (int64_t)headerSize) {
+         TDECK_LOG_E("Failed to write recording header: %s", path);
+         delete file;
+         file = nullptr;
+         return false;
+     }
+ 
+     if (encoding == AUDIO_RECORD_ADPCM) {
+         adpcmPending = (int16_t*)malloc(RECORD_ADPCM_FRAMES * RECORD_FRAME_BYTES);
+         if (!adpcmPending) {
+             TDECK_LOG_E("Failed to allocate ADPCM encoder");
+             delete file;
+             file = nullptr;
+             return false;
+         }
+         adpcmPendingFrames = 0;
+         for (int c = 0; c < RECORD_CHANNELS; c++) {
+             adpcmState[c] = {0, 0};
+         }
+     }
+ 
+     if (!launch(durationMs, TDECK_AUDIO_RECORD_STACK_SIZE)) {
+         return false;
+     }
+ 
+     TDECK_LOG_I("Recording audio to: %s for %u ms (%s)", path, durationMs,
+                 encoding == AUDIO_RECORD_ADPCM ? "IMA-ADPCM" : "PCM");
+     return true;
+ }
+ 
+ // Start handing captured frames to a sink
+ bool AudioRecorder::startStream(AudioRecordSink recordSink, void* context, uint32_t durationMs) {
+     if (!ring) {
+         TDECK_LOG_E("Audio recorder not initialized");
+         return false;
+     }
+     if (active) {
+         stop();
+     }
+ 
+     encoding = AUDIO_RECORD_PCM;
+     memset(&stats, 0, sizeof(stats));
+     sink = recordSink;
+     sinkContext = context;
+     if (!launch(durationMs, TDECK_AUDIO_RECORD_SINK_STACK_SIZE)) {
+         sink = nullptr;
+         return false;
+     }
+ 
+     TDECK_LOG_I("Streaming microphone audio for %u ms", durationMs);
+     return true;
+ }
+ 
+ // Start the reader and writer tasks
+ bool AudioRecorder::launch(uint32_t durationMs, uint32_t writerStackSize) {
+     frameLimit = (uint32_t)((uint64_t)durationMs * TDECK_AUDIO_SAMPLE_RATE / 1000);
+     xStreamBufferReset(ring);
+     if (i2sEvents) {
+         xQueueReset(i2sEvents);
+     }
+     xSemaphoreTake(finished, 0);
+     active = true;
+     capturing = true;
+     captureDone = false;
+ 
+     // The reader runs above the writer so a slow write never starves it
+     if (xTaskCreatePinnedToCore(writerTaskFunc, "audio_rec_write", writerStackSize, NULL,
+                                 TDECK_SYSTEM_TASK_PRIORITY, NULL, 0) != pdPASS) {
+         TDECK_LOG_E("Failed to create recording writer task");
+         active = false;
+         free(adpcmPending);
+         adpcmPending = nullptr;
+         delete file;
+         file = nullptr;
+         return false;
+     }
+     if (xTaskCreatePinnedToCore(readerTaskFunc, "audio_rec_read", TDECK_AUDIO_RECORD_STACK_SIZE, NULL,
+                                 TDECK_COMMS_TASK_PRIORITY + 1, NULL, 0) != pdPASS) {
+         // The writer finishes an empty file on its own
+         TDECK_LOG_E("Failed to create recording reader task");
+         captureDone = true;
+         stop();
+         return false;
+     }
+     return true;
+ }
+ 
+ // Stop recording and wait for the file
+ bool AudioRecorder::stop() {
+     if (!active) {
+         return lastResult;
+     }
+ 
+     TDECK_LOG_I("Stopping audio recording");
+     capturing = false;
+     if (xSemaphoreTake(finished, pdMS_TO_TICKS(RECORD_STOP_TIMEOUT_MS)) != pdTRUE) {
+         TDECK_LOG_E("Recording writer did not finish");
+         return false;
+     }
+     return lastResult;
+ }
+ 
+ // Check if a recording is in progress
+ bool AudioRecorder::isRecording() {
+     return active;
+ }
+ 
+ // Get the recording counters
+ AudioRecordStats AudioRecorder::getStats() {
+     return stats;
+ }
+ 
+ // Reader task, moves I2S blocks into the ring
+ void AudioRecorder::readerTaskFunc(void* parameter) {
+     uint8_t* buffer = (uint8_t*)malloc(RECORD_READ_SIZE);
+     if (!buffer) {
+         TDECK_LOG_E("Failed to allocate memory for recording buffer");
+         captureDone = true;
+         vTaskDelete(NULL);
+         return;
+     }
+ 
+     // The microphone channel only runs while capturing
+     Power::lock(PowerLock::AUDIO);
+     i2s_start(I2S_NUM_1);
+ 
+     while (capturing && (frameLimit == 0 || stats.frames < frameLimit)) {
+         size_t bytesRead = 0;
+         i2s_read(I2S_NUM_1, buffer, RECORD_READ_SIZE, &bytesRead, pdMS_TO_TICKS(RECORD_FLUSH_MS));
+ 
+         // A full event queue means DMA buffers were refilled before anyone read them
+         i2s_event_t event;
+         while (i2sEvents && xQueueReceive(i2sEvents, &event, 0) == pdTRUE) {
+             if (event.type == I2S_EVENT_RX_Q_OVF) {
+                 stats.dmaOverruns++;
+             }
+         }
+ 
+         bytesRead -= bytesRead % RECORD_FRAME_BYTES;
+         if (frameLimit > 0) {
+             bytesRead = min(bytesRead, (size_t)(frameLimit - stats.frames) * RECORD_FRAME_BYTES);
+         }
+         if (bytesRead == 0) {
+             continue;
+         }
+ 
+         // Whole reads or nothing, so the writer always sees whole frames
+         if (xStreamBufferSpacesAvailable(ring) < bytesRead) {
+             stats.ringOverruns++;
+             stats.droppedBytes += bytesRead;
+             continue;
+         }
+         xStreamBufferSend(ring, buffer, bytesRead, 0);
+         stats.frames += bytesRead / RECORD_FRAME_BYTES;
+ 
+         size_t waiting = xStreamBufferBytesAvailable(ring);
+         if (waiting > stats.ringPeak) {
+             stats.ringPeak = waiting;
+         }
+     }
+ 
+     i2s_stop(I2S_NUM_1);
+     Power::unlock(PowerLock::AUDIO);
+     free(buffer);
+     captureDone = true;
+     vTaskDelete(NULL);
+ }
+ 
+ // Writer task, moves the ring into the file in batches
+ void AudioRecorder::writerTaskFunc(void* parameter) {
+     // PCM is written as received, ADPCM blocks are gathered for one write per batch
+     const size_t encodedSize = (TDECK_AUDIO_RECORD_BATCH / RECORD_FRAME_BYTES / RECORD_ADPCM_FRAMES + 2) *
+                                TDECK_AUDIO_RECORD_ADPCM_BLOCK;
+     uint8_t* batch = (uint8_t*)heap_caps_malloc(TDECK_AUDIO_RECORD_BATCH, MALLOC_CAP_SPIRAM);
+     uint8_t* encoded = encoding == AUDIO_RECORD_ADPCM ? (uint8_t*)malloc(encodedSize) : nullptr;
+     bool ok = batch && (encoding != AUDIO_RECORD_ADPCM || encoded);
+     uint32_t framesWritten = 0;
+     if (!ok) {
+         // Nothing can be written, let the reader wind down and close an empty file
+         TDECK_LOG_E("Failed to allocate recording write buffer");
+         capturing = false;
+         while (!captureDone) {
+             vTaskDelay(pdMS_TO_TICKS(10));
+         }
+     }
+ 
+     while (batch) {
+         // Checked before the receive so a last block cannot arrive unseen
+         bool last = captureDone;
+         size_t length = xStreamBufferReceive(ring, batch, TDECK_AUDIO_RECORD_BATCH,
+                                              pdMS_TO_TICKS(RECORD_FLUSH_MS));
+         if (length == 0) {
+             if (last) {
+                 break;
+             }
+             continue;
+         }
+         framesWritten += length / RECORD_FRAME_BYTES;
+         if (!ok) {
+             continue;
+         }
+         if (sink) {
+             sink((const int16_t*)batch, length / RECORD_FRAME_BYTES, sinkContext);
+             stats.bytesWritten += length;
+         } else if (encoding == AUDIO_RECORD_ADPCM) {
+             ok = writeAdpcm((const int16_t*)batch, length / RECORD_FRAME_BYTES, encoded, encodedSize, false);
+         } else {
+             ok = timedWrite(batch, length);
+         }
+         if (!ok) {
+             TDECK_LOG_E("Recording write failed, stopping");
+             capturing = false;
+         }
+     }
+ 
+     if (ok && encoding == AUDIO_RECORD_ADPCM) {
+         ok = writeAdpcm(nullptr, 0, encoded, encodedSize, true);
+     }
+ 
+     // The real sizes are only known now
+     if (file) {
+         uint8_t header[WAV_HEADER_MAX_SIZE];
+         size_t headerSize = AudioDSP::buildWavHeader(header, fileFormat(stats.bytesWritten), framesWritten);
+         ok &= file->seek(0) && file->write(header, headerSize) == (int64_t)headerSize;
+         ok &= file->close();
+         delete file;
+         file = nullptr;
+     }
+     sink = nullptr;
+ 
+     heap_caps_free(batch);
+     free(encoded);
+     free(adpcmPending);
+     adpcmPending = nullptr;
+ 
+     if (ok) {
+         TDECK_LOG_I("Audio recording completed, %u frames, %u bytes", framesWritten, stats.bytesWritten);
+     } else {
+         TDECK_LOG_E("Failed to write recording");
+     }
+     if (stats.ringOverruns > 0 || stats.dmaOverruns > 0) {
+         TDECK_LOG_W("Recording lost audio: %u ring overruns (%u bytes), %u DMA overruns",
+                     stats.ringOverruns, stats.droppedBytes, stats.dmaOverruns);
+     }
+ 
+     lastResult = ok;
+     active = false;
+     xSemaphoreGive(finished);
+     vTaskDelete(NULL);
+ }
\ No newline at end of file
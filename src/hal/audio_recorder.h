@@ -0,0 +1,116 @@
+/**
+ * @file audio_recorder.h
+ * @brief Microphone recording pipeline for T-Deck hardware
+ *
+ * A high priority reader task does nothing but drain the I2S DMA buffers
+ * into a PSRAM ring, so an SD card stall delays the file instead of losing
+ * samples. A writer task takes the ring in large batches, optionally
+ * encodes them as IMA-ADPCM for a quarter of the size, and writes the WAV
+ * header with the final sizes when recording stops. Overruns on either
+ * side of the ring are counted rather than silently dropped.
+ */
+
+ #ifndef TDECK_AUDIO_RECORDER_H
+ #define TDECK_AUDIO_RECORDER_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ #include "audio_dsp.h"
+ 
+ /**
+  * @brief Sample encoding of a recording
+  */
+ enum AudioRecordEncoding {
+     AUDIO_RECORD_PCM,              // 16-bit PCM WAV
+     AUDIO_RECORD_ADPCM             // IMA-ADPCM WAV, 4 bits per sample
+ };
+ 
+ // Receives captured 16-bit stereo frames at TDECK_AUDIO_SAMPLE_RATE, runs on the writer task
+ typedef void (*AudioRecordSink)(const int16_t* frames, size_t count, void* context);
+ 
+ /**
+  * @brief Counters of the current or last recording
+  */
+ struct AudioRecordStats {
+     uint32_t frames;               // Frames captured into the ring
+     uint32_t bytesWritten;         // Sample data bytes in the file
+     uint32_t ringOverruns;         // I2S reads dropped because the ring was full
+     uint32_t droppedBytes;         // Bytes of those reads
+     uint32_t dmaOverruns;          // I2S DMA buffers overwritten before they were read
+     uint32_t ringPeak;             // Most bytes waiting in the ring
+     uint32_t writeMaxMs;           // Longest single file write
+ };
+ 
+ /**
+  * @class AudioRecorder
+  * @brief Records the microphone to a WAV file
+  */
+ class AudioRecorder {
+ public:
+     /**
+      * @brief Set up the ring, the microphone I2S driver must be installed
+      * @param events I2S_NUM_1 event queue, nullptr to not count DMA overruns
+      * @return true if successful
+      */
+     static bool init(QueueHandle_t events);
+ 
+     /**
+      * @brief Start recording, stopping any recording in progress first
+      * @param path Path of the WAV file to write
+      * @param durationMs Recording length in milliseconds, 0 until stop()
+      * @param encoding Sample encoding
+      * @return true if recording started
+      */
+     static bool start(const char* path, uint32_t durationMs = 0,
+                       AudioRecordEncoding encoding = AUDIO_RECORD_PCM);
+ 
+     /**
+      * @brief Start handing captured frames to a sink instead of a file
+      *
+      * The sink gets batches of up to TDECK_AUDIO_RECORD_BATCH bytes on the
+      * writer task, which then has a TDECK_AUDIO_RECORD_SINK_STACK_SIZE stack
+      * for encoders that need it.
+      *
+      * @param sink Frame sink
+      * @param context Passed to the sink
+      * @param durationMs Capture length in milliseconds, 0 until stop()
+      * @return true if capture started
+      */
+     static bool startStream(AudioRecordSink sink, void* context, uint32_t durationMs = 0);
+ 
+     /**
+      * @brief Stop recording and wait for the file to be finished
+      * @return true if the file was written completely
+      */
+     static bool stop();
+ 
+     /**
+      * @brief Check if a recording or stream is in progress
+      */
+     static bool isRecording();
+ 
+     /**
+      * @brief Get the counters of the current or last recording
+      */
+     static AudioRecordStats getStats();
+ 
+ private:
+     /**
+      * @brief Reset the ring and start the reader and writer tasks
+      * @param durationMs Capture length in milliseconds, 0 until stop()
+      * @param writerStackSize Writer task stack
+      */
+     static bool launch(uint32_t durationMs, uint32_t writerStackSize);
+ 
+     /**
+      * @brief Reader task, moves I2S blocks into the ring
+      */
+     static void readerTaskFunc(void* parameter);
+ 
+     /**
+      * @brief Writer task, moves the ring into the file in batches
+      */
+     static void writerTaskFunc(void* parameter);
+ };
+ 
+ #endif // TDECK_AUDIO_RECORDER_H
\ No newline at end of file
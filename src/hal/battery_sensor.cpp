@@ -0,0 +1,194 @@
+/**
+ * @file battery_sensor.cpp
+ * @brief Implementation of calibrated battery voltage sampling
+ */
+
+ #include "battery_sensor.h"
+ #include <driver/adc.h>
+ 
+ // Bytes of one burst, each conversion is one output word
+ #define BURST_BYTES (TDECK_BATTERY_OVERSAMPLE * SOC_ADC_DIGI_RESULT_BYTES)
+ 
+ // A burst that takes longer than twice its length has stalled
+ #define BURST_TIMEOUT_MS (2 * 1000 * TDECK_BATTERY_OVERSAMPLE / TDECK_BATTERY_ADC_RATE + 10)
+ 
+ // One-shot reads averaged when continuous mode is unavailable
+ #define ONESHOT_SAMPLES 16
+ 
+ // Resting LiPo cell voltage in mV at 0, 5, ... 100 percent charge
+ static const uint16_t lipoCurve[] = {
+     3270, 3610, 3690, 3710, 3730, 3750, 3770, 3790, 3800, 3820, 3840,
+     3850, 3870, 3910, 3950, 3980, 4020, 4080, 4110, 4150, 4200
+ };
+ #define LIPO_CURVE_POINTS (sizeof(lipoCurve) / sizeof(lipoCurve[0]))
+ #define LIPO_CURVE_STEP (100 / (LIPO_CURVE_POINTS - 1))
+ 
+ // Global instance
+ BatterySensor batterySensor;
+ 
+ // Constructor
+ BatterySensor::BatterySensor()
+     : _channel(-1)
+     , _unit(0)
+     , _continuous(false)
+     , _calibrated(false)
+     , _voltage(0.0f)
+ {
+ }
+ 
+ // Set up the ADC and take the first reading
+ bool BatterySensor::begin() {
+     // Arduino numbers ADC2 channels after the ADC1 ones
+     int8_t channel = digitalPinToAnalogChannel(TDECK_BATTERY_ADC);
+     if (channel < 0) {
+         TDECK_LOG_E("Battery pin %d has no ADC channel", TDECK_BATTERY_ADC);
+         return false;
+     }
+     _unit = channel >= SOC_ADC_MAX_CHANNEL_NUM ? 1 : 0;
+     _channel = channel % SOC_ADC_MAX_CHANNEL_NUM;
+ 
+     // Two-point eFuse values where the chip has them, the default reference otherwise
+     esp_adc_cal_value_t source = esp_adc_cal_characterize(_unit ? ADC_UNIT_2 : ADC_UNIT_1, ADC_ATTEN_DB_11,
+                                                           ADC_WIDTH_BIT_12, 1100, &_characteristics);
+     _calibrated = source != ESP_ADC_CAL_VAL_DEFAULT_VREF;
+ 
+     adc_digi_init_config_t initConfig = {
+         .max_store_buf_size = 2 * BURST_BYTES,
+         .conv_num_each_intr = BURST_BYTES,
+         .adc1_chan_mask = _unit ? 0 : (uint32_t)BIT(_channel),
+         .adc2_chan_mask = _unit ? (uint32_t)BIT(_channel) : 0,
+     };
+     adc_digi_pattern_config_t pattern = {
+         .atten = ADC_ATTEN_DB_11,
+         .channel = (uint8_t)_channel,
+         .unit = _unit,
+         .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+     };
+     adc_digi_configuration_t digiConfig = {
+         .conv_limit_en = false,
+         .conv_limit_num = 0,
+         .pattern_num = 1,
+         .adc_pattern = &pattern,
+         .sample_freq_hz = TDECK_BATTERY_ADC_RATE,
+         .conv_mode = _unit ? ADC_CONV_SINGLE_UNIT_2 : ADC_CONV_SINGLE_UNIT_1,
+         .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+     };
+     _continuous = adc_digi_initialize(&initConfig) == ESP_OK;
+     if (_continuous && adc_digi_controller_configure(&digiConfig) != ESP_OK) {
+         adc_digi_deinitialize();
+         _continuous = false;
+     }
+     if (!_continuous) {
+         TDECK_LOG_W("ADC continuous mode unavailable, sampling the battery with one-shot reads");
+         analogReadResolution(12);
+         pinMode(TDECK_BATTERY_ADC, INPUT);
+     }
+ 
+     sample();
+     TDECK_LOG_I("Battery sensor on ADC%d channel %d (%s, %s): %.2fV", _unit + 1, _channel,
+                 _continuous ? "DMA" : "one-shot", _calibrated ? "eFuse calibrated" : "uncalibrated",
+                 getVoltage());
+     return isAvailable();
+ }
+ 
+ // Take one burst of conversions and fold it into the filter
+ uint32_t BatterySensor::sample() {
+     uint32_t millivolts;
+     if (_channel < 0 || !(_continuous ? readBurst(millivolts) : readOneShot(millivolts))) {
+         return UINT32_MAX;
+     }
+ 
+     // The first reading seeds the filter, later ones move it by a fraction
+     float voltage = millivolts * TDECK_BATTERY_DIVIDER / 1000.0f;
+     if (_voltage == 0.0f) {
+         _voltage = voltage;
+     } else {
+         _voltage = _voltage + (voltage - _voltage) / (1 << TDECK_BATTERY_FILTER_SHIFT);
+     }
+     return UINT32_MAX;
+ }
+ 
+ // Check if at least one reading has been taken
+ bool BatterySensor::isAvailable() const {
+     return _voltage > 0.0f;
+ }
+ 
+ // Check if the readings use the eFuse calibration
+ bool BatterySensor::isCalibrated() const {
+     return _calibrated;
+ }
+ 
+ // Get the filtered battery voltage
+ float BatterySensor::getVoltage() const {
+     return _voltage;
+ }
+ 
+ // Interpolate the LiPo discharge curve
+ uint8_t BatterySensor::voltageToPercentage(float voltage) {
+     int millivolts = (int)(voltage * 1000.0f);
+     if (millivolts <= lipoCurve[0]) {
+         return 0;
+     }
+     for (size_t i = 1; i < LIPO_CURVE_POINTS; i++) {
+         if (millivolts < lipoCurve[i]) {
+             int span = lipoCurve[i] - lipoCurve[i - 1];
+             return (i - 1) * LIPO_CURVE_STEP + (millivolts - lipoCurve[i - 1]) * LIPO_CURVE_STEP / span;
+         }
+     }
+     return 100;
+ }
+ 
+ // Average a burst of DMA conversions
+ bool BatterySensor::readBurst(uint32_t& millivolts) {
+     static uint8_t buffer[BURST_BYTES];
+     uint32_t sum = 0;
+     uint32_t count = 0;
+ 
+     // The driver holds the APB clock only while converting
+     adc_digi_start();
+     uint32_t start = millis();
+     while (count < TDECK_BATTERY_OVERSAMPLE && millis() - start < BURST_TIMEOUT_MS) {
+         uint32_t length = 0;
+         esp_err_t err = adc_digi_read_bytes(buffer, BURST_BYTES, &length, BURST_TIMEOUT_MS);
+         if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+             break;
+         }
+         for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length && count < TDECK_BATTERY_OVERSAMPLE;
+              i += SOC_ADC_DIGI_RESULT_BYTES) {
+             const adc_digi_output_data_t* result = (const adc_digi_output_data_t*)&buffer[i];
+             if (result->type2.channel == _channel && result->type2.unit == _unit) {
+                 sum += result->type2.data;
+                 count++;
+             }
+         }
+     }
+     adc_digi_stop();
+ 
+     // Conversions left over would be a burst old by the next read
+     uint32_t length;
+     while (adc_digi_read_bytes(buffer, BURST_BYTES, &length, 0) == ESP_OK && length > 0) {
+     }
+ 
+     if (count < TDECK_BATTERY_OVERSAMPLE / 2) {
+         TDECK_LOG_W("Battery ADC burst returned %u of %d conversions", (unsigned)count, TDECK_BATTERY_OVERSAMPLE);
+         return false;
+     }
+ 
+     // The fraction of the mean is kept by interpolating between calibrated codes
+     uint32_t raw = sum / count;
+     uint32_t low = esp_adc_cal_raw_to_voltage(raw, &_characteristics);
+     uint32_t high = esp_adc_cal_raw_to_voltage(raw + 1, &_characteristics);
+     millivolts = low + (high - low) * (sum % count) / count;
+     return true;
+ }
+ 
+ // Average one-shot conversions when continuous mode is unavailable
+ bool BatterySensor::readOneShot(uint32_t& millivolts) {
+     // analogReadMilliVolts() applies the same eFuse calibration
+     uint32_t sum = 0;
+     for (int i = 0; i < ONESHOT_SAMPLES; i++) {
+         sum += analogReadMilliVolts(TDECK_BATTERY_ADC);
+     }
+     millivolts = sum / ONESHOT_SAMPLES;
+     return millivolts > 0;
+ }
\ No newline at end of file
@@ -0,0 +1,92 @@
+/**
+ * @file battery_sensor.h
+ * @brief Calibrated battery voltage sampling for T-Deck hardware
+ *
+ * One service owns the battery ADC pin. Every period it runs a short burst
+ * of ADC continuous (DMA) conversions, averages them, converts the mean with
+ * the eFuse calibration and smooths successive bursts. BatteryManager and
+ * Power both read the published voltage instead of sampling the pin
+ * themselves. The ADC only runs during a burst, so it does not hold the APB
+ * clock between samples.
+ */
+
+ #ifndef TDECK_BATTERY_SENSOR_H
+ #define TDECK_BATTERY_SENSOR_H
+ 
+ #include <Arduino.h>
+ #include <esp_adc_cal.h>
+ #include "../config.h"
+ 
+ /**
+  * @class BatterySensor
+  * @brief Samples the battery divider and publishes one filtered voltage
+  */
+ class BatterySensor {
+ public:
+     /**
+      * @brief Constructor
+      */
+     BatterySensor();
+ 
+     /**
+      * @brief Set up the ADC and take the first reading
+      * @return true if the battery pin can be sampled
+      */
+     bool begin();
+ 
+     /**
+      * @brief Take one burst of conversions and fold it into the filter
+      * @return UINT32_MAX, for use as a scheduler service
+      */
+     uint32_t sample();
+ 
+     /**
+      * @brief Check if at least one reading has been taken
+      */
+     bool isAvailable() const;
+ 
+     /**
+      * @brief Check if the readings use the eFuse calibration
+      */
+     bool isCalibrated() const;
+ 
+     /**
+      * @brief Get the filtered battery voltage
+      * @return Voltage in volts, 0 before the first reading
+      */
+     float getVoltage() const;
+ 
+     /**
+      * @brief Get the charge left for a resting LiPo cell voltage
+      * @param voltage Battery voltage in volts
+      * @return Charge in percent (0-100)
+      */
+     static uint8_t voltageToPercentage(float voltage);
+ 
+ private:
+     esp_adc_cal_characteristics_t _characteristics;
+     int8_t _channel;               // Channel within the unit, -1 if the pin has no ADC
+     uint8_t _unit;                 // 0 for ADC1, 1 for ADC2
+     bool _continuous;              // DMA bursts, otherwise one-shot reads
+     bool _calibrated;
+     volatile float _voltage;       // Published filtered voltage
+ 
+     /**
+      * @brief Average a burst of DMA conversions
+      * @param millivolts Calibrated mean pin voltage
+      * @return true if enough conversions were read
+      */
+     bool readBurst(uint32_t& millivolts);
+ 
+     /**
+      * @brief Average one-shot conversions when continuous mode is unavailable
+      * @param millivolts Calibrated mean pin voltage
+      * @return true if the pin was read
+      */
+     bool readOneShot(uint32_t& millivolts);
+ };
+ 
+ // Global instance
+ extern BatterySensor batterySensor;
+ 
+ #endif // TDECK_BATTERY_SENSOR_H
\ No newline at end of file
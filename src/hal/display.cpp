@@ -4,24 +4,48 @@
  */
 
  #include "display.h"
+ #include "spi_bus.h"
+ #include "power.h"
+ #include <esp_heap_caps.h>
+ #include "../ui/frame_stats.h"
 
  // Global display instance
  Display display;
  
  Display::Display() : 
      _backlight_level(TDECK_DISPLAY_BL_MAX),
-     _is_on(false)
+     _is_on(false),
+     _draw_buf1(nullptr),
+     _draw_buf2(nullptr),
+     _dma_enabled(false),
+     _flush_drv(nullptr)
  {
  }
  
  bool Display::init() {
      TDECK_LOG_I("Initializing display");
      
-     // Initialize TFT
+     // Initialize TFT, reset and setup are one burst on the shared bus
+     spiBus.acquire(SPI_BUS_DISPLAY);
      _tft.init();
      _tft.setRotation(1); // Landscape mode
      _tft.fillScreen(TFT_BLACK);
      
+     // LVGL renders RGB565 in native byte order, the panel expects it swapped
+     _tft.setSwapBytes(true);
+     
+     // Enable SPI DMA for asynchronous flushing
+     if (TDECK_DISPLAY_FLUSH_DMA) {
+         _dma_enabled = _tft.initDMA();
+         if (!_dma_enabled) {
+             TDECK_LOG_W("Display DMA unavailable, using blocking flush");
+         }
+     }
+     spiBus.release(SPI_BUS_DISPLAY);
+     
+     // A DMA flush holds the bus until it completes
+     spiBus.setFinisher(SPI_BUS_DISPLAY, _finish_flush);
+     
      // Initialize backlight control
      if (!_init_backlight()) {
          TDECK_LOG_E("Failed to initialize backlight");
@@ -86,7 +110,66 @@
      lv_task_handler();
  }
  
+ bool Display::initDrawBuffers(lv_disp_draw_buf_t *draw_buf) {
+     const uint32_t buf_pixels = TDECK_DISPLAY_WIDTH * TDECK_DISPLAY_BUF_LINES;
+     const size_t buf_bytes = buf_pixels * sizeof(lv_color_t);
+     const uint32_t caps = MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL;
+     
+     _draw_buf1 = (lv_color_t*)heap_caps_malloc(buf_bytes, caps);
+     if (!_draw_buf1) {
+         TDECK_LOG_E("Failed to allocate display draw buffer (%u bytes)", buf_bytes);
+         return false;
+     }
+     
+     // A second buffer only helps when the flush does not block
+     if (_dma_enabled) {
+         _draw_buf2 = (lv_color_t*)heap_caps_malloc(buf_bytes, caps);
+         if (!_draw_buf2) {
+             TDECK_LOG_W("Failed to allocate second draw buffer, rendering will wait on DMA");
+         }
+     }
+     
+     lv_disp_draw_buf_init(draw_buf, _draw_buf1, _draw_buf2, buf_pixels);
+     
+     TDECK_LOG_I("Display draw buffers: %d x %u bytes, %s flush", 
+                 _draw_buf2 ? 2 : 1, buf_bytes, _dma_enabled ? "DMA" : "blocking");
+     return true;
+ }
+ 
+ void Display::pollFlush() {
+     _complete_flush(false);
+ }
+ 
+ bool Display::isFlushPending() const {
+     return _flush_drv != nullptr;
+ }
+ 
+ void Display::_complete_flush(bool wait) {
+     if (!_flush_drv) {
+         return;
+     }
+     
+     if (!wait && _tft.dmaBusy()) {
+         return;
+     }
+     
+     // Wait for the transfer and release the SPI bus
+     _tft.dmaWait();
+     _tft.endWrite();
+     spiBus.release(SPI_BUS_DISPLAY);
+     Power::unlock(PowerLock::DISPLAY);
+     
+     lv_disp_drv_t *drv = _flush_drv;
+     _flush_drv = nullptr;
+     frameStats.endFlushTransfer();
+     lv_disp_flush_ready(drv);
+ }
+ 
  void Display::sleep() {
+     // Let any in-flight frame finish before touching the panel
+     _complete_flush(true);
+     SPIBusLock bus(SPI_BUS_DISPLAY);
+     
      // Save current state
      bool was_on = _is_on;
      
@@ -102,7 +185,9 @@
  
  void Display::wakeup() {
      // Wake up the display
+     spiBus.acquire(SPI_BUS_DISPLAY);
      _tft.writecommand(0x11); // Exit sleep mode
+     spiBus.release(SPI_BUS_DISPLAY);
      delay(120); // Mandatory delay after sleep out command
      
      // Restore previous state
@@ -116,12 +201,48 @@
      uint32_t w = (area->x2 - area->x1 + 1);
      uint32_t h = (area->y2 - area->y1 + 1);
      
+     if (display._dma_enabled) {
+         // Previous transfer must be done before the next one is queued
+         display._complete_flush(true);
+         frameStats.beginFlush(w * h);
+         
+         // Start the transfer and return; LVGL keeps rendering into the other buffer.
+         // The bus and the clock stay taken until _complete_flush() sees the transfer done.
+         Power::lock(PowerLock::DISPLAY);
+         spiBus.acquire(SPI_BUS_DISPLAY);
+         display._tft.startWrite();
+         display._tft.pushImageDMA(area->x1, area->y1, w, h, (uint16_t*)color_p);
+         display._flush_drv = disp_drv;
+         frameStats.endFlushCall();
+         return;
+     }
+     
+     frameStats.beginFlush(w * h);
+     
+     // Window and pixels go out as one burst, chip select drops once
+     spiBus.acquire(SPI_BUS_DISPLAY);
+     display.getTft().startWrite();
+     
      // Set the active window
      display.getTft().setAddrWindow(area->x1, area->y1, w, h);
      
      // Push colors to display
      display.getTft().pushColors((uint16_t*)color_p, w * h);
+     display.getTft().endWrite();
+     spiBus.release(SPI_BUS_DISPLAY);
+     frameStats.endFlushCall();
+     frameStats.endFlushTransfer();
      
      // Indicate to LVGL that the flush is done
      lv_disp_flush_ready(disp_drv);
+ }
+ 
+ // Static callback LVGL spins on while a buffer is still being transmitted
+ void Display::wait_cb(lv_disp_drv_t *disp_drv) {
+     display._complete_flush(false);
+ }
+ 
+ // SPI bus finisher for a flush left open by the task that now needs the bus
+ void Display::_finish_flush() {
+     display._complete_flush(true);
  }
\ No newline at end of file
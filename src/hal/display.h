@@ -99,6 +99,43 @@
       */
      static void flush_cb(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p);
  
+     /**
+      * @brief Static callback LVGL calls while waiting for a flush to finish
+      * 
+      * Completes the pending DMA flush once the SPI transfer is done so LVGL
+      * can reuse the buffer.
+      * 
+      * @param disp_drv Display driver
+      */
+     static void wait_cb(lv_disp_drv_t *disp_drv);
+ 
+     /**
+      * @brief Allocate the LVGL draw buffers and initialize the draw buffer descriptor
+      * 
+      * With TDECK_DISPLAY_FLUSH_DMA enabled two DMA-capable buffers of
+      * TDECK_DISPLAY_BUF_LINES lines are allocated from internal RAM so LVGL
+      * can render into one while the other is being transmitted.
+      * 
+      * @param draw_buf LVGL draw buffer descriptor to initialize
+      * @return true if at least one buffer was allocated
+      * @return false if allocation failed
+      */
+     bool initDrawBuffers(lv_disp_draw_buf_t *draw_buf);
+ 
+     /**
+      * @brief Complete a pending DMA flush if the transfer has finished
+      * 
+      * Should be called regularly from the UI task
+      */
+     void pollFlush();
+ 
+     /**
+      * @brief Check if a DMA flush is still waiting to be handed back to LVGL
+      * 
+      * @return true if a flush is in flight
+      */
+     bool isFlushPending() const;
+ 
  private:
      // TFT driver instance
      TFT_eSPI _tft;
@@ -109,8 +146,22 @@
      // Display state
      bool _is_on;
      
+     // LVGL draw buffers (internal, DMA-capable RAM)
+     lv_color_t *_draw_buf1;
+     lv_color_t *_draw_buf2;
+     
+     // DMA flush state
+     bool _dma_enabled;
+     lv_disp_drv_t *_flush_drv;  // Driver waiting for lv_disp_flush_ready, nullptr if idle
+     
      // Initialize backlight control
      bool _init_backlight();
+     
+     // Finish the in-flight DMA flush and notify LVGL
+     void _complete_flush(bool wait);
+     
+     // SPI bus finisher, ends the flush when the UI task needs the bus for the SD card
+     static void _finish_flush();
  };
  
  // Global display instance
@@ -4,22 +4,31 @@
  */
 
  #include "keyboard.h"
+ #include "power.h"
 
  // Global keyboard instance
  TDeckKeyboard keyboard;
  
  TDeckKeyboard::TDeckKeyboard() : 
      _callback_count(0),
-     _last_interrupt_time(0),
-     _interrupt_triggered(false)
+     _interrupt_triggered(false),
+     _notify_task(NULL),
+     _notify_bits(0),
+     _reader_task(NULL),
+     _event_head(0),
+     _event_tail(0),
+     _lv_head(0),
+     _lv_tail(0),
+     _dropped_events(0)
  {
      // Initialize callbacks array
      for (uint8_t i = 0; i < MAX_CALLBACKS; i++) {
          _callbacks[i] = nullptr;
      }
      
-     // Initialize key states
-     memset(_key_states, 0, sizeof(_key_states));
+     // Initialize key states (active low, all released)
+     memset(_key_states, 0xFF, sizeof(_key_states));
+     memset(_key_change_time, 0, sizeof(_key_change_time));
  }
  
  bool TDeckKeyboard::init() {
@@ -38,8 +47,18 @@
          return false;
      }
      
-     // Attach interrupt handler
+     // Start the reader before the interrupt so the ISR always has a task to wake
+     if (xTaskCreatePinnedToCore(_reader_task_func, "Key_Reader", 2048, this,
+                                 TDECK_UI_TASK_PRIORITY + 1, &_reader_task, 1) != pdPASS) {
+         TDECK_LOG_E("Failed to create keyboard reader task, reading from UI task");
+         _reader_task = NULL;
+     }
+     
+     // Attach interrupt handler, a key press also wakes the chip from light sleep.
+     // As a wake source the line is level triggered, _keyboard_isr() disarms it
+     // and whoever scans the matrix rearms it, so each press wakes the chip once
      attachInterruptArg(_int_pin, _keyboard_isr, this, FALLING);
+     Power::addWakeSource((gpio_num_t)_int_pin, LOW);
      
      TDECK_LOG_I("Keyboard initialized successfully");
      return true;
@@ -48,11 +67,55 @@
  void IRAM_ATTR TDeckKeyboard::_keyboard_isr(void* arg) {
      TDeckKeyboard* keyboard = static_cast<TDeckKeyboard*>(arg);
      
+     // Level triggered, stays quiet until the matrix has been scanned
+     Power::disarmWakeFromISR((gpio_num_t)keyboard->_int_pin);
+     
      // Set interrupt flag
      keyboard->_interrupt_triggered = true;
+     
+     // Wake the reader task, or the task that services the keyboard
+     BaseType_t woken = pdFALSE;
+     if (keyboard->_reader_task) {
+         vTaskNotifyGiveFromISR(keyboard->_reader_task, &woken);
+     } else if (keyboard->_notify_task) {
+         xTaskNotifyFromISR(keyboard->_notify_task, keyboard->_notify_bits, eSetBits, &woken);
+     }
+     portYIELD_FROM_ISR(woken);
  }
  
- bool TDeckKeyboard::_read_key_states() {
+ void TDeckKeyboard::_reader_task_func(void* arg) {
+     TDeckKeyboard* keyboard = static_cast<TDeckKeyboard*>(arg);
+     bool bouncing = false;
+     
+     while (1) {
+         // Sleep until the next interrupt, or rescan once a bouncing key has settled
+         TickType_t timeout = bouncing ? pdMS_TO_TICKS(TDECK_KEYBOARD_DEBOUNCE_MS) : portMAX_DELAY;
+         ulTaskNotifyTake(pdTRUE, timeout);
+         
+         // Rearm before reading, a pulse during the scan then wakes us again
+         keyboard->_interrupt_triggered = false;
+         Power::rearmWake((gpio_num_t)keyboard->_int_pin, LOW);
+         uint16_t head = keyboard->_event_head;
+         bouncing = keyboard->_scan();
+         
+         // Let the UI task deliver the new events
+         if (keyboard->_notify_task && keyboard->_event_head != head) {
+             xTaskNotify(keyboard->_notify_task, keyboard->_notify_bits, eSetBits);
+         }
+     }
+ }
+ 
+ bool TDeckKeyboard::_scan() {
+     uint8_t raw_states[8];
+     
+     if (!_read_key_states(raw_states)) {
+         return false;
+     }
+     
+     return _process_key_changes(raw_states);
+ }
+ 
+ bool TDeckKeyboard::_read_key_states(uint8_t* states) {
      // Request 8 bytes of data from the keyboard controller
      _wire.requestFrom(_address, (uint8_t)8);
      
@@ -63,16 +126,19 @@
      
      // Read the key state bytes
      for (uint8_t i = 0; i < 8; i++) {
-         _key_states[i] = _wire.read();
+         states[i] = _wire.read();
      }
      
      return true;
  }
  
- void TDeckKeyboard::_process_key_changes(const uint8_t* old_states) {
+ bool TDeckKeyboard::_process_key_changes(const uint8_t* raw_states) {
+     uint32_t now = millis();
+     bool bouncing = false;
+     
      // Check each bit to see which keys changed state
      for (uint8_t byte_idx = 0; byte_idx < 8; byte_idx++) {
-         uint8_t changes = old_states[byte_idx] ^ _key_states[byte_idx];
+         uint8_t changes = raw_states[byte_idx] ^ _key_states[byte_idx];
          
          if (changes == 0) {
              continue; // No changes in this byte
@@ -80,50 +146,89 @@
          
          // Check each bit in the changed byte
          for (uint8_t bit_idx = 0; bit_idx < 8; bit_idx++) {
-             if (changes & (1 << bit_idx)) {
-                 // Calculate key position
-                 uint8_t key_pos = byte_idx * 8 + bit_idx;
-                 
-                 // Determine if key is now pressed or released
-                 bool pressed = (_key_states[byte_idx] & (1 << bit_idx)) == 0; // Key is active low
-                 
-                 // Map key position to actual key code
-                 uint8_t key_code = _map_key_code(byte_idx, bit_idx);
-                 
-                 // Notify all registered callbacks
-                 for (uint8_t i = 0; i < _callback_count; i++) {
-                     if (_callbacks[i]) {
-                         _callbacks[i](key_code, pressed);
-                     }
-                 }
+             if (!(changes & (1 << bit_idx))) {
+                 continue;
+             }
+             
+             // Calculate key position
+             uint8_t key_pos = byte_idx * 8 + bit_idx;
+             
+             // Ignore changes inside this key's debounce window, rescan later
+             if (now - _key_change_time[key_pos] < TDECK_KEYBOARD_DEBOUNCE_MS) {
+                 bouncing = true;
+                 continue;
              }
+             _key_change_time[key_pos] = now;
+             
+             // Accept the new state
+             _key_states[byte_idx] ^= (1 << bit_idx);
+             
+             // Determine if key is now pressed or released
+             bool pressed = (_key_states[byte_idx] & (1 << bit_idx)) == 0; // Key is active low
+             
+             // Map key position to actual key code and queue the event
+             TDeckKeyEvent event = {_map_key_code(byte_idx, bit_idx), pressed, now};
+             _push_event(event);
          }
      }
+     
+     return bouncing;
  }
  
- void TDeckKeyboard::update() {
-     if (!_interrupt_triggered) {
-         return; // No key state change
-     }
-     
-     // Reset interrupt flag
-     _interrupt_triggered = false;
+ void TDeckKeyboard::_push_event(const TDeckKeyEvent& event) {
+     uint16_t next = (_event_head + 1) & (TDECK_KEYBOARD_QUEUE_SIZE - 1);
      
-     // Debounce
-     unsigned long current_time = millis();
-     if (current_time - _last_interrupt_time < 20) { // 20ms debounce time
+     // Drop the event rather than overwrite one the consumer may be reading
+     if (next == _event_tail) {
+         _dropped_events++;
          return;
      }
-     _last_interrupt_time = current_time;
      
-     // Save old key states for change detection
-     uint8_t old_states[8];
-     memcpy(old_states, _key_states, sizeof(_key_states));
+     _event_queue[_event_head] = event;
+     __sync_synchronize();
+     _event_head = next;
+ }
+ 
+ bool TDeckKeyboard::_pop_event(TDeckKeyEvent& event) {
+     if (_event_tail == _event_head) {
+         return false;
+     }
+     
+     event = _event_queue[_event_tail];
+     __sync_synchronize();
+     _event_tail = (_event_tail + 1) & (TDECK_KEYBOARD_QUEUE_SIZE - 1);
+     return true;
+ }
+ 
+ void TDeckKeyboard::update() {
+     // Without a reader task the matrix is read here after an interrupt
+     if (!_reader_task && _interrupt_triggered) {
+         _interrupt_triggered = false;
+         Power::rearmWake((gpio_num_t)_int_pin, LOW);
+         
+         // Keep scanning on later passes until bouncing keys settle
+         if (_scan()) {
+             _interrupt_triggered = true;
+         }
+     }
      
-     // Read current key states
-     if (_read_key_states()) {
-         // Process key changes
-         _process_key_changes(old_states);
+     TDeckKeyEvent event;
+     while (_pop_event(event)) {
+         // Notify all registered callbacks
+         for (uint8_t i = 0; i < _callback_count; i++) {
+             if (_callbacks[i]) {
+                 _callbacks[i](event.key, event.pressed);
+             }
+         }
+         
+         // Keep the event for LVGL so typeahead is not lost
+         uint16_t next = (_lv_head + 1) & (TDECK_KEYBOARD_QUEUE_SIZE - 1);
+         if (next == _lv_tail) {
+             _dropped_events++;
+             continue;
+         }
+         _lv_queue[_lv_head] = event;
+         _lv_head = next;
      }
  }
  
@@ -142,6 +247,25 @@
      return false;
  }
  
+ bool TDeckKeyboard::isAnyKeyPressed() const {
+     for (uint8_t byte_idx = 0; byte_idx < 8; byte_idx++) {
+         if (_key_states[byte_idx] != 0xFF) {
+             return true; // At least one active low bit
+         }
+     }
+     
+     return false;
+ }
+ 
+ void TDeckKeyboard::setNotifyTask(TaskHandle_t task, uint32_t bits) {
+     _notify_bits = bits;
+     _notify_task = task;
+ }
+ 
+ uint32_t TDeckKeyboard::getDroppedEvents() const {
+     return _dropped_events;
+ }
+ 
  bool TDeckKeyboard::registerCallback(KeyEventCallback callback) {
      if (_callback_count >= MAX_CALLBACKS) {
          TDECK_LOG_E("Maximum number of keyboard callbacks reached");
@@ -171,38 +295,46 @@
  
  // Static callback function for LVGL keyboard input reading
  void TDeckKeyboard::read_cb(lv_indev_drv_t* indev_drv, lv_indev_data_t* data) {
-     // Default to no key pressed
-     data->key = 0;
-     data->state = LV_INDEV_STATE_RELEASED;
-     
-     // Check for arrow key presses for navigation
-     if (keyboard.isKeyPressed(TDECK_KEY_UP)) {
-         data->key = LV_KEY_UP;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_DOWN)) {
-         data->key = LV_KEY_DOWN;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_LEFT)) {
-         data->key = LV_KEY_LEFT;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_RIGHT)) {
-         data->key = LV_KEY_RIGHT;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_ENTER)) {
-         data->key = LV_KEY_ENTER;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_ESC)) {
-         data->key = LV_KEY_ESC;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_BACKSPACE)) {
-         data->key = LV_KEY_BACKSPACE;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_HOME)) {
-         data->key = LV_KEY_HOME;
-         data->state = LV_INDEV_STATE_PRESSED;
-     } else if (keyboard.isKeyPressed(TDECK_KEY_END)) {
-         data->key = LV_KEY_END;
-         data->state = LV_INDEV_STATE_PRESSED;
+     static uint32_t last_key = 0;
+     static bool last_pressed = false;
+     
+     // Default to the last reported key, still held until its release is queued
+     data->key = last_key;
+     data->state = last_pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+     
+     // Replay queued events in order, one per read
+     while (keyboard._lv_tail != keyboard._lv_head) {
+         TDeckKeyEvent event = keyboard._lv_queue[keyboard._lv_tail];
+         keyboard._lv_tail = (keyboard._lv_tail + 1) & (TDECK_KEYBOARD_QUEUE_SIZE - 1);
+         
+         // Map navigation keys, pass printable characters through
+         uint32_t key;
+         switch (event.key) {
+             case TDECK_KEY_UP:        key = LV_KEY_UP; break;
+             case TDECK_KEY_DOWN:      key = LV_KEY_DOWN; break;
+             case TDECK_KEY_LEFT:      key = LV_KEY_LEFT; break;
+             case TDECK_KEY_RIGHT:     key = LV_KEY_RIGHT; break;
+             case TDECK_KEY_ENTER:     key = LV_KEY_ENTER; break;
+             case TDECK_KEY_ESC:       key = LV_KEY_ESC; break;
+             case TDECK_KEY_BACKSPACE: key = LV_KEY_BACKSPACE; break;
+             case TDECK_KEY_HOME:      key = LV_KEY_HOME; break;
+             case TDECK_KEY_END:       key = LV_KEY_END; break;
+             default:
+                 key = (event.key >= 32 && event.key < 127) ? event.key : 0;
+                 break;
+         }
+         
+         // Modifiers and unmapped keys are only seen by the callbacks
+         if (key == 0) {
+             continue;
+         }
+         
+         last_key = key;
+         last_pressed = event.pressed;
+         data->key = key;
+         data->state = event.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+         data->continue_reading = keyboard._lv_tail != keyboard._lv_head;
+         return;
      }
  }
  
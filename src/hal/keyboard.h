@@ -17,6 +17,15 @@
  // Key event callback type
  typedef void (*KeyEventCallback)(uint8_t key, bool pressed);
  
+ /**
+  * @brief Timestamped key press or release
+  */
+ struct TDeckKeyEvent {
+     uint8_t key;        // Mapped key code
+     bool pressed;       // true on press, false on release
+     uint32_t timestamp; // millis() when the change was read
+ };
+ 
  /**
   * @brief Key codes for special keys
   */
@@ -61,7 +70,7 @@
      bool init();
  
      /**
-      * @brief Update the keyboard state (should be called regularly from the main loop)
+      * @brief Deliver queued key events to the callbacks (should be called regularly from the UI task)
       */
      void update();
  
@@ -74,6 +83,29 @@
       */
      bool isKeyPressed(uint8_t key) const;
  
+     /**
+      * @brief Check if any key is currently held down
+      * 
+      * @return true if at least one key is pressed
+      * @return false if all keys are released
+      */
+     bool isAnyKeyPressed() const;
+ 
+     /**
+      * @brief Set the task to notify from the keyboard interrupt
+      * 
+      * @param task Task handle to notify, or NULL to disable notifications
+      * @param bits Notification bits set on the task
+      */
+     void setNotifyTask(TaskHandle_t task, uint32_t bits);
+ 
+     /**
+      * @brief Get the number of key events lost because a queue was full
+      * 
+      * @return uint32_t dropped event count
+      */
+     uint32_t getDroppedEvents() const;
+ 
      /**
       * @brief Register a callback for key events
       * 
@@ -122,20 +154,52 @@
      KeyEventCallback _callbacks[MAX_CALLBACKS];
      uint8_t _callback_count;
      
-     // Last interrupt time for debouncing
-     unsigned long _last_interrupt_time;
+     // Time of the last accepted change per key, for debouncing
+     uint32_t _key_change_time[64];
      
      // Flag indicating if an interrupt was triggered
      volatile bool _interrupt_triggered;
      
+     // Task woken by the interrupt handler
+     TaskHandle_t _notify_task;
+     uint32_t _notify_bits;
+     
+     // Reader task doing the I2C reads, NULL when reading from update()
+     TaskHandle_t _reader_task;
+     
+     // Single producer/single consumer queue from the reader to update()
+     TDeckKeyEvent _event_queue[TDECK_KEYBOARD_QUEUE_SIZE];
+     volatile uint16_t _event_head;
+     volatile uint16_t _event_tail;
+     
+     // Events waiting for read_cb, only touched by the UI task
+     TDeckKeyEvent _lv_queue[TDECK_KEYBOARD_QUEUE_SIZE];
+     uint16_t _lv_head;
+     uint16_t _lv_tail;
+     
+     // Events lost to a full queue
+     uint32_t _dropped_events;
+     
      // Interrupt service routine
      static void IRAM_ATTR _keyboard_isr(void* arg);
      
-     // Read key states from the keyboard controller
-     bool _read_key_states();
+     // Reader task, sleeps until the keyboard interrupt fires
+     static void _reader_task_func(void* arg);
+     
+     // Read the matrix and queue debounced changes, returns true if a change is still bouncing
+     bool _scan();
+     
+     // Read raw key states from the keyboard controller
+     bool _read_key_states(uint8_t* states);
+     
+     // Debounce raw states against the accepted states and queue the changes
+     bool _process_key_changes(const uint8_t* raw_states);
+     
+     // Append an event to the reader queue
+     void _push_event(const TDeckKeyEvent& event);
      
-     // Process key changes
-     void _process_key_changes(const uint8_t* old_states);
+     // Take the oldest event from the reader queue
+     bool _pop_event(TDeckKeyEvent& event);
      
      // Get key status at specific position
      bool _get_key_state(uint8_t key) const;
@@ -6,6 +6,8 @@
  */
 
  #include "lora.h"
+ #include "sx127x.h"
+ #include "spi_bus.h"
 
  // Create global LoRa module instance
  LoRaModule lora;
@@ -19,17 +21,19 @@
      _syncWord(TDECK_LORA_SYNC_WORD),
      _txPower(17), // Default to 17 dBm
      _mode(LoRaMode::STANDBY),
+     _channelActive(false),
      _nodeAddress(0x01), // Default address
      _timeout(1000), // Default timeout 1 second
      _packetId(0)
  {
-     _spi = new SPIClass(VSPI);
+     // The radio shares its SPI host with the display and SD card
+     _spi = &spiBus.spi();
  }
  
  bool LoRaModule::begin(float frequency, int8_t sckPin, int8_t misoPin, int8_t mosiPin, 
                        int8_t csPin, int8_t resetPin, int8_t irqPin)
  {
-     // Initialize SPI for LoRa
+     // Initialize SPI for LoRa, a no-op once spiBus has started the host
      if (sckPin >= 0 && misoPin >= 0 && mosiPin >= 0) {
          _spi->begin(sckPin, misoPin, mosiPin, csPin);
      } else {
@@ -37,8 +41,8 @@
          _spi->begin();
      }
      
-     // Set SPI frequency
-     _spi->setFrequency(8000000); // 8 MHz SPI clock
+     // The radio clock is set per transaction, the shared host keeps its own
+     LoRa.setSPIFrequency(TDECK_SPI_LORA_FREQUENCY);
      
      // Initialize LoRa module
      LoRa.setSPI(*_spi);
@@ -233,12 +237,22 @@
              TDECK_LOG_I("LoRa mode set to RECEIVE");
              break;
              
-         case LoRaMode::CAD:
-             // Channel Activity Detection not directly supported in the library
-             // This would require custom implementation using low-level SPI commands
-             TDECK_LOG_E("LoRa CAD mode not implemented");
-             _mode = previousMode; // Revert to previous mode
-             return false;
+         case LoRaMode::CAD: {
+             // One detection at register level, the radio ends up in standby
+             SX127xCad result = sx127xChannelActivity(*_spi, _spreadingFactor, (long)_bandwidth);
+             _mode = LoRaMode::STANDBY;
+             
+             if (result == SX127xCad::TIMEOUT) {
+                 TDECK_LOG_E("LoRa CAD timed out");
+                 _channelActive = false;
+                 setMode(previousMode);
+                 return false;
+             }
+             
+             _channelActive = result == SX127xCad::DETECTED;
+             TDECK_LOG_I("LoRa CAD: channel %s", _channelActive ? "active" : "clear");
+             break;
+         }
      }
      
      return true;
@@ -249,6 +263,11 @@
      return _mode;
  }
  
+ bool LoRaModule::isChannelActive() const
+ {
+     return _channelActive;
+ }
+ 
  void LoRaModule::setNodeAddress(uint8_t address)
  {
      _nodeAddress = address;
@@ -314,11 +333,11 @@
      }
      
      // Set source address
-     packet.source = _nodeAddress;
+     packet.sourceId = _nodeAddress;
      
      // Set packet ID if not already set
-     if (packet.id == 0) {
-         packet.id = ++_packetId;
+     if (packet.packetId == 0) {
+         packet.packetId = ++_packetId;
      }
      
      // Calculate timeout
@@ -327,10 +346,10 @@
      // Start packet
      LoRa.beginPacket();
      
-     // Write header
-     LoRa.write(packet.destination);
-     LoRa.write(packet.source);
-     LoRa.write(packet.id);
+     // Write header, this driver uses 8-bit addresses and IDs on air
+     LoRa.write((uint8_t)packet.destId);
+     LoRa.write((uint8_t)packet.sourceId);
+     LoRa.write((uint8_t)packet.packetId);
      LoRa.write(packet.flags);
      LoRa.write(packet.length);
      
@@ -351,11 +370,11 @@
      
      // Log transmission
      TDECK_LOG_I("LoRa packet sent: ID=%d, Dst=0x%02X, Src=0x%02X, Len=%d", 
-                 packet.id, packet.destination, packet.source, packet.length);
+                 packet.packetId, packet.destId, packet.sourceId, packet.length);
      
      // Handle reliable transmission (requires ACK)
      if (packet.flags & LORA_FLAG_RELIABLE) {
-         TDECK_LOG_I("Waiting for ACK for packet ID %d", packet.id);
+         TDECK_LOG_I("Waiting for ACK for packet ID %d", packet.packetId);
          
          // Switch to receive mode to wait for ACK
          setMode(LoRaMode::RECEIVE);
@@ -368,10 +387,10 @@
                  if (receivePacket(ackPacket, 100) == LoRaStatus::OK) {
                      // Check if this is an ACK for our packet
                      if (ackPacket.flags & LORA_FLAG_ACK && 
-                         ackPacket.id == packet.id && 
-                         ackPacket.destination == _nodeAddress && 
-                         ackPacket.source == packet.destination) {
-                         TDECK_LOG_I("ACK received for packet ID %d", packet.id);
+                         ackPacket.packetId == packet.packetId && 
+                         ackPacket.destId == _nodeAddress && 
+                         ackPacket.sourceId == packet.destId) {
+                         TDECK_LOG_I("ACK received for packet ID %d", packet.packetId);
                          return LoRaStatus::OK;
                      }
                  }
@@ -380,7 +399,7 @@
          }
          
          // No ACK received
-         TDECK_LOG_W("No ACK received for packet ID %d", packet.id);
+         TDECK_LOG_W("No ACK received for packet ID %d", packet.packetId);
          return LoRaStatus::NO_ACK;
      }
      
@@ -418,9 +437,9 @@
      }
      
      // Read packet header
-     packet.destination = LoRa.read();
-     packet.source = LoRa.read();
-     packet.id = LoRa.read();
+     packet.destId = LoRa.read();
+     packet.sourceId = LoRa.read();
+     packet.packetId = LoRa.read();
      packet.flags = LoRa.read();
      packet.length = LoRa.read();
      
@@ -442,25 +461,25 @@
      
      // Log reception
      TDECK_LOG_I("LoRa packet received: ID=%d, Dst=0x%02X, Src=0x%02X, Len=%d, RSSI=%d, SNR=%.1f", 
-                 packet.id, packet.destination, packet.source, packet.length, 
+                 packet.packetId, packet.destId, packet.sourceId, packet.length, 
                  getPacketRssi(), getPacketSnr());
      
      // Check if packet is for us or broadcast
-     if (packet.destination != _nodeAddress && packet.destination != 0xFF) {
+     if (packet.destId != _nodeAddress && packet.destId != 0xFF) {
          TDECK_LOG_I("LoRa packet not for us (dest=0x%02X, our=0x%02X)", 
-                    packet.destination, _nodeAddress);
+                    packet.destId, _nodeAddress);
          return LoRaStatus::OK; // Still return OK, but caller should check destination
      }
      
      // Send ACK if required
      if (packet.flags & LORA_FLAG_RELIABLE && !(packet.flags & LORA_FLAG_ACK)) {
-         TDECK_LOG_I("Sending ACK for packet ID %d", packet.id);
+         TDECK_LOG_I("Sending ACK for packet ID %d", packet.packetId);
          
          // Prepare ACK packet
          LoRaPacket ackPacket;
-         ackPacket.destination = packet.source;
-         ackPacket.source = _nodeAddress;
-         ackPacket.id = packet.id;
+         ackPacket.destId = packet.sourceId;
+         ackPacket.sourceId = _nodeAddress;
+         ackPacket.packetId = packet.packetId;
          ackPacket.flags = LORA_FLAG_ACK;
          ackPacket.length = 0;
          
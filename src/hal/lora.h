@@ -13,16 +13,7 @@
  #include <SPI.h>
  #include <LoRa.h>
  #include "../../config.h"
- 
- // LoRa packet structure
- struct LoRaPacket {
-     uint8_t destination;     // Destination address
-     uint8_t source;          // Source address
-     uint8_t id;              // Packet ID
-     uint8_t flags;           // Packet flags
-     uint8_t length;          // Payload length
-     uint8_t payload[240];    // Payload data (max 240 bytes)
- };
+ #include "../comms/lora_packet.h"
  
  // LoRa transmission modes
  enum class LoRaMode {
@@ -33,14 +24,6 @@
      CAD                     // Channel activity detection mode
  };
  
- // LoRa packet flags
- #define LORA_FLAG_ACK       0x01    // Acknowledgment packet
- #define LORA_FLAG_RELIABLE  0x02    // Reliable transmission (requires ACK)
- #define LORA_FLAG_BROADCAST 0x04    // Broadcast packet
- #define LORA_FLAG_ENCRYPTED 0x08    // Encrypted payload
- #define LORA_FLAG_FRAGMENT  0x10    // Fragmented packet
- #define LORA_FLAG_LAST_FRAG 0x20    // Last fragment
- 
  // LoRa transmission status
  enum class LoRaStatus {
      OK,                     // Operation successful
@@ -176,6 +159,17 @@
       */
      LoRaMode getMode() const;
  
+     /**
+      * @brief Get the result of the last channel activity detection
+      * 
+      * setMode(LoRaMode::CAD) runs one detection and returns the radio to
+      * standby, this reports what it found.
+      * 
+      * @return true if a LoRa preamble was detected
+      * @return false if the channel was clear
+      */
+     bool isChannelActive() const;
+ 
      /**
       * @brief Set node address
       * 
@@ -275,6 +269,7 @@
      uint8_t _syncWord;           // Current sync word
      int _txPower;                // Current TX power
      LoRaMode _mode;              // Current operation mode
+     bool _channelActive;         // Result of the last CAD
      uint8_t _nodeAddress;        // Node address
      uint32_t _timeout;           // Transmission timeout
      uint8_t _packetId;           // Packet ID counter
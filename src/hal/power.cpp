@@ -7,10 +7,20 @@
  */
 
  #include "power.h"
+ #include "../system/config_storage.h"
+ #include "battery_sensor.h"
+ #include <hal/gpio_ll.h>
 
  // Create global power instance
  Power power;
  
+ // PM locks, shared by every Power instance
+ static esp_pm_lock_handle_t pmLocks[(int)PowerLock::COUNT] = {};
+ static const char* const pmLockNames[(int)PowerLock::COUNT] = {"display", "audio", "usb", "radio"};
+ 
+ // Cleared when the framework is built without tickless idle
+ static bool lightSleepSupported = TDECK_PM_LIGHT_SLEEP;
+ 
  Power::Power() :
      _batteryVoltage(0.0f),
      _batteryPercentage(0),
@@ -25,12 +35,6 @@
  
  bool Power::begin()
  {
-     // Configure ADC for battery voltage reading
-     analogReadResolution(12);  // 12-bit resolution for better accuracy
-     
-     // Initialize battery ADC pin
-     pinMode(TDECK_BATTERY_ADC, INPUT);
-     
      // Initialize backlight control
      ledcSetup(TDECK_DISPLAY_BL_CHANNEL, TDECK_DISPLAY_BL_FREQ, TDECK_DISPLAY_BL_RESOLUTION);
      ledcAttachPin(TDECK_DISPLAY_BL_PIN, TDECK_DISPLAY_BL_CHANNEL);
@@ -128,14 +132,14 @@
      // Handle state transition
      switch (state) {
          case PowerState::NORMAL:
-             // Restore full performance
-             setCpuFrequencyMhz(240);
+             // Restore full performance, DFS still idles the clock down
+             configureFrequency(state);
              setBacklight(_backlightLevel);
              break;
              
          case PowerState::LOW_POWER:
-             // Reduce CPU frequency and backlight to save power
-             setCpuFrequencyMhz(80);
+             // Lower the DFS range and the backlight to save power
+             configureFrequency(state);
              setBacklight(_backlightLevel / 2);
              break;
              
@@ -175,7 +179,7 @@
          esp_sleep_enable_timer_wakeup(sleepTime * 1000); // Convert to microseconds
      }
      
-     // Enter light sleep mode
+     // Enter light sleep mode, the wake sources and the timer bring it back
      esp_light_sleep_start();
      
      // Code resumes here after waking up
@@ -203,6 +207,9 @@
          esp_sleep_enable_timer_wakeup(sleepTime * 1000); // Convert to microseconds
      }
      
+     // Pending configuration changes would be lost with RAM
+     configStorage.flush();
+     
      // Enter deep sleep mode
      esp_deep_sleep_start();
      
@@ -259,50 +266,56 @@
      return esp_sleep_get_wakeup_cause();
  }
  
- float Power::readBatteryVoltage()
+ void Power::lock(PowerLock lock)
  {
-     // Read raw ADC value
-     uint32_t adcValue = 0;
-     const int samples = 10;
-     
-     // Take multiple samples for better accuracy
-     for (int i = 0; i < samples; i++) {
-         adcValue += analogRead(TDECK_BATTERY_ADC);
-         delay(5);
+     if (pmLocks[(int)lock]) {
+         esp_pm_lock_acquire(pmLocks[(int)lock]);
+     }
+ }
+ 
+ void Power::unlock(PowerLock lock)
+ {
+     if (pmLocks[(int)lock]) {
+         esp_pm_lock_release(pmLocks[(int)lock]);
+     }
+ }
+ 
+ void Power::addWakeSource(gpio_num_t pin, int activeLevel)
+ {
+     // Light sleep only wakes on levels, the ISR disarms the line until its device is serviced
+     esp_err_t err = gpio_wakeup_enable(pin, activeLevel ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+     if (err == ESP_OK) {
+         err = esp_sleep_enable_gpio_wakeup();
+     }
+     if (err != ESP_OK) {
+         TDECK_LOG_E("Failed to set pin %d as light sleep wake source", pin);
+         return;
      }
-     adcValue /= samples;
-     
-     // Convert ADC reading to voltage
-     // ESP32-S3 ADC has 12-bit resolution (0-4095)
-     // ADC is typically configured with an input divider circuit
-     // The actual conversion factor depends on the specific hardware
-     
-     // Typically, T-Deck has a voltage divider to measure battery voltage
-     // These values may need adjustment based on specific hardware
-     const float conversionFactor = 2.0f * 3.3f / 4095.0f;
-     float voltage = adcValue * conversionFactor;
-     
-     // Optional: Apply any calibration factors
-     // voltage = voltage * calibrationFactor;
      
-     return voltage;
+     TDECK_LOG_I("Set pin %d as light sleep wake source", pin);
+ }
+ 
+ void IRAM_ATTR Power::disarmWakeFromISR(gpio_num_t pin)
+ {
+     // gpio_set_intr_type() is not in IRAM, the register write is
+     gpio_ll_set_intr_type(&GPIO, pin, GPIO_INTR_DISABLE);
+ }
+ 
+ void Power::rearmWake(gpio_num_t pin, int activeLevel)
+ {
+     gpio_set_intr_type(pin, activeLevel ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+ }
+ 
+ float Power::readBatteryVoltage()
+ {
+     // The battery sensor service samples the ADC for every reader
+     return batterySensor.getVoltage();
  }
  
  uint8_t Power::voltageToPercentage(float voltage)
  {
-     // Convert battery voltage to percentage
-     // LiPo battery discharge curve is non-linear, but we can approximate
-     
-     // Clamp voltage to valid range
-     voltage = constrain(voltage, TDECK_BATTERY_MIN_VOLTAGE, TDECK_BATTERY_MAX_VOLTAGE);
-     
-     // Linear mapping from voltage to percentage
-     uint8_t percentage = map(voltage * 100, 
-                              TDECK_BATTERY_MIN_VOLTAGE * 100, 
-                              TDECK_BATTERY_MAX_VOLTAGE * 100, 
-                              0, 100);
-     
-     return percentage;
+     // LiPo discharge curve, the cell voltage is far from linear in charge
+     return BatterySensor::voltageToPercentage(voltage);
  }
  
  bool Power::checkCharging()
@@ -373,16 +386,42 @@
  
  void Power::initPowerManagement()
  {
-     // Configure ESP32 power management
+     // Locks may be taken from tasks that start before begin(), create them once
+     for (int i = 0; i < (int)PowerLock::COUNT; i++) {
+         if (!pmLocks[i] && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, pmLockNames[i], &pmLocks[i]) != ESP_OK) {
+             TDECK_LOG_E("Failed to create %s PM lock", pmLockNames[i]);
+             pmLocks[i] = nullptr;
+         }
+     }
+     
+     configureFrequency(_powerState);
+ }
+ 
+ bool Power::configureFrequency(PowerState state)
+ {
+     // DFS clocks down between bursts, light sleep covers the gaps between ticks
+     bool low = state == PowerState::LOW_POWER;
      esp_pm_config_esp32s3_t pmConfig = {
-         .max_freq_mhz = 240,
-         .min_freq_mhz = 80,
-         .light_sleep_enable = true
+         .max_freq_mhz = low ? TDECK_PM_LOW_POWER_MAX_MHZ : TDECK_PM_MAX_MHZ,
+         .min_freq_mhz = low ? TDECK_PM_LOW_POWER_MIN_MHZ : TDECK_PM_MIN_MHZ,
+         .light_sleep_enable = lightSleepSupported
      };
      
-     // Apply power management configuration
      esp_err_t err = esp_pm_configure(&pmConfig);
+     if (err == ESP_ERR_NOT_SUPPORTED && pmConfig.light_sleep_enable) {
+         // Automatic light sleep needs CONFIG_FREERTOS_USE_TICKLESS_IDLE, keep DFS alone
+         TDECK_LOG_W("Automatic light sleep not supported by this build");
+         lightSleepSupported = false;
+         pmConfig.light_sleep_enable = false;
+         err = esp_pm_configure(&pmConfig);
+     }
+     
      if (err != ESP_OK) {
-         TDECK_LOG_E("Failed to configure power management");
+         TDECK_LOG_E("Failed to configure power management: %d", err);
+         return false;
      }
+     
+     TDECK_LOG_I("CPU clock %d-%d MHz, light sleep %s", pmConfig.min_freq_mhz, pmConfig.max_freq_mhz,
+                 pmConfig.light_sleep_enable ? "on" : "off");
+     return true;
  }
\ No newline at end of file
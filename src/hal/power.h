@@ -12,7 +12,8 @@
  #include <Arduino.h>
  #include <esp_sleep.h>
  #include <esp_pm.h>
- #include "../../config.h"
+ #include <driver/gpio.h>
+ #include "../config.h"
  
  // Power states
  enum class PowerState {
@@ -32,6 +33,15 @@
      CRITICAL        // Battery is critically low
  };
  
+ // Subsystems that hold the full CPU clock and keep automatic light sleep off
+ enum class PowerLock {
+     DISPLAY,        // Display DMA flush in flight
+     AUDIO,          // Mixer playing or microphone capturing
+     USB,            // USB host connected
+     RADIO,          // LoRa transmission on air
+     COUNT
+ };
+ 
  /**
   * @class Power
   * @brief Hardware abstraction layer for T-Deck power management
@@ -184,6 +194,60 @@
       */
      esp_sleep_wakeup_cause_t getWakeupCause();
  
+     /**
+      * @brief Hold the full CPU clock of the current power state
+      * 
+      * While any lock is held DFS stays at the top of the range and the chip
+      * does not enter automatic light sleep. Locks count, every lock() needs
+      * an unlock(). Both do nothing before begin() or without PM support.
+      * 
+      * @param lock Subsystem taking the lock
+      */
+     static void lock(PowerLock lock);
+ 
+     /**
+      * @brief Release a lock taken with lock()
+      * 
+      * @param lock Subsystem releasing the lock
+      */
+     static void unlock(PowerLock lock);
+ 
+     /**
+      * @brief Let an interrupt line wake the chip from light sleep
+      * 
+      * Call after the line's interrupt is attached. The line becomes level
+      * triggered at its active level, so its ISR must call disarmWakeFromISR()
+      * first thing and the task servicing the device rearmWake() once it has
+      * run. Never use a pin another peripheral drives, it would wake the chip
+      * on that peripheral's traffic.
+      * 
+      * @param pin GPIO pin number
+      * @param activeLevel Level the device drives when it needs attention
+      */
+     static void addWakeSource(gpio_num_t pin, int activeLevel);
+ 
+     /**
+      * @brief Stop a wake source from firing again while its line stays active
+      * 
+      * The level trigger replaces the edge type given to attachInterruptArg(),
+      * so without this the ISR would run for as long as the line is active.
+      * 
+      * @param pin GPIO pin number
+      */
+     static void IRAM_ATTR disarmWakeFromISR(gpio_num_t pin);
+ 
+     /**
+      * @brief Let a disarmed wake source fire again, from task context
+      * 
+      * A line that is still active fires at once. Devices that pulse their
+      * line rearm before reading so a pulse during the read is not lost,
+      * devices that hold it until read rearm afterwards.
+      * 
+      * @param pin GPIO pin number
+      * @param activeLevel Level passed to addWakeSource()
+      */
+     static void rearmWake(gpio_num_t pin, int activeLevel);
+ 
  private:
      float _batteryVoltage;          // Current battery voltage
      uint8_t _batteryPercentage;     // Current battery percentage
@@ -231,9 +295,17 @@
      void updateBatteryState();
      
      /**
-      * @brief Initialize ESP32 power management
+      * @brief Initialize ESP32 power management and create the PM locks
       */
      void initPowerManagement();
+     
+     /**
+      * @brief Apply the DFS range and light sleep setting of a power state
+      * 
+      * @param state NORMAL or LOW_POWER
+      * @return true if the configuration was accepted
+      */
+     bool configureFrequency(PowerState state);
  };
  
  // Global power instance
@@ -6,6 +6,7 @@
  */
 
  #include "sdcard.h"
+ #include "spi_bus.h"
 
  // Create global SD card instance
  SDCard sdcard;
@@ -14,12 +15,13 @@
      _available(false),
      _type(0)
  {
-     _spi = new SPIClass(HSPI);
+     // The card shares its SPI host with the display and LoRa radio
+     _spi = &spiBus.spi();
  }
  
  bool SDCard::begin(int8_t sckPin, int8_t misoPin, int8_t mosiPin, int8_t csPin)
  {
-     // Initialize SPI for SD card
+     // Initialize SPI for SD card, a no-op once spiBus has started the host
      if (sckPin >= 0 && misoPin >= 0 && mosiPin >= 0) {
          _spi->begin(sckPin, misoPin, mosiPin, csPin);
      } else {
@@ -27,8 +29,9 @@
          _spi->begin();
      }
      
-     // Initialize SD card
-     if (!SD.begin(csPin, *_spi)) {
+     // Initialize SD card, the driver applies its own clock on every transaction
+     SPIBusLock bus(SPI_BUS_SD);
+     if (!SD.begin(csPin, *_spi, TDECK_SPI_SD_FREQUENCY)) {
          TDECK_LOG_E("SD card initialization failed");
          _available = false;
          return false;
@@ -110,6 +113,7 @@
          return false;
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      return SD.exists(path);
  }
  
@@ -124,6 +128,7 @@
          return true;
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      return SD.mkdir(path);
  }
  
@@ -133,6 +138,7 @@
          return false;
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      return SD.remove(path);
  }
  
@@ -142,6 +148,7 @@
          return false;
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      return SD.rename(pathFrom, pathTo);
  }
  
@@ -151,6 +158,7 @@
          return File();
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      return SD.open(path, mode);
  }
  
@@ -162,6 +170,7 @@
      }
      
      TDECK_LOG_I("Listing directory: %s", dirname);
+     SPIBusLock bus(SPI_BUS_SD);
  
      File root = SD.open(dirname);
      if (!root) {
@@ -196,6 +205,7 @@
          return false;
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      File file = SD.open(path);
      if (!file) {
          return false;
@@ -217,6 +227,7 @@
          return 0;
      }
      
+     SPIBusLock bus(SPI_BUS_SD);
      File file = SD.open(path);
      if (!file) {
          return 0;
@@ -234,11 +245,9 @@
          return true;
      }
      
-     // The ESP32 SD library doesn't have a direct unmount function
-     // We'll simulate it by ending the SPI connection
-     
+     // The SPI host stays up, the display and LoRa radio still use it
+     SPIBusLock bus(SPI_BUS_SD);
      SD.end();
-     _spi->end();
      _available = false;
      
      TDECK_LOG_I("SD card unmounted");
@@ -0,0 +1,215 @@
+/**
+ * @file spi_bus.cpp
+ * @brief Implementation of the shared SPI bus arbiter
+ */
+
+ #include "spi_bus.h"
+ 
+ // Global bus instance
+ SPIBus spiBus;
+ 
+ // Constructor
+ SPIBus::SPIBus()
+     : _lock(portMUX_INITIALIZER_UNLOCKED)
+     , _owner(NULL)
+     , _ownerDevice(SPI_BUS_LORA)
+     , _depth(0)
+     , _granted(-1)
+ {
+     _settings[SPI_BUS_LORA] = SPISettings(TDECK_SPI_LORA_FREQUENCY, MSBFIRST, SPI_MODE0);
+     _settings[SPI_BUS_DISPLAY] = SPISettings(TDECK_SPI_DISPLAY_FREQUENCY, MSBFIRST, SPI_MODE0);
+     _settings[SPI_BUS_SD] = SPISettings(TDECK_SPI_SD_FREQUENCY, MSBFIRST, SPI_MODE0);
+ 
+     for (int i = 0; i < SPI_BUS_DEVICE_COUNT; i++) {
+         _wake[i] = NULL;
+         _finishers[i] = nullptr;
+         _waiting[i] = 0;
+     }
+     memset(_stats, 0, sizeof(_stats));
+ }
+ 
+ // Start the shared SPI host
+ bool SPIBus::begin() {
+     for (int i = 0; i < SPI_BUS_DEVICE_COUNT; i++) {
+         _wake[i] = xSemaphoreCreateCounting(UINT8_MAX, 0);
+         if (!_wake[i]) {
+             TDECK_LOG_E("Failed to create SPI bus lock");
+             return false;
+         }
+     }
+ 
+     // Idle chip selects high so no device reads another one's burst
+     pinMode(TDECK_SD_CS, OUTPUT);
+     digitalWrite(TDECK_SD_CS, HIGH);
+     pinMode(TDECK_LORA_CS, OUTPUT);
+     digitalWrite(TDECK_LORA_CS, HIGH);
+ 
+     SPI.begin(TDECK_SPI_SCK, TDECK_SPI_MISO, TDECK_SPI_MOSI);
+     return true;
+ }
+ 
+ // Get the shared SPI host
+ SPIClass& SPIBus::spi() {
+     return SPI;
+ }
+ 
+ // Get the clock and mode of a device
+ const SPISettings& SPIBus::settings(SPIBusDevice device) const {
+     return _settings[device];
+ }
+ 
+ // Take the bus for a burst
+ void SPIBus::acquire(SPIBusDevice device) {
+     // Before begin() only the setup task runs
+     if (!_wake[device]) {
+         return;
+     }
+ 
+     TaskHandle_t self = xTaskGetCurrentTaskHandle();
+ 
+     portENTER_CRITICAL(&_lock);
+ 
+     // Waiting on our own asynchronous burst would never end, complete it instead
+     if (_owner == self && _ownerDevice != device && _depth == 1 && _finishers[_ownerDevice]) {
+         void (*finisher)() = _finishers[_ownerDevice];
+         portEXIT_CRITICAL(&_lock);
+         finisher();
+         portENTER_CRITICAL(&_lock);
+     }
+ 
+     if (_owner == self) {
+         _depth++;
+         portEXIT_CRITICAL(&_lock);
+         return;
+     }
+ 
+     _stats[device].bursts++;
+     if (_owner == NULL && _granted < 0) {
+         _owner = self;
+         _ownerDevice = device;
+         _depth = 1;
+         portEXIT_CRITICAL(&_lock);
+         return;
+     }
+ 
+     _waiting[device]++;
+     _stats[device].contended++;
+     portEXIT_CRITICAL(&_lock);
+ 
+     uint32_t start = micros();
+     xSemaphoreTake(_wake[device], portMAX_DELAY);
+     uint32_t waited = micros() - start;
+ 
+     // The releasing task picked this device and left the bus to us
+     portENTER_CRITICAL(&_lock);
+     _owner = self;
+     _ownerDevice = device;
+     _depth = 1;
+     _granted = -1;
+     if (waited > _stats[device].maxWaitMicros) {
+         _stats[device].maxWaitMicros = waited;
+     }
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // End a burst and hand the bus on
+ void SPIBus::release(SPIBusDevice device) {
+     if (!_wake[device]) {
+         return;
+     }
+ 
+     int next = -1;
+ 
+     portENTER_CRITICAL(&_lock);
+     if (_depth > 1) {
+         _depth--;
+         portEXIT_CRITICAL(&_lock);
+         return;
+     }
+ 
+     _owner = NULL;
+     _depth = 0;
+ 
+     // Devices are numbered by urgency, the first one waiting gets the bus
+     for (int i = 0; i < SPI_BUS_DEVICE_COUNT; i++) {
+         if (_waiting[i] > 0) {
+             _waiting[i]--;
+             _granted = i;
+             next = i;
+             break;
+         }
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     if (next >= 0) {
+         xSemaphoreGive(_wake[next]);
+     }
+ }
+ 
+ // Check whether a more urgent device is waiting
+ bool SPIBus::contended(SPIBusDevice device) const {
+     bool waiting = false;
+ 
+     portENTER_CRITICAL(&_lock);
+     for (int i = 0; i < device; i++) {
+         if (_waiting[i] > 0) {
+             waiting = true;
+             break;
+         }
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     return waiting;
+ }
+ 
+ // Step aside between chunks of a long burst
+ bool SPIBus::yield(SPIBusDevice device) {
+     if (!contended(device)) {
+         return false;
+     }
+ 
+     // A nested burst cannot give the bus away from under its outer one
+     portENTER_CRITICAL(&_lock);
+     bool whole = _depth == 1;
+     if (whole) {
+         _stats[device].yields++;
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     if (!whole) {
+         return false;
+     }
+ 
+     release(device);
+     acquire(device);
+     return true;
+ }
+ 
+ // Register the function that completes a device's open burst
+ void SPIBus::setFinisher(SPIBusDevice device, void (*finisher)()) {
+     _finishers[device] = finisher;
+ }
+ 
+ // Get the bus usage of a device
+ void SPIBus::getStats(SPIBusDevice device, SPIBusStats& stats) const {
+     portENTER_CRITICAL(&_lock);
+     stats = _stats[device];
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Take the bus for the scope
+ SPIBusLock::SPIBusLock(SPIBusDevice device, bool enabled)
+     : _device(device)
+     , _enabled(enabled)
+ {
+     if (_enabled) {
+         spiBus.acquire(_device);
+     }
+ }
+ 
+ // Release the bus at the end of the scope
+ SPIBusLock::~SPIBusLock() {
+     if (_enabled) {
+         spiBus.release(_device);
+     }
+ }
\ No newline at end of file
@@ -0,0 +1,161 @@
+/**
+ * @file spi_bus.h
+ * @brief Arbiter for the SPI bus shared by the display, SD card and LoRa radio
+ *
+ * The display, the SD card and the radio sit on one SPI host. A device takes
+ * the bus for a whole burst of transactions, so chip select and clock change
+ * once per burst instead of once per register. A released bus goes to the
+ * most urgent device waiting, and bulk SD transfers step aside between
+ * chunks so the radio FIFO and display flushes are never held up for long.
+ */
+
+ #ifndef TDECK_HAL_SPI_BUS_H
+ #define TDECK_HAL_SPI_BUS_H
+ 
+ #include <Arduino.h>
+ #include <SPI.h>
+ #include "../config.h"
+ 
+ // Devices on the shared bus, most urgent first
+ enum SPIBusDevice {
+     SPI_BUS_LORA = 0,       // Radio registers and FIFO, must keep up with the air
+     SPI_BUS_DISPLAY,        // Display flushes, held while a DMA transfer runs
+     SPI_BUS_SD,             // SD card, bulk transfers yield between chunks
+     SPI_BUS_DEVICE_COUNT
+ };
+ 
+ // Bus usage of one device
+ struct SPIBusStats {
+     uint32_t bursts;        // Times the device took the bus
+     uint32_t contended;     // Times it had to wait for another device
+     uint32_t yields;        // Times a burst stepped aside for a more urgent device
+     uint32_t maxWaitMicros; // Longest wait for the bus
+ };
+ 
+ /**
+  * @class SPIBus
+  * @brief Priority-aware owner of the shared SPI host
+  *
+  * The bus is recursive for the task holding it, so a burst can be made of
+  * helpers that take the bus themselves.
+  */
+ class SPIBus {
+ public:
+     /**
+      * @brief Constructor
+      */
+     SPIBus();
+ 
+     /**
+      * @brief Start the shared SPI host on the T-Deck pins
+      *
+      * Must run before any device driver, their own SPI.begin() calls then
+      * keep these pins.
+      *
+      * @return true if the lock could be created
+      */
+     bool begin();
+ 
+     /**
+      * @brief Get the shared SPI host
+      * @return SPI host every device is driven through
+      */
+     SPIClass& spi();
+ 
+     /**
+      * @brief Get the clock and mode of a device
+      * @param device Device on the bus
+      * @return Settings for beginTransaction()
+      */
+     const SPISettings& settings(SPIBusDevice device) const;
+ 
+     /**
+      * @brief Take the bus for a burst, waiting behind more urgent devices
+      *
+      * A task already holding the bus nests. If it holds it for another
+      * device, that device's finisher completes its burst first.
+      *
+      * @param device Device starting the burst
+      */
+     void acquire(SPIBusDevice device);
+ 
+     /**
+      * @brief End a burst and hand the bus to the most urgent device waiting
+      * @param device Device ending the burst
+      */
+     void release(SPIBusDevice device);
+ 
+     /**
+      * @brief Check whether a more urgent device is waiting for the bus
+      * @param device Device holding the bus
+      * @return true if the burst should step aside
+      */
+     bool contended(SPIBusDevice device) const;
+ 
+     /**
+      * @brief Let a more urgent device run between chunks of a long burst
+      * @param device Device holding the bus
+      * @return true if the bus was handed over and taken back
+      */
+     bool yield(SPIBusDevice device);
+ 
+     /**
+      * @brief Register the function that completes a device's open burst
+      *
+      * Used for bursts that end asynchronously, like a DMA flush, when the
+      * task holding them needs the bus for another device.
+      *
+      * @param device Device with asynchronous bursts
+      * @param finisher Completes the burst and releases the bus
+      */
+     void setFinisher(SPIBusDevice device, void (*finisher)());
+ 
+     /**
+      * @brief Get the bus usage of a device
+      * @param device Device on the bus
+      * @param stats Receives the counters
+      */
+     void getStats(SPIBusDevice device, SPIBusStats& stats) const;
+ 
+ private:
+     SPISettings _settings[SPI_BUS_DEVICE_COUNT];    // Clock and mode per device
+     SemaphoreHandle_t _wake[SPI_BUS_DEVICE_COUNT];  // Counts grants to each device's waiters
+     void (*_finishers[SPI_BUS_DEVICE_COUNT])();     // Completes an asynchronous burst
+     uint8_t _waiting[SPI_BUS_DEVICE_COUNT];         // Tasks waiting per device
+     SPIBusStats _stats[SPI_BUS_DEVICE_COUNT];       // Usage counters
+     mutable portMUX_TYPE _lock;                     // Guards the ownership state
+     TaskHandle_t _owner;                            // Task holding the bus
+     SPIBusDevice _ownerDevice;                      // Device the owner is driving
+     uint8_t _depth;                                 // Nested acquisitions of the owner
+     int8_t _granted;                                // Device handed the bus whose waiter has not run yet, -1 if none
+ };
+ 
+ /**
+  * @class SPIBusLock
+  * @brief Holds the bus for the lifetime of a scope
+  */
+ class SPIBusLock {
+ public:
+     /**
+      * @brief Take the bus
+      * @param device Device starting the burst
+      * @param enabled false to skip locking, for paths that may not touch the bus
+      */
+     explicit SPIBusLock(SPIBusDevice device, bool enabled = true);
+ 
+     /**
+      * @brief Release the bus
+      */
+     ~SPIBusLock();
+ 
+ private:
+     SPIBusDevice _device;
+     bool _enabled;
+ 
+     SPIBusLock(const SPIBusLock&) = delete;
+     SPIBusLock& operator=(const SPIBusLock&) = delete;
+ };
+ 
+ extern SPIBus spiBus;
+ 
+ #endif // TDECK_HAL_SPI_BUS_H
\ No newline at end of file
@@ -0,0 +1,67 @@
+/**
+ * @file sx127x.cpp
+ * @brief Register-level SX127x helpers for LilyGO T-Deck
+ */
+
+ #include "sx127x.h"
+ 
+ uint8_t sx127xReadRegister(SPIClass& spi, uint8_t reg)
+ {
+     SPIBusLock bus(SPI_BUS_LORA);
+     spi.beginTransaction(spiBus.settings(SPI_BUS_LORA));
+     digitalWrite(TDECK_LORA_CS, LOW);
+     spi.transfer(reg & ~SX127X_REG_WRITE);
+     uint8_t value = spi.transfer(0x00);
+     digitalWrite(TDECK_LORA_CS, HIGH);
+     spi.endTransaction();
+     return value;
+ }
+ 
+ void sx127xWriteRegister(SPIClass& spi, uint8_t reg, uint8_t value)
+ {
+     SPIBusLock bus(SPI_BUS_LORA);
+     spi.beginTransaction(spiBus.settings(SPI_BUS_LORA));
+     digitalWrite(TDECK_LORA_CS, LOW);
+     spi.transfer(reg | SX127X_REG_WRITE);
+     spi.transfer(value);
+     digitalWrite(TDECK_LORA_CS, HIGH);
+     spi.endTransaction();
+ }
+ 
+ uint32_t sx127xSymbolMicros(int spreadingFactor, long bandwidth)
+ {
+     return (uint32_t)(((uint64_t)1000000 << spreadingFactor) / bandwidth);
+ }
+ 
+ SX127xCad sx127xChannelActivity(SPIClass& spi, int spreadingFactor, long bandwidth)
+ {
+     // CAD takes about two symbols, allow four plus a tick of slack
+     uint32_t timeoutMs = (4 * sx127xSymbolMicros(spreadingFactor, bandwidth)) / 1000 + 2;
+     
+     // One burst to start CAD, the bus is free again while it runs
+     spiBus.acquire(SPI_BUS_LORA);
+     sx127xWriteRegister(spi, SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_STDBY);
+     sx127xWriteRegister(spi, SX127X_REG_IRQ_FLAGS, SX127X_IRQ_CAD_DONE | SX127X_IRQ_CAD_DETECTED);
+     sx127xWriteRegister(spi, SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_CAD);
+     spiBus.release(SPI_BUS_LORA);
+     
+     uint32_t start = millis();
+     uint8_t flags = 0;
+     while (!((flags = sx127xReadRegister(spi, SX127X_REG_IRQ_FLAGS)) & SX127X_IRQ_CAD_DONE)) {
+         if (millis() - start > timeoutMs) {
+             sx127xWriteRegister(spi, SX127X_REG_OP_MODE, SX127X_MODE_LONG_RANGE | SX127X_MODE_STDBY);
+             return SX127xCad::TIMEOUT;
+         }
+         
+         // Short CADs finish within a few hundred microseconds of polling
+         if (timeoutMs > 4) {
+             vTaskDelay(1);
+         } else {
+             delayMicroseconds(100);
+         }
+     }
+     
+     // The radio drops back to standby by itself after CadDone
+     sx127xWriteRegister(spi, SX127X_REG_IRQ_FLAGS, SX127X_IRQ_CAD_DONE | SX127X_IRQ_CAD_DETECTED);
+     return (flags & SX127X_IRQ_CAD_DETECTED) ? SX127xCad::DETECTED : SX127xCad::CLEAR;
+ }
\ No newline at end of file
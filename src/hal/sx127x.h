@@ -0,0 +1,91 @@
+/**
+ * @file sx127x.h
+ * @brief Register-level access to the SX127x LoRa radio on the T-Deck
+ * 
+ * The LoRa library keeps its register helpers private and has no channel
+ * activity detection, so the few registers used for burst FIFO access and
+ * CAD are driven directly here.
+ */
+
+ #ifndef TDECK_HAL_SX127X_H
+ #define TDECK_HAL_SX127X_H
+ 
+ #include <Arduino.h>
+ #include <SPI.h>
+ #include "../config.h"
+ #include "spi_bus.h"
+ 
+ // Registers
+ #define SX127X_REG_FIFO 0x00
+ #define SX127X_REG_OP_MODE 0x01
+ #define SX127X_REG_IRQ_FLAGS 0x12
+ #define SX127X_REG_MODEM_STAT 0x18
+ #define SX127X_REG_PAYLOAD_LENGTH 0x22
+ #define SX127X_REG_WRITE 0x80
+ 
+ // Operating modes, always combined with SX127X_MODE_LONG_RANGE
+ #define SX127X_MODE_LONG_RANGE 0x80
+ #define SX127X_MODE_STDBY 0x01
+ #define SX127X_MODE_CAD 0x07
+ 
+ // IRQ flags
+ #define SX127X_IRQ_CAD_DETECTED 0x01
+ #define SX127X_IRQ_CAD_DONE 0x04
+ #define SX127X_IRQ_TX_DONE 0x08
+ #define SX127X_IRQ_RX_DONE 0x40
+ 
+ // Modem status
+ #define SX127X_MODEM_SIGNAL_DETECTED 0x01
+ 
+ // Result of a channel activity detection
+ enum class SX127xCad {
+     CLEAR,                  // No LoRa preamble on the channel
+     DETECTED,               // Preamble detected, a packet is on the air
+     TIMEOUT                 // CadDone never arrived
+ };
+ 
+ /**
+  * @brief Read a radio register
+  * 
+  * Takes the shared bus for the access, callers batching several accesses
+  * hold it around them.
+  * 
+  * @param spi SPI bus the radio is on
+  * @param reg Register address
+  * @return uint8_t Register value
+  */
+ uint8_t sx127xReadRegister(SPIClass& spi, uint8_t reg);
+ 
+ /**
+  * @brief Write a radio register
+  * 
+  * @param spi SPI bus the radio is on
+  * @param reg Register address
+  * @param value Value to write
+  */
+ void sx127xWriteRegister(SPIClass& spi, uint8_t reg, uint8_t value);
+ 
+ /**
+  * @brief Run one channel activity detection
+  * 
+  * Puts the radio through standby into CAD and polls for CadDone. The radio
+  * is left in standby. RxDone and TxDone flags are not touched, so a packet
+  * already waiting in the FIFO is not lost.
+  * 
+  * @param spi SPI bus the radio is on
+  * @param spreadingFactor Current spreading factor, sets the CAD duration
+  * @param bandwidth Current bandwidth in Hz
+  * @return SX127xCad Detection result
+  */
+ SX127xCad sx127xChannelActivity(SPIClass& spi, int spreadingFactor, long bandwidth);
+ 
+ /**
+  * @brief Get the duration of one LoRa symbol
+  * 
+  * @param spreadingFactor Spreading factor
+  * @param bandwidth Bandwidth in Hz
+  * @return uint32_t Symbol time in microseconds
+  */
+ uint32_t sx127xSymbolMicros(int spreadingFactor, long bandwidth);
+ 
+ #endif // TDECK_HAL_SX127X_H
\ No newline at end of file
@@ -6,10 +6,15 @@
  */
 
  #include "touchscreen.h"
+ #include "power.h"
 
  // Create global touchscreen instance
  TouchScreen touchScreen;
  
+ // FT6206 interrupt mode register and trigger mode value
+ #define FT6206_REG_G_MODE 0xA4
+ #define FT6206_G_MODE_TRIGGER 0x01
+ 
  TouchScreen::TouchScreen() :
      _available(false),
      _touched(false),
@@ -17,6 +22,13 @@
      _touchY(0),
      _touchPressure(0),
      _rotation(0),
+     _interruptPending(false),
+     _notifyTask(NULL),
+     _notifyBits(0),
+     _readerTask(NULL),
+     _queueHead(0),
+     _queueTail(0),
+     _droppedSamples(0),
      _minX(0),
      _maxX(TDECK_DISPLAY_WIDTH),
      _minY(0),
@@ -42,11 +54,76 @@
          return false;
      }
      
-     TDECK_LOG_I("Touchscreen initialized successfully");
      _available = true;
+     
+     // Start the reader before the interrupt so the ISR always has a task to wake
+     if (TDECK_TOUCH_IRQ_MODE) {
+         if (!enableTriggerMode()) {
+             TDECK_LOG_E("Failed to set touch trigger mode, falling back to polling");
+         } else if (xTaskCreatePinnedToCore(readerTask, "Touch_Reader", 2048, this,
+                                            TDECK_UI_TASK_PRIORITY + 1, &_readerTask, 1) != pdPASS) {
+             TDECK_LOG_E("Failed to create touch reader task, falling back to polling");
+             _readerTask = NULL;
+         }
+     }
+     
+     // The controller pulls INT low when it has new touch data. As a wake source
+     // the line is level triggered, touchISR() disarms it and whoever samples the
+     // controller rearms it, so each report wakes the chip once
+     pinMode(TDECK_TOUCH_INT, INPUT_PULLUP);
+     attachInterruptArg(TDECK_TOUCH_INT, touchISR, this, FALLING);
+     Power::addWakeSource((gpio_num_t)TDECK_TOUCH_INT, LOW);
+     
+     TDECK_LOG_I("Touchscreen initialized successfully (%s)", _readerTask ? "IRQ" : "polling");
      return true;
  }
  
+ bool TouchScreen::enableTriggerMode() {
+     _wire->beginTransmission(0x38);
+     _wire->write(FT6206_REG_G_MODE);
+     _wire->write(FT6206_G_MODE_TRIGGER);
+     return _wire->endTransmission() == 0;
+ }
+ 
+ void TouchScreen::readerTask(void* arg) {
+     TouchScreen* touch = static_cast<TouchScreen*>(arg);
+     
+     while (1) {
+         // Idle until the controller signals, resample while a finger is down
+         // in case a report or the release edge is missed
+         TickType_t timeout = touch->_touched ? pdMS_TO_TICKS(TDECK_TOUCH_SAMPLE_MS) : portMAX_DELAY;
+         ulTaskNotifyTake(pdTRUE, timeout);
+         
+         // Rearm before reading, a report during the read then wakes us again
+         touch->_interruptPending = false;
+         Power::rearmWake((gpio_num_t)TDECK_TOUCH_INT, LOW);
+         touch->sampleController();
+         
+         // Let the UI task drain the new samples
+         if (touch->_notifyTask && touch->hasSamples()) {
+             xTaskNotify(touch->_notifyTask, touch->_notifyBits, eSetBits);
+         }
+     }
+ }
+ 
+ void IRAM_ATTR TouchScreen::touchISR(void* arg) {
+     TouchScreen* touch = static_cast<TouchScreen*>(arg);
+     
+     // Level triggered, stays quiet until the controller has been sampled
+     Power::disarmWakeFromISR((gpio_num_t)TDECK_TOUCH_INT);
+     
+     touch->_interruptPending = true;
+     
+     // Wake the reader task, or the task polling the touchscreen
+     BaseType_t woken = pdFALSE;
+     if (touch->_readerTask) {
+         vTaskNotifyGiveFromISR(touch->_readerTask, &woken);
+     } else if (touch->_notifyTask) {
+         xTaskNotifyFromISR(touch->_notifyTask, touch->_notifyBits, eSetBits, &woken);
+     }
+     portYIELD_FROM_ISR(woken);
+ }
+ 
  bool TouchScreen::isAvailable() const {
      return _available;
  }
@@ -56,30 +133,87 @@
          return false;
      }
      
+     // The reader task owns the controller in IRQ mode
+     if (_readerTask) {
+         return hasSamples();
+     }
+     
+     // Nothing to read until the controller signals a new touch
+     if (!_touched && !_interruptPending) {
+         return false;
+     }
+     _interruptPending = false;
+     Power::rearmWake((gpio_num_t)TDECK_TOUCH_INT, LOW);
+     
+     return sampleController();
+ }
+ 
+ bool TouchScreen::sampleController() {
      // Check if the screen is being touched
      bool previousTouched = _touched;
-     _touched = _ft6206.touched();
+     bool touched = _ft6206.touched();
      
      // If screen is being touched, update coordinates
-     if (_touched) {
+     if (touched) {
          TS_Point point = _ft6206.getPoint();
          
          // Store raw coordinates
-         _touchX = point.x;
-         _touchY = point.y;
+         uint16_t x = point.x;
+         uint16_t y = point.y;
          
          // Apply calibration and rotation
-         mapCoordinates(_touchX, _touchY);
+         mapCoordinates(x, y);
+         
+         // Only buffer samples that carry new information
+         if (!previousTouched || x != _touchX || y != _touchY) {
+             _touchX = x;
+             _touchY = y;
+             pushSample({x, y, true, (uint32_t)millis()});
+         }
          
          // Set a default pressure value (FT6206 doesn't provide pressure)
          _touchPressure = 255;
-         
-         // Return true if this is a new touch event
-         return !previousTouched;
+     } else if (previousTouched) {
+         pushSample({_touchX, _touchY, false, (uint32_t)millis()});
+     }
+     
+     _touched = touched;
+     
+     // Return true if a touch started or ended
+     return previousTouched != touched;
+ }
+ 
+ void TouchScreen::pushSample(const TouchSample &sample) {
+     uint16_t next = (_queueHead + 1) & (TDECK_TOUCH_QUEUE_SIZE - 1);
+     
+     // Drop the sample rather than overwrite one the consumer may be reading
+     if (next == _queueTail) {
+         _droppedSamples++;
+         return;
+     }
+     
+     _queue[_queueHead] = sample;
+     __sync_synchronize();
+     _queueHead = next;
+ }
+ 
+ bool TouchScreen::popSample(TouchSample &sample) {
+     if (_queueTail == _queueHead) {
+         return false;
      }
      
-     // Return true if touch has ended
-     return previousTouched && !_touched;
+     sample = _queue[_queueTail];
+     __sync_synchronize();
+     _queueTail = (_queueTail + 1) & (TDECK_TOUCH_QUEUE_SIZE - 1);
+     return true;
+ }
+ 
+ bool TouchScreen::hasSamples() const {
+     return _queueTail != _queueHead;
+ }
+ 
+ uint32_t TouchScreen::getDroppedSamples() const {
+     return _droppedSamples;
  }
  
  uint16_t TouchScreen::getX() const {
@@ -130,6 +264,11 @@
      _rotation = rotation % 4;
  }
  
+ void TouchScreen::setNotifyTask(TaskHandle_t task, uint32_t bits) {
+     _notifyBits = bits;
+     _notifyTask = task;
+ }
+ 
  void TouchScreen::mapCoordinates(uint16_t &x, uint16_t &y) {
      // T-Deck touchscreen typically needs coordinates to be mapped
      // depending on the display orientation
@@ -182,21 +321,26 @@
  void TouchScreen::read_cb(lv_indev_drv_t *indev_drv, lv_indev_data_t *data) {
      static lv_coord_t last_x = 0;
      static lv_coord_t last_y = 0;
+     static bool last_pressed = false;
      
-     // Check if touchscreen is being touched
-     if (touchScreen.isTouched()) {
-         // Get current coordinates
-         last_x = touchScreen.getX();
-         last_y = touchScreen.getY();
-         
-         // Set data for LVGL
-         data->state = LV_INDEV_STATE_PR;
-         data->point.x = last_x;
-         data->point.y = last_y;
+     // Replay buffered samples one per read so fast swipes keep every point
+     TouchSample sample;
+     if (touchScreen.popSample(sample)) {
+         last_x = sample.x;
+         last_y = sample.y;
+         last_pressed = sample.pressed;
+         data->continue_reading = touchScreen.hasSamples();
      } else {
-         // Not touched, set released state but keep last coordinates
-         data->state = LV_INDEV_STATE_REL;
-         data->point.x = last_x;
-         data->point.y = last_y;
+         // Buffer empty, fall back to the current state in case samples were dropped
+         last_pressed = touchScreen.isTouched();
+         if (last_pressed) {
+             last_x = touchScreen.getX();
+             last_y = touchScreen.getY();
+         }
      }
+     
+     // Set data for LVGL, keep last coordinates on release
+     data->state = last_pressed ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+     data->point.x = last_x;
+     data->point.y = last_y;
  }
\ No newline at end of file
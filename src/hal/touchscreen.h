@@ -14,6 +14,16 @@
  #include <Adafruit_FT6206.h>
  #include "../config.h"
  
+ /**
+  * @brief Timestamped touch sample
+  */
+ typedef struct {
+     uint16_t x;                      // Display X coordinate
+     uint16_t y;                      // Display Y coordinate
+     bool pressed;                    // true while the finger is down
+     uint32_t timestamp;              // millis() when the sample was read
+ } TouchSample;
+ 
  /**
   * @class TouchScreen
   * @brief Hardware abstraction layer for the T-Deck touchscreen
@@ -47,11 +57,40 @@
      /**
       * @brief Update touch data
       * 
+      * In IRQ mode the reader task samples the controller and this only
+      * reports whether samples are waiting. Otherwise the controller is
+      * read here after an interrupt or while a touch is in progress.
+      * 
       * @return true if a touch event was detected
       * @return false if no touch event was detected
       */
      bool update();
  
+     /**
+      * @brief Take the oldest buffered touch sample
+      * 
+      * Must only be called from one task (the LVGL input read).
+      * 
+      * @param sample Filled with the sample
+      * @return true if a sample was available
+      * @return false if the buffer is empty
+      */
+     bool popSample(TouchSample &sample);
+ 
+     /**
+      * @brief Check if buffered touch samples are waiting
+      * 
+      * @return true if at least one sample is buffered
+      */
+     bool hasSamples() const;
+ 
+     /**
+      * @brief Get the number of samples dropped because the buffer was full
+      * 
+      * @return uint32_t dropped sample count
+      */
+     uint32_t getDroppedSamples() const;
+ 
      /**
       * @brief Get the current touch X coordinate
       * 
@@ -106,6 +145,14 @@
       */
      void setRotation(uint8_t rotation);
  
+     /**
+      * @brief Set the task to notify from the touch interrupt
+      * 
+      * @param task Task handle to notify, or NULL to disable notifications
+      * @param bits Notification bits set on the task
+      */
+     void setNotifyTask(TaskHandle_t task, uint32_t bits);
+ 
      /**
       * @brief Static callback function for LVGL touchscreen input
       * 
@@ -120,11 +167,21 @@
      Adafruit_FT6206 _ft6206;         // FT6206 driver instance
      TwoWire* _wire;                  // I2C interface
      bool _available;                 // Touchscreen availability flag
-     bool _touched;                   // Touch state
+     volatile bool _touched;          // Touch state
      uint16_t _touchX;                // Current touch X coordinate
      uint16_t _touchY;                // Current touch Y coordinate
      uint8_t _touchPressure;          // Current touch pressure
      uint8_t _rotation;               // Display rotation (0-3)
+     volatile bool _interruptPending; // Touch interrupt seen since last update
+     TaskHandle_t _notifyTask;        // Task woken by the touch interrupt
+     uint32_t _notifyBits;            // Notification bits set on the task
+     TaskHandle_t _readerTask;        // IRQ mode reader task, NULL when polling
+     
+     // Single producer/single consumer sample ring buffer
+     TouchSample _queue[TDECK_TOUCH_QUEUE_SIZE];
+     volatile uint16_t _queueHead;    // Next slot written by the reader
+     volatile uint16_t _queueTail;    // Next slot read by read_cb
+     uint32_t _droppedSamples;        // Samples lost to a full buffer
      
      // Calibration values
      uint16_t _minX;
@@ -139,6 +196,41 @@
       * @param y Raw Y coordinate
       */
      void mapCoordinates(uint16_t &x, uint16_t &y);
+ 
+     /**
+      * @brief Read the controller and buffer a sample if the state changed or moved
+      * 
+      * @return true if the touch state changed
+      */
+     bool sampleController();
+ 
+     /**
+      * @brief Append a sample to the ring buffer
+      * 
+      * @param sample Sample to append
+      */
+     void pushSample(const TouchSample &sample);
+ 
+     /**
+      * @brief Switch the controller INT line to pulse once per new report
+      * 
+      * @return true if the mode register was written
+      */
+     bool enableTriggerMode();
+ 
+     /**
+      * @brief Reader task, sleeps until the touch interrupt fires
+      * 
+      * @param arg Pointer to the TouchScreen instance
+      */
+     static void readerTask(void* arg);
+ 
+     /**
+      * @brief Touch interrupt handler
+      * 
+      * @param arg Pointer to the TouchScreen instance
+      */
+     static void IRAM_ATTR touchISR(void* arg);
  };
  
  // Global touchscreen instance
@@ -0,0 +1,94 @@
+/**
+ * @file voice_codec.cpp
+ * @brief Implementation of the low bitrate speech codec
+ */
+
+ #include "voice_codec.h"
+ #include "audio.h"
+ #if __has_include(<codec2.h>)
+ #include <codec2.h>
+ #define VOICE_HAS_CODEC2 1
+ #else
+ #define VOICE_HAS_CODEC2 0
+ #endif
+ 
+ // Constructor
+ VoiceCodec::VoiceCodec()
+     : _codec(nullptr)
+     , _samplesPerFrame(0)
+     , _bytesPerFrame(0)
+ {
+ }
+ 
+ // Destructor
+ VoiceCodec::~VoiceCodec() {
+     end();
+ }
+ 
+ // Create the codec state
+ bool VoiceCodec::begin(uint16_t bitrate) {
+     end();
+ 
+ #if VOICE_HAS_CODEC2
+     int mode;
+     switch (bitrate) {
+         case 3200: mode = CODEC2_MODE_3200; break;
+         case 2400: mode = CODEC2_MODE_2400; break;
+         case 1600: mode = CODEC2_MODE_1600; break;
+         case 1400: mode = CODEC2_MODE_1400; break;
+         case 1300: mode = CODEC2_MODE_1300; break;
+         case 1200: mode = CODEC2_MODE_1200; break;
+         default:
+             TDECK_LOG_E("Unsupported voice bitrate: %u", bitrate);
+             return false;
+     }
+ 
+     _codec = codec2_create(mode);
+     if (!_codec) {
+         TDECK_LOG_E("Failed to create voice codec");
+         return false;
+     }
+     _samplesPerFrame = codec2_samples_per_frame(_codec);
+     _bytesPerFrame = codec2_bytes_per_frame(_codec);
+     return true;
+ #else
+     TDECK_LOG_E("Voice codec not built in");
+     return false;
+ #endif
+ }
+ 
+ // Release the codec state
+ void VoiceCodec::end() {
+ #if VOICE_HAS_CODEC2
+     if (_codec) {
+         codec2_destroy(_codec);
+     }
+ #endif
+     _codec = nullptr;
+     _samplesPerFrame = 0;
+     _bytesPerFrame = 0;
+ }
+ 
+ // Get the samples in one frame
+ size_t VoiceCodec::getSamplesPerFrame() const {
+     return _samplesPerFrame;
+ }
+ 
+ // Get the bytes of one encoded frame
+ size_t VoiceCodec::getBytesPerFrame() const {
+     return _bytesPerFrame;
+ }
+ 
+ // Encode one frame
+ void VoiceCodec::encode(const int16_t* samples, uint8_t* bits) {
+ #if VOICE_HAS_CODEC2
+     codec2_encode(_codec, bits, (short*)samples);
+ #endif
+ }
+ 
+ // Decode one frame
+ void VoiceCodec::decode(const uint8_t* bits, int16_t* samples) {
+ #if VOICE_HAS_CODEC2
+     codec2_decode(_codec, samples, bits);
+ #endif
+ }
\ No newline at end of file
@@ -0,0 +1,80 @@
+/**
+ * @file voice_codec.h
+ * @brief Low bitrate speech codec for T-Deck hardware
+ *
+ * A thin wrapper over Codec2, which codes 8 kHz mono speech in fixed size
+ * frames of a few bytes. At TDECK_AUDIO_VOICE_BITRATE 1600 a second of
+ * speech is 200 bytes, small enough to send over LoRa. Without the Codec2
+ * library begin() fails and voice features stay off.
+ */
+
+ #ifndef TDECK_VOICE_CODEC_H
+ #define TDECK_VOICE_CODEC_H
+ 
+ #include <Arduino.h>
+ #include "audio.h"
+ 
+ // Codec2 runs on 8 kHz mono
+ #define VOICE_SAMPLE_RATE 8000
+ 
+ struct CODEC2;
+ 
+ /**
+  * @class VoiceCodec
+  * @brief Encodes and decodes Codec2 frames
+  */
+ class VoiceCodec {
+ public:
+     /**
+      * @brief Constructor
+      */
+     VoiceCodec();
+ 
+     /**
+      * @brief Destructor, releases the codec state
+      */
+     ~VoiceCodec();
+ 
+     /**
+      * @brief Create the codec state
+      * @param bitrate Codec2 bitrate, 3200, 2400, 1600, 1400, 1300 or 1200
+      * @return true if the mode is supported and the state was allocated
+      */
+     bool begin(uint16_t bitrate = TDECK_AUDIO_VOICE_BITRATE);
+ 
+     /**
+      * @brief Release the codec state
+      */
+     void end();
+ 
+     /**
+      * @brief Get the samples in one frame, 0 before begin()
+      */
+     size_t getSamplesPerFrame() const;
+ 
+     /**
+      * @brief Get the bytes of one encoded frame, 0 before begin()
+      */
+     size_t getBytesPerFrame() const;
+ 
+     /**
+      * @brief Encode one frame
+      * @param samples getSamplesPerFrame() samples at VOICE_SAMPLE_RATE
+      * @param bits Receives getBytesPerFrame() bytes
+      */
+     void encode(const int16_t* samples, uint8_t* bits);
+ 
+     /**
+      * @brief Decode one frame
+      * @param bits getBytesPerFrame() bytes
+      * @param samples Receives getSamplesPerFrame() samples
+      */
+     void decode(const uint8_t* bits, int16_t* samples);
+ 
+ private:
+     CODEC2* _codec;
+     size_t _samplesPerFrame;
+     size_t _bytesPerFrame;
+ };
+ 
+ #endif // TDECK_VOICE_CODEC_H
\ No newline at end of file
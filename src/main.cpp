@@ -6,6 +6,7 @@
  #include <Arduino.h>
  #include <lvgl.h>
  #include "config.h"
+ #include "hal/spi_bus.h"
  #include "hal/display.h"
  #include "hal/keyboard.h"
  #include "hal/power.h"
@@ -15,11 +16,19 @@
  #include "hal/lora.h"
  #include "system/fs_manager.h"
  #include "system/battery.h"
+ #include "hal/battery_sensor.h"
  #include "system/config_storage.h"
  #include "system/ota.h"
+ #include "system/scheduler.h"
+ #include "system/boot_timeline.h"
+ #include "system/assets.h"
+ #include "system/heap_tracker.h"
+ #include "system/task_profiler.h"
+ #include "system/trace.h"
  #include "ui/ui_manager.h"
  #include "ui/theme.h"
  #include "ui/styles.h"
+ #include "ui/frame_stats.h"
  #include "apps/launcher.h"
  #include "apps/file_browser.h"
  #include "apps/wifi_manager.h"
@@ -31,10 +40,10 @@
  #include "comms/wifi.h"
  #include "comms/bluetooth.h"
  #include "comms/lora.h"
+ #include "comms/lora_gateway.h"
  
- // LVGL display buffer
+ // LVGL display buffer (memory is owned by the display driver)
  static lv_disp_draw_buf_t disp_buf;
- static lv_color_t buf[TDECK_DISPLAY_WIDTH * 10];
  
  // Hardware Managers
  Display display;
@@ -68,73 +77,380 @@
  TaskHandle_t uiTaskHandle = NULL;
  TaskHandle_t systemTaskHandle = NULL;
  
+ // Set by the radio bring-up tasks, the system task waits for all of them
+ static EventGroupHandle_t radioEvents = NULL;
+ static EventBits_t radioPending = 0;
+ 
+ // LVGL input devices, their read timers only run while input is active
+ static lv_indev_t* touchIndev = NULL;
+ static lv_indev_t* keyboardIndev = NULL;
+ 
+ // Pause or resume polling of the LVGL input devices
+ static void setInputPolling(bool enabled) {
+     lv_indev_t* indevs[] = {touchIndev, keyboardIndev};
+     
+     for (lv_indev_t* indev : indevs) {
+         if (!indev) {
+             continue;
+         }
+         
+         lv_timer_t* timer = lv_indev_get_read_timer(indev);
+         if (enabled) {
+             lv_timer_resume(timer);
+             lv_timer_ready(timer);
+         } else {
+             lv_timer_pause(timer);
+         }
+     }
+ }
+ 
  // UI Task - handles LVGL UI updates
+ // Sleeps until the next LVGL timer is due or an input interrupt or posted
+ // work item wakes it through a task notification.
  void uiTask(void *pvParameters) {
      TDECK_LOG_I("UI Task started");
+     heapTracker.setTaskTag(HEAP_TAG_UI);
+     
+     uint32_t lastInputTime = millis();
+     bool inputPolling = true;
+     bool firstFrame = true;
      
      while (1) {
-         // Call LVGL task handler
-         lv_task_handler();
-         
          // Handle touch events
          touchScreen.update();
          
          // Handle keyboard events
          keyboard.update();
          
-         // Update UI Manager (clock, notifications, etc.)
-         uiManager.update();
+         // Keep input devices polled while a finger or key is down
+         uint32_t now = millis();
+         if (touchScreen.isTouched() || keyboard.isAnyKeyPressed()) {
+             lastInputTime = now;
+         }
          
-         // Delay to yield to other tasks
-         delay(TDECK_UI_REFRESH_RATE);
-     }
- }
- 
- // System Task - handles system monitoring and services
- void systemTask(void *pvParameters) {
-     TDECK_LOG_I("System Task started");
-     
-     while (1) {
-         // Check battery status
-         batteryManager.update();
+         bool inputActive = now - lastInputTime < TDECK_UI_INPUT_IDLE_MS;
+         if (inputActive != inputPolling) {
+             setInputPolling(inputActive);
+             inputPolling = inputActive;
+         }
          
-         // Update power manager
-         powerManager.update();
+         // Call LVGL timer handler (timed for frame statistics)
+         frameStats.beginRender();
+         uint32_t sleepMs = lv_timer_handler();
+         frameStats.endRender();
          
-         // Check OTA updates
-         if (TDECK_FEATURE_OTA) {
-             otaManager.update();
-         }
+         // Hand finished DMA buffers back to LVGL
+         display.pollFlush();
          
-         // Check connection statuses
-         if (TDECK_FEATURE_WIFI) {
-             wifiManager.update();
+         // The launcher is on screen once its first frame has gone out
+         if (firstFrame && frameStats.getFrameCount() > 0 && !display.isFlushPending()) {
+             bootTimeline.mark("first frame");
+             firstFrame = false;
          }
          
-         if (TDECK_FEATURE_BLUETOOTH) {
-             btManager.update();
+         // Update UI Manager (clock, notifications, posted work)
+         uiManager.update();
+         
+         // Sleep until the next LVGL deadline, bounded so periodic work still runs
+         if (display.isFlushPending()) {
+             sleepMs = 1;
+         } else if (inputActive) {
+             sleepMs = min(sleepMs, (uint32_t)TDECK_UI_REFRESH_RATE);
+         } else {
+             sleepMs = min(sleepMs, (uint32_t)TDECK_UI_MAX_IDLE_MS);
          }
          
-         if (TDECK_FEATURE_LORA) {
-             loraManager.update();
+         uint32_t events = 0;
+         xTaskNotifyWait(0, UINT32_MAX, &events, pdMS_TO_TICKS(sleepMs));
+         
+         // Input interrupts start a new burst of input polling
+         if (events & (TDECK_UI_NOTIFY_KEYBOARD | TDECK_UI_NOTIFY_TOUCH)) {
+             lastInputTime = millis();
+         }
+     }
+ }
+ 
+ // Apps build their UI when shown, the UI manager destroys it once they are no longer warm
+ void launchSettingsApp() {
+     uiManager.showApp(&settings);
+ }
+ 
+ // Other apps open the file browser to pick files, it keeps its screen once built
+ void launchFileBrowserApp() {
+     static bool initialized = false;
+     if (!initialized) {
+         fileBrowser.init();
+         initialized = true;
+     }
+     fileBrowser.show();
+ }
+ 
+ void launchTerminalApp() {
+     uiManager.showApp(&terminal);
+ }
+ 
+ void launchWiFiManagerApp() {
+     uiManager.showApp(&wifiManagerApp);
+ }
+ 
+ void launchBluetoothManagerApp() {
+     uiManager.showApp(&bleManagerApp);
+ }
+ 
+ void launchLoRaMessengerApp() {
+     uiManager.showApp(&loraMessenger);
+ }
+ 
+ void launchSystemInfoApp() {
+     uiManager.showApp(&systemInfo);
+ }
+ 
+ // One radio stack brought up by its own task on core 0
+ struct RadioBringUp {
+     const char* name;   // Task and timeline stage name
+     bool enabled;       // Feature flag
+     HeapTag tag;        // Subsystem charged with the stack's allocations
+     bool (*init)();
+ };
+ 
+ static bool initWiFi() {
+     return wifiManager.init();
+ }
+ 
+ static bool initBluetooth() {
+     return btManager.init();
+ }
+ 
+ static bool initLoRa() {
+     return loraManager.init();
+ }
+ 
+ static bool initOta() {
+     return otaManager.init();
+ }
+ 
+ static const RadioBringUp radios[] = {
+     {"wifi", TDECK_FEATURE_WIFI, HEAP_TAG_WIFI, initWiFi},
+     {"bluetooth", TDECK_FEATURE_BLUETOOTH, HEAP_TAG_BLE, initBluetooth},
+     {"lora", TDECK_FEATURE_LORA, HEAP_TAG_LORA, initLoRa},
+     {"ota", TDECK_FEATURE_OTA, HEAP_TAG_OTA, initOta},
+ };
+ 
+ static void bringUpRadio(size_t index) {
+     {
+         HeapTagScope heapTag(radios[index].tag);
+         if (!radios[index].init()) {
+             TDECK_LOG_E("Failed to initialize %s", radios[index].name);
+         }
+     }
+     
+     bootTimeline.mark(radios[index].name);
+     xEventGroupSetBits(radioEvents, 1 << index);
+ }
+ 
+ // Radio bring-up task, exits once its stack is up
+ void radioBootTask(void *pvParameters) {
+     bringUpRadio((size_t)pvParameters);
+     vTaskDelete(NULL);
+ }
+ 
+ // Start the radio stacks in parallel, setup() goes on to show the launcher
+ static void startRadios() {
+     radioEvents = xEventGroupCreate();
+     
+     for (size_t i = 0; i < sizeof(radios) / sizeof(radios[0]); i++) {
+         if (!radios[i].enabled) {
+             continue;
          }
          
-         // Delay for system monitoring (slower than UI updates)
-         delay(1000);
+         radioPending |= 1 << i;
+         if (xTaskCreatePinnedToCore(radioBootTask, radios[i].name, TDECK_BOOT_TASK_STACK_SIZE,
+                                     (void*)i, TDECK_SYSTEM_TASK_PRIORITY, NULL, 0) != pdPASS) {
+             TDECK_LOG_W("No task for %s bring-up, starting it inline", radios[i].name);
+             bringUpRadio(i);
+         }
+     }
+ }
+ 
+ // System services, each run by the scheduler at its own period
+ static ServiceId wifiService = SERVICE_INVALID;
+ 
+ // Status bar state packed into a work item argument: battery percentage, then flags
+ #define STATUS_CHARGING (1u << 8)
+ #define STATUS_WIFI (1u << 9)
+ #define STATUS_BLUETOOTH (1u << 10)
+ #define STATUS_LORA (1u << 11)
+ 
+ // Apply a status snapshot, runs on the UI task
+ static void applyStatus(void* arg) {
+     uint32_t status = (uint32_t)(uintptr_t)arg;
+     uiManager.updateBatteryStatus(status & 0xFF, status & STATUS_CHARGING);
+     uiManager.updateWiFiStatus(status & STATUS_WIFI);
+     uiManager.updateBluetoothStatus(status & STATUS_BLUETOOTH);
+     uiManager.updateLoRaStatus(status & STATUS_LORA);
+ }
+ 
+ // Push the status bar state to the UI task when it has changed
+ static void publishStatus() {
+     static uint32_t published = UINT32_MAX;
+     
+     uint32_t status = (uint32_t)constrain(batteryManager.getPercentage(), 0, 100);
+     if (batteryManager.isCharging()) {
+         status |= STATUS_CHARGING;
+     }
+     if (TDECK_FEATURE_WIFI && wifiManager.isConnected()) {
+         status |= STATUS_WIFI;
+     }
+     if (TDECK_FEATURE_BLUETOOTH && (btManager.isConnected() || btManager.isDataChannelConnected() ||
+                                     btManager.isDiscoverable())) {
+         status |= STATUS_BLUETOOTH;
+     }
+     if (TDECK_FEATURE_LORA && loraManager.isEnabled()) {
+         status |= STATUS_LORA;
+     }
+     
+     // An unchanged state posts nothing, so the UI never polls
+     if (status != published && uiManager.postWork(applyStatus, (void*)(uintptr_t)status)) {
+         published = status;
+     }
+ }
+ 
+ static uint32_t serviceBatteryAdc(void* context) {
+     return batterySensor.sample();
+ }
+ 
+ static uint32_t serviceBattery(void* context) {
+     batteryManager.update();
+     publishStatus();
+     return UINT32_MAX;
+ }
+ 
+ static uint32_t servicePower(void* context) {
+     powerManager.update();
+     return UINT32_MAX;
+ }
+ 
+ static uint32_t serviceOta(void* context) {
+     otaManager.update();
+     return UINT32_MAX;
+ }
+ 
+ static uint32_t serviceWiFi(void* context) {
+     wifiManager.update();
+     publishStatus();
+     return UINT32_MAX;
+ }
+ 
+ static uint32_t serviceBluetooth(void* context) {
+     btManager.update();
+     publishStatus();
+     return UINT32_MAX;
+ }
+ 
+ static uint32_t serviceLoRa(void* context) {
+     return loraManager.update();
+ }
+ 
+ static uint32_t serviceGateway(void* context) {
+     return loraGateway.update();
+ }
+ 
+ static uint32_t serviceProfiler(void* context) {
+     return taskProfiler.sample();
+ }
+ 
+ static uint32_t serviceConfig(void* context) {
+     return configStorage.service();
+ }
+ 
+ // Connection changes and finished scans are handled right away, not on the next period
+ static void onWiFiEvent(arduino_event_id_t event) {
+     serviceScheduler.wake(wifiService);
+ }
+ 
+ // Register the system task services
+ static void registerServices() {
+     serviceScheduler.add("battery_adc", TDECK_SERVICE_BATTERY_ADC_MS, serviceBatteryAdc);
+     serviceScheduler.add("battery", TDECK_SERVICE_BATTERY_MS, serviceBattery);
+     serviceScheduler.add("power", TDECK_SERVICE_POWER_MS, servicePower);
+     
+     if (TDECK_FEATURE_OTA) {
+         serviceScheduler.add("ota", TDECK_SERVICE_OTA_MS, serviceOta);
+     }
+     
+     if (TDECK_FEATURE_WIFI) {
+         wifiService = serviceScheduler.add("wifi", TDECK_SERVICE_WIFI_MS, serviceWiFi);
+         WiFi.onEvent(onWiFiEvent);
+     }
+     
+     if (TDECK_FEATURE_BLUETOOTH) {
+         serviceScheduler.add("bluetooth", TDECK_SERVICE_BLUETOOTH_MS, serviceBluetooth);
+     }
+     
+     // In IRQ mode the comms task serves the radio and this only runs at the period
+     if (TDECK_FEATURE_LORA) {
+         serviceScheduler.add("lora", TDECK_LORA_RX_POLL_MS, serviceLoRa);
+     }
+     
+     // Base stations batch what they hear and uplink it over WiFi
+     if (TDECK_FEATURE_LORA && TDECK_FEATURE_WIFI && loraGateway.init() && loraGateway.getConfig().enabled) {
+         serviceScheduler.add("gateway", TDECK_LORA_GATEWAY_BATCH_MS, serviceGateway);
+     }
+     
+     // Write back configuration changes that have settled
+     serviceScheduler.add("config", TDECK_CONFIG_WRITE_DELAY_MS, serviceConfig);
+     
+     // Per-task CPU figures for top and System Info
+     if (taskProfiler.begin()) {
+         serviceScheduler.add("profiler", TDECK_SERVICE_PROFILER_MS, serviceProfiler);
      }
  }
  
+ // System Task - runs the system services, sleeping until the next one is due
+ void systemTask(void *pvParameters) {
+     TDECK_LOG_I("System Task started");
+     heapTracker.setTaskTag(HEAP_TAG_SYSTEM);
+     
+     // The services poll the radio managers, wait until every stack is up
+     if (radioPending) {
+         xEventGroupWaitBits(radioEvents, radioPending, pdFALSE, pdTRUE, portMAX_DELAY);
+     }
+     
+     bootTimeline.mark("radios ready");
+     bootTimeline.print();
+     
+     serviceScheduler.run();
+ }
+ 
+ // Test builds (pio test) bring their own setup() and loop() and use the globals above
+ #ifndef PIO_UNIT_TESTING
  void setup() {
      // Initialize serial for debugging
      TDECK_DEBUG_SERIAL.begin(115200);
      TDECK_LOG_I("T-Deck UI Firmware v%s starting...", TDECK_FIRMWARE_VERSION);
+     bootTimeline.mark("serial");
+     
+     // In tdeck-heap builds, track every allocation from here on
+     heapTracker.begin();
+     
+     // Hot paths trace into per-core rings, a low-priority task writes them out
+     traceLog.begin();
+     
+     // The display, SD card and radio share one SPI host, start it before their drivers
+     if (!spiBus.begin()) {
+         TDECK_LOG_E("Failed to initialize SPI bus");
+     }
      
      // Initialize hardware components
      display.init();
      touchScreen.begin();
      keyboard.init();
+     
+     // Both battery readers take their voltage from the sensor's first reading on
+     batterySensor.begin();
      powerManager.begin();
      batteryManager.init();
+     bootTimeline.mark("hardware");
      
      if (TDECK_FEATURE_SD_CARD) {
          sdcard.begin();
@@ -146,36 +462,45 @@
      }
      
      configStorage.init();
+     bootTimeline.mark("storage");
+     
+     // Map fonts and icons before any style refers to them
+     assets.begin();
+     bootTimeline.mark("assets");
      
      // Initialize LVGL
      lv_init();
      
-     // Initialize display buffer
-     lv_disp_draw_buf_init(&disp_buf, buf, NULL, TDECK_DISPLAY_WIDTH * 10);
+     // Initialize display buffers
+     if (!display.initDrawBuffers(&disp_buf)) {
+         TDECK_LOG_E("Failed to initialize display buffers");
+     }
      
-     // Register display driver
-     lv_disp_drv_t disp_drv;
+     // Register display driver (LVGL keeps a pointer to the driver structs)
+     static lv_disp_drv_t disp_drv;
      lv_disp_drv_init(&disp_drv);
      disp_drv.flush_cb = Display::flush_cb;
+     disp_drv.wait_cb = Display::wait_cb;
+     disp_drv.monitor_cb = FrameStats::monitor_cb;
      disp_drv.draw_buf = &disp_buf;
      disp_drv.hor_res = TDECK_DISPLAY_WIDTH;
      disp_drv.ver_res = TDECK_DISPLAY_HEIGHT;
      lv_disp_drv_register(&disp_drv);
      
      // Register touch input device
-     lv_indev_drv_t touch_drv;
+     static lv_indev_drv_t touch_drv;
      lv_indev_drv_init(&touch_drv);
      touch_drv.type = LV_INDEV_TYPE_POINTER;
      touch_drv.read_cb = TouchScreen::read_cb;
-     lv_indev_drv_register(&touch_drv);
+     touchIndev = lv_indev_drv_register(&touch_drv);
      
      // Register keyboard input device (if enabled)
      if (TDECK_FEATURE_KEYBOARD) {
-         lv_indev_drv_t kb_drv;
+         static lv_indev_drv_t kb_drv;
          lv_indev_drv_init(&kb_drv);
          kb_drv.type = LV_INDEV_TYPE_KEYPAD;
          kb_drv.read_cb = TDeckKeyboard::read_cb;
-         lv_indev_drv_register(&kb_drv);
+         keyboardIndev = lv_indev_drv_register(&kb_drv);
      }
      
      // Initialize UI manager
@@ -184,37 +509,18 @@
      // Initialize theme and styles
      theme.init();
      styles.init();
+     bootTimeline.mark("lvgl");
      
-     // Initialize communication modules
-     if (TDECK_FEATURE_WIFI) {
-         wifiManager.init();
-     }
-     
-     if (TDECK_FEATURE_BLUETOOTH) {
-         btManager.init();
-     }
+     // Bring up the radios on core 0 while the launcher is built
+     startRadios();
      
-     if (TDECK_FEATURE_LORA) {
-         loraManager.init();
-     }
+     // Apply saved settings and keep storing messages, the app UIs are built on first launch
+     settings.begin();
+     loraMessenger.begin();
      
-     if (TDECK_FEATURE_OTA) {
-         otaManager.init();
-     }
-     
-     // Initialize applications
+     // The launcher registers every app with its launch function
      launcher.init(uiManager.getMainContainer());
-     fileBrowser.init();
-     settings.init(uiManager.getMainContainer());
-     terminal.init(uiManager.getMainContainer());
-     systemInfo.init(uiManager.getMainContainer());
-     wifiManagerApp.init(uiManager.getMainContainer());
-     bleManagerApp.init(uiManager.getMainContainer());
-     loraMessenger.init(uiManager.getMainContainer());
-     
-     // Register apps with launcher
-     // The launcher.registerApp calls should go here based on 
-     // the app function declarations seen in src/apps/launcher.cpp
+     bootTimeline.mark("launcher");
      
      // Start UI task
      xTaskCreatePinnedToCore(
@@ -227,7 +533,13 @@
          1                          // Core (1 = Arduino core)
      );
      
+     // Wake the UI task on input interrupts and posted work
+     keyboard.setNotifyTask(uiTaskHandle, TDECK_UI_NOTIFY_KEYBOARD);
+     touchScreen.setNotifyTask(uiTaskHandle, TDECK_UI_NOTIFY_TOUCH);
+     uiManager.setUITask(uiTaskHandle);
+     
      // Start system task
+     registerServices();
      xTaskCreatePinnedToCore(
          systemTask,                    // Task function
          "System_Task",                 // Name
@@ -240,6 +552,7 @@
      
      // Show launcher as default app
      launcher.start();
+     bootTimeline.mark("setup");
      
      TDECK_LOG_I("Setup complete");
  }
@@ -247,4 +560,5 @@
  void loop() {
      // Main loop is empty as tasks handle everything
      delay(1000);
- }
\ No newline at end of file
+ }
+ #endif // PIO_UNIT_TESTING
\ No newline at end of file
@@ -0,0 +1,93 @@
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the Arduino core, native builds only
+ *
+ * Just enough of the core for the modules the native environment builds:
+ * fixed-width types, min/max, timing, a String over std::string, a Serial
+ * that prints to stdout and no-op critical sections. The modules themselves
+ * are compiled unchanged.
+ */
+
+ #ifndef TDECK_NATIVE_ARDUINO_H
+ #define TDECK_NATIVE_ARDUINO_H
+ 
+ #include <stdint.h>
+ #include <stddef.h>
+ #include <stdio.h>
+ #include <stdarg.h>
+ #include <string.h>
+ #include <math.h>
+ #include <algorithm>
+ #include <chrono>
+ #include <string>
+ 
+ using std::min;
+ using std::max;
+ 
+ #define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+ #define IRAM_ATTR
+ 
+ // Critical sections guard against the other core on the device, the host harness is single threaded
+ typedef int portMUX_TYPE;
+ #define portMUX_INITIALIZER_UNLOCKED 0
+ #define portENTER_CRITICAL(mux) ((void)(mux))
+ #define portEXIT_CRITICAL(mux) ((void)(mux))
+ 
+ inline uint32_t micros() {
+     using namespace std::chrono;
+     static const steady_clock::time_point start = steady_clock::now();
+     return (uint32_t)duration_cast<microseconds>(steady_clock::now() - start).count();
+ }
+ 
+ inline uint32_t millis() {
+     return micros() / 1000;
+ }
+ 
+ /**
+  * @brief The part of the Arduino String the host modules use
+  */
+ class String {
+ public:
+     String() {}
+     String(const char* text) : _text(text ? text : "") {}
+     String(const char* text, unsigned int length) : _text(text, length) {}
+     
+     unsigned int length() const { return _text.length(); }
+     bool isEmpty() const { return _text.empty(); }
+     const char* c_str() const { return _text.c_str(); }
+     
+     String& operator+=(const String& other) { _text += other._text; return *this; }
+     String& operator+=(const char* other) { _text += other; return *this; }
+     bool operator==(const String& other) const { return _text == other._text; }
+     bool operator!=(const String& other) const { return _text != other._text; }
+     
+     friend String operator+(String left, const String& right) { return left += right; }
+     friend String operator+(String left, const char* right) { return left += right; }
+     
+ private:
+     std::string _text;
+ };
+ 
+ /**
+  * @brief Serial port that writes to stdout, silenced by the fuzzer build
+  */
+ class HostSerial {
+ public:
+     void begin(unsigned long) {}
+     
+     size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+ #ifdef TDECK_FUZZ
+         return 0;
+ #else
+         va_list args;
+         va_start(args, format);
+         int written = vprintf(format, args);
+         va_end(args);
+         return written > 0 ? written : 0;
+ #endif
+     }
+ };
+ 
+ extern HostSerial Serial;
+ 
+ #endif // TDECK_NATIVE_ARDUINO_H
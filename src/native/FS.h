@@ -0,0 +1,52 @@
+/**
+ * @file FS.h
+ * @brief Host stand-in for the Arduino FS layer, native builds only
+ *
+ * An fs::File over a stdio stream. Files are opened through the host
+ * FSManager, which maps the /sd and /flash mounts into a directory of the
+ * host (see host_fs.h), so modules written against FSManager run unchanged.
+ */
+
+ #ifndef TDECK_NATIVE_FS_H
+ #define TDECK_NATIVE_FS_H
+
+ #include <Arduino.h>
+ #include <memory>
+
+ #define FILE_READ "r"
+ #define FILE_WRITE "w"
+ #define FILE_APPEND "a"
+
+ namespace fs {
+
+ enum SeekMode {
+     SeekSet = 0,
+     SeekCur = 1,
+     SeekEnd = 2
+ };
+
+ /**
+  * @brief Open file, copies share the stream like on the device
+  */
+ class File {
+ public:
+     File() {}
+     explicit File(FILE* stream) : _stream(stream, fclose) {}
+
+     size_t read(uint8_t* buffer, size_t size);
+     size_t write(const uint8_t* buffer, size_t size);
+     bool seek(uint32_t position, SeekMode mode = SeekSet);
+     size_t position() const;
+     size_t size() const;
+     void flush();
+     void close() { _stream.reset(); }
+
+     operator bool() const { return (bool)_stream; }
+
+ private:
+     std::shared_ptr<FILE> _stream;
+ };
+
+ } // namespace fs
+
+ #endif // TDECK_NATIVE_FS_H
@@ -0,0 +1,133 @@
+/**
+ * @file host_fs.cpp
+ * @brief FSManager file calls and fs::File over a host directory
+ *
+ * Only the calls the host-built modules make are provided. Directory
+ * listings, the listing cache, the SD worker and the shared SPI bus have no
+ * host counterpart.
+ */
+
+ #include "host_fs.h"
+ #include "../system/fs_manager.h"
+ #include "../system/fs_path.h"
+ #include <sys/stat.h>
+
+ static std::string hostRoot = "host_fs";
+ static int64_t writeBudget = -1;
+ static std::string lastError;
+
+ bool HostFS::setRoot(const std::string& root) {
+     hostRoot = root;
+     mkdir(root.c_str(), 0755);
+     mkdir((root + "/flash").c_str(), 0755);
+     mkdir((root + "/sd").c_str(), 0755);
+
+     struct stat info;
+     return stat((root + "/sd").c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+ }
+
+ // Resolve like the device: the first component names the mount and is
+ // stripped, anything but /sd is on flash
+ std::string HostFS::hostPath(const std::string& path) {
+     std::string normalized = FSPath::normalize(path);
+     size_t pos = normalized.find('/', 1);
+     std::string inner = pos != std::string::npos ? normalized.substr(pos) : "/";
+     return hostRoot + "/" + FSPath::fs_type(normalized) + inner;
+ }
+
+ void HostFS::setWriteBudget(int64_t bytes) {
+     writeBudget = bytes;
+ }
+
+ size_t fs::File::read(uint8_t* buffer, size_t size) {
+     return _stream ? fread(buffer, 1, size, _stream.get()) : 0;
+ }
+
+ size_t fs::File::write(const uint8_t* buffer, size_t size) {
+     if (!_stream) {
+         return 0;
+     }
+     if (writeBudget >= 0) {
+         size = min(size, (size_t)writeBudget);
+         writeBudget -= size;
+     }
+     size_t written = fwrite(buffer, 1, size, _stream.get());
+     fflush(_stream.get());
+     return written;
+ }
+
+ bool fs::File::seek(uint32_t position, SeekMode mode) {
+     static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+     return _stream && fseek(_stream.get(), position, whence[mode]) == 0;
+ }
+
+ size_t fs::File::position() const {
+     return _stream ? ftell(_stream.get()) : 0;
+ }
+
+ size_t fs::File::size() const {
+     struct stat info;
+     if (!_stream || fstat(fileno(_stream.get()), &info) != 0) {
+         return 0;
+     }
+     return info.st_size;
+ }
+
+ void fs::File::flush() {
+     if (_stream) {
+         fflush(_stream.get());
+     }
+ }
+
+ bool FSManager::rename_file(const std::string& old_path, const std::string& new_path) {
+     if (FSPath::fs_type(FSPath::normalize(old_path)) != FSPath::fs_type(FSPath::normalize(new_path))) {
+         lastError = "Cannot rename across different filesystems";
+         return false;
+     }
+     if (rename(HostFS::hostPath(old_path).c_str(), HostFS::hostPath(new_path).c_str()) != 0) {
+         lastError = "Failed to rename file: " + FSPath::normalize(old_path);
+         return false;
+     }
+     return true;
+ }
+
+ bool FSManager::remove_file(const std::string& path) {
+     if (remove(HostFS::hostPath(path).c_str()) != 0) {
+         lastError = "Failed to remove file: " + FSPath::normalize(path);
+         return false;
+     }
+     return true;
+ }
+
+ int64_t FSManager::get_file_size(const std::string& path) {
+     struct stat info;
+     if (stat(HostFS::hostPath(path).c_str(), &info) != 0 || S_ISDIR(info.st_mode)) {
+         lastError = "Failed to open file: " + FSPath::normalize(path);
+         return -1;
+     }
+     return info.st_size;
+ }
+
+ fs::File FSManager::open_file(const std::string& path, const char* mode) {
+     // Binary streams, the device has no text mode
+     std::string hostMode = std::string(mode) + "b";
+     FILE* stream = fopen(HostFS::hostPath(path).c_str(), hostMode.c_str());
+     if (!stream) {
+         lastError = "Failed to open file: " + FSPath::normalize(path);
+         return fs::File();
+     }
+     return fs::File(stream);
+ }
+
+ bool FSManager::file_exists(const std::string& path) {
+     std::string normalized = FSPath::normalize(path);
+     if (normalized == "/" || normalized == "/flash" || normalized == "/sd") {
+         return true;
+     }
+     struct stat info;
+     return stat(HostFS::hostPath(path).c_str(), &info) == 0;
+ }
+
+ std::string FSManager::get_last_error() {
+     return lastError;
+ }
@@ -0,0 +1,41 @@
+/**
+ * @file host_fs.h
+ * @brief SD card and flash mock of the native environment
+ *
+ * The host FSManager resolves every path inside one host directory, one
+ * subdirectory per mount: "/sd/music/a.mp3" is <root>/sd/music/a.mp3 and
+ * "/flash/messages.log" is <root>/flash/messages.log. A write budget stands
+ * in for the card being pulled or the power failing part way through a
+ * write.
+ */
+
+ #ifndef TDECK_NATIVE_HOST_FS_H
+ #define TDECK_NATIVE_HOST_FS_H
+
+ #include <stdint.h>
+ #include <string>
+
+ namespace HostFS {
+
+ /**
+  * @brief Set the host directory the mounts live in, created with its mounts if missing
+  * @return true if the directory is usable
+  */
+ bool setRoot(const std::string& root);
+
+ /**
+  * @brief Map a device path to its host path
+  */
+ std::string hostPath(const std::string& path);
+
+ /**
+  * @brief Let only this many more bytes reach the files, -1 for no limit
+  *
+  * The write that crosses the budget is cut short and every later write
+  * fails, as on a card that went away.
+  */
+ void setWriteBudget(int64_t bytes);
+
+ } // namespace HostFS
+
+ #endif // TDECK_NATIVE_HOST_FS_H
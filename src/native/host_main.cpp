@@ -0,0 +1,312 @@
+/**
+ * @file host_main.cpp
+ * @brief Host harness of the native environment
+ *
+ * Runs the LoRa receive parsing, the FSManager path handling and the
+ * messenger's message store on the host, where profilers and sanitizers
+ * are available:
+ *
+ *   .pio/build/native/program packet <frame files...>
+ *   .pio/build/native/program path <path files...>
+ *   .pio/build/native/program store <message logs...>
+ *   .pio/build/native/program bench
+ *
+ * A packet file holds one raw frame as read from the radio FIFO. It goes
+ * through LoRaWire::decode() and then every payload parser the LoRa manager
+ * may pick for it. A path file holds one path per line. A message log is a
+ * copy of /flash/messages.log, it is opened without its index like after a
+ * lost index and the broadcast history is printed. Files the store writes
+ * go to the directory named by TDECK_HOST_FS, host_fs by default. The
+ * native-fuzz environment builds the same targets as a libFuzzer entry
+ * point instead.
+ */
+
+ #include <Arduino.h>
+ #include <ArduinoJson.h>
+ #include <string>
+ #include <vector>
+ #include <fstream>
+ #include <sstream>
+ #include <stdlib.h>
+ #include "../config.h"
+ #include "../comms/lora_wire.h"
+ #include "../comms/lora_codec.h"
+ #include "../system/fs_path.h"
+ #include "../system/fs_manager.h"
+ #include "../apps/message_store.h"
+ #include "host_fs.h"
+
+ HostSerial Serial;
+
+ // Same 1e-7 degree fixed point the device sends
+ static const LoRaLocation benchLocation = {473977420, 85455940, 4080};
+
+ // Decode a frame and parse its payload every way a received packet can be
+ static size_t parseFrame(const uint8_t* frame, size_t size) {
+     static LoRaPacket packet;
+     memset(&packet, 0, offsetof(LoRaPacket, payload));
+
+     LoRaWireStatus status = LoRaWire::decode(frame, size, packet);
+     if (status == LORA_WIRE_TOO_SHORT) {
+         return 0;
+     }
+
+     size_t fields = 0;
+     const uint8_t* payload = packet.payload;
+     size_t length = packet.length;
+
+     // Compressed text is expanded before delivery
+     uint8_t expanded[LORA_MAX_PACKET_SIZE];
+     if (packet.flags & LORA_FLAG_COMPRESSED) {
+         length = LoRaCodec::expandText(packet.payload, packet.length, expanded, sizeof(expanded));
+         payload = expanded;
+     }
+
+     if (LoRaCodec::isBinary(payload, length)) {
+         LoRaLocation location;
+         fields += LoRaCodec::decodeLocation(payload, length, location);
+
+         LoRaTlvReader reader(payload, length);
+         LoRaTlvField field;
+         while (reader.next(field)) {
+             fields++;
+         }
+     } else {
+         StaticJsonDocument<256> doc;
+         if (!deserializeJson(doc, (const char*)payload, length)) {
+             fields += doc.size();
+         }
+     }
+
+     return fields;
+ }
+
+ // Normalize a path and classify it like every FSManager call does
+ static size_t parsePath(const std::string& path) {
+     std::string normalized = FSPath::normalize(path);
+     return normalized.length() + (FSPath::fs_type(normalized) == "sd") + FSPath::is_root(normalized);
+ }
+
+ // Replace the message log with the given bytes and drop its index
+ static bool loadLog(const uint8_t* log, size_t size) {
+     FSManager::remove_file(TDECK_MESSAGE_INDEX_FILE);
+     fs::File file = FSManager::open_file(TDECK_MESSAGE_LOG_FILE, FILE_WRITE);
+     if (!file) {
+         return false;
+     }
+     bool written = size == 0 || file.write(log, size) == size;
+     file.close();
+     return written;
+ }
+
+ // Open a log, run it through an append with the given write budget and a
+ // full compaction, then open what is left the way the next boot would
+ static size_t replayStore(const uint8_t* log, size_t size, int64_t budget) {
+     if (!loadLog(log, size)) {
+         return 0;
+     }
+
+     std::vector<LoRaMessage> messages;
+     {
+         MessageStore store(TDECK_MESSAGE_LOG_FILE, TDECK_MESSAGE_INDEX_FILE);
+         store.open();
+         store.read(MESSAGE_BROADCAST, 0, store.count(MESSAGE_BROADCAST), messages);
+
+         LoRaMessage message = {"T-Deck", "Replayed", millis(), false, MESSAGE_BROADCAST};
+         HostFS::setWriteBudget(budget);
+         store.append(message);
+         store.clear(0x1234);
+         while (store.service()) {
+         }
+         HostFS::setWriteBudget(-1);
+     }
+
+     MessageStore reopened(TDECK_MESSAGE_LOG_FILE, TDECK_MESSAGE_INDEX_FILE);
+     reopened.open();
+     reopened.read(MESSAGE_BROADCAST, 0, reopened.count(MESSAGE_BROADCAST), messages);
+     return messages.size();
+ }
+
+ // Host directory of the SD card and flash mocks
+ static bool openHostFS() {
+     const char* root = getenv("TDECK_HOST_FS");
+     if (!HostFS::setRoot(root ? root : "host_fs")) {
+         fprintf(stderr, "Cannot use %s as the host file system\n", root ? root : "host_fs");
+         return false;
+     }
+     return true;
+ }
+
+ #ifdef TDECK_FUZZ
+
+ // First byte picks the target, the rest is its input. A message log is
+ // preceded by the write budget of the append that follows its replay.
+ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+     static bool hostFS = openHostFS();
+     if (size < 1) {
+         return 0;
+     }
+
+     if ((data[0] & 2) && hostFS) {
+         if (size >= 2) {
+             replayStore(data + 2, size - 2, data[1] == 0xFF ? -1 : data[1]);
+         }
+     } else if (data[0] & 1) {
+         parsePath(std::string((const char*)data + 1, size - 1));
+     } else {
+         parseFrame(data + 1, min(size - 1, (size_t)LORA_MAX_FRAME_SIZE));
+     }
+     return 0;
+ }
+
+ #else
+
+ static bool readFile(const char* path, std::string& contents) {
+     std::ifstream file(path, std::ios::binary);
+     if (!file) {
+         fprintf(stderr, "Cannot read %s\n", path);
+         return false;
+     }
+     std::ostringstream buffer;
+     buffer << file.rdbuf();
+     contents = buffer.str();
+     return true;
+ }
+
+ // Repeat an operation and print its rate in the BENCH line format of the device benchmarks
+ template <typename Op>
+ static void bench(const char* name, uint32_t runs, Op op) {
+     volatile size_t sink = 0;
+     uint32_t start = micros();
+     for (uint32_t i = 0; i < runs; i++) {
+         sink += op(i);
+     }
+     uint32_t us = max(micros() - start, (uint32_t)1);
+     printf("BENCH,%s-native,%s,%.3f,ops/s\n", TDECK_FIRMWARE_VERSION, name, runs * 1000000.0 / us);
+ }
+
+ static int runBench() {
+     // A status packet as a node with the binary schema sends it
+     LoRaPacket status = {};
+     status.messageType = 3;
+     status.sourceId = 0x1234;
+     status.destId = 0xFFFF;
+     status.hopLimit = TDECK_LORA_MESH_HOPS;
+     {
+         StaticJsonDocument<256> doc;
+         doc["battery"] = 87;
+         doc["rssi"] = -92;
+         doc["snr"] = 7.25f;
+         doc["uptime"] = 123456;
+         doc["name"] = "T-Deck";
+         status.length = LoRaCodec::encodeObject(doc.as<JsonObjectConst>(), status.payload, LORA_MAX_PACKET_SIZE);
+     }
+     uint8_t statusFrame[LORA_MAX_FRAME_SIZE];
+     size_t statusSize = LoRaWire::encode(status, 0, statusFrame);
+
+     // A compressed chat message
+     static const char text[] = "Hey, are you there? I will be at the meeting point in ten minutes, see you soon";
+     LoRaPacket chat = {};
+     chat.flags = LORA_FLAG_COMPRESSED;
+     chat.length = LoRaCodec::compressText((const uint8_t*)text, sizeof(text) - 1, chat.payload, LORA_MAX_PACKET_SIZE);
+     uint8_t chatFrame[LORA_MAX_FRAME_SIZE];
+     size_t chatSize = LoRaWire::encode(chat, 0, chatFrame);
+
+     // A JSON location from an older node, no trailer
+     static const char json[] = "{\"lat\":47.397742,\"lon\":8.545594,\"alt\":408.0}";
+     uint8_t jsonFrame[LORA_MAX_FRAME_SIZE];
+     LoRaPacket location = {};
+     location.length = sizeof(json) - 1;
+     memcpy(location.payload, json, location.length);
+     LoRaWire::encodeHeader(location, jsonFrame);
+     memcpy(jsonFrame + LORA_HEADER_SIZE, json, location.length);
+     size_t jsonSize = LORA_HEADER_SIZE + location.length;
+
+     bench("host.frame_status", 1000000, [&](uint32_t) { return parseFrame(statusFrame, statusSize); });
+     bench("host.frame_text", 1000000, [&](uint32_t) { return parseFrame(chatFrame, chatSize); });
+     bench("host.frame_json", 1000000, [&](uint32_t) { return parseFrame(jsonFrame, jsonSize); });
+     bench("host.location_roundtrip", 1000000, [&](uint32_t) {
+         uint8_t buffer[LORA_LOCATION_MAX_SIZE];
+         LoRaLocation decoded;
+         size_t length = LoRaCodec::encodeLocation(benchLocation, buffer, sizeof(buffer));
+         return (size_t)LoRaCodec::decodeLocation(buffer, length, decoded);
+     });
+
+     static const char* paths[] = {"/sd/music/album/track01.mp3", "sd//downloads///file.bin", "/flash/config/system.json", "/"};
+     bench("host.normalize_path", 1000000, [&](uint32_t i) { return parsePath(paths[i & 3]); });
+
+     // A full broadcast history, then the boot that loads it from the index
+     if (!openHostFS() || !loadLog(nullptr, 0)) {
+         return 1;
+     }
+     MessageStore store(TDECK_MESSAGE_LOG_FILE, TDECK_MESSAGE_INDEX_FILE);
+     store.open();
+     bench("host.store_append", TDECK_MESSAGE_HISTORY_MAX, [&](uint32_t i) {
+         LoRaMessage message = {"T-Deck", text, i, (i & 1) != 0, MESSAGE_BROADCAST};
+         return (size_t)store.append(message);
+     });
+     bench("host.store_open", 100, [&](uint32_t) {
+         MessageStore reopened(TDECK_MESSAGE_LOG_FILE, TDECK_MESSAGE_INDEX_FILE);
+         reopened.open();
+         return reopened.count(MESSAGE_BROADCAST);
+     });
+     bench("host.store_read_page", 10000, [&](uint32_t i) {
+         std::vector<LoRaMessage> page;
+         return store.read(MESSAGE_BROADCAST, (i * TDECK_MESSAGE_PAGE_SIZE) % TDECK_MESSAGE_HISTORY_MAX,
+                           TDECK_MESSAGE_PAGE_SIZE, page);
+     });
+     return 0;
+ }
+
+ int main(int argc, char** argv) {
+     if (argc < 2) {
+         fprintf(stderr, "usage: %s packet <files...> | path <files...> | store <files...> | bench\n", argv[0]);
+         return 2;
+     }
+
+     std::string mode = argv[1];
+     if (mode == "bench") {
+         return runBench();
+     }
+     if (mode == "store" && !openHostFS()) {
+         return 1;
+     }
+
+     for (int i = 2; i < argc; i++) {
+         std::string contents;
+         if (!readFile(argv[i], contents)) {
+             return 1;
+         }
+
+         if (mode == "packet") {
+             size_t fields = parseFrame((const uint8_t*)contents.data(), min(contents.size(), (size_t)LORA_MAX_FRAME_SIZE));
+             printf("%s: %u fields\n", argv[i], (unsigned)fields);
+         } else if (mode == "path") {
+             std::istringstream lines(contents);
+             std::string line;
+             while (std::getline(lines, line)) {
+                 printf("%s -> %s\n", line.c_str(), FSPath::normalize(line).c_str());
+             }
+         } else if (mode == "store") {
+             if (!loadLog((const uint8_t*)contents.data(), contents.size())) {
+                 fprintf(stderr, "Cannot write %s\n", HostFS::hostPath(TDECK_MESSAGE_LOG_FILE).c_str());
+                 return 1;
+             }
+             MessageStore store(TDECK_MESSAGE_LOG_FILE, TDECK_MESSAGE_INDEX_FILE);
+             store.open();
+             std::vector<LoRaMessage> messages;
+             store.read(MESSAGE_BROADCAST, 0, store.count(MESSAGE_BROADCAST), messages);
+             printf("%s: %u broadcast messages\n", argv[i], (unsigned)messages.size());
+             for (const LoRaMessage& message : messages) {
+                 printf("  %lu %s %s: %s\n", (unsigned long)message.timestamp, message.incoming ? "<" : ">",
+                        message.sender.c_str(), message.content.c_str());
+             }
+         } else {
+             fprintf(stderr, "Unknown mode %s\n", mode.c_str());
+             return 2;
+         }
+     }
+     return 0;
+ }
+
+ #endif // TDECK_FUZZ
@@ -0,0 +1,384 @@
+/**
+ * @file assets.cpp
+ * @brief Implementation of the flash asset partition
+ */
+
+ #include "assets.h"
+ #include <esp_heap_caps.h>
+ 
+ // Global asset partition instance
+ AssetPartition assets;
+ 
+ // Constructor
+ AssetPartition::AssetPartition()
+     : _partition(nullptr)
+     , _mapped(nullptr)
+     , _mapHandle(0)
+     , _cacheMemory(nullptr)
+     , _cacheNext(0)
+     , _cacheHits(0)
+     , _cacheMisses(0)
+ {
+     memset(&_header, 0, sizeof(_header));
+     memset(_cache, 0, sizeof(_cache));
+ }
+ 
+ // Find the partition, check its header and map it
+ bool AssetPartition::begin() {
+     _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                           TDECK_ASSET_PARTITION);
+     if (!_partition) {
+         TDECK_LOG_W("No asset partition, using built-in fonts and icons");
+         return false;
+     }
+ 
+     if (esp_partition_read(_partition, 0, &_header, sizeof(_header)) != ESP_OK ||
+         _header.magic != ASSET_MAGIC || _header.version != ASSET_VERSION ||
+         _header.size > _partition->size) {
+         TDECK_LOG_W("Asset partition is empty or from another version, run the uploadassets target");
+         _partition = nullptr;
+         return false;
+     }
+ 
+     // The table of contents is kept in RAM either way, it is small and searched often
+     _entries.resize(_header.count);
+     if (esp_partition_read(_partition, sizeof(_header), _entries.data(),
+                            _header.count * sizeof(AssetEntry)) != ESP_OK) {
+         TDECK_LOG_E("Failed to read asset table");
+         _entries.clear();
+         _partition = nullptr;
+         return false;
+     }
+ 
+ #if ESP_IDF_VERSION_MAJOR >= 5
+     esp_partition_mmap_memory_t memory = ESP_PARTITION_MMAP_DATA;
+ #else
+     spi_flash_mmap_memory_t memory = SPI_FLASH_MMAP_DATA;
+ #endif
+     const void* mapped = nullptr;
+     if (esp_partition_mmap(_partition, 0, _header.size, memory, &mapped, &_mapHandle) == ESP_OK) {
+         _mapped = (const uint8_t*)mapped;
+     } else {
+         // Out of cache pages, glyphs are read into PSRAM instead
+         TDECK_LOG_W("Failed to map asset partition, reading glyphs through the cache");
+     }
+ 
+     TDECK_LOG_I("Asset partition: %u assets, %u bytes, %s", _header.count, _header.size,
+                 _mapped ? "mapped" : "not mapped");
+     return true;
+ }
+ 
+ // Check whether the partition is mapped
+ bool AssetPartition::isMapped() const {
+     return _mapped != nullptr;
+ }
+ 
+ // Find an entry by name and type
+ const AssetEntry* AssetPartition::find(const char* name, uint8_t type) const {
+     size_t low = 0;
+     size_t high = _entries.size();
+ 
+     // The packer sorts entries by name
+     while (low < high) {
+         size_t mid = (low + high) / 2;
+         int cmp = strncmp(_entries[mid].name, name, ASSET_NAME_LENGTH);
+         if (cmp == 0) {
+             return _entries[mid].type == type ? &_entries[mid] : nullptr;
+         }
+         if (cmp < 0) {
+             low = mid + 1;
+         } else {
+             high = mid;
+         }
+     }
+     return nullptr;
+ }
+ 
+ // Get a font
+ const lv_font_t* AssetPartition::getFont(const char* name, const lv_font_t* fallback) {
+     for (LoadedFont* loaded : _fonts) {
+         if (strncmp(loaded->name, name, ASSET_NAME_LENGTH) == 0) {
+             return &loaded->font;
+         }
+     }
+ 
+     const AssetEntry* entry = _partition ? find(name, ASSET_TYPE_FONT) : nullptr;
+     if (!entry) {
+         return fallback;
+     }
+ 
+     LoadedFont* loaded = new LoadedFont();
+     memset(loaded, 0, sizeof(LoadedFont));
+     strncpy(loaded->name, name, ASSET_NAME_LENGTH - 1);
+ 
+     uint32_t glyphsOffset = entry->offset + sizeof(AssetFont);
+     size_t glyphsSize = 0;
+     if (esp_partition_read(_partition, entry->offset, &loaded->header, sizeof(AssetFont)) == ESP_OK) {
+         glyphsSize = loaded->header.glyphCount * sizeof(AssetGlyph);
+     }
+     loaded->bitmapOffset = glyphsOffset + glyphsSize;
+ 
+     if (_mapped) {
+         loaded->glyphs = (const AssetGlyph*)(_mapped + glyphsOffset);
+         loaded->bitmaps = _mapped + loaded->bitmapOffset;
+     } else {
+         // Looking glyphs up must not hit flash, the bitmaps go through the cache
+         AssetGlyph* glyphs = (AssetGlyph*)heap_caps_malloc(glyphsSize, MALLOC_CAP_SPIRAM);
+         if (!glyphs || esp_partition_read(_partition, glyphsOffset, glyphs, glyphsSize) != ESP_OK) {
+             TDECK_LOG_E("Failed to load font %s", name);
+             heap_caps_free(glyphs);
+             delete loaded;
+             return fallback;
+         }
+         loaded->glyphs = glyphs;
+     }
+ 
+     lv_font_t& font = loaded->font;
+     font.get_glyph_dsc = getGlyphDsc;
+     font.get_glyph_bitmap = getGlyphBitmap;
+     font.line_height = loaded->header.lineHeight;
+     font.base_line = loaded->header.baseLine;
+     font.subpx = LV_FONT_SUBPX_NONE;
+     font.underline_position = loaded->header.underlinePosition;
+     font.underline_thickness = loaded->header.underlineThickness;
+     font.dsc = loaded;
+     font.user_data = this;
+ 
+     // Symbols the asset lacks come from the built-in font
+     font.fallback = fallback;
+ 
+     _fonts.push_back(loaded);
+     return &font;
+ }
+ 
+ // Get an image
+ const lv_img_dsc_t* AssetPartition::getImage(const char* name, const lv_img_dsc_t* fallback) {
+     for (LoadedImage* loaded : _images) {
+         if (strncmp(loaded->name, name, ASSET_NAME_LENGTH) == 0) {
+             return &loaded->image;
+         }
+     }
+ 
+     // Pixels are only read in place, an unmapped partition keeps the built-in image
+     const AssetEntry* entry = _mapped ? find(name, ASSET_TYPE_IMAGE) : nullptr;
+     if (!entry) {
+         return fallback;
+     }
+ 
+     const AssetImage* header = (const AssetImage*)(_mapped + entry->offset);
+     LoadedImage* loaded = new LoadedImage();
+     memset(loaded, 0, sizeof(LoadedImage));
+     strncpy(loaded->name, name, ASSET_NAME_LENGTH - 1);
+ 
+     lv_img_dsc_t& image = loaded->image;
+     image.header.always_zero = 0;
+     image.header.w = header->width;
+     image.header.h = header->height;
+     image.header.cf = header->format == ASSET_IMAGE_RGB565A8 ? LV_IMG_CF_TRUE_COLOR_ALPHA : LV_IMG_CF_TRUE_COLOR;
+     image.data_size = entry->size - sizeof(AssetImage);
+     image.data = (const uint8_t*)(header + 1);
+ 
+     _images.push_back(loaded);
+     return &image;
+ }
+ 
+ // Get an image of an atlas
+ const lv_img_dsc_t* AssetPartition::getAtlasImage(const char* atlas, const char* name,
+                                                   const lv_img_dsc_t* fallback) {
+     for (LoadedImage* loaded : _images) {
+         if (strncmp(loaded->name, name, ASSET_NAME_LENGTH) == 0) {
+             return &loaded->image;
+         }
+     }
+ 
+     LoadedAtlas* loadedAtlas = _partition ? loadAtlas(atlas) : nullptr;
+     if (!loadedAtlas) {
+         return fallback;
+     }
+ 
+     for (const AssetAtlasImage& sub : loadedAtlas->images) {
+         if (strncmp(sub.name, name, ASSET_NAME_LENGTH) != 0) {
+             continue;
+         }
+ 
+         bool alpha = loadedAtlas->header.format == ASSET_IMAGE_RGB565A8;
+         uint32_t size = (uint32_t)sub.width * sub.height * (alpha ? 3 : 2);
+         if (sub.offset + size > loadedAtlas->pixelsSize) {
+             break;
+         }
+ 
+         LoadedImage* loaded = new LoadedImage();
+         memset(loaded, 0, sizeof(LoadedImage));
+         strncpy(loaded->name, name, ASSET_NAME_LENGTH - 1);
+ 
+         // The descriptor points into the shared block, LVGL draws it as any other image
+         lv_img_dsc_t& image = loaded->image;
+         image.header.always_zero = 0;
+         image.header.w = sub.width;
+         image.header.h = sub.height;
+         image.header.cf = alpha ? LV_IMG_CF_TRUE_COLOR_ALPHA : LV_IMG_CF_TRUE_COLOR;
+         image.data_size = size;
+         image.data = loadedAtlas->pixels + sub.offset;
+ 
+         _images.push_back(loaded);
+         return &image;
+     }
+ 
+     TDECK_LOG_W("Atlas %s has no image %s", atlas, name);
+     return fallback;
+ }
+ 
+ // Load an atlas on first use
+ AssetPartition::LoadedAtlas* AssetPartition::loadAtlas(const char* name) {
+     for (LoadedAtlas* loaded : _atlases) {
+         if (strncmp(loaded->name, name, ASSET_NAME_LENGTH) == 0) {
+             return loaded;
+         }
+     }
+ 
+     const AssetEntry* entry = find(name, ASSET_TYPE_ATLAS);
+     if (!entry) {
+         return nullptr;
+     }
+ 
+     AssetAtlas header;
+     if (esp_partition_read(_partition, entry->offset, &header, sizeof(header)) != ESP_OK) {
+         TDECK_LOG_E("Failed to read atlas %s", name);
+         return nullptr;
+     }
+     uint32_t tableSize = header.count * sizeof(AssetAtlasImage);
+     if (sizeof(AssetAtlas) + tableSize > entry->size) {
+         TDECK_LOG_E("Atlas %s is truncated", name);
+         return nullptr;
+     }
+ 
+     LoadedAtlas* loaded = new LoadedAtlas();
+     strncpy(loaded->name, name, ASSET_NAME_LENGTH - 1);
+     loaded->header = header;
+     loaded->images.resize(header.count);
+     loaded->pixelsSize = entry->size - sizeof(AssetAtlas) - tableSize;
+ 
+     uint32_t pixelsOffset = entry->offset + sizeof(AssetAtlas) + tableSize;
+     bool ok = esp_partition_read(_partition, entry->offset + sizeof(AssetAtlas), loaded->images.data(),
+                                  tableSize) == ESP_OK;
+     if (ok && _mapped) {
+         loaded->pixels = _mapped + pixelsOffset;
+     } else if (ok) {
+         // A small block, one read keeps every icon ready to draw without touching flash again
+         uint8_t* pixels = (uint8_t*)heap_caps_malloc(loaded->pixelsSize, MALLOC_CAP_SPIRAM);
+         ok = pixels && esp_partition_read(_partition, pixelsOffset, pixels, loaded->pixelsSize) == ESP_OK;
+         if (!ok) {
+             heap_caps_free(pixels);
+         }
+         loaded->pixels = pixels;
+     }
+     if (!ok) {
+         TDECK_LOG_E("Failed to load atlas %s", name);
+         delete loaded;
+         return nullptr;
+     }
+ 
+     TDECK_LOG_I("Atlas %s: %u images, %u bytes %s", name, header.count, (unsigned)loaded->pixelsSize,
+                 _mapped ? "mapped" : "in PSRAM");
+     _atlases.push_back(loaded);
+     return loaded;
+ }
+ 
+ // Get glyph cache statistics
+ void AssetPartition::getCacheStats(uint32_t& hits, uint32_t& misses) const {
+     hits = _cacheHits;
+     misses = _cacheMisses;
+ }
+ 
+ // Find a glyph of a font
+ const AssetGlyph* AssetPartition::findGlyph(const LoadedFont* font, uint32_t codepoint) {
+     size_t low = 0;
+     size_t high = font->header.glyphCount;
+ 
+     while (low < high) {
+         size_t mid = (low + high) / 2;
+         uint32_t found = font->glyphs[mid].codepoint;
+         if (found == codepoint) {
+             return &font->glyphs[mid];
+         }
+         if (found < codepoint) {
+             low = mid + 1;
+         } else {
+             high = mid;
+         }
+     }
+     return nullptr;
+ }
+ 
+ // Read a glyph bitmap through the PSRAM cache
+ const uint8_t* AssetPartition::cachedBitmap(const LoadedFont* font, const AssetGlyph* glyph) {
+     for (CacheSlot& slot : _cache) {
+         if (slot.font == font && slot.codepoint == glyph->codepoint) {
+             _cacheHits++;
+             return slot.bitmap;
+         }
+     }
+ 
+     size_t size = (glyph->boxWidth * glyph->boxHeight * font->header.bpp + 7) / 8;
+     if (size > TDECK_ASSET_GLYPH_MAX_BYTES) {
+         return nullptr;
+     }
+ 
+     if (!_cacheMemory) {
+         _cacheMemory = (uint8_t*)heap_caps_malloc(TDECK_ASSET_GLYPH_CACHE_SLOTS * TDECK_ASSET_GLYPH_MAX_BYTES,
+                                                   MALLOC_CAP_SPIRAM);
+         if (!_cacheMemory) {
+             return nullptr;
+         }
+         for (size_t i = 0; i < TDECK_ASSET_GLYPH_CACHE_SLOTS; i++) {
+             _cache[i].bitmap = _cacheMemory + i * TDECK_ASSET_GLYPH_MAX_BYTES;
+         }
+     }
+ 
+     // Round robin, the slot just returned is never the one replaced next
+     CacheSlot& slot = _cache[_cacheNext];
+     _cacheNext = (_cacheNext + 1) % TDECK_ASSET_GLYPH_CACHE_SLOTS;
+ 
+     _cacheMisses++;
+     if (esp_partition_read(_partition, font->bitmapOffset + glyph->bitmapOffset, slot.bitmap, size) != ESP_OK) {
+         slot.font = nullptr;
+         return nullptr;
+     }
+ 
+     slot.font = font;
+     slot.codepoint = glyph->codepoint;
+     return slot.bitmap;
+ }
+ 
+ // LVGL asks for the metrics of a glyph
+ bool AssetPartition::getGlyphDsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t next) {
+     const LoadedFont* loaded = (const LoadedFont*)font->dsc;
+     const AssetGlyph* glyph = findGlyph(loaded, letter);
+     if (!glyph) {
+         return false;
+     }
+ 
+     dsc->adv_w = (glyph->advance + 8) >> 4;
+     dsc->box_w = glyph->boxWidth;
+     dsc->box_h = glyph->boxHeight;
+     dsc->ofs_x = glyph->offsetX;
+     dsc->ofs_y = glyph->offsetY;
+     dsc->bpp = loaded->header.bpp;
+     return true;
+ }
+ 
+ // LVGL asks for the bitmap of a glyph, right before drawing it
+ const uint8_t* AssetPartition::getGlyphBitmap(const lv_font_t* font, uint32_t letter) {
+     const LoadedFont* loaded = (const LoadedFont*)font->dsc;
+     const AssetGlyph* glyph = findGlyph(loaded, letter);
+     if (!glyph) {
+         return nullptr;
+     }
+ 
+     if (loaded->bitmaps) {
+         return loaded->bitmaps + glyph->bitmapOffset;
+     }
+ 
+     AssetPartition* self = (AssetPartition*)font->user_data;
+     return self->cachedBitmap(loaded, glyph);
+ }
\ No newline at end of file
@@ -0,0 +1,246 @@
+/**
+ * @file assets.h
+ * @brief Fonts and icons read in place from the flash asset partition
+ *
+ * tools/pack_assets.py packs the files listed in assets/assets.json into one
+ * image at build time, which is flashed to the "assets" partition. At boot
+ * the partition is mapped into the data address space, so LVGL reads glyph
+ * and pixel data straight from flash through the cache. If mapping fails,
+ * fonts fall back to reading glyphs into a small PSRAM cache and images to
+ * the built-in copies.
+ *
+ * Icons drawn together, such as the launcher's, are packed as an atlas: one
+ * block of pixels in a single format with a table of sub-images. Each
+ * sub-image is a plain LVGL true color image pointing into the block, so
+ * drawing one is a copy from flash with nothing to decode.
+ */
+
+ #ifndef TDECK_ASSETS_H
+ #define TDECK_ASSETS_H
+ 
+ #include <Arduino.h>
+ #include <lvgl.h>
+ #include <esp_partition.h>
+ #include <vector>
+ #include "../config.h"
+ 
+ // Image layout, shared with tools/pack_assets.py, all fields little endian
+ #define ASSET_MAGIC 0x53414454      // "TDAS"
+ #define ASSET_VERSION 1
+ #define ASSET_NAME_LENGTH 20
+ 
+ // Asset types
+ #define ASSET_TYPE_RAW 0
+ #define ASSET_TYPE_IMAGE 1
+ #define ASSET_TYPE_FONT 2
+ #define ASSET_TYPE_ATLAS 3
+ 
+ // Pixel formats of image assets
+ #define ASSET_IMAGE_RGB565 0        // 2 bytes per pixel
+ #define ASSET_IMAGE_RGB565A8 1      // 2 bytes of color then 1 of alpha per pixel
+ 
+ // Partition header, followed by count entries sorted by name
+ struct AssetHeader {
+     uint32_t magic;
+     uint16_t version;
+     uint16_t count;
+     uint32_t size;          // Bytes used in the partition
+     uint32_t reserved;
+ };
+ 
+ // Table of contents entry, offset from the start of the partition, 4-byte aligned
+ struct AssetEntry {
+     char name[ASSET_NAME_LENGTH];
+     uint8_t type;
+     uint8_t reserved[3];
+     uint32_t offset;
+     uint32_t size;
+ };
+ 
+ // Image asset, followed by the pixels
+ struct AssetImage {
+     uint16_t width;
+     uint16_t height;
+     uint8_t format;
+     uint8_t reserved[3];
+ };
+ 
+ // Atlas asset, followed by count sub-images, then the pixels of all of them
+ struct AssetAtlas {
+     uint16_t count;
+     uint8_t format;         // Pixel format shared by every sub-image
+     uint8_t reserved;
+ };
+ 
+ // One image of an atlas, its rows are packed back to back
+ struct AssetAtlasImage {
+     char name[ASSET_NAME_LENGTH];
+     uint16_t width;
+     uint16_t height;
+     uint32_t offset;        // From the first pixel byte of the atlas, 4-byte aligned
+ };
+ 
+ // Font asset, followed by glyphCount glyphs sorted by code point, then the bitmaps
+ struct AssetFont {
+     int16_t lineHeight;
+     int16_t baseLine;
+     int8_t underlinePosition;
+     int8_t underlineThickness;
+     uint8_t bpp;            // Bits per pixel of the glyph bitmaps
+     uint8_t reserved;
+     uint32_t glyphCount;
+ };
+ 
+ // One glyph, a bitmap is box width x height pixels with rows packed back to back
+ struct AssetGlyph {
+     uint32_t codepoint;
+     uint32_t bitmapOffset;  // From the first bitmap byte
+     uint16_t advance;       // 1/16 pixel
+     uint8_t boxWidth;
+     uint8_t boxHeight;
+     int8_t offsetX;
+     int8_t offsetY;
+     uint16_t reserved;
+ };
+ 
+ /**
+  * @class AssetPartition
+  * @brief Looks up fonts and images in the asset partition
+  *
+  * Fonts and images are created on first use and live until reboot. Called
+  * from the UI task only.
+  */
+ class AssetPartition {
+ public:
+     /**
+      * @brief Constructor
+      */
+     AssetPartition();
+ 
+     /**
+      * @brief Find the partition, check its header and map it
+      * @return true if assets can be looked up
+      */
+     bool begin();
+ 
+     /**
+      * @brief Check whether the partition is mapped
+      * @return true if LVGL reads from flash directly
+      */
+     bool isMapped() const;
+ 
+     /**
+      * @brief Get a font
+      * @param name Asset name
+      * @param fallback Font returned when the asset is missing
+      * @return Asset font, or fallback
+      */
+     const lv_font_t* getFont(const char* name, const lv_font_t* fallback = LV_FONT_DEFAULT);
+ 
+     /**
+      * @brief Get an image
+      * @param name Asset name
+      * @param fallback Image returned when the asset is missing or not mapped
+      * @return Asset image, or fallback
+      */
+     const lv_img_dsc_t* getImage(const char* name, const lv_img_dsc_t* fallback = nullptr);
+ 
+     /**
+      * @brief Get an image of an atlas
+      *
+      * The first lookup in an atlas loads it: mapped, the pixels are used in
+      * place, otherwise the whole block is copied to PSRAM in one read.
+      *
+      * @param atlas Atlas asset name
+      * @param name Image name within the atlas
+      * @param fallback Image returned when the atlas or image is missing
+      * @return Atlas image, or fallback
+      */
+     const lv_img_dsc_t* getAtlasImage(const char* atlas, const char* name, const lv_img_dsc_t* fallback = nullptr);
+ 
+     /**
+      * @brief Get glyph cache statistics, only used when the partition is not mapped
+      * @param hits Receives the glyphs found in the cache
+      * @param misses Receives the glyphs read from flash
+      */
+     void getCacheStats(uint32_t& hits, uint32_t& misses) const;
+ 
+ private:
+     // A font built from an asset, dsc of its lv_font_t points here
+     struct LoadedFont {
+         lv_font_t font;
+         char name[ASSET_NAME_LENGTH];
+         AssetFont header;
+         const AssetGlyph* glyphs;   // Mapped, or a PSRAM copy of the glyph table
+         const uint8_t* bitmaps;     // Mapped, nullptr when read through the cache
+         uint32_t bitmapOffset;      // Partition offset of the first bitmap byte
+     };
+ 
+     // An image built from a mapped asset
+     struct LoadedImage {
+         lv_img_dsc_t image;
+         char name[ASSET_NAME_LENGTH];
+     };
+ 
+     // An atlas whose sub-images have been looked up
+     struct LoadedAtlas {
+         char name[ASSET_NAME_LENGTH];
+         AssetAtlas header;
+         std::vector<AssetAtlasImage> images;
+         const uint8_t* pixels;      // Mapped, or a PSRAM copy of the pixel block
+         uint32_t pixelsSize;
+     };
+ 
+     // One cached glyph bitmap
+     struct CacheSlot {
+         const LoadedFont* font;
+         uint32_t codepoint;
+         uint8_t* bitmap;
+     };
+ 
+     const esp_partition_t* _partition;
+     AssetHeader _header;
+     const uint8_t* _mapped;                 // Start of the mapping, nullptr if not mapped
+     spi_flash_mmap_handle_t _mapHandle;
+     std::vector<AssetEntry> _entries;       // Table of contents, sorted by name
+     std::vector<LoadedFont*> _fonts;
+     std::vector<LoadedImage*> _images;
+     std::vector<LoadedAtlas*> _atlases;
+ 
+     CacheSlot _cache[TDECK_ASSET_GLYPH_CACHE_SLOTS];
+     uint8_t* _cacheMemory;
+     uint8_t _cacheNext;                     // Slot replaced on the next miss
+     uint32_t _cacheHits;
+     uint32_t _cacheMisses;
+ 
+     /**
+      * @brief Find an entry by name and type
+      * @return Entry, nullptr if missing
+      */
+     const AssetEntry* find(const char* name, uint8_t type) const;
+ 
+     /**
+      * @brief Load an atlas on first use
+      * @return Atlas, nullptr if missing or unreadable
+      */
+     LoadedAtlas* loadAtlas(const char* name);
+ 
+     /**
+      * @brief Find a glyph of a font
+      * @return Glyph, nullptr if the font does not have it
+      */
+     static const AssetGlyph* findGlyph(const LoadedFont* font, uint32_t codepoint);
+ 
+     /**
+      * @brief Read a glyph bitmap through the PSRAM cache
+      */
+     const uint8_t* cachedBitmap(const LoadedFont* font, const AssetGlyph* glyph);
+ 
+     // LVGL font callbacks
+     static bool getGlyphDsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t next);
+     static const uint8_t* getGlyphBitmap(const lv_font_t* font, uint32_t letter);
+ };
+ 
+ extern AssetPartition assets;
+ 
+ #endif // TDECK_ASSETS_H
\ No newline at end of file
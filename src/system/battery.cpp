@@ -4,16 +4,11 @@
  */
 
  #include "battery.h"
+ #include "../hal/battery_sensor.h"
 
  // Create global instance
  BatteryManager batteryManager;
  
- // ADC configuration values
- #define BATTERY_ADC_PIN TDECK_BATTERY_ADC
- #define ADC_RESOLUTION 4095
- #define ADC_REFERENCE_VOLTAGE 3.3f
- #define BATTERY_VOLTAGE_DIVIDER 2.0f  // Assuming a voltage divider is used
- 
  // Update interval in milliseconds (check battery every 10 seconds)
  #define BATTERY_UPDATE_INTERVAL 10000
  
@@ -24,33 +19,15 @@
      _wasLow(false),
      _wasCritical(false),
      _lastUpdateTime(0),
-     _readIndex(0),
-     _voltageTotal(0),
      _lowBatteryCallback(nullptr),
      _criticalBatteryCallback(nullptr) {
-     
-     // Initialize voltage readings array
-     for (int i = 0; i < VOLTAGE_READINGS; i++) {
-         _voltageReadings[i] = 0;
-     }
  }
  
  bool BatteryManager::init() {
      TDECK_LOG_I("Initializing battery management system");
      
-     // Configure ADC
-     analogReadResolution(12);  // 12-bit resolution for ESP32
-     pinMode(BATTERY_ADC_PIN, INPUT);
-     
-     // Take initial readings for averaging
-     for (int i = 0; i < VOLTAGE_READINGS; i++) {
-         _voltageReadings[i] = readVoltage();
-         _voltageTotal += _voltageReadings[i];
-         delay(10);
-     }
-     
-     // Calculate initial voltage and percentage
-     _voltage = _voltageTotal / VOLTAGE_READINGS;
+     // The battery sensor owns the ADC and has taken its first reading
+     _voltage = batterySensor.getVoltage();
      _percentage = calculatePercentage(_voltage);
      
      TDECK_LOG_I("Battery initialized. Initial voltage: %.2fV, Percentage: %d%%", 
@@ -69,20 +46,8 @@
      
      _lastUpdateTime = currentTime;
      
-     // Subtract the oldest reading
-     _voltageTotal -= _voltageReadings[_readIndex];
-     
-     // Read new voltage
-     _voltageReadings[_readIndex] = readVoltage();
-     
-     // Add the new reading to the total
-     _voltageTotal += _voltageReadings[_readIndex];
-     
-     // Advance to the next position in the array
-     _readIndex = (_readIndex + 1) % VOLTAGE_READINGS;
-     
-     // Calculate the average
-     _voltage = _voltageTotal / VOLTAGE_READINGS;
+     // Filtered voltage published by the battery sensor service
+     _voltage = batterySensor.getVoltage();
      
      // Update percentage
      _percentage = calculatePercentage(_voltage);
@@ -140,29 +105,7 @@
      _criticalBatteryCallback = callback;
  }
  
- float BatteryManager::readVoltage() {
-     // Read raw ADC value
-     int rawValue = analogRead(BATTERY_ADC_PIN);
-     
-     // Convert ADC value to voltage
-     float pinVoltage = (rawValue / (float)ADC_RESOLUTION) * ADC_REFERENCE_VOLTAGE;
-     
-     // Calculate actual battery voltage using voltage divider
-     float batteryVoltage = pinVoltage * BATTERY_VOLTAGE_DIVIDER;
-     
-     // Optional: Apply any calibration offset if needed
-     
-     return batteryVoltage;
- }
- 
  int BatteryManager::calculatePercentage(float voltage) {
-     // Simple linear mapping from voltage to percentage
-     float percentage = (voltage - TDECK_BATTERY_MIN_VOLTAGE) / 
-                       (TDECK_BATTERY_MAX_VOLTAGE - TDECK_BATTERY_MIN_VOLTAGE) * 100.0f;
-     
-     // Clamp percentage between 0 and 100
-     if (percentage < 0) percentage = 0;
-     if (percentage > 100) percentage = 100;
-     
-     return (int)percentage;
+     // LiPo discharge curve, the cell voltage is far from linear in charge
+     return BatterySensor::voltageToPercentage(voltage);
  }
\ No newline at end of file
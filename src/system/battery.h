@@ -85,7 +85,6 @@
      void setCriticalBatteryCallback(void (*callback)());
  
  private:
-     float readVoltage();                   // Read raw voltage from ADC
      int calculatePercentage(float voltage); // Calculate percentage from voltage
  
      // Battery status
@@ -96,12 +95,6 @@
      bool _wasCritical;                     // Previous critical battery state
      unsigned long _lastUpdateTime;         // Last update timestamp
  
-     // Smoothing filter values
-     static const int VOLTAGE_READINGS = 10; // Number of readings to average
-     float _voltageReadings[VOLTAGE_READINGS]; // Array of recent voltage readings
-     int _readIndex;                         // Current reading index
-     float _voltageTotal;                    // Total for calculating average
- 
      // Callback functions
      void (*_lowBatteryCallback)();         // Low battery callback
      void (*_criticalBatteryCallback)();    // Critical battery callback
@@ -0,0 +1,75 @@
+/**
+ * @file boot_timeline.cpp
+ * @brief Implementation of the boot stage timeline
+ */
+
+ #include "boot_timeline.h"
+ 
+ // Global timeline instance
+ BootTimeline bootTimeline;
+ 
+ // Constructor
+ BootTimeline::BootTimeline()
+     : _count(0)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+ }
+ 
+ // Record that a stage has finished
+ void BootTimeline::mark(const char* name) {
+     uint32_t now = micros();
+ 
+     portENTER_CRITICAL(&_lock);
+     if (_count < TDECK_BOOT_TIMELINE_MAX) {
+         _stages[_count].name = name;
+         _stages[_count].micros = now;
+         _count++;
+     }
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Log every stage
+ void BootTimeline::print() const {
+     BootStage stage;
+     uint32_t previous = 0;
+ 
+     TDECK_LOG_I("Boot timeline:");
+     for (size_t i = 0; getStage(i, stage); i++) {
+         TDECK_LOG_I("  %8lu us  +%7lu us  %s", (unsigned long)stage.micros,
+                     (unsigned long)(stage.micros - previous), stage.name);
+         previous = stage.micros;
+     }
+ }
+ 
+ // Get the number of recorded stages
+ size_t BootTimeline::getCount() const {
+     portENTER_CRITICAL(&_lock);
+     size_t count = _count;
+     portEXIT_CRITICAL(&_lock);
+     return count;
+ }
+ 
+ // Get a recorded stage
+ bool BootTimeline::getStage(size_t index, BootStage& stage) const {
+     bool found = false;
+ 
+     portENTER_CRITICAL(&_lock);
+     if (index < _count) {
+         stage = _stages[index];
+         found = true;
+     }
+     portEXIT_CRITICAL(&_lock);
+     return found;
+ }
+ 
+ // Get the time a stage finished
+ uint32_t BootTimeline::getMicros(const char* name) const {
+     BootStage stage;
+ 
+     for (size_t i = 0; getStage(i, stage); i++) {
+         if (strcmp(stage.name, name) == 0) {
+             return stage.micros;
+         }
+     }
+     return 0;
+ }
\ No newline at end of file
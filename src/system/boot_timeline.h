@@ -0,0 +1,76 @@
+/**
+ * @file boot_timeline.h
+ * @brief Timestamps of the boot stages
+ *
+ * Each stage of setup() and of the radio bring-up tasks records the time it
+ * finished, counted from the start of the application. The timeline is
+ * printed once the last radio is up and kept for the System Info app.
+ */
+
+ #ifndef TDECK_BOOT_TIMELINE_H
+ #define TDECK_BOOT_TIMELINE_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // One finished boot stage
+ struct BootStage {
+     const char* name;       // Stage name, a string literal
+     uint32_t micros;        // micros() when the stage finished
+ };
+ 
+ /**
+  * @class BootTimeline
+  * @brief Fixed table of boot stage timestamps
+  *
+  * mark() may be called from any task, stages past
+  * TDECK_BOOT_TIMELINE_MAX are dropped.
+  */
+ class BootTimeline {
+ public:
+     /**
+      * @brief Constructor
+      */
+     BootTimeline();
+ 
+     /**
+      * @brief Record that a stage has finished
+      * @param name Stage name, must outlive the timeline
+      */
+     void mark(const char* name);
+ 
+     /**
+      * @brief Log every stage with its time and the time since the previous one
+      */
+     void print() const;
+ 
+     /**
+      * @brief Get the number of recorded stages
+      * @return Stage count
+      */
+     size_t getCount() const;
+ 
+     /**
+      * @brief Get a recorded stage, in the order they finished
+      * @param index Stage number
+      * @param stage Receives the stage
+      * @return true if index is a recorded stage
+      */
+     bool getStage(size_t index, BootStage& stage) const;
+ 
+     /**
+      * @brief Get the time a stage finished
+      * @param name Stage name
+      * @return micros() of the first stage of that name, 0 if not recorded
+      */
+     uint32_t getMicros(const char* name) const;
+ 
+ private:
+     BootStage _stages[TDECK_BOOT_TIMELINE_MAX];
+     uint8_t _count;                 // Recorded stages
+     mutable portMUX_TYPE _lock;     // Guards the table, radio tasks mark concurrently
+ };
+ 
+ extern BootTimeline bootTimeline;
+ 
+ #endif // TDECK_BOOT_TIMELINE_H
\ No newline at end of file
@@ -27,7 +27,19 @@
  #define JSON_SIZE_POWER 512
  #define JSON_SIZE_CUSTOM 1024
  
+ // Smallest document allocated for a parsed configuration file
+ #define JSON_SIZE_MIN 256
+ 
  ConfigStorage::ConfigStorage() : _initialized(false) {
+     for (CacheEntry& entry : _cache) {
+         entry.doc = nullptr;
+         entry.dirtyKeys = 0;
+         entry.generation = 0;
+         entry.firstChange = 0;
+         entry.lastChange = 0;
+     }
+     _mutex = xSemaphoreCreateMutex();
+     _writeMutex = xSemaphoreCreateMutex();
  }
  
  bool ConfigStorage::init() {
@@ -95,7 +107,7 @@
      }
      
      const char* path = getCategoryPath(category);
-     bool result = fsManager.loadJsonFromFile(path, doc);
+     bool result = read(path, doc);
      
      if (!result) {
          TDECK_LOG_E("Failed to load configuration from %s", path);
@@ -116,12 +128,10 @@
      }
      
      const char* path = getCategoryPath(category);
-     bool result = fsManager.saveJsonToFile(path, doc);
+     bool result = write(path, doc);
      
      if (!result) {
          TDECK_LOG_E("Failed to save configuration to %s", path);
-     } else {
-         TDECK_LOG_I("Configuration saved to %s", path);
      }
      
      return result;
@@ -134,7 +144,7 @@
      }
      
      String path = getCustomConfigPath(name);
-     bool result = fsManager.loadJsonFromFile(path.c_str(), doc);
+     bool result = read(path.c_str(), doc);
      
      if (!result) {
          TDECK_LOG_E("Failed to load custom configuration from %s", path.c_str());
@@ -150,12 +160,10 @@
      }
      
      String path = getCustomConfigPath(name);
-     bool result = fsManager.saveJsonToFile(path.c_str(), doc);
+     bool result = write(path.c_str(), doc);
      
      if (!result) {
          TDECK_LOG_E("Failed to save custom configuration to %s", path.c_str());
-     } else {
-         TDECK_LOG_I("Custom configuration saved to %s", path.c_str());
      }
      
      return result;
@@ -213,8 +221,13 @@
          return false;
      }
      
+     // Parses the file into the cache, so init() reads each category once
      const char* path = getCategoryPath(category);
-     return fsManager.exists(path);
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     CacheEntry* entry = lookup(path);
+     bool exists = entry && entry->doc;
+     xSemaphoreGive(_mutex);
+     return exists;
  }
  
  bool ConfigStorage::deleteConfig(ConfigCategory category) {
@@ -224,7 +237,253 @@
      }
      
      const char* path = getCategoryPath(category);
-     return fsManager.deleteFile(path);
+     return remove(path);
+ }
+ 
+ bool ConfigStorage::read(const char* path, JsonDocument& doc) {
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     CacheEntry* entry = lookup(path);
+     bool found = entry && entry->doc;
+     if (found) {
+         doc.set(*entry->doc);
+     }
+     xSemaphoreGive(_mutex);
+     
+     if (found && doc.overflowed()) {
+         TDECK_LOG_W("Configuration %s truncated, document too small", path);
+     }
+     return found;
+ }
+ 
+ bool ConfigStorage::write(const char* path, const JsonDocument& doc) {
+     JsonObjectConst changes = doc.as<JsonObjectConst>();
+     if (changes.isNull()) {
+         TDECK_LOG_E("Configuration for %s is not an object", path);
+         return false;
+     }
+     
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     CacheEntry* entry = lookup(path);
+     if (!entry) {
+         xSemaphoreGive(_mutex);
+         return false;
+     }
+     
+     // Only keys that actually changed dirty the file
+     uint16_t changed = 0;
+     for (JsonPairConst kv : changes) {
+         if (!entry->doc || (*entry->doc)[kv.key().c_str()] != kv.value()) {
+             changed++;
+         }
+     }
+     if (changed == 0) {
+         xSemaphoreGive(_mutex);
+         return true;
+     }
+     
+     // Merge into a fresh document so replaced strings do not pile up in the pool
+     size_t capacity = (entry->doc ? entry->doc->memoryUsage() : 0) + doc.memoryUsage() + JSON_SIZE_MIN;
+     DynamicJsonDocument* merged = new DynamicJsonDocument(capacity);
+     if (entry->doc) {
+         merged->set(*entry->doc);
+     }
+     for (JsonPairConst kv : changes) {
+         (*merged)[String(kv.key().c_str())] = kv.value();
+     }
+     if (merged->overflowed()) {
+         delete merged;
+         xSemaphoreGive(_mutex);
+         TDECK_LOG_E("Out of memory updating configuration %s", path);
+         return false;
+     }
+     merged->shrinkToFit();
+     
+     delete entry->doc;
+     entry->doc = merged;
+     
+     uint32_t now = millis();
+     if (entry->dirtyKeys == 0) {
+         entry->firstChange = now;
+     }
+     entry->dirtyKeys += changed;
+     entry->lastChange = now;
+     entry->generation++;
+     xSemaphoreGive(_mutex);
+     return true;
+ }
+ 
+ bool ConfigStorage::remove(const char* path) {
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     for (CacheEntry& entry : _cache) {
+         if (entry.path == path) {
+             delete entry.doc;
+             entry.doc = nullptr;
+             entry.path = "";
+             entry.dirtyKeys = 0;
+             entry.generation++;
+             break;
+         }
+     }
+     xSemaphoreGive(_mutex);
+     
+     return !FSManager::file_exists(path) || FSManager::remove_file(path);
+ }
+ 
+ bool ConfigStorage::flush() {
+     bool success = true;
+     for (int i = 0; i < TDECK_CONFIG_CACHE_ENTRIES; i++) {
+         success &= writeBack(i, true);
+     }
+     return success;
+ }
+ 
+ uint32_t ConfigStorage::service() {
+     for (int i = 0; i < TDECK_CONFIG_CACHE_ENTRIES; i++) {
+         writeBack(i, false);
+     }
+     
+     // Whichever delay runs out first sets the next write-back
+     uint32_t next = UINT32_MAX;
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     uint32_t now = millis();
+     for (const CacheEntry& entry : _cache) {
+         if (entry.dirtyKeys == 0 || !entry.doc) {
+             continue;
+         }
+         uint32_t quiet = now - entry.lastChange;
+         uint32_t pending = now - entry.firstChange;
+         uint32_t remaining = min(quiet < TDECK_CONFIG_WRITE_DELAY_MS ? TDECK_CONFIG_WRITE_DELAY_MS - quiet : 0,
+                                  pending < TDECK_CONFIG_WRITE_MAX_DELAY_MS ? TDECK_CONFIG_WRITE_MAX_DELAY_MS - pending : 0);
+         next = min(next, remaining);
+     }
+     xSemaphoreGive(_mutex);
+     
+     return next;
+ }
+ 
+ ConfigStorage::CacheEntry* ConfigStorage::lookup(const char* path) {
+     CacheEntry* empty = nullptr;
+     CacheEntry* clean = nullptr;
+     for (CacheEntry& entry : _cache) {
+         if (entry.path == path) {
+             return &entry;
+         }
+         if (entry.path.isEmpty()) {
+             empty = empty ? empty : &entry;
+         } else if (entry.dirtyKeys == 0) {
+             clean = clean ? clean : &entry;
+         }
+     }
+     
+     // Prefer an empty slot, otherwise evict a file that has been written back
+     CacheEntry* free = empty ? empty : clean;
+     if (!free) {
+         TDECK_LOG_E("Configuration cache full, cannot hold %s", path);
+         return nullptr;
+     }
+     
+     delete free->doc;
+     free->doc = nullptr;
+     free->path = path;
+     free->dirtyKeys = 0;
+     
+     // Finish a write-back interrupted between removing the old file and renaming the new one
+     String tmpPath = String(path) + ".tmp";
+     if (!FSManager::file_exists(path) && FSManager::file_exists(tmpPath.c_str())) {
+         FSManager::rename_file(tmpPath.c_str(), path);
+     }
+     
+     if (!FSManager::file_exists(path)) {
+         return free;
+     }
+     
+     fs::File file = FSManager::open_file(path, FILE_READ);
+     if (!file) {
+         TDECK_LOG_E("Failed to open configuration %s", path);
+         return free;
+     }
+     
+     DynamicJsonDocument* doc = new DynamicJsonDocument(max((size_t)file.size() * 2, (size_t)JSON_SIZE_MIN));
+     DeserializationError error = deserializeJson(*doc, file);
+     file.close();
+     
+     if (error) {
+         TDECK_LOG_W("Failed to parse configuration %s: %s", path, error.c_str());
+         delete doc;
+         return free;
+     }
+     
+     doc->shrinkToFit();
+     free->doc = doc;
+     return free;
+ }
+ 
+ bool ConfigStorage::writeBack(int slot, bool force) {
+     xSemaphoreTake(_writeMutex, portMAX_DELAY);
+     
+     // Snapshot under the lock, the slow flash write runs without it
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     CacheEntry& entry = _cache[slot];
+     uint32_t now = millis();
+     bool due = entry.dirtyKeys > 0 && entry.doc &&
+                (force || now - entry.lastChange >= TDECK_CONFIG_WRITE_DELAY_MS ||
+                 now - entry.firstChange >= TDECK_CONFIG_WRITE_MAX_DELAY_MS);
+     if (!due) {
+         xSemaphoreGive(_mutex);
+         xSemaphoreGive(_writeMutex);
+         return true;
+     }
+     String path = entry.path;
+     uint16_t dirtyKeys = entry.dirtyKeys;
+     uint32_t generation = entry.generation;
+     DynamicJsonDocument snapshot(*entry.doc);
+     xSemaphoreGive(_mutex);
+     
+     bool success = writeFile(path.c_str(), snapshot);
+     
+     xSemaphoreTake(_mutex, portMAX_DELAY);
+     if (success && entry.generation == generation) {
+         entry.dirtyKeys = 0;
+     } else if (!success) {
+         // Retry after another quiet period
+         entry.lastChange = now;
+         entry.firstChange = now;
+     }
+     xSemaphoreGive(_mutex);
+     xSemaphoreGive(_writeMutex);
+     
+     if (success) {
+         TDECK_LOG_I("Configuration saved to %s (%d keys changed)", path.c_str(), dirtyKeys);
+     }
+     return success;
+ }
+ 
+ bool ConfigStorage::writeFile(const char* path, const JsonDocument& doc) {
+     String tmpPath = String(path) + ".tmp";
+     
+     fs::File file = FSManager::open_file(tmpPath.c_str(), FILE_WRITE);
+     if (!file) {
+         TDECK_LOG_E("Failed to create %s", tmpPath.c_str());
+         return false;
+     }
+     
+     size_t expected = measureJson(doc);
+     size_t written = serializeJson(doc, file);
+     file.close();
+     
+     if (written != expected) {
+         TDECK_LOG_E("Failed to write configuration %s", path);
+         FSManager::remove_file(tmpPath.c_str());
+         return false;
+     }
+     
+     // A reader never sees a half-written file, lookup() completes an interrupted swap
+     FSManager::remove_file(path);
+     if (!FSManager::rename_file(tmpPath.c_str(), path)) {
+         TDECK_LOG_E("Failed to replace configuration %s", path);
+         return false;
+     }
+     return true;
  }
  
  const char* ConfigStorage::getCategoryPath(ConfigCategory category) {
@@ -239,8 +498,8 @@
  }
  
  bool ConfigStorage::ensureConfigDir() {
-     if (!fsManager.exists(TDECK_FS_CONFIG_DIR)) {
-         return fsManager.createDir(TDECK_FS_CONFIG_DIR);
+     if (!FSManager::file_exists(TDECK_FS_CONFIG_DIR)) {
+         return FSManager::create_directory(TDECK_FS_CONFIG_DIR);
      }
      return true;
  }
@@ -5,6 +5,10 @@
  * This class handles saving and loading configuration settings to/from
  * persistent storage on the file system. It includes functionality for
  * handling different configuration categories and defaults.
+ * 
+ * Every configuration file is parsed once and kept in RAM. Reads are served
+ * from the cached copy, changes are tracked per top-level key and a dirty
+ * file is written back once, atomically, after a quiet period.
  */
 
  #ifndef TDECK_CONFIG_STORAGE_H
@@ -12,6 +16,8 @@
  
  #include <Arduino.h>
  #include <ArduinoJson.h>
+ #include <freertos/FreeRTOS.h>
+ #include <freertos/semphr.h>
  #include "../config.h"
  #include "fs_manager.h"
  
@@ -108,9 +114,86 @@
       * @return false if deletion failed
       */
      bool deleteConfig(ConfigCategory category);
+     
+     /**
+      * @brief Read a configuration file through the cache
+      * 
+      * The file is parsed on first access only, later reads copy the cached
+      * document. May be called from any task, before init() as well.
+      * 
+      * @param path Configuration file path
+      * @param doc JsonDocument to receive the configuration
+      * @return true if the configuration exists
+      * @return false if it does not exist or could not be parsed
+      */
+     bool read(const char* path, JsonDocument& doc);
+     
+     /**
+      * @brief Update a configuration file through the cache
+      * 
+      * Top-level keys whose value differs from the cached copy are merged in,
+      * keys missing from doc are kept. The file is written back by service()
+      * once it has not changed for TDECK_CONFIG_WRITE_DELAY_MS.
+      * 
+      * @param path Configuration file path
+      * @param doc JsonDocument holding a JSON object
+      * @return true if the change was accepted
+      * @return false if the cache is full or out of memory
+      */
+     bool write(const char* path, const JsonDocument& doc);
+     
+     /**
+      * @brief Drop a configuration file from the cache and the file system
+      * 
+      * @param path Configuration file path
+      * @return true if the file is gone
+      * @return false if it could not be removed
+      */
+     bool remove(const char* path);
+     
+     /**
+      * @brief Write back every dirty configuration file now
+      * 
+      * Call before restarting or entering deep sleep.
+      * 
+      * @return true if all files were written
+      * @return false if a write failed
+      */
+     bool flush();
+     
+     /**
+      * @brief Write back configuration files whose changes have settled
+      * 
+      * Called periodically from the system task.
+      * 
+      * @return Milliseconds until the next write-back is due, UINT32_MAX if all files are clean
+      */
+     uint32_t service();
  
  private:
+     // One cached configuration file
+     struct CacheEntry {
+         String path;                 // Configuration file, empty if the slot is free
+         DynamicJsonDocument* doc;    // Parsed configuration, nullptr if the file does not exist
+         uint16_t dirtyKeys;          // Keys changed since the last write-back
+         uint32_t generation;         // Bumped on every change
+         uint32_t firstChange;        // millis() of the oldest unwritten change
+         uint32_t lastChange;         // millis() of the newest unwritten change
+     };
+     
      bool _initialized;
+     CacheEntry _cache[TDECK_CONFIG_CACHE_ENTRIES];
+     SemaphoreHandle_t _mutex;        // Guards _cache
+     SemaphoreHandle_t _writeMutex;   // Serializes write-backs
+     
+     // Cache access, caller holds _mutex
+     CacheEntry* lookup(const char* path);
+     
+     // Write one entry back if dirty, forced or once settled
+     bool writeBack(int slot, bool force);
+     
+     // Write a document to a temporary file and rename it into place
+     static bool writeFile(const char* path, const JsonDocument& doc);
      
      // Path getters
      const char* getCategoryPath(ConfigCategory category);
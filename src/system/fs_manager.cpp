@@ -7,7 +7,9 @@
 
  #include "fs_manager.h"
  #include "../config.h"
+ #include "fs_path.h"
  #include "../hal/sdcard.h"
+ #include "../hal/spi_bus.h"
  
  #include <Arduino.h>
  #include <FS.h>
@@ -16,6 +18,8 @@
  #include <SPI.h>
  #include <algorithm>
  #include <vector>
+ #include <list>
+ #include <esp_heap_caps.h>
  #include <dirent.h>
  #include <sys/stat.h>
  
@@ -23,13 +27,71 @@
  static std::string last_error;
  static bool sd_available = false;
  static bool spiffs_available = false;
+ static bool sd_lent = false;                // SD card is a USB block device
+ static int sd_streams = 0;                  // FSStreams open on the SD card
+ static portMUX_TYPE sd_lock = portMUX_INITIALIZER_UNLOCKED;
+ 
+ /**
+  * @brief Asynchronous directory listing request
+  */
+ struct FSListRequest {
+     FSListHandle handle;           ///< Handle returned to the caller
+     std::string path;              ///< Directory to list
+     size_t offset;                 ///< Visible entries to skip
+     size_t limit;                  ///< Maximum entries to deliver, 0 for all
+     size_t batch_size;             ///< Entries per batch
+     FSListBatchCallback callback;  ///< Batch receiver
+ };
+ 
+ /**
+  * @brief Cached listing of one directory
+  * 
+  * Entries are packed into a single PSRAM block as
+  * [size u32][modified u32][is_directory u8][name length u8][name].
+  */
+ struct FSDirCacheEntry {
+     std::string path;              ///< Cache key, normalized without trailing slash
+     uint8_t *data;                 ///< Packed entries in PSRAM
+     size_t size;                   ///< Bytes used by data
+     uint32_t count;                ///< Number of entries
+ };
+ 
+ /**
+  * @brief Result of a metadata cache lookup
+  */
+ enum FSCacheResult {
+     FS_CACHE_MISS,                 ///< Not known, ask the file system
+     FS_CACHE_FOUND,                ///< Entry exists
+     FS_CACHE_ABSENT                ///< Parent listing is cached and has no such entry
+ };
+ 
+ // Directory metadata cache, most recently used first
+ static std::list<FSDirCacheEntry> dir_cache;
+ static size_t dir_cache_bytes = 0;
+ static SemaphoreHandle_t cache_mutex = NULL;
+ 
+ // Async listing worker state
+ static TaskHandle_t list_task = NULL;
+ static QueueHandle_t list_queue = NULL;
+ static portMUX_TYPE list_lock = portMUX_INITIALIZER_UNLOCKED;
+ static FSListHandle list_next_handle = 1;
+ static FSListHandle list_active[TDECK_FS_LIST_MAX_REQUESTS];   // Queued or running handles
+ static volatile bool list_cancelled[TDECK_FS_LIST_MAX_REQUESTS];
  
  // Helper functions
  static fs::FS& get_fs_for_path(const std::string &path);
  static void set_error(const std::string &error);
- static std::string get_fs_type_for_path(const std::string &path);
- static bool is_root_directory(const std::string &path);
- static std::string normalize_path(const std::string &path);
+ static size_t read_bursts(fs::File &file, uint8_t *buffer, size_t size, bool sd);
+ static size_t write_bursts(fs::File &file, const uint8_t *buffer, size_t size, bool sd);
+ static bool list_directory_range(const std::string &path, size_t offset, size_t limit, size_t batch_size,
+                                  const std::function<bool(std::vector<FSFileInfo> &batch)> &on_batch);
+ static void list_task_func(void *arg);
+ static std::string cache_key(const std::string &path);
+ static bool cache_lookup_dir(const std::string &key, std::vector<FSFileInfo> &entries);
+ static void cache_store_dir(const std::string &key, const std::vector<FSFileInfo> &entries);
+ static FSCacheResult cache_lookup_file(const std::string &key, FSFileInfo &info);
+ static bool is_list_cancelled(FSListHandle handle);
+ static void release_list_handle(FSListHandle handle);
  
  /**
   * @brief Initialize the file system
@@ -41,6 +103,11 @@
  bool FSManager::init() {
      TDECK_LOG_I("Initializing file systems");
      
+     // Metadata cache is shared by the UI task and the listing worker
+     if(TDECK_FS_CACHE_BUDGET > 0 && !cache_mutex) {
+         cache_mutex = xSemaphoreCreateMutex();
+     }
+     
      // Initialize SPIFFS
      if(SPIFFS.begin(true)) {
          TDECK_LOG_I("SPIFFS initialized successfully");
@@ -66,11 +133,10 @@
      
      // Initialize SD card
      if(TDECK_FEATURE_SD_CARD) {
-         SPIClass *spi = new SPIClass(HSPI);
-         spi->begin();
+         SPIBusLock bus(SPI_BUS_SD);
          
-         // Mount the SD card with the SD_CS pin and SPI
-         if(SD.begin(TDECK_SD_CS, *spi)) {
+         // Mount the SD card on the SPI host it shares with the display and radio
+         if(SD.begin(TDECK_SD_CS, spiBus.spi(), TDECK_SPI_SD_FREQUENCY)) {
              TDECK_LOG_I("SD card initialized successfully");
              sd_available = true;
          } else {
@@ -91,6 +157,122 @@
      return sd_available;
  }
  
+ /**
+  * @brief Hand the SD card to the USB host as a raw block device
+  * 
+  * @param sector_count Receives the number of sectors
+  * @param sector_size Receives the sector size in bytes
+  * @return true if the card is lent
+  */
+ bool FSManager::lend_sd(uint32_t &sector_count, uint16_t &sector_size) {
+     if(!sd_available || sd_lent) {
+         set_error("SD card not mounted");
+         return false;
+     }
+     
+     // Open files would be corrupted by the host and by their own close
+     portENTER_CRITICAL(&sd_lock);
+     bool busy = sd_streams > 0;
+     if(!busy) {
+         sd_available = false;
+         sd_lent = true;
+     }
+     portEXIT_CRITICAL(&sd_lock);
+     if(busy) {
+         set_error("SD card has open files");
+         return false;
+     }
+     
+     invalidate_cache("/sd");
+     
+     // Every file is closed, so FATFS has nothing left to write back
+     SPIBusLock bus(SPI_BUS_SD);
+     sector_count = SD.numSectors();
+     sector_size = SD.sectorSize();
+     TDECK_LOG_I("SD card lent to USB host (%lu sectors)", (unsigned long)sector_count);
+     return true;
+ }
+ 
+ /**
+  * @brief Take the SD card back from the USB host and remount it
+  * 
+  * @return true if the card is mounted again
+  */
+ bool FSManager::return_sd() {
+     if(!sd_lent) {
+         return sd_available;
+     }
+     
+     // Remount so FATFS drops what it cached before the host changed the card
+     {
+         SPIBusLock bus(SPI_BUS_SD);
+         SD.end();
+         sd_available = SD.begin(TDECK_SD_CS, spiBus.spi(), TDECK_SPI_SD_FREQUENCY);
+     }
+     sd_lent = false;
+     invalidate_cache("/sd");
+     
+     if(sd_available) {
+         TDECK_LOG_I("SD card remounted");
+     } else {
+         TDECK_LOG_E("Failed to remount SD card");
+     }
+     return sd_available;
+ }
+ 
+ /**
+  * @brief Check if the SD card is lent to the USB host
+  * 
+  * @return true between lend_sd() and return_sd()
+  */
+ bool FSManager::is_sd_lent() {
+     return sd_lent;
+ }
+ 
+ /**
+  * @brief Read raw sectors of the lent SD card
+  * 
+  * @param sector First sector
+  * @param buffer Buffer of count sectors
+  * @param count Number of sectors
+  * @return true if every sector was read
+  */
+ bool FSManager::read_sd_sectors(uint32_t sector, uint8_t *buffer, uint32_t count) {
+     if(!sd_lent) {
+         return false;
+     }
+     
+     SPIBusLock bus(SPI_BUS_SD);
+     for(uint32_t i = 0; i < count; i++) {
+         if(!SD.readRAW(buffer + i * SD.sectorSize(), sector + i)) {
+             return false;
+         }
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Write raw sectors of the lent SD card
+  * 
+  * @param sector First sector
+  * @param buffer Data of count sectors
+  * @param count Number of sectors
+  * @return true if every sector was written
+  */
+ bool FSManager::write_sd_sectors(uint32_t sector, const uint8_t *buffer, uint32_t count) {
+     if(!sd_lent) {
+         return false;
+     }
+     
+     SPIBusLock bus(SPI_BUS_SD);
+     for(uint32_t i = 0; i < count; i++) {
+         if(!SD.writeRAW(const_cast<uint8_t*>(buffer) + i * SD.sectorSize(), sector + i)) {
+             return false;
+         }
+     }
+     return true;
+ }
+ 
  /**
   * @brief List contents of a directory
   * 
@@ -99,75 +281,91 @@
   * @return true if successful
   */
  bool FSManager::list_directory(const std::string &path, std::vector<FSFileInfo> &entries) {
-     std::string norm_path = normalize_path(path);
-     fs::FS &fs = get_fs_for_path(norm_path);
+     return list_directory_range(path, 0, 0, SIZE_MAX,
+                                 [&entries](std::vector<FSFileInfo> &batch) {
+                                     entries.insert(entries.end(), batch.begin(), batch.end());
+                                     return true;
+                                 });
+ }
+ 
+ /**
+  * @brief List contents of a directory on the file system worker task
+  * 
+  * @param path Directory path
+  * @param callback Callback receiving the batches
+  * @param offset Number of visible entries to skip
+  * @param limit Maximum number of entries to deliver, 0 for all
+  * @param batch_size Entries per batch
+  * @return Handle of the listing, or 0 if it could not be queued
+  */
+ FSListHandle FSManager::list_directory_async(const std::string &path, FSListBatchCallback callback,
+                                              size_t offset, size_t limit, size_t batch_size) {
+     if(!callback || batch_size == 0) {
+         return 0;
+     }
      
-     if(norm_path == "/") {
-         // Special case for root: show both filesystems if available
-         if(spiffs_available) {
-             FSFileInfo spiffs_entry;
-             spiffs_entry.name = "flash";
-             spiffs_entry.is_directory = true;
-             spiffs_entry.size = 0;
-             spiffs_entry.modified_time = 0;
-             entries.push_back(spiffs_entry);
+     // Start the worker on first use
+     if(!list_task) {
+         list_queue = xQueueCreate(TDECK_FS_LIST_MAX_REQUESTS, sizeof(FSListRequest*));
+         if(!list_queue ||
+            xTaskCreatePinnedToCore(list_task_func, "FS_List", 4096, NULL,
+                                    TDECK_SYSTEM_TASK_PRIORITY, &list_task, 0) != pdPASS) {
+             set_error("Failed to start directory listing worker");
+             TDECK_LOG_E("Failed to start directory listing worker");
+             list_task = NULL;
+             return 0;
          }
-         
-         if(sd_available) {
-             FSFileInfo sd_entry;
-             sd_entry.name = "sd";
-             sd_entry.is_directory = true;
-             sd_entry.size = 0;
-             sd_entry.modified_time = 0;
-             entries.push_back(sd_entry);
-         }
-         
-         return true;
      }
      
-     // Remove leading slash for non-root FS-specific paths
-     std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
-     if(fs_type == "flash" || fs_type == "sd") {
-         size_t pos = norm_path.find('/', 1);
-         if(pos != std::string::npos) {
-             fs_path = norm_path.substr(pos);
-         } else {
-             fs_path = "/";
+     // Claim a slot so the listing can be cancelled
+     FSListHandle handle = 0;
+     portENTER_CRITICAL(&list_lock);
+     for(int i = 0; i < TDECK_FS_LIST_MAX_REQUESTS; i++) {
+         if(list_active[i] == 0) {
+             handle = list_next_handle++;
+             if(list_next_handle == 0) {
+                 list_next_handle = 1;
+             }
+             list_active[i] = handle;
+             list_cancelled[i] = false;
+             break;
          }
      }
+     portEXIT_CRITICAL(&list_lock);
      
-     File dir = fs.open(fs_path.c_str());
-     if(!dir || !dir.isDirectory()) {
-         set_error("Failed to open directory: " + norm_path);
-         TDECK_LOG_E("Failed to open directory: %s", norm_path.c_str());
-         return false;
+     if(handle == 0) {
+         set_error("Too many directory listings in progress");
+         TDECK_LOG_E("Too many directory listings in progress");
+         return 0;
      }
      
-     File file = dir.openNextFile();
-     while(file) {
-         FSFileInfo entry;
-         entry.name = file.name();
-         
-         // Remove path prefix if present
-         size_t last_slash = entry.name.find_last_of('/');
-         if(last_slash != std::string::npos) {
-             entry.name = entry.name.substr(last_slash + 1);
-         }
-         
-         entry.size = file.size();
-         entry.is_directory = file.isDirectory();
-         entry.modified_time = file.getLastWrite();
-         
-         // Skip hidden files (starting with .)
-         if(entry.name.length() > 0 && entry.name[0] != '.') {
-             entries.push_back(entry);
-         }
-         
-         file = dir.openNextFile();
+     FSListRequest *request = new FSListRequest{handle, path, offset, limit, batch_size, callback};
+     if(xQueueSend(list_queue, &request, 0) != pdTRUE) {
+         release_list_handle(handle);
+         delete request;
+         return 0;
      }
      
-     return true;
+     return handle;
+ }
+ 
+ /**
+  * @brief Cancel an asynchronous directory listing
+  * 
+  * @param handle Listing to cancel
+  */
+ void FSManager::cancel_list(FSListHandle handle) {
+     if(handle == 0) {
+         return;
+     }
+     
+     portENTER_CRITICAL(&list_lock);
+     for(int i = 0; i < TDECK_FS_LIST_MAX_REQUESTS; i++) {
+         if(list_active[i] == handle) {
+             list_cancelled[i] = true;
+         }
+     }
+     portEXIT_CRITICAL(&list_lock);
  }
  
  /**
@@ -177,12 +375,12 @@
   * @return true if successful
   */
  bool FSManager::create_directory(const std::string &path) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -192,7 +390,9 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      if(fs.mkdir(fs_path.c_str())) {
+         invalidate_cache(norm_path);
          TDECK_LOG_I("Created directory: %s", norm_path.c_str());
          return true;
      } else {
@@ -209,11 +409,11 @@
   * @return true if successful
   */
  bool FSManager::remove_directory(const std::string &path) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
      // Prevent deleting root directories
-     if(is_root_directory(norm_path)) {
+     if(FSPath::is_root(norm_path)) {
          set_error("Cannot remove root directory: " + norm_path);
          TDECK_LOG_E("Cannot remove root directory: %s", norm_path.c_str());
          return false;
@@ -221,7 +421,7 @@
      
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -231,7 +431,9 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      if(fs.rmdir(fs_path.c_str())) {
+         invalidate_cache(norm_path);
          TDECK_LOG_I("Removed directory: %s", norm_path.c_str());
          return true;
      } else {
@@ -249,11 +451,11 @@
   * @return true if successful
   */
  bool FSManager::rename_file(const std::string &old_path, const std::string &new_path) {
-     std::string norm_old_path = normalize_path(old_path);
-     std::string norm_new_path = normalize_path(new_path);
+     std::string norm_old_path = FSPath::normalize(old_path);
+     std::string norm_new_path = FSPath::normalize(new_path);
      
      // Make sure both paths are on the same filesystem
-     if(get_fs_type_for_path(norm_old_path) != get_fs_type_for_path(norm_new_path)) {
+     if(FSPath::fs_type(norm_old_path) != FSPath::fs_type(norm_new_path)) {
          set_error("Cannot rename across different filesystems");
          TDECK_LOG_E("Cannot rename across different filesystems: %s to %s", 
                    norm_old_path.c_str(), norm_new_path.c_str());
@@ -265,7 +467,7 @@
      // Remove leading slash for non-root FS-specific paths
      std::string fs_old_path = norm_old_path;
      std::string fs_new_path = norm_new_path;
-     std::string fs_type = get_fs_type_for_path(norm_old_path);
+     std::string fs_type = FSPath::fs_type(norm_old_path);
      
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos_old = norm_old_path.find('/', 1);
@@ -283,7 +485,10 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      if(fs.rename(fs_old_path.c_str(), fs_new_path.c_str())) {
+         invalidate_cache(norm_old_path);
+         invalidate_cache(norm_new_path);
          TDECK_LOG_I("Renamed: %s to %s", norm_old_path.c_str(), norm_new_path.c_str());
          return true;
      } else {
@@ -300,12 +505,12 @@
   * @return true if successful
   */
  bool FSManager::remove_file(const std::string &path) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -315,7 +520,9 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      if(fs.remove(fs_path.c_str())) {
+         invalidate_cache(norm_path);
          TDECK_LOG_I("Removed file: %s", norm_path.c_str());
          return true;
      } else {
@@ -332,12 +539,22 @@
   * @return File size in bytes, or -1 if error
   */
  int64_t FSManager::get_file_size(const std::string &path) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
+     // Answer from the cached parent listing when there is one
+     FSFileInfo info;
+     FSCacheResult cached = cache_lookup_file(cache_key(norm_path), info);
+     if(cached == FS_CACHE_FOUND) {
+         return info.size;
+     } else if(cached == FS_CACHE_ABSENT) {
+         set_error("Failed to open file: " + norm_path);
+         return -1;
+     }
+     
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -347,6 +564,7 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      File file = fs.open(fs_path.c_str(), FILE_READ);
      if(!file) {
          set_error("Failed to open file: " + norm_path);
@@ -368,12 +586,12 @@
   * @return Number of bytes read, or -1 if error
   */
  int64_t FSManager::read_file(const std::string &path, uint8_t *buffer, size_t max_size) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -383,6 +601,7 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      File file = fs.open(fs_path.c_str(), FILE_READ);
      if(!file) {
          set_error("Failed to open file for reading: " + norm_path);
@@ -390,15 +609,9 @@
          return -1;
      }
      
-     int64_t bytes_read = file.read(buffer, max_size);
+     int64_t bytes_read = read_bursts(file, buffer, max_size, fs_type == "sd");
      file.close();
      
-     if(bytes_read < 0) {
-         set_error("Error reading from file: " + norm_path);
-         TDECK_LOG_E("Error reading from file: %s", norm_path.c_str());
-         return -1;
-     }
-     
      return bytes_read;
  }
  
@@ -411,12 +624,12 @@
   * @return Number of bytes written, or -1 if error
   */
  int64_t FSManager::write_file(const std::string &path, const uint8_t *buffer, size_t size) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -426,6 +639,7 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      File file = fs.open(fs_path.c_str(), FILE_WRITE);
      if(!file) {
          set_error("Failed to open file for writing: " + norm_path);
@@ -433,9 +647,12 @@
          return -1;
      }
      
-     int64_t bytes_written = file.write(buffer, size);
+     int64_t bytes_written = write_bursts(file, buffer, size, fs_type == "sd");
      file.close();
      
+     // Size and possibly existence changed, even on a short write
+     invalidate_cache(norm_path);
+     
      if(bytes_written != size) {
          set_error("Error writing to file: " + norm_path);
          TDECK_LOG_E("Error writing to file: %s", norm_path.c_str());
@@ -445,6 +662,45 @@
      return bytes_written;
  }
  
+ /**
+  * @brief Open a file for streaming access
+  * 
+  * @param path File path
+  * @param mode Open mode (FILE_READ, FILE_WRITE, FILE_APPEND)
+  * @return Open file, or an invalid File on error
+  */
+ fs::File FSManager::open_file(const std::string &path, const char *mode) {
+     std::string norm_path = FSPath::normalize(path);
+     fs::FS &fs = get_fs_for_path(norm_path);
+     
+     // Remove leading slash for non-root FS-specific paths
+     std::string fs_path = norm_path;
+     std::string fs_type = FSPath::fs_type(norm_path);
+     if(fs_type == "flash" || fs_type == "sd") {
+         size_t pos = norm_path.find('/', 1);
+         if(pos != std::string::npos) {
+             fs_path = norm_path.substr(pos);
+         } else {
+             fs_path = "/";
+         }
+     }
+     
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
+     File file = fs.open(fs_path.c_str(), mode);
+     if(!file) {
+         set_error("Failed to open file: " + norm_path);
+         TDECK_LOG_E("Failed to open file: %s", norm_path.c_str());
+         return file;
+     }
+     
+     // Anything but a read can change the size or create the file
+     if(strcmp(mode, FILE_READ) != 0) {
+         invalidate_cache(norm_path);
+     }
+     
+     return file;
+ }
+ 
  /**
   * @brief Check if a file exists
   * 
@@ -452,7 +708,7 @@
   * @return true if file exists
   */
  bool FSManager::file_exists(const std::string &path) {
-     std::string norm_path = normalize_path(path);
+     std::string norm_path = FSPath::normalize(path);
      fs::FS &fs = get_fs_for_path(norm_path);
      
      // Special case for virtual root and filesystem roots
@@ -460,9 +716,16 @@
          return true;
      }
      
+     // Answer from the cached parent listing when there is one
+     FSFileInfo info;
+     FSCacheResult cached = cache_lookup_file(cache_key(norm_path), info);
+     if(cached != FS_CACHE_MISS) {
+         return cached == FS_CACHE_FOUND;
+     }
+     
      // Remove leading slash for non-root FS-specific paths
      std::string fs_path = norm_path;
-     std::string fs_type = get_fs_type_for_path(norm_path);
+     std::string fs_type = FSPath::fs_type(norm_path);
      if(fs_type == "flash" || fs_type == "sd") {
          size_t pos = norm_path.find('/', 1);
          if(pos != std::string::npos) {
@@ -472,6 +735,7 @@
          }
      }
      
+     SPIBusLock bus(SPI_BUS_SD, fs_type == "sd");
      return fs.exists(fs_path.c_str());
  }
  
@@ -484,7 +748,7 @@
   * @return true if successful
   */
  bool FSManager::get_space_info(const std::string &path, uint64_t &total_bytes, uint64_t &free_bytes) {
-     std::string fs_type = get_fs_type_for_path(path);
+     std::string fs_type = FSPath::fs_type(path);
      
      if(fs_type == "flash") {
          total_bytes = SPIFFS.totalBytes();
@@ -492,6 +756,7 @@
          return true;
      } else if(fs_type == "sd" && sd_available) {
          // SD card total size and free space
+         SPIBusLock bus(SPI_BUS_SD);
          total_bytes = SD.totalBytes();
          free_bytes = SD.usedBytes();
          return true;
@@ -504,6 +769,33 @@
      }
  }
  
+ /**
+  * @brief Drop cached metadata for a path
+  * 
+  * @param path File or directory path that changed
+  */
+ void FSManager::invalidate_cache(const std::string &path) {
+     if(!cache_mutex) {
+         return;
+     }
+     
+     std::string key = cache_key(path);
+     std::string parent = key.substr(0, std::max<size_t>(key.find_last_of('/'), 1));
+     std::string prefix = key + "/";
+     
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for(auto it = dir_cache.begin(); it != dir_cache.end();) {
+         if(it->path == key || it->path == parent || it->path.compare(0, prefix.length(), prefix) == 0) {
+             dir_cache_bytes -= it->size;
+             heap_caps_free(it->data);
+             it = dir_cache.erase(it);
+         } else {
+             ++it;
+         }
+     }
+     xSemaphoreGive(cache_mutex);
+ }
+ 
  /**
   * @brief Get last file system error
   * 
@@ -513,6 +805,353 @@
      return last_error;
  }
  
+ /**
+  * @brief Construct a closed stream
+  */
+ FSStream::FSStream()
+     : _buffer(nullptr)
+     , _capacity(0)
+     , _start(0)
+     , _length(0)
+     , _dirty(false)
+     , _written(false)
+     , _error(false)
+     , _position(0)
+     , _file_position(0)
+     , _size(0)
+     , _sd(false)
+ {
+ }
+ 
+ /**
+  * @brief Close the stream, flushing pending writes
+  */
+ FSStream::~FSStream() {
+     close();
+ }
+ 
+ /**
+  * @brief Open a file
+  * 
+  * @param path File path
+  * @param mode Open mode (FILE_READ, FILE_WRITE, FILE_APPEND)
+  * @param buffer_size Read-ahead/write-behind buffer in bytes, 0 for unbuffered
+  * @return true if the file was opened
+  */
+ bool FSStream::open(const std::string &path, const char *mode, size_t buffer_size) {
+     close();
+     
+     _file = FSManager::open_file(path, mode);
+     if(!_file) {
+         return false;
+     }
+     
+     // Unbuffered is still correct, only slower
+     if(buffer_size > 0) {
+         _buffer = alloc_buffer(buffer_size);
+         if(_buffer) {
+             _capacity = buffer_size;
+         } else {
+             TDECK_LOG_W("No memory for a %u byte stream buffer, unbuffered: %s", buffer_size, path.c_str());
+         }
+     }
+     
+     _path = path;
+     _sd = FSPath::fs_type(FSPath::normalize(path)) == "sd" && sd_available;
+     if(_sd) {
+         portENTER_CRITICAL(&sd_lock);
+         sd_streams++;
+         portEXIT_CRITICAL(&sd_lock);
+     }
+     _size = _file.size();
+     _position = strcmp(mode, FILE_APPEND) == 0 ? _size : 0;
+     _file_position = _position;
+     _start = 0;
+     _length = 0;
+     _dirty = false;
+     _written = false;
+     _error = false;
+     return true;
+ }
+ 
+ /**
+  * @brief Read from the current position
+  * 
+  * @param buffer Buffer to receive the data
+  * @param size Maximum bytes to read
+  * @return Bytes read, 0 at end of file, or -1 if error
+  */
+ int64_t FSStream::read(uint8_t *buffer, size_t size) {
+     if(!_file) {
+         return -1;
+     }
+     
+     // Pending writes must land before the same bytes are read back
+     if(_dirty && !flush_buffer()) {
+         return -1;
+     }
+     
+     size_t total = 0;
+     while(total < size) {
+         // Serve what the read-ahead block already holds
+         if(_length > 0 && _position >= _start && _position < _start + _length) {
+             size_t offset = _position - _start;
+             size_t count = std::min(size - total, _length - offset);
+             memcpy(buffer + total, _buffer + offset, count);
+             total += count;
+             _position += count;
+             continue;
+         }
+         
+         size_t remaining = size - total;
+         if(!_buffer || remaining >= _capacity) {
+             // Large requests go straight into the caller's buffer
+             SPIBusLock bus(SPI_BUS_SD, _sd);
+             if(!sync_position(_position)) {
+                 break;
+             }
+             size_t count = read_bursts(_file, buffer + total, remaining, _sd);
+             if(count == 0) {
+                 break;
+             }
+             _file_position += count;
+             _position += count;
+             total += count;
+             continue;
+         }
+         
+         // Refill the read-ahead block
+         SPIBusLock bus(SPI_BUS_SD, _sd);
+         if(!sync_position(_position)) {
+             break;
+         }
+         size_t count = read_bursts(_file, _buffer, _capacity, _sd);
+         if(count == 0) {
+             _length = 0;
+             break;
+         }
+         _start = _position;
+         _length = count;
+         _file_position += count;
+     }
+     
+     return total;
+ }
+ 
+ /**
+  * @brief Write at the current position
+  * 
+  * @param buffer Data to write
+  * @param size Number of bytes to write
+  * @return Bytes accepted, or -1 if error
+  */
+ int64_t FSStream::write(const uint8_t *buffer, size_t size) {
+     if(!_file || _error) {
+         return -1;
+     }
+     
+     // Writing invalidates the read-ahead block
+     if(!_dirty) {
+         _length = 0;
+     }
+     
+     // Coalesce only writes that continue the pending block
+     if(_dirty && (_position != _start + _length || _length + size > _capacity)) {
+         if(!flush_buffer()) {
+             return -1;
+         }
+     }
+     
+     if(!_buffer || size >= _capacity) {
+         SPIBusLock bus(SPI_BUS_SD, _sd);
+         if(!sync_position(_position) || write_bursts(_file, buffer, size, _sd) != size) {
+             set_error("Error writing to file: " + _path);
+             TDECK_LOG_E("Error writing to file: %s", _path.c_str());
+             _error = true;
+             return -1;
+         }
+         _file_position += size;
+     } else {
+         if(!_dirty) {
+             _start = _position;
+             _length = 0;
+             _dirty = true;
+         }
+         memcpy(_buffer + _length, buffer, size);
+         _length += size;
+     }
+     
+     _written = true;
+     _position += size;
+     _size = std::max(_size, _position);
+     return size;
+ }
+ 
+ /**
+  * @brief Move the current position
+  * 
+  * @param position Offset from the start of the file
+  * @return true if successful
+  */
+ bool FSStream::seek(uint64_t position) {
+     if(!_file || position > _size) {
+         return false;
+     }
+     
+     // The buffers are kept; read() and write() check the new position against them
+     _position = position;
+     return true;
+ }
+ 
+ /**
+  * @brief Get the current position
+  * 
+  * @return Offset from the start of the file
+  */
+ uint64_t FSStream::position() const {
+     return _position;
+ }
+ 
+ /**
+  * @brief Get the file size, buffered writes included
+  * 
+  * @return Size in bytes
+  */
+ uint64_t FSStream::size() const {
+     return _size;
+ }
+ 
+ /**
+  * @brief Write buffered data to the file
+  * 
+  * @return true if successful
+  */
+ bool FSStream::flush() {
+     if(!_file) {
+         return false;
+     }
+     if(_dirty && !flush_buffer()) {
+         return false;
+     }
+     SPIBusLock bus(SPI_BUS_SD, _sd);
+     _file.flush();
+     return !_error;
+ }
+ 
+ /**
+  * @brief Flush and close the file
+  * 
+  * @return true if every write reached the file
+  */
+ bool FSStream::close() {
+     bool success = !_error;
+     
+     if(_file) {
+         SPIBusLock bus(SPI_BUS_SD, _sd);
+         if(_dirty) {
+             success = flush_buffer() && success;
+         }
+         _file.close();
+         
+         // The cached listing may have been refilled with the old size
+         if(_written) {
+             FSManager::invalidate_cache(_path);
+         }
+         
+         if(_sd) {
+             portENTER_CRITICAL(&sd_lock);
+             sd_streams--;
+             portEXIT_CRITICAL(&sd_lock);
+         }
+     }
+     
+     free_buffer(_buffer);
+     _buffer = nullptr;
+     _capacity = 0;
+     _length = 0;
+     _dirty = false;
+     _written = false;
+     return success;
+ }
+ 
+ /**
+  * @brief Check if a file is open
+  * 
+  * @return true if open
+  */
+ bool FSStream::is_open() const {
+     return (bool)_file;
+ }
+ 
+ /**
+  * @brief Allocate a transfer buffer suited to the card's DMA
+  * 
+  * @param size Buffer size in bytes
+  * @return Buffer, or nullptr if out of memory
+  */
+ uint8_t *FSStream::alloc_buffer(size_t size) {
+     uint8_t *buffer = (uint8_t*)heap_caps_aligned_alloc(4, size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+     if(!buffer) {
+         buffer = (uint8_t*)heap_caps_aligned_alloc(4, size, MALLOC_CAP_SPIRAM);
+     }
+     return buffer;
+ }
+ 
+ /**
+  * @brief Free a buffer from alloc_buffer()
+  * 
+  * @param buffer Buffer to free, may be nullptr
+  */
+ void FSStream::free_buffer(uint8_t *buffer) {
+     if(buffer) {
+         heap_caps_free(buffer);
+     }
+ }
+ 
+ /**
+  * @brief Write pending data to the file
+  * 
+  * @return true if successful
+  */
+ bool FSStream::flush_buffer() {
+     size_t length = _length;
+     _dirty = false;
+     _length = 0;
+     
+     if(length == 0) {
+         return true;
+     }
+     
+     SPIBusLock bus(SPI_BUS_SD, _sd);
+     if(!sync_position(_start) || write_bursts(_file, _buffer, length, _sd) != length) {
+         set_error("Error writing to file: " + _path);
+         TDECK_LOG_E("Error writing to file: %s", _path.c_str());
+         _error = true;
+         return false;
+     }
+     
+     _file_position = _start + length;
+     return true;
+ }
+ 
+ /**
+  * @brief Move the underlying file if it is not already there
+  * 
+  * @param position Offset from the start of the file
+  * @return true if successful
+  */
+ bool FSStream::sync_position(uint64_t position) {
+     if(_file_position == position) {
+         return true;
+     }
+     if(!_file.seek(position)) {
+         set_error("Error seeking in file: " + _path);
+         return false;
+     }
+     _file_position = position;
+     return true;
+ }
+ 
  /**
   * @brief Get the appropriate filesystem for the given path
   * 
@@ -520,7 +1159,7 @@
   * @return Reference to the appropriate filesystem
   */
  static fs::FS& get_fs_for_path(const std::string &path) {
-     std::string fs_type = get_fs_type_for_path(path);
+     std::string fs_type = FSPath::fs_type(path);
      
      if(fs_type == "sd" && sd_available) {
          return SD;
@@ -530,61 +1169,481 @@
  }
  
  /**
-  * @brief Get the filesystem type for the given path
+  * @brief Set the last error message
   * 
-  * @param path The file path
-  * @return String indicating filesystem type ("flash" or "sd")
+  * @param error Error message
   */
- static std::string get_fs_type_for_path(const std::string &path) {
-     if(path.length() >= 3 && path.substr(0, 3) == "/sd") {
-         return "sd";
-     } else if(path.length() >= 6 && path.substr(0, 6) == "/flash") {
-         return "flash";
-     } else {
-         // Default to flash for other paths
-         return "flash";
+ static void set_error(const std::string &error) {
+     last_error = error;
+ }
+ 
+ /**
+  * @brief Read in bursts of TDECK_SPI_SD_BURST bytes
+  * 
+  * The caller holds the shared SPI bus for SD files; between bursts the bus
+  * goes to the radio or display if they are waiting.
+  * 
+  * @param file Open file
+  * @param buffer Buffer to receive the data
+  * @param size Maximum bytes to read
+  * @param sd true if the file is on the SD card
+  * @return Bytes read
+  */
+ static size_t read_bursts(fs::File &file, uint8_t *buffer, size_t size, bool sd) {
+     size_t total = 0;
+     while(total < size) {
+         size_t chunk = std::min(size - total, (size_t)TDECK_SPI_SD_BURST);
+         size_t count = file.read(buffer + total, chunk);
+         total += count;
+         if(count < chunk) {
+             break;
+         }
+         if(sd && total < size) {
+             spiBus.yield(SPI_BUS_SD);
+         }
      }
+     return total;
  }
  
  /**
-  * @brief Set the last error message
+  * @brief Write in bursts of TDECK_SPI_SD_BURST bytes
   * 
-  * @param error Error message
+  * @param file Open file
+  * @param buffer Data to write
+  * @param size Number of bytes to write
+  * @param sd true if the file is on the SD card
+  * @return Bytes written
   */
- static void set_error(const std::string &error) {
-     last_error = error;
+ static size_t write_bursts(fs::File &file, const uint8_t *buffer, size_t size, bool sd) {
+     size_t total = 0;
+     while(total < size) {
+         size_t chunk = std::min(size - total, (size_t)TDECK_SPI_SD_BURST);
+         size_t count = file.write(buffer + total, chunk);
+         total += count;
+         if(count < chunk) {
+             break;
+         }
+         if(sd && total < size) {
+             spiBus.yield(SPI_BUS_SD);
+         }
+     }
+     return total;
+ }
+  
+ /**
+  * @brief Walk a directory and hand its visible entries out in batches
+  * 
+  * @param path Directory path
+  * @param offset Number of visible entries to skip
+  * @param limit Maximum number of entries to deliver, 0 for all
+  * @param batch_size Entries per batch
+  * @param on_batch Receives each full batch and the remainder, returns false to stop
+  * @return true if the directory could be opened
+  */
+ static bool list_directory_range(const std::string &path, size_t offset, size_t limit, size_t batch_size,
+                                  const std::function<bool(std::vector<FSFileInfo> &batch)> &on_batch) {
+     std::string norm_path = FSPath::normalize(path);
+     fs::FS &fs = get_fs_for_path(norm_path);
+     std::vector<FSFileInfo> batch;
+     
+     if(norm_path == "/") {
+         // Special case for root: show both filesystems if available
+         if(spiffs_available) {
+             FSFileInfo spiffs_entry;
+             spiffs_entry.name = "flash";
+             spiffs_entry.is_directory = true;
+             spiffs_entry.size = 0;
+             spiffs_entry.modified_time = 0;
+             batch.push_back(spiffs_entry);
+         }
+         
+         if(sd_available) {
+             FSFileInfo sd_entry;
+             sd_entry.name = "sd";
+             sd_entry.is_directory = true;
+             sd_entry.size = 0;
+             sd_entry.modified_time = 0;
+             batch.push_back(sd_entry);
+         }
+         
+         // Apply the page to the virtual entries too
+         batch.erase(batch.begin(), batch.begin() + std::min(offset, batch.size()));
+         if(limit > 0 && batch.size() > limit) {
+             batch.resize(limit);
+         }
+         
+         on_batch(batch);
+         return true;
+     }
+     
+     // Remove leading slash for non-root FS-specific paths
+     std::string fs_path = norm_path;
+     std::string fs_type = FSPath::fs_type(norm_path);
+     if(fs_type == "flash" || fs_type == "sd") {
+         size_t pos = norm_path.find('/', 1);
+         if(pos != std::string::npos) {
+             fs_path = norm_path.substr(pos);
+         } else {
+             fs_path = "/";
+         }
+     }
+     
+     // Serve the page from a cached listing without touching the card
+     std::string key = cache_key(norm_path);
+     std::vector<FSFileInfo> cached;
+     if(cache_lookup_dir(key, cached)) {
+         size_t end = cached.size();
+         if(limit > 0 && offset + limit < end) {
+             end = offset + limit;
+         }
+         
+         for(size_t i = offset; i < end; i++) {
+             batch.push_back(cached[i]);
+             if(batch.size() >= batch_size) {
+                 if(!on_batch(batch)) {
+                     return true;
+                 }
+                 batch.clear();
+             }
+         }
+         
+         on_batch(batch);
+         return true;
+     }
+     
+     // The walk holds the card, stepping aside between entries for more urgent devices.
+     // Batches go out with the bus released: the receiver may wait on the UI task,
+     // which needs the bus to flush the display.
+     bool sd = fs_type == "sd";
+     
+     // Only a complete walk can be cached
+     bool cacheable = offset == 0 && limit == 0 && cache_mutex;
+     std::vector<FSFileInfo> all;
+     
+     {
+         SPIBusLock bus(SPI_BUS_SD, sd);
+         
+         File dir = fs.open(fs_path.c_str());
+         if(!dir || !dir.isDirectory()) {
+             set_error("Failed to open directory: " + norm_path);
+             TDECK_LOG_E("Failed to open directory: %s", norm_path.c_str());
+             return false;
+         }
+         
+         size_t skipped = 0;
+         size_t delivered = 0;
+         
+         File file = dir.openNextFile();
+         while(file) {
+             FSFileInfo entry;
+             entry.name = file.name();
+             
+             // Remove path prefix if present
+             size_t last_slash = entry.name.find_last_of('/');
+             if(last_slash != std::string::npos) {
+                 entry.name = entry.name.substr(last_slash + 1);
+             }
+             
+             entry.size = file.size();
+             entry.is_directory = file.isDirectory();
+             entry.modified_time = file.getLastWrite();
+             file.close();
+             
+             // Skip hidden files (starting with .), then apply the page
+             if(entry.name.length() > 0 && entry.name[0] != '.') {
+                 if(skipped < offset) {
+                     skipped++;
+                 } else {
+                     batch.push_back(entry);
+                     delivered++;
+                     if(cacheable) {
+                         all.push_back(entry);
+                     }
+                     
+                     if(batch.size() >= batch_size) {
+                         if(sd) {
+                             spiBus.release(SPI_BUS_SD);
+                         }
+                         bool more = on_batch(batch);
+                         if(sd) {
+                             spiBus.acquire(SPI_BUS_SD);
+                         }
+                         if(!more) {
+                             return true;
+                         }
+                         batch.clear();
+                     }
+                     
+                     if(limit > 0 && delivered >= limit) {
+                         break;
+                     }
+                 }
+             }
+             
+             if(sd) {
+                 spiBus.yield(SPI_BUS_SD);
+             }
+             file = dir.openNextFile();
+         }
+     }
+     
+     if(cacheable) {
+         cache_store_dir(key, all);
+     }
+     
+     on_batch(batch);
+     return true;
+ }
+ 
+ /**
+  * @brief Directory listing worker, serves queued requests one at a time
+  * 
+  * @param arg Unused
+  */
+ static void list_task_func(void *arg) {
+     FSListRequest *request;
+     
+     while(true) {
+         if(xQueueReceive(list_queue, &request, portMAX_DELAY) != pdTRUE) {
+             continue;
+         }
+         
+         FSListHandle handle = request->handle;
+         std::vector<FSFileInfo> last_batch;
+         
+         // Hold back each batch until the next one arrives so the last one can carry done
+         bool ok = list_directory_range(request->path, request->offset, request->limit, request->batch_size,
+                                        [&](std::vector<FSFileInfo> &batch) {
+                                            if(is_list_cancelled(handle)) {
+                                                return false;
+                                            }
+                                            if(!last_batch.empty()) {
+                                                request->callback(handle, last_batch, false, true);
+                                            }
+                                            last_batch.swap(batch);
+                                            return true;
+                                        });
+         
+         if(!is_list_cancelled(handle)) {
+             request->callback(handle, last_batch, true, ok);
+         }
+         
+         release_list_handle(handle);
+         delete request;
+     }
+ }
+ 
+ /**
+  * @brief Check if a listing was cancelled
+  * 
+  * @param handle Listing handle
+  * @return true if cancel_list was called for the handle
+  */
+ static bool is_list_cancelled(FSListHandle handle) {
+     bool cancelled = false;
+     
+     portENTER_CRITICAL(&list_lock);
+     for(int i = 0; i < TDECK_FS_LIST_MAX_REQUESTS; i++) {
+         if(list_active[i] == handle) {
+             cancelled = list_cancelled[i];
+             break;
+         }
+     }
+     portEXIT_CRITICAL(&list_lock);
+     
+     return cancelled;
+ }
+ 
+ /**
+  * @brief Free the slot of a finished listing
+  * 
+  * @param handle Listing handle
+  */
+ static void release_list_handle(FSListHandle handle) {
+     portENTER_CRITICAL(&list_lock);
+     for(int i = 0; i < TDECK_FS_LIST_MAX_REQUESTS; i++) {
+         if(list_active[i] == handle) {
+             list_active[i] = 0;
+             list_cancelled[i] = false;
+             break;
+         }
+     }
+     portEXIT_CRITICAL(&list_lock);
+ }
+ 
+ /**
+  * @brief Build the metadata cache key of a path
+  * 
+  * @param path Path to convert
+  * @return Normalized path without trailing slash
+  */
+ static std::string cache_key(const std::string &path) {
+     std::string key = FSPath::normalize(path);
+     while(key.length() > 1 && key.back() == '/') {
+         key.pop_back();
+     }
+     return key;
  }
  
  /**
-  * @brief Check if the path is a root directory
+  * @brief Look up a cached directory listing and mark it most recently used
   * 
-  * @param path Path to check
-  * @return true if path is a root directory
+  * @param key Cache key of the directory
+  * @param entries Receives the unpacked entries on a hit
+  * @return true on a cache hit
   */
- static bool is_root_directory(const std::string &path) {
-     return (path == "/" || path == "/flash" || path == "/sd" || 
-             path == "/flash/" || path == "/sd/");
+ static bool cache_lookup_dir(const std::string &key, std::vector<FSFileInfo> &entries) {
+     if(!cache_mutex) {
+         return false;
+     }
+     
+     bool hit = false;
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for(auto it = dir_cache.begin(); it != dir_cache.end(); ++it) {
+         if(it->path != key) {
+             continue;
+         }
+         
+         // Unpack the records
+         entries.reserve(entries.size() + it->count);
+         const uint8_t *p = it->data;
+         for(uint32_t i = 0; i < it->count; i++) {
+             FSFileInfo entry;
+             memcpy(&entry.size, p, sizeof(uint32_t));
+             memcpy(&entry.modified_time, p + 4, sizeof(uint32_t));
+             entry.is_directory = p[8] != 0;
+             entry.name.assign((const char*)p + 10, p[9]);
+             p += 10 + p[9];
+             entries.push_back(entry);
+         }
+         
+         dir_cache.splice(dir_cache.begin(), dir_cache, it);
+         hit = true;
+         break;
+     }
+     xSemaphoreGive(cache_mutex);
+     
+     return hit;
  }
  
  /**
-  * @brief Normalize a file path (ensure leading slash, etc.)
+  * @brief Store a complete directory listing, evicting least recently used ones
   * 
-  * @param path Path to normalize
-  * @return Normalized path
+  * @param key Cache key of the directory
+  * @param entries All visible entries of the directory
   */
- static std::string normalize_path(const std::string &path) {
-     std::string result = path;
+ static void cache_store_dir(const std::string &key, const std::vector<FSFileInfo> &entries) {
+     if(!cache_mutex) {
+         return;
+     }
      
-     // Ensure path starts with a slash
-     if(result.empty() || result[0] != '/') {
-         result = "/" + result;
+     // Work out the packed size, names longer than a record allows are not cached
+     size_t size = 0;
+     for(const auto &entry : entries) {
+         if(entry.name.length() > 255) {
+             return;
+         }
+         size += 10 + entry.name.length();
      }
      
-     // Remove duplicate slashes
-     size_t pos = 0;
-     while((pos = result.find("//", pos)) != std::string::npos) {
-         result.erase(pos, 1);
+     if(size > TDECK_FS_CACHE_BUDGET) {
+         return;
      }
      
+     uint8_t *data = (uint8_t*)heap_caps_malloc(size > 0 ? size : 1, MALLOC_CAP_SPIRAM);
+     if(!data) {
+         return;
+     }
+     
+     uint8_t *p = data;
+     for(const auto &entry : entries) {
+         uint32_t file_size = entry.size;
+         memcpy(p, &file_size, sizeof(uint32_t));
+         memcpy(p + 4, &entry.modified_time, sizeof(uint32_t));
+         p[8] = entry.is_directory ? 1 : 0;
+         p[9] = (uint8_t)entry.name.length();
+         memcpy(p + 10, entry.name.data(), entry.name.length());
+         p += 10 + entry.name.length();
+     }
+     
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     
+     // Replace an older copy of the same directory
+     for(auto it = dir_cache.begin(); it != dir_cache.end(); ++it) {
+         if(it->path == key) {
+             dir_cache_bytes -= it->size;
+             heap_caps_free(it->data);
+             dir_cache.erase(it);
+             break;
+         }
+     }
+     
+     // Evict least recently used listings until the new one fits
+     while(!dir_cache.empty() && dir_cache_bytes + size > TDECK_FS_CACHE_BUDGET) {
+         dir_cache_bytes -= dir_cache.back().size;
+         heap_caps_free(dir_cache.back().data);
+         dir_cache.pop_back();
+     }
+     
+     dir_cache.push_front({key, data, size, (uint32_t)entries.size()});
+     dir_cache_bytes += size;
+     
+     xSemaphoreGive(cache_mutex);
+ }
+ 
+ /**
+  * @brief Look up a file in the cached listing of its parent directory
+  * 
+  * @param key Cache key of the file
+  * @param info Receives the entry when found
+  * @return Lookup result, hidden files are always a miss since listings skip them
+  */
+ static FSCacheResult cache_lookup_file(const std::string &key, FSFileInfo &info) {
+     size_t slash = key.find_last_of('/');
+     if(slash == std::string::npos || slash + 1 >= key.length() || key[slash + 1] == '.') {
+         return FS_CACHE_MISS;
+     }
+     
+     std::string parent = key.substr(0, std::max<size_t>(slash, 1));
+     std::string name = key.substr(slash + 1);
+     
+     // The virtual root is never cached
+     if(parent == "/") {
+         return FS_CACHE_MISS;
+     }
+     
+     if(!cache_mutex) {
+         return FS_CACHE_MISS;
+     }
+     
+     FSCacheResult result = FS_CACHE_MISS;
+     xSemaphoreTake(cache_mutex, portMAX_DELAY);
+     for(auto it = dir_cache.begin(); it != dir_cache.end(); ++it) {
+         if(it->path != parent) {
+             continue;
+         }
+         
+         // Scan the packed records in place
+         result = FS_CACHE_ABSENT;
+         const uint8_t *p = it->data;
+         for(uint32_t i = 0; i < it->count; i++) {
+             if(p[9] == name.length() && memcmp(p + 10, name.data(), p[9]) == 0) {
+                 uint32_t file_size;
+                 memcpy(&file_size, p, sizeof(uint32_t));
+                 memcpy(&info.modified_time, p + 4, sizeof(uint32_t));
+                 info.size = file_size;
+                 info.is_directory = p[8] != 0;
+                 info.name = name;
+                 result = FS_CACHE_FOUND;
+                 break;
+             }
+             p += 10 + p[9];
+         }
+         
+         dir_cache.splice(dir_cache.begin(), dir_cache, it);
+         break;
+     }
+     xSemaphoreGive(cache_mutex);
+     
      return result;
- }
\ No newline at end of file
+ }
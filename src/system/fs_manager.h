@@ -11,6 +11,9 @@
  
  #include <string>
  #include <vector>
+ #include <functional>
+ #include <FS.h>
+ #include "../config.h"
  
  /**
   * @brief File information structure
@@ -22,6 +25,23 @@
      uint32_t modified_time;  ///< Last modified time (Unix timestamp)
  };
  
+ /**
+  * @brief Handle of an asynchronous directory listing, 0 is never a valid handle
+  */
+ typedef uint32_t FSListHandle;
+ 
+ /**
+  * @brief Callback receiving batches of an asynchronous directory listing
+  * 
+  * Runs on the file system worker task, not on the caller's task.
+  * 
+  * @param handle Listing the batch belongs to
+  * @param batch Entries read since the previous batch
+  * @param done true for the last batch of the listing
+  * @param ok false if the directory could not be opened
+  */
+ using FSListBatchCallback = std::function<void(FSListHandle handle, const std::vector<FSFileInfo> &batch, bool done, bool ok)>;
+ 
  /**
   * @brief File system manager
   * 
@@ -43,6 +63,53 @@
       */
      static bool is_sd_available();
      
+     /**
+      * @brief Hand the SD card to the USB host as a raw block device
+      * 
+      * Fails while a stream on the card is open. Until return_sd() the card
+      * is hidden from every path, so nothing in the firmware touches the
+      * file system under the host.
+      * 
+      * @param sector_count Receives the number of sectors
+      * @param sector_size Receives the sector size in bytes
+      * @return true if the card is lent
+      */
+     static bool lend_sd(uint32_t &sector_count, uint16_t &sector_size);
+     
+     /**
+      * @brief Take the SD card back from the USB host and remount it
+      * 
+      * @return true if the card is mounted again
+      */
+     static bool return_sd();
+     
+     /**
+      * @brief Check if the SD card is lent to the USB host
+      * 
+      * @return true between lend_sd() and return_sd()
+      */
+     static bool is_sd_lent();
+     
+     /**
+      * @brief Read raw sectors of the lent SD card
+      * 
+      * @param sector First sector
+      * @param buffer Buffer of count sectors
+      * @param count Number of sectors
+      * @return true if every sector was read
+      */
+     static bool read_sd_sectors(uint32_t sector, uint8_t *buffer, uint32_t count);
+     
+     /**
+      * @brief Write raw sectors of the lent SD card
+      * 
+      * @param sector First sector
+      * @param buffer Data of count sectors
+      * @param count Number of sectors
+      * @return true if every sector was written
+      */
+     static bool write_sd_sectors(uint32_t sector, const uint8_t *buffer, uint32_t count);
+     
      /**
       * @brief List contents of a directory
       * 
@@ -52,6 +119,31 @@
       */
      static bool list_directory(const std::string &path, std::vector<FSFileInfo> &entries);
      
+     /**
+      * @brief List contents of a directory on the file system worker task
+      * 
+      * Entries are delivered in batches of batch_size through the callback,
+      * followed by a final call with done set. Cancelled listings stop at the
+      * next entry and do not call the callback again.
+      * 
+      * @param path Directory path
+      * @param callback Callback receiving the batches
+      * @param offset Number of visible entries to skip
+      * @param limit Maximum number of entries to deliver, 0 for all
+      * @param batch_size Entries per batch
+      * @return Handle of the listing, or 0 if it could not be queued
+      */
+     static FSListHandle list_directory_async(const std::string &path, FSListBatchCallback callback,
+                                              size_t offset = 0, size_t limit = 0,
+                                              size_t batch_size = TDECK_FS_LIST_BATCH_SIZE);
+     
+     /**
+      * @brief Cancel an asynchronous directory listing
+      * 
+      * @param handle Listing to cancel, unknown or finished handles are ignored
+      */
+     static void cancel_list(FSListHandle handle);
+     
      /**
       * @brief Create a new directory
       * 
@@ -113,6 +205,15 @@
       */
      static int64_t write_file(const std::string &path, const uint8_t *buffer, size_t size);
      
+     /**
+      * @brief Open a file for streaming access
+      * 
+      * @param path File path
+      * @param mode Open mode (FILE_READ, FILE_WRITE, FILE_APPEND)
+      * @return Open file, or an invalid File on error
+      */
+     static fs::File open_file(const std::string &path, const char *mode);
+     
      /**
       * @brief Check if a file exists
       * 
@@ -131,6 +232,17 @@
       */
      static bool get_space_info(const std::string &path, uint64_t &total_bytes, uint64_t &free_bytes);
      
+     /**
+      * @brief Drop cached metadata for a path
+      * 
+      * Invalidates the listing of the path itself, of its parent directory
+      * and of everything below it. FSManager calls this for its own write
+      * operations; code that writes files through another API must call it.
+      * 
+      * @param path File or directory path that changed
+      */
+     static void invalidate_cache(const std::string &path);
+     
      /**
       * @brief Get last file system error
       * 
@@ -139,4 +251,132 @@
      static std::string get_last_error();
  };
  
+ /**
+  * @brief Buffered file stream on any mount
+  * 
+  * Reads and writes go through caller-supplied buffers of any size. With a
+  * stream buffer, small reads are served from one large read-ahead block and
+  * small writes are coalesced into one large write-behind block, so the card
+  * sees few, big, aligned transfers. Requests at least as large as the stream
+  * buffer bypass it. Paths are resolved like every FSManager call, so /flash
+  * and /sd files behave the same. A stream is used by one task at a time.
+  */
+ class FSStream {
+ public:
+     FSStream();
+     ~FSStream();
+     
+     /**
+      * @brief Open a file
+      * 
+      * @param path File path
+      * @param mode Open mode (FILE_READ, FILE_WRITE, FILE_APPEND)
+      * @param buffer_size Read-ahead/write-behind buffer in bytes, 0 for unbuffered
+      * @return true if the file was opened
+      */
+     bool open(const std::string &path, const char *mode, size_t buffer_size = TDECK_FS_STREAM_BUFFER_SIZE);
+     
+     /**
+      * @brief Read from the current position
+      * 
+      * @param buffer Buffer to receive the data
+      * @param size Maximum bytes to read
+      * @return Bytes read, 0 at end of file, or -1 if error
+      */
+     int64_t read(uint8_t *buffer, size_t size);
+     
+     /**
+      * @brief Write at the current position
+      * 
+      * Buffered data reaches the file on flush(), close() or when the
+      * buffer fills.
+      * 
+      * @param buffer Data to write
+      * @param size Number of bytes to write
+      * @return Bytes accepted, or -1 if error
+      */
+     int64_t write(const uint8_t *buffer, size_t size);
+     
+     /**
+      * @brief Move the current position
+      * 
+      * @param position Offset from the start of the file
+      * @return true if successful
+      */
+     bool seek(uint64_t position);
+     
+     /**
+      * @brief Get the current position
+      * 
+      * @return Offset from the start of the file
+      */
+     uint64_t position() const;
+     
+     /**
+      * @brief Get the file size, buffered writes included
+      * 
+      * @return Size in bytes
+      */
+     uint64_t size() const;
+     
+     /**
+      * @brief Write buffered data to the file
+      * 
+      * @return true if successful
+      */
+     bool flush();
+     
+     /**
+      * @brief Flush and close the file
+      * 
+      * @return true if every write reached the file
+      */
+     bool close();
+     
+     /**
+      * @brief Check if a file is open
+      * 
+      * @return true if open
+      */
+     bool is_open() const;
+     
+     /**
+      * @brief Allocate a transfer buffer suited to the card's DMA
+      * 
+      * Prefers word-aligned internal memory, falls back to PSRAM.
+      * 
+      * @param size Buffer size in bytes
+      * @return Buffer, or nullptr if out of memory
+      */
+     static uint8_t *alloc_buffer(size_t size);
+     
+     /**
+      * @brief Free a buffer from alloc_buffer()
+      * 
+      * @param buffer Buffer to free, may be nullptr
+      */
+     static void free_buffer(uint8_t *buffer);
+     
+ private:
+     fs::File _file;          ///< Underlying file
+     std::string _path;       ///< Path the stream was opened with
+     uint8_t *_buffer;        ///< Stream buffer, nullptr if unbuffered
+     size_t _capacity;        ///< Size of _buffer
+     uint64_t _start;         ///< File offset of _buffer[0]
+     size_t _length;          ///< Valid read-ahead or pending write bytes in _buffer
+     bool _dirty;             ///< _buffer holds pending writes
+     bool _written;           ///< Anything was written since open
+     bool _error;             ///< A write-behind failed
+     uint64_t _position;      ///< Logical position
+     uint64_t _file_position; ///< Position of the underlying file
+     uint64_t _size;          ///< File size, buffered writes included
+     bool _sd;                ///< File is on the SD card, transfers take the shared SPI bus
+      
+     // Write pending data to the file
+     bool flush_buffer();
+     
+     // Move the underlying file if it is not already there
+     bool sync_position(uint64_t position);
+ };
+ 
  #endif // TDECK_FS_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,57 @@
+/**
+ * @file fs_path.cpp
+ * @brief Implementation of the FSManager path helpers
+ */
+
+ #include "fs_path.h"
+ 
+ /**
+  * @brief Normalize a file path (ensure leading slash, etc.)
+  * 
+  * One pass that copies each character unless it repeats a slash.
+  * 
+  * @param path Path to normalize
+  * @return Normalized path
+  */
+ std::string FSPath::normalize(const std::string &path) {
+     std::string result;
+     result.reserve(path.length() + 1);
+     
+     // Ensure path starts with a slash
+     result.push_back('/');
+     
+     // Remove duplicate slashes
+     for(char c : path) {
+         if(c != '/' || result.back() != '/') {
+             result.push_back(c);
+         }
+     }
+     
+     return result;
+ }
+ 
+ /**
+  * @brief Get file system type for a path
+  * 
+  * @param path Path to check
+  * @return File system type ("flash" or "sd")
+  */
+ std::string FSPath::fs_type(const std::string &path) {
+     if(path.compare(0, 3, "/sd") == 0) {
+         return "sd";
+     }
+     
+     // Default to flash for other paths
+     return "flash";
+ }
+ 
+ /**
+  * @brief Check if the path is a root directory
+  * 
+  * @param path Path to check
+  * @return true if path is a root directory
+  */
+ bool FSPath::is_root(const std::string &path) {
+     return (path == "/" || path == "/flash" || path == "/sd" || 
+             path == "/flash/" || path == "/sd/");
+ }
@@ -0,0 +1,44 @@
+/**
+ * @file fs_path.h
+ * @brief Path handling shared by every FSManager call
+ * 
+ * Pure string functions with no file system underneath, so they build on
+ * the host for profiling and fuzzing as well.
+ */
+
+ #ifndef TDECK_FS_PATH_H
+ #define TDECK_FS_PATH_H
+ 
+ #include <string>
+ 
+ /**
+  * @brief Path helpers
+  */
+ class FSPath {
+ public:
+     /**
+      * @brief Normalize a file path (ensure leading slash, collapse repeated slashes)
+      * 
+      * @param path Path to normalize
+      * @return Normalized path
+      */
+     static std::string normalize(const std::string &path);
+     
+     /**
+      * @brief Get the mount a normalized path lives on
+      * 
+      * @param path Normalized path
+      * @return "sd" for paths under /sd, otherwise "flash"
+      */
+     static std::string fs_type(const std::string &path);
+     
+     /**
+      * @brief Check if the path is a root directory
+      * 
+      * @param path Path to check
+      * @return true if path is a root directory
+      */
+     static bool is_root(const std::string &path);
+ };
+ 
+ #endif // TDECK_FS_PATH_H
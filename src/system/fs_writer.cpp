@@ -0,0 +1,232 @@
+/**
+ * @file fs_writer.cpp
+ * @brief Implementation of the background file writer
+ */
+
+ #include "fs_writer.h"
+ 
+ FSWriter::FSWriter()
+     : _free_queue(NULL)
+     , _job_queue(NULL)
+     , _closed(NULL)
+     , _task(NULL)
+     , _open(false)
+     , _error(false)
+     , _discard(false)
+     , _close_result(false)
+     , _written(0) {
+     memset(_slots, 0, sizeof(_slots));
+ }
+ 
+ FSWriter::~FSWriter() {
+     abort();
+ }
+ 
+ /**
+  * @brief Create or truncate a file and allocate the slot pool
+  * 
+  * @param path File path
+  * @return true if the file is open and the writer task running
+  */
+ bool FSWriter::open(const std::string &path) {
+     if(_open) {
+         abort();
+     }
+     
+     // Start the task on first use
+     if(!_task) {
+         _free_queue = xQueueCreate(TDECK_FS_WRITER_SLOTS, sizeof(uint8_t*));
+         _job_queue = xQueueCreate(TDECK_FS_WRITER_SLOTS + 1, sizeof(Job));
+         _closed = xSemaphoreCreateBinary();
+         if(!_free_queue || !_job_queue || !_closed ||
+            xTaskCreatePinnedToCore(task_func, "FS_Writer", TDECK_FS_WRITER_STACK_SIZE, this,
+                                    TDECK_SYSTEM_TASK_PRIORITY, &_task, 0) != pdPASS) {
+             TDECK_LOG_E("Failed to start file writer task");
+             _task = NULL;
+             return false;
+         }
+     }
+     
+     // The slots match the card's DMA, so writes go out without a bounce copy
+     for(int i = 0; i < TDECK_FS_WRITER_SLOTS; i++) {
+         _slots[i] = FSStream::alloc_buffer(TDECK_FS_WRITER_SLOT_SIZE);
+         if(!_slots[i]) {
+             TDECK_LOG_E("No memory for file writer slots");
+             free_slots_memory();
+             return false;
+         }
+     }
+     
+     // Unbuffered, every slot is already as large as a stream buffer would be
+     if(!_file.open(path, FILE_WRITE, 0)) {
+         free_slots_memory();
+         return false;
+     }
+     
+     xQueueReset(_free_queue);
+     xQueueReset(_job_queue);
+     for(int i = 0; i < TDECK_FS_WRITER_SLOTS; i++) {
+         xQueueSend(_free_queue, &_slots[i], 0);
+     }
+     
+     _error = false;
+     _discard = false;
+     _written = 0;
+     _open = true;
+     return true;
+ }
+ 
+ /**
+  * @brief Take a free slot to fill
+  * 
+  * @param wait Ticks to wait for the writer to free one
+  * @return Slot of TDECK_FS_WRITER_SLOT_SIZE bytes, or nullptr if all are queued
+  */
+ uint8_t *FSWriter::acquire(TickType_t wait) {
+     uint8_t *slot = nullptr;
+     if(!_open || _error || xQueueReceive(_free_queue, &slot, wait) != pdTRUE) {
+         return nullptr;
+     }
+     return slot;
+ }
+ 
+ /**
+  * @brief Queue a filled slot for writing
+  * 
+  * @param slot Slot from acquire()
+  * @param length Bytes to write from the slot
+  * @return true if queued, false if the file is not open or a write failed
+  */
+ bool FSWriter::commit(uint8_t *slot, size_t length) {
+     if(!slot) {
+         return false;
+     }
+     
+     if(!_open || _error || length == 0) {
+         // Nothing to write, the slot goes straight back
+         xQueueSend(_free_queue, &slot, 0);
+         return _open && !_error;
+     }
+     
+     // There are as many job entries as slots, so this never waits
+     Job job = {slot, length};
+     return xQueueSend(_job_queue, &job, portMAX_DELAY) == pdTRUE;
+ }
+ 
+ /**
+  * @brief Wait for every queued slot to be written, then close the file
+  * 
+  * @return true if every write reached the file
+  */
+ bool FSWriter::close() {
+     return finish(false);
+ }
+ 
+ /**
+  * @brief Drop queued slots and close the file
+  */
+ void FSWriter::abort() {
+     finish(true);
+ }
+ 
+ /**
+  * @brief Check if a file is open
+  * 
+  * @return true if open
+  */
+ bool FSWriter::is_open() const {
+     return _open;
+ }
+ 
+ /**
+  * @brief Check if a write has failed since open
+  * 
+  * @return true once any slot could not be written
+  */
+ bool FSWriter::failed() const {
+     return _error;
+ }
+ 
+ /**
+  * @brief Get the number of slots free for acquire()
+  * 
+  * @return Free slots
+  */
+ size_t FSWriter::free_slots() const {
+     return _open ? uxQueueMessagesWaiting(_free_queue) : 0;
+ }
+ 
+ /**
+  * @brief Get the bytes written to the file so far
+  * 
+  * @return Bytes written by the writer task
+  */
+ uint64_t FSWriter::written() const {
+     return _written;
+ }
+ 
+ /**
+  * @brief Wait for the queued jobs and the close, then release the slots
+  * 
+  * @param discard Drop queued slots instead of writing them
+  * @return true if every write reached the file
+  */
+ bool FSWriter::finish(bool discard) {
+     if(!_open) {
+         return false;
+     }
+     
+     // Jobs are handled in order, so the close request comes after every slot
+     _discard = discard;
+     Job job = {nullptr, 0};
+     xQueueSend(_job_queue, &job, portMAX_DELAY);
+     xSemaphoreTake(_closed, portMAX_DELAY);
+     
+     _open = false;
+     free_slots_memory();
+     return _close_result && !_error;
+ }
+ 
+ /**
+  * @brief Free the slot pool
+  */
+ void FSWriter::free_slots_memory() {
+     for(int i = 0; i < TDECK_FS_WRITER_SLOTS; i++) {
+         FSStream::free_buffer(_slots[i]);
+         _slots[i] = nullptr;
+     }
+ }
+ 
+ /**
+  * @brief Writer task body, drains committed slots to the file
+  * 
+  * @param param The writer
+  */
+ void FSWriter::task_func(void *param) {
+     FSWriter *writer = static_cast<FSWriter*>(param);
+     Job job;
+     
+     while(true) {
+         if(xQueueReceive(writer->_job_queue, &job, portMAX_DELAY) != pdTRUE) {
+             continue;
+         }
+         
+         if(!job.slot) {
+             writer->_close_result = writer->_file.close();
+             xSemaphoreGive(writer->_closed);
+             continue;
+         }
+         
+         // After a failure the rest of the file is pointless, keep returning slots
+         if(!writer->_discard && !writer->_error) {
+             if(writer->_file.write(job.slot, job.length) == (int64_t)job.length) {
+                 writer->_written += job.length;
+             } else {
+                 TDECK_LOG_E("File writer: write failed after %llu bytes", (unsigned long long)writer->_written);
+                 writer->_error = true;
+             }
+         }
+         
+         xQueueSend(writer->_free_queue, &job.slot, 0);
+     }
+ }
\ No newline at end of file
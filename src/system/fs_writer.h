@@ -0,0 +1,127 @@
+/**
+ * @file fs_writer.h
+ * @brief Background file writer fed through a pool of large buffers
+ * 
+ * The producer fills slots from a fixed pool and commits them, a writer
+ * task drains committed slots to the file in order. Slots are multiples of
+ * the card's sector size, so every write but the last one is a large,
+ * sector-aligned transfer. When the card falls behind, acquire() runs out
+ * of slots, and the producer holds off its source instead of dropping data.
+ */
+
+ #ifndef TDECK_FS_WRITER_H
+ #define TDECK_FS_WRITER_H
+ 
+ #include <Arduino.h>
+ #include <string>
+ #include "fs_manager.h"
+ #include "../config.h"
+ 
+ /**
+  * @brief Pipelined writer of one file at a time
+  * 
+  * One producer task acquires, fills and commits slots. The writer task is
+  * started on first use and kept, the slots only exist while a file is open.
+  */
+ class FSWriter {
+ public:
+     FSWriter();
+     ~FSWriter();
+     
+     /**
+      * @brief Create or truncate a file and allocate the slot pool
+      * 
+      * @param path File path
+      * @return true if the file is open and the writer task running
+      */
+     bool open(const std::string &path);
+     
+     /**
+      * @brief Take a free slot to fill
+      * 
+      * @param wait Ticks to wait for the writer to free one
+      * @return Slot of TDECK_FS_WRITER_SLOT_SIZE bytes, or nullptr if all are queued
+      */
+     uint8_t *acquire(TickType_t wait = 0);
+     
+     /**
+      * @brief Queue a filled slot for writing
+      * 
+      * @param slot Slot from acquire()
+      * @param length Bytes to write from the slot
+      * @return true if queued, false if the file is not open or a write failed
+      */
+     bool commit(uint8_t *slot, size_t length);
+     
+     /**
+      * @brief Wait for every queued slot to be written, then close the file
+      * 
+      * @return true if every write reached the file
+      */
+     bool close();
+     
+     /**
+      * @brief Drop queued slots and close the file
+      */
+     void abort();
+     
+     /**
+      * @brief Check if a file is open
+      * 
+      * @return true if open
+      */
+     bool is_open() const;
+     
+     /**
+      * @brief Check if a write has failed since open
+      * 
+      * @return true once any slot could not be written
+      */
+     bool failed() const;
+     
+     /**
+      * @brief Get the number of slots free for acquire()
+      * 
+      * @return Free slots
+      */
+     size_t free_slots() const;
+     
+     /**
+      * @brief Get the bytes written to the file so far
+      * 
+      * @return Bytes written by the writer task
+      */
+     uint64_t written() const;
+ 
+ private:
+     /**
+      * @brief One committed slot, a null slot asks the task to close the file
+      */
+     struct Job {
+         uint8_t *slot;
+         size_t length;
+     };
+     
+     FSStream _file;                              ///< Written by the task only while open
+     uint8_t *_slots[TDECK_FS_WRITER_SLOTS];      ///< Slot pool
+     QueueHandle_t _free_queue;                   ///< Slots ready for acquire()
+     QueueHandle_t _job_queue;                    ///< Slots waiting to be written
+     SemaphoreHandle_t _closed;                   ///< Given by the task once the file is closed
+     TaskHandle_t _task;                          ///< Writer task
+     bool _open;                                  ///< A file is open
+     volatile bool _error;                        ///< A write failed
+     volatile bool _discard;                      ///< Queued slots are dropped, not written
+     volatile bool _close_result;                 ///< Whether the file closed cleanly
+     volatile uint64_t _written;                  ///< Bytes written
+     
+     // Writer task body
+     static void task_func(void *param);
+     
+     // Wait for the queued jobs and the close, then release the slots
+     bool finish(bool discard);
+     
+     // Free the slot pool
+     void free_slots_memory();
+ };
+ 
+ #endif // TDECK_FS_WRITER_H
\ No newline at end of file
@@ -0,0 +1,426 @@
+/**
+ * @file heap_tracker.cpp
+ * @brief Implementation of the heap allocation tracker
+ */
+
+ #include "heap_tracker.h"
+ #include <esp_heap_caps.h>
+ #include <esp_debug_helpers.h>
+ #include <algorithm>
+ 
+ // Global heap tracker instance
+ HeapTracker heapTracker;
+ 
+ // Tag names, in HeapTag order
+ static const char* const TAG_NAMES[HEAP_TAG_COUNT] = {
+     "other", "ui", "terminal", "system", "wifi", "ble", "lora", "ota"
+ };
+ 
+ // Frames between the allocation site and the backtrace start: captureSite and the wrapper
+ #define SKIP_FRAMES 2
+ 
+ // Collect the return addresses of the caller of the allocator
+ static void __attribute__((noinline)) captureSite(uint32_t* pcs) {
+     esp_backtrace_frame_t frame;
+     esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+ 
+     int depth = 0;
+     for (int i = 0; depth < TDECK_HEAP_TRACK_DEPTH && frame.next_pc != 0; i++) {
+         if (!esp_backtrace_get_next_frame(&frame)) {
+             break;
+         }
+         if (i >= SKIP_FRAMES) {
+             // Windowed calls keep the window size in the top bits of the return address
+             pcs[depth++] = (frame.pc & 0x3FFFFFFF) | 0x40000000;
+         }
+     }
+     while (depth < TDECK_HEAP_TRACK_DEPTH) {
+         pcs[depth++] = 0;
+     }
+ }
+ 
+ // Constructor
+ HeapTracker::HeapTracker()
+     : _blocks(nullptr)
+     , _sites(nullptr)
+     , _siteCount(0)
+     , _blockCount(0)
+     , _untracked(0)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+     memset(_tags, 0, sizeof(_tags));
+     memset(_taskTags, 0, sizeof(_taskTags));
+ }
+ 
+ // Allocate the tracking tables
+ bool HeapTracker::begin() {
+ #if TDECK_HEAP_TRACKING
+     // heap_caps_calloc is not wrapped, so the tables do not track themselves
+     Block* blocks = (Block*)heap_caps_calloc(TDECK_HEAP_TRACK_SLOTS, sizeof(Block), MALLOC_CAP_SPIRAM);
+     HeapSite* sites = (HeapSite*)heap_caps_calloc(TDECK_HEAP_TRACK_SITES, sizeof(HeapSite), MALLOC_CAP_SPIRAM);
+     if (!blocks || !sites) {
+         TDECK_LOG_E("Failed to allocate heap tracking tables");
+         heap_caps_free(blocks);
+         heap_caps_free(sites);
+         return false;
+     }
+ 
+     portENTER_CRITICAL(&_lock);
+     _sites = sites;
+     _blocks = blocks;
+     portEXIT_CRITICAL(&_lock);
+ 
+     TDECK_LOG_I("Heap tracking on: %u blocks, %u sites", TDECK_HEAP_TRACK_SLOTS, TDECK_HEAP_TRACK_SITES);
+     return true;
+ #else
+     return false;
+ #endif
+ }
+ 
+ // Check whether allocations are tracked
+ bool HeapTracker::isTracking() const {
+     return _blocks != nullptr;
+ }
+ 
+ // Charge the current task's allocations to a tag
+ HeapTag HeapTracker::setTaskTag(HeapTag tag) {
+     TaskHandle_t task = xTaskGetCurrentTaskHandle();
+     HeapTag previous = HEAP_TAG_OTHER;
+ 
+     portENTER_CRITICAL(&_lock);
+     TaskTag* empty = nullptr;
+     TaskTag* entry = nullptr;
+     for (TaskTag& taskTag : _taskTags) {
+         if (taskTag.task == task) {
+             entry = &taskTag;
+             break;
+         }
+         if (!taskTag.task && !empty) {
+             empty = &taskTag;
+         }
+     }
+     if (!entry && empty) {
+         entry = empty;
+         entry->task = task;
+         entry->tag = HEAP_TAG_OTHER;
+     }
+     if (entry) {
+         previous = entry->tag;
+         entry->tag = tag;
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     return previous;
+ }
+ 
+ // Tag of the calling task, called with the lock held
+ HeapTag HeapTracker::currentTag() const {
+     if (xPortInIsrContext()) {
+         return HEAP_TAG_OTHER;
+     }
+ 
+     TaskHandle_t task = xTaskGetCurrentTaskHandle();
+     for (const TaskTag& taskTag : _taskTags) {
+         if (taskTag.task == task) {
+             return taskTag.tag;
+         }
+     }
+     return HEAP_TAG_OTHER;
+ }
+ 
+ // Get statistics of one memory capability
+ void HeapTracker::getCapsStats(uint32_t caps, HeapCapsStats& stats) {
+     multi_heap_info_t info;
+     heap_caps_get_info(&info, caps);
+ 
+     stats.free = info.total_free_bytes;
+     stats.total = info.total_free_bytes + info.total_allocated_bytes;
+     stats.minFree = info.minimum_free_bytes;
+     stats.largest = info.largest_free_block;
+     stats.fragmentation = stats.free ? 100 - (uint8_t)((uint64_t)stats.largest * 100 / stats.free) : 0;
+ }
+ 
+ // Get the allocations charged to a tag
+ void HeapTracker::getTagStats(HeapTag tag, HeapTagStats& stats) const {
+     portENTER_CRITICAL(&_lock);
+     stats = _tags[tag < HEAP_TAG_COUNT ? tag : HEAP_TAG_OTHER];
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Copy the allocation sites, largest first
+ size_t HeapTracker::getSites(HeapSite* out, size_t max, bool byCount) const {
+     if (!_sites || max == 0) {
+         return 0;
+     }
+ 
+     // Select the top sites first, copying the whole table would not fit on a stack
+     size_t copied = 0;
+     portENTER_CRITICAL(&_lock);
+     for (size_t i = 0; i < _siteCount; i++) {
+         const HeapSite& site = _sites[i];
+         uint32_t key = byCount ? site.count : site.bytes;
+ 
+         size_t pos = copied;
+         while (pos > 0 && (byCount ? out[pos - 1].count : out[pos - 1].bytes) < key) {
+             pos--;
+         }
+         if (pos >= max) {
+             continue;
+         }
+ 
+         size_t last = copied < max ? copied : max - 1;
+         for (size_t j = last; j > pos; j--) {
+             out[j] = out[j - 1];
+         }
+         out[pos] = site;
+         if (copied < max) {
+             copied++;
+         }
+     }
+     portEXIT_CRITICAL(&_lock);
+ 
+     return copied;
+ }
+ 
+ // Get allocations that could not be recorded
+ uint32_t HeapTracker::getUntracked() const {
+     return _untracked;
+ }
+ 
+ // Clear the sites and restart the high-water marks
+ void HeapTracker::reset() {
+     portENTER_CRITICAL(&_lock);
+     for (HeapTagStats& stats : _tags) {
+         stats.peak = stats.live;
+     }
+     if (_blocks) {
+         for (uint32_t i = 0; i < TDECK_HEAP_TRACK_SLOTS; i++) {
+             _blocks[i].site = TDECK_HEAP_TRACK_SITES;
+         }
+     }
+     _siteCount = 0;
+     _untracked = 0;
+     portEXIT_CRITICAL(&_lock);
+ }
+ 
+ // Get a tag's name
+ const char* HeapTracker::getTagName(HeapTag tag) {
+     return tag < HEAP_TAG_COUNT ? TAG_NAMES[tag] : "?";
+ }
+ 
+ // Home slot of a pointer, blocks are at least 4-byte aligned
+ uint32_t HeapTracker::slotOf(uintptr_t ptr) {
+     return ((ptr >> 2) * 2654435761U) & (TDECK_HEAP_TRACK_SLOTS - 1);
+ }
+ 
+ // Find or add the site of a backtrace, called with the lock held
+ uint8_t HeapTracker::findSite(const uint32_t* pcs, HeapTag tag, size_t size) {
+     for (size_t i = 0; i < _siteCount; i++) {
+         if (memcmp(_sites[i].pcs, pcs, sizeof(_sites[i].pcs)) == 0) {
+             return i;
+         }
+     }
+ 
+     size_t index = _siteCount;
+     if (index >= TDECK_HEAP_TRACK_SITES) {
+         // Full: a large allocation replaces the least frequent small site
+         if (size < TDECK_HEAP_ALLOCATION_THRESHOLD) {
+             _untracked++;
+             return TDECK_HEAP_TRACK_SITES;
+         }
+         index = TDECK_HEAP_TRACK_SITES;
+         for (size_t i = 0; i < _siteCount; i++) {
+             if (_sites[i].maxSize < TDECK_HEAP_ALLOCATION_THRESHOLD &&
+                 (index == TDECK_HEAP_TRACK_SITES || _sites[i].count < _sites[index].count)) {
+                 index = i;
+             }
+         }
+         if (index == TDECK_HEAP_TRACK_SITES) {
+             _untracked++;
+             return TDECK_HEAP_TRACK_SITES;
+         }
+         // Blocks of the replaced site no longer count towards a site
+         for (uint32_t i = 0; i < TDECK_HEAP_TRACK_SLOTS; i++) {
+             if (_blocks[i].site == index) {
+                 _blocks[i].site = TDECK_HEAP_TRACK_SITES;
+             }
+         }
+     } else {
+         _siteCount++;
+     }
+ 
+     HeapSite& site = _sites[index];
+     memset(&site, 0, sizeof(site));
+     memcpy(site.pcs, pcs, sizeof(site.pcs));
+     site.tag = tag;
+     return index;
+ }
+ 
+ // Record a new block
+ void HeapTracker::onAlloc(void* ptr, size_t size) {
+     if (!_blocks) {
+         return;
+     }
+ 
+     uint32_t pcs[TDECK_HEAP_TRACK_DEPTH];
+     captureSite(pcs);
+ 
+     portENTER_CRITICAL_SAFE(&_lock);
+     HeapTag tag = currentTag();
+     HeapTagStats& stats = _tags[tag];
+     stats.allocs++;
+ 
+     // Keep a quarter of the table empty so probes stay short
+     if (_blockCount >= TDECK_HEAP_TRACK_SLOTS - TDECK_HEAP_TRACK_SLOTS / 4) {
+         _untracked++;
+         portEXIT_CRITICAL_SAFE(&_lock);
+         return;
+     }
+ 
+     uint8_t siteIndex = findSite(pcs, tag, size);
+     if (siteIndex < TDECK_HEAP_TRACK_SITES) {
+         HeapSite& site = _sites[siteIndex];
+         site.count++;
+         site.bytes += size;
+         site.live++;
+         if (size > site.maxSize) {
+             site.maxSize = size;
+         }
+     }
+ 
+     uint32_t slot = slotOf((uintptr_t)ptr);
+     while (_blocks[slot].ptr) {
+         slot = (slot + 1) & (TDECK_HEAP_TRACK_SLOTS - 1);
+     }
+     _blocks[slot].ptr = (uintptr_t)ptr;
+     _blocks[slot].size = size;
+     _blocks[slot].tag = tag;
+     _blocks[slot].site = siteIndex;
+     _blockCount++;
+ 
+     stats.live += size;
+     if (stats.live > stats.peak) {
+         stats.peak = stats.live;
+     }
+     portEXIT_CRITICAL_SAFE(&_lock);
+ }
+ 
+ // Forget a block about to be freed
+ bool HeapTracker::onFree(void* ptr, size_t* size) {
+     if (!_blocks) {
+         return false;
+     }
+ 
+     const uint32_t mask = TDECK_HEAP_TRACK_SLOTS - 1;
+     bool found = false;
+ 
+     portENTER_CRITICAL_SAFE(&_lock);
+     uint32_t slot = slotOf((uintptr_t)ptr);
+     while (_blocks[slot].ptr) {
+         if (_blocks[slot].ptr == (uintptr_t)ptr) {
+             found = true;
+             break;
+         }
+         slot = (slot + 1) & mask;
+     }
+ 
+     if (found) {
+         Block& block = _blocks[slot];
+         HeapTagStats& stats = _tags[block.tag];
+         stats.frees++;
+         stats.live -= block.size;
+         if (block.site < TDECK_HEAP_TRACK_SITES) {
+             _sites[block.site].live--;
+         }
+         if (size) {
+             *size = block.size;
+         }
+ 
+         // Backward-shift deletion keeps every probe chain unbroken
+         uint32_t hole = slot;
+         uint32_t next = (hole + 1) & mask;
+         while (_blocks[next].ptr) {
+             uint32_t home = slotOf(_blocks[next].ptr);
+             if (((next - home) & mask) >= ((next - hole) & mask)) {
+                 _blocks[hole] = _blocks[next];
+                 hole = next;
+             }
+             next = (next + 1) & mask;
+         }
+         _blocks[hole].ptr = 0;
+         _blockCount--;
+     }
+     portEXIT_CRITICAL_SAFE(&_lock);
+ 
+     return found;
+ }
+ 
+ // Charge the scope's allocations to a tag
+ HeapTagScope::HeapTagScope(HeapTag tag)
+     : _previous(HEAP_TAG_OTHER)
+ {
+ #if TDECK_HEAP_TRACKING
+     _previous = heapTracker.setTaskTag(tag);
+ #else
+     (void)tag;
+ #endif
+ }
+ 
+ // Restore the task's previous tag
+ HeapTagScope::~HeapTagScope() {
+ #if TDECK_HEAP_TRACKING
+     heapTracker.setTaskTag(_previous);
+ #endif
+ }
+ 
+ #if TDECK_HEAP_TRACKING
+ 
+ // Allocator wrappers, linked in with -Wl,--wrap by the tdeck-heap environment
+ extern "C" {
+ 
+ void* __real_malloc(size_t size);
+ void* __real_calloc(size_t count, size_t size);
+ void* __real_realloc(void* ptr, size_t size);
+ void __real_free(void* ptr);
+ 
+ void* __wrap_malloc(size_t size) {
+     void* ptr = __real_malloc(size);
+     if (ptr) {
+         heapTracker.onAlloc(ptr, size);
+     }
+     return ptr;
+ }
+ 
+ void* __wrap_calloc(size_t count, size_t size) {
+     void* ptr = __real_calloc(count, size);
+     if (ptr) {
+         heapTracker.onAlloc(ptr, count * size);
+     }
+     return ptr;
+ }
+ 
+ void* __wrap_realloc(void* ptr, size_t size) {
+     // Forget the old block first, another task may be handed its address once it is freed
+     size_t oldSize = 0;
+     bool tracked = ptr && heapTracker.onFree(ptr, &oldSize);
+ 
+     void* resized = __real_realloc(ptr, size);
+     if (resized) {
+         heapTracker.onAlloc(resized, size);
+     } else if (tracked && size) {
+         // The old block is still allocated
+         heapTracker.onAlloc(ptr, oldSize);
+     }
+     return resized;
+ }
+ 
+ void __wrap_free(void* ptr) {
+     if (ptr) {
+         heapTracker.onFree(ptr, nullptr);
+     }
+     __real_free(ptr);
+ }
+ 
+ }
+ 
+ #endif // TDECK_HEAP_TRACKING
\ No newline at end of file
@@ -0,0 +1,191 @@
+/**
+ * @file heap_tracker.h
+ * @brief Opt-in heap instrumentation with per-subsystem tagging
+ *
+ * The tdeck-heap environment links malloc, calloc, realloc and free through
+ * the wrappers in heap_tracker.cpp. Each live block is then recorded with
+ * the subsystem tag of the task that allocated it and a short backtrace of
+ * the call site, so the heap command and System Info can show which
+ * subsystems hold memory and which sites allocate often or large. Blocks
+ * allocated with heap_caps_malloc directly, such as LVGL's, are not seen.
+ *
+ * Capability statistics (free, low-water mark, fragmentation) are available
+ * in every build.
+ */
+
+ #ifndef TDECK_HEAP_TRACKER_H
+ #define TDECK_HEAP_TRACKER_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // Subsystem an allocation is charged to
+ enum HeapTag {
+     HEAP_TAG_OTHER,
+     HEAP_TAG_UI,
+     HEAP_TAG_TERMINAL,
+     HEAP_TAG_SYSTEM,
+     HEAP_TAG_WIFI,
+     HEAP_TAG_BLE,
+     HEAP_TAG_LORA,
+     HEAP_TAG_OTA,
+     HEAP_TAG_COUNT
+ };
+ 
+ // Heap statistics of one memory capability
+ struct HeapCapsStats {
+     uint32_t total;         // Heap size
+     uint32_t free;          // Bytes free now
+     uint32_t minFree;       // Low-water mark of free bytes since boot
+     uint32_t largest;       // Largest free block
+     uint8_t fragmentation;  // Percent of free bytes outside the largest block
+ };
+ 
+ // Allocations charged to one tag
+ struct HeapTagStats {
+     uint32_t allocs;        // Allocations made
+     uint32_t frees;         // Tracked blocks freed
+     uint32_t live;          // Bytes in tracked blocks
+     uint32_t peak;          // High-water mark of live
+ };
+ 
+ // One allocation site, identified by its caller backtrace
+ struct HeapSite {
+     uint32_t pcs[TDECK_HEAP_TRACK_DEPTH]; // Return addresses, innermost first, 0 past the end
+     uint8_t tag;            // Tag of the first allocation
+     uint32_t count;         // Allocations made
+     uint32_t bytes;         // Bytes allocated in total
+     uint32_t maxSize;       // Largest single allocation
+     uint32_t live;          // Blocks still allocated
+ };
+ 
+ /**
+  * @class HeapTracker
+  * @brief Records live blocks, tags and allocation sites
+  *
+  * The hooks run on every allocation of every task, inside a spinlock and
+  * without allocating themselves. Tables are fixed size: blocks past
+  * TDECK_HEAP_TRACK_SLOTS and sites past TDECK_HEAP_TRACK_SITES are counted
+  * as untracked.
+  */
+ class HeapTracker {
+ public:
+     /**
+      * @brief Constructor
+      */
+     HeapTracker();
+ 
+     /**
+      * @brief Allocate the tracking tables, tracking starts on success
+      * @return true if allocations are tracked, false in builds without the wrappers
+      */
+     bool begin();
+ 
+     /**
+      * @brief Check whether allocations are tracked
+      * @return true once begin() succeeded in a tracking build
+      */
+     bool isTracking() const;
+ 
+     /**
+      * @brief Charge the current task's allocations to a tag
+      * @param tag New tag
+      * @return Previous tag of the task
+      */
+     HeapTag setTaskTag(HeapTag tag);
+ 
+     /**
+      * @brief Get statistics of one memory capability
+      * @param caps MALLOC_CAP_INTERNAL or MALLOC_CAP_SPIRAM
+      * @param stats Receives the statistics
+      */
+     static void getCapsStats(uint32_t caps, HeapCapsStats& stats);
+ 
+     /**
+      * @brief Get the allocations charged to a tag
+      * @param tag Tag
+      * @param stats Receives the statistics
+      */
+     void getTagStats(HeapTag tag, HeapTagStats& stats) const;
+ 
+     /**
+      * @brief Copy the allocation sites, largest first
+      * @param out Receives the sites
+      * @param max Capacity of out
+      * @param byCount Sort by allocation count instead of bytes allocated
+      * @return Number of sites copied
+      */
+     size_t getSites(HeapSite* out, size_t max, bool byCount) const;
+ 
+     /**
+      * @brief Get allocations that could not be recorded
+      * @return Blocks or sites dropped because a table was full
+      */
+     uint32_t getUntracked() const;
+ 
+     /**
+      * @brief Clear the sites and restart the tag high-water marks from the live bytes
+      */
+     void reset();
+ 
+     /**
+      * @brief Get a tag's name
+      * @param tag Tag
+      * @return Short lowercase name
+      */
+     static const char* getTagName(HeapTag tag);
+ 
+     // Called by the allocator wrappers only
+     void onAlloc(void* ptr, size_t size);
+     bool onFree(void* ptr, size_t* size);
+ 
+ private:
+     // One live block
+     struct Block {
+         uintptr_t ptr;      // 0 when the slot is empty
+         uint32_t size;
+         uint8_t tag;
+         uint8_t site;       // Index into _sites, TDECK_HEAP_TRACK_SITES if none
+     };
+ 
+     // One task's current tag
+     struct TaskTag {
+         TaskHandle_t task;
+         HeapTag tag;
+     };
+ 
+     Block* _blocks;                                 // Open addressing table, PSRAM
+     HeapSite* _sites;                               // PSRAM
+     uint16_t _siteCount;
+     uint32_t _blockCount;
+     uint32_t _untracked;
+     HeapTagStats _tags[HEAP_TAG_COUNT];
+     TaskTag _taskTags[TDECK_HEAP_TRACK_TASKS];
+     mutable portMUX_TYPE _lock;
+ 
+     // Tag of the calling task, HEAP_TAG_OTHER in interrupts and untagged tasks
+     HeapTag currentTag() const;
+ 
+     // Home slot of a pointer
+     static uint32_t slotOf(uintptr_t ptr);
+ 
+     // Find or add the site of a backtrace
+     uint8_t findSite(const uint32_t* pcs, HeapTag tag, size_t size);
+ };
+ 
+ /**
+  * @class HeapTagScope
+  * @brief Charges the current task's allocations to a tag until it goes out of scope
+  */
+ class HeapTagScope {
+ public:
+     explicit HeapTagScope(HeapTag tag);
+     ~HeapTagScope();
+ 
+ private:
+     HeapTag _previous;
+ };
+ 
+ extern HeapTracker heapTracker;
+ 
+ #endif // TDECK_HEAP_TRACKER_H
\ No newline at end of file
@@ -5,6 +5,14 @@
 
  #include "ota.h"
  #include "battery.h"
+ #include "../hal/battery_sensor.h"
+ #include "config_storage.h"
+ #include "heap_tracker.h"
+ #include "fs_manager.h"
+ #include "trace.h"
+ #include "../comms/lora.h"
+ #include <esp_heap_caps.h>
+ #include <esp_ota_ops.h>
  
  // Create global instance
  OTAManager otaManager;
@@ -22,12 +30,28 @@
  // OTA configuration file
  #define OTA_CONFIG_FILE "/config/ota.json"
  
+ // Where an update received from a peer is stored before it is applied
+ #define OTA_PEER_FILE "/sd/ota_peer.bin"
+ 
  // Timeout for HTTP connections (milliseconds)
  #define HTTP_TIMEOUT 10000
  
  // Update check interval (hours)
  #define DEFAULT_CHECK_INTERVAL 24
  
+ // A filled download buffer on its way to the flash writer, a null slot stops it
+ struct OTASlot {
+     uint8_t* slot;
+     size_t length;
+ };
+ 
+ // Outcome of one HTTP request of a download
+ enum OTAAttempt {
+     OTA_ATTEMPT_COMPLETE,    // Every byte received
+     OTA_ATTEMPT_RETRY,       // Connection lost, resume from the bytes received so far
+     OTA_ATTEMPT_FAILED       // Download cannot continue, the error is set
+ };
+ 
  OTAManager::OTAManager() :
      _status(OTA_IDLE),
      _errorCode(OTA_ERROR_NONE),
@@ -35,10 +59,26 @@
      _updateUrl(""),
      _defaultUpdateUrl(DEFAULT_UPDATE_SERVER),
      _expectedMD5(""),
+     _expectedSHA256(""),
+     _deltaUrl(""),
+     _delta(false),
+     _updatePath(""),
      _updateVersion(""),
      _downloadProgress(0),
      _updateSize(0),
+     _receivedSize(0),
      _writtenSize(0),
+     _lastProgressTime(0),
+     _abortRequested(false),
+     _freeSlots(nullptr),
+     _fullSlots(nullptr),
+     _flashDone(nullptr),
+     _flashFailed(false),
+     _readSlot(nullptr),
+     _readFill(0),
+     _deltaApplied(false),
+     _peerId(0),
+     _peerDeadline(0),
      _autoCheckEnabled(true),
      _checkIntervalHours(DEFAULT_CHECK_INTERVAL),
      _lastCheckTime(0),
@@ -46,6 +86,7 @@
      _completionCallback(nullptr),
      _updateTaskHandle(nullptr),
      _updateTaskRunning(false) {
+     memset(_slots, 0, sizeof(_slots));
  }
  
  bool OTAManager::init() {
@@ -73,6 +114,11 @@
          // This prevents blocking the initialization process
      }
      
+ #if TDECK_FEATURE_LORA
+     // Updates from a peer arrive as fragmented LoRa transfers
+     loraManager.addTransferCallback(onPeerTransfer);
+ #endif
+     
      return true;
  }
  
@@ -106,6 +152,8 @@
  }
  
  bool OTAManager::checkForUpdates(const char* url) {
+     HeapTagScope heapTag(HEAP_TAG_OTA);
+     
      // Cannot check if already updating
      if (_status != OTA_IDLE && _status != OTA_ERROR && _status != OTA_UPDATE_COMPLETE) {
          TDECK_LOG_E("Cannot check for updates while update in progress");
@@ -259,6 +307,20 @@
          _expectedMD5 = "";
      }
      
+     // SHA-256 is checked on top of MD5 when the server lists it
+     const char* sha256 = doc["sha256"];
+     _expectedSHA256 = sha256 ? sha256 : "";
+     
+     // A patch is only usable against the exact version it was made from
+     const char* deltaFrom = doc["delta"]["from"];
+     const char* deltaUrl = doc["delta"]["url"];
+     if (deltaFrom && deltaUrl && strcmp(deltaFrom, TDECK_FIRMWARE_VERSION) == 0) {
+         _deltaUrl = deltaUrl;
+         TDECK_LOG_I("Delta update offered: %s", deltaUrl);
+     } else {
+         _deltaUrl = "";
+     }
+     
      // Update last check time
      _lastCheckTime = millis() / 1000;
      saveUpdateSettings();
@@ -271,8 +333,8 @@
  }
  
  bool OTAManager::startUpdate(const char* url, const char* expectedMD5, const char* version) {
-     // Cannot start update if already updating
-     if (_status == OTA_DOWNLOADING || _status == OTA_APPLYING) {
+     // Cannot start update if already updating, or while an aborted one winds down
+     if (_status == OTA_DOWNLOADING || _status == OTA_APPLYING || _updateTaskRunning) {
          TDECK_LOG_E("Update already in progress");
          return false;
      }
@@ -286,22 +348,11 @@
          return false;
      }
      
-     // Check battery level
-     if (!checkBatteryLevel()) {
-         TDECK_LOG_E("Battery level too low for update");
-         _status = OTA_ERROR;
-         _errorCode = OTA_ERROR_BATTERY_LOW;
-         _errorMessage = "Battery level too low for update";
-         
-         if (_completionCallback) {
-             _completionCallback(false, _errorCode);
-         }
-         
-         return false;
-     }
-     
-     // Set update parameters
+     // Set update parameters, a different image makes the offered patch useless
      if (url != NULL) {
+         if (_updateUrl != url) {
+             _deltaUrl = "";
+         }
          _updateUrl = url;
      }
      
@@ -315,10 +366,114 @@
      
      TDECK_LOG_I("Starting update from URL: %s", _updateUrl.c_str());
      
+     _updatePath = "";
+     _delta = _deltaUrl.length() > 0;
+     return launchUpdate();
+ }
+ 
+ bool OTAManager::startUpdateFromFile(const char* path, const char* expectedSHA256) {
+     // Cannot start update if already updating, or while an aborted one winds down
+     if (_status == OTA_DOWNLOADING || _status == OTA_APPLYING || _updateTaskRunning) {
+         TDECK_LOG_E("Update already in progress");
+         return false;
+     }
+     
+     // A patch is told apart from an image by its magic, images start with 0xE9
+     FSStream file;
+     uint32_t magic = 0;
+     if (!file.open(path, FILE_READ, 0) || file.read((uint8_t*)&magic, sizeof(magic)) != sizeof(magic)) {
+         TDECK_LOG_E("Cannot read update file: %s", path);
+         _status = OTA_ERROR;
+         _errorCode = OTA_ERROR_DOWNLOAD_FAILED;
+         _errorMessage = "Cannot read update file";
+         return false;
+     }
+     file.close();
+     
+     // The file carries no MD5, Update checks the image itself and the SHA-256 is optional
+     _updatePath = path;
+     _delta = magic == OTA_DELTA_MAGIC;
+     _expectedMD5 = "";
+     _expectedSHA256 = expectedSHA256 != NULL ? expectedSHA256 : "";
+     
+     TDECK_LOG_I("Starting update from file: %s%s", path, _delta ? " (delta)" : "");
+     return launchUpdate();
+ }
+ 
+ bool OTAManager::sendPeerUpdate(const char* path, uint16_t destId) {
+ #if TDECK_FEATURE_LORA
+     // Acknowledged delivery only, a broadcast cannot resend a lost fragment
+     if (destId == 0xFFFF) {
+         TDECK_LOG_E("Peer updates need a destination device");
+         return false;
+     }
+     if (loraManager.sendFile(LORA_MSG_FIRMWARE, path, destId) == 0) {
+         TDECK_LOG_E("Failed to send update %s to 0x%04X", path, destId);
+         return false;
+     }
+     TDECK_LOG_I("Sending update %s to 0x%04X", path, destId);
+     return true;
+ #else
+     return false;
+ #endif
+ }
+ 
+ bool OTAManager::acceptPeerUpdate(uint16_t sourceId, uint32_t timeoutMs) {
+     // Receiving an image that cannot be flashed would only tie up the link
+     if (!checkUpdatePartition()) {
+         return false;
+     }
+     
+     _peerId = sourceId;
+     _peerDeadline = millis() + timeoutMs;
+     TDECK_LOG_I("Accepting an update from 0x%04X for %lu ms", sourceId, (unsigned long)timeoutMs);
+     return true;
+ }
+ 
+ bool OTAManager::checkUpdatePartition() {
+     if (esp_ota_get_next_update_partition(NULL) != NULL) {
+         return true;
+     }
+     
+     TDECK_LOG_E("No OTA update partition, the partition table needs an ota_1 app slot");
+     _status = OTA_ERROR;
+     _errorCode = OTA_ERROR_NO_PARTITION;
+     _errorMessage = "No update partition";
+     
+     if (_completionCallback) {
+         _completionCallback(false, _errorCode);
+     }
+     
+     return false;
+ }
+ 
+ bool OTAManager::launchUpdate() {
+     // Nothing is downloaded unless there is a slot to write it to
+     if (!checkUpdatePartition()) {
+         return false;
+     }
+     
+     // Check battery level
+     if (!checkBatteryLevel()) {
+         TDECK_LOG_E("Battery level too low for update");
+         _status = OTA_ERROR;
+         _errorCode = OTA_ERROR_BATTERY_LOW;
+         _errorMessage = "Battery level too low for update";
+         
+         if (_completionCallback) {
+             _completionCallback(false, _errorCode);
+         }
+         
+         return false;
+     }
+     
      // Reset progress
      _downloadProgress = 0;
      _updateSize = 0;
+     _receivedSize = 0;
      _writtenSize = 0;
+     _lastProgressTime = 0;
+     _abortRequested = false;
      
      // Update status
      _status = OTA_DOWNLOADING;
@@ -367,16 +522,13 @@
      
      TDECK_LOG_I("Aborting update");
      
-     // If update task is running, delete it
-     if (_updateTaskRunning && _updateTaskHandle != nullptr) {
-         vTaskDelete(_updateTaskHandle);
-         _updateTaskHandle = nullptr;
-         _updateTaskRunning = false;
+     // The update task stops its flash writer and aborts Update itself, deleting
+     // it here could leave the writer task in the middle of a flash write
+     _abortRequested = true;
+     if (!_updateTaskRunning) {
+         Update.abort();
      }
      
-     // End update
-     Update.abort();
-     
      // Update status
      _status = OTA_ERROR;
      _errorCode = OTA_ERROR_ABORTED;
@@ -450,10 +602,11 @@
          return false;
      }
      
-     TDECK_LOG_I("Beginning update. Size: %u bytes", _updateSize);
+     TDECK_LOG_I("Beginning update. Size: %u bytes%s", _updateSize, _delta ? " (delta)" : "");
      
-     // Initialize update
-     if (!Update.begin(_updateSize)) {
+     // Initialize update, the size a patch rebuilds is only known from its header
+     // and the decoder checks it against the partition
+     if (!Update.begin(_delta ? UPDATE_SIZE_UNKNOWN : _updateSize)) {
          TDECK_LOG_E("Failed to begin update: %s", Update.errorString());
          _status = OTA_ERROR;
          _errorCode = OTA_ERROR_FLASH_FAILED;
@@ -471,101 +624,64 @@
  }
  
  void OTAManager::processDownload() {
-     TDECK_LOG_I("Starting firmware download from: %s", _updateUrl.c_str());
-     
-     // Create HTTP client
-     HTTPClient http;
-     http.setTimeout(HTTP_TIMEOUT);
-     http.begin(_updateUrl);
+     if (_updatePath.length() == 0) {
+         TDECK_LOG_I("Starting firmware download from: %s", (_delta ? _deltaUrl : _updateUrl).c_str());
+     }
      
-     // Send HTTP GET request
-     int httpCode = http.GET();
+     if (!startPipeline()) {
+         failDownload(OTA_ERROR_DOWNLOAD_FAILED, "No memory for download buffers");
+         return;
+     }
      
-     // Check HTTP response
-     if (httpCode != HTTP_CODE_OK) {
-         TDECK_LOG_E("HTTP GET failed, error: %d", httpCode);
-         _status = OTA_ERROR;
-         _errorCode = OTA_ERROR_DOWNLOAD_FAILED;
-         _errorMessage = "Download failed: HTTP " + String(httpCode);
+     // A dropped connection resumes where it stopped instead of starting over,
+     // only attempts that bring no new data count against the retry budget.
+     // A local file has nothing to resume
+     int attempts = 0;
+     int result = OTA_ATTEMPT_RETRY;
+     while (!_abortRequested) {
+         size_t before = _receivedSize;
+         result = _updatePath.length() > 0 ? fileAttempt() : downloadAttempt();
+         if (result != OTA_ATTEMPT_RETRY || _abortRequested) {
+             break;
+         }
          
-         http.end();
-         return;
+         attempts = _receivedSize > before ? 1 : attempts + 1;
+         if (attempts > TDECK_OTA_RETRIES) {
+             failDownload(OTA_ERROR_DOWNLOAD_FAILED, "Download incomplete");
+             result = OTA_ATTEMPT_FAILED;
+             break;
+         }
+         
+         TDECK_LOG_W("Download interrupted at %u/%u bytes, resuming (attempt %d)",
+                     _receivedSize, _updateSize, attempts);
+         vTaskDelay(pdMS_TO_TICKS(TDECK_OTA_RETRY_DELAY_MS * attempts));
      }
      
-     // Get content length
-     _updateSize = http.getSize();
-     TDECK_LOG_I("Update size: %u bytes", _updateSize);
+     // Let the flash writer finish what is queued
+     bool flashed = stopPipeline();
      
-     if (_updateSize == 0) {
-         TDECK_LOG_E("Invalid update size");
-         _status = OTA_ERROR;
-         _errorCode = OTA_ERROR_DOWNLOAD_FAILED;
-         _errorMessage = "Invalid update size";
-         
-         http.end();
+     if (_abortRequested) {
+         // abortUpdate() already reported the abort
+         Update.abort();
          return;
      }
      
-     // Begin update process
-     if (!beginUpdate()) {
-         http.end();
+     if (_delta && (!flashed || (result == OTA_ATTEMPT_COMPLETE && !_deltaApplied))) {
+         // The next attempt fetches the full image instead
+         failDownload(OTA_ERROR_VERIFICATION_FAILED, "Delta update failed: " + String(_deltaDecoder.getError()));
+         _deltaUrl = "";
+         Update.abort();
          return;
      }
      
-     // Get file stream
-     WiFiClient* stream = http.getStreamPtr();
-     
-     // Read all data from server and write to flash
-     _writtenSize = 0;
-     uint8_t buff[1024] = {0};
-     size_t bytesRead = 0;
-     
-     while (http.connected() && (_writtenSize < _updateSize)) {
-         size_t available = stream->available();
-         
-         if (available) {
-             // Read data from stream
-             bytesRead = stream->readBytes(buff, min(available, sizeof(buff)));
-             
-             // Write data to update
-             if (Update.write(buff, bytesRead) != bytesRead) {
-                 TDECK_LOG_E("Write error: %s", Update.errorString());
-                 _status = OTA_ERROR;
-                 _errorCode = OTA_ERROR_FLASH_FAILED;
-                 _errorMessage = "Flash write error: " + String(Update.errorString());
-                 
-                 http.end();
-                 return;
-             }
-             
-             // Update progress
-             _writtenSize += bytesRead;
-             _downloadProgress = (_writtenSize * 100) / _updateSize;
-             
-             if (_progressCallback) {
-                 _progressCallback(_downloadProgress, _status);
-             }
-             
-             // Log progress periodically
-             if (_writtenSize % 51200 == 0) { // Log every 50KB
-                 TDECK_LOG_I("Download progress: %d%% (%u/%u bytes)", 
-                             _downloadProgress, _writtenSize, _updateSize);
-             }
-         }
-         
-         // Small delay to prevent watchdog issues
-         delay(1);
+     if (!flashed) {
+         failDownload(OTA_ERROR_FLASH_FAILED, "Flash write error: " + String(Update.errorString()));
+         Update.abort();
+         return;
      }
      
-     // End HTTP connection
-     http.end();
-     
-     // Verify download completed
-     if (_writtenSize != _updateSize) {
-         TDECK_LOG_E("Download incomplete. Received: %u, Expected: %u", _writtenSize, _updateSize);
-         _status = OTA_ERROR;
-         _errorCode = OTA_ERROR_DOWNLOAD_FAILED;
-         _errorMessage = "Download incomplete";
+     if (result != OTA_ATTEMPT_COMPLETE) {
+         Update.abort();
          return;
      }
      
@@ -578,6 +694,19 @@
          _progressCallback(100, _status);
      }
      
+     // The digest was computed by the flash writer as the data went by
+     if (_expectedSHA256.length() > 0) {
+         char hex[sizeof(_sha256) * 2 + 1];
+         for (size_t i = 0; i < sizeof(_sha256); i++) {
+             sprintf(hex + i * 2, "%02x", _sha256[i]);
+         }
+         if (!_expectedSHA256.equalsIgnoreCase(hex)) {
+             Update.abort();
+             failDownload(OTA_ERROR_VERIFICATION_FAILED, "Verification failed: SHA-256 mismatch");
+             return;
+         }
+     }
+     
      // Finish update
      if (!Update.end(true)) {
          TDECK_LOG_E("Update verify failed: %s", Update.errorString());
@@ -591,12 +720,306 @@
      _status = OTA_UPDATE_COMPLETE;
      
      // Delay to allow status to propagate
+     configStorage.flush();
+     traceLog.drain();
      delay(1000);
      
      // Reboot
      ESP.restart();
  }
  
+ int OTAManager::downloadAttempt() {
+     HTTPClient http;
+     http.setTimeout(HTTP_TIMEOUT);
+     http.begin(_delta ? _deltaUrl : _updateUrl);
+     
+     // Ask only for what is still missing
+     if (_receivedSize > 0) {
+         http.addHeader("Range", "bytes=" + String(_receivedSize) + "-");
+     }
+     
+     int httpCode = http.GET();
+     size_t skip = 0;
+     
+     if (httpCode == HTTP_CODE_PARTIAL_CONTENT && _receivedSize > 0) {
+         // Resumed, the body is the rest of the file
+         if (http.getSize() > 0 && (size_t)http.getSize() != _updateSize - _receivedSize) {
+             failDownload(OTA_ERROR_SERVER_RESPONSE, "Resume size mismatch");
+             http.end();
+             return OTA_ATTEMPT_FAILED;
+         }
+     } else if (httpCode == HTTP_CODE_OK) {
+         if (_updateSize == 0) {
+             // First request: size the update partition
+             int contentLength = http.getSize();
+             TDECK_LOG_I("Update size: %d bytes", contentLength);
+             if (contentLength <= 0) {
+                 failDownload(OTA_ERROR_DOWNLOAD_FAILED, "Invalid update size");
+                 http.end();
+                 return OTA_ATTEMPT_FAILED;
+             }
+             _updateSize = contentLength;
+             
+             if (!beginUpdate()) {
+                 http.end();
+                 return OTA_ATTEMPT_FAILED;
+             }
+         } else {
+             // The server ignored the range, drop the part already flashed
+             skip = _receivedSize;
+         }
+     } else {
+         TDECK_LOG_E("HTTP GET failed, error: %d", httpCode);
+         http.end();
+         
+         // Transport errors are worth a retry, a refusal from the server is not
+         if (httpCode < 0 && _updateSize > 0) {
+             return OTA_ATTEMPT_RETRY;
+         }
+         failDownload(OTA_ERROR_DOWNLOAD_FAILED, "Download failed: HTTP " + String(httpCode));
+         return OTA_ATTEMPT_FAILED;
+     }
+     
+     // Read straight into the slots, as much as the socket holds per read
+     WiFiClient* stream = http.getStreamPtr();
+     unsigned long lastData = millis();
+     while (_receivedSize < _updateSize && !_abortRequested && !_flashFailed) {
+         if (_readSlot == nullptr) {
+             // Blocks while the flash writer is behind
+             if (xQueueReceive(_freeSlots, &_readSlot, pdMS_TO_TICKS(HTTP_TIMEOUT)) != pdTRUE) {
+                 _readSlot = nullptr;
+                 continue;
+             }
+             _readFill = 0;
+         }
+         
+         size_t want = TDECK_OTA_SLOT_SIZE - _readFill;
+         if (skip > 0) {
+             want = min(want, skip);
+         } else {
+             want = min(want, _updateSize - _receivedSize);
+         }
+         
+         int available = stream->available();
+         if (available <= 0) {
+             // Stalled or closed, keep what arrived and resume
+             if (!stream->connected() || millis() - lastData > HTTP_TIMEOUT) {
+                 break;
+             }
+             vTaskDelay(pdMS_TO_TICKS(5));
+             continue;
+         }
+         
+         int bytesRead = stream->read(_readSlot + _readFill, min(want, (size_t)available));
+         if (bytesRead <= 0) {
+             break;
+         }
+         lastData = millis();
+         
+         if (skip > 0) {
+             skip -= (size_t)bytesRead;
+             continue;
+         }
+         
+         _readFill += bytesRead;
+         _receivedSize += bytesRead;
+         if (_readFill == TDECK_OTA_SLOT_SIZE || _receivedSize == _updateSize) {
+             commitSlot();
+         }
+         reportProgress();
+     }
+     
+     http.end();
+     
+     // A partly filled slot is still good data
+     commitSlot();
+     if (_flashFailed) {
+         return OTA_ATTEMPT_FAILED;
+     }
+     return _receivedSize == _updateSize ? OTA_ATTEMPT_COMPLETE : OTA_ATTEMPT_RETRY;
+ }
+ 
+ int OTAManager::fileAttempt() {
+     FSStream file;
+     if (!file.open(_updatePath.c_str(), FILE_READ, 0)) {
+         failDownload(OTA_ERROR_DOWNLOAD_FAILED, "Cannot read update file");
+         return OTA_ATTEMPT_FAILED;
+     }
+     
+     _updateSize = file.size();
+     TDECK_LOG_I("Update size: %u bytes", _updateSize);
+     if (_updateSize == 0) {
+         failDownload(OTA_ERROR_DOWNLOAD_FAILED, "Invalid update size");
+         file.close();
+         return OTA_ATTEMPT_FAILED;
+     }
+     if (!beginUpdate()) {
+         file.close();
+         return OTA_ATTEMPT_FAILED;
+     }
+     
+     // Whole slots straight from the card, no staging copy
+     while (_receivedSize < _updateSize && !_abortRequested && !_flashFailed) {
+         if (_readSlot == nullptr) {
+             // Blocks while the flash writer is behind
+             if (xQueueReceive(_freeSlots, &_readSlot, pdMS_TO_TICKS(HTTP_TIMEOUT)) != pdTRUE) {
+                 _readSlot = nullptr;
+                 continue;
+             }
+             _readFill = 0;
+         }
+         
+         size_t want = min(TDECK_OTA_SLOT_SIZE - _readFill, _updateSize - _receivedSize);
+         int64_t bytesRead = file.read(_readSlot + _readFill, want);
+         if (bytesRead <= 0) {
+             failDownload(OTA_ERROR_DOWNLOAD_FAILED, "Update file read error");
+             break;
+         }
+         
+         _readFill += bytesRead;
+         _receivedSize += bytesRead;
+         if (_readFill == TDECK_OTA_SLOT_SIZE || _receivedSize == _updateSize) {
+             commitSlot();
+         }
+         reportProgress();
+     }
+     
+     file.close();
+     
+     commitSlot();
+     return _receivedSize == _updateSize && !_flashFailed ? OTA_ATTEMPT_COMPLETE : OTA_ATTEMPT_FAILED;
+ }
+ 
+ bool OTAManager::startPipeline() {
+     _freeSlots = xQueueCreate(TDECK_OTA_SLOTS, sizeof(uint8_t*));
+     _fullSlots = xQueueCreate(TDECK_OTA_SLOTS + 1, sizeof(OTASlot));
+     _flashDone = xSemaphoreCreateBinary();
+     
+     bool allocated = _freeSlots && _fullSlots && _flashDone;
+     for (int i = 0; allocated && i < TDECK_OTA_SLOTS; i++) {
+         _slots[i] = (uint8_t*)heap_caps_malloc(TDECK_OTA_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+         allocated = _slots[i] != nullptr;
+         if (allocated) {
+             xQueueSend(_freeSlots, &_slots[i], 0);
+         }
+     }
+     
+     _readSlot = nullptr;
+     _readFill = 0;
+     _flashFailed = false;
+     mbedtls_sha256_init(&_sha);
+     mbedtls_sha256_starts(&_sha, 0);
+     
+     // A patch is rebuilt from the running image into the partition Update will use,
+     // launchUpdate() has checked there is one
+     if (allocated && _delta) {
+         const esp_partition_t* target = esp_ota_get_next_update_partition(NULL);
+         allocated = target != nullptr &&
+                     _deltaDecoder.begin(esp_ota_get_running_partition(), target->size,
+                                         [this](const uint8_t* data, size_t length) {
+                                             return writeImage(data, length);
+                                         });
+     }
+     
+     if (!allocated || xTaskCreatePinnedToCore(flashTask, "OTA_Flash_Task", TDECK_OTA_WRITER_STACK_SIZE,
+                                               this, OTA_TASK_PRIORITY, nullptr, 1) != pdPASS) {
+         TDECK_LOG_E("Failed to start OTA download pipeline");
+         for (int i = 0; i < TDECK_OTA_SLOTS; i++) {
+             heap_caps_free(_slots[i]);
+             _slots[i] = nullptr;
+         }
+         if (_freeSlots) vQueueDelete(_freeSlots);
+         if (_fullSlots) vQueueDelete(_fullSlots);
+         if (_flashDone) vSemaphoreDelete(_flashDone);
+         _freeSlots = nullptr;
+         _fullSlots = nullptr;
+         _flashDone = nullptr;
+         mbedtls_sha256_free(&_sha);
+         _deltaDecoder.end();
+         return false;
+     }
+     return true;
+ }
+ 
+ bool OTAManager::stopPipeline() {
+     // The writer handles jobs in order, so the stop comes after every slot
+     OTASlot stop = {nullptr, 0};
+     xQueueSend(_fullSlots, &stop, portMAX_DELAY);
+     xSemaphoreTake(_flashDone, portMAX_DELAY);
+     
+     mbedtls_sha256_finish(&_sha, _sha256);
+     mbedtls_sha256_free(&_sha);
+     if (_delta) {
+         _deltaApplied = _deltaDecoder.finish(_sha256);
+         _deltaDecoder.end();
+     }
+     
+     for (int i = 0; i < TDECK_OTA_SLOTS; i++) {
+         heap_caps_free(_slots[i]);
+         _slots[i] = nullptr;
+     }
+     vQueueDelete(_freeSlots);
+     vQueueDelete(_fullSlots);
+     vSemaphoreDelete(_flashDone);
+     _freeSlots = nullptr;
+     _fullSlots = nullptr;
+     _flashDone = nullptr;
+     _readSlot = nullptr;
+     
+     return !_flashFailed;
+ }
+ 
+ bool OTAManager::writeImage(const uint8_t* data, size_t length) {
+     mbedtls_sha256_update(&_sha, data, length);
+     if (Update.write((uint8_t*)data, length) != length) {
+         TDECK_LOG_E("Write error: %s", Update.errorString());
+         return false;
+     }
+     _writtenSize += length;
+     return true;
+ }
+ 
+ bool OTAManager::commitSlot() {
+     if (_readSlot == nullptr) {
+         return true;
+     }
+     
+     OTASlot job = {_readSlot, _readFill};
+     _readSlot = nullptr;
+     if (job.length == 0) {
+         return xQueueSend(_freeSlots, &job.slot, 0) == pdTRUE;
+     }
+     // There is a job entry for every slot, so this never waits
+     return xQueueSend(_fullSlots, &job, portMAX_DELAY) == pdTRUE;
+ }
+ 
+ void OTAManager::reportProgress() {
+     _downloadProgress = ((uint64_t)_receivedSize * 100) / _updateSize;
+     
+     // Callbacks redraw the UI, a few per second is plenty
+     unsigned long now = millis();
+     if (now - _lastProgressTime < TDECK_OTA_PROGRESS_INTERVAL_MS && _receivedSize < _updateSize) {
+         return;
+     }
+     _lastProgressTime = now;
+     
+     if (_progressCallback) {
+         _progressCallback(_downloadProgress, _status);
+     }
+ }
+ 
+ void OTAManager::failDownload(OTAErrorCode error, const String& message) {
+     TDECK_LOG_E("%s", message.c_str());
+     
+     // An abort has already been reported
+     if (_abortRequested) {
+         return;
+     }
+     _status = OTA_ERROR;
+     _errorCode = error;
+     _errorMessage = message;
+ }
+ 
  void OTAManager::finishUpdate(bool success, OTAErrorCode error) {
      if (success) {
          _status = OTA_UPDATE_COMPLETE;
@@ -611,6 +1034,12 @@
  }
  
  bool OTAManager::checkBatteryLevel() {
+     // Without a battery reading the percentage would be 0, do not refuse on it
+     if (!batterySensor.isAvailable()) {
+         TDECK_LOG_W("Battery level unknown, allowing update");
+         return true;
+     }
+     
      // Check battery percentage
      int batteryPercentage = batteryManager.getPercentage();
      
@@ -642,7 +1071,7 @@
      doc["update_server"] = _defaultUpdateUrl;
      
      // Save to file
-     if (!fsManager.saveJsonToFile(OTA_CONFIG_FILE, doc)) {
+     if (!configStorage.write(OTA_CONFIG_FILE, doc)) {
          TDECK_LOG_E("Failed to save OTA settings");
      }
  }
@@ -652,7 +1081,7 @@
      DynamicJsonDocument doc(512);
      
      // Load from file
-     if (fsManager.loadJsonFromFile(OTA_CONFIG_FILE, doc)) {
+     if (configStorage.read(OTA_CONFIG_FILE, doc)) {
          // Get settings
          _autoCheckEnabled = doc["auto_check"] | true;
          _checkIntervalHours = doc["check_interval_hours"] | DEFAULT_CHECK_INTERVAL;
@@ -681,6 +1110,7 @@
  // Static update task function
  void OTAManager::updateTask(void* parameter) {
      OTAManager* otaManager = static_cast<OTAManager*>(parameter);
+     heapTracker.setTaskTag(HEAP_TAG_OTA);
      
      // Process download
      otaManager->processDownload();
@@ -691,4 +1121,50 @@
      
      // Delete task
      vTaskDelete(NULL);
+ }
+ 
+ // Reassembled LoRa transfers, runs on the LoRa comms task
+ void OTAManager::onPeerTransfer(uint16_t sourceId, uint8_t messageType, const uint8_t* data, size_t length) {
+     if (messageType != LORA_MSG_FIRMWARE) {
+         return;
+     }
+     
+     // Only the peer the user agreed to, and only once
+     if (otaManager._peerDeadline == 0 || sourceId != otaManager._peerId ||
+         (long)(millis() - otaManager._peerDeadline) > 0) {
+         TDECK_LOG_W("Ignoring firmware from 0x%04X, not accepted", sourceId);
+         return;
+     }
+     otaManager._peerDeadline = 0;
+     
+     // The data is only valid during the call, the file source streams it from the card
+     if (FSManager::write_file(OTA_PEER_FILE, data, length) != (int64_t)length) {
+         TDECK_LOG_E("Failed to store firmware from 0x%04X", sourceId);
+         return;
+     }
+     TDECK_LOG_I("Received %u byte update from 0x%04X", length, sourceId);
+     otaManager.startUpdateFromFile(OTA_PEER_FILE);
+ }
+ 
+ // Static flash writer task function
+ void OTAManager::flashTask(void* parameter) {
+     OTAManager* otaManager = static_cast<OTAManager*>(parameter);
+     heapTracker.setTaskTag(HEAP_TAG_OTA);
+     
+     // Hash and flash each slot as it arrives, while the next one downloads
+     OTASlot job;
+     while (xQueueReceive(otaManager->_fullSlots, &job, portMAX_DELAY) == pdTRUE && job.slot) {
+         if (!otaManager->_flashFailed && !otaManager->_abortRequested) {
+             // A patch is inflated and applied here too, writing the rebuilt image
+             bool written = otaManager->_delta ? otaManager->_deltaDecoder.feed(job.slot, job.length)
+                                               : otaManager->writeImage(job.slot, job.length);
+             if (!written) {
+                 otaManager->_flashFailed = true;
+             }
+         }
+         xQueueSend(otaManager->_freeSlots, &job.slot, 0);
+     }
+     
+     xSemaphoreGive(otaManager->_flashDone);
+     vTaskDelete(NULL);
  }
\ No newline at end of file
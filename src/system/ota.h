@@ -14,8 +14,10 @@
  #include <WiFi.h>
  #include <HTTPClient.h>
  #include <ArduinoJson.h>
+ #include <mbedtls/sha256.h>
  #include "../config.h"
  #include "config_storage.h"
+ #include "ota_delta.h"
  
  // OTA update status
  enum OTAUpdateStatus {
@@ -38,7 +40,8 @@
      OTA_ERROR_FLASH_FAILED,          // Failed to flash update
      OTA_ERROR_INSUFFICIENT_SPACE,    // Not enough space for update
      OTA_ERROR_BATTERY_LOW,           // Battery too low for update
-     OTA_ERROR_ABORTED                // Update aborted by user
+     OTA_ERROR_ABORTED,               // Update aborted by user
+     OTA_ERROR_NO_PARTITION           // Partition table has no second app slot to update into
  };
  
  class OTAManager {
@@ -80,6 +83,44 @@
       * @return false if failed to start update
       */
      bool startUpdate(const char* url, const char* expectedMD5 = NULL, const char* version = NULL);
+     
+     /**
+      * @brief Start applying an update from a file, without WiFi
+      * 
+      * The image, or a patch from tools/make_delta.py, is streamed from the
+      * file through the same verified flashing path as a download.
+      * 
+      * @param path Path of the image or patch, e.g. on /sd
+      * @param expectedSHA256 Expected SHA-256 of the firmware image as hex (optional)
+      * @return true if update process started
+      * @return false if failed to start update
+      */
+     bool startUpdateFromFile(const char* path, const char* expectedSHA256 = NULL);
+     
+     /**
+      * @brief Send an update file to another device over LoRa
+      * 
+      * Fragmented transfers are limited to TDECK_LORA_TRANSFER_MAX, which in
+      * practice means a delta patch. The receiver must call acceptPeerUpdate().
+      * 
+      * @param path Path of the patch or image
+      * @param destId Destination device ID
+      * @return true if the transfer started
+      * @return false if it could not be queued
+      */
+     bool sendPeerUpdate(const char* path, uint16_t destId);
+     
+     /**
+      * @brief Accept one update sent by a peer over LoRa
+      * 
+      * The update is stored on the SD card and applied with startUpdateFromFile().
+      * 
+      * @param sourceId Device ID allowed to send it
+      * @param timeoutMs How long the offer stands
+      * @return true if the update will be accepted
+      * @return false if there is no partition to flash it to
+      */
+     bool acceptPeerUpdate(uint16_t sourceId, uint32_t timeoutMs = TDECK_OTA_PEER_TIMEOUT_MS);
  
      /**
       * @brief Abort current update process
@@ -162,10 +203,35 @@
      String _updateUrl;
      String _defaultUpdateUrl;
      String _expectedMD5;
+     String _expectedSHA256;
+     String _deltaUrl;               // Patch against the running version, empty if none was offered
+     bool _delta;                    // The current download is a patch
+     String _updatePath;             // Local image or patch, empty for downloads
      String _updateVersion;
      int _downloadProgress;
      size_t _updateSize;
-     size_t _writtenSize;
+     size_t _receivedSize;
+     volatile size_t _writtenSize;
+     unsigned long _lastProgressTime;
+     volatile bool _abortRequested;
+     
+     // Download pipeline: the update task reads the network into slots, the flash task
+     // hashes and writes them. _readSlot is the slot being filled
+     uint8_t* _slots[TDECK_OTA_SLOTS];
+     QueueHandle_t _freeSlots;
+     QueueHandle_t _fullSlots;
+     SemaphoreHandle_t _flashDone;
+     volatile bool _flashFailed;
+     uint8_t* _readSlot;
+     size_t _readFill;
+     mbedtls_sha256_context _sha;
+     uint8_t _sha256[32];
+     OTADelta _deltaDecoder;
+     bool _deltaApplied;
+     
+     // Peer allowed to send an update over LoRa, until _peerDeadline (0 if none)
+     uint16_t _peerId;
+     unsigned long _peerDeadline;
      
      // Auto update settings
      bool _autoCheckEnabled;
@@ -181,8 +247,18 @@
      bool _updateTaskRunning;
      
      // Helper methods
+     bool launchUpdate();
+     bool checkUpdatePartition();
      bool beginUpdate();
      void processDownload();
+     int downloadAttempt();
+     int fileAttempt();
+     bool startPipeline();
+     bool stopPipeline();
+     bool commitSlot();
+     bool writeImage(const uint8_t* data, size_t length);
+     void reportProgress();
+     void failDownload(OTAErrorCode error, const String& message);
      void finishUpdate(bool success, OTAErrorCode error = OTA_ERROR_NONE);
      bool checkBatteryLevel();
      void saveUpdateSettings();
@@ -190,6 +266,12 @@
      
      // Update task function
      static void updateTask(void* parameter);
+     
+     // Flash writer task function, one per download
+     static void flashTask(void* parameter);
+     
+     // Reassembled LoRa transfer callback
+     static void onPeerTransfer(uint16_t sourceId, uint8_t messageType, const uint8_t* data, size_t length);
  };
  
  extern OTAManager otaManager;
@@ -0,0 +1,317 @@
+/**
+ * @file ota_delta.cpp
+ * @brief Implementation of the delta update decoder
+ */
+
+ #include "ota_delta.h"
+ #include <esp_heap_caps.h>
+ #include <mbedtls/sha256.h>
+ #if __has_include(<esp32s3/rom/miniz.h>)
+ #include <esp32s3/rom/miniz.h>
+ #else
+ #include <rom/miniz.h>
+ #endif
+ 
+ // Constructor
+ OTADelta::OTADelta()
+     : _source(nullptr)
+     , _maxTargetSize(0)
+     , _headerFill(0)
+     , _inflator(nullptr)
+     , _window(nullptr)
+     , _windowOffset(0)
+     , _scratch(nullptr)
+     , _inflated(false)
+     , _state(STATE_HEADER)
+     , _op(0)
+     , _argsFill(0)
+     , _argsNeed(0)
+     , _sourcePosition(0)
+     , _remaining(0)
+     , _written(0)
+     , _error("")
+ {
+     memset(&_header, 0, sizeof(_header));
+ }
+ 
+ // Destructor
+ OTADelta::~OTADelta() {
+     end();
+ }
+ 
+ // Allocate the inflate state and start a patch
+ bool OTADelta::begin(const esp_partition_t* source, size_t maxTargetSize, Sink sink) {
+     end();
+ 
+     // The ring must be the full deflate window, back references reach that far
+     _inflator = heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_SPIRAM);
+     _window = (uint8_t*)heap_caps_malloc(TINFL_LZ_DICT_SIZE, MALLOC_CAP_SPIRAM);
+     _scratch = (uint8_t*)heap_caps_malloc(TDECK_OTA_DELTA_SCRATCH_SIZE, MALLOC_CAP_INTERNAL);
+     if (!source || !_inflator || !_window || !_scratch) {
+         end();
+         return fail("No memory for delta decoder");
+     }
+     tinfl_init((tinfl_decompressor*)_inflator);
+ 
+     _source = source;
+     _maxTargetSize = maxTargetSize;
+     _sink = sink;
+     _headerFill = 0;
+     _windowOffset = 0;
+     _inflated = false;
+     _state = STATE_HEADER;
+     _written = 0;
+     _error = "";
+     return true;
+ }
+ 
+ // Decode the next bytes of the patch
+ bool OTADelta::feed(const uint8_t* data, size_t length) {
+     if (!_inflator) {
+         return fail("Delta decoder not started");
+     }
+ 
+     // The header is stored uncompressed ahead of the zlib stream
+     if (_state == STATE_HEADER) {
+         size_t take = min(length, sizeof(_header) - _headerFill);
+         memcpy((uint8_t*)&_header + _headerFill, data, take);
+         _headerFill += take;
+         data += take;
+         length -= take;
+         if (_headerFill < sizeof(_header)) {
+             return true;
+         }
+         if (!checkSource()) {
+             return false;
+         }
+         _state = STATE_OP;
+     }
+ 
+     while (!_inflated) {
+         size_t inBytes = length;
+         size_t outBytes = TINFL_LZ_DICT_SIZE - _windowOffset;
+         tinfl_status status = tinfl_decompress((tinfl_decompressor*)_inflator, data, &inBytes,
+                                                _window, _window + _windowOffset, &outBytes,
+                                                TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+         data += inBytes;
+         length -= inBytes;
+ 
+         if (outBytes > 0 && !parse(_window + _windowOffset, outBytes)) {
+             return false;
+         }
+         _windowOffset = (_windowOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+ 
+         if (status == TINFL_STATUS_DONE) {
+             _inflated = true;
+         } else if (status < 0) {
+             return fail("Corrupt delta patch");
+         } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0) {
+             // The rest arrives with the next slot
+             break;
+         }
+     }
+     return true;
+ }
+ 
+ // Check that the whole patch was applied
+ bool OTADelta::finish(const uint8_t* imageSha256) {
+     if (_state != STATE_END || !_inflated) {
+         return fail("Delta patch incomplete");
+     }
+     if (_written != _header.targetSize) {
+         return fail("Delta patch produced the wrong size");
+     }
+     if (memcmp(imageSha256, _header.targetSha256, sizeof(_header.targetSha256)) != 0) {
+         return fail("Delta result SHA-256 mismatch");
+     }
+     return true;
+ }
+ 
+ // Free the inflate state
+ void OTADelta::end() {
+     heap_caps_free(_inflator);
+     heap_caps_free(_window);
+     heap_caps_free(_scratch);
+     _inflator = nullptr;
+     _window = nullptr;
+     _scratch = nullptr;
+     _sink = nullptr;
+ }
+ 
+ // Get the reason feed() or finish() failed
+ const char* OTADelta::getError() const {
+     return _error;
+ }
+ 
+ // Check the header and that the running image is the one the patch was made against
+ bool OTADelta::checkSource() {
+     if (_header.magic != OTA_DELTA_MAGIC || _header.version != OTA_DELTA_VERSION) {
+         return fail("Not a delta patch");
+     }
+     if (_header.sourceSize > _source->size) {
+         return fail("Delta patch is for another firmware");
+     }
+     if (_header.targetSize > _maxTargetSize) {
+         return fail("Delta result too large for the update partition");
+     }
+ 
+     mbedtls_sha256_context sha;
+     mbedtls_sha256_init(&sha);
+     mbedtls_sha256_starts(&sha, 0);
+     for (uint32_t offset = 0; offset < _header.sourceSize; offset += TDECK_OTA_DELTA_SCRATCH_SIZE) {
+         size_t length = min((uint32_t)TDECK_OTA_DELTA_SCRATCH_SIZE, _header.sourceSize - offset);
+         if (esp_partition_read(_source, offset, _scratch, length) != ESP_OK) {
+             mbedtls_sha256_free(&sha);
+             return fail("Failed to read running firmware");
+         }
+         mbedtls_sha256_update(&sha, _scratch, length);
+     }
+     uint8_t digest[32];
+     mbedtls_sha256_finish(&sha, digest);
+     mbedtls_sha256_free(&sha);
+ 
+     if (memcmp(digest, _header.sourceSha256, sizeof(digest)) != 0) {
+         return fail("Delta patch is for another firmware");
+     }
+     return true;
+ }
+ 
+ // Run inflated bytes through the operation parser
+ bool OTADelta::parse(const uint8_t* data, size_t length) {
+     while (length > 0) {
+         switch (_state) {
+             case STATE_OP:
+                 _op = *data++;
+                 length--;
+                 _argsFill = 0;
+                 if (_op == OTA_DELTA_OP_END) {
+                     _state = STATE_END;
+                 } else if (_op == OTA_DELTA_OP_COPY || _op == OTA_DELTA_OP_DIFF) {
+                     _argsNeed = 8;
+                     _state = STATE_ARGS;
+                 } else if (_op == OTA_DELTA_OP_LITERAL) {
+                     _argsNeed = 4;
+                     _state = STATE_ARGS;
+                 } else {
+                     return fail("Corrupt delta patch");
+                 }
+                 break;
+ 
+             case STATE_ARGS: {
+                 size_t take = min(length, _argsNeed - _argsFill);
+                 memcpy(_args + _argsFill, data, take);
+                 _argsFill += take;
+                 data += take;
+                 length -= take;
+                 if (_argsFill == _argsNeed && !startOp()) {
+                     return false;
+                 }
+                 break;
+             }
+ 
+             case STATE_DIFF: {
+                 // New byte = old byte + patch byte, a scratch buffer at a time
+                 size_t take = min(min(length, (size_t)_remaining), (size_t)TDECK_OTA_DELTA_SCRATCH_SIZE);
+                 if (esp_partition_read(_source, _sourcePosition, _scratch, take) != ESP_OK) {
+                     return fail("Failed to read running firmware");
+                 }
+                 for (size_t i = 0; i < take; i++) {
+                     _scratch[i] += data[i];
+                 }
+                 if (!emit(_scratch, take)) {
+                     return false;
+                 }
+                 _sourcePosition += take;
+                 _remaining -= take;
+                 data += take;
+                 length -= take;
+                 if (_remaining == 0) {
+                     _state = STATE_OP;
+                 }
+                 break;
+             }
+ 
+             case STATE_LITERAL: {
+                 size_t take = min(length, (size_t)_remaining);
+                 if (!emit(data, take)) {
+                     return false;
+                 }
+                 _remaining -= take;
+                 data += take;
+                 length -= take;
+                 if (_remaining == 0) {
+                     _state = STATE_OP;
+                 }
+                 break;
+             }
+ 
+             default:
+                 return fail("Data after the end of the delta patch");
+         }
+     }
+     return true;
+ }
+ 
+ // Start the operation whose arguments are complete
+ bool OTADelta::startOp() {
+     uint32_t first;
+     uint32_t second = 0;
+     memcpy(&first, _args, sizeof(first));
+     if (_argsNeed == 8) {
+         memcpy(&second, _args + 4, sizeof(second));
+     }
+ 
+     if (_op == OTA_DELTA_OP_LITERAL) {
+         _remaining = first;
+         _state = _remaining > 0 ? STATE_LITERAL : STATE_OP;
+         return true;
+     }
+ 
+     // COPY and DIFF read [first, first + second) of the old image
+     if (first > _header.sourceSize || second > _header.sourceSize - first) {
+         return fail("Corrupt delta patch");
+     }
+     if (_op == OTA_DELTA_OP_COPY) {
+         _state = STATE_OP;
+         return copySource(first, second);
+     }
+     _sourcePosition = first;
+     _remaining = second;
+     _state = _remaining > 0 ? STATE_DIFF : STATE_OP;
+     return true;
+ }
+ 
+ // Pass rebuilt bytes to the sink
+ bool OTADelta::emit(const uint8_t* data, size_t length) {
+     if (length > _header.targetSize - _written) {
+         return fail("Delta patch produced the wrong size");
+     }
+     if (!_sink(data, length)) {
+         return fail("Flash write error");
+     }
+     _written += length;
+     return true;
+ }
+ 
+ // Pass a run of unchanged old bytes to the sink
+ bool OTADelta::copySource(uint32_t offset, uint32_t length) {
+     while (length > 0) {
+         size_t take = min(length, (uint32_t)TDECK_OTA_DELTA_SCRATCH_SIZE);
+         if (esp_partition_read(_source, offset, _scratch, take) != ESP_OK) {
+             return fail("Failed to read running firmware");
+         }
+         if (!emit(_scratch, take)) {
+             return false;
+         }
+         offset += take;
+         length -= take;
+     }
+     return true;
+ }
+ 
+ // Record an error, always returns false
+ bool OTADelta::fail(const char* error) {
+     _error = error;
+     TDECK_LOG_E("OTA delta: %s", error);
+     return false;
+ }
\ No newline at end of file
@@ -0,0 +1,136 @@
+/**
+ * @file ota_delta.h
+ * @brief Streaming decoder for delta (binary patch) firmware updates
+ *
+ * tools/make_delta.py diffs two firmware images into a patch: a fixed header
+ * followed by a zlib stream of copy, diff and literal operations. The
+ * decoder inflates the patch as it arrives, reads the old bytes straight from
+ * the running app partition and hands the rebuilt image to a sink, so RAM use
+ * is bounded by the inflate window whatever the image size.
+ */
+
+ #ifndef TDECK_OTA_DELTA_H
+ #define TDECK_OTA_DELTA_H
+ 
+ #include <Arduino.h>
+ #include <esp_partition.h>
+ #include <functional>
+ #include "../config.h"
+ 
+ // Patch layout, shared with tools/make_delta.py, all fields little endian
+ #define OTA_DELTA_MAGIC 0x50444454  // "TDDP"
+ #define OTA_DELTA_VERSION 1
+ 
+ // Operations in the inflated stream
+ #define OTA_DELTA_OP_END 0x00       // End of the patch
+ #define OTA_DELTA_OP_COPY 0x01      // Source offset (4), length (4): old bytes unchanged
+ #define OTA_DELTA_OP_DIFF 0x02      // Source offset (4), length (4), then length bytes added to the old ones
+ #define OTA_DELTA_OP_LITERAL 0x03   // Length (4), then length new bytes
+ 
+ // Patch header, the zlib stream follows
+ struct __attribute__((packed)) OTADeltaHeader {
+     uint32_t magic;
+     uint8_t version;
+     uint8_t reserved[3];
+     uint32_t sourceSize;    // Bytes of the running image the patch applies to
+     uint8_t sourceSha256[32];
+     uint32_t targetSize;    // Bytes of the rebuilt image
+     uint8_t targetSha256[32];
+ };
+ 
+ /**
+  * @brief Rebuilds a firmware image from the running one and a patch
+  */
+ class OTADelta {
+ public:
+     // Receives the rebuilt image in order, returns false to stop
+     using Sink = std::function<bool(const uint8_t* data, size_t length)>;
+ 
+     OTADelta();
+     ~OTADelta();
+ 
+     /**
+      * @brief Allocate the inflate state and start a patch
+      *
+      * @param source Partition holding the image the patch was made against
+      * @param maxTargetSize Largest image the destination can hold
+      * @param sink Receives the rebuilt image
+      * @return true if ready for feed()
+      */
+     bool begin(const esp_partition_t* source, size_t maxTargetSize, Sink sink);
+ 
+     /**
+      * @brief Decode the next bytes of the patch
+      *
+      * The source image is checked against the header as soon as the header
+      * is complete, before anything reaches the sink.
+      *
+      * @param data Patch bytes
+      * @param length Number of bytes
+      * @return false on a corrupt patch, a wrong source or a sink failure
+      */
+     bool feed(const uint8_t* data, size_t length);
+ 
+     /**
+      * @brief Check that the whole patch was applied
+      *
+      * @param imageSha256 SHA-256 of everything the sink received
+      * @return true if the patch ended, the size is right and the hash matches the header
+      */
+     bool finish(const uint8_t* imageSha256);
+ 
+     /**
+      * @brief Free the inflate state
+      */
+     void end();
+ 
+     /**
+      * @brief Get the reason feed() or finish() failed
+      *
+      * @return Error message
+      */
+     const char* getError() const;
+ 
+ private:
+     // Parser states for the inflated operation stream
+     enum State {
+         STATE_HEADER,
+         STATE_OP,
+         STATE_ARGS,
+         STATE_DIFF,
+         STATE_LITERAL,
+         STATE_END
+     };
+ 
+     const esp_partition_t* _source;
+     size_t _maxTargetSize;
+     Sink _sink;
+ 
+     OTADeltaHeader _header;
+     size_t _headerFill;
+ 
+     void* _inflator;            // tinfl_decompressor
+     uint8_t* _window;           // Inflate dictionary, also the output ring
+     size_t _windowOffset;
+     uint8_t* _scratch;          // Source bytes read for COPY and DIFF
+     bool _inflated;             // zlib stream ended
+ 
+     State _state;
+     uint8_t _op;
+     uint8_t _args[8];
+     size_t _argsFill;
+     size_t _argsNeed;
+     uint32_t _sourcePosition;
+     uint32_t _remaining;
+     uint32_t _written;
+     const char* _error;
+ 
+     bool checkSource();
+     bool parse(const uint8_t* data, size_t length);
+     bool startOp();
+     bool emit(const uint8_t* data, size_t length);
+     bool copySource(uint32_t offset, uint32_t length);
+     bool fail(const char* error);
+ };
+ 
+ #endif // TDECK_OTA_DELTA_H
\ No newline at end of file
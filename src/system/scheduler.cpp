@@ -0,0 +1,139 @@
+/**
+ * @file scheduler.cpp
+ * @brief Implementation of the system task service scheduler
+ */
+
+ #include "scheduler.h"
+ 
+ // Global scheduler instance
+ ServiceScheduler serviceScheduler;
+ 
+ // Signed deadline check that survives millis() wrap-around
+ static inline bool isDue(uint32_t deadline, uint32_t now) {
+     return (int32_t)(deadline - now) <= 0;
+ }
+ 
+ // Constructor
+ ServiceScheduler::ServiceScheduler()
+     : _count(0)
+     , _task(NULL)
+     , _lock(portMUX_INITIALIZER_UNLOCKED)
+ {
+ }
+ 
+ // Register a service
+ ServiceId ServiceScheduler::add(const char* name, uint32_t periodMs, ServiceFunction function, void* context) {
+     if (_count >= TDECK_SCHEDULER_MAX_SERVICES || !function) {
+         TDECK_LOG_E("Cannot register service %s", name);
+         return SERVICE_INVALID;
+     }
+ 
+     Service& service = _services[_count];
+     service.function = function;
+     service.context = context;
+     service.deadline = millis();
+     service.woken = false;
+     memset(&service.stats, 0, sizeof(service.stats));
+     service.stats.name = name;
+     service.stats.periodMs = periodMs;
+     return _count++;
+ }
+ 
+ // Run a service as soon as possible
+ void ServiceScheduler::wake(ServiceId id) {
+     if (id >= _count) {
+         return;
+     }
+ 
+     _services[id].woken = true;
+     if (_task) {
+         xTaskNotifyGive(_task);
+     }
+ }
+ 
+ // Run a service as soon as possible, from an interrupt handler
+ void IRAM_ATTR ServiceScheduler::wakeFromISR(ServiceId id) {
+     if (id >= _count) {
+         return;
+     }
+ 
+     _services[id].woken = true;
+     if (_task) {
+         BaseType_t woken = pdFALSE;
+         vTaskNotifyGiveFromISR(_task, &woken);
+         portYIELD_FROM_ISR(woken);
+     }
+ }
+ 
+ // Run services forever
+ void ServiceScheduler::run() {
+     _task = xTaskGetCurrentTaskHandle();
+ 
+     while (1) {
+         uint32_t sleepMs = runDue();
+ 
+         // A wake() since runDue() left a notification, so this returns at once
+         ulTaskNotifyTake(pdTRUE, sleepMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(sleepMs));
+     }
+ }
+ 
+ // Run every service that is due or woken
+ uint32_t ServiceScheduler::runDue() {
+     for (uint8_t i = 0; i < _count; i++) {
+         Service& service = _services[i];
+         uint32_t now = millis();
+ 
+         bool woken = service.woken;
+         if (!woken && !isDue(service.deadline, now)) {
+             continue;
+         }
+         service.woken = false;
+ 
+         uint32_t start = micros();
+         uint32_t next = service.function(service.context);
+         uint32_t elapsed = micros() - start;
+ 
+         // The period is the longest a service waits, it may ask to run sooner
+         service.deadline = millis() + min(next, service.stats.periodMs);
+ 
+         portENTER_CRITICAL(&_lock);
+         service.stats.runs++;
+         if (woken) {
+             service.stats.wakes++;
+         }
+         service.stats.totalMicros += elapsed;
+         if (elapsed > service.stats.maxMicros) {
+             service.stats.maxMicros = elapsed;
+         }
+         portEXIT_CRITICAL(&_lock);
+     }
+ 
+     // Sleep until the earliest deadline
+     uint32_t now = millis();
+     uint32_t sleepMs = UINT32_MAX;
+     for (uint8_t i = 0; i < _count; i++) {
+         const Service& service = _services[i];
+         if (service.woken || isDue(service.deadline, now)) {
+             return 0;
+         }
+         sleepMs = min(sleepMs, service.deadline - now);
+     }
+     return sleepMs;
+ }
+ 
+ // Get the number of registered services
+ size_t ServiceScheduler::getCount() const {
+     return _count;
+ }
+ 
+ // Get the run statistics of a service
+ bool ServiceScheduler::getStats(ServiceId id, ServiceStats& stats) const {
+     if (id >= _count) {
+         return false;
+     }
+ 
+     portENTER_CRITICAL(&_lock);
+     stats = _services[id].stats;
+     portEXIT_CRITICAL(&_lock);
+     return true;
+ }
\ No newline at end of file
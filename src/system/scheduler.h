@@ -0,0 +1,121 @@
+/**
+ * @file scheduler.h
+ * @brief Cooperative scheduler for the system task services
+ *
+ * Each manager registers a service with a period. The system task runs the
+ * services that are due and then sleeps until the earliest deadline, or
+ * until an event source wakes a service early.
+ */
+
+ #ifndef TDECK_SCHEDULER_H
+ #define TDECK_SCHEDULER_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // Handle of a registered service
+ typedef uint8_t ServiceId;
+ 
+ // Returned by add() when the table is full
+ #define SERVICE_INVALID 0xFF
+ 
+ /**
+  * @brief Service entry point
+  * @param context Pointer given at registration
+  * @return Milliseconds until the service next needs to run, the period
+  *         bounds it, UINT32_MAX to just wait for the period
+  */
+ typedef uint32_t (*ServiceFunction)(void* context);
+ 
+ // Run statistics of one service
+ struct ServiceStats {
+     const char* name;       // Name given at registration
+     uint32_t periodMs;      // Longest interval between runs
+     uint32_t runs;          // Times the service ran
+     uint32_t wakes;         // Runs brought forward by an event
+     uint64_t totalMicros;   // Time spent in the service
+     uint32_t maxMicros;     // Longest single run
+ };
+ 
+ /**
+  * @class ServiceScheduler
+  * @brief Runs registered services from one task, each at its own deadline
+  *
+  * Services register during setup, before run() starts. wake() may be
+  * called from any task, wakeFromISR() from interrupt handlers.
+  */
+ class ServiceScheduler {
+ public:
+     /**
+      * @brief Constructor
+      */
+     ServiceScheduler();
+ 
+     /**
+      * @brief Register a service, it first runs when run() starts
+      * @param name Name for statistics, must outlive the scheduler
+      * @param periodMs Longest interval between runs
+      * @param function Service entry point
+      * @param context Passed to function
+      * @return Service handle, SERVICE_INVALID if the table is full
+      */
+     ServiceId add(const char* name, uint32_t periodMs, ServiceFunction function, void* context = nullptr);
+ 
+     /**
+      * @brief Run a service as soon as possible
+      * @param id Service handle
+      */
+     void wake(ServiceId id);
+ 
+     /**
+      * @brief Run a service as soon as possible, from an interrupt handler
+      * @param id Service handle
+      */
+     void wakeFromISR(ServiceId id);
+ 
+     /**
+      * @brief Run services forever, sleeping between deadlines
+      *
+      * Called from the system task, never returns.
+      */
+     void run();
+ 
+     /**
+      * @brief Run every service that is due or woken
+      * @return Milliseconds until the earliest deadline
+      */
+     uint32_t runDue();
+ 
+     /**
+      * @brief Get the number of registered services
+      * @return Service count
+      */
+     size_t getCount() const;
+ 
+     /**
+      * @brief Get the run statistics of a service
+      * @param id Service handle
+      * @param stats Receives the statistics
+      * @return true if id is a registered service
+      */
+     bool getStats(ServiceId id, ServiceStats& stats) const;
+ 
+ private:
+     // One registered service
+     struct Service {
+         ServiceFunction function;
+         void* context;
+         uint32_t deadline;      // millis() at which the service is due
+         volatile bool woken;    // An event asked for an early run
+         ServiceStats stats;
+     };
+ 
+     Service _services[TDECK_SCHEDULER_MAX_SERVICES];
+     uint8_t _count;                 // Registered services
+     TaskHandle_t _task;             // Task inside run(), NULL before it starts
+     mutable portMUX_TYPE _lock;     // Guards the wake flags and statistics
+ };
+ 
+ extern ServiceScheduler serviceScheduler;
+ 
+ #endif // TDECK_SCHEDULER_H
\ No newline at end of file
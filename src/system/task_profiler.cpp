@@ -0,0 +1,422 @@
+/**
+ * @file task_profiler.cpp
+ * @brief Implementation of the task CPU and PC sampling profiler
+ */
+
+ #include "task_profiler.h"
+ #include <driver/timer.h>
+ #include <esp_timer.h>
+ #include <algorithm>
+ 
+ // Timer of each core's sampling interrupt, core n uses group n
+ #define SAMPLE_TIMER TIMER_0
+ 
+ // Longest wait for a core to set up or tear down its timer
+ #define SETUP_TIMEOUT_MS 100
+ 
+ // Slots probed in the PC table before a sample is dropped
+ #define PC_PROBES 8
+ 
+ // Global instance
+ TaskProfiler taskProfiler;
+ 
+ // Tasks interrupted by one core's sampling timer
+ struct TickSlot {
+     TaskHandle_t task;
+     uint32_t ticks;
+ };
+ 
+ // Samples of one PC bucket
+ struct PcSlot {
+     uint32_t pc;
+     uint32_t count;
+ };
+ 
+ // Written by the sampling interrupts, each core only touches its own row
+ static TickSlot tickSlots[portNUM_PROCESSORS][TDECK_PROFILER_MAX_TASKS];
+ static uint32_t tickTotal[portNUM_PROCESSORS];
+ static PcSlot pcSlots[portNUM_PROCESSORS][TDECK_PROFILER_PC_SLOTS];
+ static uint32_t pcTotal[portNUM_PROCESSORS];
+ static uint32_t pcDropped[portNUM_PROCESSORS];
+ static volatile bool perfEnabled = false;
+ static portMUX_TYPE sampleLocks[portNUM_PROCESSORS] = {portMUX_INITIALIZER_UNLOCKED, portMUX_INITIALIZER_UNLOCKED};
+ 
+ // Request handed to a core's timer setup task
+ struct TimerSetup {
+     uint8_t core;
+     uint32_t hz;                    // 0 to tear the timer down
+     TaskHandle_t caller;
+     bool ok;
+ };
+ 
+ // Constructor
+ TaskProfiler::TaskProfiler()
+     : _taskCount(0)
+     , _intervalMs(0)
+     , _lock(NULL)
+     , _previousCount(0)
+     , _previousTime(0)
+     , _watchUntil(0)
+     , _sampleHz(0)
+     , _perf(false)
+ {
+     memset(_coreLoad, 0, sizeof(_coreLoad));
+ }
+ 
+ // Take the first snapshot
+ bool TaskProfiler::begin() {
+     if (!_lock) {
+         _lock = xSemaphoreCreateMutex();
+     }
+     if (!_lock) {
+         TDECK_LOG_E("Failed to create profiler lock");
+         return false;
+     }
+ 
+     sample();
+     TDECK_LOG_I("Task profiler: CPU time from %s", hasRunTimeCounters() ? "run time counters" : "sampling");
+     return true;
+ }
+ 
+ // Take a snapshot of every task
+ uint32_t TaskProfiler::sample() {
+     static TaskStatus_t status[TDECK_PROFILER_MAX_TASKS];
+     if (!_lock) {
+         return UINT32_MAX;
+     }
+ 
+     UBaseType_t count = uxTaskGetSystemState(status, TDECK_PROFILER_MAX_TASKS, NULL);
+     if (count == 0) {
+         TDECK_LOG_W("More than %d tasks, raise TDECK_PROFILER_MAX_TASKS", TDECK_PROFILER_MAX_TASKS);
+         return UINT32_MAX;
+     }
+     uint64_t now = esp_timer_get_time();
+ 
+     xSemaphoreTake(_lock, portMAX_DELAY);
+ 
+     // CPU figures cover the time since the previous snapshot
+     uint64_t busy[TDECK_PROFILER_MAX_TASKS] = {};
+     uint64_t perCore = 0;               // Units of one core's time in the interval
+     uint32_t intervalMs = 0;
+     uint64_t idle[portNUM_PROCESSORS] = {};
+     uint64_t coreTotal[portNUM_PROCESSORS] = {};
+ 
+ #if configGENERATE_RUN_TIME_STATS
+     if (_previousTime) {
+         perCore = now - _previousTime;
+         intervalMs = perCore / 1000;
+     }
+     for (UBaseType_t i = 0; i < count; i++) {
+         uint32_t previous = 0;
+         for (size_t j = 0; j < _previousCount; j++) {
+             if (_previous[j].number == status[i].xTaskNumber) {
+                 previous = _previous[j].runTime;
+                 break;
+             }
+         }
+         // The counters are 32-bit microseconds, unsigned arithmetic covers a wrap
+         busy[i] = (uint32_t)(status[i].ulRunTimeCounter - previous);
+     }
+     _previousCount = count;
+     for (UBaseType_t i = 0; i < count; i++) {
+         _previous[i].number = status[i].xTaskNumber;
+         _previous[i].runTime = status[i].ulRunTimeCounter;
+     }
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         coreTotal[core] = perCore;
+     }
+ #else
+     // The interrupts count ticks, take this interval's and start the next. Shares
+     // of the ticks need no clock, so a window cut short by starting is still right
+     static TickSlot ticks[portNUM_PROCESSORS][TDECK_PROFILER_MAX_TASKS];
+     if (_sampleHz) {
+         for (int core = 0; core < portNUM_PROCESSORS; core++) {
+             portENTER_CRITICAL(&sampleLocks[core]);
+             memcpy(ticks[core], tickSlots[core], sizeof(ticks[core]));
+             coreTotal[core] = tickTotal[core];
+             memset(tickSlots[core], 0, sizeof(tickSlots[core]));
+             tickTotal[core] = 0;
+             portEXIT_CRITICAL(&sampleLocks[core]);
+             perCore += coreTotal[core];
+         }
+         perCore /= portNUM_PROCESSORS;
+         intervalMs = perCore * 1000 / _sampleHz;
+         for (UBaseType_t i = 0; i < count; i++) {
+             for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                 for (const TickSlot& slot : ticks[core]) {
+                     if (slot.task == status[i].xHandle) {
+                         busy[i] += slot.ticks;
+                         break;
+                     }
+                 }
+             }
+         }
+     }
+ #endif
+ 
+     _taskCount = 0;
+     for (UBaseType_t i = 0; i < count; i++) {
+         TaskCpuStats& task = _tasks[_taskCount++];
+         strlcpy(task.name, status[i].pcTaskName, sizeof(task.name));
+         task.cpuPermille = perCore ? (uint16_t)std::min<uint64_t>(busy[i] * 1000 / perCore, 1000) : 0;
+         task.priority = status[i].uxCurrentPriority;
+         // StackType_t is a byte on this port, so the mark is in bytes
+         task.stackFree = status[i].usStackHighWaterMark * sizeof(StackType_t);
+ #if configTASKLIST_INCLUDE_COREID
+         BaseType_t affinity = status[i].xCoreID;
+ #else
+         BaseType_t affinity = xTaskGetAffinity(status[i].xHandle);
+ #endif
+         task.core = affinity < portNUM_PROCESSORS ? affinity : PROFILER_ANY_CORE;
+ 
+         for (int core = 0; core < portNUM_PROCESSORS; core++) {
+             if (status[i].xHandle == xTaskGetIdleTaskHandleForCPU(core)) {
+                 idle[core] = busy[i];
+             }
+         }
+     }
+     std::sort(_tasks, _tasks + _taskCount, [](const TaskCpuStats& a, const TaskCpuStats& b) {
+         return a.cpuPermille != b.cpuPermille ? a.cpuPermille > b.cpuPermille : strcmp(a.name, b.name) < 0;
+     });
+ 
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         _coreLoad[core] = coreTotal[core] ? 100 - std::min<uint64_t>(idle[core] * 100 / coreTotal[core], 100) : 0;
+     }
+     _intervalMs = perCore ? intervalMs : 0;
+     _previousTime = now;
+ 
+     // Sampling only runs while the figures are looked at or perf records
+     if (_sampleHz && !_perf && (hasRunTimeCounters() || (int32_t)(millis() - _watchUntil) >= 0)) {
+         stopSampling();
+     }
+ 
+     xSemaphoreGive(_lock);
+     return UINT32_MAX;
+ }
+ 
+ // Keep CPU figures coming for a while
+ void TaskProfiler::watch() {
+     if (!_lock) {
+         return;
+     }
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     _watchUntil = millis() + TDECK_PROFILER_WATCH_MS;
+     if (!hasRunTimeCounters() && !_sampleHz) {
+         startSampling(TDECK_PROFILER_SAMPLE_HZ);
+     }
+     xSemaphoreGive(_lock);
+ }
+ 
+ // Check where CPU time comes from
+ bool TaskProfiler::hasRunTimeCounters() {
+     return configGENERATE_RUN_TIME_STATS;
+ }
+ 
+ // Get the latest snapshot
+ size_t TaskProfiler::getTasks(TaskCpuStats* tasks, size_t max) {
+     if (!_lock) {
+         return 0;
+     }
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     size_t count = std::min(max, _taskCount);
+     memcpy(tasks, _tasks, count * sizeof(TaskCpuStats));
+     xSemaphoreGive(_lock);
+     return count;
+ }
+ 
+ // Get how busy a core was
+ uint8_t TaskProfiler::getCoreLoad(uint8_t core) const {
+     return core < portNUM_PROCESSORS ? _coreLoad[core] : 0;
+ }
+ 
+ // Get the length of the last interval
+ uint32_t TaskProfiler::getIntervalMs() const {
+     return _intervalMs;
+ }
+ 
+ // Start recording program counters
+ bool TaskProfiler::startPerf(uint32_t hz) {
+     if (!_lock || hz == 0 || hz > TDECK_PROFILER_MAX_HZ) {
+         return false;
+     }
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         portENTER_CRITICAL(&sampleLocks[core]);
+         memset(pcSlots[core], 0, sizeof(pcSlots[core]));
+         pcTotal[core] = 0;
+         pcDropped[core] = 0;
+         portEXIT_CRITICAL(&sampleLocks[core]);
+     }
+ 
+     if (_sampleHz != hz) {
+         stopSampling();
+     }
+     bool ok = _sampleHz || startSampling(hz);
+     _perf = ok;
+     perfEnabled = ok;
+     xSemaphoreGive(_lock);
+     return ok;
+ }
+ 
+ // Stop recording program counters
+ void TaskProfiler::stopPerf() {
+     if (!_lock) {
+         return;
+     }
+     xSemaphoreTake(_lock, portMAX_DELAY);
+     perfEnabled = false;
+     _perf = false;
+     if (_sampleHz && (hasRunTimeCounters() || (int32_t)(millis() - _watchUntil) >= 0)) {
+         stopSampling();
+     }
+     xSemaphoreGive(_lock);
+ }
+ 
+ // Check whether program counters are being recorded
+ bool TaskProfiler::isPerfRunning() const {
+     return _perf;
+ }
+ 
+ // Get the most sampled buckets
+ size_t TaskProfiler::getHotspots(PerfHotspot* hotspots, size_t max, uint32_t& total, uint32_t& dropped) {
+     size_t count = 0;
+     total = 0;
+     dropped = 0;
+ 
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         // Insertion into a short sorted list, the table is scanned once per core
+         portENTER_CRITICAL(&sampleLocks[core]);
+         for (const PcSlot& slot : pcSlots[core]) {
+             if (slot.count == 0 || (count == max && slot.count <= hotspots[max - 1].count)) {
+                 continue;
+             }
+             size_t i = count < max ? count++ : max - 1;
+             while (i > 0 && hotspots[i - 1].count < slot.count) {
+                 hotspots[i] = hotspots[i - 1];
+                 i--;
+             }
+             hotspots[i] = {slot.pc, slot.count, (uint8_t)core};
+         }
+         total += pcTotal[core];
+         dropped += pcDropped[core];
+         portEXIT_CRITICAL(&sampleLocks[core]);
+     }
+     return count;
+ }
+ 
+ // Start the sampling interrupt on every core
+ bool TaskProfiler::startSampling(uint32_t hz) {
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         portENTER_CRITICAL(&sampleLocks[core]);
+         memset(tickSlots[core], 0, sizeof(tickSlots[core]));
+         tickTotal[core] = 0;
+         portEXIT_CRITICAL(&sampleLocks[core]);
+     }
+ 
+     // An interrupt is serviced by the core that allocated it
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         TimerSetup setup = {(uint8_t)core, hz, xTaskGetCurrentTaskHandle(), false};
+         if (xTaskCreatePinnedToCore(timerSetupTask, "prof_setup", 2048, &setup, configMAX_PRIORITIES - 1,
+                                     NULL, core) != pdPASS ||
+             !ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETUP_TIMEOUT_MS)) || !setup.ok) {
+             TDECK_LOG_E("Failed to start the sampling timer on core %d", core);
+             _sampleHz = hz;
+             stopSampling();
+             return false;
+         }
+     }
+     _sampleHz = hz;
+     return true;
+ }
+ 
+ // Stop the sampling interrupts
+ void TaskProfiler::stopSampling() {
+     for (int core = 0; core < portNUM_PROCESSORS && _sampleHz; core++) {
+         TimerSetup setup = {(uint8_t)core, 0, xTaskGetCurrentTaskHandle(), false};
+         if (xTaskCreatePinnedToCore(timerSetupTask, "prof_setup", 2048, &setup, configMAX_PRIORITIES - 1,
+                                     NULL, core) == pdPASS) {
+             ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETUP_TIMEOUT_MS));
+         }
+     }
+     _sampleHz = 0;
+ }
+ 
+ // Allocate or free the sampling timer of the core this runs on
+ void TaskProfiler::timerSetupTask(void* parameter) {
+     TimerSetup* setup = (TimerSetup*)parameter;
+     timer_group_t group = (timer_group_t)setup->core;
+ 
+     if (setup->hz == 0) {
+         // Tearing down a timer that never started only returns errors
+         timer_pause(group, SAMPLE_TIMER);
+         timer_isr_callback_remove(group, SAMPLE_TIMER);
+         timer_deinit(group, SAMPLE_TIMER);
+         setup->ok = true;
+     } else {
+         // XTAL keeps the rate steady while DFS moves the APB clock
+         timer_config_t config = {};
+         config.alarm_en = TIMER_ALARM_EN;
+         config.counter_en = TIMER_PAUSE;
+         config.intr_type = TIMER_INTR_LEVEL;
+         config.counter_dir = TIMER_COUNT_UP;
+         config.auto_reload = TIMER_AUTORELOAD_EN;
+ #if SOC_TIMER_GROUP_SUPPORT_XTAL
+         config.clk_src = TIMER_SRC_CLK_XTAL;
+         config.divider = 40;        // 1 MHz from the 40 MHz crystal
+ #else
+         config.divider = 80;        // 1 MHz from the 80 MHz APB clock
+ #endif
+         setup->ok = timer_init(group, SAMPLE_TIMER, &config) == ESP_OK &&
+                     timer_set_counter_value(group, SAMPLE_TIMER, 0) == ESP_OK &&
+                     timer_set_alarm_value(group, SAMPLE_TIMER, 1000000 / setup->hz) == ESP_OK &&
+                     timer_enable_intr(group, SAMPLE_TIMER) == ESP_OK &&
+                     timer_isr_callback_add(group, SAMPLE_TIMER, onSampleTimer, (void*)(uintptr_t)setup->core,
+                                            ESP_INTR_FLAG_IRAM) == ESP_OK &&
+                     timer_start(group, SAMPLE_TIMER) == ESP_OK;
+     }
+ 
+     xTaskNotifyGive(setup->caller);
+     vTaskDelete(NULL);
+ }
+ 
+ // Sampling interrupt, counts the interrupted task and program counter
+ bool IRAM_ATTR TaskProfiler::onSampleTimer(void* arg) {
+     uint32_t core = (uint32_t)(uintptr_t)arg;
+ 
+     // Level 1 interrupts do not nest, so EPC1 still holds the interrupted PC
+     uint32_t pc;
+     __asm__ __volatile__("rsr.epc1 %0" : "=a"(pc));
+     TaskHandle_t task = xTaskGetCurrentTaskHandleForCPU(core);
+ 
+     portENTER_CRITICAL_ISR(&sampleLocks[core]);
+     tickTotal[core]++;
+     uint32_t slot = ((uintptr_t)task >> 2) % TDECK_PROFILER_MAX_TASKS;
+     for (int i = 0; i < TDECK_PROFILER_MAX_TASKS; i++) {
+         TickSlot& tick = tickSlots[core][(slot + i) % TDECK_PROFILER_MAX_TASKS];
+         if (tick.task == task || tick.task == NULL) {
+             tick.task = task;
+             tick.ticks++;
+             break;
+         }
+     }
+ 
+     if (perfEnabled) {
+         uint32_t bucket = pc & ~(uint32_t)(TDECK_PROFILER_PC_GRANULE - 1);
+         uint32_t index = (bucket * 2654435761u) >> 8;
+         pcTotal[core]++;
+         bool stored = false;
+         for (int i = 0; i < PC_PROBES && !stored; i++) {
+             PcSlot& entry = pcSlots[core][(index + i) & (TDECK_PROFILER_PC_SLOTS - 1)];
+             if (entry.pc == bucket || entry.count == 0) {
+                 entry.pc = bucket;
+                 entry.count++;
+                 stored = true;
+             }
+         }
+         if (!stored) {
+             pcDropped[core]++;
+         }
+     }
+     portEXIT_CRITICAL_ISR(&sampleLocks[core]);
+     return false;
+ }
\ No newline at end of file
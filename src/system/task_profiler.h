@@ -0,0 +1,174 @@
+/**
+ * @file task_profiler.h
+ * @brief Per-task CPU usage and PC sampling profiler
+ *
+ * Every TDECK_SERVICE_PROFILER_MS the system task takes a snapshot of all
+ * FreeRTOS tasks: CPU share over the last interval, stack high-water mark,
+ * priority and core affinity. The top command and System Info read the
+ * latest snapshot.
+ *
+ * CPU time comes from the FreeRTOS run time counters, clocked by esp_timer
+ * in microseconds, when the framework is built with
+ * CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS. Otherwise a hardware timer
+ * interrupt on each core counts which task it interrupted, at
+ * TDECK_PROFILER_SAMPLE_HZ while someone is watching. The same interrupt
+ * records the interrupted program counter for the perf command, giving a
+ * coarse histogram of hot code that addr2line resolves to functions. Code
+ * running with interrupts masked is seen where it unmasks them.
+ */
+
+ #ifndef TDECK_TASK_PROFILER_H
+ #define TDECK_TASK_PROFILER_H
+ 
+ #include <Arduino.h>
+ #include "../config.h"
+ 
+ // Core value of a task that may run on either core
+ #define PROFILER_ANY_CORE 0xFF
+ 
+ // One task in a snapshot
+ struct TaskCpuStats {
+     char name[configMAX_TASK_NAME_LEN];
+     uint16_t cpuPermille;       // Per mille of one core over the last interval
+     uint8_t core;               // Core it is pinned to, PROFILER_ANY_CORE if not pinned
+     uint8_t priority;
+     uint32_t stackFree;         // Bytes of stack never used since the task started
+ };
+ 
+ // One program counter bucket of the perf histogram
+ struct PerfHotspot {
+     uint32_t pc;                // Start of a TDECK_PROFILER_PC_GRANULE byte bucket
+     uint32_t count;
+     uint8_t core;
+ };
+ 
+ /**
+  * @class TaskProfiler
+  * @brief Collects task CPU snapshots and PC samples
+  */
+ class TaskProfiler {
+ public:
+     /**
+      * @brief Constructor
+      */
+     TaskProfiler();
+ 
+     /**
+      * @brief Take the first snapshot
+      * @return true if task statistics are available
+      */
+     bool begin();
+ 
+     /**
+      * @brief Take a snapshot and stop sampling nobody is watching
+      * @return UINT32_MAX, for use as a scheduler service
+      */
+     uint32_t sample();
+ 
+     /**
+      * @brief Keep CPU figures coming for TDECK_PROFILER_WATCH_MS
+      *
+      * Without run time counters this starts the sampling interrupts, so the
+      * first figures appear one interval later.
+      */
+     void watch();
+ 
+     /**
+      * @brief Check whether CPU time comes from the run time counters
+      * @return true for counters, false for sampling
+      */
+     static bool hasRunTimeCounters();
+ 
+     /**
+      * @brief Get the latest snapshot, busiest task first
+      * @param tasks Receives up to max tasks
+      * @param max Capacity of tasks
+      * @return Tasks stored, 0 before the first complete interval
+      */
+     size_t getTasks(TaskCpuStats* tasks, size_t max);
+ 
+     /**
+      * @brief Get how busy a core was over the last interval
+      * @param core Core number
+      * @return Percent of the interval not spent in the idle task
+      */
+     uint8_t getCoreLoad(uint8_t core) const;
+ 
+     /**
+      * @brief Get the length of the last interval
+      * @return Milliseconds, 0 before the first complete interval
+      */
+     uint32_t getIntervalMs() const;
+ 
+     /**
+      * @brief Start recording program counters, clearing the histogram
+      * @param hz Samples per second and core
+      * @return true if the sampling interrupts are running
+      */
+     bool startPerf(uint32_t hz = TDECK_PROFILER_SAMPLE_HZ);
+ 
+     /**
+      * @brief Stop recording program counters, the histogram is kept
+      */
+     void stopPerf();
+ 
+     /**
+      * @brief Check whether program counters are being recorded
+      */
+     bool isPerfRunning() const;
+ 
+     /**
+      * @brief Get the most sampled buckets
+      * @param hotspots Receives up to max buckets, most samples first
+      * @param max Capacity of hotspots
+      * @param total Receives the samples taken, including dropped ones
+      * @param dropped Receives the samples that found the histogram full
+      * @return Buckets stored
+      */
+     size_t getHotspots(PerfHotspot* hotspots, size_t max, uint32_t& total, uint32_t& dropped);
+ 
+ private:
+     // Run time of a task in the previous snapshot
+     struct TaskRunTime {
+         uint32_t number;
+         uint32_t runTime;
+     };
+ 
+     TaskCpuStats _tasks[TDECK_PROFILER_MAX_TASKS];
+     size_t _taskCount;
+     uint8_t _coreLoad[portNUM_PROCESSORS];
+     uint32_t _intervalMs;
+     SemaphoreHandle_t _lock;            // Guards the published snapshot
+ 
+     TaskRunTime _previous[TDECK_PROFILER_MAX_TASKS];
+     size_t _previousCount;
+     uint64_t _previousTime;             // esp_timer time of the previous snapshot
+     uint32_t _watchUntil;               // millis() until which figures are wanted
+     uint32_t _sampleHz;                 // Rate of the running interrupts, 0 when stopped
+     bool _perf;
+ 
+     /**
+      * @brief Start the sampling interrupt on every core
+      */
+     bool startSampling(uint32_t hz);
+ 
+     /**
+      * @brief Stop the sampling interrupts
+      */
+     void stopSampling();
+ 
+     /**
+      * @brief Allocates the sampling timer of the core it runs on
+      */
+     static void timerSetupTask(void* parameter);
+ 
+     /**
+      * @brief Sampling interrupt, counts the interrupted task and PC
+      */
+     static bool IRAM_ATTR onSampleTimer(void* arg);
+ };
+ 
+ // Global instance
+ extern TaskProfiler taskProfiler;
+ 
+ #endif // TDECK_TASK_PROFILER_H
\ No newline at end of file
@@ -0,0 +1,368 @@
+/**
+ * @file trace.cpp
+ * @brief Implementation of the deferred trace log
+ */
+
+ #include "trace.h"
+ #include "fs_manager.h"
+
+ // Record header: committed, padding, level, module, length in words
+ #define TRACE_HDR_COMMIT 0x80000000u
+ #define TRACE_HDR_PAD 0x40000000u
+ #define TRACE_HDR_LEVEL_SHIFT 24
+ #define TRACE_HDR_MODULE_SHIFT 16
+ #define TRACE_HDR_WORDS_MASK 0xFFFFu
+
+ // Longest formatted line, longer ones are cut
+ #define TRACE_LINE_SIZE 256
+
+ // Largest record, a record of many long strings is dropped rather than split
+ #define TRACE_MAX_RECORD_WORDS 128
+
+ static const char* const MODULE_NAMES[TRACE_MODULE_COUNT] = {"sys", "lora", "ble", "usb", "fs"};
+ static const char* const LEVEL_NAMES[] = {"", "ERROR", "WARN", "INFO", "DEBUG"};
+
+ // Global instance, constructed before anything can trace
+ TraceLog traceLog;
+
+ // Constructor
+ TraceLog::TraceLog()
+     : _sinks(TDECK_DEBUG ? TRACE_SINK_SERIAL : 0)
+     , _task(NULL)
+     , _drainMutex(NULL)
+ {
+     for (Ring& ring : _rings) {
+         memset(ring.words, 0, sizeof(ring.words));
+         ring.head.store(0);
+         ring.tail.store(0);
+         ring.recorded.store(0);
+         ring.dropped.store(0);
+         ring.reportedDrops = 0;
+     }
+ }
+
+ // Start the drain task, records made before this are drained on its first pass
+ bool TraceLog::begin() {
+     if (_task) {
+         return true;
+     }
+
+     _drainMutex = xSemaphoreCreateMutex();
+     if (!_drainMutex ||
+         xTaskCreatePinnedToCore(drainTask, "Trace", TDECK_TRACE_TASK_STACK_SIZE, this,
+                                 TDECK_TRACE_TASK_PRIORITY, &_task, tskNO_AFFINITY) != pdPASS) {
+         TDECK_LOG_E("Failed to start trace drain task");
+         _task = NULL;
+         return false;
+     }
+     return true;
+ }
+
+ // Claim space with a compare-and-swap on the head, other writers on this core may interleave
+ uint32_t* TraceLog::reserve(uint32_t words) {
+     Ring& ring = _rings[xPortGetCoreID()];
+     if (words > TRACE_MAX_RECORD_WORDS) {
+         ring.dropped.fetch_add(1, std::memory_order_relaxed);
+         return nullptr;
+     }
+
+     uint32_t head = ring.head.load(std::memory_order_relaxed);
+     uint32_t pos;
+     uint32_t need;
+     uint32_t used;
+     do {
+         // A record never wraps, the rest of the ring becomes padding instead
+         pos = head % TRACE_RING_WORDS;
+         uint32_t toEnd = TRACE_RING_WORDS - pos;
+         need = words <= toEnd ? words : toEnd + words;
+         used = head - ring.tail.load(std::memory_order_acquire);
+         if (used + need > TRACE_RING_WORDS) {
+             ring.dropped.fetch_add(1, std::memory_order_relaxed);
+             return nullptr;
+         }
+     } while (!ring.head.compare_exchange_weak(head, head + need, std::memory_order_acq_rel,
+                                               std::memory_order_relaxed));
+
+     ring.recorded.fetch_add(1, std::memory_order_relaxed);
+
+     // Wake the drain task early once the ring is half full
+     if (used < TRACE_RING_WORDS / 2 && used + need >= TRACE_RING_WORDS / 2 && _task) {
+         if (xPortInIsrContext()) {
+             vTaskNotifyGiveFromISR(_task, NULL);
+         } else {
+             xTaskNotifyGive(_task);
+         }
+     }
+
+     if (need != words) {
+         __atomic_store_n(&ring.words[pos], TRACE_HDR_COMMIT | TRACE_HDR_PAD | (need - words), __ATOMIC_RELEASE);
+         return ring.words;
+     }
+     return &ring.words[pos];
+ }
+
+ // Writing the header last publishes the record to the drain task
+ void TraceLog::commit(uint32_t* slot, TraceModule module, uint8_t level, uint32_t words) {
+     __atomic_store_n(slot, TRACE_HDR_COMMIT | ((uint32_t)level << TRACE_HDR_LEVEL_SHIFT) |
+                            ((uint32_t)module << TRACE_HDR_MODULE_SHIFT) | words, __ATOMIC_RELEASE);
+ }
+
+ // Drain every ring in order of arrival per core
+ size_t TraceLog::drain() {
+     if (_drainMutex) {
+         xSemaphoreTake(_drainMutex, portMAX_DELAY);
+     }
+
+     static uint32_t record[TRACE_MAX_RECORD_WORDS];
+     static char line[TRACE_LINE_SIZE];
+     uint8_t sinks = _sinks;
+     bool sd = (sinks & TRACE_SINK_SD) && FSManager::is_sd_available() && !FSManager::is_sd_lent();
+     FSStream file;
+     size_t drained = 0;
+
+     for (int core = 0; core < portNUM_PROCESSORS; core++) {
+         Ring& ring = _rings[core];
+         uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+         uint32_t head = ring.head.load(std::memory_order_acquire);
+
+         while (tail != head) {
+             uint32_t pos = tail % TRACE_RING_WORDS;
+             uint32_t header = __atomic_load_n(&ring.words[pos], __ATOMIC_ACQUIRE);
+
+             // The writer has reserved but not finished, the rest waits for the next pass
+             if (!(header & TRACE_HDR_COMMIT)) {
+                 break;
+             }
+
+             uint32_t words = header & TRACE_HDR_WORDS_MASK;
+             bool pad = header & TRACE_HDR_PAD;
+             if (!pad) {
+                 memcpy(record, &ring.words[pos], words * sizeof(uint32_t));
+             }
+
+             // Zero the whole record so a later header never lands on stale words
+             memset(&ring.words[pos], 0, words * sizeof(uint32_t));
+             tail += words;
+             ring.tail.store(tail, std::memory_order_release);
+
+             if (pad) {
+                 continue;
+             }
+
+             size_t length = formatRecord(record, words, line, sizeof(line));
+             if (sinks & TRACE_SINK_SERIAL) {
+                 TDECK_DEBUG_SERIAL.write((const uint8_t*)line, length);
+             }
+             if (sd) {
+                 if (!file.is_open() && !file.open(TDECK_TRACE_LOG_FILE, FILE_APPEND)) {
+                     sd = false;
+                 } else {
+                     file.write((const uint8_t*)line, length);
+                 }
+             }
+             drained++;
+         }
+
+         // Report drops as a record of their own
+         uint32_t dropped = ring.dropped.load(std::memory_order_relaxed);
+         if (dropped != ring.reportedDrops) {
+             int length = snprintf(line, sizeof(line), "[WARN] [trace] %lu records dropped on core %d\n",
+                                   (unsigned long)(dropped - ring.reportedDrops), core);
+             ring.reportedDrops = dropped;
+             if (sinks & TRACE_SINK_SERIAL) {
+                 TDECK_DEBUG_SERIAL.write((const uint8_t*)line, length);
+             }
+             if (sd && file.is_open()) {
+                 file.write((const uint8_t*)line, length);
+             }
+         }
+     }
+
+     // The stream is closed between passes so the card can still be lent to USB
+     if (file.is_open()) {
+         bool full = file.size() >= TDECK_TRACE_LOG_MAX_SIZE;
+         file.close();
+         if (full) {
+             rotateLog();
+         }
+     }
+
+     if (_drainMutex) {
+         xSemaphoreGive(_drainMutex);
+     }
+     return drained;
+ }
+
+ // Timestamp, level, module and message
+ size_t TraceLog::formatRecord(const uint32_t* record, uint32_t words, char* line, size_t capacity) {
+     uint32_t header = record[0];
+     uint8_t level = (header >> TRACE_HDR_LEVEL_SHIFT) & 0x0F;
+     uint8_t module = (header >> TRACE_HDR_MODULE_SHIFT) & 0xFF;
+
+     // Records are drained well within the 71 minutes the low 32 bits cover
+     int64_t now = esp_timer_get_time();
+     int64_t timestamp = now - (uint32_t)((uint32_t)now - record[1]);
+
+     int length = snprintf(line, capacity, "[%6lu.%06lu] [%s] [%s] ", (unsigned long)(timestamp / 1000000),
+                           (unsigned long)(timestamp % 1000000), level < 5 ? LEVEL_NAMES[level] : "?",
+                           getModuleName((TraceModule)module));
+     size_t used = min((size_t)max(length, 0), capacity - 2);
+     used += formatMessage((const char*)(uintptr_t)record[2], record + TRACE_RECORD_FIXED_WORDS,
+                           words - TRACE_RECORD_FIXED_WORDS, line + used, capacity - used - 1);
+     line[used++] = '\n';
+     line[used] = 0;
+     return used;
+ }
+
+ // printf over packed arguments, one conversion at a time
+ size_t TraceLog::formatMessage(const char* format, const uint32_t* args, uint32_t count, char* out, size_t capacity) {
+     size_t used = 0;
+     uint32_t next = 0;
+     const char* p = format;
+
+     while (*p && used + 1 < capacity) {
+         if (*p != '%') {
+             out[used++] = *p++;
+             continue;
+         }
+         if (p[1] == '%') {
+             out[used++] = '%';
+             p += 2;
+             continue;
+         }
+
+         // Copy the conversion, a '*' width or precision takes its value from the arguments
+         char spec[24];
+         size_t s = 0;
+         bool isLong = false;
+         bool isLongLong = false;
+         spec[s++] = *p++;
+         while (*p && strchr("-+ #0123456789.*hlzjt", *p) && s < sizeof(spec) - 12) {
+             if (*p == '*') {
+                 int value = next < count ? (int)args[next++] : 0;
+                 s += snprintf(spec + s, sizeof(spec) - s, "%d", value);
+                 p++;
+                 continue;
+             }
+             if (*p == 'l') {
+                 isLongLong = isLong;
+                 isLong = true;
+             } else if (*p == 'j') {
+                 isLongLong = true;
+             }
+             spec[s++] = *p++;
+         }
+         if (!*p) {
+             break;
+         }
+         char conversion = *p++;
+         spec[s++] = conversion;
+         spec[s] = 0;
+
+         char* dst = out + used;
+         size_t room = capacity - used;
+         int n = 0;
+         switch (conversion) {
+             case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                 if (isLongLong) {
+                     uint64_t value = next + 1 < count ? (args[next] | ((uint64_t)args[next + 1] << 32)) : 0;
+                     next += 2;
+                     n = snprintf(dst, room, spec, (unsigned long long)value);
+                 } else if (isLong) {
+                     n = snprintf(dst, room, spec, (unsigned long)(next < count ? args[next] : 0));
+                     next++;
+                 } else {
+                     n = snprintf(dst, room, spec, (unsigned)(next < count ? args[next] : 0));
+                     next++;
+                 }
+                 break;
+
+             case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                 double value = 0;
+                 if (next + 1 < count) {
+                     memcpy(&value, &args[next], sizeof(value));
+                 }
+                 next += 2;
+                 n = snprintf(dst, room, spec, value);
+                 break;
+             }
+
+             case 's': {
+                 const char* value = "<?>";
+                 if (next < count) {
+                     uint32_t words = 1 + (args[next] + 4) / 4;
+                     if (next + words <= count) {
+                         value = (const char*)&args[next + 1];
+                     }
+                     next += words;
+                 }
+                 n = snprintf(dst, room, spec, value);
+                 break;
+             }
+
+             case 'p':
+                 n = snprintf(dst, room, spec, (void*)(uintptr_t)(next < count ? args[next] : 0));
+                 next++;
+                 break;
+
+             default:
+                 n = snprintf(dst, room, "%s", spec);
+                 break;
+         }
+         used += min((size_t)max(n, 0), room - 1);
+     }
+
+     out[used] = 0;
+     return used;
+ }
+
+ // trace.log becomes trace.1.log, older logs move up one and the oldest is deleted
+ void TraceLog::rotateLog() {
+     String base = TDECK_TRACE_LOG_FILE;
+     int dot = base.lastIndexOf('.');
+     String stem = dot > 0 ? base.substring(0, dot) : base;
+     String ext = dot > 0 ? base.substring(dot) : "";
+
+     FSManager::remove_file((stem + "." + TDECK_TRACE_LOG_FILES + ext).c_str());
+     for (int i = TDECK_TRACE_LOG_FILES - 1; i >= 1; i--) {
+         String from = stem + "." + i + ext;
+         if (FSManager::file_exists(from.c_str())) {
+             FSManager::rename_file(from.c_str(), (stem + "." + (i + 1) + ext).c_str());
+         }
+     }
+     FSManager::rename_file(TDECK_TRACE_LOG_FILE, (stem + ".1" + ext).c_str());
+ }
+
+ void TraceLog::setSinks(uint8_t sinks) {
+     if ((sinks & TRACE_SINK_SD) && !(_sinks & TRACE_SINK_SD)) {
+         String dir = TDECK_TRACE_LOG_FILE;
+         FSManager::create_directory(dir.substring(0, dir.lastIndexOf('/')).c_str());
+     }
+     _sinks = sinks;
+ }
+
+ uint8_t TraceLog::getSinks() const {
+     return _sinks;
+ }
+
+ void TraceLog::getStats(int core, TraceRingStats& stats) const {
+     const Ring& ring = _rings[core];
+     stats.recorded = ring.recorded.load(std::memory_order_relaxed);
+     stats.dropped = ring.dropped.load(std::memory_order_relaxed);
+     stats.used = (ring.head.load(std::memory_order_relaxed) - ring.tail.load(std::memory_order_relaxed)) *
+                  sizeof(uint32_t);
+ }
+
+ const char* TraceLog::getModuleName(TraceModule module) {
+     return module < TRACE_MODULE_COUNT ? MODULE_NAMES[module] : "?";
+ }
+
+ // Sleep until records arrive or the period ends, shorter while they keep coming
+ void TraceLog::drainTask(void* arg) {
+     TraceLog* self = (TraceLog*)arg;
+
+     while (1) {
+         size_t drained = self->drain();
+         ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(drained ? TDECK_TRACE_DRAIN_MS : TDECK_TRACE_IDLE_MS));
+     }
+ }
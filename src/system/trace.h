@@ -0,0 +1,297 @@
+/**
+ * @file trace.h
+ * @brief Deferred binary trace logging for hot paths
+ *
+ * TDECK_TRACE_I/W/E(module, fmt, ...) cost a few hundred cycles instead of
+ * the milliseconds a synchronous Serial.printf spends formatting and waiting
+ * for the UART. A call site stores the address of its format string, which
+ * lives in flash and doubles as its ID, a timestamp and the raw arguments in
+ * a ring buffer of the core it runs on. Strings are copied, truncated to
+ * TDECK_TRACE_MAX_STRING bytes, so callers may pass temporaries.
+ *
+ * Rings are lock-free: writers reserve space with a compare-and-swap and
+ * publish a record by writing its header last, so tasks and interrupts on
+ * the same core can interleave. A full ring drops the record and counts it.
+ * A low-priority drain task formats the records and writes them to serial
+ * and, when enabled, to a rotating log on the SD card.
+ *
+ * Each module has a compile-time level, TDECK_TRACE_LEVEL_<module> in
+ * config.h. Calls above it compile to nothing, and their format strings are
+ * still checked against the arguments.
+ */
+
+ #ifndef TDECK_TRACE_H
+ #define TDECK_TRACE_H
+
+ #include <Arduino.h>
+ #include <esp_timer.h>
+ #include <atomic>
+ #include <type_traits>
+ #include "../config.h"
+
+ // Trace levels, a call is kept if its level is at most the module's level
+ #define TRACE_LEVEL_OFF 0
+ #define TRACE_LEVEL_ERROR 1
+ #define TRACE_LEVEL_WARN 2
+ #define TRACE_LEVEL_INFO 3
+ #define TRACE_LEVEL_DEBUG 4
+
+ // Output sinks
+ #define TRACE_SINK_SERIAL 0x01     // TDECK_DEBUG_SERIAL
+ #define TRACE_SINK_SD 0x02         // TDECK_TRACE_LOG_FILE, rotated at TDECK_TRACE_LOG_MAX_SIZE
+
+ // Modules, each with its own TDECK_TRACE_LEVEL_<name>
+ enum TraceModule {
+     TRACE_MODULE_SYSTEM = 0,
+     TRACE_MODULE_LORA,
+     TRACE_MODULE_BLE,
+     TRACE_MODULE_USB,
+     TRACE_MODULE_FS,
+     TRACE_MODULE_COUNT
+ };
+
+ // Record words: header, timestamp, format string
+ #define TRACE_RECORD_FIXED_WORDS 3
+
+ // Ring size in 32-bit words
+ #define TRACE_RING_WORDS (TDECK_TRACE_RING_SIZE / 4)
+
+ // The ring indexes with head % TRACE_RING_WORDS on free-running counters, which only stays
+ // continuous across the 32-bit wrap when the size divides 2^32
+ static_assert(TRACE_RING_WORDS > 0 && (TRACE_RING_WORDS & (TRACE_RING_WORDS - 1)) == 0,
+               "TDECK_TRACE_RING_SIZE must be a power of two");
+
+ // Counters of one core's ring
+ struct TraceRingStats {
+     uint32_t recorded;          // Records written since boot
+     uint32_t dropped;           // Records lost to a full ring
+     uint32_t used;              // Bytes waiting for the drain task
+ };
+
+ // Compile-time format check, never called
+ inline void traceCheckFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+ inline void traceCheckFormat(const char* format, ...) {}
+
+ /**
+  * @class TraceArgs
+  * @brief Packs call arguments into record words
+  *
+  * Integers up to 32 bits and pointers take one word, 64-bit integers and
+  * floating point two (floats widen to double as in printf), strings a
+  * length word followed by their NUL-terminated bytes.
+  */
+ class TraceArgs {
+ public:
+     static uint32_t words() { return 0; }
+
+     template <typename T, typename... Rest>
+     static uint32_t words(T value, Rest... rest) {
+         return argWords(value) + words(rest...);
+     }
+
+     static void write(uint32_t* out) {}
+
+     template <typename T, typename... Rest>
+     static void write(uint32_t* out, T value, Rest... rest) {
+         write(out + writeArg(out, value), rest...);
+     }
+
+ private:
+     template <typename T>
+     static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint32_t>::type
+     argWords(T value) {
+         return sizeof(T) > 4 ? 2 : 1;
+     }
+
+     template <typename T>
+     static typename std::enable_if<std::is_floating_point<T>::value, uint32_t>::type argWords(T value) {
+         return 2;
+     }
+
+     static uint32_t argWords(const void* value) {
+         return 1;
+     }
+
+     static uint32_t argWords(const char* value) {
+         return 1 + (stringLength(value) + 4) / 4;
+     }
+
+     template <typename T>
+     static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint32_t>::type
+     writeArg(uint32_t* out, T value) {
+         uint64_t bits = (uint64_t)(int64_t)value;
+         out[0] = (uint32_t)bits;
+         if (sizeof(T) > 4) {
+             out[1] = (uint32_t)(bits >> 32);
+             return 2;
+         }
+         return 1;
+     }
+
+     template <typename T>
+     static typename std::enable_if<std::is_floating_point<T>::value, uint32_t>::type
+     writeArg(uint32_t* out, T value) {
+         double widened = value;
+         memcpy(out, &widened, sizeof(widened));
+         return 2;
+     }
+
+     static uint32_t writeArg(uint32_t* out, const void* value) {
+         out[0] = (uint32_t)(uintptr_t)value;
+         return 1;
+     }
+
+     static uint32_t writeArg(uint32_t* out, const char* value) {
+         uint32_t length = stringLength(value);
+         out[0] = length;
+         memcpy(out + 1, value ? value : "(null)", length);
+         ((char*)(out + 1))[length] = 0;
+         return 1 + (length + 4) / 4;
+     }
+
+     static uint32_t stringLength(const char* value) {
+         return value ? strnlen(value, TDECK_TRACE_MAX_STRING) : 6;
+     }
+ };
+
+ /**
+  * @class TraceLog
+  * @brief Per-core trace rings and the task that drains them
+  */
+ class TraceLog {
+ public:
+     /**
+      * @brief Constructor, tracing works from here on and is drained once begin() has run
+      */
+     TraceLog();
+
+     /**
+      * @brief Start the drain task
+      * @return true if the task is running
+      */
+     bool begin();
+
+     /**
+      * @brief Append a record to the current core's ring, use the TDECK_TRACE macros instead
+      * @param module Module of the call site
+      * @param level Level of the call site
+      * @param format printf format string literal, stored by address
+      * @param args Arguments matching the format
+      */
+     template <typename... Args>
+     void record(TraceModule module, uint8_t level, const char* format, Args... args) {
+         uint32_t words = TRACE_RECORD_FIXED_WORDS + TraceArgs::words(args...);
+         uint32_t* slot = reserve(words);
+         if (!slot) {
+             return;
+         }
+         slot[1] = (uint32_t)esp_timer_get_time();
+         slot[2] = (uint32_t)(uintptr_t)format;
+         TraceArgs::write(slot + TRACE_RECORD_FIXED_WORDS, args...);
+         commit(slot, module, level, words);
+     }
+
+     /**
+      * @brief Format and write every committed record now
+      *
+      * Runs on the drain task, call it directly before a restart so nothing is lost.
+      *
+      * @return Records written
+      */
+     size_t drain();
+
+     /**
+      * @brief Choose where formatted records go
+      * @param sinks TRACE_SINK_* flags
+      */
+     void setSinks(uint8_t sinks);
+
+     /**
+      * @brief Get the enabled sinks
+      * @return TRACE_SINK_* flags
+      */
+     uint8_t getSinks() const;
+
+     /**
+      * @brief Get the counters of one core's ring
+      * @param core Core number
+      * @param stats Receives the counters
+      */
+     void getStats(int core, TraceRingStats& stats) const;
+
+     /**
+      * @brief Get the name of a module as it appears in the log
+      * @param module Module
+      * @return Short lower-case name
+      */
+     static const char* getModuleName(TraceModule module);
+
+ private:
+     // One core's ring, head and tail count words since boot
+     struct Ring {
+         uint32_t words[TRACE_RING_WORDS];
+         std::atomic<uint32_t> head;
+         std::atomic<uint32_t> tail;
+         std::atomic<uint32_t> recorded;
+         std::atomic<uint32_t> dropped;
+         uint32_t reportedDrops;     // Drops already reported by the drain task
+     };
+
+     Ring _rings[portNUM_PROCESSORS];
+     volatile uint8_t _sinks;        // TRACE_SINK_* flags
+     TaskHandle_t _task;             // Drain task, NULL before begin()
+     SemaphoreHandle_t _drainMutex;  // Serializes drain() between the task and direct callers
+
+     /**
+      * @brief Reserve words in the current core's ring, padding over its end if needed
+      * @return First word of the record, nullptr if the ring is full
+      */
+     uint32_t* reserve(uint32_t words);
+
+     /**
+      * @brief Publish a record by writing its header
+      */
+     void commit(uint32_t* slot, TraceModule module, uint8_t level, uint32_t words);
+
+     /**
+      * @brief Format one record into a line
+      * @return Line length
+      */
+     static size_t formatRecord(const uint32_t* record, uint32_t words, char* line, size_t capacity);
+
+     /**
+      * @brief Expand a format string with the packed arguments of a record
+      * @return Characters written
+      */
+     static size_t formatMessage(const char* format, const uint32_t* args, uint32_t count, char* out, size_t capacity);
+
+     /**
+      * @brief Rotate the SD log once it has reached TDECK_TRACE_LOG_MAX_SIZE
+      */
+     static void rotateLog();
+
+     /**
+      * @brief Drain task entry point
+      */
+     static void drainTask(void* arg);
+ };
+
+ // Global instance
+ extern TraceLog traceLog;
+
+ #define TDECK_TRACE(module, level, fmt, ...) \
+     do { \
+         if (0) { \
+             traceCheckFormat(fmt, ##__VA_ARGS__); \
+         } \
+         if ((level) <= TDECK_TRACE_LEVEL_##module) { \
+             traceLog.record(TRACE_MODULE_##module, (level), "" fmt, ##__VA_ARGS__); \
+         } \
+     } while (0)
+
+ #define TDECK_TRACE_E(module, fmt, ...) TDECK_TRACE(module, TRACE_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+ #define TDECK_TRACE_W(module, fmt, ...) TDECK_TRACE(module, TRACE_LEVEL_WARN, fmt, ##__VA_ARGS__)
+ #define TDECK_TRACE_I(module, fmt, ...) TDECK_TRACE(module, TRACE_LEVEL_INFO, fmt, ##__VA_ARGS__)
+ #define TDECK_TRACE_D(module, fmt, ...) TDECK_TRACE(module, TRACE_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+ #endif // TDECK_TRACE_H
@@ -0,0 +1,197 @@
+/**
+ * @file frame_stats.cpp
+ * @brief Implementation of frame timing instrumentation for T-Deck UI
+ */
+
+ #include "frame_stats.h"
+ #include <algorithm>
+ 
+ // Global frame stats instance
+ FrameStats frameStats;
+ 
+ // Overlay refresh interval in milliseconds
+ #define FRAME_STATS_OVERLAY_INTERVAL 500
+ 
+ FrameStats::FrameStats() :
+     _head(0),
+     _count(0),
+     _frameCount(0),
+     _renderStart(0),
+     _renderTime(0),
+     _flushCallTime(0),
+     _flushCallStart(0),
+     _flushStart(0),
+     _flushEnd(0),
+     _flushedPixels(0),
+     _invalidPixels(0),
+     _pendingTransfers(0),
+     _awaitingTransfer(false),
+     _overlay(NULL),
+     _overlayTimer(NULL)
+ {
+     memset(_samples, 0, sizeof(_samples));
+ }
+ 
+ void FrameStats::beginRender() {
+     _renderStart = micros();
+     _flushCallTime = 0;
+ }
+ 
+ void FrameStats::endRender() {
+     // Time spent inside flush_cb is reported as flush time, not render time
+     uint32_t elapsed = micros() - _renderStart;
+     _renderTime += (elapsed > _flushCallTime) ? elapsed - _flushCallTime : 0;
+ 
+     // Idle pass, nothing was drawn
+     if (_flushedPixels == 0 && _invalidPixels == 0) {
+         _renderTime = 0;
+         return;
+     }
+ 
+     // Close the frame once the last DMA transfer has landed
+     if (_pendingTransfers > 0) {
+         _awaitingTransfer = true;
+         return;
+     }
+ 
+     _commitFrame();
+ }
+ 
+ void FrameStats::beginFlush(uint32_t pixels) {
+     uint32_t now = micros();
+ 
+     if (_flushedPixels == 0) {
+         _flushStart = now;
+     }
+ 
+     _flushCallStart = now;
+     _flushedPixels += pixels;
+     _pendingTransfers++;
+ }
+ 
+ void FrameStats::endFlushCall() {
+     _flushCallTime += micros() - _flushCallStart;
+ }
+ 
+ void FrameStats::endFlushTransfer() {
+     if (_pendingTransfers == 0) {
+         return;
+     }
+ 
+     _flushEnd = micros();
+     _pendingTransfers--;
+ 
+     if (_pendingTransfers == 0 && _awaitingTransfer) {
+         _commitFrame();
+     }
+ }
+ 
+ void FrameStats::_commitFrame() {
+     _samples[FRAME_METRIC_RENDER][_head] = _renderTime;
+     _samples[FRAME_METRIC_FLUSH][_head] = _flushedPixels > 0 ? _flushEnd - _flushStart : 0;
+     _samples[FRAME_METRIC_FLUSHED_PX][_head] = _flushedPixels;
+     _samples[FRAME_METRIC_INVALID_PX][_head] = _invalidPixels;
+ 
+     _head = (_head + 1) % TDECK_FRAME_STATS_WINDOW;
+     if (_count < TDECK_FRAME_STATS_WINDOW) {
+         _count++;
+     }
+     _frameCount++;
+ 
+     // Reset accumulators for the next frame
+     _renderTime = 0;
+     _flushedPixels = 0;
+     _invalidPixels = 0;
+     _awaitingTransfer = false;
+ }
+ 
+ FrameStatSummary FrameStats::getSummary(FrameMetric metric) const {
+     FrameStatSummary summary = {0, 0, 0, 0};
+ 
+     if (_count == 0 || metric >= FRAME_METRIC_COUNT) {
+         return summary;
+     }
+ 
+     // Copy the window so it can be sorted for the percentile
+     uint32_t sorted[TDECK_FRAME_STATS_WINDOW];
+     uint64_t total = 0;
+     for (uint16_t i = 0; i < _count; i++) {
+         sorted[i] = _samples[metric][i];
+         total += sorted[i];
+     }
+     std::sort(sorted, sorted + _count);
+ 
+     uint16_t lastIndex = (_head + TDECK_FRAME_STATS_WINDOW - 1) % TDECK_FRAME_STATS_WINDOW;
+     uint16_t p99Index = (_count * 99 + 99) / 100 - 1;
+ 
+     summary.last = _samples[metric][lastIndex];
+     summary.min = sorted[0];
+     summary.avg = total / _count;
+     summary.p99 = sorted[p99Index];
+ 
+     return summary;
+ }
+ 
+ uint32_t FrameStats::getFrameCount() const {
+     return _frameCount;
+ }
+ 
+ void FrameStats::setOverlayVisible(bool visible) {
+     if (visible == isOverlayVisible()) {
+         return;
+     }
+ 
+     if (visible) {
+         // Overlay lives on the top layer so it stays above every app
+         _overlay = lv_label_create(lv_layer_top(), NULL);
+         lv_obj_set_style_local_bg_opa(_overlay, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_70);
+         lv_obj_set_style_local_bg_color(_overlay, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_BLACK);
+         lv_obj_set_style_local_text_color(_overlay, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_LIME);
+         lv_obj_set_style_local_pad_all(_overlay, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, 2);
+         lv_obj_set_pos(_overlay, 0, TDECK_STATUS_BAR_HEIGHT);
+ 
+         _updateOverlay();
+         _overlayTimer = lv_timer_create(_overlayTimerCallback, FRAME_STATS_OVERLAY_INTERVAL, this);
+     } else {
+         lv_timer_del(_overlayTimer);
+         _overlayTimer = NULL;
+         lv_obj_del(_overlay);
+         _overlay = NULL;
+     }
+ }
+ 
+ void FrameStats::toggleOverlay() {
+     setOverlayVisible(!isOverlayVisible());
+ }
+ 
+ bool FrameStats::isOverlayVisible() const {
+     return _overlay != NULL;
+ }
+ 
+ void FrameStats::_updateOverlay() {
+     if (!_overlay) {
+         return;
+     }
+ 
+     FrameStatSummary render = getSummary(FRAME_METRIC_RENDER);
+     FrameStatSummary flush = getSummary(FRAME_METRIC_FLUSH);
+     FrameStatSummary area = getSummary(FRAME_METRIC_FLUSHED_PX);
+ 
+     char text[128];
+     snprintf(text, sizeof(text),
+              "rnd %.1f/%.1f/%.1f ms\nfl  %.1f/%.1f/%.1f ms\npx  %lu avg",
+              render.min / 1000.0f, render.avg / 1000.0f, render.p99 / 1000.0f,
+              flush.min / 1000.0f, flush.avg / 1000.0f, flush.p99 / 1000.0f,
+              (unsigned long)area.avg);
+     lv_label_set_text(_overlay, text);
+ }
+ 
+ void FrameStats::_overlayTimerCallback(lv_timer_t* timer) {
+     FrameStats* self = (FrameStats*)timer->user_data;
+     self->_updateOverlay();
+ }
+ 
+ // Static LVGL monitor callback - px is the area redrawn during the refresh
+ void FrameStats::monitor_cb(lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px) {
+     frameStats._invalidPixels += px;
+ }
\ No newline at end of file
@@ -0,0 +1,164 @@
+/**
+ * @file frame_stats.h
+ * @brief Frame timing instrumentation for T-Deck UI
+ *
+ * This file defines the frame statistics collector which measures how long
+ * LVGL spends rendering and flushing each frame, keeps rolling statistics
+ * over a window of recent frames and can show them in an on-screen overlay.
+ */
+
+ #ifndef TDECK_FRAME_STATS_H
+ #define TDECK_FRAME_STATS_H
+ 
+ #include <Arduino.h>
+ #include <lvgl.h>
+ #include "../config.h"
+ 
+ /**
+  * @brief Metrics recorded for every frame
+  */
+ typedef enum {
+     FRAME_METRIC_RENDER,      // Time spent in lv_task_handler excluding flush (us)
+     FRAME_METRIC_FLUSH,       // Time from first flush start to last flush completion (us)
+     FRAME_METRIC_FLUSHED_PX,  // Pixels sent to the panel
+     FRAME_METRIC_INVALID_PX,  // Pixels LVGL invalidated and redrew
+     FRAME_METRIC_COUNT
+ } FrameMetric;
+ 
+ /**
+  * @brief Rolling statistics for one metric
+  */
+ typedef struct {
+     uint32_t last;   // Value of the most recent frame
+     uint32_t min;    // Minimum over the window
+     uint32_t avg;    // Average over the window
+     uint32_t p99;    // 99th percentile over the window
+ } FrameStatSummary;
+ 
+ /**
+  * @class FrameStats
+  * @brief Collects per-frame render and flush timing
+  *
+  * The UI task brackets lv_task_handler() with beginRender()/endRender() and
+  * the display driver reports every flush. Passes that neither invalidate
+  * nor flush anything are not counted as frames so idle time does not
+  * dilute the statistics.
+  */
+ class FrameStats {
+ public:
+     /**
+      * @brief Constructor
+      */
+     FrameStats();
+ 
+     /**
+      * @brief Mark the start of an lv_task_handler() pass
+      */
+     void beginRender();
+ 
+     /**
+      * @brief Mark the end of an lv_task_handler() pass and close the frame
+      */
+     void endRender();
+ 
+     /**
+      * @brief Record that a flush of an area started
+      * @param pixels Number of pixels in the flushed area
+      */
+     void beginFlush(uint32_t pixels);
+ 
+     /**
+      * @brief Record that the flush_cb returned to LVGL
+      *
+      * For blocking flushes the transfer is complete at this point, for DMA
+      * flushes only the CPU part of the flush is done.
+      */
+     void endFlushCall();
+ 
+     /**
+      * @brief Record that the pixels of the last flush reached the panel
+      */
+     void endFlushTransfer();
+ 
+     /**
+      * @brief Get rolling statistics for a metric
+      * @param metric Metric to summarize
+      * @return Summary over the current window
+      */
+     FrameStatSummary getSummary(FrameMetric metric) const;
+ 
+     /**
+      * @brief Get the number of frames recorded since boot
+      * @return Frame count
+      */
+     uint32_t getFrameCount() const;
+ 
+     /**
+      * @brief Show or hide the on-screen stats overlay
+      * @param visible true to show the overlay
+      */
+     void setOverlayVisible(bool visible);
+ 
+     /**
+      * @brief Toggle the on-screen stats overlay
+      */
+     void toggleOverlay();
+ 
+     /**
+      * @brief Check if the overlay is visible
+      * @return true if visible
+      */
+     bool isOverlayVisible() const;
+ 
+     /**
+      * @brief Static LVGL monitor callback, reports the invalidated area
+      * @param disp_drv Display driver
+      * @param time Refresh duration in ms
+      * @param px Number of pixels redrawn
+      */
+     static void monitor_cb(lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px);
+ 
+ private:
+     // Ring buffer of recent frames, one row per metric
+     uint32_t _samples[FRAME_METRIC_COUNT][TDECK_FRAME_STATS_WINDOW];
+     uint16_t _head;                  // Next slot to write
+     uint16_t _count;                 // Valid samples in the window
+     uint32_t _frameCount;            // Frames recorded since boot
+ 
+     // Current frame accumulators
+     uint32_t _renderStart;           // micros() at beginRender
+     uint32_t _renderTime;            // Render time accumulated this frame (us)
+     uint32_t _flushCallTime;         // Time spent inside flush_cb (us)
+     uint32_t _flushCallStart;        // micros() at the last beginFlush
+     uint32_t _flushStart;            // micros() of the first flush in the frame
+     uint32_t _flushEnd;              // micros() of the last completed transfer
+     uint32_t _flushedPixels;         // Pixels flushed this frame
+     uint32_t _invalidPixels;         // Pixels invalidated this frame
+     uint16_t _pendingTransfers;      // Flushes started but not yet on the panel
+     bool _awaitingTransfer;          // Render finished, waiting for the last transfer
+ 
+     // Overlay
+     lv_obj_t* _overlay;              // Overlay label on the top layer
+     lv_timer_t* _overlayTimer;       // Overlay refresh timer
+ 
+     /**
+      * @brief Push the current frame into the window and reset accumulators
+      */
+     void _commitFrame();
+ 
+     /**
+      * @brief Refresh the overlay text
+      */
+     void _updateOverlay();
+ 
+     /**
+      * @brief Overlay timer callback
+      * @param timer Timer object
+      */
+     static void _overlayTimerCallback(lv_timer_t* timer);
+ };
+ 
+ // Global frame stats instance
+ extern FrameStats frameStats;
+ 
+ #endif // TDECK_FRAME_STATS_H
\ No newline at end of file
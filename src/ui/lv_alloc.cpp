@@ -0,0 +1,148 @@
+/**
+ * @file lv_alloc.cpp
+ * @brief Implementation of the SRAM/PSRAM split LVGL allocator
+ */
+
+ #include "lv_alloc.h"
+ #include <Arduino.h>
+ #include <esp_heap_caps.h>
+ #include "../config.h"
+ 
+ // Placed before every block so free() knows its size and pool, keeps blocks 8-byte aligned
+ struct BlockHeader {
+     uint32_t size;          // Block size, header included
+     uint32_t pool;          // tdeck_lv_pool_t the block came from
+ };
+ 
+ // Heap capabilities of each pool
+ static const uint32_t poolCaps[TDECK_LV_POOL_COUNT] = {
+     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+     MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT
+ };
+ 
+ // LVGL only runs on the UI task, the counters need no lock
+ static tdeck_lv_pool_stats_t poolStats[TDECK_LV_POOL_COUNT];
+ static uint32_t failures = 0;
+ 
+ // Cached PSRAM presence, boards without it put everything in SRAM
+ static bool hasPsram() {
+     static int8_t present = -1;
+     if (present < 0) {
+         present = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0 ? 1 : 0;
+     }
+     return present == 1;
+ }
+ 
+ // Pick the pool for a block of the given total size
+ static tdeck_lv_pool_t choosePool(size_t total) {
+     if (!hasPsram()) {
+         return TDECK_LV_POOL_SRAM;
+     }
+ 
+     // Small objects are touched on every redraw, they stay internal while the budget lasts
+     if (total <= TDECK_LV_SRAM_MAX_BLOCK &&
+         poolStats[TDECK_LV_POOL_SRAM].used + total <= TDECK_LV_SRAM_BUDGET) {
+         return TDECK_LV_POOL_SRAM;
+     }
+ 
+     return TDECK_LV_POOL_PSRAM;
+ }
+ 
+ // Allocate from a pool and account for the block
+ static void* allocFrom(tdeck_lv_pool_t pool, size_t total) {
+     BlockHeader* header = (BlockHeader*)heap_caps_malloc(total, poolCaps[pool]);
+     if (!header) {
+         return nullptr;
+     }
+ 
+     header->size = total;
+     header->pool = pool;
+ 
+     tdeck_lv_pool_stats_t& stats = poolStats[pool];
+     stats.used += total;
+     stats.blocks++;
+     if (stats.used > stats.peak) {
+         stats.peak = stats.used;
+     }
+ 
+     return header + 1;
+ }
+ 
+ // Allocate a block for LVGL
+ void* tdeck_lv_malloc(size_t size) {
+     size_t total = sizeof(BlockHeader) + (size ? size : 1);
+     tdeck_lv_pool_t pool = choosePool(total);
+ 
+     void* ptr = allocFrom(pool, total);
+     if (!ptr && hasPsram()) {
+         // The other pool is slower or scarcer, but better than failing
+         poolStats[pool].fallbacks++;
+         ptr = allocFrom(pool == TDECK_LV_POOL_SRAM ? TDECK_LV_POOL_PSRAM : TDECK_LV_POOL_SRAM, total);
+     }
+ 
+     if (!ptr) {
+         failures++;
+     }
+     return ptr;
+ }
+ 
+ // Free a block allocated by tdeck_lv_malloc
+ void tdeck_lv_free(void* ptr) {
+     if (!ptr) {
+         return;
+     }
+ 
+     BlockHeader* header = (BlockHeader*)ptr - 1;
+     tdeck_lv_pool_stats_t& stats = poolStats[header->pool];
+     stats.used -= header->size;
+     stats.blocks--;
+ 
+     heap_caps_free(header);
+ }
+ 
+ // Resize a block, it moves pool when its new size belongs elsewhere
+ void* tdeck_lv_realloc(void* ptr, size_t size) {
+     if (!ptr) {
+         return tdeck_lv_malloc(size);
+     }
+ 
+     if (size == 0) {
+         tdeck_lv_free(ptr);
+         return nullptr;
+     }
+ 
+     BlockHeader* header = (BlockHeader*)ptr - 1;
+     size_t oldSize = header->size - sizeof(BlockHeader);
+ 
+     void* resized = tdeck_lv_malloc(size);
+     if (!resized) {
+         return nullptr;
+     }
+ 
+     memcpy(resized, ptr, oldSize < size ? oldSize : size);
+     tdeck_lv_free(ptr);
+     return resized;
+ }
+ 
+ // Get the usage of one pool
+ void tdeck_lv_get_pool_stats(tdeck_lv_pool_t pool, tdeck_lv_pool_stats_t* stats) {
+     *stats = poolStats[pool];
+     stats->heapFree = heap_caps_get_free_size(poolCaps[pool]);
+     stats->heapLargest = heap_caps_get_largest_free_block(poolCaps[pool]);
+ }
+ 
+ // Get the number of allocations neither pool could serve
+ uint32_t tdeck_lv_get_failures(void) {
+     return failures;
+ }
+ 
+ // Get the bytes LVGL could still allocate
+ size_t tdeck_lv_get_available(void) {
+     if (!hasPsram()) {
+         return heap_caps_get_free_size(poolCaps[TDECK_LV_POOL_SRAM]);
+     }
+ 
+     size_t used = poolStats[TDECK_LV_POOL_SRAM].used;
+     size_t budget = used < TDECK_LV_SRAM_BUDGET ? TDECK_LV_SRAM_BUDGET - used : 0;
+     return budget + heap_caps_get_free_size(poolCaps[TDECK_LV_POOL_PSRAM]);
+ }
\ No newline at end of file
@@ -4,263 +4,278 @@
  */
 
  #include "styles.h"
+ #include "../system/assets.h"
 
  // Global styles instance
  Styles styles;
  
- Styles::Styles() {
-     // Nothing to initialize here, initialization happens in init()
+ Styles::Styles() : currentTheme(THEME_LIGHT), initialized(false), changed(0) {
+     // Styles are built in init(), once the fonts are mapped
  }
  
  bool Styles::init() {
      TDECK_LOG_I("Initializing UI styles");
      
-     // Initialize and apply styles based on current theme
-     initStyles();
+     // Build both themes once, a switch only swaps style maps
+     if (!initialized) {
+         buildStyles(sets[THEME_LIGHT], Theme::getPalette(THEME_LIGHT));
+         buildStyles(sets[THEME_DARK], Theme::getPalette(THEME_DARK));
+         changed = themeDiffStyles((const lv_style_t*)&sets[THEME_LIGHT], (const lv_style_t*)&sets[THEME_DARK],
+                                   STYLE_COUNT);
+         initialized = true;
+     }
+     
+     // Start in the theme's current type, nothing refers to the styles yet
+     currentTheme = theme.getCurrentTheme();
+     active = sets[currentTheme];
      
      return true;
  }
  
  void Styles::updateForTheme(ThemeType themeType) {
-     TDECK_LOG_I("Updating styles for theme change");
+     if (!initialized || themeType == currentTheme) {
+         return;
+     }
      
-     // Reinitialize styles with the new theme
-     initStyles();
+     TDECK_LOG_I("Updating styles for theme change");
+     currentTheme = themeType;
+     themeSwapStyles((lv_style_t*)&active, (const lv_style_t*)&sets[themeType], STYLE_COUNT, changed);
  }
  
- void Styles::initStyles() {
-     // Get current theme colors
-     const ThemeColors& colors = theme.getColors();
+ void Styles::buildStyles(StyleSet& set, const ThemeColors& colors) {
+     static_assert(STYLE_COUNT <= 32, "Changed style mask holds 32 styles");
      
      // App icon style
-     lv_style_init(&style_app_icon);
-     lv_style_set_image_recolor(&style_app_icon, LV_STATE_DEFAULT, colors.text);
-     lv_style_set_image_recolor_opa(&style_app_icon, LV_STATE_DEFAULT, LV_OPA_0);
-     lv_style_set_image_recolor_opa(&style_app_icon, LV_STATE_PRESSED, LV_OPA_30);
-     lv_style_set_transition_time(&style_app_icon, LV_STATE_DEFAULT, 100);
-     lv_style_set_transition_prop_1(&style_app_icon, LV_STATE_DEFAULT, LV_STYLE_IMAGE_RECOLOR_OPA);
+     lv_style_init(&set.app_icon);
+     lv_style_set_image_recolor(&set.app_icon, LV_STATE_DEFAULT, colors.text);
+     lv_style_set_image_recolor_opa(&set.app_icon, LV_STATE_DEFAULT, LV_OPA_0);
+     lv_style_set_image_recolor_opa(&set.app_icon, LV_STATE_PRESSED, LV_OPA_30);
+     lv_style_set_transition_time(&set.app_icon, LV_STATE_DEFAULT, 100);
+     lv_style_set_transition_prop_1(&set.app_icon, LV_STATE_DEFAULT, LV_STYLE_IMAGE_RECOLOR_OPA);
      
      // Launcher grid style
-     lv_style_init(&style_launcher_grid);
-     lv_style_set_pad_inner(&style_launcher_grid, LV_STATE_DEFAULT, 20);
-     lv_style_set_pad_top(&style_launcher_grid, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_bottom(&style_launcher_grid, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_left(&style_launcher_grid, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_right(&style_launcher_grid, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.launcher_grid);
+     lv_style_set_pad_inner(&set.launcher_grid, LV_STATE_DEFAULT, 20);
+     lv_style_set_pad_top(&set.launcher_grid, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_bottom(&set.launcher_grid, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_left(&set.launcher_grid, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_right(&set.launcher_grid, LV_STATE_DEFAULT, 10);
      
      // Status bar icon style
-     lv_style_init(&style_status_bar_icon);
-     lv_style_set_image_recolor(&style_status_bar_icon, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
-     lv_style_set_image_recolor_opa(&style_status_bar_icon, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_pad_all(&style_status_bar_icon, LV_STATE_DEFAULT, 2);
+     lv_style_init(&set.status_bar_icon);
+     lv_style_set_image_recolor(&set.status_bar_icon, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
+     lv_style_set_image_recolor_opa(&set.status_bar_icon, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_pad_all(&set.status_bar_icon, LV_STATE_DEFAULT, 2);
      
      // Status bar text style
-     lv_style_init(&style_status_bar_text);
-     lv_style_set_text_color(&style_status_bar_text, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
-     lv_style_set_text_font(&style_status_bar_text, LV_STATE_DEFAULT, &lv_font_montserrat_12);
+     lv_style_init(&set.status_bar_text);
+     lv_style_set_text_color(&set.status_bar_text, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
+     lv_style_set_text_font(&set.status_bar_text, LV_STATE_DEFAULT, assets.getFont("montserrat_12"));
      
      // Table header style
-     lv_style_init(&style_table_header);
-     lv_style_set_bg_color(&style_table_header, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_bg_opa(&style_table_header, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_text_color(&style_table_header, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
-     lv_style_set_border_side(&style_table_header, LV_STATE_DEFAULT, LV_BORDER_SIDE_BOTTOM);
-     lv_style_set_border_width(&style_table_header, LV_STATE_DEFAULT, 2);
-     lv_style_set_border_color(&style_table_header, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_pad_top(&style_table_header, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_bottom(&style_table_header, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_left(&style_table_header, LV_STATE_DEFAULT, 5);
-     lv_style_set_pad_right(&style_table_header, LV_STATE_DEFAULT, 5);
+     lv_style_init(&set.table_header);
+     lv_style_set_bg_color(&set.table_header, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_bg_opa(&set.table_header, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_text_color(&set.table_header, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
+     lv_style_set_border_side(&set.table_header, LV_STATE_DEFAULT, LV_BORDER_SIDE_BOTTOM);
+     lv_style_set_border_width(&set.table_header, LV_STATE_DEFAULT, 2);
+     lv_style_set_border_color(&set.table_header, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_pad_top(&set.table_header, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_bottom(&set.table_header, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_left(&set.table_header, LV_STATE_DEFAULT, 5);
+     lv_style_set_pad_right(&set.table_header, LV_STATE_DEFAULT, 5);
      
      // Settings item style
-     lv_style_init(&style_settings_item);
-     lv_style_set_bg_color(&style_settings_item, LV_STATE_DEFAULT, colors.surface);
-     lv_style_set_bg_opa(&style_settings_item, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_border_width(&style_settings_item, LV_STATE_DEFAULT, 0);
-     lv_style_set_border_side(&style_settings_item, LV_STATE_DEFAULT, LV_BORDER_SIDE_BOTTOM);
-     lv_style_set_border_color(&style_settings_item, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_border_width(&style_settings_item, LV_STATE_DEFAULT, 1);
-     lv_style_set_pad_top(&style_settings_item, LV_STATE_DEFAULT, 15);
-     lv_style_set_pad_bottom(&style_settings_item, LV_STATE_DEFAULT, 15);
-     lv_style_set_pad_left(&style_settings_item, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_right(&style_settings_item, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.settings_item);
+     lv_style_set_bg_color(&set.settings_item, LV_STATE_DEFAULT, colors.surface);
+     lv_style_set_bg_opa(&set.settings_item, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_border_width(&set.settings_item, LV_STATE_DEFAULT, 0);
+     lv_style_set_border_side(&set.settings_item, LV_STATE_DEFAULT, LV_BORDER_SIDE_BOTTOM);
+     lv_style_set_border_color(&set.settings_item, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_border_width(&set.settings_item, LV_STATE_DEFAULT, 1);
+     lv_style_set_pad_top(&set.settings_item, LV_STATE_DEFAULT, 15);
+     lv_style_set_pad_bottom(&set.settings_item, LV_STATE_DEFAULT, 15);
+     lv_style_set_pad_left(&set.settings_item, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_right(&set.settings_item, LV_STATE_DEFAULT, 10);
      
      // Battery normal style
-     lv_style_init(&style_battery_normal);
-     lv_style_set_bg_color(&style_battery_normal, LV_STATE_DEFAULT, colors.success);
-     lv_style_set_bg_opa(&style_battery_normal, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_init(&set.battery_normal);
+     lv_style_set_bg_color(&set.battery_normal, LV_STATE_DEFAULT, colors.success);
+     lv_style_set_bg_opa(&set.battery_normal, LV_STATE_DEFAULT, LV_OPA_COVER);
      
      // Battery low style
-     lv_style_init(&style_battery_low);
-     lv_style_set_bg_color(&style_battery_low, LV_STATE_DEFAULT, colors.warning);
-     lv_style_set_bg_opa(&style_battery_low, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_init(&set.battery_low);
+     lv_style_set_bg_color(&set.battery_low, LV_STATE_DEFAULT, colors.warning);
+     lv_style_set_bg_opa(&set.battery_low, LV_STATE_DEFAULT, LV_OPA_COVER);
      
      // Battery critical style
-     lv_style_init(&style_battery_critical);
-     lv_style_set_bg_color(&style_battery_critical, LV_STATE_DEFAULT, colors.error);
-     lv_style_set_bg_opa(&style_battery_critical, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_init(&set.battery_critical);
+     lv_style_set_bg_color(&set.battery_critical, LV_STATE_DEFAULT, colors.error);
+     lv_style_set_bg_opa(&set.battery_critical, LV_STATE_DEFAULT, LV_OPA_COVER);
      
      // Tab style
-     lv_style_init(&style_tab);
-     lv_style_set_bg_color(&style_tab, LV_STATE_DEFAULT, colors.bg_alt);
-     lv_style_set_bg_opa(&style_tab, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_text_color(&style_tab, LV_STATE_DEFAULT, colors.text_secondary);
-     lv_style_set_pad_top(&style_tab, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_bottom(&style_tab, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_left(&style_tab, LV_STATE_DEFAULT, 15);
-     lv_style_set_pad_right(&style_tab, LV_STATE_DEFAULT, 15);
+     lv_style_init(&set.tab);
+     lv_style_set_bg_color(&set.tab, LV_STATE_DEFAULT, colors.bg_alt);
+     lv_style_set_bg_opa(&set.tab, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_text_color(&set.tab, LV_STATE_DEFAULT, colors.text_secondary);
+     lv_style_set_pad_top(&set.tab, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_bottom(&set.tab, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_left(&set.tab, LV_STATE_DEFAULT, 15);
+     lv_style_set_pad_right(&set.tab, LV_STATE_DEFAULT, 15);
      
      // Active tab style
-     lv_style_init(&style_tab_active);
-     lv_style_set_bg_color(&style_tab_active, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_text_color(&style_tab_active, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
-     lv_style_set_bg_opa(&style_tab_active, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_init(&set.tab_active);
+     lv_style_set_bg_color(&set.tab_active, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_text_color(&set.tab_active, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
+     lv_style_set_bg_opa(&set.tab_active, LV_STATE_DEFAULT, LV_OPA_COVER);
      
      // File icon style
-     lv_style_init(&style_file_icon);
-     lv_style_set_image_recolor(&style_file_icon, LV_STATE_DEFAULT, colors.secondary);
-     lv_style_set_image_recolor_opa(&style_file_icon, LV_STATE_DEFAULT, LV_OPA_50);
+     lv_style_init(&set.file_icon);
+     lv_style_set_image_recolor(&set.file_icon, LV_STATE_DEFAULT, colors.secondary);
+     lv_style_set_image_recolor_opa(&set.file_icon, LV_STATE_DEFAULT, LV_OPA_50);
      
      // Folder icon style
-     lv_style_init(&style_folder_icon);
-     lv_style_set_image_recolor(&style_folder_icon, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_image_recolor_opa(&style_folder_icon, LV_STATE_DEFAULT, LV_OPA_50);
+     lv_style_init(&set.folder_icon);
+     lv_style_set_image_recolor(&set.folder_icon, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_image_recolor_opa(&set.folder_icon, LV_STATE_DEFAULT, LV_OPA_50);
      
      // Dialog style
-     lv_style_init(&style_dialog);
-     lv_style_set_bg_color(&style_dialog, LV_STATE_DEFAULT, colors.surface);
-     lv_style_set_bg_opa(&style_dialog, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_border_color(&style_dialog, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_border_width(&style_dialog, LV_STATE_DEFAULT, 1);
-     lv_style_set_radius(&style_dialog, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
-     lv_style_set_shadow_width(&style_dialog, LV_STATE_DEFAULT, 20);
-     lv_style_set_shadow_color(&style_dialog, LV_STATE_DEFAULT, lv_color_make(0, 0, 0));
-     lv_style_set_shadow_opa(&style_dialog, LV_STATE_DEFAULT, LV_OPA_30);
-     lv_style_set_pad_all(&style_dialog, LV_STATE_DEFAULT, 20);
+     lv_style_init(&set.dialog);
+     lv_style_set_bg_color(&set.dialog, LV_STATE_DEFAULT, colors.surface);
+     lv_style_set_bg_opa(&set.dialog, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_border_color(&set.dialog, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_border_width(&set.dialog, LV_STATE_DEFAULT, 1);
+     lv_style_set_radius(&set.dialog, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
+     lv_style_set_shadow_width(&set.dialog, LV_STATE_DEFAULT, 20);
+     lv_style_set_shadow_color(&set.dialog, LV_STATE_DEFAULT, lv_color_make(0, 0, 0));
+     lv_style_set_shadow_opa(&set.dialog, LV_STATE_DEFAULT, LV_OPA_30);
+     lv_style_set_pad_all(&set.dialog, LV_STATE_DEFAULT, 20);
      
      // Keyboard style
-     lv_style_init(&style_keyboard);
-     lv_style_set_bg_color(&style_keyboard, LV_STATE_DEFAULT, colors.bg_alt);
-     lv_style_set_bg_opa(&style_keyboard, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_pad_top(&style_keyboard, LV_STATE_DEFAULT, 5);
-     lv_style_set_pad_bottom(&style_keyboard, LV_STATE_DEFAULT, 5);
-     lv_style_set_pad_left(&style_keyboard, LV_STATE_DEFAULT, 5);
-     lv_style_set_pad_right(&style_keyboard, LV_STATE_DEFAULT, 5);
-     lv_style_set_pad_inner(&style_keyboard, LV_STATE_DEFAULT, 4);
+     lv_style_init(&set.keyboard);
+     lv_style_set_bg_color(&set.keyboard, LV_STATE_DEFAULT, colors.bg_alt);
+     lv_style_set_bg_opa(&set.keyboard, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_pad_top(&set.keyboard, LV_STATE_DEFAULT, 5);
+     lv_style_set_pad_bottom(&set.keyboard, LV_STATE_DEFAULT, 5);
+     lv_style_set_pad_left(&set.keyboard, LV_STATE_DEFAULT, 5);
+     lv_style_set_pad_right(&set.keyboard, LV_STATE_DEFAULT, 5);
+     lv_style_set_pad_inner(&set.keyboard, LV_STATE_DEFAULT, 4);
      
      // Toast notification style
-     lv_style_init(&style_toast);
-     lv_style_set_bg_color(&style_toast, LV_STATE_DEFAULT, lv_color_make(0x30, 0x30, 0x30));
-     lv_style_set_bg_opa(&style_toast, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_text_color(&style_toast, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
-     lv_style_set_radius(&style_toast, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
-     lv_style_set_shadow_width(&style_toast, LV_STATE_DEFAULT, 15);
-     lv_style_set_shadow_color(&style_toast, LV_STATE_DEFAULT, lv_color_make(0, 0, 0));
-     lv_style_set_shadow_opa(&style_toast, LV_STATE_DEFAULT, LV_OPA_30);
-     lv_style_set_pad_all(&style_toast, LV_STATE_DEFAULT, 15);
+     lv_style_init(&set.toast);
+     lv_style_set_bg_color(&set.toast, LV_STATE_DEFAULT, lv_color_make(0x30, 0x30, 0x30));
+     lv_style_set_bg_opa(&set.toast, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_text_color(&set.toast, LV_STATE_DEFAULT, lv_color_make(0xFF, 0xFF, 0xFF));
+     lv_style_set_radius(&set.toast, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
+     lv_style_set_shadow_width(&set.toast, LV_STATE_DEFAULT, 15);
+     lv_style_set_shadow_color(&set.toast, LV_STATE_DEFAULT, lv_color_make(0, 0, 0));
+     lv_style_set_shadow_opa(&set.toast, LV_STATE_DEFAULT, LV_OPA_30);
+     lv_style_set_pad_all(&set.toast, LV_STATE_DEFAULT, 15);
      
      // Chart style
-     lv_style_init(&style_chart);
-     lv_style_set_line_width(&style_chart, LV_STATE_DEFAULT, 2);
-     lv_style_set_line_color(&style_chart, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_scale_grad_color(&style_chart, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_scale_end_color(&style_chart, LV_STATE_DEFAULT, colors.text_secondary);
-     lv_style_set_pad_all(&style_chart, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.chart);
+     lv_style_set_line_width(&set.chart, LV_STATE_DEFAULT, 2);
+     lv_style_set_line_color(&set.chart, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_scale_grad_color(&set.chart, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_scale_end_color(&set.chart, LV_STATE_DEFAULT, colors.text_secondary);
+     lv_style_set_pad_all(&set.chart, LV_STATE_DEFAULT, 10);
+     
+     // Chart series colors - modify these if using multiple series
+     lv_style_init(&set.chart_series);
+     lv_style_set_line_color(&set.chart_series, 0, colors.primary);
+     lv_style_set_line_color(&set.chart_series, 1, colors.secondary);
+     lv_style_set_line_color(&set.chart_series, 2, colors.accent);
+     lv_style_set_line_color(&set.chart_series, 3, colors.success);
      
      // Progress bar style
-     lv_style_init(&style_progress);
-     lv_style_set_bg_color(&style_progress, LV_STATE_DEFAULT, colors.bg_alt);
-     lv_style_set_bg_opa(&style_progress, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_border_width(&style_progress, LV_STATE_DEFAULT, 0);
-     lv_style_set_radius(&style_progress, LV_STATE_DEFAULT, 10); // More rounded for progress bars
-     lv_style_set_pad_all(&style_progress, LV_STATE_DEFAULT, 0);
+     lv_style_init(&set.progress);
+     lv_style_set_bg_color(&set.progress, LV_STATE_DEFAULT, colors.bg_alt);
+     lv_style_set_bg_opa(&set.progress, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_border_width(&set.progress, LV_STATE_DEFAULT, 0);
+     lv_style_set_radius(&set.progress, LV_STATE_DEFAULT, 10); // More rounded for progress bars
+     lv_style_set_pad_all(&set.progress, LV_STATE_DEFAULT, 0);
+     
+     // Progress bar indicator style
+     lv_style_init(&set.progress_indic);
+     lv_style_set_bg_color(&set.progress_indic, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_radius(&set.progress_indic, LV_STATE_DEFAULT, 10);
  }
  
  // Style application methods
  
  void Styles::applyAppIconStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_IMG_PART_MAIN, &style_app_icon);
+     lv_obj_add_style(obj, LV_IMG_PART_MAIN, &active.app_icon);
  }
  
  void Styles::applyLauncherGridStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &style_launcher_grid);
+     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &active.launcher_grid);
  }
  
  void Styles::applyStatusBarIconStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_IMG_PART_MAIN, &style_status_bar_icon);
+     lv_obj_add_style(obj, LV_IMG_PART_MAIN, &active.status_bar_icon);
  }
  
  void Styles::applyStatusBarTextStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_LABEL_PART_MAIN, &style_status_bar_text);
+     lv_obj_add_style(obj, LV_LABEL_PART_MAIN, &active.status_bar_text);
  }
  
  void Styles::applyTableHeaderStyle(lv_obj_t* obj) {
      // Apply this to the table header part
-     lv_obj_add_style(obj, LV_TABLE_PART_CELL1, &style_table_header);
+     lv_obj_add_style(obj, LV_TABLE_PART_CELL1, &active.table_header);
  }
  
  void Styles::applySettingsItemStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &style_settings_item);
+     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &active.settings_item);
  }
  
  void Styles::applyBatteryStyle(lv_obj_t* obj, uint8_t level) {
      if (level <= TDECK_BATTERY_CRITICAL_THRESHOLD) {
-         lv_obj_add_style(obj, LV_BAR_PART_INDIC, &style_battery_critical);
+         lv_obj_add_style(obj, LV_BAR_PART_INDIC, &active.battery_critical);
      } else if (level <= TDECK_BATTERY_LOW_THRESHOLD) {
-         lv_obj_add_style(obj, LV_BAR_PART_INDIC, &style_battery_low);
+         lv_obj_add_style(obj, LV_BAR_PART_INDIC, &active.battery_low);
      } else {
-         lv_obj_add_style(obj, LV_BAR_PART_INDIC, &style_battery_normal);
+         lv_obj_add_style(obj, LV_BAR_PART_INDIC, &active.battery_normal);
      }
  }
  
  void Styles::applyTabStyle(lv_obj_t* obj, bool isActive) {
      if (isActive) {
-         lv_obj_add_style(obj, LV_BTN_PART_MAIN, &style_tab_active);
+         lv_obj_add_style(obj, LV_BTN_PART_MAIN, &active.tab_active);
      } else {
-         lv_obj_add_style(obj, LV_BTN_PART_MAIN, &style_tab);
+         lv_obj_add_style(obj, LV_BTN_PART_MAIN, &active.tab);
      }
  }
  
  void Styles::applyFileIconStyle(lv_obj_t* obj, bool isFolder) {
      if (isFolder) {
-         lv_obj_add_style(obj, LV_IMG_PART_MAIN, &style_folder_icon);
+         lv_obj_add_style(obj, LV_IMG_PART_MAIN, &active.folder_icon);
      } else {
-         lv_obj_add_style(obj, LV_IMG_PART_MAIN, &style_file_icon);
+         lv_obj_add_style(obj, LV_IMG_PART_MAIN, &active.file_icon);
      }
  }
  
  void Styles::applyDialogStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &style_dialog);
+     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &active.dialog);
  }
  
  void Styles::applyKeyboardStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_KEYBOARD_PART_BG, &style_keyboard);
+     lv_obj_add_style(obj, LV_KEYBOARD_PART_BG, &active.keyboard);
  }
  
  void Styles::applyToastStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &style_toast);
+     lv_obj_add_style(obj, LV_CONT_PART_MAIN, &active.toast);
  }
  
  void Styles::applyChartStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_CHART_PART_BG, &style_chart);
+     lv_obj_add_style(obj, LV_CHART_PART_BG, &active.chart);
      
-     // Get current theme colors for custom series colors
-     const ThemeColors& colors = theme.getColors();
-     
-     // Set series colors - modify these if using multiple series
-     lv_obj_set_style_local_line_color(obj, LV_CHART_PART_SERIES, 0, colors.primary);
-     lv_obj_set_style_local_line_color(obj, LV_CHART_PART_SERIES, 1, colors.secondary);
-     lv_obj_set_style_local_line_color(obj, LV_CHART_PART_SERIES, 2, colors.accent);
-     lv_obj_set_style_local_line_color(obj, LV_CHART_PART_SERIES, 3, colors.success);
+     // Series colors follow the theme
+     lv_obj_add_style(obj, LV_CHART_PART_SERIES, &active.chart_series);
  }
  
  void Styles::applyProgressStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_BAR_PART_BG, &style_progress);
-     
-     // Get current theme colors
-     const ThemeColors& colors = theme.getColors();
+     lv_obj_add_style(obj, LV_BAR_PART_BG, &active.progress);
      
      // Set indicator style for progress bar
-     lv_obj_set_style_local_bg_color(obj, LV_BAR_PART_INDIC, LV_STATE_DEFAULT, colors.primary);
-     lv_obj_set_style_local_radius(obj, LV_BAR_PART_INDIC, LV_STATE_DEFAULT, 10);
+     lv_obj_add_style(obj, LV_BAR_PART_INDIC, &active.progress_indic);
  }
\ No newline at end of file
@@ -36,7 +36,7 @@
      bool init();
      
      /**
-      * @brief Update styles when theme changes
+      * @brief Update styles when theme changes, swapping to the prebuilt set
       * @param themeType The new theme type
       */
      void updateForTheme(ThemeType themeType);
@@ -129,30 +129,43 @@
      void applyProgressStyle(lv_obj_t* obj);
  
  private:
-     /**
-      * @brief Initialize all styles
-      */
-     void initStyles();
-     
-     // Specialized styles
-     lv_style_t style_app_icon;        // App icon style
-     lv_style_t style_launcher_grid;   // Launcher grid style
-     lv_style_t style_status_bar_icon; // Status bar icon style
-     lv_style_t style_status_bar_text; // Status bar text style
-     lv_style_t style_table_header;    // Table header style
-     lv_style_t style_settings_item;   // Settings item style
-     lv_style_t style_battery_normal;  // Battery normal style
-     lv_style_t style_battery_low;     // Battery low style
-     lv_style_t style_battery_critical; // Battery critical style
-     lv_style_t style_tab;             // Tab style
-     lv_style_t style_tab_active;      // Active tab style
-     lv_style_t style_file_icon;       // File icon style
-     lv_style_t style_folder_icon;     // Folder icon style
-     lv_style_t style_dialog;          // Dialog style
-     lv_style_t style_keyboard;        // Keyboard style
-     lv_style_t style_toast;           // Toast notification style
-     lv_style_t style_chart;           // Chart style
-     lv_style_t style_progress;        // Progress bar style
+     // Specialized styles, only lv_style_t members so a set can be walked as an array
+     struct StyleSet {
+         lv_style_t app_icon;          // App icon style
+         lv_style_t launcher_grid;     // Launcher grid style
+         lv_style_t status_bar_icon;   // Status bar icon style
+         lv_style_t status_bar_text;   // Status bar text style
+         lv_style_t table_header;      // Table header style
+         lv_style_t settings_item;     // Settings item style
+         lv_style_t battery_normal;    // Battery normal style
+         lv_style_t battery_low;       // Battery low style
+         lv_style_t battery_critical;  // Battery critical style
+         lv_style_t tab;               // Tab style
+         lv_style_t tab_active;        // Active tab style
+         lv_style_t file_icon;         // File icon style
+         lv_style_t folder_icon;       // Folder icon style
+         lv_style_t dialog;            // Dialog style
+         lv_style_t keyboard;          // Keyboard style
+         lv_style_t toast;             // Toast notification style
+         lv_style_t chart;             // Chart style
+         lv_style_t chart_series;      // Chart series colors
+         lv_style_t progress;          // Progress bar style
+         lv_style_t progress_indic;    // Progress bar indicator style
+     };
+     static const size_t STYLE_COUNT = sizeof(StyleSet) / sizeof(lv_style_t);
+     
+     /**
+      * @brief Build the styles of one theme
+      * @param set Styles to initialize
+      * @param colors Palette of the theme
+      */
+     static void buildStyles(StyleSet& set, const ThemeColors& colors);
+     
+     ThemeType currentTheme;           // Theme of the active styles
+     bool initialized;                 // Both sets built
+     StyleSet active;                  // Styles objects refer to, share the maps of one set
+     StyleSet sets[2];                 // Prebuilt light and dark styles
+     uint32_t changed;                 // Styles that differ between the sets
  };
  
  // Global styles instance
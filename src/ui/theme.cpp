@@ -4,36 +4,88 @@
  */
 
  #include "theme.h"
+ #include "../system/assets.h"
 
  // Global theme instance
  Theme theme;
  
- // Define some color constants
- #define COLOR_WHITE        lv_color_make(0xFF, 0xFF, 0xFF)
- #define COLOR_BLACK        lv_color_make(0x00, 0x00, 0x00)
- #define COLOR_GRAY         lv_color_make(0x80, 0x80, 0x80)
- #define COLOR_LIGHT_GRAY   lv_color_make(0xE0, 0xE0, 0xE0)
- #define COLOR_DARK_GRAY    lv_color_make(0x30, 0x30, 0x30)
- #define COLOR_BLUE         lv_color_make(0x21, 0x96, 0xF3)
- #define COLOR_DARK_BLUE    lv_color_make(0x18, 0x76, 0xD2)
- #define COLOR_PURPLE       lv_color_make(0x9C, 0x27, 0xB0)
- #define COLOR_GREEN        lv_color_make(0x4C, 0xAF, 0x50)
- #define COLOR_RED          lv_color_make(0xF4, 0x43, 0x36)
- #define COLOR_ORANGE       lv_color_make(0xFF, 0x98, 0x00)
- #define COLOR_CYAN         lv_color_make(0x00, 0xBC, 0xD4)
+ // Define some color constants, LV_COLOR_MAKE so the palettes are constant data
+ #define COLOR_WHITE        LV_COLOR_MAKE(0xFF, 0xFF, 0xFF)
+ #define COLOR_BLACK        LV_COLOR_MAKE(0x00, 0x00, 0x00)
+ #define COLOR_GRAY         LV_COLOR_MAKE(0x80, 0x80, 0x80)
+ #define COLOR_LIGHT_GRAY   LV_COLOR_MAKE(0xE0, 0xE0, 0xE0)
+ #define COLOR_DARK_GRAY    LV_COLOR_MAKE(0x30, 0x30, 0x30)
+ #define COLOR_BLUE         LV_COLOR_MAKE(0x21, 0x96, 0xF3)
+ #define COLOR_DARK_BLUE    LV_COLOR_MAKE(0x18, 0x76, 0xD2)
+ #define COLOR_PURPLE       LV_COLOR_MAKE(0x9C, 0x27, 0xB0)
+ #define COLOR_GREEN        LV_COLOR_MAKE(0x4C, 0xAF, 0x50)
+ #define COLOR_RED          LV_COLOR_MAKE(0xF4, 0x43, 0x36)
+ #define COLOR_ORANGE       LV_COLOR_MAKE(0xFF, 0x98, 0x00)
+ #define COLOR_CYAN         LV_COLOR_MAKE(0x00, 0xBC, 0xD4)
  
- Theme::Theme() : currentTheme(THEME_LIGHT) {
+ // Palettes indexed by ThemeType, in ThemeColors member order
+ static const ThemeColors palettes[2] = {
+     // Light theme palette
+     {
+         COLOR_WHITE, COLOR_LIGHT_GRAY, LV_COLOR_MAKE(0xF5, 0xF5, 0xF5),
+         COLOR_BLUE, COLOR_PURPLE, COLOR_CYAN,
+         COLOR_BLACK, COLOR_GRAY,
+         LV_COLOR_MAKE(0xD0, 0xD0, 0xD0), LV_COLOR_MAKE(0xA0, 0xA0, 0xA0),
+         COLOR_GREEN, COLOR_ORANGE, COLOR_RED
+     },
+     // Dark theme palette
+     {
+         COLOR_BLACK, COLOR_DARK_GRAY, LV_COLOR_MAKE(0x12, 0x12, 0x12),
+         COLOR_BLUE, COLOR_PURPLE, COLOR_CYAN,
+         COLOR_WHITE, COLOR_LIGHT_GRAY,
+         LV_COLOR_MAKE(0x40, 0x40, 0x40), LV_COLOR_MAKE(0x60, 0x60, 0x60),
+         COLOR_GREEN, COLOR_ORANGE, COLOR_RED
+     }
+ };
+ 
+ void themeSwapStyles(lv_style_t* active, const lv_style_t* set, size_t count, uint32_t changed) {
+     // Taking over the maps swaps pointers, objects keep pointing at the active styles
+     for (size_t i = 0; i < count; i++) {
+         active[i] = set[i];
+     }
+     
+     // Each report walks the object tree and refreshes only the objects using the style
+     for (size_t i = 0; i < count; i++) {
+         if (changed & (1UL << i)) {
+             lv_obj_report_style_mod(&active[i]);
+         }
+     }
+ }
+ 
+ uint32_t themeDiffStyles(const lv_style_t* a, const lv_style_t* b, size_t count) {
+     uint32_t changed = 0;
+     for (size_t i = 0; i < count; i++) {
+         uint16_t size = _lv_style_get_mem_size(&a[i]);
+         if (size != _lv_style_get_mem_size(&b[i]) || (size > 0 && memcmp(a[i].map, b[i].map, size) != 0)) {
+             changed |= 1UL << i;
+         }
+     }
+     return changed;
+ }
+ 
+ Theme::Theme() : currentTheme(THEME_LIGHT), initialized(false), changed(0) {
      // Constructor initializes with light theme by default
  }
  
  bool Theme::init() {
      TDECK_LOG_I("Initializing theme system");
      
-     // Initialize styles
-     initStyles();
+     // Build both themes once, a switch only swaps style maps
+     if (!initialized) {
+         buildStyles(sets[THEME_LIGHT], palettes[THEME_LIGHT]);
+         buildStyles(sets[THEME_DARK], palettes[THEME_DARK]);
+         changed = themeDiffStyles((const lv_style_t*)&sets[THEME_LIGHT], (const lv_style_t*)&sets[THEME_DARK],
+                                   STYLE_COUNT);
+         initialized = true;
+     }
      
-     // Set default theme colors
-     updateColors();
+     // Nothing refers to the styles yet
+     active = sets[currentTheme];
      
      return true;
  }
@@ -42,8 +94,9 @@
      if (currentTheme != type) {
          TDECK_LOG_I("Changing theme to %s", type == THEME_DARK ? "dark" : "light");
          currentTheme = type;
-         updateColors();
-         initStyles(); // Reinitialize styles with new colors
+         if (initialized) {
+             themeSwapStyles((lv_style_t*)&active, (const lv_style_t*)&sets[type], STYLE_COUNT, changed);
+         }
      }
  }
  
@@ -52,230 +105,211 @@
  }
  
  const ThemeColors& Theme::getColors() const {
-     return colors;
+     return palettes[currentTheme];
  }
  
- void Theme::updateColors() {
-     if (currentTheme == THEME_DARK) {
-         // Dark theme palette
-         colors.bg = COLOR_BLACK;
-         colors.bg_alt = COLOR_DARK_GRAY;
-         colors.surface = lv_color_make(0x12, 0x12, 0x12);
-         colors.primary = COLOR_BLUE;
-         colors.secondary = COLOR_PURPLE;
-         colors.accent = COLOR_CYAN;
-         colors.text = COLOR_WHITE;
-         colors.text_secondary = COLOR_LIGHT_GRAY;
-         colors.border = lv_color_make(0x40, 0x40, 0x40);
-         colors.disabled = lv_color_make(0x60, 0x60, 0x60);
-         colors.success = COLOR_GREEN;
-         colors.warning = COLOR_ORANGE;
-         colors.error = COLOR_RED;
-     } else {
-         // Light theme palette
-         colors.bg = COLOR_WHITE;
-         colors.bg_alt = COLOR_LIGHT_GRAY;
-         colors.surface = lv_color_make(0xF5, 0xF5, 0xF5);
-         colors.primary = COLOR_BLUE;
-         colors.secondary = COLOR_PURPLE;
-         colors.accent = COLOR_CYAN;
-         colors.text = COLOR_BLACK;
-         colors.text_secondary = COLOR_GRAY;
-         colors.border = lv_color_make(0xD0, 0xD0, 0xD0);
-         colors.disabled = lv_color_make(0xA0, 0xA0, 0xA0);
-         colors.success = COLOR_GREEN;
-         colors.warning = COLOR_ORANGE;
-         colors.error = COLOR_RED;
-     }
+ const ThemeColors& Theme::getPalette(ThemeType type) {
+     return palettes[type];
  }
  
- void Theme::initStyles() {
-     // Initialize all styles with the current theme colors
+ void Theme::buildStyles(StyleSet& set, const ThemeColors& colors) {
+     // Initialize all styles with the colors of one theme
+     static_assert(STYLE_COUNT <= 32, "Changed style mask holds 32 styles");
      
      // Background style
-     lv_style_init(&style_bg);
-     lv_style_set_bg_color(&style_bg, LV_STATE_DEFAULT, colors.bg);
-     lv_style_set_text_color(&style_bg, LV_STATE_DEFAULT, colors.text);
+     lv_style_init(&set.bg);
+     lv_style_set_bg_color(&set.bg, LV_STATE_DEFAULT, colors.bg);
+     lv_style_set_text_color(&set.bg, LV_STATE_DEFAULT, colors.text);
      
      // Card style
-     lv_style_init(&style_card);
-     lv_style_set_bg_color(&style_card, LV_STATE_DEFAULT, colors.surface);
-     lv_style_set_bg_opa(&style_card, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_radius(&style_card, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
-     lv_style_set_border_color(&style_card, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_border_width(&style_card, LV_STATE_DEFAULT, 1);
-     lv_style_set_shadow_width(&style_card, LV_STATE_DEFAULT, 10);
-     lv_style_set_shadow_color(&style_card, LV_STATE_DEFAULT, lv_color_mix(colors.bg, colors.text, 240));
-     lv_style_set_shadow_opa(&style_card, LV_STATE_DEFAULT, LV_OPA_20);
-     lv_style_set_pad_top(&style_card, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_bottom(&style_card, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_left(&style_card, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_right(&style_card, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.card);
+     lv_style_set_bg_color(&set.card, LV_STATE_DEFAULT, colors.surface);
+     lv_style_set_bg_opa(&set.card, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_radius(&set.card, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
+     lv_style_set_border_color(&set.card, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_border_width(&set.card, LV_STATE_DEFAULT, 1);
+     lv_style_set_shadow_width(&set.card, LV_STATE_DEFAULT, 10);
+     lv_style_set_shadow_color(&set.card, LV_STATE_DEFAULT, lv_color_mix(colors.bg, colors.text, 240));
+     lv_style_set_shadow_opa(&set.card, LV_STATE_DEFAULT, LV_OPA_20);
+     lv_style_set_pad_top(&set.card, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_bottom(&set.card, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_left(&set.card, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_right(&set.card, LV_STATE_DEFAULT, 10);
      
      // Button style
-     lv_style_init(&style_btn);
-     lv_style_set_bg_color(&style_btn, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_bg_opa(&style_btn, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_bg_color(&style_btn, LV_STATE_DISABLED, colors.disabled);
-     lv_style_set_radius(&style_btn, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
-     lv_style_set_text_color(&style_btn, LV_STATE_DEFAULT, COLOR_WHITE);
-     lv_style_set_text_color(&style_btn, LV_STATE_DISABLED, lv_color_mix(COLOR_WHITE, colors.disabled, 180));
-     lv_style_set_pad_top(&style_btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING);
-     lv_style_set_pad_bottom(&style_btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING);
-     lv_style_set_pad_left(&style_btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING * 2);
-     lv_style_set_pad_right(&style_btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING * 2);
+     lv_style_init(&set.btn);
+     lv_style_set_bg_color(&set.btn, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_bg_opa(&set.btn, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_bg_color(&set.btn, LV_STATE_DISABLED, colors.disabled);
+     lv_style_set_radius(&set.btn, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
+     lv_style_set_text_color(&set.btn, LV_STATE_DEFAULT, COLOR_WHITE);
+     lv_style_set_text_color(&set.btn, LV_STATE_DISABLED, lv_color_mix(COLOR_WHITE, colors.disabled, 180));
+     lv_style_set_pad_top(&set.btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING);
+     lv_style_set_pad_bottom(&set.btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING);
+     lv_style_set_pad_left(&set.btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING * 2);
+     lv_style_set_pad_right(&set.btn, LV_STATE_DEFAULT, TDECK_UI_BUTTON_PADDING * 2);
+     
+     // Secondary button style, overrides the primary color
+     lv_style_init(&set.btn_secondary);
+     lv_style_set_bg_color(&set.btn_secondary, LV_STATE_DEFAULT, colors.secondary);
      
      // Button pressed style
-     lv_style_init(&style_btn_pressed);
-     lv_style_set_bg_color(&style_btn_pressed, LV_STATE_PRESSED, COLOR_DARK_BLUE);
+     lv_style_init(&set.btn_pressed);
+     lv_style_set_bg_color(&set.btn_pressed, LV_STATE_PRESSED, COLOR_DARK_BLUE);
      
      // Toggle button style
-     lv_style_init(&style_btn_toggle);
-     lv_style_set_bg_color(&style_btn_toggle, LV_STATE_CHECKED, colors.secondary);
+     lv_style_init(&set.btn_toggle);
+     lv_style_set_bg_color(&set.btn_toggle, LV_STATE_CHECKED, colors.secondary);
      
      // Title text style
-     lv_style_init(&style_title);
-     lv_style_set_text_color(&style_title, LV_STATE_DEFAULT, colors.text);
-     lv_style_set_text_font(&style_title, LV_STATE_DEFAULT, &lv_font_montserrat_24);
+     lv_style_init(&set.title);
+     lv_style_set_text_color(&set.title, LV_STATE_DEFAULT, colors.text);
+     lv_style_set_text_font(&set.title, LV_STATE_DEFAULT, assets.getFont("montserrat_24"));
      
      // Normal text style
-     lv_style_init(&style_text);
-     lv_style_set_text_color(&style_text, LV_STATE_DEFAULT, colors.text);
-     lv_style_set_text_font(&style_text, LV_STATE_DEFAULT, &lv_font_montserrat_14);
+     lv_style_init(&set.text);
+     lv_style_set_text_color(&set.text, LV_STATE_DEFAULT, colors.text);
+     lv_style_set_text_font(&set.text, LV_STATE_DEFAULT, &lv_font_montserrat_14);
      
      // Secondary text style
-     lv_style_init(&style_text_secondary);
-     lv_style_set_text_color(&style_text_secondary, LV_STATE_DEFAULT, colors.text_secondary);
-     lv_style_set_text_font(&style_text_secondary, LV_STATE_DEFAULT, &lv_font_montserrat_14);
+     lv_style_init(&set.text_secondary);
+     lv_style_set_text_color(&set.text_secondary, LV_STATE_DEFAULT, colors.text_secondary);
+     lv_style_set_text_font(&set.text_secondary, LV_STATE_DEFAULT, &lv_font_montserrat_14);
      
      // Text field style
-     lv_style_init(&style_textfield);
-     lv_style_set_bg_color(&style_textfield, LV_STATE_DEFAULT, lv_color_mix(colors.bg, colors.surface, 128));
-     lv_style_set_bg_opa(&style_textfield, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_border_color(&style_textfield, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_border_width(&style_textfield, LV_STATE_DEFAULT, 1);
-     lv_style_set_radius(&style_textfield, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
-     lv_style_set_pad_top(&style_textfield, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_bottom(&style_textfield, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_left(&style_textfield, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_right(&style_textfield, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.textfield);
+     lv_style_set_bg_color(&set.textfield, LV_STATE_DEFAULT, lv_color_mix(colors.bg, colors.surface, 128));
+     lv_style_set_bg_opa(&set.textfield, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_border_color(&set.textfield, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_border_width(&set.textfield, LV_STATE_DEFAULT, 1);
+     lv_style_set_radius(&set.textfield, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
+     lv_style_set_pad_top(&set.textfield, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_bottom(&set.textfield, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_left(&set.textfield, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_right(&set.textfield, LV_STATE_DEFAULT, 10);
      
      // Text field focused style
-     lv_style_init(&style_textfield_focused);
-     lv_style_set_border_color(&style_textfield_focused, LV_STATE_FOCUSED, colors.primary);
-     lv_style_set_border_width(&style_textfield_focused, LV_STATE_FOCUSED, 2);
+     lv_style_init(&set.textfield_focused);
+     lv_style_set_border_color(&set.textfield_focused, LV_STATE_FOCUSED, colors.primary);
+     lv_style_set_border_width(&set.textfield_focused, LV_STATE_FOCUSED, 2);
      
      // Switch style
-     lv_style_init(&style_switch);
-     lv_style_set_bg_color(&style_switch, LV_STATE_DEFAULT, colors.bg_alt);
-     lv_style_set_bg_color(&style_switch, LV_STATE_CHECKED, colors.primary);
+     lv_style_init(&set.switch_bg);
+     lv_style_set_bg_color(&set.switch_bg, LV_STATE_DEFAULT, colors.bg_alt);
+     lv_style_set_bg_color(&set.switch_bg, LV_STATE_CHECKED, colors.primary);
      
      // Slider style
-     lv_style_init(&style_slider);
-     lv_style_set_bg_color(&style_slider, LV_STATE_DEFAULT, colors.bg_alt);
-     lv_style_set_bg_color(&style_slider, LV_STATE_EDITED, colors.primary);
+     lv_style_init(&set.slider);
+     lv_style_set_bg_color(&set.slider, LV_STATE_DEFAULT, colors.bg_alt);
+     lv_style_set_bg_color(&set.slider, LV_STATE_EDITED, colors.primary);
+     
+     // Slider indicator and knob styles
+     lv_style_init(&set.slider_indic);
+     lv_style_set_bg_color(&set.slider_indic, LV_STATE_DEFAULT, colors.primary);
+     lv_style_init(&set.slider_knob);
+     lv_style_set_bg_color(&set.slider_knob, LV_STATE_DEFAULT, lv_color_darken(colors.primary, LV_OPA_20));
      
      // List style
-     lv_style_init(&style_list);
-     lv_style_set_bg_color(&style_list, LV_STATE_DEFAULT, colors.surface);
-     lv_style_set_border_color(&style_list, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_border_width(&style_list, LV_STATE_DEFAULT, 1);
-     lv_style_set_radius(&style_list, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
-     lv_style_set_pad_inner(&style_list, LV_STATE_DEFAULT, 5);
+     lv_style_init(&set.list);
+     lv_style_set_bg_color(&set.list, LV_STATE_DEFAULT, colors.surface);
+     lv_style_set_border_color(&set.list, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_border_width(&set.list, LV_STATE_DEFAULT, 1);
+     lv_style_set_radius(&set.list, LV_STATE_DEFAULT, TDECK_UI_DEFAULT_CORNER_RADIUS);
+     lv_style_set_pad_inner(&set.list, LV_STATE_DEFAULT, 5);
      
      // List item style
-     lv_style_init(&style_list_item);
-     lv_style_set_bg_color(&style_list_item, LV_STATE_DEFAULT, colors.surface);
-     lv_style_set_bg_color(&style_list_item, LV_STATE_PRESSED, lv_color_mix(colors.surface, colors.primary, 230));
-     lv_style_set_bg_color(&style_list_item, LV_STATE_FOCUSED, lv_color_mix(colors.surface, colors.primary, 230));
-     lv_style_set_text_color(&style_list_item, LV_STATE_DEFAULT, colors.text);
-     lv_style_set_border_width(&style_list_item, LV_STATE_DEFAULT, 0);
-     lv_style_set_border_width(&style_list_item, LV_STATE_FOCUSED, 0);
-     lv_style_set_pad_top(&style_list_item, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_bottom(&style_list_item, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_left(&style_list_item, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_right(&style_list_item, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.list_item);
+     lv_style_set_bg_color(&set.list_item, LV_STATE_DEFAULT, colors.surface);
+     lv_style_set_bg_color(&set.list_item, LV_STATE_PRESSED, lv_color_mix(colors.surface, colors.primary, 230));
+     lv_style_set_bg_color(&set.list_item, LV_STATE_FOCUSED, lv_color_mix(colors.surface, colors.primary, 230));
+     lv_style_set_text_color(&set.list_item, LV_STATE_DEFAULT, colors.text);
+     lv_style_set_border_width(&set.list_item, LV_STATE_DEFAULT, 0);
+     lv_style_set_border_width(&set.list_item, LV_STATE_FOCUSED, 0);
+     lv_style_set_pad_top(&set.list_item, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_bottom(&set.list_item, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_left(&set.list_item, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_right(&set.list_item, LV_STATE_DEFAULT, 10);
      
      // Dropdown style
-     lv_style_init(&style_dropdown);
-     lv_style_set_bg_color(&style_dropdown, LV_STATE_DEFAULT, colors.surface);
-     lv_style_set_bg_opa(&style_dropdown, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_border_color(&style_dropdown, LV_STATE_DEFAULT, colors.border);
-     lv_style_set_border_width(&style_dropdown, LV_STATE_DEFAULT, 1);
-     lv_style_set_text_color(&style_dropdown, LV_STATE_DEFAULT, colors.text);
-     lv_style_set_pad_top(&style_dropdown, LV_STATE_DEFAULT, 8);
-     lv_style_set_pad_bottom(&style_dropdown, LV_STATE_DEFAULT, 8);
-     lv_style_set_pad_left(&style_dropdown, LV_STATE_DEFAULT, 10);
-     lv_style_set_pad_right(&style_dropdown, LV_STATE_DEFAULT, 10);
+     lv_style_init(&set.dropdown);
+     lv_style_set_bg_color(&set.dropdown, LV_STATE_DEFAULT, colors.surface);
+     lv_style_set_bg_opa(&set.dropdown, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_border_color(&set.dropdown, LV_STATE_DEFAULT, colors.border);
+     lv_style_set_border_width(&set.dropdown, LV_STATE_DEFAULT, 1);
+     lv_style_set_text_color(&set.dropdown, LV_STATE_DEFAULT, colors.text);
+     lv_style_set_pad_top(&set.dropdown, LV_STATE_DEFAULT, 8);
+     lv_style_set_pad_bottom(&set.dropdown, LV_STATE_DEFAULT, 8);
+     lv_style_set_pad_left(&set.dropdown, LV_STATE_DEFAULT, 10);
+     lv_style_set_pad_right(&set.dropdown, LV_STATE_DEFAULT, 10);
      
      // Status bar style
-     lv_style_init(&style_status_bar);
-     lv_style_set_bg_color(&style_status_bar, LV_STATE_DEFAULT, colors.primary);
-     lv_style_set_bg_opa(&style_status_bar, LV_STATE_DEFAULT, LV_OPA_COVER);
-     lv_style_set_text_color(&style_status_bar, LV_STATE_DEFAULT, COLOR_WHITE);
-     lv_style_set_pad_top(&style_status_bar, LV_STATE_DEFAULT, 2);
-     lv_style_set_pad_bottom(&style_status_bar, LV_STATE_DEFAULT, 2);
-     lv_style_set_pad_left(&style_status_bar, LV_STATE_DEFAULT, 5);
-     lv_style_set_pad_right(&style_status_bar, LV_STATE_DEFAULT, 5);
+     lv_style_init(&set.status_bar);
+     lv_style_set_bg_color(&set.status_bar, LV_STATE_DEFAULT, colors.primary);
+     lv_style_set_bg_opa(&set.status_bar, LV_STATE_DEFAULT, LV_OPA_COVER);
+     lv_style_set_text_color(&set.status_bar, LV_STATE_DEFAULT, COLOR_WHITE);
+     lv_style_set_pad_top(&set.status_bar, LV_STATE_DEFAULT, 2);
+     lv_style_set_pad_bottom(&set.status_bar, LV_STATE_DEFAULT, 2);
+     lv_style_set_pad_left(&set.status_bar, LV_STATE_DEFAULT, 5);
+     lv_style_set_pad_right(&set.status_bar, LV_STATE_DEFAULT, 5);
  }
  
  // Apply functions for different UI elements
  
  void Theme::applyStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_OBJ_PART_MAIN, &style_bg);
+     lv_obj_add_style(obj, LV_OBJ_PART_MAIN, &active.bg);
  }
  
  void Theme::applyCardStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_OBJ_PART_MAIN, &style_card);
+     lv_obj_add_style(obj, LV_OBJ_PART_MAIN, &active.card);
  }
  
  void Theme::applyButtonStyle(lv_obj_t* obj, bool isPrimary) {
-     lv_obj_add_style(obj, LV_BTN_PART_MAIN, &style_btn);
-     lv_obj_add_style(obj, LV_BTN_PART_MAIN, &style_btn_pressed);
+     lv_obj_add_style(obj, LV_BTN_PART_MAIN, &active.btn);
      
      if (!isPrimary) {
          // For secondary buttons, override primary color with secondary color
-         lv_obj_set_style_local_bg_color(obj, LV_BTN_PART_MAIN, LV_STATE_DEFAULT, colors.secondary);
+         lv_obj_add_style(obj, LV_BTN_PART_MAIN, &active.btn_secondary);
      }
+     
+     lv_obj_add_style(obj, LV_BTN_PART_MAIN, &active.btn_pressed);
  }
  
  void Theme::applyTitleStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_LABEL_PART_MAIN, &style_title);
+     lv_obj_add_style(obj, LV_LABEL_PART_MAIN, &active.title);
  }
  
  void Theme::applyTextFieldStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_TEXTAREA_PART_BG, &style_textfield);
-     lv_obj_add_style(obj, LV_TEXTAREA_PART_BG, &style_textfield_focused);
+     lv_obj_add_style(obj, LV_TEXTAREA_PART_BG, &active.textfield);
+     lv_obj_add_style(obj, LV_TEXTAREA_PART_BG, &active.textfield_focused);
  }
  
  void Theme::applySwitchStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_SWITCH_PART_BG, &style_switch);
+     lv_obj_add_style(obj, LV_SWITCH_PART_BG, &active.switch_bg);
  }
  
  void Theme::applySliderStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_SLIDER_PART_BG, &style_slider);
-     lv_obj_add_style(obj, LV_SLIDER_PART_INDIC, &style_slider);
+     lv_obj_add_style(obj, LV_SLIDER_PART_BG, &active.slider);
+     lv_obj_add_style(obj, LV_SLIDER_PART_INDIC, &active.slider);
      
      // Apply primary color to indicator
-     lv_obj_set_style_local_bg_color(obj, LV_SLIDER_PART_INDIC, LV_STATE_DEFAULT, colors.primary);
+     lv_obj_add_style(obj, LV_SLIDER_PART_INDIC, &active.slider_indic);
      
      // Apply darker color to knob
-     lv_obj_set_style_local_bg_color(obj, LV_SLIDER_PART_KNOB, LV_STATE_DEFAULT, 
-         lv_color_darken(colors.primary, LV_OPA_20));
+     lv_obj_add_style(obj, LV_SLIDER_PART_KNOB, &active.slider_knob);
  }
  
  void Theme::applyListStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_LIST_PART_BG, &style_list);
+     lv_obj_add_style(obj, LV_LIST_PART_BG, &active.list);
  }
  
  void Theme::applyListItemStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_BTN_PART_MAIN, &style_list_item);
+     lv_obj_add_style(obj, LV_BTN_PART_MAIN, &active.list_item);
  }
  
  void Theme::applyDropdownStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_DROPDOWN_PART_MAIN, &style_dropdown);
+     lv_obj_add_style(obj, LV_DROPDOWN_PART_MAIN, &active.dropdown);
  }
  
  void Theme::applyStatusBarStyle(lv_obj_t* obj) {
-     lv_obj_add_style(obj, LV_OBJ_PART_MAIN, &style_status_bar);
+     lv_obj_add_style(obj, LV_OBJ_PART_MAIN, &active.status_bar);
  }
\ No newline at end of file
@@ -40,6 +40,27 @@
      lv_color_t error;        // Error indicator color
  } ThemeColors;
  
+ /**
+  * @brief Swap a group of active styles to a prebuilt set
+  * 
+  * The active styles take over the property maps of the set, so objects
+  * keep their style pointers and nothing is allocated. Only the styles
+  * marked in changed are reported to LVGL, the rest look the same in
+  * both themes.
+  * 
+  * @param active Styles objects refer to, never modified directly
+  * @param set Prebuilt styles of the new theme
+  * @param count Number of styles
+  * @param changed Bit i set if style i differs between the themes
+  */
+ void themeSwapStyles(lv_style_t* active, const lv_style_t* set, size_t count, uint32_t changed);
+ 
+ /**
+  * @brief Find the styles that differ between two prebuilt sets
+  * @return Bit i set if style i differs
+  */
+ uint32_t themeDiffStyles(const lv_style_t* a, const lv_style_t* b, size_t count);
+ 
  /**
   * @class Theme
   * @brief Manages UI themes for the T-Deck
@@ -78,6 +99,13 @@
       */
      const ThemeColors& getColors() const;
      
+     /**
+      * @brief Get the colors of a theme
+      * @param type The theme type
+      * @return Reference to the constant palette of the theme
+      */
+     static const ThemeColors& getPalette(ThemeType type);
+     
      /**
       * @brief Apply default style to a widget
       * @param obj The LVGL object to style
@@ -146,36 +174,42 @@
      void applyStatusBarStyle(lv_obj_t* obj);
  
  private:
-     /**
-      * @brief Initialize theme styles
-      */
-     void initStyles();
-     
-     /**
-      * @brief Update theme colors based on the current theme type
-      */
-     void updateColors();
+     // Basic styles, only lv_style_t members so a set can be walked as an array
+     struct StyleSet {
+         lv_style_t bg;            // Background style
+         lv_style_t card;          // Card style
+         lv_style_t btn;           // Button style
+         lv_style_t btn_secondary; // Secondary button color
+         lv_style_t btn_pressed;   // Pressed button style
+         lv_style_t btn_toggle;    // Toggle button style
+         lv_style_t title;         // Title text style
+         lv_style_t text;          // Normal text style
+         lv_style_t text_secondary; // Secondary text style
+         lv_style_t textfield_focused; // Focused text field style
+         lv_style_t textfield;     // Normal text field style
+         lv_style_t switch_bg;     // Switch style
+         lv_style_t slider;        // Slider style
+         lv_style_t slider_indic;  // Slider indicator color
+         lv_style_t slider_knob;   // Slider knob color
+         lv_style_t list;          // List style
+         lv_style_t list_item;     // List item style
+         lv_style_t dropdown;      // Dropdown style
+         lv_style_t status_bar;    // Status bar style
+     };
+     static const size_t STYLE_COUNT = sizeof(StyleSet) / sizeof(lv_style_t);
+     
+     /**
+      * @brief Build the styles of one theme
+      * @param set Styles to initialize
+      * @param colors Palette of the theme
+      */
+     static void buildStyles(StyleSet& set, const ThemeColors& colors);
  
      ThemeType currentTheme;       // Current theme type
-     ThemeColors colors;           // Current theme colors
-     
-     // Basic styles
-     lv_style_t style_bg;          // Background style
-     lv_style_t style_card;        // Card style
-     lv_style_t style_btn;         // Button style
-     lv_style_t style_btn_pressed; // Pressed button style
-     lv_style_t style_btn_toggle;  // Toggle button style
-     lv_style_t style_title;       // Title text style
-     lv_style_t style_text;        // Normal text style
-     lv_style_t style_text_secondary; // Secondary text style
-     lv_style_t style_textfield_focused; // Focused text field style
-     lv_style_t style_textfield;   // Normal text field style
-     lv_style_t style_switch;      // Switch style
-     lv_style_t style_slider;      // Slider style
-     lv_style_t style_list;        // List style
-     lv_style_t style_list_item;   // List item style
-     lv_style_t style_dropdown;    // Dropdown style
-     lv_style_t style_status_bar;  // Status bar style
+     bool initialized;             // Both sets built
+     StyleSet active;              // Styles objects refer to, share the maps of one set
+     StyleSet sets[2];             // Prebuilt light and dark styles
+     uint32_t changed;             // Styles that differ between the sets
  };
  
  // Global theme instance
@@ -5,11 +5,22 @@
 
  #include "ui_manager.h"
  #include "../apps/app_base.h"
+ #include "../apps/launcher.h"
+ #include "lv_alloc.h"
  #include <ctime>
  
  // Global UI manager instance
  UIManager uiManager;
  
+ // Shown whenever no app is in the foreground
+ extern Launcher launcher;
+ 
+ // Work item queued by postWork()
+ typedef struct {
+     UIWorkCallback callback;
+     void* arg;
+ } UIWorkItem;
+ 
  // Forward declaration of callback for dialog
  static void dialogButtonCallback(lv_obj_t* obj, lv_event_t event);
  
@@ -26,14 +37,29 @@
      btIcon(NULL),
      loraIcon(NULL),
      clockLabel(NULL),
+     shownWiFi(false),
+     shownBluetooth(false),
+     shownLoRa(false),
+     shownCharging(false),
+     shownMinute(-1),
+     nextClockCheck(0),
      currentApp(NULL),
-     currentTheme(THEME_LIGHT) {
+     currentTheme(THEME_LIGHT),
+     uiTask(NULL),
+     workQueue(NULL) {
      // Constructor initializes pointers to NULL
  }
  
  bool UIManager::init() {
      TDECK_LOG_I("Initializing UI Manager");
      
+     // Create the queue other tasks use to post UI work
+     workQueue = xQueueCreate(TDECK_UI_WORK_QUEUE_SIZE, sizeof(UIWorkItem));
+     if (!workQueue) {
+         TDECK_LOG_E("Failed to create UI work queue");
+         return false;
+     }
+     
      // Initialize themes and styles
      theme.init();
      styles.init();
@@ -75,32 +101,65 @@
  }
  
  void UIManager::showApp(AppBase* app) {
-     if (!app) return;
+     if (!app || app == currentApp) return;
      
-     // Hide current app if exists
+     // Pause current app, it stays warm until it falls out of the recent list
      if (currentApp) {
-         currentApp->hide();
+         currentApp->pause();
      }
      
-     // Set and show new app
+     // Move the app to the front of the recent list
+     for (auto it = recentApps.begin(); it != recentApps.end(); ++it) {
+         if (*it == app) {
+             recentApps.erase(it);
+             break;
+         }
+     }
+     recentApps.insert(recentApps.begin(), app);
      currentApp = app;
-     currentApp->show();
+     
+     // Free the screens of older apps before building the new one
+     trimApps();
+     
+     if (!currentApp->resume(mainScreen)) {
+         recentApps.erase(recentApps.begin());
+         currentApp = NULL;
+         showNotification("Not enough memory to open app", NOTIFICATION_ERROR);
+         showLauncher();
+         return;
+     }
      
      TDECK_LOG_I("Showing app: %s", app->getName());
  }
  
  void UIManager::showLauncher() {
-     // Implemented when Launcher class is built
-     // This will be used to return to the home screen
      TDECK_LOG_I("Returning to launcher");
      
      if (currentApp) {
-         currentApp->hide();
+         currentApp->pause();
          currentApp = NULL;
      }
      
-     // This will be properly implemented when launcher is built
-     // launcher.show();
+     trimApps();
+     launcher.start();
+ }
+ 
+ void UIManager::trimApps() {
+     // The foreground app is always first in the recent list
+     size_t keep = TDECK_UI_WARM_APPS + (currentApp ? 1 : 0);
+     
+     // Short on LVGL heap, keep only the foreground app
+     if (tdeck_lv_get_available() < TDECK_UI_APP_MIN_FREE_MEM) {
+         keep = currentApp ? 1 : 0;
+     }
+     
+     while (recentApps.size() > keep) {
+         AppBase* app = recentApps.back();
+         recentApps.pop_back();
+         
+         TDECK_LOG_I("Destroying app: %s", app->getName());
+         app->destroy();
+     }
  }
  
  void UIManager::registerApp(AppBase* app) {
@@ -335,67 +394,56 @@
  }
  
  void UIManager::updateWiFiStatus(bool connected, uint8_t strength) {
-     if (!wifiIcon) return;
-     
-     // Set proper icon based on state
-     if (connected) {
-         // Here you would set different icon symbols based on strength
-         // For simplicity, just showing connected vs not connected
-         // In a real implementation you'd use different icons for signal levels
-         lv_obj_set_hidden(wifiIcon, false);
-     } else {
-         // Not connected
-         lv_obj_set_hidden(wifiIcon, true);
-     }
+     launcher.updateWiFiStatus(connected);
+     if (!wifiIcon || connected == shownWiFi) return;
+     
+     // Signal strength is not shown, so it does not count as a change
+     lv_obj_set_hidden(wifiIcon, !connected);
+     shownWiFi = connected;
  }
  
  void UIManager::updateBluetoothStatus(bool active, bool connected) {
-     if (!btIcon) return;
+     launcher.updateBluetoothStatus(active);
+     if (!btIcon || active == shownBluetooth) return;
      
-     // Set proper icon visibility based on state
-     if (active) {
-         lv_obj_set_hidden(btIcon, false);
-     } else {
-         lv_obj_set_hidden(btIcon, true);
-     }
+     lv_obj_set_hidden(btIcon, !active);
+     shownBluetooth = active;
  }
  
  void UIManager::updateLoRaStatus(bool active, uint8_t signal) {
-     if (!loraIcon) return;
+     if (!loraIcon || active == shownLoRa) return;
      
-     // Set proper icon visibility based on state
-     if (active) {
-         lv_obj_set_hidden(loraIcon, false);
-     } else {
-         lv_obj_set_hidden(loraIcon, true);
-     }
+     lv_obj_set_hidden(loraIcon, !active);
+     shownLoRa = active;
  }
  
  void UIManager::updateBatteryStatus(uint8_t percentage, bool charging) {
-     if (!batteryIcon || !chargingIcon) return;
-     
-     // Update battery icon level
-     // Here you would adjust the battery icon appearance
-     // based on percentage
+     launcher.updateBatteryStatus(percentage);
+     if (!batteryIcon || !chargingIcon || charging == shownCharging) return;
      
      // Show/hide charging icon
      lv_obj_set_hidden(chargingIcon, !charging);
+     shownCharging = charging;
  }
  
  void UIManager::updateClock(uint8_t hour, uint8_t minute) {
-     if (!clockLabel) return;
+     launcher.updateClock(hour, minute);
+     int16_t minuteOfDay = hour * 60 + minute;
+     if (!clockLabel || minuteOfDay == shownMinute) return;
      
      // Format and update clock display
      char timeStr[6]; // HH:MM\0
      snprintf(timeStr, sizeof(timeStr), "%02d:%02d", hour, minute);
      lv_label_set_text(clockLabel, timeStr);
+     shownMinute = minuteOfDay;
  }
  
  void UIManager::toggleTheme() {
      // Toggle between light and dark themes
      currentTheme = (currentTheme == THEME_LIGHT) ? THEME_DARK : THEME_LIGHT;
      
-     // Update theme and styles
+     // Swap both style groups to their prebuilt sets, LVGL refreshes only
+     // the objects using a style that differs, all in the next frame
      theme.setTheme(currentTheme);
      styles.updateForTheme(currentTheme);
      
@@ -441,20 +489,54 @@
  }
  
  void UIManager::update() {
-     // Update clock every minute
-     static uint32_t lastClockUpdate = 0;
+     // Update the clock on each minute boundary, not once per call
      uint32_t currentTime = millis();
      
-     if (currentTime - lastClockUpdate > 60000) { // Update clock every minute
+     if ((int32_t)(currentTime - nextClockCheck) >= 0) {
          // Get current time
          time_t now = time(NULL);
          struct tm* timeinfo = localtime(&now);
          
          updateClock(timeinfo->tm_hour, timeinfo->tm_min);
-         lastClockUpdate = currentTime;
+         nextClockCheck = currentTime + (60 - timeinfo->tm_sec) * 1000;
+     }
+     
+     // Run work posted from other tasks
+     processWork();
+ }
+ 
+ void UIManager::setUITask(TaskHandle_t task) {
+     uiTask = task;
+ }
+ 
+ bool UIManager::postWork(UIWorkCallback callback, void* arg, TickType_t wait) {
+     if (!workQueue || !callback) {
+         return false;
      }
      
-     // Other periodic UI updates can go here
+     UIWorkItem item = {callback, arg};
+     if (xQueueSend(workQueue, &item, wait) != pdTRUE) {
+         TDECK_LOG_E("UI work queue full");
+         return false;
+     }
+     
+     // Wake the UI task so the work runs without waiting for a timer
+     if (uiTask) {
+         xTaskNotify(uiTask, TDECK_UI_NOTIFY_WORK, eSetBits);
+     }
+     
+     return true;
+ }
+ 
+ void UIManager::processWork() {
+     if (!workQueue) {
+         return;
+     }
+     
+     UIWorkItem item;
+     while (xQueueReceive(workQueue, &item, 0) == pdTRUE) {
+         item.callback(item.arg);
+     }
  }
  
  void UIManager::initStatusBar() {
@@ -21,6 +21,9 @@
  // Forward declarations
  class AppBase;
  
+ // Work item callback executed on the UI task
+ typedef void (*UIWorkCallback)(void* arg);
+ 
  /**
   * @brief UI notification type
   */
@@ -64,13 +67,17 @@
      lv_obj_t* getContentArea();
      
      /**
-      * @brief Show a specific app screen
+      * @brief Bring an app to the foreground
+      * 
+      * The previous app is paused. Apps beyond the TDECK_UI_WARM_APPS most
+      * recently shown are destroyed before the new screen is built, so the
+      * LVGL heap holds the foreground app and a few warm ones at most.
       * @param app Pointer to the app to display
       */
      void showApp(AppBase* app);
      
      /**
-      * @brief Return to the launcher screen
+      * @brief Pause the foreground app and return to the launcher screen
       */
      void showLauncher();
      
@@ -102,6 +109,11 @@
      
      /**
       * @brief Update WiFi status icon
+      *
+      * The status updates are pushed when a value changes and mirrored to
+      * the launcher's status bar. Each touches, and so redraws, only its own
+      * icon, and only if what it shows actually changed.
+      *
       * @param connected Whether WiFi is connected
       * @param strength WiFi signal strength (0-100)
       */
@@ -162,6 +174,24 @@
       * This should be called regularly from the UI task
       */
      void update();
+     
+     /**
+      * @brief Set the task that runs LVGL and services posted work
+      * @param task UI task handle
+      */
+     void setUITask(TaskHandle_t task);
+     
+     /**
+      * @brief Run a function on the UI task and wake it
+      * 
+      * LVGL is not thread safe, other tasks use this to touch UI objects.
+      * Never wait from the UI task itself, it is the one emptying the queue.
+      * @param callback Function to run on the UI task
+      * @param arg Argument passed to the callback
+      * @param wait Ticks to wait for room when the queue is full
+      * @return true if the work was queued
+      */
+     bool postWork(UIWorkCallback callback, void* arg, TickType_t wait = 0);
  
  private:
      /**
@@ -179,6 +209,16 @@
       * @param timer LVGL timer instance
       */
      static void hideNotificationCallback(lv_timer_t* timer);
+     
+     /**
+      * @brief Run all work items posted from other tasks
+      */
+     void processWork();
+     
+     /**
+      * @brief Destroy the least recently shown apps beyond the warm limit
+      */
+     void trimApps();
  
      // LVGL objects
      lv_obj_t* mainScreen;       // Main screen object
@@ -196,12 +236,25 @@
      lv_obj_t* loraIcon;         // LoRa status indicator
      lv_obj_t* clockLabel;       // Clock display
      
+     // Status shown in the status bar, starting as created
+     bool shownWiFi;
+     bool shownBluetooth;
+     bool shownLoRa;
+     bool shownCharging;
+     int16_t shownMinute;        // Minute of the day on the clock, -1 before the first update
+     uint32_t nextClockCheck;    // millis() of the next minute boundary
+     
      // App management
      std::vector<AppBase*> registeredApps; // List of registered applications
      AppBase* currentApp;        // Currently active app
+     std::vector<AppBase*> recentApps; // Created apps, most recently shown first
      
      // Theme state
      ThemeType currentTheme;     // Current theme type
+     
+     // Cross-task work
+     TaskHandle_t uiTask;        // Task woken when work is posted
+     QueueHandle_t workQueue;    // Pending UIWorkItem entries
  };
  
  // Global UI manager instance
@@ -0,0 +1,105 @@
+/**
+ * @file bench_timing.h
+ * @brief Timing and reporting helpers of the on-device benchmarks
+ *
+ * Every result goes out as one line a script can pick from the serial log:
+ *
+ *   BENCH,<firmware version>,<name>,<value>,<unit>
+ *
+ * tools/bench_report.py collects these lines and compares two runs.
+ */
+
+ #ifndef TDECK_TEST_BENCH_TIMING_H
+ #define TDECK_TEST_BENCH_TIMING_H
+
+ #include <Arduino.h>
+ #include <esp_timer.h>
+ #include "config.h"
+
+ /**
+  * @brief Microsecond stopwatch on esp_timer
+  */
+ class BenchTimer {
+ public:
+     BenchTimer() : _start(esp_timer_get_time()) {}
+
+     /**
+      * @brief Restart the stopwatch
+      */
+     void restart() {
+         _start = esp_timer_get_time();
+     }
+
+     /**
+      * @brief Get the time since construction or the last restart()
+      * @return Elapsed microseconds
+      */
+     int64_t elapsedUs() const {
+         return esp_timer_get_time() - _start;
+     }
+
+ private:
+     int64_t _start;
+ };
+
+ /**
+  * @brief Latency samples of a repeated operation
+  */
+ struct BenchStats {
+     uint32_t runs;      // Samples taken
+     int64_t totalUs;    // Sum of the samples
+     int64_t minUs;      // Fastest sample
+     int64_t maxUs;      // Slowest sample
+
+     BenchStats() : runs(0), totalUs(0), minUs(INT64_MAX), maxUs(0) {}
+
+     void add(int64_t us) {
+         runs++;
+         totalUs += us;
+         minUs = min(minUs, us);
+         maxUs = max(maxUs, us);
+     }
+
+     double meanUs() const {
+         return runs ? (double)totalUs / runs : 0.0;
+     }
+ };
+
+ /**
+  * @brief Print one machine-readable result line
+  * @param name Dotted benchmark name, e.g. "sd.seq_read"
+  * @param value Measured value
+  * @param unit Unit of the value
+  */
+ inline void benchReport(const char* name, double value, const char* unit) {
+     TDECK_DEBUG_SERIAL.printf("BENCH,%s,%s,%.3f,%s\n", TDECK_FIRMWARE_VERSION, name, value, unit);
+ }
+
+ /**
+  * @brief Print the mean, min and max of latency samples as name.mean/.min/.max in microseconds
+  */
+ inline void benchReportLatency(const char* name, const BenchStats& stats) {
+     char key[64];
+     snprintf(key, sizeof(key), "%s.mean", name);
+     benchReport(key, stats.meanUs(), "us");
+     snprintf(key, sizeof(key), "%s.min", name);
+     benchReport(key, (double)stats.minUs, "us");
+     snprintf(key, sizeof(key), "%s.max", name);
+     benchReport(key, (double)stats.maxUs, "us");
+ }
+
+ /**
+  * @brief Convert bytes moved in a time to MB/s (10^6 bytes)
+  */
+ inline double benchMBps(uint64_t bytes, int64_t us) {
+     return us > 0 ? (double)bytes / (double)us : 0.0;
+ }
+
+ /**
+  * @brief Convert operations done in a time to operations per second
+  */
+ inline double benchPerSecond(uint64_t ops, int64_t us) {
+     return us > 0 ? (double)ops * 1000000.0 / (double)us : 0.0;
+ }
+
+ #endif // TDECK_TEST_BENCH_TIMING_H
@@ -0,0 +1,484 @@
+/**
+ * @file test_main.cpp
+ * @brief On-device benchmarks of the firmware hot paths
+ *
+ * Run with `pio test -e tdeck-bench`. Each test brings up only what it
+ * measures and prints its results through benchReport(). Tests that need an
+ * SD card or a LoRa peer are ignored when there is none. The SD tests work
+ * under /sd/bench, the listing fixtures there are created on the first run
+ * and reused afterwards.
+ */
+
+ #include <Arduino.h>
+ #include <unity.h>
+ #include <lvgl.h>
+ #include <ArduinoJson.h>
+ #include "bench_timing.h"
+ #include "config.h"
+ #include "hal/spi_bus.h"
+ #include "hal/display.h"
+ #include "hal/sdcard.h"
+ #include "hal/audio.h"
+ #include "hal/audio_dsp.h"
+ #include "system/fs_manager.h"
+ #include "system/config_storage.h"
+ #include "comms/lora.h"
+ #include "comms/lora_codec.h"
+
+ #define BENCH_DIR "/sd/bench"
+ #define BENCH_FILE BENCH_DIR "/io.bin"
+ #define BENCH_FILE_SIZE (4 * 1024 * 1024)   // Sequential transfer size
+ #define BENCH_IO_CHUNK 16384                // Bytes per sequential read or write call
+ #define BENCH_RANDOM_BLOCK 4096             // Bytes per random read or write
+ #define BENCH_RANDOM_OPS 256                // Random operations per pass
+ #define BENCH_FLUSH_FRAMES 50               // Full screens pushed by the flush benchmark
+ #define BENCH_CODEC_RUNS 10000              // Encode/decode iterations
+ #define BENCH_CONFIG_RUNS 20                // Config load/save iterations
+ #define BENCH_DSP_RUNS 200                  // DSP buffers processed per benchmark
+ #define BENCH_LORA_TIMEOUT_MS 300000        // Longest the ping benchmark may take
+
+ // Peer answering the LoRa ping benchmark, 0 skips it
+ #ifndef TDECK_BENCH_LORA_PEER
+ #define TDECK_BENCH_LORA_PEER 0
+ #endif
+
+ static bool sdReady = false;
+ static uint8_t* ioBuffer = nullptr;
+
+ // Fill a buffer with a pattern that does not compress to nothing
+ static void fillPattern(uint8_t* buffer, size_t size, uint32_t seed) {
+     for (size_t i = 0; i < size; i++) {
+         seed = seed * 1664525 + 1013904223;
+         buffer[i] = seed >> 24;
+     }
+ }
+
+ // Skip a test that needs the SD card when none is mounted
+ static bool requireSd() {
+     if (!sdReady) {
+         TEST_IGNORE_MESSAGE("No SD card");
+         return false;
+     }
+     return true;
+ }
+
+ // Push full screens through the LVGL flush callback, DMA or blocking as configured
+ void test_display_flush() {
+     static lv_disp_draw_buf_t drawBuf;
+     static lv_disp_drv_t drv;
+
+     TEST_ASSERT_TRUE(display.init());
+     lv_init();
+     TEST_ASSERT_TRUE(display.initDrawBuffers(&drawBuf));
+     lv_disp_drv_init(&drv);
+     drv.flush_cb = Display::flush_cb;
+     drv.wait_cb = Display::wait_cb;
+     drv.draw_buf = &drawBuf;
+     drv.hor_res = TDECK_DISPLAY_WIDTH;
+     drv.ver_res = TDECK_DISPLAY_HEIGHT;
+     lv_disp_drv_register(&drv);
+
+     // Alternate the two buffers like LVGL does when it has both
+     lv_color_t* buffers[2] = {(lv_color_t*)drawBuf.buf1, (lv_color_t*)drawBuf.buf2};
+     if (!buffers[1]) {
+         buffers[1] = buffers[0];
+     }
+     uint32_t lines = drawBuf.size / TDECK_DISPLAY_WIDTH;
+     for (lv_color_t* buffer : buffers) {
+         fillPattern((uint8_t*)buffer, lines * TDECK_DISPLAY_WIDTH * sizeof(lv_color_t), (uint32_t)(uintptr_t)buffer);
+     }
+
+     uint64_t pixels = 0;
+     uint32_t strips = 0;
+     BenchTimer timer;
+     for (int frame = 0; frame < BENCH_FLUSH_FRAMES; frame++) {
+         for (uint32_t y = 0; y < TDECK_DISPLAY_HEIGHT; y += lines) {
+             lv_area_t area = {0, (lv_coord_t)y, TDECK_DISPLAY_WIDTH - 1,
+                               (lv_coord_t)min(y + lines, (uint32_t)TDECK_DISPLAY_HEIGHT) - 1};
+             Display::flush_cb(&drv, &area, buffers[strips++ & 1]);
+             pixels += (uint32_t)lv_area_get_size(&area);
+         }
+     }
+     while (display.isFlushPending()) {
+         display.pollFlush();
+     }
+     int64_t us = timer.elapsedUs();
+
+     benchReport("display.flush", (double)pixels / (double)us, "MPixel/s");
+     benchReport("display.frame", (double)us / BENCH_FLUSH_FRAMES / 1000.0, "ms");
+ }
+
+ // Stream a file out and back in through FSStream with its default buffer
+ void test_sd_sequential() {
+     if (!requireSd()) {
+         return;
+     }
+
+     FSStream stream;
+     TEST_ASSERT_TRUE(stream.open(BENCH_FILE, FILE_WRITE));
+     BenchTimer timer;
+     for (size_t done = 0; done < BENCH_FILE_SIZE; done += BENCH_IO_CHUNK) {
+         TEST_ASSERT_EQUAL(BENCH_IO_CHUNK, stream.write(ioBuffer, BENCH_IO_CHUNK));
+     }
+     TEST_ASSERT_TRUE(stream.flush());
+     stream.close();
+     benchReport("sd.seq_write", benchMBps(BENCH_FILE_SIZE, timer.elapsedUs()), "MB/s");
+
+     TEST_ASSERT_TRUE(stream.open(BENCH_FILE, FILE_READ));
+     timer.restart();
+     size_t total = 0;
+     int64_t got;
+     while ((got = stream.read(ioBuffer, BENCH_IO_CHUNK)) > 0) {
+         total += got;
+     }
+     benchReport("sd.seq_read", benchMBps(total, timer.elapsedUs()), "MB/s");
+     stream.close();
+     TEST_ASSERT_EQUAL(BENCH_FILE_SIZE, total);
+ }
+
+ // Unbuffered block-aligned reads and writes at random offsets of the sequential file
+ void test_sd_random() {
+     if (!requireSd()) {
+         return;
+     }
+
+     const uint32_t blocks = BENCH_FILE_SIZE / BENCH_RANDOM_BLOCK;
+     FSStream stream;
+     TEST_ASSERT_TRUE(stream.open(BENCH_FILE, FILE_READ, 0));
+     TEST_ASSERT_EQUAL(BENCH_FILE_SIZE, stream.size());
+
+     randomSeed(1);
+     BenchStats reads;
+     BenchTimer total;
+     for (int i = 0; i < BENCH_RANDOM_OPS; i++) {
+         BenchTimer timer;
+         TEST_ASSERT_TRUE(stream.seek((uint64_t)random(blocks) * BENCH_RANDOM_BLOCK));
+         TEST_ASSERT_EQUAL(BENCH_RANDOM_BLOCK, stream.read(ioBuffer, BENCH_RANDOM_BLOCK));
+         reads.add(timer.elapsedUs());
+     }
+     int64_t us = total.elapsedUs();
+     stream.close();
+     benchReport("sd.rand_read", benchPerSecond(BENCH_RANDOM_OPS, us), "IOPS");
+     benchReport("sd.rand_read_bw", benchMBps((uint64_t)BENCH_RANDOM_OPS * BENCH_RANDOM_BLOCK, us), "MB/s");
+     benchReportLatency("sd.rand_read_lat", reads);
+
+     // "r+" keeps the file, every write goes to the card before the next seek
+     TEST_ASSERT_TRUE(stream.open(BENCH_FILE, "r+", 0));
+     BenchStats writes;
+     total.restart();
+     for (int i = 0; i < BENCH_RANDOM_OPS; i++) {
+         BenchTimer timer;
+         TEST_ASSERT_TRUE(stream.seek((uint64_t)random(blocks) * BENCH_RANDOM_BLOCK));
+         TEST_ASSERT_EQUAL(BENCH_RANDOM_BLOCK, stream.write(ioBuffer, BENCH_RANDOM_BLOCK));
+         TEST_ASSERT_TRUE(stream.flush());
+         writes.add(timer.elapsedUs());
+     }
+     us = total.elapsedUs();
+     stream.close();
+     benchReport("sd.rand_write", benchPerSecond(BENCH_RANDOM_OPS, us), "IOPS");
+     benchReport("sd.rand_write_bw", benchMBps((uint64_t)BENCH_RANDOM_OPS * BENCH_RANDOM_BLOCK, us), "MB/s");
+     benchReportLatency("sd.rand_write_lat", writes);
+ }
+
+ // Fill a directory with empty files unless an earlier run already did
+ static bool prepareListing(const std::string& dir, size_t count) {
+     std::vector<FSFileInfo> entries;
+     if (FSManager::list_directory(dir, entries) && entries.size() == count) {
+         return true;
+     }
+
+     TDECK_LOG_I("Creating %u files in %s, this takes a while once", (unsigned)count, dir.c_str());
+     FSManager::create_directory(dir);
+     char path[TDECK_FS_MAX_PATH_LENGTH];
+     for (size_t i = entries.size(); i < count; i++) {
+         snprintf(path, sizeof(path), "%s/f%05u.txt", dir.c_str(), (unsigned)i);
+         fs::File file = FSManager::open_file(path, FILE_WRITE);
+         if (!file) {
+             return false;
+         }
+         file.close();
+     }
+
+     entries.clear();
+     return FSManager::list_directory(dir, entries) && entries.size() == count;
+ }
+
+ // List a fixture directory with the metadata cache dropped and then from it
+ static void benchListing(const char* name, size_t count) {
+     char dir[32];
+     snprintf(dir, sizeof(dir), BENCH_DIR "/list%u", (unsigned)count);
+     TEST_ASSERT_TRUE_MESSAGE(prepareListing(dir, count), "Could not create the listing fixture");
+
+     std::vector<FSFileInfo> entries;
+     entries.reserve(count);
+     FSManager::invalidate_cache(dir);
+     BenchTimer timer;
+     TEST_ASSERT_TRUE(FSManager::list_directory(dir, entries));
+     int64_t cold = timer.elapsedUs();
+     TEST_ASSERT_EQUAL(count, entries.size());
+
+     entries.clear();
+     timer.restart();
+     TEST_ASSERT_TRUE(FSManager::list_directory(dir, entries));
+     int64_t warm = timer.elapsedUs();
+
+     char key[48];
+     snprintf(key, sizeof(key), "fs.list_%s.cold", name);
+     benchReport(key, cold / 1000.0, "ms");
+     snprintf(key, sizeof(key), "fs.list_%s.cold_rate", name);
+     benchReport(key, benchPerSecond(count, cold), "entries/s");
+     snprintf(key, sizeof(key), "fs.list_%s.cached", name);
+     benchReport(key, warm / 1000.0, "ms");
+ }
+
+ void test_fs_list_1k() {
+     if (requireSd()) {
+         benchListing("1k", 1000);
+     }
+ }
+
+ void test_fs_list_10k() {
+     if (requireSd()) {
+         benchListing("10k", 10000);
+     }
+ }
+
+ // Binary status payloads, compressed chat text and locations through the codec
+ void test_lora_codec() {
+     StaticJsonDocument<256> status;
+     status["battery"] = 87;
+     status["charging"] = false;
+     status["rssi"] = -92;
+     status["snr"] = 7.25f;
+     status["uptime"] = 123456;
+     status["name"] = "T-Deck";
+     status["mode"] = "relay";
+
+     uint8_t payload[LORA_MAX_PAYLOAD_LENGTH];
+     size_t length = 0;
+     BenchTimer timer;
+     for (int i = 0; i < BENCH_CODEC_RUNS; i++) {
+         length = LoRaCodec::encodeObject(status.as<JsonObjectConst>(), payload, sizeof(payload), "status");
+     }
+     int64_t us = timer.elapsedUs();
+     TEST_ASSERT_GREATER_THAN(0, length);
+     benchReport("lora.tlv_encode", benchPerSecond(BENCH_CODEC_RUNS, us), "ops/s");
+
+     uint32_t fields = 0;
+     timer.restart();
+     for (int i = 0; i < BENCH_CODEC_RUNS; i++) {
+         LoRaTlvReader reader(payload, length);
+         LoRaTlvField field;
+         while (reader.next(field)) {
+             fields++;
+         }
+         TEST_ASSERT_TRUE(reader.ok());
+     }
+     us = timer.elapsedUs();
+     TEST_ASSERT_EQUAL(BENCH_CODEC_RUNS * (status.size() + 1), fields);
+     benchReport("lora.tlv_decode", benchPerSecond(BENCH_CODEC_RUNS, us), "ops/s");
+
+     static const char text[] = "Hey, are you there? I will be at the meeting point in ten minutes, see you soon";
+     uint8_t compressed[sizeof(text)];
+     uint8_t expanded[sizeof(text)];
+     size_t packed = 0;
+     timer.restart();
+     for (int i = 0; i < BENCH_CODEC_RUNS; i++) {
+         packed = LoRaCodec::compressText((const uint8_t*)text, sizeof(text) - 1, compressed, sizeof(compressed));
+     }
+     us = timer.elapsedUs();
+     TEST_ASSERT_GREATER_THAN(0, packed);
+     benchReport("lora.text_compress", benchPerSecond(BENCH_CODEC_RUNS, us), "ops/s");
+     benchReport("lora.text_ratio", (double)packed / (sizeof(text) - 1), "ratio");
+
+     size_t unpacked = 0;
+     timer.restart();
+     for (int i = 0; i < BENCH_CODEC_RUNS; i++) {
+         unpacked = LoRaCodec::expandText(compressed, packed, expanded, sizeof(expanded));
+     }
+     us = timer.elapsedUs();
+     TEST_ASSERT_EQUAL(sizeof(text) - 1, unpacked);
+     TEST_ASSERT_EQUAL_MEMORY(text, expanded, unpacked);
+     benchReport("lora.text_expand", benchPerSecond(BENCH_CODEC_RUNS, us), "ops/s");
+
+     LoRaLocation location = {473977420, 85455940, 4080};
+     LoRaLocation decoded;
+     timer.restart();
+     for (int i = 0; i < BENCH_CODEC_RUNS; i++) {
+         length = LoRaCodec::encodeLocation(location, payload, sizeof(payload));
+         TEST_ASSERT_TRUE(LoRaCodec::decodeLocation(payload, length, decoded));
+     }
+     us = timer.elapsedUs();
+     TEST_ASSERT_EQUAL(location.latitude, decoded.latitude);
+     benchReport("lora.location_roundtrip", benchPerSecond(BENCH_CODEC_RUNS, us), "ops/s");
+ }
+
+ // Ping benchmark against TDECK_BENCH_LORA_PEER, radio airtime included
+ void test_lora_ping() {
+     if (TDECK_BENCH_LORA_PEER == 0) {
+         TEST_IGNORE_MESSAGE("Set TDECK_BENCH_LORA_PEER to a device ID to run the ping benchmark");
+         return;
+     }
+
+     if (!loraManager.isInitialized()) {
+         TEST_ASSERT_TRUE(loraManager.init());
+     }
+     TEST_ASSERT_TRUE(loraManager.startBenchmark(LORA_BENCH_MODE_PING, TDECK_BENCH_LORA_PEER,
+                                                 TDECK_LORA_BENCH_COUNT, TDECK_LORA_BENCH_SIZE));
+
+     LoRaBenchResult result;
+     uint32_t started = millis();
+     do {
+         delay(100);
+         loraManager.getBenchmark(result);
+     } while (result.running && millis() - started < BENCH_LORA_TIMEOUT_MS);
+     loraManager.stopBenchmark();
+     loraManager.getBenchmark(result);
+
+     TEST_ASSERT_GREATER_THAN_MESSAGE(0, result.received, "No pong from the peer");
+     benchReport("lora.ping_rtt.mean", (double)result.rttTotalMs / result.received, "ms");
+     benchReport("lora.ping_rtt.min", result.rttMinMs, "ms");
+     benchReport("lora.ping_rtt.max", result.rttMaxMs, "ms");
+     benchReport("lora.ping_loss", 100.0 * result.failed / max((uint16_t)1, result.sent), "%");
+ }
+
+ // A settings-sized document through the same paths as a config cache miss and write-back
+ void test_config_json() {
+     static const char* path = TDECK_FS_CONFIG_DIR "/bench.json";
+
+     TEST_ASSERT_TRUE(configStorage.init());
+     DynamicJsonDocument doc(2048);
+     for (int i = 0; i < 24; i++) {
+         doc[String("key") + i] = i * 31;
+         doc[String("name") + i] = "a configuration string value";
+     }
+
+     // Save: merge a changed key into the cache, then write the file back
+     BenchStats saves;
+     for (int i = 0; i < BENCH_CONFIG_RUNS; i++) {
+         doc["counter"] = i;
+         BenchTimer timer;
+         TEST_ASSERT_TRUE(configStorage.write(path, doc));
+         TEST_ASSERT_TRUE(configStorage.flush());
+         saves.add(timer.elapsedUs());
+     }
+     benchReportLatency("config.save", saves);
+
+     // Cold load: open and parse the file like a cache miss does
+     BenchStats loads;
+     for (int i = 0; i < BENCH_CONFIG_RUNS; i++) {
+         BenchTimer timer;
+         fs::File file = FSManager::open_file(path, FILE_READ);
+         TEST_ASSERT_TRUE(file);
+         DynamicJsonDocument loaded(max((size_t)file.size() * 2, (size_t)256));
+         TEST_ASSERT_EQUAL(DeserializationError::Ok, deserializeJson(loaded, file).code());
+         file.close();
+         loads.add(timer.elapsedUs());
+     }
+     benchReportLatency("config.load", loads);
+
+     // Cached load: what every later read costs
+     BenchStats cached;
+     DynamicJsonDocument copy(4096);
+     for (int i = 0; i < BENCH_CONFIG_RUNS; i++) {
+         BenchTimer timer;
+         TEST_ASSERT_TRUE(configStorage.read(path, copy));
+         cached.add(timer.elapsedUs());
+     }
+     benchReportLatency("config.load_cached", cached);
+
+     configStorage.remove(path);
+ }
+
+ // Resampling, gain and ADPCM on one mixer block, reported per buffer and as real-time load
+ void test_audio_dsp() {
+     const size_t frames = TDECK_AUDIO_MIXER_BLOCK;
+     const double blockUs = frames * 1000000.0 / TDECK_AUDIO_SAMPLE_RATE;
+     static int16_t input[TDECK_AUDIO_MIXER_BLOCK * 2];
+     static int16_t output[TDECK_AUDIO_MIXER_BLOCK * 2];
+     static uint8_t adpcm[TDECK_AUDIO_MIXER_BLOCK];
+     fillPattern((uint8_t*)input, sizeof(input), 7);
+
+     // 22.05 kHz mono 16-bit, the most common sound file rate that needs converting
+     AudioFormat source = {};
+     source.sampleRate = 22050;
+     source.channels = 1;
+     source.bitsPerSample = 16;
+     source.blockAlign = 2;
+     source.formatTag = WAV_FORMAT_PCM;
+
+     AudioResampler resampler;
+     resampler.begin(source, TDECK_AUDIO_SAMPLE_RATE);
+     size_t inputBytes = (frames * source.sampleRate / TDECK_AUDIO_SAMPLE_RATE + 1) * source.blockAlign;
+     BenchTimer timer;
+     for (int i = 0; i < BENCH_DSP_RUNS; i++) {
+         size_t consumed = 0;
+         resampler.process((const uint8_t*)input, inputBytes, consumed, output, frames);
+     }
+     double us = (double)timer.elapsedUs() / BENCH_DSP_RUNS;
+     benchReport("audio.resample", us, "us/buffer");
+     benchReport("audio.resample_load", 100.0 * us / blockUs, "%");
+
+     timer.restart();
+     for (int i = 0; i < BENCH_DSP_RUNS; i++) {
+         AudioDSP::applyGain(output, frames * 2, AudioDSP::volumeToGain(TDECK_SPEAKER_MAX_VOLUME / 2));
+     }
+     us = (double)timer.elapsedUs() / BENCH_DSP_RUNS;
+     benchReport("audio.gain", us, "us/buffer");
+     benchReport("audio.gain_load", 100.0 * us / blockUs, "%");
+
+     timer.restart();
+     for (int i = 0; i < BENCH_DSP_RUNS; i++) {
+         AdpcmState state = {0, 0};
+         for (size_t n = 0; n < frames; n += 2) {
+             adpcm[n / 2] = AudioDSP::adpcmEncode(input[n], state) | (AudioDSP::adpcmEncode(input[n + 1], state) << 4);
+         }
+     }
+     us = (double)timer.elapsedUs() / BENCH_DSP_RUNS;
+     benchReport("audio.adpcm_encode", us, "us/buffer");
+
+     timer.restart();
+     for (int i = 0; i < BENCH_DSP_RUNS; i++) {
+         AdpcmState state = {0, 0};
+         for (size_t n = 0; n < frames; n += 2) {
+             output[n] = AudioDSP::adpcmDecode(adpcm[n / 2] & 0x0F, state);
+             output[n + 1] = AudioDSP::adpcmDecode(adpcm[n / 2] >> 4, state);
+         }
+     }
+     us = (double)timer.elapsedUs() / BENCH_DSP_RUNS;
+     benchReport("audio.adpcm_decode", us, "us/buffer");
+ }
+
+ void setup() {
+     // The test runner opens the port after reset, give it time to attach
+     delay(2000);
+
+     spiBus.begin();
+     if (TDECK_FEATURE_SD_CARD) {
+         sdcard.begin();
+     }
+     FSManager::init();
+     sdReady = FSManager::is_sd_available();
+     if (sdReady) {
+         FSManager::create_directory(BENCH_DIR);
+     }
+
+     ioBuffer = (uint8_t*)heap_caps_malloc(BENCH_IO_CHUNK, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+     fillPattern(ioBuffer, BENCH_IO_CHUNK, 1);
+
+     UNITY_BEGIN();
+     RUN_TEST(test_display_flush);
+     RUN_TEST(test_sd_sequential);
+     RUN_TEST(test_sd_random);
+     RUN_TEST(test_fs_list_1k);
+     RUN_TEST(test_fs_list_10k);
+     RUN_TEST(test_lora_codec);
+     RUN_TEST(test_lora_ping);
+     RUN_TEST(test_config_json);
+     RUN_TEST(test_audio_dsp);
+     UNITY_END();
+ }
+
+ void loop() {
+     delay(1000);
+ }
@@ -0,0 +1,78 @@
+"""
+Collect the results of the on-device benchmarks, see test/test_bench.
+
+Capture the output of "pio test -e tdeck-bench" and turn it into CSV:
+
+    python tools/bench_report.py bench.log > bench-1.0.0.csv
+
+Or compare a run against an earlier one, flagging results that moved by
+more than the threshold in the worse direction:
+
+    python tools/bench_report.py bench.log --baseline bench-1.0.0.csv
+
+Units where a smaller value is better (time, load, loss) are recognised by
+name, everything else is a rate where larger is better.
+"""
+
+import argparse
+import csv
+import re
+import sys
+
+LINE = re.compile(r"BENCH,([^,]*),([^,]+),(-?[0-9.]+),(\S+)")
+
+LOWER_IS_BETTER = {"us", "ms", "us/buffer", "%", "ratio"}
+
+
+def read_results(path):
+    """{name: (version, value, unit)} of the last result of each benchmark in a log or CSV."""
+    results = {}
+    with open(path, encoding="utf-8", errors="replace") as log:
+        for text in log:
+            match = LINE.search(text)
+            if match:
+                version, name, value, unit = match.groups()
+                results[name] = (version, float(value), unit)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="serial log or CSV of a benchmark run")
+    parser.add_argument("--baseline", help="serial log or CSV of an earlier run to compare against")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent change reported as a regression (default 10)")
+    args = parser.parse_args()
+
+    results = read_results(args.log)
+    if not results:
+        sys.exit(f"No BENCH lines in {args.log}")
+
+    if not args.baseline:
+        writer = csv.writer(sys.stdout, lineterminator="\n")
+        for name, (version, value, unit) in results.items():
+            writer.writerow(["BENCH", version, name, f"{value:.3f}", unit])
+        return
+
+    baseline = read_results(args.baseline)
+    regressions = 0
+    print(f"{'benchmark':<32} {'before':>12} {'after':>12} {'change':>8}  unit")
+    for name, (_, value, unit) in results.items():
+        if name not in baseline:
+            print(f"{name:<32} {'':>12} {value:>12.3f} {'new':>8}  {unit}")
+            continue
+        before = baseline[name][1]
+        change = (value - before) / before * 100.0 if before else 0.0
+        worse = -change if unit not in LOWER_IS_BETTER else change
+        flag = ""
+        if worse > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<32} {before:>12.3f} {value:>12.3f} {change:>+7.1f}%  {unit}{flag}")
+
+    if regressions:
+        sys.exit(f"{regressions} regression(s) above {args.threshold:.0f}%")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+"""
+Make a delta patch that upgrades one T-Deck firmware image to another, see
+src/system/ota_delta.h for the patch layout.
+
+    python tools/make_delta.py old/firmware.bin new/firmware.bin firmware-1.1-from-1.0.tdp
+
+The device only applies a patch to the exact image it was made against, so
+publish it next to the full image in version.json and name the version it
+upgrades from; any other version, or a patch that fails, takes the full image:
+
+    {
+        "version": "1.1.0",
+        "url": "https://example.com/firmware-1.1.bin",
+        "md5": "...",
+        "sha256": "...",
+        "delta": {"from": "1.0.0", "url": "https://example.com/firmware-1.1-from-1.0.tdp"}
+    }
+
+Matching is bsdiff-like: runs of the new image are found in the old one and
+stored as the bytewise difference, which is mostly zeros where only
+addresses moved and compresses well.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = 0x50444454
+VERSION = 1
+HEADER = struct.Struct("<IB3xI32sI32s")
+
+OP_END, OP_COPY, OP_DIFF, OP_LITERAL = range(4)
+
+KEY = 8             # Bytes hashed to find match candidates
+STEP = 4            # Old image offsets indexed, instructions are 4 byte aligned at best
+CANDIDATES = 8      # Offsets kept per key
+MIN_MATCH = 32      # Shorter matches cost more than a literal
+
+
+def index(old):
+    table = {}
+    for offset in range(0, len(old) - KEY + 1, STEP):
+        offsets = table.setdefault(old[offset:offset + KEY], [])
+        if len(offsets) < CANDIDATES:
+            offsets.append(offset)
+    return table
+
+
+def extend(old, source, new, target):
+    """Length of the approximate match, where half the bytes or more agree."""
+    limit = min(len(old) - source, len(new) - target)
+    score = best = length = 0
+    for i in range(limit):
+        score += 1 if old[source + i] == new[target + i] else -1
+        if score > best:
+            best, length = score, i + 1
+        elif best - score > 64:
+            break
+    return length
+
+
+def diff(old, new):
+    table = index(old)
+    ops = bytearray()
+    literal = bytearray()
+    shift = None
+    target = 0
+
+    def flush_literal():
+        if literal:
+            ops.extend(struct.pack("<BI", OP_LITERAL, len(literal)))
+            ops.extend(literal)
+            literal.clear()
+
+    while target < len(new):
+        candidates = list(table.get(new[target:target + KEY], ()))
+        if shift is not None and 0 <= target + shift < len(old):
+            # The previous alignment first, code after a change is usually just moved
+            candidates.insert(0, target + shift)
+        source, length = 0, 0
+        for candidate in candidates:
+            found = extend(old, candidate, new, target)
+            if found > length:
+                source, length = candidate, found
+
+        if length < MIN_MATCH:
+            literal.append(new[target])
+            target += 1
+            continue
+
+        flush_literal()
+        before, after = old[source:source + length], new[target:target + length]
+        if before == after:
+            ops.extend(struct.pack("<BII", OP_COPY, source, length))
+        else:
+            ops.extend(struct.pack("<BII", OP_DIFF, source, length))
+            ops.extend((b - a) & 0xFF for a, b in zip(before, after))
+        shift = source - target
+        target += length
+
+    flush_literal()
+    ops.append(OP_END)
+    return bytes(ops)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="T-Deck delta firmware patch")
+    parser.add_argument("old", help="image the device is running")
+    parser.add_argument("new", help="image to upgrade to")
+    parser.add_argument("patch")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    header = HEADER.pack(MAGIC, VERSION, len(old), hashlib.sha256(old).digest(),
+                         len(new), hashlib.sha256(new).digest())
+    patch = header + zlib.compress(diff(old, new), 9)
+    with open(args.patch, "wb") as f:
+        f.write(patch)
+
+    print("%s: %d bytes, %.1f%% of the full image" %
+          (args.patch, len(patch), 100.0 * len(patch) / max(len(new), 1)), file=sys.stderr)
+    print("image sha256 %s" % hashlib.sha256(new).hexdigest(), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
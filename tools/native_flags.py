@@ -0,0 +1,8 @@
+"""
+PlatformIO extra script of the native environments: build_flags only reach
+the compiler, sanitizers and libFuzzer have to be linked in as well.
+"""
+
+Import("env")  # noqa: F821  (provided by PlatformIO)
+
+env.Append(LINKFLAGS=[flag for flag in env.get("CCFLAGS", []) if str(flag).startswith("-fsanitize")])  # noqa: F821
@@ -0,0 +1,366 @@
+"""
+Pack the fonts and icons listed in assets/assets.json into one image for the
+"assets" flash partition, see src/system/assets.h for the layout. Icons of an
+atlas are converted to one pixel format and stored back to back, so the
+firmware draws each one straight from the shared block.
+
+As a PlatformIO extra script it writes $BUILD_DIR/assets.bin after every
+firmware build and adds an "uploadassets" target that flashes it:
+
+    pio run -t uploadassets
+
+It also runs on its own:
+
+    python tools/pack_assets.py --lvgl .pio/libdeps/tdeck/lvgl --out assets.bin
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = 0x53414454  # "TDAS"
+VERSION = 1
+NAME_LENGTH = 20
+
+TYPE_IMAGE = 1
+TYPE_FONT = 2
+TYPE_ATLAS = 3
+
+IMAGE_RGB565 = 0
+IMAGE_RGB565A8 = 1
+
+HEADER = struct.Struct("<IHHII")
+ENTRY = struct.Struct("<20sB3xII")
+IMAGE = struct.Struct("<HHB3x")
+FONT = struct.Struct("<hhbbBxI")
+GLYPH = struct.Struct("<IIHBBbbH")
+ATLAS = struct.Struct("<HB1x")
+ATLAS_IMAGE = struct.Struct("<20sHHI")
+
+PARTITION_LABEL = "assets"
+
+
+class PackError(Exception):
+    pass
+
+
+def align(data, boundary=4):
+    """Pad a bytearray to the next multiple of boundary."""
+    data.extend(b"\0" * (-len(data) % boundary))
+
+
+# --- LVGL C fonts -----------------------------------------------------------
+
+def strip_comments(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    return re.sub(r"//[^\n]*", "", text)
+
+
+def c_array(text, name):
+    """Integers of a C array definition, None if the file has none."""
+    match = re.search(r"\b" + re.escape(name) + r"\s*\[\s*\]\s*=\s*\{(.*?)\};", text, re.S)
+    if not match:
+        return None
+    return [int(value, 0) for value in re.findall(r"-?(?:0x[0-9a-fA-F]+|\d+)", match.group(1))]
+
+
+def c_field(text, name, default=None):
+    match = re.search(r"\." + name + r"\s*=\s*(-?\w+)", text)
+    if not match:
+        if default is None:
+            raise PackError("missing ." + name)
+        return default
+    return int(match.group(1), 0)
+
+
+def parse_font(path):
+    """Glyphs and metrics of a font produced by lv_font_conv."""
+    text = strip_comments(open(path, encoding="utf-8").read())
+
+    if c_field(text, "bitmap_format", 0) != 0:
+        raise PackError(path + ": compressed fonts are not supported, regenerate with --no-compress")
+
+    bitmap = bytes(c_array(text, "glyph_bitmap"))
+    glyph_dsc = []
+    for entry in re.findall(r"\{\s*(\.bitmap_index[^}]*)\}", text):
+        glyph_dsc.append({key: int(value, 0) for key, value in re.findall(r"\.(\w+)\s*=\s*(-?\w+)", entry)})
+
+    # Map code points to glyph IDs through the character maps
+    glyph_ids = {}
+    cmaps = re.search(r"cmaps\s*\[\s*\]\s*=\s*\{(.*?)\};", text, re.S)
+    for cmap in re.findall(r"\{([^{}]*\.range_start[^{}]*)\}", cmaps.group(1)):
+        start = c_field(cmap, "range_start")
+        length = c_field(cmap, "range_length")
+        first_id = c_field(cmap, "glyph_id_start")
+        kind = re.search(r"\.type\s*=\s*LV_FONT_FMT_TXT_CMAP_(\w+)", cmap).group(1)
+        unicode_name = re.search(r"\.unicode_list\s*=\s*(\w+)", cmap).group(1)
+        offsets_name = re.search(r"\.glyph_id_ofs_list\s*=\s*(\w+)", cmap).group(1)
+        unicode_list = c_array(text, unicode_name) if unicode_name not in ("NULL", "0") else None
+        offsets = c_array(text, offsets_name) if offsets_name not in ("NULL", "0") else None
+
+        if kind == "FORMAT0_TINY":
+            for i in range(length):
+                glyph_ids[start + i] = first_id + i
+        elif kind == "FORMAT0_FULL":
+            for i in range(length):
+                if offsets[i]:
+                    glyph_ids[start + i] = first_id + offsets[i]
+        elif kind == "SPARSE_TINY":
+            for i, delta in enumerate(unicode_list):
+                glyph_ids[start + delta] = first_id + i
+        elif kind == "SPARSE_FULL":
+            for i, delta in enumerate(unicode_list):
+                glyph_ids[start + delta] = first_id + offsets[i]
+        else:
+            raise PackError(path + ": unknown character map " + kind)
+
+    bpp = c_field(text, "bpp")
+    glyphs = []
+    for codepoint in sorted(glyph_ids):
+        dsc = glyph_dsc[glyph_ids[codepoint]]
+        size = (dsc["box_w"] * dsc["box_h"] * bpp + 7) // 8
+        start = dsc["bitmap_index"]
+        glyphs.append((codepoint, dsc, bitmap[start:start + size]))
+
+    return {
+        "line_height": c_field(text, "line_height"),
+        "base_line": c_field(text, "base_line"),
+        "underline_position": c_field(text, "underline_position", 0),
+        "underline_thickness": c_field(text, "underline_thickness", 0),
+        "bpp": bpp,
+        "glyphs": glyphs,
+    }
+
+
+def pack_font(path):
+    font = parse_font(path)
+    table = bytearray()
+    bitmaps = bytearray()
+    for codepoint, dsc, bitmap in font["glyphs"]:
+        table += GLYPH.pack(codepoint, len(bitmaps), dsc["adv_w"], dsc["box_w"], dsc["box_h"],
+                            dsc["ofs_x"], dsc["ofs_y"], 0)
+        bitmaps += bitmap
+
+    data = bytearray(FONT.pack(font["line_height"], font["base_line"], font["underline_position"],
+                               font["underline_thickness"], font["bpp"], len(font["glyphs"])))
+    return data + table + bitmaps
+
+
+# --- PNG icons --------------------------------------------------------------
+
+def read_png(path):
+    """Width, height and RGBA rows of an 8-bit RGB or RGBA PNG."""
+    data = open(path, "rb").read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise PackError(path + ": not a PNG file")
+
+    pos = 8
+    idat = bytearray()
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        if kind == b"IHDR":
+            width, height, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", chunk)
+        elif kind == b"IDAT":
+            idat += chunk
+        pos += 12 + length
+
+    if depth != 8 or color not in (2, 6) or interlace:
+        raise PackError(path + ": only 8-bit RGB and RGBA PNGs without interlacing are supported")
+
+    channels = 4 if color == 6 else 3
+    stride = width * channels
+    raw = zlib.decompress(bytes(idat))
+    rows = []
+    previous = bytearray(stride)
+    for y in range(height):
+        line = raw[y * (stride + 1):(y + 1) * (stride + 1)]
+        kind, row = line[0], bytearray(line[1:])
+        for x in range(stride):
+            left = row[x - channels] if x >= channels else 0
+            up = previous[x]
+            corner = previous[x - channels] if x >= channels else 0
+            if kind == 1:
+                row[x] = (row[x] + left) & 0xFF
+            elif kind == 2:
+                row[x] = (row[x] + up) & 0xFF
+            elif kind == 3:
+                row[x] = (row[x] + ((left + up) >> 1)) & 0xFF
+            elif kind == 4:
+                p = left + up - corner
+                pa, pb, pc = abs(p - left), abs(p - up), abs(p - corner)
+                predictor = left if pa <= pb and pa <= pc else (up if pb <= pc else corner)
+                row[x] = (row[x] + predictor) & 0xFF
+        rows.append([tuple(row[x:x + channels]) + ((255,) if channels == 3 else ())
+                     for x in range(0, stride, channels)])
+        previous = row
+    return width, height, rows
+
+
+def has_alpha(rows):
+    return any(pixel[3] != 255 for row in rows for pixel in row)
+
+
+def pixels(rows, alpha):
+    """RGB565 pixels of RGBA rows, each followed by its alpha byte if alpha is set."""
+    data = bytearray()
+    for row in rows:
+        for r, g, b, a in row:
+            # LV_COLOR_16_SWAP is off, so pixels are stored little endian
+            data += struct.pack("<H", ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3))
+            if alpha:
+                data.append(a)
+    return data
+
+
+def pack_image(path):
+    width, height, rows = read_png(path)
+    alpha = has_alpha(rows)
+    data = bytearray(IMAGE.pack(width, height, IMAGE_RGB565A8 if alpha else IMAGE_RGB565))
+    return data + pixels(rows, alpha)
+
+
+def pack_atlas(name, images):
+    """One pixel block holding every (name, path) image in the same format."""
+    decoded = []
+    for image_name, path in images:
+        if len(image_name) >= NAME_LENGTH:
+            raise PackError(image_name + ": image names are limited to %d characters" % (NAME_LENGTH - 1))
+        decoded.append((image_name, read_png(path)))
+    if not decoded:
+        raise PackError(name + ": atlas has no images")
+
+    # One icon with transparency makes the whole atlas carry alpha
+    alpha = any(has_alpha(rows) for _, (_, _, rows) in decoded)
+    table = bytearray()
+    block = bytearray()
+    for image_name, (width, height, rows) in decoded:
+        table += ATLAS_IMAGE.pack(image_name.encode(), width, height, len(block))
+        block += pixels(rows, alpha)
+        align(block)
+
+    data = bytearray(ATLAS.pack(len(decoded), IMAGE_RGB565A8 if alpha else IMAGE_RGB565))
+    return data + table + block
+
+
+# --- Image ------------------------------------------------------------------
+
+def pack(manifest_path, lvgl_dir):
+    """Build the partition image from a manifest."""
+    manifest = json.load(open(manifest_path, encoding="utf-8"))
+    base = os.path.dirname(os.path.abspath(manifest_path))
+
+    def check_name(name):
+        if len(name) >= NAME_LENGTH:
+            raise PackError(name + ": asset names are limited to %d characters" % (NAME_LENGTH - 1))
+
+    def source_path(item):
+        """Path of an item's source, None after reporting it missing."""
+        source = item["source"].replace("$LVGL", lvgl_dir)
+        source = source if os.path.isabs(source) else os.path.join(base, source)
+        if not os.path.exists(source):
+            # The firmware keeps its built-in copy of anything missing here
+            print("pack_assets: %s not found, skipping %s" % (source, item["name"]))
+            return None
+        return source
+
+    assets = []
+    for kind, packer, items in ((TYPE_FONT, pack_font, manifest.get("fonts", [])),
+                                (TYPE_IMAGE, pack_image, manifest.get("images", []))):
+        for item in items:
+            check_name(item["name"])
+            source = source_path(item)
+            if source:
+                assets.append((item["name"], kind, packer(source)))
+
+    for atlas in manifest.get("atlases", []):
+        check_name(atlas["name"])
+        images = [(item["name"], source) for item in atlas["images"] for source in [source_path(item)] if source]
+        if images:
+            assets.append((atlas["name"], TYPE_ATLAS, pack_atlas(atlas["name"], images)))
+
+    # The firmware binary searches the table by name
+    assets.sort(key=lambda asset: asset[0].encode())
+
+    offset = HEADER.size + ENTRY.size * len(assets)
+    table = bytearray()
+    body = bytearray()
+    for name, kind, data in assets:
+        table += ENTRY.pack(name.encode(), kind, offset + len(body), len(data))
+        body += data
+        align(body)
+
+    image = bytearray(HEADER.pack(MAGIC, VERSION, len(assets), offset + len(body), 0))
+    return image + table + body
+
+
+def partition(partitions_path, label=PARTITION_LABEL):
+    """Offset and size of a partition in a partition table CSV."""
+    with open(partitions_path, encoding="utf-8") as table:
+        for row in csv.reader(line for line in table if not line.lstrip().startswith("#")):
+            row = [field.strip() for field in row]
+            if row and row[0] == label:
+                return int(row[3], 0), int(row[4], 0)
+    raise PackError("%s: no %s partition" % (partitions_path, label))
+
+
+def write(image, out_path, partitions_path):
+    _, size = partition(partitions_path)
+    if len(image) > size:
+        raise PackError("assets need %d bytes, the partition holds %d" % (len(image), size))
+    with open(out_path, "wb") as out:
+        out.write(image)
+    print("pack_assets: %s, %d of %d bytes" % (out_path, len(image), size))
+
+
+# --- PlatformIO -------------------------------------------------------------
+
+def platformio():
+    Import("env")  # noqa: F821, provided by SCons
+
+    project = env.subst("$PROJECT_DIR")
+    manifest = os.path.join(project, "assets", "assets.json")
+    partitions = os.path.join(project, env.GetProjectOption("board_build.partitions"))
+    lvgl = env.subst("$PROJECT_LIBDEPS_DIR/$PIOENV/lvgl")
+    out = env.subst("$BUILD_DIR/assets.bin")
+
+    def build(*_args, **_kwargs):
+        write(pack(manifest, lvgl), out, partitions)
+
+    def upload(*_args, **_kwargs):
+        build()
+        env.AutodetectUploadPort()
+        offset, _ = partition(partitions)
+        env.Execute(env.VerboseAction(
+            '"$PYTHONEXE" "$UPLOADER" --chip esp32s3 --port "$UPLOAD_PORT" --baud $UPLOAD_SPEED '
+            'write_flash 0x%x "%s"' % (offset, out), "Uploading assets"))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", build)
+    env.AddCustomTarget("uploadassets", None, upload, title="Upload Assets",
+                        description="Pack fonts and icons and flash the asset partition")
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description="Pack fonts and icons for the asset partition")
+    parser.add_argument("--manifest", default=os.path.join(root, "assets", "assets.json"))
+    parser.add_argument("--partitions", default=os.path.join(root, "partitions.csv"))
+    parser.add_argument("--lvgl", default=os.path.join(root, ".pio", "libdeps", "tdeck", "lvgl"))
+    parser.add_argument("--out", default="assets.bin")
+    args = parser.parse_args()
+
+    try:
+        write(pack(args.manifest, args.lvgl), args.out, args.partitions)
+    except PackError as error:
+        sys.exit("pack_assets: %s" % error)
+
+
+if __name__ == "__main__":
+    main()
+else:
+    platformio()
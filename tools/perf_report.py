@@ -0,0 +1,81 @@
+"""
+Total the PC samples of the terminal's perf command per function, see
+src/system/task_profiler.h.
+
+On the device run "perf start", the workload, "perf stop" and "perf dump",
+capturing the serial port, then:
+
+    python tools/perf_report.py serial.log .pio/build/tdeck/firmware.elf
+
+Buckets are TDECK_PROFILER_PC_GRANULE bytes, so a bucket that straddles two
+small functions is charged to the one at its start.
+"""
+
+import argparse
+import collections
+import re
+import shutil
+import subprocess
+import sys
+
+LINE = re.compile(r"PERF (\d+) ([0-9a-fA-F]{8}) (\d+)")
+TOTAL = re.compile(r"PERF total (\d+)")
+
+ADDR2LINE = "xtensa-esp32s3-elf-addr2line"
+
+
+def read_dump(path):
+    """(core, pc, count) samples and the total of the last dump in a log."""
+    samples = []
+    total = 0
+    with open(path, encoding="utf-8", errors="replace") as log:
+        for text in log:
+            match = TOTAL.search(text)
+            if match:
+                total = int(match.group(1))
+                continue
+            match = LINE.search(text)
+            if match:
+                samples.append((int(match.group(1)), int(match.group(2), 16), int(match.group(3))))
+    return samples, total
+
+
+def resolve(elf, pcs, tool):
+    """Function name of each PC."""
+    output = subprocess.run([tool, "-f", "-C", "-e", elf] + ["0x%08x" % pc for pc in pcs],
+                            check=True, capture_output=True, text=True).stdout.splitlines()
+    # Two lines per address: the function, then file:line
+    return {pc: output[i * 2] for i, pc in enumerate(pcs)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-function totals of a T-Deck perf dump")
+    parser.add_argument("log", help="serial output holding a perf dump")
+    parser.add_argument("elf", help="firmware.elf of the running build")
+    parser.add_argument("--top", type=int, default=30, help="functions to list")
+    parser.add_argument("--addr2line", default=ADDR2LINE)
+    args = parser.parse_args()
+
+    samples, total = read_dump(args.log)
+    if not samples:
+        sys.exit("perf_report: %s has no perf dump" % args.log)
+    if not shutil.which(args.addr2line):
+        sys.exit("perf_report: %s not found, add the toolchain to PATH" % args.addr2line)
+
+    names = resolve(args.elf, sorted({pc for _, pc, _ in samples}), args.addr2line)
+    functions = collections.Counter()
+    cores = collections.defaultdict(set)
+    for core, pc, count in samples:
+        functions[names[pc]] += count
+        cores[names[pc]].add(core)
+
+    # Samples that found the histogram full are in the total but in no bucket
+    total = max(total, sum(functions.values()))
+    print("%6s  %8s  %5s  %s" % ("share", "samples", "cores", "function"))
+    for name, count in functions.most_common(args.top):
+        print("%5.1f%%  %8d  %5s  %s" % (100.0 * count / total, count,
+                                         ",".join(str(core) for core in sorted(cores[name])), name))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,318 @@
+"""
+Copy files to and from the T-Deck over USB with the framed binary protocol,
+see src/comms/usb.h for the frame layout.
+
+    python tools/usb_transfer.py /dev/ttyACM0 get /sd/logs/boot.log boot.log
+    python tools/usb_transfer.py /dev/ttyACM0 put photo.jpg /sd/photos/photo.jpg
+    python tools/usb_transfer.py /dev/ttyACM0 sync provision/ /sd
+
+sync compares the SHA-256 of every chunk of every local file with the
+device's copy and sends only the chunks that differ, so an unchanged tree
+costs one hash pass on the device and no data.
+
+Needs pyserial.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+MAGIC = b"\xa5\x5a"
+HEADER = struct.Struct("<2sBxII")
+CRC = struct.Struct("<I")
+
+(OPEN_READ, OPEN_WRITE, OPEN_ACK, DATA, ACK, NACK, DONE, ERROR, ABORT, EXIT,
+ HASH, HASHES, PATCH) = range(1, 14)
+
+HASH_SIZE = 32
+
+ACK_TIMEOUT = 0.5
+TRANSFER_TIMEOUT = 10.0
+
+
+class TransferError(Exception):
+    pass
+
+
+class Link:
+    """Frames over a CDC port, resynchronising on the magic after a bad frame."""
+
+    def __init__(self, port):
+        self.port = serial.Serial(port, timeout=0.05)
+        self.buffer = bytearray()
+        self.bad_frames = 0
+
+    def enter_binary(self):
+        self.port.reset_input_buffer()
+        self.port.write(b"BINARY\n")
+        deadline = time.monotonic() + 2
+        while time.monotonic() < deadline:
+            line = self.port.readline().decode(errors="replace").strip()
+            if line.startswith("OK: BINARY"):
+                version, self.chunk, self.window = (int(field) for field in line.split()[2:5])
+                return version
+            if line.startswith("ERROR:"):
+                raise TransferError(line)
+        raise TransferError("device did not enter binary mode")
+
+    def send(self, kind, seq=0, payload=b""):
+        header = HEADER.pack(MAGIC, kind, seq, len(payload))
+        crc = zlib.crc32(payload, zlib.crc32(header[2:]))
+        self.port.write(header + payload + CRC.pack(crc))
+
+    def receive(self, timeout):
+        """Next good frame as (kind, seq, payload), None on timeout."""
+        deadline = time.monotonic() + timeout
+        while True:
+            frame = self._parse()
+            if frame:
+                return frame
+            if time.monotonic() > deadline:
+                return None
+            self.buffer += self.port.read(max(1, self.port.in_waiting))
+
+    def _parse(self):
+        while True:
+            start = self.buffer.find(MAGIC)
+            if start < 0:
+                del self.buffer[:-1]
+                return None
+            del self.buffer[:start]
+            if len(self.buffer) < HEADER.size:
+                return None
+
+            _, kind, seq, length = HEADER.unpack_from(self.buffer)
+            total = HEADER.size + length + CRC.size
+            if length > 1 << 20:
+                self.bad_frames += 1
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < total:
+                return None
+
+            payload = bytes(self.buffer[HEADER.size:HEADER.size + length])
+            (crc,) = CRC.unpack_from(self.buffer, HEADER.size + length)
+            if zlib.crc32(self.buffer[2:HEADER.size + length]) != crc:
+                self.bad_frames += 1
+                del self.buffer[:1]
+                continue
+
+            del self.buffer[:total]
+            return kind, seq, payload
+
+
+def expect_open(link):
+    frame = link.receive(TRANSFER_TIMEOUT)
+    if not frame:
+        raise TransferError("no reply to open")
+    kind, _, payload = frame
+    if kind == ERROR:
+        raise TransferError(payload.decode(errors="replace"))
+    if kind != OPEN_ACK:
+        raise TransferError("unexpected frame %d" % kind)
+    size, chunk, window = struct.unpack_from("<QIH", payload)
+    return size, chunk, window
+
+
+def check_done(payload, crc):
+    (device_crc,) = CRC.unpack_from(payload)
+    if device_crc != crc:
+        raise TransferError("CRC mismatch: device %08x, host %08x" % (device_crc, crc))
+
+
+def get(link, remote, local):
+    link.send(OPEN_READ, 0, remote.encode())
+    size, chunk, window = expect_open(link)
+    count = (size + chunk - 1) // chunk
+
+    received = {}
+    nacked = set()
+    expected = 0
+    crc = 0
+    last_progress = time.monotonic()
+    with open(local, "wb") as out:
+        while True:
+            frame = link.receive(ACK_TIMEOUT)
+            now = time.monotonic()
+            if frame is None:
+                if now - last_progress > TRANSFER_TIMEOUT:
+                    raise TransferError("transfer timeout")
+                # Ask for the chunk the file is waiting on again
+                if expected < count:
+                    link.send(NACK, expected)
+                continue
+
+            kind, seq, payload = frame
+            if kind == ERROR:
+                raise TransferError(payload.decode(errors="replace"))
+            if kind == DONE:
+                check_done(payload, crc)
+                return size
+            if kind != DATA or seq < expected:
+                if kind == DATA:
+                    link.send(ACK, expected)
+                continue
+
+            received[seq] = payload
+            # Selective repeat: ask once for each chunk skipped over
+            for missing in range(expected, seq):
+                if missing not in received and missing not in nacked:
+                    nacked.add(missing)
+                    link.send(NACK, missing)
+
+            advanced = False
+            while expected in received:
+                data = received.pop(expected)
+                out.write(data)
+                crc = zlib.crc32(data, crc)
+                nacked.discard(expected)
+                expected += 1
+                advanced = True
+            if advanced:
+                last_progress = now
+                link.send(ACK, expected)
+            print("\r%d / %d KB" % (min(expected * chunk, size) // 1024, size // 1024), end="", file=sys.stderr)
+
+
+def put(link, local, remote, keep=()):
+    """Send a file, chunks in keep are copied from the device's own copy instead."""
+    data = open(local, "rb").read()
+    link.send(PATCH if keep else OPEN_WRITE, 0, struct.pack("<Q", len(data)) + remote.encode())
+    _, chunk, window = expect_open(link)
+    count = (len(data) + chunk - 1) // chunk
+    crc = zlib.crc32(data)
+
+    def send_chunk(seq):
+        link.send(DATA, seq, b"" if seq in keep else data[seq * chunk:(seq + 1) * chunk])
+
+    base = 0
+    next_seq = 0
+    last_progress = time.monotonic()
+    while True:
+        while next_seq < count and next_seq - base < window:
+            send_chunk(next_seq)
+            next_seq += 1
+
+        frame = link.receive(ACK_TIMEOUT)
+        now = time.monotonic()
+        if frame is None:
+            if now - last_progress > TRANSFER_TIMEOUT:
+                raise TransferError("transfer timeout")
+            if base < next_seq:
+                send_chunk(base)
+            continue
+
+        kind, seq, payload = frame
+        if kind == ERROR:
+            raise TransferError(payload.decode(errors="replace"))
+        if kind == DONE:
+            check_done(payload, crc)
+            return len(data)
+        if kind == ACK and seq > base:
+            base = seq
+            last_progress = now
+        elif kind == NACK and base <= seq < next_seq:
+            send_chunk(seq)
+        print("\r%d / %d KB" % (min(base * chunk, len(data)) // 1024, len(data) // 1024), end="", file=sys.stderr)
+
+
+def chunk_hashes(data, chunk):
+    return [hashlib.sha256(data[offset:offset + chunk]).digest() for offset in range(0, len(data), chunk)]
+
+
+def device_hashes(link, remote):
+    """(size, chunk digests) of the device's copy, None if it has none."""
+    link.send(HASH, 0, remote.encode())
+    size = None
+    digests = []
+    while True:
+        frame = link.receive(TRANSFER_TIMEOUT)
+        if not frame:
+            raise TransferError("no reply to hash")
+        kind, seq, payload = frame
+        if kind == ERROR:
+            message = payload.decode(errors="replace")
+            if message == "File not found":
+                return None
+            raise TransferError(message)
+        if kind == HASHES and seq == len(digests):
+            (size,) = struct.unpack_from("<Q", payload)
+            digests += [payload[offset:offset + HASH_SIZE] for offset in range(8, len(payload), HASH_SIZE)]
+        elif kind == DONE:
+            if size is None or seq != len(digests):
+                raise TransferError("incomplete hash list")
+            return size, digests
+
+
+def sync(link, local_root, remote_root):
+    """Bring remote_root up to date with local_root, returns (bytes sent, bytes in the tree)."""
+    sent = 0
+    total = 0
+    for directory, _, files in sorted(os.walk(local_root)):
+        for name in sorted(files):
+            local = os.path.join(directory, name)
+            relative = os.path.relpath(local, local_root).replace(os.sep, "/")
+            remote = remote_root.rstrip("/") + "/" + relative
+            data = open(local, "rb").read()
+            total += len(data)
+
+            # Host manifest entry against the device's chunk digests
+            wanted = chunk_hashes(data, link.chunk)
+            existing = device_hashes(link, remote)
+            if existing and existing[0] == len(data) and existing[1] == wanted:
+                print("= %s" % relative, file=sys.stderr)
+                continue
+
+            # Equal digests mean equal chunks, lengths included
+            keep = set()
+            if existing:
+                keep = {seq for seq, digest in enumerate(wanted[:len(existing[1])]) if existing[1][seq] == digest}
+            changed = [seq for seq in range(len(wanted)) if seq not in keep]
+            print("%s %s (%d of %d chunks)" % ("~" if existing else "+", relative, len(changed), len(wanted)),
+                  file=sys.stderr)
+            put(link, local, remote, keep)
+            print(file=sys.stderr)
+            sent += sum(len(data[seq * link.chunk:(seq + 1) * link.chunk]) for seq in changed)
+    return sent, total
+
+
+def main():
+    parser = argparse.ArgumentParser(description="T-Deck USB file transfer")
+    parser.add_argument("port")
+    parser.add_argument("command", choices=("get", "put", "sync"))
+    parser.add_argument("source")
+    parser.add_argument("destination", nargs="?")
+    args = parser.parse_args()
+
+    destination = args.destination or os.path.basename(args.source)
+    link = Link(args.port)
+    try:
+        link.enter_binary()
+        started = time.monotonic()
+        if args.command == "sync":
+            if not args.destination:
+                parser.error("sync needs a device directory")
+            sent, size = sync(link, args.source, args.destination)
+            print("%d of %d bytes sent" % (sent, size), file=sys.stderr)
+        elif args.command == "get":
+            size = get(link, args.source, destination)
+        else:
+            size = put(link, args.source, destination)
+        elapsed = max(time.monotonic() - started, 1e-3)
+        print("\n%d bytes in %.2f s, %.0f KB/s, %d bad frames" %
+              (size, elapsed, size / elapsed / 1024, link.bad_frames), file=sys.stderr)
+    except TransferError as error:
+        link.send(ABORT)
+        sys.exit("\nusb_transfer: %s" % error)
+    finally:
+        link.send(EXIT)
+
+
+if __name__ == "__main__":
+    main()